@@ -4,7 +4,7 @@
 
 TEMPLATE = subdirs
 
-SUBDIRS = engine mediator common qdoas convolution ring usamp cmdline
+SUBDIRS = engine mediator common qdoas convolution ring usamp cmdline benchmark binmatrix
 
 CONFIG += ordered
 
@@ -0,0 +1,722 @@
+/* Copyright (C) 2017 Royal Belgian Institute for Space Aeronomy
+ * (BIRA-IASB)
+ *
+ * BIRA-IASB
+ * Ringlaan 3 Avenue Circulaire
+ * 1180 Uccle
+ * Belgium
+ * qdoas@aeronomie.be
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// Benchmark of the numerical core of the DOAS fit on synthetic spectra.
+//
+// High resolution cross sections and a solar spectrum are generated on a
+// regular grid and convolved with a Gaussian slit function
+// (XSCONV_TypeStandard).  Spectra are then simulated with known slant
+// columns, a polynomial and a shift/stretch of the wavelength
+// calibration.  For each spectrum, the benchmark realigns the spectrum on
+// the reference grid (SPLINE_Deriv2, SPLINE_Vector) and solves the linear
+// DOAS fit with QR (LINEAR_decompose/LINEAR_solve) and SVD (SVD_Dcmp).
+//
+// The same spectra are then analysed by the engine (ANALYSE_Spectrum) in an
+// analysis window set up in memory, with the shift and the stretch fitted
+// non linearly by Curfit.  Curfit is also timed alone, on the state left by
+// the analysis of the spectrum.
+//
+// Spectra are finally calibrated (KURUCZ_Spectrum) in a calibration window
+// with a fixed non linear offset, once with the sub-windows fitted by two
+// threads and once with more threads.  Every sub-window is then fitted from
+// the same initial values, so the new wavelength grids must be identical (the
+// default serial fit, which starts each sub-window from the values found in
+// the previous one, is not compared).
+//
+// For each stage, the benchmark reports the number of calls, latency
+// percentiles and the number of MEMORY_AllocBuffer calls per call;
+// finally the throughput in spectra per second and the largest relative
+// error on the retrieved slant columns.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "comdefs.h"
+#include "matrix.h"
+#include "spline.h"
+#include "xsconv.h"
+
+extern "C" {
+#include "winthrd.h"
+#include "engine_context.h"
+#include "engine.h"
+#include "analyse.h"
+#include "curfit.h"
+#include "kurucz.h"
+#include "vector.h"
+#include "linear_system.h"
+}
+
+using std::vector;
+
+namespace {
+
+  const int N_SPECIES = 4;                                                      // number of synthetic absorbers
+  const int POLY_ORDER = 3;
+
+  const double LAMBDA_MIN = 320.;                                               // nm
+  const double LAMBDA_MAX = 400.;
+  const double HR_STEP = 0.01;                                                  // step of the high resolution grid
+  const double FWHM = 0.5;                                                      // width of the Gaussian slit function
+  const double SHIFT = 0.02;                                                    // shift and stretch of the simulated spectra
+  const double STRETCH = 1.e-4;
+  const double NOISE = 1.e-4;                                                   // relative noise on the simulated spectra
+  const double FIT_MARGIN = 2.;                                                 // fitting window of ANALYSE_Spectrum inside the detector grid (nm)
+  const int CALIB_WINDOWS = 8;                                                  // sub-windows of the wavelength calibration
+  const int CALIB_THREADS = 4;                                                  // threads compared to two threads for the calibration
+
+  // slant columns and band positions of the synthetic absorbers
+  const double slant_columns[N_SPECIES] = { 1.e17, 5.e17, 2.e17, 1.e18 };
+  const double band_step[N_SPECIES] = { 2.5, 4.1, 1.3, 7.7 };
+
+  struct stage {
+    std::string name;
+    vector<double> latencies;                                                   // microseconds
+    long allocations;
+
+    explicit stage(const char *n) : name(n), allocations(0) {}
+  };
+
+  // time a call of f and count the buffers it allocates through MEMORY_AllocBuffer
+  template<typename F>
+  RC timed(stage& s, F f) {
+    long allocations_before, allocations_after;
+
+    MEMORY_GetStatistics(&allocations_before, NULL, NULL);
+    const auto start = std::chrono::steady_clock::now();
+    const RC rc = f();
+    const auto stop = std::chrono::steady_clock::now();
+    MEMORY_GetStatistics(&allocations_after, NULL, NULL);
+
+    s.latencies.push_back(std::chrono::duration<double, std::micro>(stop - start).count());
+    s.allocations += allocations_after - allocations_before;
+    return rc;
+  }
+
+  double percentile(const vector<double>& sorted, double p) {
+    if (sorted.empty())
+      return 0.;
+    const size_t i = std::min(sorted.size() - 1, (size_t)(p * sorted.size()));
+    return sorted[i];
+  }
+
+  void report(const stage& s) {
+    vector<double> sorted(s.latencies);
+    std::sort(sorted.begin(), sorted.end());
+
+    const size_t n = sorted.size();
+    printf("%-12s %8zu %10.1f %10.1f %10.1f %10.1f %10.2f\n", s.name.c_str(), n,
+           percentile(sorted, 0.5), percentile(sorted, 0.9), percentile(sorted, 0.99),
+           n ? sorted.back() : 0., n ? (double)s.allocations / n : 0.);
+  }
+
+  // synthetic absorption bands: a comb of Gaussian lines modulated by a slow envelope
+  double synthetic_xs(int species, double lambda) {
+    const double step = band_step[species];
+    const double phase = (lambda - LAMBDA_MIN) / step;
+    const double offset = (phase - std::floor(phase) - 0.5) * step;
+    const double width = 0.15 * step;
+
+    return 1.e-19 / (1. + species) * (1.2 + std::sin(0.05 * lambda * (species + 1))) * std::exp(-offset * offset / (2. * width * width));
+  }
+
+  // synthetic solar spectrum: smooth continuum with Fraunhofer-like lines
+  double synthetic_solar(double lambda) {
+    const double phase = (lambda - LAMBDA_MIN) / 0.73;
+    const double offset = (phase - std::floor(phase) - 0.5) * 0.73;
+
+    return 1.e14 * (1. + 0.002 * (lambda - LAMBDA_MIN)) * (1. - 0.6 * std::exp(-offset * offset / 0.002));
+  }
+
+  // cross sections, put in the workspace so that ANALYSE_LoadCross finds them instead of loading a file
+  RC load_cross_sections(const vector<double>& lambda, const vector<vector<double> >& xs) {
+    const int n_wavel = (int)lambda.size();
+    RC rc;
+
+    for (int k = 0; k < N_SPECIES; ++k) {
+      WRK_SYMBOL *symbol = &WorkSpace[NWorkSpace];
+
+      symbol->type = WRK_SYMBOL_CROSS;
+      sprintf(symbol->symbolName, "xs%d", k + 1);
+      sprintf(symbol->crossFileName, "synthetic_xs%d", k + 1);
+
+      if ((rc = MATRIX_Allocate(&symbol->xs, n_wavel, 2, 0, 0, 0, __func__)) != ERROR_ID_NO)
+        return rc;
+
+      std::copy(lambda.begin(), lambda.end(), symbol->xs.matrix[0]);
+      std::copy(xs[k].begin(), xs[k].end(), symbol->xs.matrix[1]);
+      NWorkSpace++;
+    }
+
+    return ERROR_ID_NO;
+  }
+
+  // analysis window set up in memory as mediateRequestLoadAnalysisRow sets it up from the project :
+  // cross sections already on the grid of the reference, polynomial, shift and stretch of the spectrum.
+  // The calibration window (hidden) has no gaps and a fixed non linear offset of order 1.
+  RC load_analysis_window(ENGINE_CONTEXT *engine, const vector<double>& lambda, const double *solar,
+                          double fit_min, double fit_max, bool calibration) {
+    const int n_wavel = (int)lambda.size();
+    FENO *feno = &TabFeno[0][NFeno];
+    vector<ANALYSIS_CROSS> cross(N_SPECIES);
+    ANALYSE_LINEAR_PARAMETERS linear[2];
+    ANALYSE_NON_LINEAR_PARAMETERS offset;
+    ANALYSIS_SHIFT_STRETCH shift_stretch;
+    RC rc;
+
+    for (int k = 0; k < N_SPECIES; ++k) {
+      memset(&cross[k], 0, sizeof(cross[k]));
+      sprintf(cross[k].symbol, "xs%d", k + 1);
+      sprintf(cross[k].crossSectionFile, "synthetic_xs%d", k + 1);
+      strcpy(cross[k].orthogonal, "None");
+      cross[k].crossType = ANLYS_CROSS_ACTION_NOTHING;
+      cross[k].amfType = ANLYS_AMF_TYPE_NONE;
+      cross[k].correctionType = ANLYS_CORRECTION_TYPE_NONE;
+      cross[k].requireCcFit = 1;
+    }
+
+    memset(linear, 0, sizeof(linear));
+    strcpy(linear[0].symbolName, "Polynomial (x)");
+    linear[0].polyOrder = linear[0].baseOrder = POLY_ORDER;
+    strcpy(linear[1].symbolName, "Offset (rad)");
+    linear[1].polyOrder = linear[1].baseOrder = -1;
+
+    memset(&offset, 0, sizeof(offset));
+    strcpy(offset.symbolName, "Offset (Order 1)");
+    offset.initialValue = 1.e-3;                                                // not fitted
+    offset.deltaValue = 1.e-3;
+
+    memset(&shift_stretch, 0, sizeof(shift_stretch));
+    shift_stretch.nSymbol = 1;
+    strcpy(shift_stretch.symbol[0], "Spectrum");
+    shift_stretch.shFit = ANLYS_SHIFT_TYPE_NONLINEAR;
+    shift_stretch.stFit = ANLYS_STRETCH_TYPE_FIRST_ORDER;
+    shift_stretch.shDelta = shift_stretch.stDelta = shift_stretch.stDelta2 = 1.e-3;
+    shift_stretch.shMin = -1.;
+    shift_stretch.shMax = 1.;
+
+    // the reference is the solar spectrum
+
+    strcpy(feno->windowName, calibration ? "Calibration description" : "benchmark");
+    feno->hidden = calibration;
+    feno->gomeRefFlag = 1;
+    feno->useRefRow = true;
+    feno->NDET = n_wavel;
+    feno->lambda0 = 0.5 * (fit_min + fit_max);
+    feno->refSpectrumSelectionMode = ANLYS_REF_SELECTION_MODE_FILE;
+    feno->useKurucz = ANLYS_KURUCZ_NONE;
+    feno->analysisMethod = pAnalysisOptions->method;
+    feno->Decomp = 1;
+
+    if (((feno->spikes = (bool *)MEMORY_AllocBuffer(__func__, "spikes", n_wavel, sizeof(int), 0, MEMORY_TYPE_INT)) == NULL) ||
+        ((feno->Lambda = MEMORY_AllocDVector(__func__, "Lambda", 0, n_wavel - 1)) == NULL) ||
+        ((feno->LambdaK = MEMORY_AllocDVector(__func__, "LambdaK", 0, n_wavel - 1)) == NULL) ||
+        ((feno->LambdaRef = MEMORY_AllocDVector(__func__, "LambdaRef", 0, n_wavel - 1)) == NULL))
+      return ERROR_ID_ALLOC;
+
+    std::copy(lambda.begin(), lambda.end(), feno->LambdaRef);
+    std::copy(lambda.begin(), lambda.end(), feno->Lambda);
+    std::copy(lambda.begin(), lambda.end(), feno->LambdaK);
+
+    if ((rc = ANALYSE_LoadRef(engine, 0)) != ERROR_ID_NO)
+      return rc;
+
+    std::copy(solar, solar + n_wavel, feno->Sref);
+
+    if (((rc = VECTOR_NormalizeVector(feno->Sref - 1, n_wavel, &feno->refNormFact, __func__)) != ERROR_ID_NO) ||
+        ((rc = ANALYSE_LoadCross(engine, cross.data(), N_SPECIES, feno->LambdaRef, 0)) != ERROR_ID_NO) ||
+        ((rc = ANALYSE_LoadLinear(linear, 2, 0)) != ERROR_ID_NO) ||
+        (calibration && ((rc = ANALYSE_LoadNonLinear(engine, &offset, 1, feno->LambdaRef, 0)) != ERROR_ID_NO)) ||
+        ((rc = ANALYSE_LoadShiftStretch(&shift_stretch, 1, 0)) != ERROR_ID_NO) ||
+        (!calibration &&                                                        // the sub-windows of the calibration are set by KURUCZ_Alloc
+         (((rc = ANALYSE_LoadGaps(engine, NULL, 0, feno->LambdaRef, fit_min, fit_max, 0)) != ERROR_ID_NO) ||
+          ((rc = FIT_PROPERTIES_alloc(__func__, &feno->fit_properties)) != ERROR_ID_NO) ||
+          ((rc = ANALYSE_XsInterpolation(feno, feno->LambdaRef, 0)) != ERROR_ID_NO))))
+      return rc;
+
+    ANALYSE_SetAnalysisType(0);
+    NFeno++;
+
+    return ERROR_ID_NO;
+  }
+
+  // buffers of fit_curfit, kept from one call to the other
+  struct curfit_buffers {
+    vector<double> y0, yfit, params_c, params_f, deltap, sigmaa;
+  };
+
+  // one fit of the non linear parameters by Curfit, as in ANALYSE_CurFitMethod, on the state of the analysis
+  // context left by the last call of ANALYSE_Spectrum (same spectrum, same window)
+  RC fit_curfit(ANALYSE_CONTEXT *context, curfit_buffers& b, double *spectrum, double *reference, double *chisqr) {
+    struct fit_properties *fit = &context->Feno->fit_properties;
+    vector<double> &y0 = b.y0, &yfit = b.yfit, &params_c = b.params_c, &params_f = b.params_f, &deltap = b.deltap, &sigmaa = b.sigmaa;
+    double lamda = 0.001, old_chisqr;
+
+    y0.assign(fit->DimL, 0.);
+    yfit.assign(fit->DimL, 0.);
+    params_c.assign(fit->DimC + 1, 0.);
+    params_f.assign(context->Fitp, context->Fitp + fit->NF);
+    deltap.assign(context->FitDeltap, context->FitDeltap + fit->NF);
+    sigmaa.assign(fit->NF, 0.);
+    int niter = 0;
+    RC rc;
+
+    context->scratchUsed = 0;
+    *chisqr = 0.;
+
+    do {
+      old_chisqr = *chisqr;
+
+      if ((rc = Curfit(context, PRJCT_ANLYS_FIT_WEIGHTING_NONE, niter, context->nFree, spectrum, reference, y0.data(), NULL, fit->DimL,
+                       params_c.data(), params_f.data(), deltap.data(), sigmaa.data(), context->FitMinp, context->FitMaxp, fit->NF,
+                       yfit.data(), &lamda, chisqr, 0, fit)) != ERROR_ID_NO)
+        break;
+
+      for (int i = 0; i < fit->NF; ++i)
+        deltap[i] *= 0.4;
+      niter++;
+    } while (*chisqr != 0. && std::fabs(*chisqr - old_chisqr) / *chisqr > pAnalysisOptions->convergence);
+
+    return rc;
+  }
+
+  // state of the calibration window modified by a calibration (initial values of the non linear parameters, vectors),
+  // so that each calibration starts from the same state
+  struct feno_state {
+    vector<CROSS_REFERENCE> cross;
+    vector<vector<double> > vectors, deriv2;
+    double xmean, ymean;
+    int decomp;
+  };
+
+  void save_feno(const FENO *feno, int n_wavel, feno_state& state) {
+    state.cross.assign(feno->TabCross, feno->TabCross + feno->NTabCross);
+    state.vectors.assign(feno->NTabCross, vector<double>());
+    state.deriv2.assign(feno->NTabCross, vector<double>());
+
+    for (int i = 0; i < feno->NTabCross; ++i) {
+      if (feno->TabCross[i].vector != NULL)
+        state.vectors[i].assign(feno->TabCross[i].vector, feno->TabCross[i].vector + n_wavel);
+      if (feno->TabCross[i].Deriv2 != NULL)
+        state.deriv2[i].assign(feno->TabCross[i].Deriv2, feno->TabCross[i].Deriv2 + n_wavel);
+    }
+
+    state.xmean = feno->xmean;
+    state.ymean = feno->ymean;
+    state.decomp = feno->Decomp;
+  }
+
+  void restore_feno(FENO *feno, const feno_state& state) {
+    std::copy(state.cross.begin(), state.cross.end(), feno->TabCross);        // the vectors are not reallocated, their pointers do not change
+
+    for (int i = 0; i < feno->NTabCross; ++i) {
+      std::copy(state.vectors[i].begin(), state.vectors[i].end(), feno->TabCross[i].vector);
+      std::copy(state.deriv2[i].begin(), state.deriv2[i].end(), feno->TabCross[i].Deriv2);
+    }
+
+    feno->xmean = state.xmean;
+    feno->ymean = state.ymean;
+    feno->Decomp = state.decomp;
+  }
+
+  // calibrate the spectra with the given number of threads, each from the given state of the calibration window;
+  // the new grids and the shifts found in the sub-windows are appended to calibrations
+  RC calibrate(stage& s, int threads, FENO *feno, const feno_state& state, const vector<vector<double> >& spectra,
+               const vector<double>& lambda, const double *solar, vector<double>& calibrations) {
+    const int n_wavel = (int)lambda.size();
+    vector<double> spectrum(n_wavel), new_lambda(n_wavel);
+    KURUCZ *kurucz = &KURUCZ_buffers[0];
+    RC rc = ERROR_ID_NO;
+
+    KURUCZ_SetThreadsNumber(threads);
+
+    for (size_t c = 0; c < spectra.size() && !rc; ++c) {
+      spectrum = spectra[c];
+      restore_feno(feno, state);
+
+      rc = timed(s, [&]() {
+          return KURUCZ_Spectrum(&ANALYSE_context, lambda.data(), new_lambda.data(), spectrum.data(), solar, NULL, 0, "Kurucz",
+                                 kurucz->fwhmPolySpec, kurucz->fwhmVector, kurucz->fwhmDeriv2, 0, kurucz->indexKurucz, NULL, 0);
+        });
+
+      calibrations.insert(calibrations.end(), new_lambda.begin(), new_lambda.end());
+      calibrations.insert(calibrations.end(), kurucz->VShift + 1, kurucz->VShift + 1 + kurucz->Nb_Win);
+    }
+
+    KURUCZ_SetThreadsNumber(1);
+    return rc;
+  }
+
+  void show_usage(const char *program) {
+    printf("%s [-n <spectra>] [-pixels <pixels>] [-conv <runs>] [-calib <spectra>]\n\n", program);
+    printf("    -n <spectra>     : number of simulated spectra (default 10000);\n");
+    printf("    -pixels <pixels> : number of pixels of the detector (default 1024);\n");
+    printf("    -conv <runs>     : number of convolutions of each cross section (default 50);\n");
+    printf("    -calib <spectra> : number of spectra calibrated with 2 and %d threads (default 20);\n", CALIB_THREADS);
+  }
+}
+
+int main(int argc, char **argv) {
+  int n_spectra = 10000;
+  int n_wavel = 1024;
+  int n_conv = 50;
+  int n_calib = 20;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc)
+      n_spectra = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-pixels") && i + 1 < argc)
+      n_wavel = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-conv") && i + 1 < argc)
+      n_conv = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-calib") && i + 1 < argc)
+      n_calib = atoi(argv[++i]);
+    else {
+      show_usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (n_spectra <= 0 || n_conv <= 0 || n_calib <= 0 || n_wavel <= N_SPECIES + POLY_ORDER + 1) {
+    show_usage(argv[0]);
+    return 1;
+  }
+
+  stage xsconv("xsconv"), spline("spline"), qr("fit_qr"), svd("fit_svd"), analysis("analysis"), curfit("curfit"),
+    kurucz_two("kurucz_j2"), kurucz_threads("kurucz_j4");
+
+  // ----------------------------------------------------------------------------
+  // Cross sections on the high resolution grid, convolved on the detector grid
+  // ----------------------------------------------------------------------------
+
+  const int n_hr = (int)((LAMBDA_MAX - LAMBDA_MIN) / HR_STEP) + 1;
+  const double lambda_min = LAMBDA_MIN + 5. * FWHM;                             // detector grid inside the high resolution grid
+  const double lambda_max = LAMBDA_MAX - 5. * FWHM;
+
+  MATRIX_OBJECT hr, conv;
+  vector<vector<double> > xs(N_SPECIES + 1, vector<double>(n_wavel));          // convolved cross sections and solar spectrum (last)
+  vector<double> lambda(n_wavel);
+  double slit_param[NSFP] = { FWHM, 0., 0. };
+  RC rc = ERROR_ID_NO;
+
+  memset(&hr, 0, sizeof(hr));
+  memset(&conv, 0, sizeof(conv));
+
+  if (MATRIX_Allocate(&hr, n_hr, 2, 0, 0, 1, __func__) || MATRIX_Allocate(&conv, n_wavel, 2, 0, 0, 0, __func__)) {
+    fprintf(stderr, "allocation of the cross sections failed\n");
+    return 1;
+  }
+
+  for (int i = 0; i < n_wavel; ++i)
+    conv.matrix[0][i] = lambda[i] = lambda_min + (lambda_max - lambda_min) * i / (n_wavel - 1.);
+
+  for (int k = 0; k <= N_SPECIES && !rc; ++k) {
+    for (int i = 0; i < n_hr; ++i) {
+      const double l = LAMBDA_MIN + i * HR_STEP;
+      hr.matrix[0][i] = l;
+      hr.matrix[1][i] = (k < N_SPECIES) ? synthetic_xs(k, l) : synthetic_solar(l);
+    }
+
+    rc = SPLINE_Deriv2(hr.matrix[0], hr.matrix[1], hr.deriv2[1], n_hr, __func__);
+
+    // the same convolution is repeated for the percentiles of its latency
+    for (int run = 0; run < n_conv && !rc; ++run)
+      rc = timed(xsconv, [&]() {
+          return XSCONV_TypeStandard(&conv, 0, n_wavel, &hr, &hr, NULL, SLIT_TYPE_GAUSS, NULL, slit_param, 0, NULL);
+        });
+
+    std::copy(conv.matrix[1], conv.matrix[1] + n_wavel, xs[k].begin());
+  }
+
+  MATRIX_Free(&hr, __func__);
+  MATRIX_Free(&conv, __func__);
+
+  if (rc) {
+    fprintf(stderr, "convolution of the cross sections failed\n");
+    return 1;
+  }
+
+  // ----------------------------------------------------------------------------
+  // Simulated spectra and fit
+  // ----------------------------------------------------------------------------
+
+  const int n_params = N_SPECIES + POLY_ORDER + 1;
+  const double lambda0 = 0.5 * (lambda_min + lambda_max);
+
+  vector<double> solar_deriv2(n_wavel), model(n_wavel), model_deriv2(n_wavel), shifted_lambda(n_wavel),
+    spectrum(n_wavel), aligned(n_wavel), spectrum_deriv2(n_wavel);
+  vector<double> b(n_wavel + 1), x(n_params + 1), sigma(n_params + 1);
+  vector<vector<double> > columns(n_params, vector<double>(n_wavel + 1));      // 1-based columns for LINEAR_set_column
+
+  for (int j = 0; j < n_params; ++j)
+    for (int i = 0; i < n_wavel; ++i)
+      columns[j][1 + i] = (j < N_SPECIES) ? -xs[j][i] : std::pow((lambda[i] - lambda0) / (lambda_max - lambda_min), j - N_SPECIES);
+
+  // model of the optical depth, the same for each spectrum; the noise changes
+
+  for (int i = 0; i < n_wavel; ++i) {
+    double od = 0.;
+    for (int k = 0; k < N_SPECIES; ++k)
+      od += slant_columns[k] * xs[k][i];
+    model[i] = xs[N_SPECIES][i] * std::exp(-od) * (1. + 0.1 * (lambda[i] - lambda0) / (lambda_max - lambda_min));
+    shifted_lambda[i] = lambda[i] + SHIFT + STRETCH * (lambda[i] - lambda0);
+  }
+
+  if (SPLINE_Deriv2(lambda.data(), model.data(), model_deriv2.data(), n_wavel, __func__)) {
+    fprintf(stderr, "interpolation of the model failed\n");
+    return 1;
+  }
+
+  std::mt19937 generator(20171010);
+  std::normal_distribution<double> noise(0., NOISE);
+  double max_error = 0.;
+  int n_failed = 0;
+
+  const auto start = std::chrono::steady_clock::now();
+
+  for (int s = 0; s < n_spectra; ++s) {
+    // spectrum measured on a shifted and stretched calibration
+    SPLINE_Vector(lambda.data(), model.data(), model_deriv2.data(), n_wavel, shifted_lambda.data(), spectrum.data(), n_wavel, SPLINE_CUBIC);
+    for (int i = 0; i < n_wavel; ++i)
+      spectrum[i] *= 1. + noise(generator);
+
+    // realignment on the grid of the reference (known shift and stretch)
+    rc = timed(spline, [&]() {
+        RC rc_spline = SPLINE_Deriv2(shifted_lambda.data(), spectrum.data(), spectrum_deriv2.data(), n_wavel, __func__);
+        if (!rc_spline)
+          rc_spline = SPLINE_Vector(shifted_lambda.data(), spectrum.data(), spectrum_deriv2.data(), n_wavel,
+                                    lambda.data(), aligned.data(), n_wavel, SPLINE_CUBIC);
+        return rc_spline;
+      });
+
+    for (int i = 0; i < n_wavel && !rc; ++i) {
+      if (aligned[i] <= 0.)
+        rc = ERROR_ID_LOG;
+      else
+        b[1 + i] = std::log(aligned[i] / xs[N_SPECIES][i]);
+    }
+
+    // linear DOAS fit, with both decompositions
+    for (int mode = DECOMP_SVD; mode <= DECOMP_QR && !rc; ++mode) {
+      rc = timed((mode == DECOMP_QR) ? qr : svd, [&]() {
+          struct linear_system *linfit = LINEAR_alloc(n_wavel, n_params, (enum linear_fit_mode)mode);
+          if (linfit == NULL)
+            return (RC)ERROR_ID_ALLOC;
+          for (int j = 0; j < n_params; ++j)
+            LINEAR_set_column(linfit, 1 + j, columns[j].data());
+          RC rc_fit = LINEAR_decompose(linfit, sigma.data(), NULL);
+          if (!rc_fit)
+            rc_fit = LINEAR_solve(linfit, b.data(), x.data());
+          LINEAR_free(linfit);
+          return rc_fit;
+        });
+
+      for (int k = 0; k < N_SPECIES && !rc; ++k)
+        max_error = std::max(max_error, std::fabs(x[1 + k] / slant_columns[k] - 1.));
+    }
+
+    if (rc) {
+      n_failed++;
+      rc = ERROR_ID_NO;
+    }
+  }
+
+  const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  // ----------------------------------------------------------------------------
+  // Analysis of the simulated spectra by the engine (ANALYSE_Spectrum, Curfit)
+  // ----------------------------------------------------------------------------
+
+  ENGINE_CONTEXT *engine = EngineCreateContext();
+
+  if (engine == NULL) {
+    fprintf(stderr, "creation of the engine context failed\n");
+    return 1;
+  }
+
+  PROJECT *project = &engine->project;
+  FENO *feno = &TabFeno[0][0];
+  curfit_buffers buffers;
+  vector<double> normalized(n_wavel), reference(n_wavel);
+  double max_error_analysis = 0., chisqr, norm;
+  int n_failed_analysis = 0;
+
+  project->instrumental.readOutFormat = PRJCT_INSTR_FORMAT_ASCII;
+  project->analysis.method = OPTICAL_DENSITY_FIT;
+  project->analysis.fitWeighting = PRJCT_ANLYS_FIT_WEIGHTING_NONE;
+  project->analysis.interpol = PRJCT_ANLYS_INTERPOL_SPLINE;
+  project->analysis.convergence = 1.e-4;
+  project->analysis.spike_tolerance = 1.e6;                                     // no removal of spikes
+  project->slit.slitFunction.slitType = SLIT_TYPE_NONE;
+
+  NDET[0] = n_wavel;
+  THRD_id = THREAD_TYPE_ANALYSIS;
+
+  if (((engine->buffers.lambda = MEMORY_AllocDVector(__func__, "lambda", 0, n_wavel - 1)) == NULL) ||
+      ((engine->buffers.spectrum = MEMORY_AllocDVector(__func__, "spectrum", 0, n_wavel - 1)) == NULL))
+    rc = ERROR_ID_ALLOC;
+  else {
+    std::copy(lambda.begin(), lambda.end(), engine->buffers.lambda);
+    engine->recordNumber = n_spectra;
+    engine->recordInfo.Zm = 45.;
+
+    if (((rc = ANALYSE_SetInit(engine)) == ERROR_ID_NO) &&
+        ((rc = load_cross_sections(lambda, xs)) == ERROR_ID_NO))
+      rc = load_analysis_window(engine, lambda, xs[N_SPECIES].data(), lambda_min + FIT_MARGIN, lambda_max - FIT_MARGIN, false);
+  }
+
+  if (rc) {
+    fprintf(stderr, "set up of the analysis window failed\n");
+    return 1;
+  }
+
+  const auto start_analysis = std::chrono::steady_clock::now();
+
+  for (int s = 0; s < n_spectra; ++s) {
+    SPLINE_Vector(lambda.data(), model.data(), model_deriv2.data(), n_wavel, shifted_lambda.data(), engine->buffers.spectrum, n_wavel, SPLINE_CUBIC);
+    for (int i = 0; i < n_wavel; ++i)
+      engine->buffers.spectrum[i] *= 1. + noise(generator);
+
+    engine->indexRecord = s + 1;
+
+    rc = timed(analysis, [&]() {
+        return ANALYSE_Spectrum(engine, &ANALYSE_context, NULL);
+      });
+
+    if (!rc)
+      rc = feno->rc;
+
+    for (int k = 0; k < N_SPECIES && !rc; ++k)
+      max_error_analysis = std::max(max_error_analysis, std::fabs(feno->TabCrossResults[k].SlntCol / slant_columns[k] - 1.));
+
+    // Curfit alone, on the spectrum and the reference as ANALYSE_CurFitMethod passes them
+
+    if (!rc) {
+      std::copy(engine->buffers.spectrum, engine->buffers.spectrum + n_wavel, normalized.begin());
+      std::copy(feno->Sref, feno->Sref + n_wavel, reference.begin());
+
+      if ((rc = VECTOR_NormalizeVector(normalized.data() - 1, n_wavel, &norm, __func__)) == ERROR_ID_NO)
+        rc = timed(curfit, [&]() {
+            return fit_curfit(&ANALYSE_context, buffers, normalized.data(), reference.data(), &chisqr);
+          });
+    }
+
+    if (rc) {
+      n_failed_analysis++;
+      rc = ERROR_ID_NO;
+    }
+  }
+
+  const double elapsed_analysis = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_analysis).count();
+
+  // ----------------------------------------------------------------------------
+  // Wavelength calibration (KURUCZ_Spectrum) with two and more threads
+  // ----------------------------------------------------------------------------
+
+  // the solar spectrum is already on the detector grid
+
+  FENO *calib_feno = &TabFeno[0][NFeno];
+  const double calib_min = lambda_min + FIT_MARGIN, calib_max = lambda_max - FIT_MARGIN;
+  vector<vector<double> > calib_spectra(n_calib, vector<double>(n_wavel));
+  vector<double> calib_two, calib_threads;
+  MATRIX_OBJECT hr_solar;
+  feno_state state;
+  bool calib_identical = false;
+
+  project->kurucz.windowsNumber = CALIB_WINDOWS;
+  project->kurucz.shiftPolynomial = 2;
+  project->kurucz.divisionMode = PRJCT_CALIB_WINDOWS_CONTIGUOUS;
+  project->kurucz.lambdaLeft = calib_min;
+  project->kurucz.lambdaRight = calib_max;
+  project->kurucz.analysisMethod = OPTICAL_DENSITY_FIT;
+
+  memset(&hr_solar, 0, sizeof(hr_solar));
+
+  for (int c = 0; c < n_calib; ++c) {
+    SPLINE_Vector(lambda.data(), model.data(), model_deriv2.data(), n_wavel, shifted_lambda.data(), calib_spectra[c].data(), n_wavel, SPLINE_CUBIC);
+    for (int i = 0; i < n_wavel; ++i)
+      calib_spectra[c][i] *= 1. + noise(generator);
+  }
+
+  if ((rc = MATRIX_Allocate(&hr_solar, n_wavel, 2, 0, 0, 1, __func__)) == ERROR_ID_NO) {
+    std::copy(lambda.begin(), lambda.end(), hr_solar.matrix[0]);
+    std::copy(xs[N_SPECIES].begin(), xs[N_SPECIES].end(), hr_solar.matrix[1]);
+
+    if ((rc = load_analysis_window(engine, lambda, xs[N_SPECIES].data(), calib_min, calib_max, true)) == ERROR_ID_NO)
+      rc = KURUCZ_Alloc(project, lambda.data(), NFeno - 1, calib_min, calib_max, 0, &hr_solar);
+  }
+
+  if (!rc) {
+    save_feno(calib_feno, n_wavel, state);
+    rc = calibrate(kurucz_two, 2, calib_feno, state, calib_spectra, lambda, xs[N_SPECIES].data(), calib_two);
+  }
+
+  if (!rc)
+    rc = calibrate(kurucz_threads, CALIB_THREADS, calib_feno, state, calib_spectra, lambda, xs[N_SPECIES].data(), calib_threads);
+
+  calib_identical = !rc && (calib_two == calib_threads);                     // bitwise, not within a tolerance
+
+  MATRIX_Free(&hr_solar, __func__);
+
+  ANALYSE_ResetData();
+  MEMORY_ReleaseDVector(__func__, "lambda", engine->buffers.lambda, 0);
+  MEMORY_ReleaseDVector(__func__, "spectrum", engine->buffers.spectrum, 0);
+  engine->buffers.lambda = engine->buffers.spectrum = NULL;
+  THRD_id = THREAD_TYPE_NONE;
+  EngineDestroyContext(engine);
+
+  // ----------------------------------------------------------------------------
+  // Report
+  // ----------------------------------------------------------------------------
+
+  printf("%d spectra of %d pixels, %d cross sections, polynomial of order %d\n\n", n_spectra, n_wavel, N_SPECIES, POLY_ORDER);
+  printf("%-12s %8s %10s %10s %10s %10s %10s\n", "stage", "calls", "p50 (us)", "p90 (us)", "p99 (us)", "max (us)", "allocs");
+  report(xsconv);
+  report(spline);
+  report(svd);
+  report(qr);
+  report(analysis);
+  report(curfit);
+  report(kurucz_two);
+  report(kurucz_threads);
+  printf("\n%.1f spectra/s (realignment and both fits)\n", n_spectra / elapsed);
+  printf("largest relative error on the slant columns : %.2e\n", max_error);
+  printf("\n%.1f spectra/s (ANALYSE_Spectrum and Curfit)\n", n_spectra / elapsed_analysis);
+  printf("largest relative error on the slant columns : %.2e\n", max_error_analysis);
+  printf("\ncalibration with 2 and %d threads : %s\n", CALIB_THREADS,
+         rc ? "failed" : (calib_identical ? "identical" : "DIFFERENT"));
+
+  if (n_failed || n_failed_analysis)
+    printf("%d spectra failed\n", n_failed + n_failed_analysis);
+
+  return (n_failed || n_failed_analysis || !calib_identical) ? 1 : 0;
+}
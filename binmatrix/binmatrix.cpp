@@ -0,0 +1,129 @@
+/* Copyright (C) 2017 Royal Belgian Institute for Space Aeronomy
+ * (BIRA-IASB)
+ *
+ * BIRA-IASB
+ * Ringlaan 3 Avenue Circulaire
+ * 1180 Uccle
+ * Belgium
+ * qdoas@aeronomie.be
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+// Conversion of cross sections, solar spectra, slit functions and other
+// matrix files to the binary format of MATRIX_Load (see matrix.c).
+//
+//   doas_binmatrix <file> [<file> ...]
+//
+// writes next to each text file its binary companion (same name followed
+// by MATRIX_BINARY_EXT), which MATRIX_Load uses instead of the text file
+// as long as the text file is not modified.
+//
+//   doas_binmatrix -o <binary file> <file>
+//
+// writes a standalone binary file, that can be selected instead of the
+// text file in the project.
+//
+// The second derivatives of the columns are saved with the matrix when
+// they can be calculated (first column strictly increasing).
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "comdefs.h"
+#include "matrix.h"
+
+namespace {
+
+  void show_usage() {
+    std::printf("Usage: doas_binmatrix <file> [<file> ...]\n"
+                "       doas_binmatrix -o <binary file> <file>\n\n"
+                "Convert matrix files (cross sections, solar spectra, slit functions,...) to the\n"
+                "binary format read by QDOAS.  Without -o, the binary file is saved next to the\n"
+                "text file, with the extension %s added to its name, and is used by QDOAS\n"
+                "instead of the text file as long as the text file is not modified.\n", MATRIX_BINARY_EXT);
+  }
+
+  void show_error(const char *fileName) {
+    ERROR_DESCRIPTION error;
+
+    if (ERROR_GetLast(&error) != ERROR_ID_NO)
+      std::fprintf(stderr, "%s: %s\n", fileName, error.errorString);
+    else
+      std::fprintf(stderr, "%s: conversion failed\n", fileName);
+  }
+
+  // load the full text file, with the second derivatives if possible, and save it
+  RC convert(const char *textFile, const std::string &binaryFile, bool companion) {
+    MATRIX_OBJECT matrix;
+    std::memset(&matrix, 0, sizeof(matrix));
+
+    RC rc = MATRIX_Load(textFile, &matrix, 0, 0, 0., 0., 1, 0, __func__);
+
+    if (rc) {
+      ERROR_DESCRIPTION error;
+      while (ERROR_GetLast(&error) != ERROR_ID_NO)                              // without the second derivatives
+        ;
+      rc = MATRIX_Load(textFile, &matrix, 0, 0, 0., 0., 0, 0, __func__);
+    }
+
+    if (!rc) {
+      rc = MATRIX_SaveBinary(binaryFile.c_str(), &matrix, companion ? textFile : NULL);
+
+      if (!rc)
+        std::printf("%s: %d x %d%s -> %s\n", textFile, matrix.nl, matrix.nc,
+                    (matrix.deriv2 != NULL) ? " (with second derivatives)" : "", binaryFile.c_str());
+    }
+
+    MATRIX_Free(&matrix, __func__);
+    return rc;
+  }
+}
+
+int main(int argc, char **argv) {
+  std::vector<const char *> files;
+  const char *output = NULL;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "-o") && i + 1 < argc)
+      output = argv[++i];
+    else if (argv[i][0] == '-') {
+      show_usage();
+      return 1;
+    }
+    else
+      files.push_back(argv[i]);
+  }
+
+  if (files.empty() || (output != NULL && files.size() != 1)) {
+    show_usage();
+    return 1;
+  }
+
+  int errors = 0;
+
+  for (size_t i = 0; i < files.size(); ++i) {
+    const std::string binaryFile = (output != NULL) ? std::string(output) : std::string(files[i]) + MATRIX_BINARY_EXT;
+
+    if (convert(files[i], binaryFile, output == NULL)) {
+      show_error(files[i]);
+      ++errors;
+    }
+  }
+
+  return errors ? 1 : 0;
+}
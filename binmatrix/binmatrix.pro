@@ -0,0 +1,48 @@
+#----------------------------------------------
+# Conversion of matrix files to the binary format
+#----------------------------------------------
+
+TEMPLATE = app
+TARGET   = ../../qdoas/release/doas_binmatrix
+
+include( ../config.pri )
+PRE_TARGETDEPS += ../common/libcommon.a ../engine/libengine.a ../mediator/libmediator.a
+
+CONFIG += qt thread console $$CODE_GENERATION
+QT = core
+
+QMAKE_CXXFLAGS += -std=gnu++0x
+
+INCLUDEPATH  += ../mediator ../common ../engine
+
+#----------------------------------------------
+# Platform dependency ... based on ../config.pri
+#----------------------------------------------
+
+unix {
+  LIBS         += -lcoda -lhdfeos -lnetcdf -lmfhdf -ldf -lz -ljpeg -lhe5_hdfeos -lhdf5 -lhdf5_hl -lhdf5_cpp -lhdf5_hl_cpp
+}
+
+hpc {
+  LIBS += -lGctp # must be linked after hdfeos
+}
+
+linux_package {
+  TARGET = ../../linux_package/bin/doas_binmatrix.bin
+  LIBS         += -lcoda -lhdfeos -lnetcdf -lmfhdf -ldf -ljpeg -lz -lhe5_hdfeos -lhdf5_hl -lhdf5
+}
+
+mxe {
+  LIBS += -lcoda -lhdfeos -lnetcdf -lmfhdf -ldf -lz -ljpeg -lhe5_hdfeos -lhdf5_hl -lhdf5
+  LIBS += -lportablexdr
+}
+
+caro {
+  LIBS         += -L$$GSL_LIB_PATH -lgsl -lgslcblas -L$$CODA_LIB_PATH -lcoda -L$$HDF_LIB_PATH -lhdf -L$$MFHDF_LIB_PATH -lmfhdf  -L$$HDFEOS_LIB_PATH -lhdfeos -L$$HDFEOS5_LIB_PATH -lhe5_hdfeos -L$$NETCDF_LIB_PATH -L$$HDF5_LIB_PATH -lhdf5 -lhdf5_hl -lhdf5_cpp -lhdf5_hl_cpp -lhdf5_tools -lnetcdf -lm
+}
+
+#----------------------------------------------
+# Source files
+#----------------------------------------------
+
+SOURCES += binmatrix.cpp
@@ -1,9 +1,16 @@
 
 #include <cstdio>
 #include <cstring>
+#include <cstdlib>
 
 #include <iostream>
 #include <string>
+#include <vector>
+#include <set>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
 
 #include <QXmlInputSource>
 #include <QXmlSimpleReader>
@@ -12,6 +19,9 @@
 #include <QList>
 #include <QDir>
 #include <QFileInfo>
+#include <QProcess>
+#include <QMap>
+#include <QStringList>
 #include <QLocale>
 #include <clocale>
 #include <QTextCodec>
@@ -34,6 +44,7 @@
 #include "debugutil.h"
 #include "qdoasxml.h"
 #include "convxml.h"
+#include "timing.h"
 
 
 //-------------------------------------------------------------------
@@ -82,10 +93,17 @@ int analyseProjectQdoas(const CProjectConfigItem *projItem, const QString &outpu
 int analyseProjectQdoasPrepare(void **engineContext, const CProjectConfigItem *projItem, const QString &outputDir,const QString &calibDir,
 			       CBatchEngineController *controller);
 int analyseProjectQdoasFile(void *engineContext, CBatchEngineController *controller, const QString &filename);
+int analyseProjectQdoasFileParallel(void *engineContext, CBatchEngineController *controller);
 int analyseProjectQdoasTreeNode(void *engineContext, CBatchEngineController *controller, const CProjectConfigTreeNode *node);
 int analyseProjectQdoasDirectory(void *engineContext, CBatchEngineController *controller, const QString &dir,
 				 const QString &filters, bool recursive);
 
+bool analyseProjectQdoasInProcesses(const CProjectConfigItem *projItem, const QString &outputDir);
+int analyseProjectQdoasProcesses(const CProjectConfigItem *projItem, const QList<QString> &files);
+void collectProjectQdoasFiles(const QList<QString> &filenames, QList<QString> &files);
+void collectProjectQdoasTreeNode(const CProjectConfigTreeNode *node, QList<QString> &files);
+void collectProjectQdoasDirectory(const QString &dir, const QString &filter, bool recursive, QList<QString> &files);
+
 
 
 int batchProcessConvolution(commands_t *cmd);
@@ -96,6 +114,14 @@ int calibSwitch=0;
 int calibSaveSwitch=0;
 int xmlSwitch=0;
 int verboseMode=0;
+int threadCount=1;
+int calibThreadCount=1;                                 // threads fitting the sub-windows of the wavelength calibration (cfr -calib_threads)
+int processCount=1;
+int processesUsed=0;                                    // files analysed by worker processes (cfr -p)
+int stagedOutput=0;                                     // worker process : output written to temporary files renamed at the end (cfr -staged_output)
+
+QString programPath;                                   // doas_cl executable, started again for the worker processes
+QStringList workerArguments;                           // command line options to forward to the worker processes
 
 //-------------------------------------------------------------------
 
@@ -122,6 +148,8 @@ int main(int argc, char **argv)
   else {
     commands_t cmd;
 
+    programPath = argv[0];
+
     enum RunMode runMode = parseCommandLine(argc, argv, &cmd);
 
     switch (runMode) {
@@ -134,6 +162,14 @@ int main(int argc, char **argv)
       break;
     case Batch:
       retCode = batchProcess(&cmd);
+
+      if (stagedOutput && mediateRequestCommitOutputStaging(!retCode)) {
+        std::cout << "Can not rename the temporary output files" << std::endl;
+        retCode = 1;
+      }
+
+      if (!processesUsed)                               // otherwise, each worker process prints its own summary
+        mediateRequestPrintTiming();
       break;
     }
   }
@@ -153,6 +189,9 @@ enum RunMode parseCommandLine(int argc, char **argv, commands_t *cmd)
 
   while (runMode != Error && i < argc) {
 
+    int optionStart = i;
+    bool forwardOption = (argv[i][0] == '-');          // options given again to the worker processes (cfr -p)
+
     // options ...
     if (argv[i][0] == '-') {
 
@@ -173,6 +212,7 @@ enum RunMode parseCommandLine(int argc, char **argv, commands_t *cmd)
 
       }
       else if (!strcmp(argv[i], "-a")) { // project name file ...
+	forwardOption = false;
 	if (++i < argc && argv[i][0] != '-') {
 		 fileSwitch=0;
 	  cmd->projectName = argv[i];
@@ -202,6 +242,7 @@ enum RunMode parseCommandLine(int argc, char **argv, commands_t *cmd)
       }
 
       else if (!strcmp(argv[i], "-f")) { // filename ...
+	forwardOption = false;
 	if (++i < argc && argv[i][0] != '-')
 		 {
     fileSwitch=1;
@@ -237,6 +278,98 @@ enum RunMode parseCommandLine(int argc, char **argv, commands_t *cmd)
 	 }
 	else if (!strcmp(argv[i],"-v"))
 	 verboseMode=1;
+ else if (!strcmp(argv[i], "-j")) { // number of analysis threads ...
+	if (++i < argc && argv[i][0] != '-' && atoi(argv[i]) > 0) {
+		 fileSwitch=0;
+	  threadCount = atoi(argv[i]);
+	  mediateRequestSetReferenceThreads(threadCount);
+	}
+	else {
+	  runMode = Error;
+	  std::cout << "Option '-j' requires an argument (number of threads > 0)." << std::endl;
+	}
+
+      }
+ else if (!strcmp(argv[i], "-calib_threads")) { // number of threads fitting the calibration sub-windows ...
+	if (++i < argc && argv[i][0] != '-' && atoi(argv[i]) > 0) {
+		 fileSwitch=0;
+	  calibThreadCount = atoi(argv[i]);
+	  mediateRequestSetCalibrationThreads(calibThreadCount);
+	}
+	else {
+	  runMode = Error;
+	  std::cout << "Option '-calib_threads' requires an argument (number of threads > 0)." << std::endl;
+	}
+
+      }
+ else if (!strcmp(argv[i], "-p")) { // number of worker processes ...
+	forwardOption = false;
+	if (++i < argc && argv[i][0] != '-' && atoi(argv[i]) > 0) {
+		 fileSwitch=0;
+	  processCount = atoi(argv[i]);
+	}
+	else {
+	  runMode = Error;
+	  std::cout << "Option '-p' requires an argument (number of processes > 0)." << std::endl;
+	}
+
+      }
+ else if (!strcmp(argv[i], "-cache")) { // directory of convolved cross sections ...
+	if (++i < argc && argv[i][0] != '-') {
+		 fileSwitch=0;
+	  mediateRequestSetCacheDirectory(argv[i]);
+	}
+	else {
+	  runMode = Error;
+	  std::cout << "Option '-cache' requires an argument (directory)." << std::endl;
+	}
+
+      }
+ else if (!strcmp(argv[i], "-stream")) { // number of records kept in memory by the netCDF output ...
+	if (++i < argc && argv[i][0] != '-' && atoi(argv[i]) > 0) {
+		 fileSwitch=0;
+	  mediateRequestSetOutputStreaming(atoi(argv[i]));
+	}
+	else {
+	  runMode = Error;
+	  std::cout << "Option '-stream' requires an argument (number of records > 0)." << std::endl;
+	}
+
+      }
+ else if (!strcmp(argv[i], "-staged_output")) { // worker process of -p : keep the output files unchanged until the job succeeds ...
+	forwardOption = false;
+	stagedOutput = 1;
+	mediateRequestSetOutputStaging(1);
+      }
+ else if (!strcmp(argv[i], "-lazy_rows")) { // load and align the detector rows of imagers on demand ...
+	  mediateRequestSetLazyRows(1);
+      }
+ else if (!strcmp(argv[i], "-timing")) { // time spent in the main stages of the processing ...
+	if (++i < argc && !strcmp(argv[i], "text")) {
+		 fileSwitch=0;
+	  mediateRequestSetTiming(TIMING_FORMAT_TEXT);
+	}
+	else if (i < argc && !strcmp(argv[i], "json")) {
+		 fileSwitch=0;
+	  mediateRequestSetTiming(TIMING_FORMAT_JSON);
+	}
+	else {
+	  runMode = Error;
+	  std::cout << "Option '-timing' requires an argument (text or json)." << std::endl;
+	}
+
+      }
+ else if (!strcmp(argv[i], "-memory_sampling")) { // register one allocation out of n in the memory control ...
+	if (++i < argc && argv[i][0] != '-' && atoi(argv[i]) > 0) {
+		 fileSwitch=0;
+	  mediateRequestSetMemorySampling(atoi(argv[i]));
+	}
+	else {
+	  runMode = Error;
+	  std::cout << "Option '-memory_sampling' requires an argument (number of allocations > 0)." << std::endl;
+	}
+
+      }
  else if (!strcmp(argv[i], "-o")) { // output directory ...
 	if (++i < argc && argv[i][0] != '-') {
 		 fileSwitch=0;
@@ -261,6 +394,10 @@ enum RunMode parseCommandLine(int argc, char **argv, commands_t *cmd)
       std::cout << "Invalid argument '" << argv[i] << "'" << std::endl;
     }
 
+    if (forwardOption)
+      for (int k = optionStart; k <= i && k < argc; ++k)
+        workerArguments << argv[k];
+
     ++i;
   }
   
@@ -349,6 +486,38 @@ void showUsage()
   std::cout << "    -k <project name>   : for QDoas, run calibration on the specified project" << std::endl << std::endl;
   std::cout << "    -new_irrad <output> : for QDoas, run calibration, GEMS measurements, calibrated irradiances file" << std::endl << std::endl;
   std::cout << "    -v                  : verbose on (default is off)" << std::endl << std::endl;
+  std::cout << "    -j <threads>        : for QDoas, number of threads used to analyse the detector" << std::endl;
+  std::cout << "                          rows of imagers (OMI, TROPOMI,...) or to build the automatic" << std::endl;
+  std::cout << "                          reference of TROPOMI (default is 1)" << std::endl << std::endl;
+  std::cout << "    -calib_threads <n>  : for QDoas, fit the sub-windows of the wavelength" << std::endl;
+  std::cout << "                          calibration with this number of threads, each one from the" << std::endl;
+  std::cout << "                          same initial values; by default, the sub-windows are fitted" << std::endl;
+  std::cout << "                          one after the other, each one from the values found in the" << std::endl;
+  std::cout << "                          previous one, and the results may differ slightly (with -j," << std::endl;
+  std::cout << "                          these threads are used by each thread analysing the rows)" << std::endl << std::endl;
+  std::cout << "    -p <processes>      : for QDoas, number of processes used to analyse the files" << std::endl;
+  std::cout << "                          of a project (default is 1)" << std::endl << std::endl;
+  std::cout << "    -cache <directory>  : for QDoas, keep the cross sections convolved with the slit" << std::endl;
+  std::cout << "                          function of the project in this directory to reuse them" << std::endl;
+  std::cout << "                          in the next runs, together with the geolocation of the OMI," << std::endl;
+  std::cout << "                          GOME-2 and GOME (netCDF) orbits used for the automatic" << std::endl;
+  std::cout << "                          reference and the position of the records in ASCII" << std::endl;
+  std::cout << "                          spectra files (the directory should exist)" << std::endl << std::endl;
+  std::cout << "    -stream <records>   : for QDoas, with netCDF output, write the results of the" << std::endl;
+  std::cout << "                          completed scanlines each time this number of records has" << std::endl;
+  std::cout << "                          been analysed instead of keeping all results of a file in" << std::endl;
+  std::cout << "                          memory until the end of the file" << std::endl << std::endl;
+  std::cout << "    -lazy_rows          : for QDoas, with imagers (OMI, TROPOMI,...), load, convolve" << std::endl;
+  std::cout << "                          and calibrate a detector row the first time one of its" << std::endl;
+  std::cout << "                          records is analysed instead of doing it for all rows before" << std::endl;
+  std::cout << "                          the first record (not with the automatic reference or the" << std::endl;
+  std::cout << "                          output of the calibration results)" << std::endl << std::endl;
+  std::cout << "    -timing <text|json> : for QDoas, print the number of calls and the time spent in" << std::endl;
+  std::cout << "                          the main stages of the processing (read, analysis, fit," << std::endl;
+  std::cout << "                          calibration, convolution, output) at the end of the run;" << std::endl;
+  std::cout << "                          with -p, each worker process prints its own summary" << std::endl << std::endl;
+  std::cout << "    -memory_sampling <n>: in debug builds, check the release of only one allocated" << std::endl;
+  std::cout << "                          buffer out of n to track the leaks at a lower cost" << std::endl << std::endl;
   std::cout << "    -xml <path=value>   : advanced option to replace the values of some options " << std::endl;
   std::cout << "                          in the configuration file by new ones." << std::endl;
   std::cout << "------------------------------------------------------------------------------" << std::endl;
@@ -508,6 +677,14 @@ int analyseProjectQdoas(const CProjectConfigItem *projItem, const QString &outpu
   void *engineContext;
   int retCode;
 
+  if (analyseProjectQdoasInProcesses(projItem, outputDir)) {
+    QList<QString> files;
+
+    collectProjectQdoasFiles(filenames, files);
+
+    return analyseProjectQdoasProcesses(projItem, files);
+  }
+
   CBatchEngineController *controller = new CBatchEngineController;
 
   retCode = analyseProjectQdoasPrepare(&engineContext, projItem, outputDir, calibDir, controller);
@@ -548,6 +725,14 @@ int analyseProjectQdoas(const CProjectConfigItem *projItem, const QString &outpu
   void *engineContext;
   int retCode;
 
+  if (analyseProjectQdoasInProcesses(projItem, outputDir)) {
+    QList<QString> files;
+
+    collectProjectQdoasTreeNode(projItem->rootNode(), files);
+
+    return analyseProjectQdoasProcesses(projItem, files);
+  }
+
   CBatchEngineController *controller = new CBatchEngineController;
 
   retCode = analyseProjectQdoasPrepare(&engineContext, projItem, outputDir, calibDir, controller);
@@ -688,6 +873,13 @@ int analyseProjectQdoasFile(void *engineContext, CBatchEngineController *control
   if (verboseMode)
    std::cout << "Processing file " << filename.toStdString() << std::endl;
 
+  if ((threadCount > 1) && !calibSwitch && mediateRequestParallelAnalysisAllowed(engineContext)) {
+    // the calibration of each row still uses -calib_threads threads so that the results
+    // do not depend on the way the rows are analysed
+    retCode = analyseProjectQdoasFileParallel(engineContext, controller);
+    return retCode;
+  }
+
   oldResult=-1;
 
   // loop based on the controller ...
@@ -721,6 +913,145 @@ int analyseProjectQdoasFile(void *engineContext, CBatchEngineController *control
   return retCode;
 }
 
+// The records of one scanline (at most one record per detector row) are read
+// and then analysed by threadCount threads; the results are saved in the
+// order of the records, as in analyseProjectQdoasFile.
+
+int analyseProjectQdoasFileParallel(void *engineContext, CBatchEngineController *controller)
+{
+  int retCode = 0;
+  int result, oldResult = -1;
+  bool endOfFile = false;
+  size_t nSlots = 0;                                   // number of records of the current scanline
+  bool nextScanline = false;                           // the last record read belongs to the next scanline
+
+  std::vector<void *> workers;                         // one worker per record of the scanline, reused for the next ones
+  std::vector<CEngineResponseSpecificRecord *> responses;
+
+  while (!retCode && !endOfFile && controller->active()) {
+
+    std::set<int> rows;
+
+    // the record that ended the previous scanline is the first of this one
+
+    if (nextScanline) {
+      std::swap(workers[0], workers[nSlots]);
+      std::swap(responses[0], responses[nSlots]);
+      rows.insert(mediateRequestAnalysisWorkerRow(workers[0]));
+      nSlots = 1;
+      nextScanline = false;
+    }
+    else
+      nSlots = 0;
+
+    // read the records of the scanline
+
+    while (!retCode && controller->active()) {
+
+      if (nSlots == workers.size()) {
+        CEngineResponseVisual *msgResp = new CEngineResponseVisual;
+        void *worker = mediateRequestCreateAnalysisWorker(engineContext, msgResp);
+
+        msgResp->process(controller);
+        delete msgResp;
+
+        if (worker == NULL) {
+          retCode = 1;
+          break;
+        }
+
+        workers.push_back(worker);
+        responses.push_back(NULL);
+      }
+
+      CEngineResponseSpecificRecord *resp = new CEngineResponseSpecificRecord;
+
+      result = mediateRequestNextMatchingLoadSpectrum(engineContext, workers[nSlots], resp);
+
+      if ((result == 0) || (result == oldResult)) {
+        delete resp;
+        endOfFile = true;
+        break;
+      }
+      else if (result == -1) {
+        resp->setRecordNumber(result);
+        resp->process(controller);
+        delete resp;
+        retCode = 1;
+        break;
+      }
+
+      oldResult = result;
+      responses[nSlots] = resp;
+
+      if (!rows.insert(mediateRequestAnalysisWorkerRow(workers[nSlots])).second) {
+        nextScanline = true;
+        break;
+      }
+
+      ++nSlots;
+    }
+
+    // analyse the records of the scanline
+
+    std::atomic<size_t> nextSlot(0);
+
+    auto analyseSlots = [&]() {
+      for (size_t i = nextSlot++; i < nSlots; i = nextSlot++)
+        mediateRequestAnalyseWorkerSpectrum(workers[i], responses[i]);
+    };
+
+    std::vector<std::thread> threads;
+
+    for (size_t i = 1; i < std::min((size_t)threadCount, nSlots); ++i)
+      threads.push_back(std::thread(analyseSlots));
+
+    analyseSlots();
+
+    for (size_t i = 0; i < threads.size(); ++i)
+      threads[i].join();
+
+    // save the results in the order of the records; records read before a
+    // read error are saved too, as in analyseProjectQdoasFile
+
+    bool saveError = false;
+
+    for (size_t i = 0; i < nSlots; ++i) {
+
+      if (!saveError) {
+        result = mediateRequestSaveWorkerResults(engineContext, workers[i], responses[i]);
+
+        responses[i]->setRecordNumber(result);
+
+        TRACE("   record : " << result);
+
+        if (result == -1)
+          saveError = true;
+        else if (verboseMode)
+          std::cout << "  completed record " << result << std::endl;
+
+        responses[i]->process(controller);
+      }
+
+      delete responses[i];
+      responses[i] = NULL;
+    }
+
+    if (saveError)
+      retCode = 1;
+  }
+
+  if (nextScanline)
+    delete responses[nSlots];
+
+  for (size_t i = 0; i < workers.size(); ++i)
+    mediateRequestDestroyAnalysisWorker(workers[i]);
+
+  TRACE("   end file " << retCode);
+
+  return retCode;
+}
+
 int analyseProjectQdoasTreeNode(void *engineContext, CBatchEngineController *controller, const CProjectConfigTreeNode *node)
 {
   int retCode = 0;
@@ -792,6 +1123,215 @@ int analyseProjectQdoasDirectory(void *engineContext, CBatchEngineController *co
   return retCode;
 }
 
+//-------------------------------------------------------------------
+// Analysis of the files of a project by several processes (-p)
+//-------------------------------------------------------------------
+
+// The files are only distributed over processes when each of them has its own
+// output file, so that the output is the same as with a single process.
+
+bool analyseProjectQdoasInProcesses(const CProjectConfigItem *projItem, const QString &outputDir)
+{
+  if ((processCount <= 1) || calibSwitch || calibSaveSwitch)
+    return false;
+
+  mediate_project_t projectData = *(projItem->properties());
+
+  if (!outputDir.isEmpty() && outputDir.size() < FILENAME_BUFFER_LENGTH-1)
+    strcpy(projectData.output.path, outputDir.toLocal8Bit().data());
+
+  bool siteFound = (CWorkSpace::instance()->findSite(QString(projectData.instrumental.siteName)) != NULL);
+
+  if (!mediateProjectOutputPerSpectraFile(&projectData, siteFound)) {
+    std::cout << "Warning : the output file of project " << projItem->name().toStdString()
+              << " is shared by all spectra files; option '-p' ignored." << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+// Same files and same order as analyseProjectQdoas
+
+void collectProjectQdoasFiles(const QList<QString> &filenames, QList<QString> &files)
+{
+  QList<QString>::const_iterator it = filenames.begin();
+  while (it != filenames.end()) {
+    QFileInfo info(*it);
+
+    if (info.isFile())
+      files.push_back(*it);
+    else if (info.isDir())
+      collectProjectQdoasDirectory(info.filePath(), "*.*", true, files);
+    else
+      collectProjectQdoasDirectory(info.path(), info.fileName(), true, files);
+
+    ++it;
+  }
+}
+
+// Same files and same order as analyseProjectQdoasTreeNode
+
+void collectProjectQdoasTreeNode(const CProjectConfigTreeNode *node, QList<QString> &files)
+{
+  while (node != NULL) {
+
+    if (node->isEnabled()) {
+      switch (node->type()) {
+      case CProjectConfigTreeNode::eFile:
+	files.push_back(node->name());
+	break;
+      case CProjectConfigTreeNode::eFolder:
+	collectProjectQdoasTreeNode(node->firstChild(), files);
+	break;
+      case CProjectConfigTreeNode::eDirectory:
+	collectProjectQdoasDirectory(node->name(), node->filter(), node->recursive(), files);
+	break;
+      }
+    }
+
+    node = node->nextSibling();
+  }
+}
+
+// Same files and same order as analyseProjectQdoasDirectory
+
+void collectProjectQdoasDirectory(const QString &dir, const QString &filter, bool recursive, QList<QString> &files)
+{
+  QFileInfoList entries;
+  QFileInfoList::iterator it;
+
+  QDir directory(dir);
+
+  if (recursive) {
+    entries = directory.entryInfoList();
+
+    for (it = entries.begin(); it != entries.end(); ++it)
+      if (it->isDir() && !it->fileName().startsWith('.'))
+        collectProjectQdoasDirectory(it->filePath(), filter, true, files);
+  }
+
+  if (filter.isEmpty())
+    entries = directory.entryInfoList();
+  else
+    entries = directory.entryInfoList(QStringList(filter));
+
+  for (it = entries.begin(); it != entries.end(); ++it)
+    if (it->isFile())
+      files.push_back(it->filePath());
+}
+
+// Files whose output file would have the same name (mediateProjectOutputFileName)
+// are analysed by the same process, in their original order.  The largest jobs are started first and
+// each process takes the next job as soon as it is done, which balances the
+// load for files of very different sizes.  Jobs that failed are started once
+// more at the end.  The workers write their results to temporary files that
+// only replace the output files when the whole job succeeds (-staged_output),
+// so that a job started again does not append its results to the partial
+// output of the failed attempt.
+
+int analyseProjectQdoasProcesses(const CProjectConfigItem *projItem, const QList<QString> &files)
+{
+  processesUsed = 1;
+
+  struct job_t {
+    QStringList files;
+    qint64 size;
+  };
+
+  QList<job_t> jobs;
+  QMap<QString, int> jobIndexes;                       // output file name -> job
+
+  for (QList<QString>::const_iterator it = files.begin(); it != files.end(); ++it) {
+    QFileInfo info(*it);
+    char outputFileName[FILENAME_BUFFER_LENGTH];
+
+    mediateProjectOutputFileName(projItem->properties(), it->toLocal8Bit().constData(), outputFileName);
+
+    QString outputName = QString::fromLocal8Bit(outputFileName);
+
+    if (!jobIndexes.contains(outputName)) {
+      jobIndexes.insert(outputName, jobs.size());
+      jobs.push_back(job_t());
+      jobs.back().size = 0;
+    }
+
+    job_t &job = jobs[jobIndexes.value(outputName)];
+
+    job.files << *it;
+    job.size += info.size();
+  }
+
+  std::stable_sort(jobs.begin(), jobs.end(), [](const job_t &a, const job_t &b) { return a.size > b.size; });
+
+  if (verboseMode)
+    std::cout << "Processing " << files.size() << " files of project " << projItem->name().toStdString()
+              << " with " << processCount << " processes" << std::endl;
+
+  for (int pass = 0; (pass < 2) && !jobs.isEmpty(); ++pass) {
+
+    QList<job_t> failedJobs;
+    QList<QPair<QProcess *, job_t> > running;
+    int nextJob = 0;
+
+    while ((nextJob < jobs.size()) || !running.isEmpty()) {
+
+      // start new processes
+
+      while ((nextJob < jobs.size()) && (running.size() < processCount)) {
+        const job_t &job = jobs.at(nextJob++);
+        QProcess *process = new QProcess;
+        QStringList arguments = workerArguments;
+
+        arguments << "-staged_output" << "-a" << projItem->name() << "-f" << job.files;
+
+        process->setProcessChannelMode(QProcess::ForwardedChannels);
+        process->start(programPath, arguments);
+
+        if (!process->waitForStarted(-1)) {
+          std::cout << "Can not start " << programPath.toStdString() << std::endl;
+          failedJobs << job;
+          delete process;
+        }
+        else
+          running << qMakePair(process, job);
+      }
+
+      // collect the processes that are done
+
+      bool finished = false;
+
+      for (int i = 0; i < running.size(); ) {
+        QProcess *process = running[i].first;
+
+        if (process->waitForFinished(0) || (process->state() == QProcess::NotRunning)) {
+          if ((process->exitStatus() != QProcess::NormalExit) || (process->exitCode() != 0))
+            failedJobs << running[i].second;
+
+          delete process;
+          running.removeAt(i);
+          finished = true;
+        }
+        else
+          ++i;
+      }
+
+      if (!finished && !running.isEmpty())
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+
+    jobs = failedJobs;
+
+    if (!jobs.isEmpty() && !pass)
+      std::cout << jobs.size() << " job(s) of project " << projItem->name().toStdString() << " failed; trying again" << std::endl;
+  }
+
+  for (QList<job_t>::const_iterator it = jobs.begin(); it != jobs.end(); ++it)
+    std::cout << "Processing failed for " << it->files.join(" ").toStdString() << std::endl;
+
+  return jobs.isEmpty() ? 0 : 1;
+}
+
 int batchProcessConvolution(commands_t *cmd)
 {
   TRACE("batchProcessConvolution");
@@ -11,6 +11,8 @@ PRE_TARGETDEPS += ../common/libcommon.a ../engine/libengine.a ../mediator/libmed
 CONFIG += qt thread $$CODE_GENERATION
 QT = core xml
 
+QMAKE_CXXFLAGS += -std=gnu++0x
+
 INCLUDEPATH  += ../mediator ../common ../qdoas ../convolution ../usamp ../engine ../ring
 
 #----------------------------------------------
@@ -147,6 +147,7 @@
 #include "xsconv.h"
 #include "filter.h"
 #include "usamp.h"
+#include "xscache.h"
 #include "spectral_range.h"
 #include "tropomi_read.h"
 #include "gome2_read.h"
@@ -155,6 +156,7 @@
 #include "stdfunc.h"
 #include "winthrd.h"
 #include "curfit.h"
+#include "timing.h"
 #include "vector.h"
 #include "zenithal.h"
 #include "omi_read.h"
@@ -173,34 +175,21 @@
 
 PROJECT *PRJCT_itemList;
 
-doas_spectrum *global_doas_spectrum; // Should better remove this global variable.
-
 int    ANALYSE_plotKurucz,ANALYSE_plotRef,ANALYSE_indexLine;
 
 int NFeno;                             // number of analysis windows
 
-int SvdPDeb,SvdPFin,                   // analysis window limits
-  LimMin,LimMax,LimN;
-
 WRK_SYMBOL *WorkSpace;                 // list of symbols in a project
 int NWorkSpace;
-FENO **TabFeno,*Feno;                  // list of analysis windows in a project
+FENO **TabFeno;                        // list of analysis windows in a project
 
 int ANALYSE_swathSize=0;
 
-double *x,*Lambda,*LambdaSpec,
-  *ANALYSE_pixels,
-  *ANALYSE_splineX,              // abscissa used for spectra, in the units selected by user
-  *ANALYSE_absolu,               // residual spectrum
-  *ANALYSE_secX,                 // residual spectrum + the contribution of a cross section for fit display
-  *ANALYSE_t,                    // residual transmission in Marquardt-Levenberg not linear method
-  *ANALYSE_tc,                   // residual transmission in Marquardt-Levenberg not linear method
-  *ANALYSE_xsTrav,               // temporary buffer for processing on cross sections
-  *ANALYSE_xsTrav2,              // cross sections second derivatives
-  *ANALYSE_shift,
+double *ANALYSE_pixels,
   *ANALYSE_zeros,
   *ANALYSE_ones;
-double   ANALYSE_nFree;                // number of free degrees
+
+ANALYSE_CONTEXT ANALYSE_context;       // working buffers and state of the fit for the main thread
 
 MATRIX_OBJECT ANALYSIS_slitMatrix[NSFP],ANALYSIS_slitK;
 double ANALYSIS_slitParam[NSFP];
@@ -210,39 +199,23 @@ USAMP  ANALYSE_usampBuffers;
 // STATIC DECLARATIONS
 // ===================
 
-int NOrtho,
-  *OrthoSet,
-  hFilterSpecLog,hFilterRefLog;
-
 int NDET[MAX_SWATHSIZE];
 // description of an analysis windows
 
+static RC AnalyseUsampBuild(const ANALYSE_CONTEXT *pContext,int analysisFlag,int gomeFlag,int indexFenoColumn);
+
 PRJCT_FILTER *ANALYSE_plFilter,*ANALYSE_phFilter;
 PRJCT_ANLYS  *pAnalysisOptions;        // analysis options
 PRJCT_SLIT   *pSlitOptions;            // slit function options
 PRJCT_KURUCZ *pKuruczOptions;          // Kurucz options
 PRJCT_USAMP  *pUsamp;                  // undersampling options
 
-double *Fitp,
-  *FitDeltap,
-  *FitMinp,
-  *FitMaxp,
-  *a,
-  *b,
-  *Sigma,
-  *SplineSpec,
-  *SplineRef,
-  StretchFact1,StretchFact2,
-  Square,
-  ZM,TDET;
-
 // Internal variables
 
 int KuruczUseRef=0;   // 0 if spectrum is shifted, 1 if reference is shifted
 int debugResetFlag=0;
 int analyseDebugMask=0;
 int analyseDebugVar=0;
-INDEX analyseIndexRecord;
 
 // =================
 // UTILITY FUNCTIONS
@@ -304,12 +277,12 @@ static inline double root_mean_square(const double * array, const doas_spectrum
 // Return the wavelength of the center pixel of the analysis window
 // (SvdPDeb + SvdPFin)/2.  If this is in the middle of 2 pixels,
 // return the average wavelength of those pixels.
-inline double center_pixel_wavelength(int first, int last) {
+inline double center_pixel_wavelength(const double *lambda,int first, int last) {
   int center = (first + last)/2;
   if ( (first + last) %2) {
-    return 0.5*(ANALYSE_splineX[center] + ANALYSE_splineX[1+center]);
+    return 0.5*(lambda[center] + lambda[1+center]);
   } else {
-    return ANALYSE_splineX[center];
+    return lambda[center];
   }
 }
 
@@ -352,13 +325,13 @@ bool remove_spikes(double *residuals,
   return spikes;
  }
 
-int reinit_analysis(FENO *pFeno, const int n_wavel) {
+int reinit_analysis(ANALYSE_CONTEXT *pContext,FENO *pFeno, const int n_wavel) {
   pFeno->fit_properties.DimL = spectrum_length(pFeno->fit_properties.specrange);
   pFeno->Decomp = 1;
 
-  memcpy(ANALYSE_absolu, ANALYSE_zeros, sizeof(double) * n_wavel);
+  memcpy(pContext->absolu, ANALYSE_zeros, sizeof(double) * n_wavel);
 
-  return ANALYSE_SvdInit(pFeno,&pFeno->fit_properties, n_wavel, Lambda);
+  return ANALYSE_SvdInit(pContext,pFeno,&pFeno->fit_properties, n_wavel, pContext->Lambda);
  }
 
 void AnalyseGetFenoLim(FENO *pFeno,INDEX *pLimMin,INDEX *pLimMax, const int n_wavel)
@@ -566,7 +539,7 @@ RC AnalysePukiteConvoluteI0(const FENO *pTabFeno,double conc,double lambda0,
                                double *outputPukite1,double *lambdaEff,
                                double *outputPukite2,double *sigmaEff,
                                INDEX indexlambdaMin, INDEX indexlambdaMax, const int n_wavel,
-                               INDEX indexFenoColumn, int wveDptFlag)
+                               INDEX indexFenoColumn, int wveDptFlag, SLIT_BANK *pSlitBank)
  {
   // Declarations
 
@@ -654,9 +627,9 @@ RC AnalysePukiteConvoluteI0(const FENO *pTabFeno,double conc,double lambda0,
 
       // Covolve the Pukite terms separately
 
-          !(rc=XSCONV_TypeI0Correction(&xsNewI0,&xshr,&hrSolar,conc,slitType,slitMatrix,(double *)slitParam,wveDptFlag)) &&
-          !(rc=XSCONV_TypeStandard(&xsNew0,indexlambdaMin,indexlambdaMax,&xshr0,&xshr0,NULL,slitType,slitMatrix,(double *)slitParam,wveDptFlag)) &&
-          !(rc=XSCONV_TypeStandard(&xsNew1,indexlambdaMin,indexlambdaMax,&xshr1,&xshr1,NULL,slitType,slitMatrix,(double *)slitParam,wveDptFlag)))
+          !(rc=XSCONV_TypeI0Correction(&xsNewI0,&xshr,&hrSolar,conc,slitType,slitMatrix,(double *)slitParam,wveDptFlag,pSlitBank)) &&
+          !(rc=XSCONV_TypeStandard(&xsNew0,indexlambdaMin,indexlambdaMax,&xshr0,&xshr0,NULL,slitType,slitMatrix,(double *)slitParam,wveDptFlag,pSlitBank)) &&
+          !(rc=XSCONV_TypeStandard(&xsNew1,indexlambdaMin,indexlambdaMax,&xshr1,&xshr1,NULL,slitType,slitMatrix,(double *)slitParam,wveDptFlag,pSlitBank)))
        {
         for (j=indexlambdaMin;(j<indexlambdaMax) && !rc;j++)
          {
@@ -692,7 +665,7 @@ RC AnalysePukiteConvoluteI0(const FENO *pTabFeno,double conc,double lambda0,
              xshr2.matrix[1][i]=(double)xshr0.matrix[1][i]*xshr.matrix[1][i]*xshr.matrix[1][i];     // Pukite second term : I0 exp(-xs*conc) * xs ^ 2
 
             if (!(rc=SPLINE_Deriv2(xshr2.matrix[0],xshr2.matrix[1],xshr2.deriv2[1],xshr2.nl,(char *)__func__)) &&
-                !(rc=XSCONV_TypeStandard(&xsNew2,indexlambdaMin,indexlambdaMax,&xshr2,&xshr2,NULL,slitType,slitMatrix,(double *)slitParam,wveDptFlag)))
+                !(rc=XSCONV_TypeStandard(&xsNew2,indexlambdaMin,indexlambdaMax,&xshr2,&xshr2,NULL,slitType,slitMatrix,(double *)slitParam,wveDptFlag,pSlitBank)))
              {
               for (j=indexlambdaMin;(j<indexlambdaMax) && !rc;j++)
                {
@@ -1023,11 +996,11 @@ void Analyse_Molecular_Ring_End(FENO *pFeno,int n_wavel)
 // indexColumn: column index in A of the vector we want to orghogonalize
 // A[..][1..DimL]: vectors
 // DimL: vector dimension
-void OrthogonalizeVector(const int *OrthoSet, const double *NormSet,int NOrthoSet,INDEX indexColumn,double **A,int DimL) {
+void OrthogonalizeVector(const FENO *pFeno,const int *OrthoSet, const double *NormSet,int NOrthoSet,INDEX indexColumn,double **A,int DimL) {
   for (int j=0;j<NOrthoSet;j++) {
 
     if (NormSet[j]!=0.) {
-      const int indexSvd=Feno->TabCross[OrthoSet[j]].IndSvdA;
+      const int indexSvd=pFeno->TabCross[OrthoSet[j]].IndSvdA;
 
       double dot = 0.;
       for (int i=1;i<=DimL;i++)
@@ -1041,7 +1014,7 @@ void OrthogonalizeVector(const int *OrthoSet, const double *NormSet,int NOrthoSe
   }
 }
 
-static void OrthogonalizeToCross(int indexCross,double *NormSet,int currentNOrtho, double **A, int DimL) {
+static void OrthogonalizeToCross(FENO *pFeno,int indexCross,double *NormSet,int currentNOrtho, double **A, int DimL) {
   // Declarations
 
   CROSS_REFERENCE *pTabCross;
@@ -1051,21 +1024,21 @@ static void OrthogonalizeToCross(int indexCross,double *NormSet,int currentNOrth
   DEBUG_FunctionBegin((char *)__func__,DEBUG_FCTTYPE_UTIL);
 #endif
 
-  for (indexTabCross=0;indexTabCross<Feno->NTabCross;indexTabCross++) {
-    pTabCross=&Feno->TabCross[indexTabCross];
+  for (indexTabCross=0;indexTabCross<pFeno->NTabCross;indexTabCross++) {
+    pTabCross=&pFeno->TabCross[indexTabCross];
 
     if (pTabCross->IndOrthog==indexCross) {
-      OrthoSet[currentNOrtho]=indexCross;
-      NormSet[currentNOrtho]=VECTOR_Norm(A[Feno->TabCross[indexCross].IndSvdA],DimL);
+      pFeno->OrthoSet[currentNOrtho]=indexCross;
+      NormSet[currentNOrtho]=VECTOR_Norm(A[pFeno->TabCross[indexCross].IndSvdA],DimL);
 
       if ((ANALYSE_phFilter->filterFunction==NULL) ||
-          (!Feno->hidden && !ANALYSE_phFilter->hpFilterAnalysis) ||
-          ((Feno->hidden==1) && !ANALYSE_phFilter->hpFilterCalib))
-        OrthogonalizeVector(OrthoSet,NormSet,currentNOrtho+1,pTabCross->IndSvdA,A,DimL);
+          (!pFeno->hidden && !ANALYSE_phFilter->hpFilterAnalysis) ||
+          ((pFeno->hidden==1) && !ANALYSE_phFilter->hpFilterCalib))
+        OrthogonalizeVector(pFeno,pFeno->OrthoSet,NormSet,currentNOrtho+1,pTabCross->IndSvdA,A,DimL);
       else
-        OrthogonalizeVector(&OrthoSet[NOrtho],&NormSet[NOrtho],currentNOrtho-NOrtho+1,pTabCross->IndSvdA,A,DimL);
+        OrthogonalizeVector(pFeno,&pFeno->OrthoSet[pFeno->NOrtho],&NormSet[pFeno->NOrtho],currentNOrtho-pFeno->NOrtho+1,pTabCross->IndSvdA,A,DimL);
 
-      OrthogonalizeToCross(indexTabCross,NormSet,currentNOrtho+1,A,DimL);
+      OrthogonalizeToCross(pFeno,indexTabCross,NormSet,currentNOrtho+1,A,DimL);
     }
   }
 
@@ -1078,7 +1051,7 @@ static void OrthogonalizeToCross(int indexCross,double *NormSet,int currentNOrth
 // Differences between two cross sections
 // --------------------------------------
 
-static void XsDifferences(double **A,int DimL)
+static void XsDifferences(FENO *pFeno,double **A,int DimL)
  {
   // Declarations
 
@@ -1086,13 +1059,13 @@ static void XsDifferences(double **A,int DimL)
 
   // Subtraction
 
-  for (int j=0;j<Feno->NTabCross;j++)   // Index in the WorkSpace symbols list -> use IndSvdA to have indexes in the matrix
+  for (int j=0;j<pFeno->NTabCross;j++)   // Index in the WorkSpace symbols list -> use IndSvdA to have indexes in the matrix
    {
-    pTabCross=&Feno->TabCross[j];
+    pTabCross=&pFeno->TabCross[j];
 
     if (pTabCross->IndSvdA && (pTabCross->IndSubtract!=ITEM_NONE))
      for (int i=1;i<=DimL;i++)
-      A[pTabCross->IndSvdA][i]=A[Feno->TabCross[pTabCross->IndSubtract].IndSvdA][i]-A[pTabCross->IndSvdA][i];
+      A[pTabCross->IndSvdA][i]=A[pFeno->TabCross[pTabCross->IndSubtract].IndSvdA][i]-A[pTabCross->IndSvdA][i];
    }
  }
 
@@ -1100,39 +1073,39 @@ static void XsDifferences(double **A,int DimL)
 // Orthogonalization : Orthogonalization of matrix A processing
 // ------------------------------------------------------------
 
-static void Orthogonalization(double **A, int DimL) {
-  if (NOrtho) { // if no orthogonal base, cross sections can not be orthogonalized to another cross section
+static void Orthogonalization(FENO *pFeno,double **A, int DimL) {
+  if (pFeno->NOrtho) { // if no orthogonal base, cross sections can not be orthogonalized to another cross section
 
-    double NormSet[Feno->NTabCross];
+    double NormSet[pFeno->NTabCross];
 
-    NormSet[0]=VECTOR_Norm(A[Feno->TabCross[OrthoSet[0]].IndSvdA],DimL);
-    for (int i=1;i<NOrtho;++i) {
+    NormSet[0]=VECTOR_Norm(A[pFeno->TabCross[pFeno->OrthoSet[0]].IndSvdA],DimL);
+    for (int i=1;i<pFeno->NOrtho;++i) {
       // orthogonalize vector i w.r.t. vectors 0..i-1:
-      OrthogonalizeVector(OrthoSet,NormSet,i,Feno->TabCross[OrthoSet[i]].IndSvdA,A,DimL);
+      OrthogonalizeVector(pFeno,pFeno->OrthoSet,NormSet,i,pFeno->TabCross[pFeno->OrthoSet[i]].IndSvdA,A,DimL);
       // calculate norm of orthogonalized vector i:
-      NormSet[i]=VECTOR_Norm(A[Feno->TabCross[OrthoSet[i]].IndSvdA],DimL);
+      NormSet[i]=VECTOR_Norm(A[pFeno->TabCross[pFeno->OrthoSet[i]].IndSvdA],DimL);
     }
 
     // Orthogonalization to base only
 
     if ((ANALYSE_phFilter->filterFunction==NULL) ||
-        (!Feno->hidden && !ANALYSE_phFilter->hpFilterAnalysis) ||
-        ((Feno->hidden==1) && !ANALYSE_phFilter->hpFilterCalib))
+        (!pFeno->hidden && !ANALYSE_phFilter->hpFilterAnalysis) ||
+        ((pFeno->hidden==1) && !ANALYSE_phFilter->hpFilterCalib))
 
-      for (int j=0;j<Feno->NTabCross;j++) {
-        CROSS_REFERENCE *pTabCross=&Feno->TabCross[j];
+      for (int j=0;j<pFeno->NTabCross;j++) {
+        CROSS_REFERENCE *pTabCross=&pFeno->TabCross[j];
 
         if (pTabCross->IndSvdA && (pTabCross->IndOrthog==ORTHOGONAL_BASE))
-          OrthogonalizeVector(OrthoSet,NormSet,NOrtho,pTabCross->IndSvdA,A,DimL);
+          OrthogonalizeVector(pFeno,pFeno->OrthoSet,NormSet,pFeno->NOrtho,pTabCross->IndSvdA,A,DimL);
       }
 
     // Orthogonalization to base plus another vector
 
-    for (int j=0;j<Feno->NTabCross;j++) {
-      CROSS_REFERENCE *pTabCross=&Feno->TabCross[j];
+    for (int j=0;j<pFeno->NTabCross;j++) {
+      CROSS_REFERENCE *pTabCross=&pFeno->TabCross[j];
 
       if (pTabCross->IndSvdA && (pTabCross->IndOrthog==ORTHOGONAL_BASE))
-       OrthogonalizeToCross(j,NormSet,NOrtho,A,DimL);
+       OrthogonalizeToCross(pFeno,j,NormSet,pFeno->NOrtho,A,DimL);
     }
   }
 }
@@ -1144,7 +1117,7 @@ static void Orthogonalization(double **A, int DimL) {
 // Correction of a cross section by the effective temperature
 // Test 24/01/2002
 
-RC TemperatureCorrection(double *xs,double *A,double *B,double *C,double *newXs,double T, const int n_wavel)
+RC TemperatureCorrection(const ANALYSE_CONTEXT *pContext,double *xs,double *A,double *B,double *C,double *newXs,double T, const int n_wavel)
 {
 #if defined(__DEBUG_) && __DEBUG_
   DEBUG_FunctionBegin((char *)__func__,DEBUG_FCTTYPE_UTIL);
@@ -1152,7 +1125,7 @@ RC TemperatureCorrection(double *xs,double *A,double *B,double *C,double *newXs,
 
   memcpy(newXs,ANALYSE_zeros,sizeof(double)*n_wavel);
 
-  for (int j=LimMin;j<=LimMax;j++)
+  for (int j=pContext->LimMin;j<=pContext->LimMax;j++)
     newXs[j]=xs[j]+(T-241)*A[j]+(T-241)*(T-241)*B[j]+(T-241)*(T-241)*(T-241)*C[j];
 
 #if defined(__DEBUG_) && __DEBUG_
@@ -1166,7 +1139,7 @@ RC TemperatureCorrection(double *xs,double *A,double *B,double *C,double *newXs,
 // ShiftVector : Apply shift and stretch on vector; convolve reference when fitting SFP in Kurucz
 // -----------------------------------------------
 
-RC ShiftVector(const double *lambda, double *source, const double *deriv, double *target, const int n_wavel,
+RC ShiftVector(ANALYSE_CONTEXT *pContext,const double *lambda, double *source, const double *deriv, double *target, const int n_wavel,
                double DSH,double DST,double DST2,                           // first shift and stretch
                double DSH_,double DST_,double DST2_,                        // second shift and stretch
                const double *Param,int fwhmDir,int kuruczFlag,INDEX indexFenoColumn)
@@ -1175,48 +1148,50 @@ RC ShiftVector(const double *lambda, double *source, const double *deriv, double
   DEBUG_FunctionBegin((char *)__func__,DEBUG_FCTTYPE_APPL|DEBUG_FCTTYPE_MEM);
 #endif
 
-  double lambda0 = (!Feno->hidden)?Feno->lambda0: center_pixel_wavelength(SvdPDeb, SvdPFin);
-  memcpy(ANALYSE_shift,ANALYSE_zeros,sizeof(double)*n_wavel);
-  int fwhmFlag=((Feno->analysisType==ANALYSIS_TYPE_FWHM_NLFIT) && (fwhmDir!=0) && (Param!=NULL))?1:0;
-  CROSS_REFERENCE *TabCross=Feno->TabCross;
+  FENO *pFeno=pContext->Feno;
+
+  double lambda0 = (!pFeno->hidden)?pFeno->lambda0: center_pixel_wavelength(pContext->splineX,pContext->SvdPDeb, pContext->SvdPFin);
+  memcpy(pContext->shift,ANALYSE_zeros,sizeof(double)*n_wavel);
+  int fwhmFlag=((pFeno->analysisType==ANALYSIS_TYPE_FWHM_NLFIT) && (fwhmDir!=0) && (Param!=NULL))?1:0;
+  CROSS_REFERENCE *TabCross=pFeno->TabCross;
 
   RC rc=ERROR_ID_NO;
 
   // Buffer allocation for second derivative
 
-  for (int j=LimMin;j<=LimMax;j++) {             // !! p'=p-(DSH+DST*(p-p0)+DST2*(p-p0)^2
+  for (int j=pContext->LimMin;j<=pContext->LimMax;j++) {             // !! p'=p-(DSH+DST*(p-p0)+DST2*(p-p0)^2
     // Second shift and stretch              //    p''=p'-(DSH'+DST'*(p'-p0')+DST2'*(p'-p0')^2
     // with   p=ANALYSE_splineX (Lambda if unit is nm;pixels if unit is pixels)
-    double x0=(ANALYSE_splineX[j]-lambda0);        //        p0'=p0-DSH
-    double y=ANALYSE_splineX[j]-(DSH_+DST_*x0+DST2_*x0*x0);
+    double x0=(pContext->splineX[j]-lambda0);        //        p0'=p0-DSH
+    double y=pContext->splineX[j]-(DSH_+DST_*x0+DST2_*x0*x0);
 
     // First shift and stretch
 
     x0=(y-lambda0+DSH_);
-    ANALYSE_shift[j]=y-(DSH+DST*x0*StretchFact1+DST2*x0*x0*StretchFact2);
+    pContext->shift[j]=y-(DSH+DST*x0*pContext->StretchFact1+DST2*x0*x0*pContext->StretchFact2);
 
     // Fit difference of resolution between spectrum and reference
 
     if (fwhmFlag) {
       double fwhm= 0.;
 
-      const double deltaX=(ANALYSE_splineX[j]-lambda0);
+      const double deltaX=(pContext->splineX[j]-lambda0);
 
-      if (Feno->indexFwhmConst!=ITEM_NONE)
-       fwhm+=(TabCross[Feno->indexFwhmConst].FitParam!=ITEM_NONE)?(double)Param[TabCross[Feno->indexFwhmConst].FitParam]:(double)TabCross[Feno->indexFwhmConst].InitParam;
-      if (Feno->indexFwhmOrder1!=ITEM_NONE)
-       fwhm+=((TabCross[Feno->indexFwhmOrder1].FitParam!=ITEM_NONE)?(double)Param[TabCross[Feno->indexFwhmOrder1].FitParam]:(double)TabCross[Feno->indexFwhmOrder1].InitParam)*deltaX*TabCross[Feno->indexFwhmOrder1].Fact;
-      if (Feno->indexFwhmOrder2!=ITEM_NONE)
-       fwhm+=((TabCross[Feno->indexFwhmOrder2].FitParam!=ITEM_NONE)?(double)Param[TabCross[Feno->indexFwhmOrder2].FitParam]:(double)TabCross[Feno->indexFwhmOrder2].InitParam)*deltaX*deltaX*TabCross[Feno->indexFwhmOrder2].Fact;
+      if (pFeno->indexFwhmConst!=ITEM_NONE)
+       fwhm+=(TabCross[pFeno->indexFwhmConst].FitParam!=ITEM_NONE)?(double)Param[TabCross[pFeno->indexFwhmConst].FitParam]:(double)TabCross[pFeno->indexFwhmConst].InitParam;
+      if (pFeno->indexFwhmOrder1!=ITEM_NONE)
+       fwhm+=((TabCross[pFeno->indexFwhmOrder1].FitParam!=ITEM_NONE)?(double)Param[TabCross[pFeno->indexFwhmOrder1].FitParam]:(double)TabCross[pFeno->indexFwhmOrder1].InitParam)*deltaX*TabCross[pFeno->indexFwhmOrder1].Fact;
+      if (pFeno->indexFwhmOrder2!=ITEM_NONE)
+       fwhm+=((TabCross[pFeno->indexFwhmOrder2].FitParam!=ITEM_NONE)?(double)Param[TabCross[pFeno->indexFwhmOrder2].FitParam]:(double)TabCross[pFeno->indexFwhmOrder2].InitParam)*deltaX*deltaX*TabCross[pFeno->indexFwhmOrder2].Fact;
 
       // Apply shift and stretch
 
       if ( fwhm!=(double)0. &&
            ( (fwhmDir>0 && fwhm>(double)0.) || (fwhmDir<0 && fwhm<(double)0.) ) ) {
-        rc = XSCONV_TypeGauss(lambda,source,deriv,ANALYSE_shift[j],(ANALYSE_splineX[j+1]-ANALYSE_splineX[j]),
+        rc = XSCONV_TypeGauss(lambda,source,deriv,pContext->shift[j],(pContext->splineX[j+1]-pContext->splineX[j]),
                               &target[j],fabs(fwhm),(double)0.,SLIT_TYPE_GAUSS, n_wavel);
       } else {
-        rc = SPLINE_Vector(lambda,source,deriv,n_wavel,&ANALYSE_shift[j],&target[j],1,pAnalysisOptions->interpol);
+        rc = SPLINE_Vector(lambda,source,deriv,n_wavel,&pContext->shift[j],&target[j],1,pAnalysisOptions->interpol);
       }
       if (rc != ERROR_ID_NO)
         break;
@@ -1231,17 +1206,17 @@ RC ShiftVector(const double *lambda, double *source, const double *deriv, double
 
     // Initializations
 
-    slitParam=(Feno->indexFwhmParam[0]!=ITEM_NONE)?((TabCross[Feno->indexFwhmParam[0]].FitParam!=ITEM_NONE)?(double)Param[TabCross[Feno->indexFwhmParam[0]].FitParam]:(double)TabCross[Feno->indexFwhmParam[0]].InitParam):(double)0.;
+    slitParam=(pFeno->indexFwhmParam[0]!=ITEM_NONE)?((TabCross[pFeno->indexFwhmParam[0]].FitParam!=ITEM_NONE)?(double)Param[TabCross[pFeno->indexFwhmParam[0]].FitParam]:(double)TabCross[pFeno->indexFwhmParam[0]].InitParam):(double)0.;
 
     if (pKuruczOptions->fwhmType==SLIT_TYPE_INVPOLY)
      slitParam2=(double)pKuruczOptions->invPolyDegree;
-    else if (((pKuruczOptions->fwhmType==SLIT_TYPE_ERF) || (pKuruczOptions->fwhmType==SLIT_TYPE_AGAUSS) || (pKuruczOptions->fwhmType==SLIT_TYPE_SUPERGAUSS) || (pKuruczOptions->fwhmType==SLIT_TYPE_VOIGT)) && (Feno->indexFwhmParam[1]!=ITEM_NONE))
-     slitParam2=(TabCross[Feno->indexFwhmParam[1]].FitParam!=ITEM_NONE)?(double)Param[TabCross[Feno->indexFwhmParam[1]].FitParam]:(double)TabCross[Feno->indexFwhmParam[1]].InitParam;
+    else if (((pKuruczOptions->fwhmType==SLIT_TYPE_ERF) || (pKuruczOptions->fwhmType==SLIT_TYPE_AGAUSS) || (pKuruczOptions->fwhmType==SLIT_TYPE_SUPERGAUSS) || (pKuruczOptions->fwhmType==SLIT_TYPE_VOIGT)) && (pFeno->indexFwhmParam[1]!=ITEM_NONE))
+     slitParam2=(TabCross[pFeno->indexFwhmParam[1]].FitParam!=ITEM_NONE)?(double)Param[TabCross[pFeno->indexFwhmParam[1]].FitParam]:(double)TabCross[pFeno->indexFwhmParam[1]].InitParam;
     else
      slitParam2=(double)0.;
 
     if (pKuruczOptions->fwhmType==SLIT_TYPE_SUPERGAUSS)
-     slitParam3=(TabCross[Feno->indexFwhmParam[2]].FitParam!=ITEM_NONE)?(double)Param[TabCross[Feno->indexFwhmParam[2]].FitParam]:(double)TabCross[Feno->indexFwhmParam[2]].InitParam;
+     slitParam3=(TabCross[pFeno->indexFwhmParam[2]].FitParam!=ITEM_NONE)?(double)Param[TabCross[pFeno->indexFwhmParam[2]].FitParam]:(double)TabCross[pFeno->indexFwhmParam[2]].InitParam;
     else
      slitParam3=(double)0.;
 
@@ -1254,7 +1229,7 @@ RC ShiftVector(const double *lambda, double *source, const double *deriv, double
 
       rc=SPLINE_Vector(KURUCZ_buffers[indexFenoColumn].hrSolar.matrix[0],KURUCZ_buffers[indexFenoColumn].hrSolar.matrix[1],
                        KURUCZ_buffers[indexFenoColumn].hrSolar.deriv2[1],KURUCZ_buffers[indexFenoColumn].hrSolar.nl,
-                       ANALYSE_shift,source,n_wavel,pAnalysisOptions->interpol);
+                       pContext->shift,source,n_wavel,pAnalysisOptions->interpol);
 
      }
     else
@@ -1264,9 +1239,10 @@ RC ShiftVector(const double *lambda, double *source, const double *deriv, double
         double F,G,w,a,sigma,delta,step;
         INDEX i;
         int ndemi;
+        FFT *pFft=pContext->pKuruczFft;
 
-        ndemi=pKURUCZ_fft->fftSize>>1;
-        step=(pKURUCZ_fft->fftIn[pKURUCZ_fft->oldSize]-pKURUCZ_fft->fftIn[1])/(pKURUCZ_fft->oldSize-1.);
+        ndemi=pFft->fftSize>>1;
+        step=(pFft->fftIn[pFft->oldSize]-pFft->fftIn[1])/(pFft->oldSize-1.);
 
         sigma=slitParam*0.5;
         a=sigma/sqrt(log(2.));
@@ -1276,8 +1252,8 @@ RC ShiftVector(const double *lambda, double *source, const double *deriv, double
         F=exp(-a*a*w*w*0.25);
         G=(pKuruczOptions->fwhmType==SLIT_TYPE_GAUSS)?(double)1.:sin(w*delta)/(w*delta);
 
-        pKURUCZ_fft->invFftIn[1]=pKURUCZ_fft->fftOut[1];
-        pKURUCZ_fft->invFftIn[2]=pKURUCZ_fft->fftOut[2]*F*G;
+        pFft->invFftIn[1]=pFft->fftOut[1];
+        pFft->invFftIn[2]=pFft->fftOut[2]*F*G;
 
         for (i=2;i<=ndemi;i++)
          {
@@ -1286,21 +1262,21 @@ RC ShiftVector(const double *lambda, double *source, const double *deriv, double
            F=(double)exp(-a*a*w*w*0.25);
            G=(double)(pKuruczOptions->fwhmType==SLIT_TYPE_GAUSS)?(double)1.:(double)sin(w*delta)/(w*delta);
 
-           pKURUCZ_fft->invFftIn[(i<<1) /* i*2 */-1]=pKURUCZ_fft->fftOut[(i<<1) /* i*2 */-1]*F*G;      // Real part
-           pKURUCZ_fft->invFftIn[(i<<1) /* i*2 */]=pKURUCZ_fft->fftOut[(i<<1) /* i*2 */]*F*G;          // Imaginary part
+           pFft->invFftIn[(i<<1) /* i*2 */-1]=pFft->fftOut[(i<<1) /* i*2 */-1]*F*G;      // Real part
+           pFft->invFftIn[(i<<1) /* i*2 */]=pFft->fftOut[(i<<1) /* i*2 */]*F*G;          // Imaginary part
          }
 
-        realft(pKURUCZ_fft->invFftIn,pKURUCZ_fft->invFftOut,pKURUCZ_fft->fftSize,-1);
+        realft(pFft->invFftIn,pFft->invFftOut,pFft->fftSize,-1);
 
-        for (i=1;i<=pKURUCZ_fft->fftSize;i++)
-          pKURUCZ_fft->invFftOut[i]/=step;
+        for (i=1;i<=pFft->fftSize;i++)
+          pFft->invFftOut[i]/=step;
 
-        SPLINE_Deriv2(pKURUCZ_fft->fftIn+1,pKURUCZ_fft->invFftOut+1,pKURUCZ_fft->invFftIn+1,pKURUCZ_fft->oldSize,(char *)__func__);
+        SPLINE_Deriv2(pFft->fftIn+1,pFft->invFftOut+1,pFft->invFftIn+1,pFft->oldSize,(char *)__func__);
 
-        memcpy(&source[LimMin],&ANALYSE_shift[LimMin],sizeof(double)*LimN);
+        memcpy(&source[pContext->LimMin],&pContext->shift[pContext->LimMin],sizeof(double)*pContext->LimN);
 
-        SPLINE_Vector(pKURUCZ_fft->fftIn+1,pKURUCZ_fft->invFftOut+1,pKURUCZ_fft->invFftIn+1,pKURUCZ_fft->oldSize,
-                      &ANALYSE_shift[LimMin],&target[LimMin],LimN,pAnalysisOptions->interpol);
+        SPLINE_Vector(pFft->fftIn+1,pFft->invFftOut+1,pFft->invFftIn+1,pFft->oldSize,
+                      &pContext->shift[pContext->LimMin],&target[pContext->LimMin],pContext->LimN,pAnalysisOptions->interpol);
       } else {
        	MATRIX_OBJECT xsNew;
        	MATRIX_OBJECT slitMatrix[NSFP];
@@ -1321,7 +1297,7 @@ RC ShiftVector(const double *lambda, double *source, const double *deriv, double
          }
         else
          {
-          memcpy(xsNew.matrix[0],ANALYSE_shift,sizeof(double)*n_wavel);
+          memcpy(xsNew.matrix[0],pContext->shift,sizeof(double)*n_wavel);
           memcpy(xsNew.matrix[1],target,sizeof(double)*n_wavel);
 
           slitType=pKuruczOptions->fwhmType;
@@ -1333,12 +1309,12 @@ RC ShiftVector(const double *lambda, double *source, const double *deriv, double
 
             shiftIndex=(nc==2)?0:1;
 
-            fwhmStretch1=(Feno->indexFwhmParam[0]!=ITEM_NONE)?
-              ((TabCross[Feno->indexFwhmParam[0]].FitParam!=ITEM_NONE)?(double)Param[TabCross[Feno->indexFwhmParam[0]].FitParam]:(double)TabCross[Feno->indexFwhmParam[0]].InitParam)
+            fwhmStretch1=(pFeno->indexFwhmParam[0]!=ITEM_NONE)?
+              ((TabCross[pFeno->indexFwhmParam[0]].FitParam!=ITEM_NONE)?(double)Param[TabCross[pFeno->indexFwhmParam[0]].FitParam]:(double)TabCross[pFeno->indexFwhmParam[0]].InitParam)
               :(double)1.;
 
-            fwhmStretch2=(Feno->indexFwhmParam[1]!=ITEM_NONE)?
-              ((TabCross[Feno->indexFwhmParam[1]].FitParam!=ITEM_NONE)?(double)Param[TabCross[Feno->indexFwhmParam[1]].FitParam]:(double)TabCross[Feno->indexFwhmParam[1]].InitParam)
+            fwhmStretch2=(pFeno->indexFwhmParam[1]!=ITEM_NONE)?
+              ((TabCross[pFeno->indexFwhmParam[1]].FitParam!=ITEM_NONE)?(double)Param[TabCross[pFeno->indexFwhmParam[1]].FitParam]:(double)TabCross[pFeno->indexFwhmParam[1]].InitParam)
               :(double)1.;
 
            if (MATRIX_Allocate(&slitMatrix[0],nl,nc,0,0,1,"ShiftVector (slitMatrix)"))
@@ -1393,13 +1369,13 @@ RC ShiftVector(const double *lambda, double *source, const double *deriv, double
             slitOptions.slitParam2=slitParam2;
             slitOptions.slitParam3=slitParam3;
 
-            memcpy(&source[LimMin],&ANALYSE_shift[LimMin],sizeof(double)*LimN);
+            memcpy(&source[pContext->LimMin],&pContext->shift[pContext->LimMin],sizeof(double)*pContext->LimN);
             rc=XSCONV_LoadSlitFunction(slitMatrix,&slitOptions,NULL,&slitType);
            }
 
           if (!rc &&
-               !(rc=XSCONV_TypeStandard(&xsNew,LimMin,LimMax+1,&KURUCZ_buffers[indexFenoColumn].hrSolar,
-                                        &KURUCZ_buffers[indexFenoColumn].hrSolar,NULL,slitType,slitMatrix,slitParamVector,0)))
+               !(rc=XSCONV_TypeStandard(&xsNew,pContext->LimMin,pContext->LimMax+1,&KURUCZ_buffers[indexFenoColumn].hrSolar,
+                                        &KURUCZ_buffers[indexFenoColumn].hrSolar,NULL,slitType,slitMatrix,slitParamVector,0,NULL)))
 
             memcpy(target,xsNew.matrix[1],sizeof(double)*n_wavel);
          }
@@ -1412,16 +1388,16 @@ RC ShiftVector(const double *lambda, double *source, const double *deriv, double
 
     }
 
-    if (hFilterRefLog && !(rc=SPLINE_Vector(KURUCZ_buffers[indexFenoColumn].lambdaF,KURUCZ_buffers[indexFenoColumn].solarF,KURUCZ_buffers[indexFenoColumn].solarF2,n_wavel+2*KURUCZ_buffers[indexFenoColumn].solarFGap,ANALYSE_shift+LimMin,source+LimMin,LimN,pAnalysisOptions->interpol))) {
+    if (pContext->hFilterRefLog && !(rc=SPLINE_Vector(KURUCZ_buffers[indexFenoColumn].lambdaF,KURUCZ_buffers[indexFenoColumn].solarF,KURUCZ_buffers[indexFenoColumn].solarF2,n_wavel+2*KURUCZ_buffers[indexFenoColumn].solarFGap,pContext->shift+pContext->LimMin,source+pContext->LimMin,pContext->LimN,pAnalysisOptions->interpol))) {
       int i;
-      for (i=LimMin;(i<=LimMax) && (source[i]>(double)0.) && (target[i]>(double)0.);i++)
+      for (i=pContext->LimMin;(i<=pContext->LimMax) && (source[i]>(double)0.) && (target[i]>(double)0.);i++)
         target[i]=log(target[i]/source[i]);
 
-      if (i<=LimMax)
-        rc=ERROR_SetLast((char *)__func__,ERROR_TYPE_WARNING,ERROR_ID_LOG,analyseIndexRecord);
+      if (i<=pContext->LimMax)
+        rc=ERROR_SetLast((char *)__func__,ERROR_TYPE_WARNING,ERROR_ID_LOG,pContext->indexRecord);
     }
   } else if (!fwhmFlag) {
-    rc=SPLINE_Vector(lambda,source,deriv,n_wavel,&ANALYSE_shift[LimMin],&target[LimMin],LimN,pAnalysisOptions->interpol);
+    rc=SPLINE_Vector(lambda,source,deriv,n_wavel,&pContext->shift[pContext->LimMin],&target[pContext->LimMin],pContext->LimN,pAnalysisOptions->interpol);
   }
   // Return
 
@@ -1587,17 +1563,72 @@ RC ANALYSE_XsInterpolation(FENO *pTabFeno, const double *newLambda,INDEX indexFe
  return rc;
 }
 
+// -----------------------------------------------------------------------------
+// FUNCTION      AnalyseSlitKey
+// -----------------------------------------------------------------------------
+// PURPOSE       Add a slit function to a key of the cache of convolved vectors
+// -----------------------------------------------------------------------------
+
+static void AnalyseSlitKey(XSCACHE_KEY *pKey,const MATRIX_OBJECT *slitMatrix,const double *slitParam,int slitType,int wveDptFlag)
+ {
+  INDEX i;
+
+  XSCACHE_KeyAdd(pKey,&slitType,sizeof(int));
+  XSCACHE_KeyAdd(pKey,&wveDptFlag,sizeof(int));
+  XSCACHE_KeyAdd(pKey,&pAnalysisOptions->interpol,sizeof(int));
+
+  if (slitParam!=NULL)
+   XSCACHE_KeyAdd(pKey,slitParam,sizeof(double)*NSFP);
+
+  if (slitMatrix!=NULL)
+   for (i=0;i<NSFP;i++)
+    XSCACHE_KeyAddMatrix(pKey,&slitMatrix[i]);
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      AnalyseConvoluteXsKey
+// -----------------------------------------------------------------------------
+// PURPOSE       Build the key of a cross section convolved by ANALYSE_ConvoluteXs
+// -----------------------------------------------------------------------------
+
+static void AnalyseConvoluteXsKey(XSCACHE_KEY *pKey,int action,double conc,const MATRIX_OBJECT *pXs,int icolumn,const MATRIX_OBJECT *pSolar,
+                                  const MATRIX_OBJECT *slitMatrix,const double *slitParam,int slitType,
+                                  const double *newlambda,INDEX indexlambdaMin,INDEX indexlambdaMax,int n_wavel,int wveDptFlag)
+ {
+  int dim[4];
+
+  dim[0]=action;
+  dim[1]=indexlambdaMin;
+  dim[2]=indexlambdaMax;
+  dim[3]=pXs->nl;
+
+  XSCACHE_KeyInit(pKey,"ANALYSE_ConvoluteXs");
+  XSCACHE_KeyAdd(pKey,dim,sizeof(dim));
+  XSCACHE_KeyAdd(pKey,pXs->matrix[0],sizeof(double)*pXs->nl);
+  XSCACHE_KeyAdd(pKey,pXs->matrix[icolumn],sizeof(double)*pXs->nl);
+  XSCACHE_KeyAdd(pKey,newlambda,sizeof(double)*n_wavel);
+
+  if (action==ANLYS_CROSS_ACTION_CONVOLUTE_I0)
+   {
+    XSCACHE_KeyAdd(pKey,&conc,sizeof(double));
+    XSCACHE_KeyAddMatrix(pKey,pSolar);
+   }
+
+  AnalyseSlitKey(pKey,slitMatrix,slitParam,slitType,wveDptFlag);
+ }
+
 RC ANALYSE_ConvoluteXs(const FENO *pTabFeno,int action,double conc,
                        const MATRIX_OBJECT *pXs,
                        const MATRIX_OBJECT *slitMatrix, const double *slitParam, int slitType,
                        const double *newlambda, double *output, INDEX indexlambdaMin, INDEX indexlambdaMax, const int n_wavel,
-                       INDEX indexFenoColumn, int wveDptFlag)
+                       INDEX indexFenoColumn, int wveDptFlag, SLIT_BANK *pSlitBank)
 {
   // Declarations
 
   MATRIX_OBJECT xsNew,xsI0,hrSolar,xshr;
+  XSCACHE_KEY cacheKey;
   double *IcVector;
-  int icolumn;
+  int icolumn,cacheFlag,cacheHit;
   INDEX i,j;
   RC rc;
 
@@ -1610,27 +1641,43 @@ RC ANALYSE_ConvoluteXs(const FENO *pTabFeno,int action,double conc,
   memset(&xsNew,0,sizeof(MATRIX_OBJECT));
   memset(&xsI0,0,sizeof(MATRIX_OBJECT));
   memset(&xshr,0,sizeof(MATRIX_OBJECT));
+  memset(&hrSolar,0,sizeof(MATRIX_OBJECT));
 
   IcVector=NULL;
   icolumn= (pXs->nc==2) ? 1 : 1+indexFenoColumn;
+  cacheHit=0;
 
   rc=ERROR_ID_NO;
 
   memcpy(output,ANALYSE_zeros,sizeof(double)*n_wavel);
 
   if (action==ANLYS_CROSS_ACTION_CONVOLUTE_I0)
+   {
+    // Get high resolution Solar spectrum
+
+    if (pKuruczOptions->fwhmFit && (!pTabFeno->hidden && (pTabFeno->useKurucz!=ANLYS_KURUCZ_NONE)))
+     memcpy(&hrSolar,&KURUCZ_buffers[indexFenoColumn].hrSolar,sizeof(MATRIX_OBJECT));
+    else
+     memcpy(&hrSolar,&ANALYSIS_slitK,sizeof(MATRIX_OBJECT));
+   }
+
+  // Only the slit function of the project properties is cached; the slit functions
+  // fitted by the wavelength calibration change from one record to the other
+
+  if ((cacheFlag=(XSCACHE_Enabled() && (slitMatrix==ANALYSIS_slitMatrix) && (indexlambdaMax>indexlambdaMin)))!=0)
+   {
+    AnalyseConvoluteXsKey(&cacheKey,action,conc,pXs,icolumn,&hrSolar,slitMatrix,slitParam,slitType,newlambda,indexlambdaMin,indexlambdaMax,n_wavel,wveDptFlag);
+
+    if (XSCACHE_Load(&cacheKey,&output[indexlambdaMin],indexlambdaMax-indexlambdaMin))
+     cacheHit=1;
+   }
+
+  if (!cacheHit && (action==ANLYS_CROSS_ACTION_CONVOLUTE_I0))
    {
     if ((IcVector=MEMORY_AllocDVector((char *)__func__,"IcVector",0,n_wavel-1))==NULL)
      rc=ERROR_ID_ALLOC;
     else
      {
-      // Get high resolution Solar spectrum
-
-      if (pKuruczOptions->fwhmFit && (!pTabFeno->hidden && (pTabFeno->useKurucz!=ANLYS_KURUCZ_NONE)))
-       memcpy(&hrSolar,&KURUCZ_buffers[indexFenoColumn].hrSolar,sizeof(MATRIX_OBJECT));
-      else
-       memcpy(&hrSolar,&ANALYSIS_slitK,sizeof(MATRIX_OBJECT));
-
       if (!(rc=MATRIX_Allocate(&xsI0,hrSolar.nl,2,0,0,1,"ANALYSE_ConvoluteXs (xsI0)")) &&
           !(rc=MATRIX_Allocate(&xshr,hrSolar.nl,2,0,0,1,"ANALYSE_ConvoluteXs (xshr)")) &&
           !(rc=SPLINE_Vector(pXs->matrix[0],pXs->matrix[icolumn],pXs->deriv2[icolumn],pXs->nl,           // interpolation of XS on the grid of the high resolution solar spectrum
@@ -1650,10 +1697,10 @@ RC ANALYSE_ConvoluteXs(const FENO *pTabFeno,int action,double conc,
        }
      }
    }
-  else
+  else if (!cacheHit)
    memcpy(&xshr,pXs,sizeof(MATRIX_OBJECT));
 
-  if (!rc && !(rc=MATRIX_Allocate(&xsNew,n_wavel,2,0,0,1,(char *)__func__)))
+  if (!rc && !cacheHit && !(rc=MATRIX_Allocate(&xsNew,n_wavel,2,0,0,1,(char *)__func__)))
    {
         memcpy(xsNew.matrix[0],newlambda,sizeof(double)*n_wavel);
     memcpy(xsNew.matrix[1],ANALYSE_zeros,sizeof(double)*n_wavel);
@@ -1661,7 +1708,7 @@ RC ANALYSE_ConvoluteXs(const FENO *pTabFeno,int action,double conc,
     if (action==ANLYS_CROSS_ACTION_CONVOLUTE_I0)
      memcpy(IcVector,ANALYSE_zeros,sizeof(double)*n_wavel);
 
-    if (!(rc=XSCONV_TypeStandard(&xsNew,indexlambdaMin,indexlambdaMax,&xshr,(action==ANLYS_CROSS_ACTION_CONVOLUTE_I0)?&xsI0:&xshr,IcVector,slitType,slitMatrix,(double *)slitParam,wveDptFlag)))
+    if (!(rc=XSCONV_TypeStandard(&xsNew,indexlambdaMin,indexlambdaMax,&xshr,(action==ANLYS_CROSS_ACTION_CONVOLUTE_I0)?&xsI0:&xshr,IcVector,slitType,slitMatrix,(double *)slitParam,wveDptFlag,pSlitBank)))
      {
       for (j=indexlambdaMin;(j<indexlambdaMax) && !rc;j++)
        output[j]=xsNew.matrix[1][j];
@@ -1681,6 +1728,9 @@ RC ANALYSE_ConvoluteXs(const FENO *pTabFeno,int action,double conc,
        else
         output[j]=(double)log(output[j]/IcVector[j])/conc;
       }
+
+    if (!rc && cacheFlag)
+     XSCACHE_Save(&cacheKey,&output[indexlambdaMin],indexlambdaMax-indexlambdaMin);
    }
 
   // Return
@@ -1759,7 +1809,7 @@ RC ANALYSE_XsConvolution(FENO *pTabFeno,double *newlambda,
 
           if (!pTabCross->isPukite &&
               !(rc=ANALYSE_ConvoluteXs(pTabFeno,pTabCross->crossAction,pTabCross->I0Conc,pXs,slitMatrix,slitParam,slitType,
-                                       newlambda,pTabCross->vector,indexlambdaMin,indexlambdaMax,n_wavel,indexFenoColumn,wveDptFlag)) &&
+                                       newlambda,pTabCross->vector,indexlambdaMin,indexlambdaMax,n_wavel,indexFenoColumn,wveDptFlag,&pTabFeno->slitBank)) &&
               ((pTabCross->crossCorrection==ANLYS_CORRECTION_TYPE_SLOPE) ||
                (pTabCross->crossCorrection==ANLYS_CORRECTION_TYPE_PUKITE)) &&
                (pTabCross->indexPukite1!=ITEM_NONE) && (pTabFeno->TabCross[pTabCross->indexPukite1].isPukite==1))
@@ -1776,7 +1826,7 @@ RC ANALYSE_XsConvolution(FENO *pTabFeno,double *newlambda,
                                          newlambda,
                                         (pTabCross->indexPukite1!=ITEM_NONE)?pTabFeno->TabCross[pTabCross->indexPukite1].vector:NULL,(pTabCross->indexPukite1!=ITEM_NONE)?pTabFeno->TabCross[pTabCross->indexPukite1].molecularCrossSection:NULL,
                                         (pTabCross->indexPukite2!=ITEM_NONE)?pTabFeno->TabCross[pTabCross->indexPukite2].vector:NULL,(pTabCross->indexPukite2!=ITEM_NONE)?pTabFeno->TabCross[pTabCross->indexPukite2].molecularCrossSection:NULL,
-                                         indexlambdaMin,indexlambdaMax,n_wavel,indexFenoColumn,wveDptFlag);
+                                         indexlambdaMin,indexlambdaMax,n_wavel,indexFenoColumn,wveDptFlag,&pTabFeno->slitBank);
            }
 
          }
@@ -1802,7 +1852,7 @@ RC ANALYSE_XsConvolution(FENO *pTabFeno,double *newlambda,
             memcpy(matrix.deriv2[1],pXs->deriv2[2],sizeof(double)*pXs->nl);     // Second derivative of the Ramanspectrum
 
             if ((rc=ANALYSE_ConvoluteXs(pTabFeno,ANLYS_CROSS_ACTION_CONVOLUTE,(double)0.,&matrix,slitMatrix,slitParam,slitType,
-                                        newlambda,raman,indexlambdaMin,indexlambdaMax,n_wavel,indexFenoColumn,wveDptFlag))!=ERROR_ID_NO)
+                                        newlambda,raman,indexlambdaMin,indexlambdaMax,n_wavel,indexFenoColumn,wveDptFlag,&pTabFeno->slitBank))!=ERROR_ID_NO)
              break;
 
             // Solar spectrum
@@ -1811,7 +1861,7 @@ RC ANALYSE_XsConvolution(FENO *pTabFeno,double *newlambda,
             memcpy(matrix.deriv2[1],pXs->deriv2[3],sizeof(double)*pXs->nl);     // Second derivative of the Ramanspectrum
 
             if ((rc=ANALYSE_ConvoluteXs(pTabFeno,ANLYS_CROSS_ACTION_CONVOLUTE,(double)0.,&matrix,slitMatrix,slitParam,slitType,
-                                        newlambda,solar,indexlambdaMin,indexlambdaMax,n_wavel,indexFenoColumn,wveDptFlag))!=ERROR_ID_NO)
+                                        newlambda,solar,indexlambdaMin,indexlambdaMax,n_wavel,indexFenoColumn,wveDptFlag,&pTabFeno->slitBank))!=ERROR_ID_NO)
              break;
 
             // Calculate Raman/Solar
@@ -1995,7 +2045,7 @@ RC AnalyseLoadVector(const char *function, const char *fileName, double *lambda,
 // AnalyseFwhmCorrectionK : resolution adjustment between spectrum and reference using fwhms fitted by Kurucz
 // ----------------------------------------------------------------------------------------------------------
 
-RC AnalyseFwhmCorrectionK(const double *Spectre, const double *Sref,double *SpecTrav,double *RefTrav, const int n_wavel, INDEX indexFenoColumn)
+RC AnalyseFwhmCorrectionK(ANALYSE_CONTEXT *pContext,const double *Spectre, const double *Sref,double *SpecTrav,double *RefTrav, const int n_wavel, INDEX indexFenoColumn)
 {
   // Declarations
 
@@ -2025,19 +2075,19 @@ RC AnalyseFwhmCorrectionK(const double *Spectre, const double *Sref,double *Spec
 
   // Second derivatives computation for spectrum and reference
 
-  else if (!(rc=SPLINE_Deriv2(LambdaSpec,Spectre,SplineSpec,n_wavel,"AnalyseFwhmCorrectionK (Lambda) ")) &&  // !!! Lambda -> LambdaSpec
-           !(rc=SPLINE_Deriv2(Lambda,Sref,SplineRef,n_wavel,"AnalyseFwhmCorrectionK (Lambda) ")))
+  else if (!(rc=SPLINE_Deriv2(pContext->LambdaSpec,Spectre,pContext->SplineSpec,n_wavel,"AnalyseFwhmCorrectionK (Lambda) ")) &&  // !!! Lambda -> LambdaSpec
+           !(rc=SPLINE_Deriv2(pContext->Lambda,Sref,pContext->SplineRef,n_wavel,"AnalyseFwhmCorrectionK (Lambda) ")))
    {
     memcpy(xsTrav,ANALYSE_zeros,sizeof(double)*n_wavel);
 
     // Fwhm ajustment between spectrum and reference
 
-    for (j=LimMin;(j<=LimMax) && !rc;j++)
+    for (j=pContext->LimMin;(j<=pContext->LimMax) && !rc;j++)
      {
       // Retrieve fwhm from fwhm vectors build by Kurucz procedure
 
       specFwhm=KURUCZ_buffers[indexFenoColumn].fwhmVector[0][j];
-      refFwhm=Feno->fwhmVector[0][j];
+      refFwhm=pContext->Feno->fwhmVector[0][j];
 
       if ((specFwhm<=(double)0.) || (refFwhm<=(double)0.))
        rc=ERROR_SetLast((char *)__func__,ERROR_TYPE_WARNING,ERROR_ID_SQRT_ARG);
@@ -2048,8 +2098,8 @@ RC AnalyseFwhmCorrectionK(const double *Spectre, const double *Sref,double *Spec
        {
         xsTrav[j]=specFwhm;
         specFwhm=sqrt(specFwhm*specFwhm-refFwhm*refFwhm);
-        rc=XSCONV_TypeGauss(Lambda,Sref,SplineRef,Lambda[j],(Lambda[j+1]-Lambda[j]),&RefTrav[j],specFwhm,
-                            (Feno->fwhmVector[1]!=NULL)?Feno->fwhmVector[1][j]:(double)0.,pKuruczOptions->fwhmType, n_wavel);
+        rc=XSCONV_TypeGauss(pContext->Lambda,Sref,pContext->SplineRef,pContext->Lambda[j],(pContext->Lambda[j+1]-pContext->Lambda[j]),&RefTrav[j],specFwhm,
+                            (pContext->Feno->fwhmVector[1]!=NULL)?pContext->Feno->fwhmVector[1][j]:(double)0.,pKuruczOptions->fwhmType, n_wavel);
        }
 
       // Case 2 : spectrum has highest resolution => degrade spectrum
@@ -2058,8 +2108,8 @@ RC AnalyseFwhmCorrectionK(const double *Spectre, const double *Sref,double *Spec
        {
         xsTrav[j]=refFwhm;
         specFwhm=sqrt(refFwhm*refFwhm-specFwhm*specFwhm);
-        rc=XSCONV_TypeGauss(LambdaSpec,Spectre,SplineSpec,Lambda[j],(Lambda[j+1]-Lambda[j]),&SpecTrav[j],specFwhm,
-                            (Feno->fwhmVector[1]!=NULL)?Feno->fwhmVector[1][j]:(double)0.,pKuruczOptions->fwhmType, n_wavel);
+        rc=XSCONV_TypeGauss(pContext->LambdaSpec,Spectre,pContext->SplineSpec,pContext->Lambda[j],(pContext->Lambda[j+1]-pContext->Lambda[j]),&SpecTrav[j],specFwhm,
+                            (pContext->Feno->fwhmVector[1]!=NULL)?pContext->Feno->fwhmVector[1][j]:(double)0.,pKuruczOptions->fwhmType, n_wavel);
        }
 
       // Case 3 : spectrum and reference have the same resolution
@@ -2092,6 +2142,215 @@ RC AnalyseFwhmCorrectionK(const double *Spectre, const double *Sref,double *Spec
 // SVD WORKSPACE MEMORY MANAGEMENT
 // ===============================
 
+// Temporary vectors of ANALYSE_Function (6) and CurfitNumDeriv (1), which
+// calls ANALYSE_Function.  ANALYSE_Deriv takes 6 vectors but is never called
+// from these functions.
+
+#define ANALYSE_SCRATCH_VECTORS 8
+#define ANALYSE_SCRATCH_ALIGN   8                                               // in doubles (one cache line)
+
+// ----------------------------------------------------------------------------
+// ANALYSE_ContextAlloc : Allocate the working buffers of an analysis context
+// ----------------------------------------------------------------------------
+
+RC ANALYSE_ContextAlloc(ANALYSE_CONTEXT *pContext,int ndet)
+{
+  // Declarations
+
+  RC rc=ERROR_ID_NO;
+
+#if defined(__DEBUG_) && __DEBUG_
+  DEBUG_FunctionBegin((char *)__func__, DEBUG_FCTTYPE_MEM);
+#endif
+
+  // Initialization
+
+  memset(pContext,0,sizeof(*pContext));
+  pContext->ndet=ndet;
+
+  // Allocation
+
+  if (((pContext->Fitp=(double *)MEMORY_AllocDVector((char *)__func__,"Fitp",0,ANALYSE_MAX_NL_PARAMS))==NULL)  ||
+      ((pContext->FitDeltap=(double *)MEMORY_AllocDVector((char *)__func__,"FitDeltap",0,ANALYSE_MAX_NL_PARAMS))==NULL) ||
+      ((pContext->FitMinp=(double *)MEMORY_AllocDVector((char *)__func__,"FitMinp",0,ANALYSE_MAX_NL_PARAMS))==NULL) ||
+      ((pContext->FitMaxp=(double *)MEMORY_AllocDVector((char *)__func__,"FitMaxp",0,ANALYSE_MAX_NL_PARAMS))==NULL) ||
+      ((pContext->b=(double *)MEMORY_AllocDVector((char *)__func__,"b",1,ndet))==NULL) ||
+      ((pContext->x=(double *)MEMORY_AllocDVector((char *)__func__,"x",0,MAX_FIT))==NULL) ||
+      ((pContext->Sigma=(double *)MEMORY_AllocDVector((char *)__func__,"Sigma",0,MAX_FIT))==NULL) ||
+      ((pContext->shift=(double *)MEMORY_AllocDVector((char *)__func__,"shift",0,ndet-1))==NULL) ||
+      ((pContext->splineX=(double *)MEMORY_AllocDVector((char *)__func__,"splineX",0,ndet-1))==NULL) ||
+      ((pContext->absolu=(double *)MEMORY_AllocDVector((char *)__func__,"absolu",0,ndet))==NULL) ||
+      ((pContext->t=(double *)MEMORY_AllocDVector((char *)__func__,"t",0,ndet))==NULL) ||
+      ((pContext->tc=(double *)MEMORY_AllocDVector((char *)__func__,"tc",0,ndet))==NULL) ||
+      ((pContext->xsTrav=(double *)MEMORY_AllocDVector((char *)__func__,"xsTrav",0,ndet-1))==NULL) ||
+      ((pContext->xsTrav2=(double *)MEMORY_AllocDVector((char *)__func__,"xsTrav2",0,ndet-1))==NULL) ||
+      ((pContext->secX=(double *)MEMORY_AllocDVector((char *)__func__,"secX",0,ndet))==NULL) ||
+      ((pContext->SplineSpec=(double *)MEMORY_AllocDVector((char *)__func__,"SplineSpec",0,ndet-1))==NULL) ||
+      ((pContext->SplineRef=(double *)MEMORY_AllocDVector((char *)__func__,"SplineRef",0,ndet-1))==NULL) ||
+      ((pContext->scratch=(double *)MEMORY_AllocDVector((char *)__func__,"scratch",0,ANALYSE_SCRATCH_VECTORS*(ndet+ANALYSE_SCRATCH_ALIGN)-1))==NULL) ||
+      ((pContext->curfitWeight=(double *)MEMORY_AllocDVector((char *)__func__,"curfitWeight",0,ndet-1))==NULL))
+
+   rc=ERROR_ID_ALLOC;
+
+  else
+   {
+    pContext->Sigma[0]=pContext->x[0]=(double)0.;
+    pContext->scratchSize=ANALYSE_SCRATCH_VECTORS*(ndet+ANALYSE_SCRATCH_ALIGN);
+   }
+
+#if defined(__DEBUG_) && __DEBUG_
+  DEBUG_FunctionStop((char *)__func__,rc);
+#endif
+
+  return rc;
+}
+
+// ----------------------------------------------------------------------------
+// AnalyseCurfitFree : Release the buffers of Curfit
+// ----------------------------------------------------------------------------
+
+static void AnalyseCurfitFree(ANALYSE_CONTEXT *pContext)
+{
+  if (pContext->curfitB!=NULL)
+   MEMORY_ReleaseDVector((char *)__func__,"curfitB",pContext->curfitB,0);
+  if (pContext->curfitBeta!=NULL)
+   MEMORY_ReleaseDVector((char *)__func__,"curfitBeta",pContext->curfitBeta,0);
+  if (pContext->curfitAlpha!=NULL)
+   MEMORY_ReleaseDMatrix((char *)__func__,"curfitAlpha",pContext->curfitAlpha,0,0);
+  if (pContext->curfitArray!=NULL)
+   MEMORY_ReleaseDMatrix((char *)__func__,"curfitArray",pContext->curfitArray,0,0);
+  if (pContext->curfitDeriv!=NULL)
+   MEMORY_ReleaseDMatrix((char *)__func__,"curfitDeriv",pContext->curfitDeriv,0,0);
+  if (pContext->curfitIk!=NULL)
+   MEMORY_ReleaseBuffer((char *)__func__,"curfitIk",pContext->curfitIk);
+  if (pContext->curfitJk!=NULL)
+   MEMORY_ReleaseBuffer((char *)__func__,"curfitJk",pContext->curfitJk);
+
+  pContext->curfitB=pContext->curfitBeta=NULL;
+  pContext->curfitAlpha=pContext->curfitArray=pContext->curfitDeriv=NULL;
+  pContext->curfitIk=pContext->curfitJk=NULL;
+  pContext->curfitSize=0;
+}
+
+// ----------------------------------------------------------------------------
+// ANALYSE_CurfitAlloc : Allocate the buffers of Curfit for nParams non linear parameters
+// ----------------------------------------------------------------------------
+//
+// The buffers are sized from the number of non linear parameters of the
+// analysis windows fitted with the context; they are allocated with the first
+// fit and reallocated only when a window has more parameters than the previous
+// ones.
+
+RC ANALYSE_CurfitAlloc(ANALYSE_CONTEXT *pContext,int nParams)
+{
+  RC rc=ERROR_ID_NO;
+
+  if (nParams>pContext->curfitSize)
+   {
+    AnalyseCurfitFree(pContext);
+
+    if (((pContext->curfitB=(double *)MEMORY_AllocDVector((char *)__func__,"curfitB",0,nParams-1))==NULL) ||
+        ((pContext->curfitBeta=(double *)MEMORY_AllocDVector((char *)__func__,"curfitBeta",0,nParams-1))==NULL) ||
+        ((pContext->curfitAlpha=(double **)MEMORY_AllocDMatrix((char *)__func__,"curfitAlpha",0,nParams-1,0,nParams-1))==NULL) ||
+        ((pContext->curfitArray=(double **)MEMORY_AllocDMatrix((char *)__func__,"curfitArray",0,nParams-1,0,nParams-1))==NULL) ||
+        ((pContext->curfitDeriv=(double **)MEMORY_AllocDMatrix((char *)__func__,"curfitDeriv",0,pContext->ndet-1,0,nParams-1))==NULL) ||
+        ((pContext->curfitIk=(int *)MEMORY_AllocBuffer((char *)__func__,"curfitIk",nParams,sizeof(int),0,MEMORY_TYPE_INT))==NULL) ||
+        ((pContext->curfitJk=(int *)MEMORY_AllocBuffer((char *)__func__,"curfitJk",nParams,sizeof(int),0,MEMORY_TYPE_INT))==NULL))
+     {
+      AnalyseCurfitFree(pContext);
+      rc=ERROR_ID_ALLOC;
+     }
+    else
+     pContext->curfitSize=nParams;
+   }
+
+  return rc;
+}
+
+// ----------------------------------------------------------------------------
+// ANALYSE_ContextFree : Release the working buffers of an analysis context
+// ----------------------------------------------------------------------------
+
+void ANALYSE_ContextFree(ANALYSE_CONTEXT *pContext)
+{
+#if defined(__DEBUG_) && __DEBUG_
+  DEBUG_FunctionBegin((char *)__func__, DEBUG_FCTTYPE_MEM);
+#endif
+
+  if (pContext->Fitp!=NULL)
+   MEMORY_ReleaseDVector((char *)__func__,"Fitp",pContext->Fitp,0);
+  if (pContext->FitDeltap!=NULL)
+   MEMORY_ReleaseDVector((char *)__func__,"FitDeltap",pContext->FitDeltap,0);
+  if (pContext->FitMinp!=NULL)
+   MEMORY_ReleaseDVector((char *)__func__,"FitMinp",pContext->FitMinp,0);
+  if (pContext->FitMaxp!=NULL)
+   MEMORY_ReleaseDVector((char *)__func__,"FitMaxp",pContext->FitMaxp,0);
+  if (pContext->b!=NULL)
+   MEMORY_ReleaseDVector((char *)__func__,"b",pContext->b,1);
+  if (pContext->x!=NULL)
+   MEMORY_ReleaseDVector((char *)__func__,"x",pContext->x,0);
+  if (pContext->Sigma!=NULL)
+   MEMORY_ReleaseDVector((char *)__func__,"Sigma",pContext->Sigma,0);
+  if (pContext->shift!=NULL)
+   MEMORY_ReleaseDVector((char *)__func__,"shift",pContext->shift,0);
+  if (pContext->splineX!=NULL)
+   MEMORY_ReleaseDVector((char *)__func__,"splineX",pContext->splineX,0);
+  if (pContext->absolu!=NULL)
+   MEMORY_ReleaseDVector((char *)__func__,"absolu",pContext->absolu,0);
+  if (pContext->t!=NULL)
+   MEMORY_ReleaseDVector((char *)__func__,"t",pContext->t,0);
+  if (pContext->tc!=NULL)
+   MEMORY_ReleaseDVector((char *)__func__,"tc",pContext->tc,0);
+  if (pContext->xsTrav!=NULL)
+   MEMORY_ReleaseDVector((char *)__func__,"xsTrav",pContext->xsTrav,0);
+  if (pContext->xsTrav2!=NULL)
+   MEMORY_ReleaseDVector((char *)__func__,"xsTrav2",pContext->xsTrav2,0);
+  if (pContext->secX!=NULL)
+   MEMORY_ReleaseDVector((char *)__func__,"secX",pContext->secX,0);
+  if (pContext->SplineSpec!=NULL)
+   MEMORY_ReleaseDVector((char *)__func__,"SplineSpec",pContext->SplineSpec,0);
+  if (pContext->SplineRef!=NULL)
+   MEMORY_ReleaseDVector((char *)__func__,"SplineRef",pContext->SplineRef,0);
+  if (pContext->scratch!=NULL)
+   MEMORY_ReleaseDVector((char *)__func__,"scratch",pContext->scratch,0);
+  if (pContext->curfitWeight!=NULL)
+   MEMORY_ReleaseDVector((char *)__func__,"curfitWeight",pContext->curfitWeight,0);
+
+  AnalyseCurfitFree(pContext);
+
+  memset(pContext,0,sizeof(*pContext));
+
+#if defined(__DEBUG_) && __DEBUG_
+  DEBUG_FunctionStop((char *)__func__,0);
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// ANALYSE_ScratchAlloc : Take a temporary vector of n doubles from the scratch
+//                        buffer of an analysis context
+// ----------------------------------------------------------------------------
+//
+// Avoids a heap allocation in each call of the fitting function.  Vectors
+// are released together, in the reverse order of their allocation, by
+// restoring pContext->scratchUsed to its value before the allocation.  The
+// content of the vector is undefined.  Returns NULL if the buffer is full.
+// ----------------------------------------------------------------------------
+
+double *ANALYSE_ScratchAlloc(ANALYSE_CONTEXT *pContext,int n)
+{
+  double *vector;
+
+  n=(n+ANALYSE_SCRATCH_ALIGN-1)/ANALYSE_SCRATCH_ALIGN*ANALYSE_SCRATCH_ALIGN;
+
+  if ((n<=0) || (pContext->scratchUsed+n>pContext->scratchSize))
+   return NULL;
+
+  vector=pContext->scratch+pContext->scratchUsed;
+  pContext->scratchUsed+=n;
+
+  return vector;
+}
+
 // ------------------------------------------
 // AnalyseSvdGlobalAlloc : Global allocations
 // ------------------------------------------
@@ -2114,33 +2373,16 @@ RC AnalyseSvdGlobalAlloc(void)
       max_ndet = NDET[i];
   }
 
-  // Allocation
+  // Allocation : the pixels vector is shared and read-only; the working buffers
+  // of the fit belong to the analysis context of the main thread
 
-  if (((Fitp=(double *)MEMORY_AllocDVector((char *)__func__,"Fitp",0,MAX_FIT*4))==NULL)  ||
-      ((FitDeltap=(double *)MEMORY_AllocDVector((char *)__func__,"FitDeltap",0,MAX_FIT*4))==NULL) ||
-      ((FitMinp=(double *)MEMORY_AllocDVector((char *)__func__,"FitMinp",0,MAX_FIT*4))==NULL) ||
-      ((FitMaxp=(double *)MEMORY_AllocDVector((char *)__func__,"FitMaxp",0,MAX_FIT*4))==NULL) ||
-      ((a=(double *)MEMORY_AllocDVector((char *)__func__,"a",1,max_ndet))==NULL) ||
-      ((b=(double *)MEMORY_AllocDVector((char *)__func__,"b",1,max_ndet))==NULL) ||
-      ((x=(double *)MEMORY_AllocDVector((char *)__func__,"x",0,MAX_FIT))==NULL) ||
-      ((Sigma=(double *)MEMORY_AllocDVector((char *)__func__,"Sigma",0,MAX_FIT))==NULL) ||
-      ((ANALYSE_shift=(double *)MEMORY_AllocDVector((char *)__func__,"ANALYSE_shift",0,max_ndet-1))==NULL) ||
-      ((ANALYSE_pixels=(double *)MEMORY_AllocDVector((char *)__func__,"ANALYSE_pixels",0,max_ndet-1))==NULL) ||
-      ((ANALYSE_splineX=(double *)MEMORY_AllocDVector((char *)__func__,"ANALYSE_splineX",0,max_ndet-1))==NULL) ||
-      ((ANALYSE_absolu=(double *)MEMORY_AllocDVector((char *)__func__,"ANALYSE_absolu",0,max_ndet))==NULL) ||
-      ((ANALYSE_t=(double *)MEMORY_AllocDVector((char *)__func__,"ANALYSE_t",0,max_ndet))==NULL) ||
-      ((ANALYSE_tc=(double *)MEMORY_AllocDVector((char *)__func__,"ANALYSE_tc",0,max_ndet))==NULL) ||
-      ((ANALYSE_xsTrav=(double *)MEMORY_AllocDVector((char *)__func__,"ANALYSE_xsTrav",0,max_ndet-1))==NULL) ||
-      ((ANALYSE_xsTrav2=(double *)MEMORY_AllocDVector((char *)__func__,"ANALYSE_xsTrav2",0,max_ndet-1))==NULL) ||
-      ((ANALYSE_secX=(double *)MEMORY_AllocDVector((char *)__func__,"ANALYSE_secX",0,max_ndet))==NULL) ||
-      ((SplineSpec=(double *)MEMORY_AllocDVector((char *)__func__,"SplineSpec",0,max_ndet-1))==NULL) ||
-      ((SplineRef=(double *)MEMORY_AllocDVector((char *)__func__,"SplineRef",0,max_ndet-1))==NULL))
+  if (((ANALYSE_pixels=(double *)MEMORY_AllocDVector((char *)__func__,"ANALYSE_pixels",0,max_ndet-1))==NULL) ||
+      ((rc=ANALYSE_ContextAlloc(&ANALYSE_context,max_ndet))!=ERROR_ID_NO))
 
    rc=ERROR_ID_ALLOC;
 
   else {
     // Initializations
-    Sigma[0]=x[0]=(double)0.;
 
     for (int i=0;i<max_ndet;i++)
       ANALYSE_pixels[i]= i+1;
@@ -2162,7 +2404,7 @@ RC AnalyseSvdGlobalAlloc(void)
 //                   determination and concentrations computation
 // --------------------------------------------------------------------------
 
-RC ANALYSE_SvdInit(FENO* pFeno, struct fit_properties *fit, const int n_wavel, const double *lambda)
+RC ANALYSE_SvdInit(ANALYSE_CONTEXT *pContext,FENO* pFeno, struct fit_properties *fit, const int n_wavel, const double *lambda)
 {
   // Declarations
 
@@ -2178,10 +2420,7 @@ RC ANALYSE_SvdInit(FENO* pFeno, struct fit_properties *fit, const int n_wavel, c
 
   // Initializations
 
-  memcpy(ANALYSE_splineX,lambda,sizeof(*lambda)*n_wavel);
-
-  OrthoSet=pFeno->OrthoSet;
-  NOrtho=pFeno->NOrtho;
+  memcpy(pContext->splineX,lambda,sizeof(*lambda)*n_wavel);
 
   temp=(double)0.;
 
@@ -2192,17 +2431,17 @@ RC ANALYSE_SvdInit(FENO* pFeno, struct fit_properties *fit, const int n_wavel, c
   //    if ((ANALYSE_phFilter->type!=PRJCT_FILTER_TYPE_NONE) && (ANALYSE_phFilter->type!=PRJCT_FILTER_TYPE_ODDEVEN))
   //     temp+=ANALYSE_phFilter->filterEffWidth;
 
-  ANALYSE_nFree=floor(fit->DimL/((temp>(double)1.e-6)?temp:(double)1.)+0.5)-fit->nFit;
+  pContext->nFree=floor(fit->DimL/((temp>(double)1.e-6)?temp:(double)1.)+0.5)-fit->nFit;
 
-  if (ANALYSE_nFree<=(double)0.)
+  if (pContext->nFree<=(double)0.)
     rc=ERROR_SetLast("SvdInit",ERROR_TYPE_FATAL,ERROR_ID_NFREE);
   else {
-    global_doas_spectrum = fit->specrange;
+    pContext->specrange = fit->specrange;
 
-    SvdPDeb=spectrum_start(fit->specrange);
-    SvdPFin=spectrum_end(fit->specrange);
+    pContext->SvdPDeb=spectrum_start(fit->specrange);
+    pContext->SvdPFin=spectrum_end(fit->specrange);
 
-    lambda0 = (!pFeno->hidden)? pFeno->lambda0:center_pixel_wavelength(SvdPDeb, SvdPFin);
+    lambda0 = (!pFeno->hidden)? pFeno->lambda0:center_pixel_wavelength(pContext->splineX,pContext->SvdPDeb, pContext->SvdPFin);
 
     int Dim=0;
 
@@ -2214,10 +2453,10 @@ RC ANALYSE_SvdInit(FENO* pFeno, struct fit_properties *fit, const int n_wavel, c
 
     Dim=max(Dim,pAnalysisOptions->securityGap);
 
-    LimMin=max(SvdPDeb-Dim,0);
-    LimMax=min(SvdPFin+Dim,n_wavel-1);
+    pContext->LimMin=max(pContext->SvdPDeb-Dim,0);
+    pContext->LimMax=min(pContext->SvdPFin+Dim,n_wavel-1);
 
-    LimN=LimMax-LimMin+1;
+    pContext->LimN=pContext->LimMax-pContext->LimMin+1;
 
     // Set non linear normalization factors
 
@@ -2225,29 +2464,29 @@ RC ANALYSE_SvdInit(FENO* pFeno, struct fit_properties *fit, const int n_wavel, c
 
     doas_iterator my_iterator;
     for( int i = iterator_start(&my_iterator, fit->specrange); i != ITERATOR_FINISHED; i=iterator_next(&my_iterator)) {
-      deltaX=(double)(ANALYSE_splineX[i]-lambda0)*(ANALYSE_splineX[i]-lambda0);
+      deltaX=(double)(pContext->splineX[i]-lambda0)*(pContext->splineX[i]-lambda0);
 
       norm1+=deltaX;
       norm2+=deltaX*deltaX;
     }
 
-    for (j=LimMin,StretchFact1=StretchFact2=(double)0.;j<=LimMax;j++) {
-      deltaX=(ANALYSE_splineX[j]-lambda0);
+    for (j=pContext->LimMin,pContext->StretchFact1=pContext->StretchFact2=(double)0.;j<=pContext->LimMax;j++) {
+      deltaX=(pContext->splineX[j]-lambda0);
 
-      deltaX=ANALYSE_splineX[j]-lambda0-pFeno->Stretch*deltaX-pFeno->Stretch2*deltaX*deltaX;
+      deltaX=pContext->splineX[j]-lambda0-pFeno->Stretch*deltaX-pFeno->Stretch2*deltaX*deltaX;
       deltaX*=deltaX;
 
-      StretchFact1+=deltaX;
-      StretchFact2+=deltaX*deltaX;
+      pContext->StretchFact1+=deltaX;
+      pContext->StretchFact2+=deltaX*deltaX;
     }
 
     if ((norm1<=(double)0.) || (norm2<=(double)0.) ||
-        (StretchFact1<=(double)0.) || (StretchFact2<=(double)0.)) {
+        (pContext->StretchFact1<=(double)0.) || (pContext->StretchFact2<=(double)0.)) {
 
       rc=ERROR_SetLast((char *)__func__,ERROR_TYPE_WARNING,ERROR_ID_SQRT_ARG);
     } else {
-      StretchFact1=(double)1./sqrt(StretchFact1);
-      StretchFact2=(double)1./sqrt(StretchFact2);
+      pContext->StretchFact1=(double)1./sqrt(pContext->StretchFact1);
+      pContext->StretchFact2=(double)1./sqrt(pContext->StretchFact2);
 
       for (i=0,norm1=sqrt(norm1),norm2=sqrt(norm2);i<pFeno->NTabCross;i++) {
         pTabCross=&pFeno->TabCross[i];
@@ -2259,8 +2498,8 @@ RC ANALYSE_SvdInit(FENO* pFeno, struct fit_properties *fit, const int n_wavel, c
         else if ((i==pFeno->indexOffsetOrder2) || (i==pFeno->indexFwhmOrder2))
           pTabCross->Fact=norm2;
 
-        pTabCross->InitStretch/=StretchFact1;
-        pTabCross->InitStretch2/=StretchFact2;
+        pTabCross->InitStretch/=pContext->StretchFact1;
+        pTabCross->InitStretch2/=pContext->StretchFact2;
 
         // Fill, 'Fit' vectors with data on parameters to fit
 
@@ -2271,7 +2510,7 @@ RC ANALYSE_SvdInit(FENO* pFeno, struct fit_properties *fit, const int n_wavel, c
           // FitMinp and FitMaxp are in parameters of ANALYSE_Function (called by curfit)
           //
 
-          FitDeltap[pTabCross->FitConc]=pTabCross->DeltaConc;
+          pContext->FitDeltap[pTabCross->FitConc]=pTabCross->DeltaConc;
 
           if ((fabs(pTabCross->InitConc)>EPSILON) || (fabs(pTabCross->MinConc)>EPSILON) || (fabs(pTabCross->MaxConc)>EPSILON)) {
             norm=(double)0.;
@@ -2284,52 +2523,52 @@ RC ANALYSE_SvdInit(FENO* pFeno, struct fit_properties *fit, const int n_wavel, c
             else {
               norm=sqrt(norm);
 
-              Fitp[pTabCross->FitConc]=(fabs(pTabCross->InitConc)>EPSILON)?pTabCross->InitConc*norm:(double)0.;
-              FitMinp[pTabCross->FitConc]=(fabs(pTabCross->MinConc)>EPSILON)?(double)pTabCross->MinConc*norm:(double)0.;
-              FitMaxp[pTabCross->FitConc]=(fabs(pTabCross->MaxConc)>EPSILON)?(double)pTabCross->MaxConc*norm:(double)0.;
+              pContext->Fitp[pTabCross->FitConc]=(fabs(pTabCross->InitConc)>EPSILON)?pTabCross->InitConc*norm:(double)0.;
+              pContext->FitMinp[pTabCross->FitConc]=(fabs(pTabCross->MinConc)>EPSILON)?(double)pTabCross->MinConc*norm:(double)0.;
+              pContext->FitMaxp[pTabCross->FitConc]=(fabs(pTabCross->MaxConc)>EPSILON)?(double)pTabCross->MaxConc*norm:(double)0.;
             }
           } else {
-            Fitp[pTabCross->FitConc]=FitMinp[pTabCross->FitConc]=FitMaxp[pTabCross->FitConc]=(double)0.;
+            pContext->Fitp[pTabCross->FitConc]=pContext->FitMinp[pTabCross->FitConc]=pContext->FitMaxp[pTabCross->FitConc]=(double)0.;
           }
         }
         // ---------------------------------------------------------------------------
         if ((pTabCross->FitParam!=ITEM_NONE) && !pTabCross->IndSvdP) {
-          Fitp[pTabCross->FitParam]=pTabCross->InitParam;
-          FitDeltap[pTabCross->FitParam]=pTabCross->DeltaParam;
-          FitMinp[pTabCross->FitParam]=pTabCross->MinParam;
-          FitMaxp[pTabCross->FitParam]=pTabCross->MaxParam;
+          pContext->Fitp[pTabCross->FitParam]=pTabCross->InitParam;
+          pContext->FitDeltap[pTabCross->FitParam]=pTabCross->DeltaParam;
+          pContext->FitMinp[pTabCross->FitParam]=pTabCross->MinParam;
+          pContext->FitMaxp[pTabCross->FitParam]=pTabCross->MaxParam;
         }
         // ---------------------------------------------------------------------------
         if (pTabCross->FitShift!=ITEM_NONE) {
-          Fitp[pTabCross->FitShift]=pTabCross->InitShift;
-          FitDeltap[pTabCross->FitShift]=pTabCross->DeltaShift;
-          FitMinp[pTabCross->FitShift]=pTabCross->MinShift;
-          FitMaxp[pTabCross->FitShift]=pTabCross->MaxShift;
+          pContext->Fitp[pTabCross->FitShift]=pTabCross->InitShift;
+          pContext->FitDeltap[pTabCross->FitShift]=pTabCross->DeltaShift;
+          pContext->FitMinp[pTabCross->FitShift]=pTabCross->MinShift;
+          pContext->FitMaxp[pTabCross->FitShift]=pTabCross->MaxShift;
         }
         // ---------------------------------------------------------------------------
         if (pTabCross->FitStretch!=ITEM_NONE) {
-          Fitp[pTabCross->FitStretch]=pTabCross->InitStretch;
-          FitDeltap[pTabCross->FitStretch]=pTabCross->DeltaStretch;
-          FitMinp[pTabCross->FitStretch]=(double)0.;
-          FitMaxp[pTabCross->FitStretch]=(double)0.;
+          pContext->Fitp[pTabCross->FitStretch]=pTabCross->InitStretch;
+          pContext->FitDeltap[pTabCross->FitStretch]=pTabCross->DeltaStretch;
+          pContext->FitMinp[pTabCross->FitStretch]=(double)0.;
+          pContext->FitMaxp[pTabCross->FitStretch]=(double)0.;
         }
         // ---------------------------------------------------------------------------
         if (pTabCross->FitStretch2!=ITEM_NONE) {
-          Fitp[pTabCross->FitStretch2]=pTabCross->InitStretch2;
-          FitDeltap[pTabCross->FitStretch2]=pTabCross->DeltaStretch2;
-          FitMinp[pTabCross->FitStretch2]=(double)0.;
-          FitMaxp[pTabCross->FitStretch2]=(double)0.;
+          pContext->Fitp[pTabCross->FitStretch2]=pTabCross->InitStretch2;
+          pContext->FitDeltap[pTabCross->FitStretch2]=pTabCross->DeltaStretch2;
+          pContext->FitMinp[pTabCross->FitStretch2]=(double)0.;
+          pContext->FitMaxp[pTabCross->FitStretch2]=(double)0.;
         }
         // ---------------------------------------------------------------------------
       }
 
       for (i=0;i<fit->NF;i++) {
-        if ((FitMinp[i]!=(double)0.) && (FitMinp[i]==FitMaxp[i]))
-          FitMinp[i]=-FitMaxp[i];
-        if (FitMinp[i]>FitMaxp[i]) {
-          swap=FitMinp[i];
-          FitMinp[i]=FitMaxp[i];
-          FitMaxp[i]=swap;
+        if ((pContext->FitMinp[i]!=(double)0.) && (pContext->FitMinp[i]==pContext->FitMaxp[i]))
+          pContext->FitMinp[i]=-pContext->FitMaxp[i];
+        if (pContext->FitMinp[i]>pContext->FitMaxp[i]) {
+          swap=pContext->FitMinp[i];
+          pContext->FitMinp[i]=pContext->FitMaxp[i];
+          pContext->FitMaxp[i]=swap;
         }
       }
     }
@@ -2349,61 +2588,62 @@ RC ANALYSE_SvdInit(FENO* pFeno, struct fit_properties *fit, const int n_wavel, c
 // Because we use the existing analysis settings, no shift/stretch is
 // fit if the analysis window is not configured to use shift and
 // stretch.
-RC ANALYSE_fit_shift_stretch(int indexFeno, int indexFenoColumn, const double *spec1, const double *spec2,
+RC ANALYSE_fit_shift_stretch(ANALYSE_CONTEXT *pContext,int indexFeno, int indexFenoColumn, const double *spec1, const double *spec2,
                      double *shift, double *stretch, double *stretch2,
                      double *sigma_shift, double *sigma_stretch, double *sigma_stretch2) {
   FENO copy = TabFeno[indexFenoColumn][indexFeno]; // local working copy
-  Feno=&copy;
-  Feno->fit_properties.linfit = NULL;
-  Feno->Shift=Feno->Stretch=Feno->Stretch2=0.;
-  NDET[indexFenoColumn]=Feno->NDET;
+  FENO *pFeno=pContext->Feno=&copy;
+  double chiSquare;
+  pFeno->fit_properties.linfit = NULL;
+  pFeno->Shift=pFeno->Stretch=pFeno->Stretch2=0.;
+  NDET[indexFenoColumn]=pFeno->NDET;
 
   CROSS_REFERENCE *pTabCross;
 
-  for (int indexTabCross=0;indexTabCross<Feno->NTabCross;indexTabCross++)
+  for (int indexTabCross=0;indexTabCross<pFeno->NTabCross;indexTabCross++)
    {
-    pTabCross=&Feno->TabCross[indexTabCross];
+    pTabCross=&pFeno->TabCross[indexTabCross];
 
     if ((pTabCross->crossCorrection==ANLYS_CORRECTION_TYPE_SLOPE) ||
         (pTabCross->crossCorrection==ANLYS_CORRECTION_TYPE_PUKITE) ||
         (pTabCross->crossCorrection==ANLYS_CORRECTION_TYPE_MOLECULAR_RING_SLOPE))
      {
       if (pTabCross->indexPukite1!=ITEM_NONE)
-       Feno->TabCross[pTabCross->indexPukite1].FitConc=0;
+       pFeno->TabCross[pTabCross->indexPukite1].FitConc=0;
       if (pTabCross->indexPukite2!=ITEM_NONE)
-       Feno->TabCross[pTabCross->indexPukite2].FitConc=0;
+       pFeno->TabCross[pTabCross->indexPukite2].FitConc=0;
 
       pTabCross->crossCorrection=ANLYS_CORRECTION_TYPE_NONE;   // Do not use Pukite or molecular ring for the alignment of reference spectra
      }
    }
 
-  memcpy(Feno->Lambda,Feno->LambdaK,sizeof(*Feno->Lambda)*Feno->NDET); // CHECK: why this copy?
-  LambdaSpec=Feno->Lambda; // now pointer LambdaSpec== pointer Feno->Lambda, and buffer content is Feno->LambdaK
+  memcpy(pFeno->Lambda,pFeno->LambdaK,sizeof(*pFeno->Lambda)*pFeno->NDET); // CHECK: why this copy?
+  pContext->LambdaSpec=pFeno->Lambda; // now pointer LambdaSpec== pointer Feno->Lambda, and buffer content is Feno->LambdaK
 
-  Feno->Decomp=1;
-  Feno->amfFlag=0;
-  Feno->indexReference=ITEM_NONE;
-  RC rc=ANALYSE_SvdInit(Feno, &Feno->fit_properties, Feno->NDET,Feno->Lambda);
+  pFeno->Decomp=1;
+  pFeno->amfFlag=0;
+  pFeno->indexReference=ITEM_NONE;
+  RC rc=ANALYSE_SvdInit(pContext,pFeno, &pFeno->fit_properties, pFeno->NDET,pFeno->Lambda);
   // TODO: when we call curfitmethod here, absorber constraints between analysis windows will not work. is this ok?
-  if (!rc) rc=ANALYSE_CurFitMethod(indexFenoColumn,
+  if (!rc) rc=ANALYSE_CurFitMethod(pContext,indexFenoColumn,
                                    spec1,                       // etalon reference spectrum
                                    NULL,                        // error on raw spectrum
                                    spec2,                       // reference spectrum
-                                   Feno->NDET,
+                                   pFeno->NDET,
                                    NULL,
-                                   &Square,                     // returned stretch order 2
+                                   &chiSquare,                  // returned chi square
                                    NULL,                        // number of iterations in Curfit
                                    1.,
                                    1.,
-                                   &Feno->fit_properties);
+                                   &pFeno->fit_properties);
 
-  LINEAR_free(Feno->fit_properties.linfit);
+  LINEAR_free(pFeno->fit_properties.linfit);
 
   if(rc>=THREAD_EVENT_STOP) {
-    return ERROR_SetLast((char *)__func__,ERROR_TYPE_WARNING,ERROR_ID_REF_ALIGNMENT,Feno->windowName);
+    return ERROR_SetLast((char *)__func__,ERROR_TYPE_WARNING,ERROR_ID_REF_ALIGNMENT,pFeno->windowName);
   }
 
-  const CROSS_RESULTS *pResults=&Feno->TabCrossResults[Feno->indexSpectrum];
+  const CROSS_RESULTS *pResults=&pFeno->TabCrossResults[pFeno->indexSpectrum];
   *shift=pResults->Shift;
   *stretch=pResults->Stretch;
   *stretch2=pResults->Stretch2;
@@ -2421,6 +2661,7 @@ RC ANALYSE_fit_shift_stretch(int indexFeno, int indexFenoColumn, const double *s
 //  refFlag==1 : GB, automatic mode selection or satellite
 //  refFlag==2 : Satellites, automatic mode  , file mode selection, radasref && kurucz on irradiance
 RC ANALYSE_AlignReference(ENGINE_CONTEXT *pEngineContext,int refFlag,void *responseHandle,INDEX indexFenoColumn) {
+  ANALYSE_CONTEXT *pContext=&ANALYSE_context;
   RC rc = ERROR_ID_NO;
   for (int WrkFeno=0; WrkFeno<NFeno && !rc; WrkFeno++) {
 
@@ -2444,7 +2685,7 @@ RC ANALYSE_AlignReference(ENGINE_CONTEXT *pEngineContext,int refFlag,void *respo
         && !VECTOR_Equal(pFeno->SrefEtalon,pFeno->Sref,pFeno->NDET,0.) ) {
      double shift, stretch, stretch2, sigma_shift, sigma_stretch, sigma_stretch2;
 
-      rc=ANALYSE_fit_shift_stretch(WrkFeno, indexFenoColumn, pFeno->SrefEtalon, pFeno->Sref, &shift, &stretch, &stretch2, &sigma_shift, &sigma_stretch, &sigma_stretch2);
+      rc=ANALYSE_fit_shift_stretch(pContext,WrkFeno, indexFenoColumn, pFeno->SrefEtalon, pFeno->Sref, &shift, &stretch, &stretch2, &sigma_shift, &sigma_stretch, &sigma_stretch2);
 
       double *lambda=pFeno->Lambda; // CHECK: this used to be the global pointer 'Lambda'. changed it to a local pointer
       const double lambda0=pFeno->lambda0;
@@ -2463,10 +2704,10 @@ RC ANALYSE_AlignReference(ENGINE_CONTEXT *pEngineContext,int refFlag,void *respo
 
         char refTitle[120];
 
-        memcpy(ANALYSE_secX,ANALYSE_zeros,sizeof(*ANALYSE_secX)*pFeno->NDET);
+        memcpy(pContext->secX,ANALYSE_zeros,sizeof(*pContext->secX)*pFeno->NDET);
 
-        for (int i=SvdPDeb;i<=SvdPFin;i++)
-          ANALYSE_secX[i]=exp(log(pFeno->SrefEtalon[i])+ANALYSE_absolu[i]);
+        for (int i=pContext->SvdPDeb;i<=pContext->SvdPFin;i++)
+          pContext->secX[i]=exp(log(pFeno->SrefEtalon[i])+pContext->absolu[i]);
 
         if (ANALYSE_swathSize==1)
          sprintf(refTitle,"Ref1/Ref2 in %s",pFeno->windowName);
@@ -2475,8 +2716,8 @@ RC ANALYSE_AlignReference(ENGINE_CONTEXT *pEngineContext,int refFlag,void *respo
 
         plot_data_t spectrumData[2];
         const int indexPage=plotPageRef; // (pEngineContext->satelliteFlag || (ANALYSE_swathSize>1))?plotPageRef:WrkFeno+plotPageAnalysis-1;
-        mediateAllocateAndSetPlotData(&spectrumData[0],"Measured",&lambda[SvdPDeb],&pFeno->SrefEtalon[SvdPDeb],SvdPFin-SvdPDeb+1,Line);
-        mediateAllocateAndSetPlotData(&spectrumData[1],"Calculated",&lambda[SvdPDeb],&ANALYSE_secX[SvdPDeb],SvdPFin-SvdPDeb+1,Line);
+        mediateAllocateAndSetPlotData(&spectrumData[0],"Measured",&lambda[pContext->SvdPDeb],&pFeno->SrefEtalon[pContext->SvdPDeb],pContext->SvdPFin-pContext->SvdPDeb+1,Line);
+        mediateAllocateAndSetPlotData(&spectrumData[1],"Calculated",&lambda[pContext->SvdPDeb],&pContext->secX[pContext->SvdPDeb],pContext->SvdPFin-pContext->SvdPDeb+1,Line);
         mediateResponsePlotData(indexPage,spectrumData,2,Spectrum,forceAutoScale,refTitle,"Wavelength (nm)","Intensity", responseHandle);
         mediateResponseLabelPage(indexPage,pEngineContext->fileInfo.fileName, "Reference", responseHandle);
         mediateReleasePlotData(&spectrumData[1]);
@@ -2504,7 +2745,7 @@ RC ANALYSE_AlignReference(ENGINE_CONTEXT *pEngineContext,int refFlag,void *respo
   return rc;
 }
 
-RC AnalyseSaveResiduals(char *fileName,ENGINE_CONTEXT *pEngineContext, const int n_wavel)
+RC AnalyseSaveResiduals(ANALYSE_CONTEXT *pContext,char *fileName,ENGINE_CONTEXT *pEngineContext, const int n_wavel)
 {
   RC rc;
   char *fileNamePtr,*ptr,resFile[MAX_ITEM_TEXT_LEN],ext[MAX_ITEM_TEXT_LEN];
@@ -2525,7 +2766,7 @@ RC AnalyseSaveResiduals(char *fileName,ENGINE_CONTEXT *pEngineContext, const int
     if ((ptr=strrchr(fileNamePtr,'.'))!=NULL)
      *ptr=0;
 
-    sprintf(ext,"_%s.%s",Feno->windowName,FILES_types[FILE_TYPE_RES].fileExt);
+    sprintf(ext,"_%s.%s",pContext->Feno->windowName,FILES_types[FILE_TYPE_RES].fileExt);
     strcat(fileNamePtr,ext);
    }
 
@@ -2538,7 +2779,7 @@ RC AnalyseSaveResiduals(char *fileName,ENGINE_CONTEXT *pEngineContext, const int
       fprintf(fp,"0 0 0 ");
 
       for(int i=0; i<n_wavel; ++i) {
-       fprintf(fp,"%.14le ",Feno->Lambda[i]);
+       fprintf(fp,"%.14le ",pContext->Feno->Lambda[i]);
       }
       fprintf(fp,"\n");
      }
@@ -2548,7 +2789,7 @@ RC AnalyseSaveResiduals(char *fileName,ENGINE_CONTEXT *pEngineContext, const int
 
     int curPixel = 0;
     doas_iterator my_iterator;
-    doas_interval *nextinterval = iterator_start_interval(&my_iterator, Feno->fit_properties.specrange);
+    doas_interval *nextinterval = iterator_start_interval(&my_iterator, pContext->Feno->fit_properties.specrange);
     while (curPixel < n_wavel) {
      int stop = (nextinterval != NULL)
        ? interval_start(nextinterval)
@@ -2564,7 +2805,7 @@ RC AnalyseSaveResiduals(char *fileName,ENGINE_CONTEXT *pEngineContext, const int
 
       // print residual for every pixel inside the current range.
       while(curPixel <= end) {
-       fprintf(fp,"%.14le ",ANALYSE_absolu[curPixel]);
+       fprintf(fp,"%.14le ",pContext->absolu[curPixel]);
        ++curPixel;
       }
       nextinterval = iterator_next_interval(&my_iterator);
@@ -2578,15 +2819,124 @@ RC AnalyseSaveResiduals(char *fileName,ENGINE_CONTEXT *pEngineContext, const int
   return rc;
 }
 
+// -----------------------------------------------------------------------------
+// AnalyseDecompScope : how long the decomposition of the design matrix of an analysis window remains valid
+// -----------------------------------------------------------------------------
+
+enum _decompScope {
+  DECOMP_SCOPE_CALL,                                                            // the design matrix depends on the non linear parameters : decompose at each evaluation of the fitting function
+  DECOMP_SCOPE_RECORD,                                                          // the design matrix depends on the record (weights, linear offset normalized by the spectrum) : decompose once per fit
+  DECOMP_SCOPE_WINDOW                                                           // the design matrix is fixed : decompose until the analysis window is reinitialized
+};
+
+static int AnalyseDecompScope(const FENO *pFeno,const double *SigmaY)
+{
+  const CROSS_REFERENCE *TabCross=pFeno->TabCross;
+
+  // Shift and stretch of cross sections
+
+  if (pFeno->fit_properties.NP)
+   return DECOMP_SCOPE_CALL;
+
+  if (pFeno->analysisMethod==INTENSITY_FIT)
+   return DECOMP_SCOPE_WINDOW;
+
+  // The linear offset normalized by the spectrum depends on the alignment and the resolution of the spectrum and on the offset
+
+  if (pFeno->linear_offset_mode==LINEAR_OFFSET_RAD)
+   {
+    if ((pFeno->analysisType==ANALYSIS_TYPE_FWHM_NLFIT) ||
+        ((pFeno->indexSpectrum!=ITEM_NONE) &&
+        ((TabCross[pFeno->indexSpectrum].FitShift!=ITEM_NONE) ||
+         (TabCross[pFeno->indexSpectrum].FitStretch!=ITEM_NONE) ||
+         (TabCross[pFeno->indexSpectrum].FitStretch2!=ITEM_NONE))) ||
+        ((pFeno->indexOffsetConst!=ITEM_NONE) && (TabCross[pFeno->indexOffsetConst].FitParam!=ITEM_NONE)) ||
+        ((pFeno->indexOffsetOrder1!=ITEM_NONE) && (TabCross[pFeno->indexOffsetOrder1].FitParam!=ITEM_NONE)) ||
+        ((pFeno->indexOffsetOrder2!=ITEM_NONE) && (TabCross[pFeno->indexOffsetOrder2].FitParam!=ITEM_NONE)))
+
+     return DECOMP_SCOPE_CALL;
+
+    return DECOMP_SCOPE_RECORD;
+   }
+
+  return (SigmaY!=NULL)?DECOMP_SCOPE_RECORD:DECOMP_SCOPE_WINDOW;
+}
+
+// -----------------------------------------------------------------------------
+// AnalyseDimCFitted : number of columns of the linear system; fixed concentrations are not taken into account for singular value decomposition
+// -----------------------------------------------------------------------------
+
+static int AnalyseDimCFitted(const FENO *pFeno,int DimC)
+{
+  const CROSS_REFERENCE *TabCross=pFeno->TabCross;
+  int NewDimC=DimC;
+
+  for (int i=0;i<pFeno->NTabCross && (NewDimC==DimC);i++)
+   if ((pFeno->analysisMethod==OPTICAL_DENSITY_FIT) && (TabCross[i].FitConc==0) &&
+       (TabCross[i].DeltaConc==(double)0.) && TabCross[i].IndSvdA && (TabCross[i].IndSvdA<=NewDimC))
+
+    NewDimC=TabCross[i].IndSvdA-1;
+
+  return NewDimC;
+}
+
+// -----------------------------------------------------------------------------
+// AnalyseOffsetOrder : highest order of the offset applied on the spectrum (-1 if no offset)
+// -----------------------------------------------------------------------------
+
+static int AnalyseOffsetOrder(const FENO *pFeno)
+{
+  const CROSS_REFERENCE *TabCross=pFeno->TabCross;
+  int offsetOrder=-1;
+
+  if ((pFeno->indexOffsetConst!=ITEM_NONE) && ((TabCross[pFeno->indexOffsetConst].FitParam!=ITEM_NONE) || (TabCross[pFeno->indexOffsetConst].InitParam!=(double)0.)))
+   offsetOrder=0;
+  if ((pFeno->indexOffsetOrder1!=ITEM_NONE) && ((TabCross[pFeno->indexOffsetOrder1].FitParam!=ITEM_NONE) || (TabCross[pFeno->indexOffsetOrder1].InitParam!=(double)0.)))
+   offsetOrder=1;
+  if ((pFeno->indexOffsetOrder2!=ITEM_NONE) && ((TabCross[pFeno->indexOffsetOrder2].FitParam!=ITEM_NONE) || (TabCross[pFeno->indexOffsetOrder2].InitParam!=(double)0.)))
+   offsetOrder=2;
+
+  return offsetOrder;
+}
+
+// -----------------------------------------------------------------------------
+// AnalyseOffset : offset polynomial (relative to the mean of the spectrum) at deltaX=lambda-lambda0
+// -----------------------------------------------------------------------------
+
+static double AnalyseOffset(const FENO *pFeno,const double *fitParamsF,int offsetOrder,double deltaX)
+{
+  const CROSS_REFERENCE *TabCross=pFeno->TabCross;
+
+  double offset=(TabCross[pFeno->indexOffsetConst].FitParam!=ITEM_NONE)
+    ? fitParamsF[TabCross[pFeno->indexOffsetConst].FitParam]
+    : TabCross[pFeno->indexOffsetConst].InitParam;
+
+  if (offsetOrder>=1) {
+    const double val = (TabCross[pFeno->indexOffsetOrder1].FitParam!=ITEM_NONE)
+      ? fitParamsF[TabCross[pFeno->indexOffsetOrder1].FitParam]/TabCross[pFeno->indexOffsetOrder1].Fact
+      : TabCross[pFeno->indexOffsetOrder1].InitParam;
+    offset+=val*deltaX;
+  }
+  if (offsetOrder>=2) {
+    const double val = (TabCross[pFeno->indexOffsetOrder2].FitParam!=ITEM_NONE)
+      ? fitParamsF[TabCross[pFeno->indexOffsetOrder2].FitParam]/TabCross[pFeno->indexOffsetOrder2].Fact
+      : TabCross[pFeno->indexOffsetOrder2].InitParam;
+    offset+=val*deltaX*deltaX;
+  }
+
+  return offset;
+}
+
 // --------------------------------------------------------------------------------------------------------
 // Function : Cross sections and spectrum alignment using spline fitting functions and new Yfit computation
 // --------------------------------------------------------------------------------------------------------
 
-RC ANALYSE_Function(double *spectrum_orig, double *reference, const double *SigmaY, double *Yfit, int Npts,
+RC ANALYSE_Function(ANALYSE_CONTEXT *pContext,double *spectrum_orig, double *reference, const double *SigmaY, double *Yfit, int Npts,
                      double *fitParamsC, double *fitParamsF,INDEX indexFenoColumn, struct fit_properties *fitprops)
 {
   // Declarations
 
+  FENO *pFeno=pContext->Feno;                // analysis window being fitted
   double *XTrav,*YTrav,*newXsTrav,*spec_nolog,*spectrum_interpolated,*reference_shifted, deltaX;
   CROSS_REFERENCE *TabCross,*pTabCross;
   int NewDimC,offsetOrder;
@@ -2600,48 +2950,42 @@ RC ANALYSE_Function(double *spectrum_orig, double *reference, const double *Sigm
 
   // Initializations
   const int n_wavel = NDET[indexFenoColumn];
-  TabCross=Feno->TabCross;
+  const int scratchUsed = pContext->scratchUsed;
+  const double timingStart = TIMING_Start();
+  TabCross=pFeno->TabCross;
   XTrav=YTrav=newXsTrav=spectrum_interpolated=reference_shifted=spec_nolog=NULL;
 
   for (int i=0;i<NSFP;i++)
-   if (Feno->indexFwhmParam[i]!=ITEM_NONE)
-    slitParam[i]=(TabCross[Feno->indexFwhmParam[i]].FitParam!=ITEM_NONE)?fitParamsF[TabCross[Feno->indexFwhmParam[i]].FitParam]:TabCross[Feno->indexFwhmParam[i]].InitParam;
+   if (pFeno->indexFwhmParam[i]!=ITEM_NONE)
+    slitParam[i]=(TabCross[pFeno->indexFwhmParam[i]].FitParam!=ITEM_NONE)?fitParamsF[TabCross[pFeno->indexFwhmParam[i]].FitParam]:TabCross[pFeno->indexFwhmParam[i]].InitParam;
 
   polyFlag=0;
-  NewDimC=fitprops->DimC;
+  NewDimC=AnalyseDimCFitted(pFeno,fitprops->DimC);
 
-  lambda0 = (!Feno->hidden)?Feno->lambda0:center_pixel_wavelength(SvdPDeb, SvdPFin);
+  lambda0 = (!pFeno->hidden)?pFeno->lambda0:center_pixel_wavelength(pContext->splineX,pContext->SvdPDeb, pContext->SvdPFin);
 
   rc=ERROR_ID_NO;
 
   // Real time convolution for Kurucz
 
-  if ((Feno->hidden==1) && Feno->xsToConvolute && pKuruczOptions->fwhmFit) {
+  if ((pFeno->hidden==1) && pFeno->xsToConvolute && pKuruczOptions->fwhmFit) {
 
-    rc=ANALYSE_XsConvolution(Feno,Lambda,NULL,slitParam,pKuruczOptions->fwhmType,indexFenoColumn,(pKuruczOptions->fwhmType==SLIT_TYPE_FILE)?1:0);
+    rc=ANALYSE_XsConvolution(pFeno,pContext->Lambda,NULL,slitParam,pKuruczOptions->fwhmType,indexFenoColumn,(pKuruczOptions->fwhmType==SLIT_TYPE_FILE)?1:0);
     if(rc) {
       goto EndFunction;
     }
   }
 
-  // Don't take fixed concentrations into account for singular value decomposition
+  // Buffers allocation (scratch buffer of the context, released at the end of the function)
 
-  for (int i=0;i<Feno->NTabCross && (NewDimC==fitprops->DimC);i++)
-   if ((Feno->analysisMethod==OPTICAL_DENSITY_FIT) && (TabCross[i].FitConc==0) &&
-       (TabCross[i].DeltaConc==(double)0.) && TabCross[i].IndSvdA && (TabCross[i].IndSvdA<=NewDimC))
+  if (((XTrav=ANALYSE_ScratchAlloc(pContext,Npts))==NULL) ||                  // raw spectrum
+      ((YTrav=ANALYSE_ScratchAlloc(pContext,Npts))==NULL) ||                  // reference spectrum
+      ((spec_nolog=ANALYSE_ScratchAlloc(pContext,Npts))==NULL) ||
+      ((newXsTrav=ANALYSE_ScratchAlloc(pContext,n_wavel))==NULL) ||
+      ((spectrum_interpolated=ANALYSE_ScratchAlloc(pContext,n_wavel))==NULL) || // spectrum interpolated on reference wavelength grid
+      ((reference_shifted=ANALYSE_ScratchAlloc(pContext,n_wavel))==NULL))
 
-    NewDimC=TabCross[i].IndSvdA-1;
-
-  // Buffers allocation
-
-  if (((XTrav=MEMORY_AllocDVector((char *)__func__,"XTrav",0,Npts-1))==NULL) ||                  // raw spectrum
-      ((YTrav=MEMORY_AllocDVector((char *)__func__,"YTrav",0,Npts-1))==NULL) ||                  // reference spectrum
-      ((spec_nolog=MEMORY_AllocDVector((char *)__func__,"spec_nolog",0,Npts-1))==NULL) ||
-      ((newXsTrav=MEMORY_AllocDVector((char *)__func__,"newXsTrav",0,n_wavel-1))==NULL) ||
-      ((spectrum_interpolated=MEMORY_AllocDVector((char *)__func__,"spectrum_interpolated",0,n_wavel-1))==NULL) || // spectrum interpolated on reference wavelength grid
-      ((reference_shifted=MEMORY_AllocDVector((char *)__func__,"reference_shifted",0,n_wavel-1))==NULL))
-
-   rc=ERROR_ID_ALLOC;
+   rc=ERROR_SetLast((char *)__func__,ERROR_TYPE_FATAL,ERROR_ID_ALLOC,"scratch");
 
   else {
     memcpy(newXsTrav,ANALYSE_zeros,sizeof(double)*n_wavel);
@@ -2656,24 +3000,24 @@ RC ANALYSE_Function(double *spectrum_orig, double *reference, const double *Sigm
    // ---------------------------------
 
     double shift_rad, stretch_rad, stretch2_rad;
-    if(Feno->indexSpectrum!=ITEM_NONE) {
-      shift_rad = (TabCross[Feno->indexSpectrum].FitShift!=ITEM_NONE)
-        ? fitParamsF[TabCross[Feno->indexSpectrum].FitShift]
-        : TabCross[Feno->indexSpectrum].InitShift;
-      stretch_rad = (TabCross[Feno->indexSpectrum].FitStretch!=ITEM_NONE)
-        ? fitParamsF[TabCross[Feno->indexSpectrum].FitStretch]
-        : TabCross[Feno->indexSpectrum].InitStretch;
-      stretch2_rad = (TabCross[Feno->indexSpectrum].FitStretch2!=ITEM_NONE)
-        ? fitParamsF[TabCross[Feno->indexSpectrum].FitStretch2]
-        : TabCross[Feno->indexSpectrum].InitStretch2;
+    if(pFeno->indexSpectrum!=ITEM_NONE) {
+      shift_rad = (TabCross[pFeno->indexSpectrum].FitShift!=ITEM_NONE)
+        ? fitParamsF[TabCross[pFeno->indexSpectrum].FitShift]
+        : TabCross[pFeno->indexSpectrum].InitShift;
+      stretch_rad = (TabCross[pFeno->indexSpectrum].FitStretch!=ITEM_NONE)
+        ? fitParamsF[TabCross[pFeno->indexSpectrum].FitStretch]
+        : TabCross[pFeno->indexSpectrum].InitStretch;
+      stretch2_rad = (TabCross[pFeno->indexSpectrum].FitStretch2!=ITEM_NONE)
+        ? fitParamsF[TabCross[pFeno->indexSpectrum].FitStretch2]
+        : TabCross[pFeno->indexSpectrum].InitStretch2;
     } else {
       shift_rad = stretch_rad = stretch2_rad = 0.;
     }
 
-    if ( (rc=ShiftVector(LambdaSpec, spectrum_orig, SplineSpec, spectrum_interpolated, n_wavel,
+    if ( (rc=ShiftVector(pContext,pContext->LambdaSpec, spectrum_orig, pContext->SplineSpec, spectrum_interpolated, n_wavel,
                          shift_rad, stretch_rad, stretch2_rad, //
                          0., 0., 0., fitParamsF, -1, 0, indexFenoColumn))!=ERROR_ID_NO ||
-         (Feno->useUsamp && pUsamp->method==PRJCT_USAMP_AUTOMATIC && (rc=ANALYSE_UsampBuild(2,ITEM_NONE,indexFenoColumn))!=ERROR_ID_NO) )
+         (pFeno->useUsamp && pUsamp->method==PRJCT_USAMP_AUTOMATIC && (rc=AnalyseUsampBuild(pContext,2,ITEM_NONE,indexFenoColumn))!=ERROR_ID_NO) )
 
       goto EndFunction;
 
@@ -2683,9 +3027,9 @@ RC ANALYSE_Function(double *spectrum_orig, double *reference, const double *Sigm
 
    // Filter real time only when fitting difference of resolution between spectrum and reference
 
-   if ((Feno->analysisType==ANALYSIS_TYPE_FWHM_NLFIT) && (ANALYSE_plFilter->filterFunction!=NULL) &&
-       ((rc=FILTER_Vector(ANALYSE_plFilter,&spectrum_interpolated[LimMin],&spectrum_interpolated[LimMin],NULL,LimN,PRJCT_FILTER_OUTPUT_LOW))!=0)) {
-     rc=ERROR_SetLast("EndFunction",ERROR_TYPE_WARNING,ERROR_ID_ANALYSIS,analyseIndexRecord,"Filter");
+   if ((pFeno->analysisType==ANALYSIS_TYPE_FWHM_NLFIT) && (ANALYSE_plFilter->filterFunction!=NULL) &&
+       ((rc=FILTER_Vector(ANALYSE_plFilter,&spectrum_interpolated[pContext->LimMin],&spectrum_interpolated[pContext->LimMin],NULL,pContext->LimN,PRJCT_FILTER_OUTPUT_LOW))!=0)) {
+     rc=ERROR_SetLast("EndFunction",ERROR_TYPE_WARNING,ERROR_ID_ANALYSIS,pContext->indexRecord,"Filter");
      goto EndFunction;
     }
 
@@ -2693,47 +3037,23 @@ RC ANALYSE_Function(double *spectrum_orig, double *reference, const double *Sigm
    // Calculate the mean
    //-------------------
    doas_iterator my_iterator;
-   Feno->xmean=(double)0.;
-   for(int i = iterator_start(&my_iterator, global_doas_spectrum); i != ITERATOR_FINISHED; i=iterator_next(&my_iterator))
-    Feno->xmean+=(double)spectrum_interpolated[i];
+   pFeno->xmean=(double)0.;
+   for(int i = iterator_start(&my_iterator, pContext->specrange); i != ITERATOR_FINISHED; i=iterator_next(&my_iterator))
+    pFeno->xmean+=(double)spectrum_interpolated[i];
 
-   Feno->xmean/=Npts;
+   pFeno->xmean/=Npts;
 
    // -------------------------------
    // Spectrum correction with offset
    // -------------------------------
 
-   if (Feno->analysisMethod!=INTENSITY_FIT) {
-     offsetOrder=-1;
-
-     if ((Feno->indexOffsetConst!=ITEM_NONE) && ((TabCross[Feno->indexOffsetConst].FitParam!=ITEM_NONE) || (TabCross[Feno->indexOffsetConst].InitParam!=(double)0.)))
-      offsetOrder=0;
-     if ((Feno->indexOffsetOrder1!=ITEM_NONE) && ((TabCross[Feno->indexOffsetOrder1].FitParam!=ITEM_NONE) || (TabCross[Feno->indexOffsetOrder1].InitParam!=(double)0.)))
-      offsetOrder=1;
-     if ((Feno->indexOffsetOrder2!=ITEM_NONE) && ((TabCross[Feno->indexOffsetOrder2].FitParam!=ITEM_NONE) || (TabCross[Feno->indexOffsetOrder2].InitParam!=(double)0.)))
-      offsetOrder=2;
+   if (pFeno->analysisMethod!=INTENSITY_FIT) {
+     offsetOrder=AnalyseOffsetOrder(pFeno);
 
      if (offsetOrder>=0) {
-       for (int i=LimMin;i<=LimMax;i++) {
-         deltaX=(double)(ANALYSE_splineX[i]-lambda0);
-
-         double offset=(TabCross[Feno->indexOffsetConst].FitParam!=ITEM_NONE)
-           ? fitParamsF[TabCross[Feno->indexOffsetConst].FitParam]
-           : TabCross[Feno->indexOffsetConst].InitParam;
-
-         if (offsetOrder>=1) {
-           const double val = (TabCross[Feno->indexOffsetOrder1].FitParam!=ITEM_NONE)
-             ? fitParamsF[TabCross[Feno->indexOffsetOrder1].FitParam]/TabCross[Feno->indexOffsetOrder1].Fact
-             : TabCross[Feno->indexOffsetOrder1].InitParam;
-           offset+=val*deltaX;
-         }
-         if (offsetOrder>=2) {
-           const double val = (TabCross[Feno->indexOffsetOrder2].FitParam!=ITEM_NONE)
-             ? fitParamsF[TabCross[Feno->indexOffsetOrder2].FitParam]/TabCross[Feno->indexOffsetOrder2].Fact
-             : TabCross[Feno->indexOffsetOrder2].InitParam;
-           offset+=val*deltaX*deltaX;
-         }
-         spectrum_interpolated[i] -= offset*Feno->xmean;
+       for (int i=pContext->LimMin;i<=pContext->LimMax;i++) {
+         deltaX=(double)(pContext->splineX[i]-lambda0);
+         spectrum_interpolated[i] -= AnalyseOffset(pFeno,fitParamsF,offsetOrder,deltaX)*pFeno->xmean;
        }
      }
    }
@@ -2741,18 +3061,18 @@ RC ANALYSE_Function(double *spectrum_orig, double *reference, const double *Sigm
    // ------------------------------------------
    // Backup of spectrum before taking logarithm
    // ------------------------------------------
-   for( int k=0,l=iterator_start(&my_iterator, global_doas_spectrum); l != ITERATOR_FINISHED; k++,l=iterator_next(&my_iterator))
+   for( int k=0,l=iterator_start(&my_iterator, pContext->specrange); l != ITERATOR_FINISHED; k++,l=iterator_next(&my_iterator))
      spec_nolog[k]=spectrum_interpolated[l];
 
    // -------------------------------
    // High-pass filtering on spectrum
    // -------------------------------
 
-   if ((Feno->analysisMethod==OPTICAL_DENSITY_FIT) && !hFilterSpecLog &&  // logarithms are not calculated and filtered before entering this function
-       (((rc=VECTOR_Log(&spectrum_interpolated[LimMin],&spectrum_interpolated[LimMin],LimN,"ANALYSE_Function (Spec) "))!=0) ||
+   if ((pFeno->analysisMethod==OPTICAL_DENSITY_FIT) && !pContext->hFilterSpecLog &&  // logarithms are not calculated and filtered before entering this function
+       (((rc=VECTOR_Log(&spectrum_interpolated[pContext->LimMin],&spectrum_interpolated[pContext->LimMin],pContext->LimN,"ANALYSE_Function (Spec) "))!=0) ||
         ((ANALYSE_phFilter->filterFunction!=NULL) &&
-         ((!Feno->hidden && ANALYSE_phFilter->hpFilterAnalysis) || ((Feno->hidden==1) && ANALYSE_phFilter->hpFilterCalib)) &&
-         ((rc=FILTER_Vector(ANALYSE_phFilter,&spectrum_interpolated[LimMin],&spectrum_interpolated[LimMin],NULL,LimN,PRJCT_FILTER_OUTPUT_HIGH_SUB))!=0))))
+         ((!pFeno->hidden && ANALYSE_phFilter->hpFilterAnalysis) || ((pFeno->hidden==1) && ANALYSE_phFilter->hpFilterCalib)) &&
+         ((rc=FILTER_Vector(ANALYSE_phFilter,&spectrum_interpolated[pContext->LimMin],&spectrum_interpolated[pContext->LimMin],NULL,pContext->LimN,PRJCT_FILTER_OUTPUT_HIGH_SUB))!=0))))
 
     goto EndFunction;
 
@@ -2760,7 +3080,7 @@ RC ANALYSE_Function(double *spectrum_orig, double *reference, const double *Sigm
    // Transfer to working variable
    // ----------------------------
 
-   for( int k=0,l=iterator_start(&my_iterator, global_doas_spectrum); l != ITERATOR_FINISHED; k++,l=iterator_next(&my_iterator)) {
+   for( int k=0,l=iterator_start(&my_iterator, pContext->specrange); l != ITERATOR_FINISHED; k++,l=iterator_next(&my_iterator)) {
      XTrav[k]=spectrum_interpolated[l];
    }
 
@@ -2772,8 +3092,8 @@ RC ANALYSE_Function(double *spectrum_orig, double *reference, const double *Sigm
    // Build svd matrix
    // ----------------
 
-   if (Feno->Decomp) {
-     for (int i=0;i<Feno->NTabCross;i++)
+   if (pFeno->Decomp) {
+     for (int i=0;i<pFeno->NTabCross;i++)
 
        if ((indexSvdA=TabCross[i].IndSvdA)>0) {
          pTabCross=&TabCross[i];
@@ -2781,34 +3101,34 @@ RC ANALYSE_Function(double *spectrum_orig, double *reference, const double *Sigm
 
          // Fill SVD matrix with predefined components
 
-         int numpixels = spectrum_length(global_doas_spectrum);
+         int numpixels = spectrum_length(pContext->specrange);
 
          if (WorkSpace[pTabCross->Comp].type==WRK_SYMBOL_PREDEFINED) {
            doas_iterator my_iterator;
-           if (i==Feno->indexOffsetConst)
+           if (i==pFeno->indexOffsetConst)
              for (int k=1; k<=numpixels; k++)
                fitprops->A[indexSvdA][k]=1.;
-           else if (i==Feno->indexOffsetOrder1) {
-             for( int k=1,l=iterator_start(&my_iterator, global_doas_spectrum); l != ITERATOR_FINISHED; k++,l=iterator_next(&my_iterator))
-               fitprops->A[indexSvdA][k]=(double)(ANALYSE_splineX[l]-lambda0);
+           else if (i==pFeno->indexOffsetOrder1) {
+             for( int k=1,l=iterator_start(&my_iterator, pContext->specrange); l != ITERATOR_FINISHED; k++,l=iterator_next(&my_iterator))
+               fitprops->A[indexSvdA][k]=(double)(pContext->splineX[l]-lambda0);
            }
-           else if (i==Feno->indexOffsetOrder2) {
-             for( int k=1,l=iterator_start(&my_iterator, global_doas_spectrum); l != ITERATOR_FINISHED; k++,l=iterator_next(&my_iterator))
-               fitprops->A[indexSvdA][k]=(double)(ANALYSE_splineX[l]-lambda0)*(ANALYSE_splineX[l]-lambda0);
+           else if (i==pFeno->indexOffsetOrder2) {
+             for( int k=1,l=iterator_start(&my_iterator, pContext->specrange); l != ITERATOR_FINISHED; k++,l=iterator_next(&my_iterator))
+               fitprops->A[indexSvdA][k]=(double)(pContext->splineX[l]-lambda0)*(pContext->splineX[l]-lambda0);
            }
-           else if ((i==Feno->indexCommonResidual) || (i==Feno->indexUsamp1) || (i==Feno->indexUsamp2)) {
-             for( int k=1, l=iterator_start(&my_iterator, global_doas_spectrum); l != ITERATOR_FINISHED; k++,l=iterator_next(&my_iterator))
-               fitprops->A[indexSvdA][k]=(Feno->analysisMethod==OPTICAL_DENSITY_FIT) ?
+           else if ((i==pFeno->indexCommonResidual) || (i==pFeno->indexUsamp1) || (i==pFeno->indexUsamp2)) {
+             for( int k=1, l=iterator_start(&my_iterator, pContext->specrange); l != ITERATOR_FINISHED; k++,l=iterator_next(&my_iterator))
+               fitprops->A[indexSvdA][k]=(pFeno->analysisMethod==OPTICAL_DENSITY_FIT) ?
                  -pTabCross->vector[l] : pTabCross->vector[l];
            }
-           else if (i==Feno->indexResol) {
+           else if (i==pFeno->indexResol) {
 
              double resolDelta=0.05;                                                   // small increment to calculate the derivative
-             double resolCoeff=Feno->resolFwhm/resolDelta;
+             double resolCoeff=pFeno->resolFwhm/resolDelta;
              double resolX=resolDelta*sqrt((double)1.+2.*resolCoeff);
 
-             for( int k=1, l=max(iterator_start(&my_iterator, global_doas_spectrum),1); (l != ITERATOR_FINISHED) && !rc; k++,l=iterator_next(&my_iterator))
-               if (!(rc=XSCONV_TypeGauss(ANALYSE_splineX,reference,SplineRef,ANALYSE_splineX[l],ANALYSE_splineX[l]-ANALYSE_splineX[l-1],&pTabCross->vector[l],resolX,(double)0.,SLIT_TYPE_GAUSS, n_wavel)))
+             for( int k=1, l=max(iterator_start(&my_iterator, pContext->specrange),1); (l != ITERATOR_FINISHED) && !rc; k++,l=iterator_next(&my_iterator))
+               if (!(rc=XSCONV_TypeGauss(pContext->splineX,reference,pContext->SplineRef,pContext->splineX[l],pContext->splineX[l]-pContext->splineX[l-1],&pTabCross->vector[l],resolX,(double)0.,SLIT_TYPE_GAUSS, n_wavel)))
                  fitprops->A[indexSvdA][k]=pTabCross->vector[l]=(reference[l]!=0)?resolCoeff*(pTabCross->vector[l]/reference[l]-1):(double)0.;
            }
          }
@@ -2829,31 +3149,31 @@ RC ANALYSE_Function(double *spectrum_orig, double *reference, const double *Sigm
              polyOrder=ITEM_NONE;
 
            if (polyFlag && polyOrder == 0 ) {
-             for( int k=1,l=iterator_start(&my_iterator, global_doas_spectrum); l != ITERATOR_FINISHED; k++,l=iterator_next(&my_iterator))
+             for( int k=1,l=iterator_start(&my_iterator, pContext->specrange); l != ITERATOR_FINISHED; k++,l=iterator_next(&my_iterator))
                fitprops->A[indexSvdA][k]=pTabCross->vector[l];
            }
            else if (polyOrder > 0) {
              // in order to have geophysical values of the polynomial in output,
-             for( int k=1,l=iterator_start(&my_iterator, global_doas_spectrum); l != ITERATOR_FINISHED; k++,l=iterator_next(&my_iterator))
-               fitprops->A[indexSvdA][k]=pTabCross->vector[l]=fitprops->A[indexSvdA-1][k]*(ANALYSE_splineX[l]-lambda0);
+             for( int k=1,l=iterator_start(&my_iterator, pContext->specrange); l != ITERATOR_FINISHED; k++,l=iterator_next(&my_iterator))
+               fitprops->A[indexSvdA][k]=pTabCross->vector[l]=fitprops->A[indexSvdA-1][k]*(pContext->splineX[l]-lambda0);
            }
-           else if (Feno->analysisMethod==OPTICAL_DENSITY_FIT) { // SVD method, polyOrder == 0, polyFlag == 0 -> linear offset, order 0
+           else if (pFeno->analysisMethod==OPTICAL_DENSITY_FIT) { // SVD method, polyOrder == 0, polyFlag == 0 -> linear offset, order 0
 
-             switch (Feno->linear_offset_mode) {
+             switch (pFeno->linear_offset_mode) {
              case LINEAR_OFFSET_RAD: // normalized w.r.t. the spectrum
-               for( int k=1,l=iterator_start(&my_iterator, global_doas_spectrum); l != ITERATOR_FINISHED; k++,l=iterator_next(&my_iterator)) {
+               for( int k=1,l=iterator_start(&my_iterator, pContext->specrange); l != ITERATOR_FINISHED; k++,l=iterator_next(&my_iterator)) {
                  fitprops->A[indexSvdA][k]= pTabCross->vector[l] = (fabs(spec_nolog[k-1])> 1.e-14) // 1e-6
-                   ? -Feno->xmean/spec_nolog[k-1]
+                   ? -pFeno->xmean/spec_nolog[k-1]
                    : 0.;
                }
                break;
              case LINEAR_OFFSET_REF: {
                // offset normalized w.r.t. the reference.
                const double * const offset_ref = reference;
-               for (int k=0;k<Feno->NDET;k++)
-              for( int k=1,l=iterator_start(&my_iterator, global_doas_spectrum); l != ITERATOR_FINISHED; k++,l=iterator_next(&my_iterator)) {
+               for (int k=0;k<pFeno->NDET;k++)
+              for( int k=1,l=iterator_start(&my_iterator, pContext->specrange); l != ITERATOR_FINISHED; k++,l=iterator_next(&my_iterator)) {
                  fitprops->A[indexSvdA][k]=pTabCross->vector[l]= (fabs(offset_ref[l])> 1.e-14) // 1e-6
-                   ? Feno->ymean/offset_ref[l]  // !!!! XMEAN -> YMEAN
+                   ? pFeno->ymean/offset_ref[l]  // !!!! XMEAN -> YMEAN
                    : 0.;
 
                }
@@ -2866,8 +3186,8 @@ RC ANALYSE_Function(double *spectrum_orig, double *reference, const double *Sigm
              }
            } else { // linear offset, Marquardt+SVD method -> normalized w.r.t. the reference
 
-             for( int k=1,l=iterator_start(&my_iterator, global_doas_spectrum); l != ITERATOR_FINISHED; k++,l=iterator_next(&my_iterator))
-               fitprops->A[indexSvdA][k]=pTabCross->vector[l]=(fabs(reference[l])>(double)1.e-6)?(double)Feno->xmean/reference[l] :(double)0.;
+             for( int k=1,l=iterator_start(&my_iterator, pContext->specrange); l != ITERATOR_FINISHED; k++,l=iterator_next(&my_iterator))
+               fitprops->A[indexSvdA][k]=pTabCross->vector[l]=(fabs(reference[l])>(double)1.e-6)?(double)pFeno->xmean/reference[l] :(double)0.;
            }
          }
 
@@ -2877,24 +3197,24 @@ RC ANALYSE_Function(double *spectrum_orig, double *reference, const double *Sigm
           {
            // Use substitution vectors for cross sections because of AMF correction or Pukite terms
 
-           memcpy(ANALYSE_xsTrav,pTabCross->vector,sizeof(double)*n_wavel);
-           memcpy(ANALYSE_xsTrav2,pTabCross->Deriv2,sizeof(double)*n_wavel);
+           memcpy(pContext->xsTrav,pTabCross->vector,sizeof(double)*n_wavel);
+           memcpy(pContext->xsTrav2,pTabCross->Deriv2,sizeof(double)*n_wavel);
 
            // --------------
            // AMF correction
            // --------------
 
-           if ((Feno->amfFlag && ((rc=OUTPUT_GetWveAmf(&Feno->TabCrossResults[i],ZM,Lambda,ANALYSE_xsTrav,n_wavel))!=0)) ||
+           if ((pFeno->amfFlag && ((rc=OUTPUT_GetWveAmf(&pFeno->TabCrossResults[i],pContext->ZM,pContext->Lambda,pContext->xsTrav,n_wavel))!=0)) ||
 
                // ---------------------------------------
                // Wavelength alignment (AMF) for cross sections
                // ---------------------------------------
 
-                ((rc=ShiftVector(ANALYSE_splineX,ANALYSE_xsTrav /* (0:n_wavel-1) */,ANALYSE_xsTrav2 /* (0:n_wavel-1) */,newXsTrav /* (0:n_wavel-1) */, n_wavel,
+                ((rc=ShiftVector(pContext,pContext->splineX,pContext->xsTrav /* (0:n_wavel-1) */,pContext->xsTrav2 /* (0:n_wavel-1) */,newXsTrav /* (0:n_wavel-1) */, n_wavel,
                                  (pTabCross->FitShift!=ITEM_NONE)?(double)fitParamsF[pTabCross->FitShift]:(double)pTabCross->InitShift,
                                  (pTabCross->FitStretch!=ITEM_NONE)?(double)fitParamsF[pTabCross->FitStretch]:(double)pTabCross->InitStretch,
                                  (pTabCross->FitStretch2!=ITEM_NONE)?(double)fitParamsF[pTabCross->FitStretch2]:(double)pTabCross->InitStretch2,
-                                 Feno->Shift,Feno->Stretch,Feno->Stretch2,
+                                 pFeno->Shift,pFeno->Stretch,pFeno->Stretch2,
                                  NULL,0,0,indexFenoColumn))!=ERROR_ID_NO))
 
             goto EndFunction;
@@ -2902,19 +3222,19 @@ RC ANALYSE_Function(double *spectrum_orig, double *reference, const double *Sigm
            else
             {
              doas_iterator my_iterator;
-             for( int k=1,l=iterator_start(&my_iterator, global_doas_spectrum); l != ITERATOR_FINISHED; k++,l=iterator_next(&my_iterator))
+             for( int k=1,l=iterator_start(&my_iterator, pContext->specrange); l != ITERATOR_FINISHED; k++,l=iterator_next(&my_iterator))
               fitprops->A[indexSvdA][k]=newXsTrav[l];
             }
           }
         }
 
-      XsDifferences(fitprops->A,fitprops->DimL);                                // Calculate differences of cross sections before orthogonalizations
-      Orthogonalization(fitprops->A,fitprops->DimL);
+      XsDifferences(pFeno,fitprops->A,fitprops->DimL);                                // Calculate differences of cross sections before orthogonalizations
+      Orthogonalization(pFeno,fitprops->A,fitprops->DimL);
 
       // ----------------------------------------------------
       // In optical density fitting mode, allocate linear fitting environment for cross sections:
       // ----------------------------------------------------
-      if (Feno->analysisMethod==OPTICAL_DENSITY_FIT) {
+      if (pFeno->analysisMethod==OPTICAL_DENSITY_FIT) {
         // clean up old linear fit environment:
         LINEAR_free(fitprops->linfit);
         fitprops->linfit = LINEAR_alloc(Npts,NewDimC,DECOMP_QR);
@@ -2924,7 +3244,7 @@ RC ANALYSE_Function(double *spectrum_orig, double *reference, const double *Sigm
       // Cross sections correction with non linear parameters
       // ----------------------------------------------------
 
-      for (int i=0;i<Feno->NTabCross;i++) {
+      for (int i=0;i<pFeno->NTabCross;i++) {
         pTabCross=&TabCross[i];
 
         if ((indexSvdA=pTabCross->IndSvdA)>0) {
@@ -2933,7 +3253,7 @@ RC ANALYSE_Function(double *spectrum_orig, double *reference, const double *Sigm
           // ----------------------------------------------------
 
           if (indexSvdA <=  NewDimC) {
-            switch (Feno->analysisMethod) {
+            switch (pFeno->analysisMethod) {
             case OPTICAL_DENSITY_FIT:
               // ----------------------------------------------------
               // Copy cross sections for which we fit the concentration to linear fit system
@@ -2956,7 +3276,7 @@ RC ANALYSE_Function(double *spectrum_orig, double *reference, const double *Sigm
       // SVD or QR decomposition
       // -----------------
 
-      if (Feno->analysisMethod==OPTICAL_DENSITY_FIT) {
+      if (pFeno->analysisMethod==OPTICAL_DENSITY_FIT) {
         LINEAR_set_weight(fitprops->linfit, SigmaY);
         rc = LINEAR_decompose(fitprops->linfit,fitprops->SigmaSqr,fitprops->covar);
 
@@ -2964,9 +3284,12 @@ RC ANALYSE_Function(double *spectrum_orig, double *reference, const double *Sigm
           goto EndFunction;
       }
 
-        // We only need to recalculate the svd decomposition if the matrix can be chagned by non-linear fit parameters (NP), weighting by spectrum errors (SigmaY), or linear offset:
-      if (!Feno->fit_properties.NP && (SigmaY==NULL) && ( (Feno->linear_offset_mode != LINEAR_OFFSET_RAD) || (Feno->analysisMethod==INTENSITY_FIT))) {
-        Feno->Decomp=0;
+      // We only need to recalculate the svd decomposition if the matrix can be changed by non-linear fit parameters (NP) ;
+      // when it only depends on the weighting by spectrum errors (SigmaY) or on the linear offset, it is decomposed again
+      // for the next record (see ANALYSE_CurFitMethod) and only LINEAR_solve is called for the next iterations
+
+      if (AnalyseDecompScope(pFeno,SigmaY)!=DECOMP_SCOPE_CALL) {
+        pFeno->Decomp=0;
       }
     }
 
@@ -2979,34 +3302,34 @@ RC ANALYSE_Function(double *spectrum_orig, double *reference, const double *Sigm
     // ----------------------------------
 
     double shift_ref, stretch_ref, stretch2_ref;
-    if (Feno->indexReference!=ITEM_NONE) {
-      shift_ref = (TabCross[Feno->indexReference].FitShift!=ITEM_NONE)
-        ? fitParamsF[TabCross[Feno->indexReference].FitShift]
-        : TabCross[Feno->indexReference].InitShift;
-      stretch_ref = (TabCross[Feno->indexReference].FitStretch!=ITEM_NONE)
-        ? fitParamsF[TabCross[Feno->indexReference].FitStretch]
-        : TabCross[Feno->indexReference].InitStretch;
-      stretch2_ref = (TabCross[Feno->indexReference].FitStretch2!=ITEM_NONE)
-        ? fitParamsF[TabCross[Feno->indexReference].FitStretch2]
-        : TabCross[Feno->indexReference].InitStretch2;
+    if (pFeno->indexReference!=ITEM_NONE) {
+      shift_ref = (TabCross[pFeno->indexReference].FitShift!=ITEM_NONE)
+        ? fitParamsF[TabCross[pFeno->indexReference].FitShift]
+        : TabCross[pFeno->indexReference].InitShift;
+      stretch_ref = (TabCross[pFeno->indexReference].FitStretch!=ITEM_NONE)
+        ? fitParamsF[TabCross[pFeno->indexReference].FitStretch]
+        : TabCross[pFeno->indexReference].InitStretch;
+      stretch2_ref = (TabCross[pFeno->indexReference].FitStretch2!=ITEM_NONE)
+        ? fitParamsF[TabCross[pFeno->indexReference].FitStretch2]
+        : TabCross[pFeno->indexReference].InitStretch2;
     } else {
       shift_ref = stretch_ref = stretch2_ref = 0;
     }
 
 
 
-    if ((rc=ShiftVector(ANALYSE_splineX,reference,SplineRef,reference_shifted,n_wavel,
+    if ((rc=ShiftVector(pContext,pContext->splineX,reference,pContext->SplineRef,reference_shifted,n_wavel,
                         shift_ref,stretch_ref,stretch2_ref,
                         (double)0.,(double)0.,(double)0., fitParamsF,1,
-                        (Feno->analysisType==ANALYSIS_TYPE_FWHM_KURUCZ)?1:0,indexFenoColumn))!=ERROR_ID_NO)
+                        (pFeno->analysisType==ANALYSIS_TYPE_FWHM_KURUCZ)?1:0,indexFenoColumn))!=ERROR_ID_NO)
 
      goto EndFunction;
 
 #if defined(__DEBUG_) && __DEBUG_  && defined(__DEBUG_DOAS_SHIFT_) && __DEBUG_DOAS_SHIFT_
     if (((analyseDebugMask&DEBUG_FCTTYPE_MATH)!=0) && analyseDebugVar &&
-        (Feno->indexReference!=ITEM_NONE) &&
-        ((TabCross[Feno->indexReference].FitShift!=ITEM_NONE) || (TabCross[Feno->indexReference].InitShift!=(double)0.)))
-     DEBUG_PrintVar("Interpolation of the reference",ANALYSE_splineX,LimMin,LimMax,Y,LimMin,LimMax,SplineRef,LimMin,LimMax,reference_shifted,LimMin,LimMax,NULL);
+        (pFeno->indexReference!=ITEM_NONE) &&
+        ((TabCross[pFeno->indexReference].FitShift!=ITEM_NONE) || (TabCross[pFeno->indexReference].InitShift!=(double)0.)))
+     DEBUG_PrintVar("Interpolation of the reference",pContext->splineX,pContext->LimMin,pContext->LimMax,Y,pContext->LimMin,pContext->LimMax,pContext->SplineRef,pContext->LimMin,pContext->LimMax,reference_shifted,pContext->LimMin,pContext->LimMax,NULL);
 #endif
 
     // -------------------------------
@@ -3015,10 +3338,10 @@ RC ANALYSE_Function(double *spectrum_orig, double *reference, const double *Sigm
 
     // Filter real time only when fitting difference of resolution between spectrum and reference
 
-    if ((Feno->analysisType==ANALYSIS_TYPE_FWHM_NLFIT) && (ANALYSE_plFilter->filterFunction!=NULL) &&
-        ((rc=FILTER_Vector(ANALYSE_plFilter,&reference_shifted[LimMin],&reference_shifted[LimMin],NULL,LimN,PRJCT_FILTER_OUTPUT_LOW))!=0))
+    if ((pFeno->analysisType==ANALYSIS_TYPE_FWHM_NLFIT) && (ANALYSE_plFilter->filterFunction!=NULL) &&
+        ((rc=FILTER_Vector(ANALYSE_plFilter,&reference_shifted[pContext->LimMin],&reference_shifted[pContext->LimMin],NULL,pContext->LimN,PRJCT_FILTER_OUTPUT_LOW))!=0))
      {
-      rc=ERROR_SetLast("EndFunction",ERROR_TYPE_WARNING,ERROR_ID_ANALYSIS,analyseIndexRecord,"Filter");
+      rc=ERROR_SetLast("EndFunction",ERROR_TYPE_WARNING,ERROR_ID_ANALYSIS,pContext->indexRecord,"Filter");
       goto EndFunction;
      }
 
@@ -3026,13 +3349,13 @@ RC ANALYSE_Function(double *spectrum_orig, double *reference, const double *Sigm
     // Reference correction with non linear parameters
     // ----------------------------------------------
 
-    if ((Feno->analysisMethod!=INTENSITY_FIT) &&
-        (Feno->indexSol!=ITEM_NONE) &&
-        ((TabCross[Feno->indexSol].FitParam!=ITEM_NONE) ||
-         ((TabCross[Feno->indexSol].InitParam!=(double)0.)&&(TabCross[Feno->indexSol].InitParam!=(double)1.))))
+    if ((pFeno->analysisMethod!=INTENSITY_FIT) &&
+        (pFeno->indexSol!=ITEM_NONE) &&
+        ((TabCross[pFeno->indexSol].FitParam!=ITEM_NONE) ||
+         ((TabCross[pFeno->indexSol].InitParam!=(double)0.)&&(TabCross[pFeno->indexSol].InitParam!=(double)1.))))
 
-     for (int i=LimMin;i<=LimMax;i++)
-      reference_shifted[i]=pow(reference_shifted[i],(TabCross[Feno->indexSol].FitParam!=ITEM_NONE)?(double)fitParamsF[TabCross[Feno->indexSol].FitParam]:(double)TabCross[Feno->indexSol].InitParam);
+     for (int i=pContext->LimMin;i<=pContext->LimMax;i++)
+      reference_shifted[i]=pow(reference_shifted[i],(TabCross[pFeno->indexSol].FitParam!=ITEM_NONE)?(double)fitParamsF[TabCross[pFeno->indexSol].FitParam]:(double)TabCross[pFeno->indexSol].InitParam);
 
     // --------------------------------
     // High pass filtering on reference
@@ -3040,11 +3363,11 @@ RC ANALYSE_Function(double *spectrum_orig, double *reference, const double *Sigm
 
     // logarithms are not calculated and filtered before entering this function
 
-    if ((Feno->analysisMethod==OPTICAL_DENSITY_FIT) && !hFilterRefLog &&  // logarithms are not calculated and filtered before entering this function
-        (((rc=VECTOR_Log(&reference_shifted[LimMin],&reference_shifted[LimMin],LimN,"ANALYSE_Function (Ref) "))!=0) ||
+    if ((pFeno->analysisMethod==OPTICAL_DENSITY_FIT) && !pContext->hFilterRefLog &&  // logarithms are not calculated and filtered before entering this function
+        (((rc=VECTOR_Log(&reference_shifted[pContext->LimMin],&reference_shifted[pContext->LimMin],pContext->LimN,"ANALYSE_Function (Ref) "))!=0) ||
          ((ANALYSE_phFilter->filterFunction!=NULL) &&
-          ((!Feno->hidden && ANALYSE_phFilter->hpFilterAnalysis) || ((Feno->hidden==1) && ANALYSE_phFilter->hpFilterCalib)) &&
-          ((rc=FILTER_Vector(ANALYSE_phFilter,&reference_shifted[LimMin],&reference_shifted[LimMin],NULL,LimN,PRJCT_FILTER_OUTPUT_HIGH_SUB))!=0))))
+          ((!pFeno->hidden && ANALYSE_phFilter->hpFilterAnalysis) || ((pFeno->hidden==1) && ANALYSE_phFilter->hpFilterCalib)) &&
+          ((rc=FILTER_Vector(ANALYSE_phFilter,&reference_shifted[pContext->LimMin],&reference_shifted[pContext->LimMin],NULL,pContext->LimN,PRJCT_FILTER_OUTPUT_HIGH_SUB))!=0))))
 
      goto EndFunction;
 
@@ -3052,14 +3375,14 @@ RC ANALYSE_Function(double *spectrum_orig, double *reference, const double *Sigm
     // Transfer to working variable
     // ----------------------------
 
-    for( int k=0,l=iterator_start(&my_iterator, global_doas_spectrum); l != ITERATOR_FINISHED; k++,l=iterator_next(&my_iterator))
+    for( int k=0,l=iterator_start(&my_iterator, pContext->specrange); l != ITERATOR_FINISHED; k++,l=iterator_next(&my_iterator))
      YTrav[k]=reference_shifted[l];
 
     //
     // OPTICAL THICKNESS FITTING (SVD)
     //
 
-    if (Feno->analysisMethod==OPTICAL_DENSITY_FIT) {
+    if (pFeno->analysisMethod==OPTICAL_DENSITY_FIT) {
       // ---------------------
       // SVD back substitution
       // ---------------------
@@ -3067,17 +3390,17 @@ RC ANALYSE_Function(double *spectrum_orig, double *reference, const double *Sigm
       // N.B. : YTrav -> reference spectrum, shifted and stretched
       //        XTrav -> raw spectrum, shifted and stretched
 
-      for(int k=1; k<=spectrum_length(global_doas_spectrum); k++) {
-        b[k]=YTrav[k-1]-XTrav[k-1];
+      for(int k=1; k<=spectrum_length(pContext->specrange); k++) {
+        pContext->b[k]=YTrav[k-1]-XTrav[k-1];
 
         for (int l=NewDimC+1;l<=fitprops->DimC;l++)
-          b[k]-=fitprops->A[l][k]*fitParamsC[l];
+          pContext->b[k]-=fitprops->A[l][k]*fitParamsC[l];
 
         if (SigmaY!=NULL)
-          b[k]/=SigmaY[k-1];
+          pContext->b[k]/=SigmaY[k-1];
       }
 
-      rc = LINEAR_solve(fitprops->linfit, b, fitParamsC);
+      rc = LINEAR_solve(fitprops->linfit, pContext->b, fitParamsC);
       if (rc != ERROR_ID_NO)
         goto EndFunction;
 
@@ -3085,7 +3408,7 @@ RC ANALYSE_Function(double *spectrum_orig, double *reference, const double *Sigm
       // Yfit computation with the solution of the system
       // ------------------------------------------------
 
-      for (int l=0;l<Feno->NTabCross;l++) {
+      for (int l=0;l<pFeno->NTabCross;l++) {
         int svdIndex = TabCross[l].IndSvdA;
         double weight = (svdIndex <= NewDimC)
           ? fitParamsC[svdIndex]/TabCross[l].Fact
@@ -3099,15 +3422,15 @@ RC ANALYSE_Function(double *spectrum_orig, double *reference, const double *Sigm
         Yfit[k-1]=YTrav[k-1]-XTrav[k-1]; // NB : logarithm test on YTrav has been made in the previous loop
       }
 
-    } else if (Feno->analysisMethod==INTENSITY_FIT) {
+    } else if (pFeno->analysisMethod==INTENSITY_FIT) {
 
       // ------------------------------------------------------------
       // INTENSITY FITTING
       // ------------------------------------------------------------
 
-      for (int k=1,i=iterator_start(&my_iterator, global_doas_spectrum); i != ITERATOR_FINISHED; k++,i=iterator_next(&my_iterator)) {
+      for (int k=1,i=iterator_start(&my_iterator, pContext->specrange); i != ITERATOR_FINISHED; k++,i=iterator_next(&my_iterator)) {
         double tau = 0.;
-        for (int l=0;l<Feno->NTabCross;l++) {
+        for (int l=0;l<pFeno->NTabCross;l++) {
           pTabCross=&TabCross[l];
 
           if (pTabCross->IndSvdA > 0 && WorkSpace[pTabCross->Comp].type==WRK_SYMBOL_CROSS) {
@@ -3126,19 +3449,19 @@ RC ANALYSE_Function(double *spectrum_orig, double *reference, const double *Sigm
           goto EndFunction;
         }
 
-        ANALYSE_t[i]=exp(-tau); // exp(-tau)
-        ANALYSE_tc[i]=XTrav[k-1]/YTrav[k-1];  // I/I0
-        b[k] = ANALYSE_tc[i];
+        pContext->t[i]=exp(-tau); // exp(-tau)
+        pContext->tc[i]=XTrav[k-1]/YTrav[k-1];  // I/I0
+        pContext->b[k] = pContext->tc[i];
       }
 
-      for (int l=0;l<Feno->NTabCross;l++) {
+      for (int l=0;l<pFeno->NTabCross;l++) {
         pTabCross=&TabCross[l];
 
         if (((indexSvdA=pTabCross->IndSvdA)>0) && ((indexSvdP=pTabCross->IndSvdP)>0)) {
-          for( int k=1,i=iterator_start(&my_iterator, global_doas_spectrum); i != ITERATOR_FINISHED; k++,i=iterator_next(&my_iterator)) {
+          for( int k=1,i=iterator_start(&my_iterator, pContext->specrange); i != ITERATOR_FINISHED; k++,i=iterator_next(&my_iterator)) {
             if (WorkSpace[pTabCross->Comp].type==WRK_SYMBOL_CONTINUOUS && WorkSpace[pTabCross->Comp].symbolName[0]!='o') {
               // Polynomial
-              fitprops->P[indexSvdP][k]=ANALYSE_t[i]*fitprops->A[indexSvdA][k]; ///pTabCross->Fact;
+              fitprops->P[indexSvdP][k]=pContext->t[i]*fitprops->A[indexSvdA][k]; ///pTabCross->Fact;
             } else {
               // Linear offset normalized w.r.t. the reference spectrum and other parameters (Ring ...)
               fitprops->P[indexSvdP][k]=fitprops->A[indexSvdA][k]; ///pTabCross->Fact;
@@ -3151,14 +3474,14 @@ RC ANALYSE_Function(double *spectrum_orig, double *reference, const double *Sigm
       if (SigmaY != NULL) {
         LINEAR_set_weight(fitprops->linfit, SigmaY);
         for (int i=0; i<fitprops->DimP; ++i) {
-          b[1+i] /= SigmaY[i];
+          pContext->b[1+i] /= SigmaY[i];
         }
       }
 
       rc = LINEAR_decompose(fitprops->linfit, fitprops->SigmaSqr, fitprops->covar);
       double xP[fitprops->DimP];
       double *fitParamsP=xP-1; // linear fitting functions assume index starts at 1.
-      if (rc == ERROR_ID_NO) rc = LINEAR_solve(fitprops->linfit, b, fitParamsP);
+      if (rc == ERROR_ID_NO) rc = LINEAR_solve(fitprops->linfit, pContext->b, fitParamsP);
       if (rc != ERROR_ID_NO)
         goto EndFunction;
 
@@ -3166,14 +3489,14 @@ RC ANALYSE_Function(double *spectrum_orig, double *reference, const double *Sigm
       // Yfit computation with the solution of the system
       // ------------------------------------------------
 
-      for (int i=0;i<Feno->NTabCross;i++)
+      for (int i=0;i<pFeno->NTabCross;i++)
        if (((indexSvdA=TabCross[i].IndSvdA)>0) && ((indexSvdP=TabCross[i].IndSvdP)>0))
         fitParamsC[indexSvdA]=fitParamsP[indexSvdP];
 
-      for (int k=1,i=iterator_start(&my_iterator, global_doas_spectrum); i != ITERATOR_FINISHED; k++,i=iterator_next(&my_iterator)) {
+      for (int k=1,i=iterator_start(&my_iterator, pContext->specrange); i != ITERATOR_FINISHED; k++,i=iterator_next(&my_iterator)) {
         double tau = 0.;
         double offset = 0.;
-        for (int l=0;l<Feno->NTabCross;l++)
+        for (int l=0;l<pFeno->NTabCross;l++)
          if (((indexSvdA=TabCross[l].IndSvdA)>0) && ((indexSvdP=TabCross[l].IndSvdP)>0))
           {
            if ((WorkSpace[TabCross[l].Comp].type==WRK_SYMBOL_CONTINUOUS) && (WorkSpace[TabCross[l].Comp].symbolName[0]!='o'))      // Polynomial
@@ -3182,10 +3505,10 @@ RC ANALYSE_Function(double *spectrum_orig, double *reference, const double *Sigm
             offset+=fitParamsP[indexSvdP]*fitprops->A[indexSvdA][k];
           }
 
-        ANALYSE_tc[i]-=offset;            // I/I0 - offset/I0
-        ANALYSE_t[i]*=tau;                // tau*exp(-optical depth)
+        pContext->tc[i]-=offset;            // I/I0 - offset/I0
+        pContext->t[i]*=tau;                // tau*exp(-optical depth)
 
-        Yfit[k-1]=ANALYSE_t[i]-ANALYSE_tc[i];
+        Yfit[k-1]=pContext->t[i]-pContext->tc[i];
        }
     }
   }
@@ -3194,18 +3517,9 @@ RC ANALYSE_Function(double *spectrum_orig, double *reference, const double *Sigm
 
  EndFunction :
 
-  if (XTrav!=NULL)
-   MEMORY_ReleaseDVector((char *)__func__,"XTrav",XTrav,0);
-  if (YTrav!=NULL)
-   MEMORY_ReleaseDVector((char *)__func__,"YTrav",YTrav,0);
-  if (newXsTrav!=NULL)
-   MEMORY_ReleaseDVector((char *)__func__,"newXsTrav",newXsTrav,0);
-  if (spectrum_interpolated!= NULL)
-   MEMORY_ReleaseDVector((char *)__func__,"spectrum_interpolated",spectrum_interpolated,0);
-  if (reference_shifted != NULL)
-   MEMORY_ReleaseDVector((char *)__func__,"reference_shifted",reference_shifted,0);
-  if (spec_nolog != NULL)
-   MEMORY_ReleaseDVector((char *)__func__,"spec_nolog",spec_nolog,0);
+  pContext->scratchUsed=scratchUsed;
+
+  TIMING_Stop(TIMING_STAGE_FUNCTION,timingStart);
 
   // Return
 
@@ -3216,6 +3530,305 @@ RC ANALYSE_Function(double *spectrum_orig, double *reference, const double *Sigm
   return rc;
 }
 
+// -----------------------------------------------------------------------------
+// FUNCTION      ANALYSE_AnalyticDeriv
+// -----------------------------------------------------------------------------
+// PURPOSE       Check if the derivative of the fitting function w.r.t. a non
+//               linear parameter can be calculated by ANALYSE_Deriv.
+//
+//               This is the case in optical density fitting for the shift and
+//               stretch of the spectrum and of the reference, and for the
+//               offset, as long as the matrix of the linear system doesn't
+//               depend on the parameter :
+//
+//                 - the linear offset is not normalized by the spectrum;
+//                 - the undersampling is not calculated at each iteration;
+//                 - the difference of resolution is not fitted;
+//                 - the Sol parameter is not applied on the reference.
+//
+// INPUT         pContext      the analysis context
+//               indexTabCross index of the symbol in the cross reference list
+//               indexA        index of the parameter in the non linear parameters
+//
+// RETURN        1 if the derivative can be calculated analytically, 0 otherwise
+// -----------------------------------------------------------------------------
+
+int ANALYSE_AnalyticDeriv(const ANALYSE_CONTEXT *pContext,INDEX indexTabCross,INDEX indexA)
+{
+  const FENO *pFeno=pContext->Feno;
+  const CROSS_REFERENCE *TabCross=pFeno->TabCross;
+  const CROSS_REFERENCE *pTabCross=&TabCross[indexTabCross];
+
+  if ((indexA==ITEM_NONE) ||
+      (pFeno->analysisMethod!=OPTICAL_DENSITY_FIT) ||
+      (pFeno->analysisType==ANALYSIS_TYPE_FWHM_NLFIT) ||
+      (pFeno->analysisType==ANALYSIS_TYPE_FWHM_KURUCZ))
+   return 0;
+
+  const int alignFlag=((indexA==pTabCross->FitShift) || (indexA==pTabCross->FitStretch) || (indexA==pTabCross->FitStretch2))?1:0;
+
+  if (indexTabCross==pFeno->indexReference)
+   return (alignFlag &&
+           ((pFeno->indexSol==ITEM_NONE) ||
+            ((TabCross[pFeno->indexSol].FitParam==ITEM_NONE) &&
+             ((TabCross[pFeno->indexSol].InitParam==(double)0.) || (TabCross[pFeno->indexSol].InitParam==(double)1.)))))?1:0;
+
+  if ((pFeno->linear_offset_mode==LINEAR_OFFSET_RAD) ||
+      (pFeno->useUsamp && (pUsamp->method==PRJCT_USAMP_AUTOMATIC)))
+   return 0;
+
+  if (indexTabCross==pFeno->indexSpectrum)
+   return alignFlag;
+
+  return (((indexTabCross==pFeno->indexOffsetConst) ||
+           (indexTabCross==pFeno->indexOffsetOrder1) ||
+           (indexTabCross==pFeno->indexOffsetOrder2)) && (indexA==pTabCross->FitParam))?1:0;
+}
+
+// -----------------------------------------------------------------------------
+// FUNCTION      ANALYSE_Deriv
+// -----------------------------------------------------------------------------
+// PURPOSE       Analytic derivative of the fitting function (ANALYSE_Function in
+//               optical density fitting) w.r.t. a non linear parameter accepted
+//               by ANALYSE_AnalyticDeriv.
+//
+//               The derivative of the interpolated spectrum or reference is
+//               given by the first derivative of the spline multiplied by the
+//               derivative of the shifted wavelength grid (1, x-x0, (x-x0)^2);
+//               it is then propagated through the offset correction, the
+//               logarithm and the high-pass filter, which are linear or have a
+//               simple derivative.  As the linear parameters are solved
+//               again for each evaluation of the fitting function, the
+//               derivative of the residual is the component of this vector
+//               that is orthogonal to the (weighted) cross sections space.
+//
+//               The state of the linear system must correspond to the last
+//               call of ANALYSE_Function with the same non linear parameters.
+//
+// INPUT         pContext      the analysis context
+//               spectrum_orig the spectrum to evaluate
+//               reference     the control spectrum (also called reference spectrum)
+//               SigmaY        standard deviations for Y data points
+//               Npts          number of data points in Y
+//               fitParamsF    values of parameters to fit non linearly
+//               indexTabCross index of the symbol in the cross reference list
+//               indexA        index of the parameter in fitParamsF
+//
+// OUTPUT        deriv         partial derivative of the function to the parameter
+//
+// RETURN        ERROR_ID_ALLOC if the allocation of a buffer failed;
+//               ERROR_ID_LOG if the logarithm can not be calculated;
+//               ERROR_ID_NO if successful
+// -----------------------------------------------------------------------------
+
+RC ANALYSE_Deriv(ANALYSE_CONTEXT *pContext,double *spectrum_orig,double *reference,const double *SigmaY,int Npts,
+                 const double *fitParamsF,INDEX indexTabCross,INDEX indexA,double *deriv,INDEX indexFenoColumn,
+                 struct fit_properties *fitprops)
+{
+  // Declarations
+
+  FENO *pFeno=pContext->Feno;                                                   // analysis window being fitted
+  CROSS_REFERENCE *TabCross=pFeno->TabCross;
+  const CROSS_REFERENCE *pTabCross=&TabCross[indexTabCross];
+  double *grid,*vector,*dvector,*db,*dbSigma,*x;
+  double lambda0,deltaX,dsh,dst,dst2,xmean,dxmean;
+  INDEX indexAlign;
+  int refFlag,order,offsetOrder,NewDimC;
+  doas_iterator my_iterator;
+  const int scratchUsed=pContext->scratchUsed;                                  // to release the buffers
+  RC rc;
+
+#if defined(__DEBUG_) && __DEBUG_
+  DEBUG_FunctionBegin((char *)__func__,DEBUG_FCTTYPE_APPL|DEBUG_FCTTYPE_MEM);
+#endif
+
+  // Initializations
+
+  const int n_wavel = NDET[indexFenoColumn];
+  rc=ERROR_ID_NO;
+
+  lambda0 = (!pFeno->hidden)?pFeno->lambda0:center_pixel_wavelength(pContext->splineX,pContext->SvdPDeb, pContext->SvdPFin);
+
+  refFlag=(indexTabCross==pFeno->indexReference)?1:0;
+  indexAlign=(refFlag)?pFeno->indexReference:pFeno->indexSpectrum;
+
+  // Order of the selected parameter in the polynomial of the wavelength grid (-1 for offsets)
+
+  order=ITEM_NONE;
+
+  if (indexTabCross==indexAlign)
+   order=(indexA==pTabCross->FitShift)?0:((indexA==pTabCross->FitStretch)?1:2);
+
+  // Buffers allocation (scratch buffer of the context, released at the end of the function)
+
+  if (((grid=ANALYSE_ScratchAlloc(pContext,n_wavel))==NULL) ||
+      ((vector=ANALYSE_ScratchAlloc(pContext,n_wavel))==NULL) ||
+      ((dvector=ANALYSE_ScratchAlloc(pContext,n_wavel))==NULL) ||
+      ((db=ANALYSE_ScratchAlloc(pContext,Npts))==NULL) ||
+      ((dbSigma=ANALYSE_ScratchAlloc(pContext,Npts))==NULL) ||
+      ((x=ANALYSE_ScratchAlloc(pContext,fitprops->DimC+1))==NULL))
+
+   rc=ERROR_SetLast((char *)__func__,ERROR_TYPE_FATAL,ERROR_ID_ALLOC,"scratch");
+
+  else
+   {
+    db--;                                                                       // db and dbSigma are indexed from 1
+    dbSigma--;
+
+    // ---------------------------------------------------
+    // Shifted wavelength grid (see ShiftVector) and vector
+    // ---------------------------------------------------
+
+    dsh=dst=dst2=(double)0.;
+
+    if (indexAlign!=ITEM_NONE)
+     {
+      dsh=(TabCross[indexAlign].FitShift!=ITEM_NONE)?fitParamsF[TabCross[indexAlign].FitShift]:TabCross[indexAlign].InitShift;
+      dst=(TabCross[indexAlign].FitStretch!=ITEM_NONE)?fitParamsF[TabCross[indexAlign].FitStretch]:TabCross[indexAlign].InitStretch;
+      dst2=(TabCross[indexAlign].FitStretch2!=ITEM_NONE)?fitParamsF[TabCross[indexAlign].FitStretch2]:TabCross[indexAlign].InitStretch2;
+     }
+
+    for (int j=pContext->LimMin;j<=pContext->LimMax;j++)
+     {
+      deltaX=pContext->splineX[j]-lambda0;
+      grid[j]=pContext->splineX[j]-(dsh+dst*deltaX*pContext->StretchFact1+dst2*deltaX*deltaX*pContext->StretchFact2);
+     }
+
+    if (refFlag)
+     rc=SPLINE_Vector(pContext->splineX,reference,pContext->SplineRef,n_wavel,&grid[pContext->LimMin],&vector[pContext->LimMin],pContext->LimN,pAnalysisOptions->interpol);
+    else
+     rc=SPLINE_Vector(pContext->LambdaSpec,spectrum_orig,pContext->SplineSpec,n_wavel,&grid[pContext->LimMin],&vector[pContext->LimMin],pContext->LimN,pAnalysisOptions->interpol);
+
+    if (rc!=ERROR_ID_NO)
+     goto EndDeriv;
+
+    // ----------------------------------------------
+    // Derivative of the vector w.r.t. the parameter
+    // ----------------------------------------------
+
+    memcpy(dvector,ANALYSE_zeros,sizeof(double)*n_wavel);
+
+    if (order!=ITEM_NONE)
+     {
+      if (refFlag)
+       rc=SPLINE_VectorDeriv(pContext->splineX,reference,pContext->SplineRef,n_wavel,&grid[pContext->LimMin],&dvector[pContext->LimMin],pContext->LimN,pAnalysisOptions->interpol);
+      else
+       rc=SPLINE_VectorDeriv(pContext->LambdaSpec,spectrum_orig,pContext->SplineSpec,n_wavel,&grid[pContext->LimMin],&dvector[pContext->LimMin],pContext->LimN,pAnalysisOptions->interpol);
+
+      if (rc!=ERROR_ID_NO)
+       goto EndDeriv;
+
+      // d(grid)/d(param) = -1, -(x-x0)*StretchFact1, -(x-x0)^2*StretchFact2
+
+      for (int j=pContext->LimMin;j<=pContext->LimMax;j++)
+       {
+        deltaX=pContext->splineX[j]-lambda0;
+        dvector[j]*=(order==0)?(double)-1.:((order==1)?-deltaX*pContext->StretchFact1:-deltaX*deltaX*pContext->StretchFact2);
+       }
+     }
+
+    // ---------------------------------------
+    // Mean and offset correction (spectrum)
+    // ---------------------------------------
+
+    if (!refFlag && ((offsetOrder=AnalyseOffsetOrder(pFeno))>=0))
+     {
+      xmean=dxmean=(double)0.;
+
+      for (int i=iterator_start(&my_iterator,pContext->specrange);i!=ITERATOR_FINISHED;i=iterator_next(&my_iterator))
+       {
+        xmean+=vector[i];
+        dxmean+=dvector[i];
+       }
+
+      xmean/=Npts;
+      dxmean/=Npts;
+
+      for (int j=pContext->LimMin;j<=pContext->LimMax;j++)
+       {
+        deltaX=pContext->splineX[j]-lambda0;
+
+        const double offset=AnalyseOffset(pFeno,fitParamsF,offsetOrder,deltaX);
+
+        vector[j]-=offset*xmean;
+        dvector[j]-=offset*dxmean;
+
+        // derivative of the offset polynomial w.r.t. its own coefficients
+
+        if (indexTabCross==pFeno->indexOffsetConst)
+         dvector[j]-=xmean;
+        else if (indexTabCross==pFeno->indexOffsetOrder1)
+         dvector[j]-=xmean*deltaX/pTabCross->Fact;
+        else if (indexTabCross==pFeno->indexOffsetOrder2)
+         dvector[j]-=xmean*deltaX*deltaX/pTabCross->Fact;
+       }
+     }
+
+    // --------------------------------
+    // Logarithm and high-pass filtering
+    // --------------------------------
+
+    if (!((refFlag)?pContext->hFilterRefLog:pContext->hFilterSpecLog))         // logarithms are not calculated and filtered before entering ANALYSE_Function
+     {
+      for (int j=pContext->LimMin;j<=pContext->LimMax;j++)
+       {
+        if (vector[j]<=(double)0.)
+         {
+          rc=ERROR_SetLast((char *)__func__,ERROR_TYPE_WARNING,ERROR_ID_LOG,pContext->indexRecord);
+          goto EndDeriv;
+         }
+
+        dvector[j]/=vector[j];
+       }
+
+      if ((ANALYSE_phFilter->filterFunction!=NULL) &&
+          ((!pFeno->hidden && ANALYSE_phFilter->hpFilterAnalysis) || ((pFeno->hidden==1) && ANALYSE_phFilter->hpFilterCalib)) &&
+          ((rc=FILTER_Vector(ANALYSE_phFilter,&dvector[pContext->LimMin],&dvector[pContext->LimMin],NULL,pContext->LimN,PRJCT_FILTER_OUTPUT_HIGH_SUB))!=0))
+
+       goto EndDeriv;
+     }
+
+    // -------------------------------------------------------
+    // Projection orthogonally to the cross sections (Yfit=Y-X)
+    // -------------------------------------------------------
+
+    for (int k=1,l=iterator_start(&my_iterator,pContext->specrange);l!=ITERATOR_FINISHED;k++,l=iterator_next(&my_iterator))
+     {
+      db[k]=(refFlag)?dvector[l]:-dvector[l];
+      dbSigma[k]=(SigmaY!=NULL)?db[k]/SigmaY[k-1]:db[k];
+     }
+
+    if ((rc=LINEAR_solve(fitprops->linfit,dbSigma,x))!=ERROR_ID_NO)
+     goto EndDeriv;
+
+    NewDimC=AnalyseDimCFitted(pFeno,fitprops->DimC);
+
+    for (int l=0;l<pFeno->NTabCross;l++)
+     {
+      const int svdIndex=TabCross[l].IndSvdA;
+
+      if ((svdIndex>0) && (svdIndex<=NewDimC))
+       for (int k=1;k<=Npts;k++)
+        db[k]-=fitprops->A[svdIndex][k]*x[svdIndex]/TabCross[l].Fact;
+     }
+
+    for (int k=1;k<=Npts;k++)
+     deriv[k-1]=db[k];
+   }
+
+  // Release allocated buffers
+
+  EndDeriv :
+
+  pContext->scratchUsed=scratchUsed;
+
+#if defined(__DEBUG_) && __DEBUG_
+  DEBUG_FunctionStop((char *)__func__,rc);
+#endif
+
+  return rc;
+}
+
 /*                                                                           */
 /*  ANALYSE_CurFitMethod ( Spectre, Spreflog, Absolu, Square ) :             */
 /*  ==========================================================               */
@@ -3226,7 +3839,8 @@ RC ANALYSE_Function(double *spectrum_orig, double *reference, const double *Sigm
 /*         and are computed by singular value decomposition of cross         */
 /*         sections matrix.                                                  */
 /*                                                                           */
-RC ANALYSE_CurFitMethod(INDEX indexFenoColumn,  // for OMI
+RC ANALYSE_CurFitMethod(ANALYSE_CONTEXT *pContext,     // working buffers and state of the fit
+                        INDEX indexFenoColumn,  // for OMI
                         const double *Spectre,          // raw spectrum
                         const double *SigmaSpec,        // error on raw spectrum
                         const double *Sref,             // reference spectrum
@@ -3240,6 +3854,7 @@ RC ANALYSE_CurFitMethod(INDEX indexFenoColumn,  // for OMI
 {
   // Declarations
 
+  FENO *pFeno=pContext->Feno;                // analysis window being fitted
   CROSS_REFERENCE *TabCross,*pTabCross;
   CROSS_RESULTS *pResults;
   double OldChisqr,                                      // chi square a step before
@@ -3265,12 +3880,13 @@ RC ANALYSE_CurFitMethod(INDEX indexFenoColumn,  // for OMI
 
   // Initializations
 
-  TabCross=Feno->TabCross;                               // symbol cross reference
-  useErrors=((Feno->analysisMethod==OPTICAL_DENSITY_FIT) && (pAnalysisOptions->fitWeighting!=PRJCT_ANLYS_FIT_WEIGHTING_NONE) && (SigmaSpec!=NULL) && (Feno->SrefSigma!=NULL))?1:0;
+  TabCross=pFeno->TabCross;                               // symbol cross reference
+  useErrors=((pFeno->analysisMethod==OPTICAL_DENSITY_FIT) && (pAnalysisOptions->fitWeighting!=PRJCT_ANLYS_FIT_WEIGHTING_NONE) && (SigmaSpec!=NULL) && (pFeno->SrefSigma!=NULL))?1:0;
 
   fitParamsC=fitParamsF=Deltap=Sigmaa=Y0=SpecTrav=RefTrav=SigmaY=NULL;          // pointers
-  hFilterSpecLog=0;
-  hFilterRefLog=0;
+  pContext->hFilterSpecLog=0;
+  pContext->hFilterRefLog=0;
+  pContext->scratchUsed=0;                                                      // new spectrum
   rc=ERROR_ID_NO;                                      // return code
 
   /*  ==================  */
@@ -3294,6 +3910,11 @@ RC ANALYSE_CurFitMethod(INDEX indexFenoColumn,  // for OMI
    {
     // Initializations
 
+    // New weights or linear offset for this record : decompose the design matrix at the first evaluation of the fitting function
+
+    if (AnalyseDecompScope(pFeno,SigmaY)==DECOMP_SCOPE_RECORD)
+     pFeno->Decomp=1;
+
     memcpy(SpecTrav,Spectre,sizeof(double)*n_wavel);
     if (SigmaY!=NULL)
      memcpy(SigmaY,ANALYSE_zeros,sizeof(double)*fit->DimL);
@@ -3309,11 +3930,11 @@ RC ANALYSE_CurFitMethod(INDEX indexFenoColumn,  // for OMI
     // Fwhm adjustment between spectrum and reference
     // ----------------------------------------------
 
-    if (!Feno->hidden && (Feno->useKurucz!=ANLYS_KURUCZ_SPEC)) {
+    if (!pFeno->hidden && (pFeno->useKurucz!=ANLYS_KURUCZ_SPEC)) {
       // Resolution adjustment using fwhm(lambda) found by Kurucz procedure for spectrum and reference
 
-      if (pKuruczOptions->fwhmFit && (Feno->useKurucz==ANLYS_KURUCZ_REF_AND_SPEC))
-        rc=AnalyseFwhmCorrectionK(Spectre,Sref,SpecTrav,RefTrav,n_wavel,indexFenoColumn);
+      if (pKuruczOptions->fwhmFit && (pFeno->useKurucz==ANLYS_KURUCZ_REF_AND_SPEC))
+        rc=AnalyseFwhmCorrectionK(pContext,Spectre,Sref,SpecTrav,RefTrav,n_wavel,indexFenoColumn);
 
       if (rc)
         goto EndCurFitMethod;
@@ -3326,34 +3947,34 @@ RC ANALYSE_CurFitMethod(INDEX indexFenoColumn,  // for OMI
     // Low pass filtering
 
     if ((ANALYSE_plFilter->filterFunction!=NULL) &&                   // low pass filtering is requested
-        (Feno->analysisType!=ANALYSIS_TYPE_FWHM_NLFIT) &&     // doesn't fit the resolution (FWHM) between the reference and the spectrum as a non linear parameter
-        !Feno->hidden &&                                      // low pass filtering is disabled for calibration in order not to degrade the spectrum to calibrate
+        (pFeno->analysisType!=ANALYSIS_TYPE_FWHM_NLFIT) &&     // doesn't fit the resolution (FWHM) between the reference and the spectrum as a non linear parameter
+        !pFeno->hidden &&                                      // low pass filtering is disabled for calibration in order not to degrade the spectrum to calibrate
 
-        (((rc=FILTER_Vector(ANALYSE_plFilter,&SpecTrav[LimMin],&SpecTrav[LimMin],NULL,LimN,PRJCT_FILTER_OUTPUT_LOW))!=0) ||
-         ((rc=FILTER_Vector(ANALYSE_plFilter,&RefTrav[LimMin],&RefTrav[LimMin],NULL,LimN,PRJCT_FILTER_OUTPUT_LOW))!=0)))
+        (((rc=FILTER_Vector(ANALYSE_plFilter,&SpecTrav[pContext->LimMin],&SpecTrav[pContext->LimMin],NULL,pContext->LimN,PRJCT_FILTER_OUTPUT_LOW))!=0) ||
+         ((rc=FILTER_Vector(ANALYSE_plFilter,&RefTrav[pContext->LimMin],&RefTrav[pContext->LimMin],NULL,pContext->LimN,PRJCT_FILTER_OUTPUT_LOW))!=0)))
      {
-      rc=ERROR_SetLast((char *)__func__,ERROR_TYPE_WARNING,ERROR_ID_ANALYSIS,analyseIndexRecord,"Filter");
+      rc=ERROR_SetLast((char *)__func__,ERROR_TYPE_WARNING,ERROR_ID_ANALYSIS,pContext->indexRecord,"Filter");
       goto EndCurFitMethod;
      }
 
     // High pass filtering (spectrum)
 
     if ((ANALYSE_phFilter->filterFunction!=NULL) &&           // high pass filtering is requested
-        ((!Feno->hidden && ANALYSE_phFilter->hpFilterAnalysis) || ((Feno->hidden==1) && ANALYSE_phFilter->hpFilterCalib)) &&
-        (Feno->analysisType!=ANALYSIS_TYPE_FWHM_NLFIT) &&     // doesn't fit the resolution (FWHM) between the reference and the spectrum as a non linear parameter
-        (Feno->analysisMethod==OPTICAL_DENSITY_FIT) &&     // only implemented in optical density fitting
+        ((!pFeno->hidden && ANALYSE_phFilter->hpFilterAnalysis) || ((pFeno->hidden==1) && ANALYSE_phFilter->hpFilterCalib)) &&
+        (pFeno->analysisType!=ANALYSIS_TYPE_FWHM_NLFIT) &&     // doesn't fit the resolution (FWHM) between the reference and the spectrum as a non linear parameter
+        (pFeno->analysisMethod==OPTICAL_DENSITY_FIT) &&     // only implemented in optical density fitting
 
                                                               // if offset is applied on spectrum, filter spectrum and reference at each iteration in Function
                                                               // otherwise, filter logarithms
 
-        ((Feno->indexOffsetConst==ITEM_NONE) || (TabCross[Feno->indexOffsetConst].FitParam==ITEM_NONE)) &&
-        ((Feno->indexOffsetOrder1==ITEM_NONE) || (TabCross[Feno->indexOffsetOrder1].FitParam==ITEM_NONE)) &&
-        ((Feno->indexOffsetOrder2==ITEM_NONE) || (TabCross[Feno->indexOffsetOrder2].FitParam==ITEM_NONE)))
+        ((pFeno->indexOffsetConst==ITEM_NONE) || (TabCross[pFeno->indexOffsetConst].FitParam==ITEM_NONE)) &&
+        ((pFeno->indexOffsetOrder1==ITEM_NONE) || (TabCross[pFeno->indexOffsetOrder1].FitParam==ITEM_NONE)) &&
+        ((pFeno->indexOffsetOrder2==ITEM_NONE) || (TabCross[pFeno->indexOffsetOrder2].FitParam==ITEM_NONE)))
      {
-      hFilterSpecLog=1;
+      pContext->hFilterSpecLog=1;
 
-      if (((rc=VECTOR_Log(&SpecTrav[LimMin],&SpecTrav[LimMin],LimN,"ANALYSE_CurFitMethod (Ref) "))!=0) ||           // !!!
-          ((rc=FILTER_Vector(ANALYSE_phFilter,&SpecTrav[LimMin],&SpecTrav[LimMin],NULL,LimN,PRJCT_FILTER_OUTPUT_HIGH_SUB))!=0))        // !!!
+      if (((rc=VECTOR_Log(&SpecTrav[pContext->LimMin],&SpecTrav[pContext->LimMin],pContext->LimN,"ANALYSE_CurFitMethod (Ref) "))!=0) ||           // !!!
+          ((rc=FILTER_Vector(ANALYSE_phFilter,&SpecTrav[pContext->LimMin],&SpecTrav[pContext->LimMin],NULL,pContext->LimN,PRJCT_FILTER_OUTPUT_HIGH_SUB))!=0))        // !!!
 
        goto EndCurFitMethod;
      }
@@ -3361,34 +3982,34 @@ RC ANALYSE_CurFitMethod(INDEX indexFenoColumn,  // for OMI
     // High pass filtering (Reference)
 
     if ((ANALYSE_phFilter->filterFunction!=NULL) &&                   // high pass filtering is requested
-        ((!Feno->hidden && ANALYSE_phFilter->hpFilterAnalysis) || ((Feno->hidden==1) && ANALYSE_phFilter->hpFilterCalib)) &&
+        ((!pFeno->hidden && ANALYSE_phFilter->hpFilterAnalysis) || ((pFeno->hidden==1) && ANALYSE_phFilter->hpFilterCalib)) &&
 
-        (Feno->analysisType!=ANALYSIS_TYPE_FWHM_NLFIT) &&     // doesn't fit the resolution (FWHM) between the reference and the spectrum as a non linear parameter
-        (Feno->analysisType!=ANALYSIS_TYPE_FWHM_KURUCZ) &&
-        (Feno->analysisMethod==OPTICAL_DENSITY_FIT) &&       // only implemented in optical density fitting
-        ((Feno->indexSol==ITEM_NONE) || (TabCross[Feno->indexSol].FitParam==ITEM_NONE)))
+        (pFeno->analysisType!=ANALYSIS_TYPE_FWHM_NLFIT) &&     // doesn't fit the resolution (FWHM) between the reference and the spectrum as a non linear parameter
+        (pFeno->analysisType!=ANALYSIS_TYPE_FWHM_KURUCZ) &&
+        (pFeno->analysisMethod==OPTICAL_DENSITY_FIT) &&       // only implemented in optical density fitting
+        ((pFeno->indexSol==ITEM_NONE) || (TabCross[pFeno->indexSol].FitParam==ITEM_NONE)))
      {
-      hFilterRefLog=1;
+      pContext->hFilterRefLog=1;
 
-      if (((rc=VECTOR_Log(&RefTrav[LimMin],&RefTrav[LimMin],LimN,"ANALYSE_CurFitMethod (Ref) "))!=0) ||
-          ((rc=FILTER_Vector(ANALYSE_phFilter,&RefTrav[LimMin],&RefTrav[LimMin],NULL,LimN,PRJCT_FILTER_OUTPUT_HIGH_SUB))!=0))
+      if (((rc=VECTOR_Log(&RefTrav[pContext->LimMin],&RefTrav[pContext->LimMin],pContext->LimN,"ANALYSE_CurFitMethod (Ref) "))!=0) ||
+          ((rc=FILTER_Vector(ANALYSE_phFilter,&RefTrav[pContext->LimMin],&RefTrav[pContext->LimMin],NULL,pContext->LimN,PRJCT_FILTER_OUTPUT_HIGH_SUB))!=0))
 
        goto EndCurFitMethod;
      }
 
-    Feno->ymean=(double)0.;
+    pFeno->ymean=(double)0.;
     doas_iterator my_iterator;
-    for( int i=iterator_start(&my_iterator, global_doas_spectrum); i != ITERATOR_FINISHED;i=iterator_next(&my_iterator))
-     Feno->ymean+=(double)RefTrav[i];
+    for( int i=iterator_start(&my_iterator, pContext->specrange); i != ITERATOR_FINISHED;i=iterator_next(&my_iterator))
+     pFeno->ymean+=(double)RefTrav[i];
 
-    Feno->ymean/=fit->DimL;
+    pFeno->ymean/=fit->DimL;
 
     // ---------------------------------
     // Calculation of second derivatives
     // ---------------------------------
 
-    if (((rc=SPLINE_Deriv2(LambdaSpec,SpecTrav,SplineSpec,n_wavel,"ANALYSE_CurFitMethod (LambdaSpec) "))!=0) || // !!! ANALYSE_splineX -> LambdaSpec
-        ((rc=SPLINE_Deriv2(ANALYSE_splineX,RefTrav,SplineRef,n_wavel,"ANALYSE_CurFitMethod (ANALYSE_splineX) "))!=0))
+    if (((rc=SPLINE_Deriv2(pContext->LambdaSpec,SpecTrav,pContext->SplineSpec,n_wavel,"ANALYSE_CurFitMethod (LambdaSpec) "))!=0) || // !!! ANALYSE_splineX -> LambdaSpec
+        ((rc=SPLINE_Deriv2(pContext->splineX,RefTrav,pContext->SplineRef,n_wavel,"ANALYSE_CurFitMethod (ANALYSE_splineX) "))!=0))
 
      goto EndCurFitMethod;
 
@@ -3399,10 +4020,10 @@ RC ANALYSE_CurFitMethod(INDEX indexFenoColumn,  // for OMI
     int indexFeno; // TODO: this search fails for calls from alignreference because we work with a different copy of Feno
     for (indexFeno=0;indexFeno<NFeno;indexFeno++)
      if (!TabFeno[indexFenoColumn][indexFeno].hidden &&
-         (Feno==&TabFeno[indexFenoColumn][indexFeno]))
+         (pFeno==&TabFeno[indexFenoColumn][indexFeno]))
       break;
 
-    for (int i=0;i<Feno->NTabCross;i++)                        // parameters initialization
+    for (int i=0;i<pFeno->NTabCross;i++)                        // parameters initialization
      {
       if (TabCross[i].IndSvdA)
        {
@@ -3410,8 +4031,8 @@ RC ANALYSE_CurFitMethod(INDEX indexFenoColumn,  // for OMI
 
         if ((WorkSpace[TabCross[i].Comp].type==WRK_SYMBOL_CROSS) && (indexFeno<NFeno) &&
             (TabCross[i].FitFromPrevious==1) && (TabCross[i].InitConc==(double)0.) &&
-            (((Feno->analysisMethod==OPTICAL_DENSITY_FIT) && (TabCross[i].FitConc==0)) ||
-             ((Feno->analysisMethod==INTENSITY_FIT) && (TabCross[i].FitConc==ITEM_NONE))))
+            (((pFeno->analysisMethod==OPTICAL_DENSITY_FIT) && (TabCross[i].FitConc==0)) ||
+             ((pFeno->analysisMethod==INTENSITY_FIT) && (TabCross[i].FitConc==ITEM_NONE))))
          {
           bool found_previous = false;
           for (int indexFeno2=indexFeno-1;indexFeno2>=0 && !found_previous; indexFeno2--) {
@@ -3438,7 +4059,7 @@ RC ANALYSE_CurFitMethod(INDEX indexFenoColumn,  // for OMI
 
     if (useErrors)
      {
-      for( int k=0,i=iterator_start(&my_iterator, global_doas_spectrum); i != ITERATOR_FINISHED; k++,i=iterator_next(&my_iterator))
+      for( int k=0,i=iterator_start(&my_iterator, pContext->specrange); i != ITERATOR_FINISHED; k++,i=iterator_next(&my_iterator))
        if ((SpecTrav[i]==(double)0.) || (RefTrav[i]==(double)0.))
         rc=ERROR_SetLast((char *)__func__,ERROR_TYPE_WARNING,ERROR_ID_DIVISION_BY_0,"try to divide errors by a zero");
        else {
@@ -3446,17 +4067,17 @@ RC ANALYSE_CurFitMethod(INDEX indexFenoColumn,  // for OMI
         double Ispec = speNormFact * Spectre[i]; // spectrum intensity
         double Iref = refNormFact * Sref[i]; // reference intensity
         SigmaY[k]=(double)sqrt( (SigmaSpec[i]*SigmaSpec[i])/(Ispec*Ispec)
-                                + (Feno->SrefSigma[i]*Feno->SrefSigma[i])/(Iref*Iref) );
+                                + (pFeno->SrefSigma[i]*pFeno->SrefSigma[i])/(Iref*Iref) );
        }
       if (rc!=0)
        goto EndCurFitMethod;
      }
 
-    if ((fit->NF==0) && ((rc=ANALYSE_Function(SpecTrav,RefTrav,SigmaY,Yfit,fit->DimL,fitParamsC,fitParamsF,indexFenoColumn, fit))<THREAD_EVENT_STOP))
-     *Chisqr=(double)Fchisq(pAnalysisOptions->fitWeighting,(int)ANALYSE_nFree,Y0,Yfit,SigmaY,fit->DimL);
+    if ((fit->NF==0) && ((rc=ANALYSE_Function(pContext,SpecTrav,RefTrav,SigmaY,Yfit,fit->DimL,fitParamsC,fitParamsF,indexFenoColumn, fit))<THREAD_EVENT_STOP))
+     *Chisqr=(double)Fchisq(pAnalysisOptions->fitWeighting,(int)pContext->nFree,Y0,Yfit,SigmaY,fit->DimL);
     else if (fit->NF)
      {
-      for (int i=0; i<fit->NF; i++ ) { fitParamsF[i] = Fitp[i]; Deltap[i] = FitDeltap[i]; }
+      for (int i=0; i<fit->NF; i++ ) { fitParamsF[i] = pContext->Fitp[i]; Deltap[i] = pContext->FitDeltap[i]; }
 
       /*  ==============  */
       /*  Loop on Chisqr  */
@@ -3470,15 +4091,15 @@ RC ANALYSE_CurFitMethod(INDEX indexFenoColumn,  // for OMI
       do {
         OldChisqr = *Chisqr;
 
-        if ((rc=Curfit(pAnalysisOptions->fitWeighting, niter, ANALYSE_nFree,SpecTrav,RefTrav,Y0,SigmaY,fit->DimL,
-                       fitParamsC,fitParamsF,Deltap,Sigmaa,FitMinp,FitMaxp,fit->NF,Yfit,&Lamda,Chisqr,indexFenoColumn,fit))>=THREAD_EVENT_STOP)
+        if ((rc=Curfit(pContext,pAnalysisOptions->fitWeighting, niter, pContext->nFree,SpecTrav,RefTrav,Y0,SigmaY,fit->DimL,
+                       fitParamsC,fitParamsF,Deltap,Sigmaa,pContext->FitMinp,pContext->FitMaxp,fit->NF,Yfit,&Lamda,Chisqr,indexFenoColumn,fit))>=THREAD_EVENT_STOP)
          break;
 
         for (int i=0; i<fit->NF; i++ ) Deltap[i] *= 0.4;
         niter++;
       } while ( *Chisqr != 0.
                 && fabs(*Chisqr-OldChisqr)/(*Chisqr) > pAnalysisOptions->convergence
-                && (Feno->hidden || !pAnalysisOptions->maxIterations || niter<pAnalysisOptions->maxIterations) );
+                && (pFeno->hidden || !pAnalysisOptions->maxIterations || niter<pAnalysisOptions->maxIterations) );
 
       if (pNiter!=NULL)
         *pNiter=niter;
@@ -3488,22 +4109,22 @@ RC ANALYSE_CurFitMethod(INDEX indexFenoColumn,  // for OMI
       /*  ====================  */
       /*  Residual Computation  */
       /*  ====================  */
-      for( int k=0,i=iterator_start(&my_iterator, global_doas_spectrum); i != ITERATOR_FINISHED; k++,i=iterator_next(&my_iterator)) {
-        ANALYSE_absolu[i]  =  (Yfit[k]-Y0[k]);
-        if (Feno->analysisMethod!=OPTICAL_DENSITY_FIT)
-         ANALYSE_t[i]=(ANALYSE_tc[i]!=(double)0.)?(double)1.+ANALYSE_absolu[i]/ANALYSE_tc[i]:(double)0.;
+      for( int k=0,i=iterator_start(&my_iterator, pContext->specrange); i != ITERATOR_FINISHED; k++,i=iterator_next(&my_iterator)) {
+        pContext->absolu[i]  =  (Yfit[k]-Y0[k]);
+        if (pFeno->analysisMethod!=OPTICAL_DENSITY_FIT)
+         pContext->t[i]=(pContext->tc[i]!=(double)0.)?(double)1.+pContext->absolu[i]/pContext->tc[i]:(double)0.;
       }
       if (residuals != NULL)
-        memcpy(residuals,ANALYSE_absolu,n_wavel * sizeof(*residuals));
+        memcpy(residuals,pContext->absolu,n_wavel * sizeof(*residuals));
 
       scalingFactor=(pAnalysisOptions->fitWeighting==PRJCT_ANLYS_FIT_WEIGHTING_NONE)?(*Chisqr):(double)1.;
 
-      for (int i=0;i<Feno->NTabCross;i++) {
-        pResults=&Feno->TabCrossResults[i];
+      for (int i=0;i<pFeno->NTabCross;i++) {
+        pResults=&pFeno->TabCrossResults[i];
         pTabCross=&TabCross[i];
 
         // in Intensity fitting mode, fitted concentrations are scaled by the cross section normalization factor:
-        if (Feno->analysisMethod==INTENSITY_FIT) {
+        if (pFeno->analysisMethod==INTENSITY_FIT) {
           if (pTabCross->IndSvdA > 0
               && WorkSpace[pTabCross->Comp].type==WRK_SYMBOL_CROSS
               && pTabCross->FitConc > ITEM_NONE) {
@@ -3519,14 +4140,14 @@ RC ANALYSE_CurFitMethod(INDEX indexFenoColumn,  // for OMI
         if (pTabCross->IndSvdA) { // Cross section, polynomial, linear offset, undersampling
           // Fitting using SVD -> in SVD+Marquardt, polynomial is also fitted linearly !
 
-          if ((Feno->analysisMethod==OPTICAL_DENSITY_FIT && pTabCross->FitParam==ITEM_NONE) || pTabCross->IndSvdP) {
-            pResults->SlntCol=x[pTabCross->IndSvdA] = fitParamsC[pTabCross->IndSvdA];
-            pResults->SlntErr=Sigma[pTabCross->IndSvdA]= (pTabCross->FitConc!=0)
+          if ((pFeno->analysisMethod==OPTICAL_DENSITY_FIT && pTabCross->FitParam==ITEM_NONE) || pTabCross->IndSvdP) {
+            pResults->SlntCol=pContext->x[pTabCross->IndSvdA] = fitParamsC[pTabCross->IndSvdA];
+            pResults->SlntErr=pContext->Sigma[pTabCross->IndSvdA]= (pTabCross->FitConc!=0)
               ? sqrt(fit->SigmaSqr[pTabCross->IndSvdA]*scalingFactor)
               : 0.;
 
             if (WorkSpace[pTabCross->Comp].type==WRK_SYMBOL_CONTINUOUS
-                && !Feno->hidden) {
+                && !pFeno->hidden) {
               // Intensity fitting but polynomial is fitted linearly
 
               if ((pTabCross->IndSvdP) && (fabs(refNormFact)>EPSILON)) {                    // polynomial : the output differs from the display in order
@@ -3544,10 +4165,10 @@ RC ANALYSE_CurFitMethod(INDEX indexFenoColumn,  // for OMI
             }
           } else {
             // cross sections in SVD+Marquardt method or Raman in SVD method
-            pResults->SlntCol=x[pTabCross->IndSvdA] = (pTabCross->FitConc!=ITEM_NONE)
+            pResults->SlntCol=pContext->x[pTabCross->IndSvdA] = (pTabCross->FitConc!=ITEM_NONE)
               ? fitParamsF[pTabCross->FitConc]
               : fitParamsC[TabCross[i].IndSvdA];
-            pResults->SlntErr=Sigma[pTabCross->IndSvdA] = (pTabCross->FitConc!=ITEM_NONE)
+            pResults->SlntErr=pContext->Sigma[pTabCross->IndSvdA] = (pTabCross->FitConc!=ITEM_NONE)
               ? Sigmaa[pTabCross->FitConc]
               : 0.;
 
@@ -3566,13 +4187,13 @@ RC ANALYSE_CurFitMethod(INDEX indexFenoColumn,  // for OMI
          pResults->Param=pTabCross->InitParam;
 
         pResults->Shift = ( pTabCross->FitShift != ITEM_NONE ) ? (double) fitParamsF[pTabCross->FitShift] : pTabCross->InitShift;
-        pResults->Stretch = ( pTabCross->FitStretch != ITEM_NONE ) ? (double) fitParamsF[pTabCross->FitStretch]*StretchFact1 : pTabCross->InitStretch*StretchFact1;
-        pResults->Stretch2 = ( pTabCross->FitStretch2 != ITEM_NONE ) ? (double) fitParamsF[pTabCross->FitStretch2]*StretchFact2 : pTabCross->InitStretch2*StretchFact2;
+        pResults->Stretch = ( pTabCross->FitStretch != ITEM_NONE ) ? (double) fitParamsF[pTabCross->FitStretch]*pContext->StretchFact1 : pTabCross->InitStretch*pContext->StretchFact1;
+        pResults->Stretch2 = ( pTabCross->FitStretch2 != ITEM_NONE ) ? (double) fitParamsF[pTabCross->FitStretch2]*pContext->StretchFact2 : pTabCross->InitStretch2*pContext->StretchFact2;
 
         pResults->SigmaParam = (pTabCross->FitParam != ITEM_NONE) ? Sigmaa[(!pTabCross->IndSvdA)?pTabCross->FitParam:pTabCross->IndSvdA]/pTabCross->Fact : (double)1.;
         pResults->SigmaShift = (pTabCross->FitShift != ITEM_NONE) ? Sigmaa[pTabCross->FitShift] : (double)1.;
-        pResults->SigmaStretch = (pTabCross->FitStretch != ITEM_NONE) ? Sigmaa[pTabCross->FitStretch]*StretchFact1 : (double)1.;
-        pResults->SigmaStretch2 = (pTabCross->FitStretch2 != ITEM_NONE) ? Sigmaa[pTabCross->FitStretch2]*StretchFact2 : (double)1.;
+        pResults->SigmaStretch = (pTabCross->FitStretch != ITEM_NONE) ? Sigmaa[pTabCross->FitStretch]*pContext->StretchFact1 : (double)1.;
+        pResults->SigmaStretch2 = (pTabCross->FitStretch2 != ITEM_NONE) ? Sigmaa[pTabCross->FitStretch2]*pContext->StretchFact2 : (double)1.;
        }
      }
    }
@@ -3583,13 +4204,13 @@ RC ANALYSE_CurFitMethod(INDEX indexFenoColumn,  // for OMI
 
  EndCurFitMethod :
 
-  for (int i=0;i<Feno->NTabCross;i++)
+  for (int i=0;i<pFeno->NTabCross;i++)
    {
     pTabCross=&TabCross[i];
 
     pTabCross->InitParam*=pTabCross->Fact;
-    pTabCross->InitStretch*=StretchFact1;
-    pTabCross->InitStretch2*=StretchFact2;
+    pTabCross->InitStretch*=pContext->StretchFact1;
+    pTabCross->InitStretch2*=pContext->StretchFact2;
    }
 
   if (Sigmaa!=NULL)
@@ -3624,7 +4245,7 @@ RC ANALYSE_CurFitMethod(INDEX indexFenoColumn,  // for OMI
 // ANALYSE_Spectrum : Spectrum record analysis
 // -------------------------------------------
 
-RC ANALYSE_Spectrum(ENGINE_CONTEXT *pEngineContext,void *responseHandle)
+RC ANALYSE_Spectrum(ENGINE_CONTEXT *pEngineContext,ANALYSE_CONTEXT *pContext,void *responseHandle)
 {
   // Declarations
 
@@ -3633,6 +4254,7 @@ RC ANALYSE_Spectrum(ENGINE_CONTEXT *pEngineContext,void *responseHandle)
   BUFFERS *pBuffers;                                                            // pointer to the buffers part of the engine context
   RECORD_INFO *pRecord;                                                         // pointer to the record part of the engine context
 
+  FENO *pFeno;                               // analysis window being fitted
   CROSS_REFERENCE *TabCross;                 // list of symbols hold by a analysis window
   CROSS_RESULTS *Results;                    // corresponding results
   char windowTitle[MAX_ITEM_TEXT_LEN];    // window title for graphs
@@ -3671,26 +4293,28 @@ RC ANALYSE_Spectrum(ENGINE_CONTEXT *pEngineContext,void *responseHandle)
 
   // Initializations
 
+  const double timingStart=TIMING_Start();
+
   pRecord=&pEngineContext->recordInfo;
   pBuffers=&pEngineContext->buffers;
   pProject=&pEngineContext->project;
   pInstrumental=&pProject->instrumental;
 
   indexFenoColumn=pRecord->i_crosstrack;
+  pContext->indexRecord=pEngineContext->indexRecord;
 
   const int n_wavel = NDET[pRecord->i_crosstrack];
 
-  memcpy(ANALYSE_t,ANALYSE_zeros,sizeof(double)*n_wavel);
-  memcpy(ANALYSE_tc,ANALYSE_zeros,sizeof(double)*n_wavel);
+  memcpy(pContext->t,ANALYSE_zeros,sizeof(double)*n_wavel);
+  memcpy(pContext->tc,ANALYSE_zeros,sizeof(double)*n_wavel);
 
   speNormFact=1.;
-  ZM=pRecord->Zm;
-  TDET=pRecord->TDet;
+  pContext->ZM=pRecord->Zm;
 
   saveFlag=(int)pEngineContext->project.spectra.displayDataFlag;
   SpectreK=LambdaK=Sref=Trend=offset=NULL;
   molecularRing_a=(is_satellite(pEngineContext->project.instrumental.readOutFormat) ||
-                  (pEngineContext->project.instrumental.readOutFormat==PRJCT_INSTR_FORMAT_APEX))?(double)1./cos(ZM*DegToRad)/((double)1./cos(ZM*DegToRad)+(double)1./cos(pRecord->zenithViewAngle*DegToRad)):(double)1.;
+                  (pEngineContext->project.instrumental.readOutFormat==PRJCT_INSTR_FORMAT_APEX))?(double)1./cos(pContext->ZM*DegToRad)/((double)1./cos(pContext->ZM*DegToRad)+(double)1./cos(pRecord->zenithViewAngle*DegToRad)):(double)1.;
   useKurucz=0;
 
 
@@ -3736,7 +4360,7 @@ RC ANALYSE_Spectrum(ENGINE_CONTEXT *pEngineContext,void *responseHandle)
         memcpy(SpectreK,Spectre,sizeof(double)*n_wavel);
 
 //        if (((pEngineContext->project.instrumental.readOutFormat!=PRJCT_INSTR_FORMAT_GEMS) || !(rc=GEMS_LoadCalib(pEngineContext,indexFenoColumn,responseHandle))) &&
-          if (!(rc=KURUCZ_Spectrum(pBuffers->lambda,LambdaK,SpectreK,KURUCZ_buffers[indexFenoColumn].solar,pBuffers->instrFunction,
+          if (!(rc=KURUCZ_Spectrum(pContext,pBuffers->lambda,LambdaK,SpectreK,KURUCZ_buffers[indexFenoColumn].solar,pBuffers->instrFunction,
                                  1,"Calibration applied on spectrum",KURUCZ_buffers[indexFenoColumn].fwhmPolySpec,KURUCZ_buffers[indexFenoColumn].fwhmVector,KURUCZ_buffers[indexFenoColumn].fwhmDeriv2,saveFlag,
                                  KURUCZ_buffers[indexFenoColumn].indexKurucz,responseHandle,indexFenoColumn))) {
 
@@ -3772,33 +4396,33 @@ RC ANALYSE_Spectrum(ENGINE_CONTEXT *pEngineContext,void *responseHandle)
       // Browse analysis windows
       for (int WrkFeno=0;(WrkFeno<NFeno) && (rc!=THREAD_EVENT_STOP);WrkFeno++) {
        indexPage=WrkFeno+plotPageAnalysis;
-        Feno=&TabFeno[indexFenoColumn][WrkFeno];
+        pContext->Feno=pFeno=&TabFeno[indexFenoColumn][WrkFeno];
         if (((pEngineContext->project.instrumental.readOutFormat==PRJCT_INSTR_FORMAT_GOME1_NETCDF) ||
              (pEngineContext->project.instrumental.readOutFormat==PRJCT_INSTR_FORMAT_TROPOMI) ||
              (pEngineContext->project.instrumental.readOutFormat==PRJCT_INSTR_FORMAT_OMI) ||
              (pEngineContext->project.instrumental.readOutFormat==PRJCT_INSTR_FORMAT_APEX) ||
              (pEngineContext->project.instrumental.readOutFormat==PRJCT_INSTR_FORMAT_GEMS))
          &&
-            !Feno->useRefRow) continue;
+            !pFeno->useRefRow) continue;
 
         // MAXDOAS measurements : Thomas Wagner request -> add the possibility to select a reference spectrum with an elevation angle different from zenith.
         // This should be improved and move to engine.c in one of the functions dedicated to the selection of the reference spectrum
 
-        if (!Feno->hidden &&
-            (VECTOR_Equal(Spectre,Feno->Sref,n_wavel, 1.e-7) ||
-             (!pEngineContext->satelliteFlag && Feno->refSpectrumSelectionMode==ANLYS_REF_SELECTION_MODE_AUTOMATIC &&
-              (( Feno->refMaxdoasSelectionMode==ANLYS_MAXDOAS_REF_SZA &&             // Additional security (in principle, if one twilight is missing,
-                 ((pRecord->localTimeDec<=12. && Feno->indexRefMorning==ITEM_NONE) || // use ref of the other twilight, if both twilights are missing, exit)
-                  (pRecord->localTimeDec>12. && Feno->indexRefAfternoon==ITEM_NONE))) ||
+        if (!pFeno->hidden &&
+            (VECTOR_Equal(Spectre,pFeno->Sref,n_wavel, 1.e-7) ||
+             (!pEngineContext->satelliteFlag && pFeno->refSpectrumSelectionMode==ANLYS_REF_SELECTION_MODE_AUTOMATIC &&
+              (( pFeno->refMaxdoasSelectionMode==ANLYS_MAXDOAS_REF_SZA &&             // Additional security (in principle, if one twilight is missing,
+                 ((pRecord->localTimeDec<=12. && pFeno->indexRefMorning==ITEM_NONE) || // use ref of the other twilight, if both twilights are missing, exit)
+                  (pRecord->localTimeDec>12. && pFeno->indexRefAfternoon==ITEM_NONE))) ||
 
-               (Feno->refMaxdoasSelectionMode==ANLYS_MAXDOAS_REF_SCAN &&
+               (pFeno->refMaxdoasSelectionMode==ANLYS_MAXDOAS_REF_SCAN &&
                 pRecord->elevationViewAngle>=pEngineContext->project.spectra.refAngle-pEngineContext->project.spectra.refTol &&
                 pRecord->elevationViewAngle<=pEngineContext->project.spectra.refAngle+pEngineContext->project.spectra.refTol))))) {
-          Feno->rc = -1;
+          pFeno->rc = -1;
         } else {
-          Feno->rc = ERROR_ID_NO;
+          pFeno->rc = ERROR_ID_NO;
         }
-        sprintf(windowTitle,"Analysis results for %s window",Feno->windowName);
+        sprintf(windowTitle,"Analysis results for %s window",pFeno->windowName);
 
         // OMI/OMPS/TROPOMI : at this step, the irradiance is not available yet (in separate files)
 
@@ -3806,66 +4430,66 @@ RC ANALYSE_Spectrum(ENGINE_CONTEXT *pEngineContext,void *responseHandle)
            case PRJCT_INSTR_FORMAT_OMI:
            case PRJCT_INSTR_FORMAT_OMPS:
            case PRJCT_INSTR_FORMAT_TROPOMI:
-             memcpy(Feno->Lambda,pBuffers->lambda,sizeof(double)*n_wavel);
+             memcpy(pFeno->Lambda,pBuffers->lambda,sizeof(double)*n_wavel);
              break;
            default:
-             memcpy(Feno->Lambda,Feno->LambdaK,sizeof(double)*n_wavel);
+             memcpy(pFeno->Lambda,pFeno->LambdaK,sizeof(double)*n_wavel);
              break;
         }
 
         if (ANALYSE_swathSize == 1) {
-          sprintf(tabTitle,"%s results (%d/%d)",Feno->windowName,pEngineContext->indexRecord,pEngineContext->recordNumber);
+          sprintf(tabTitle,"%s results (%d/%d)",pFeno->windowName,pEngineContext->indexRecord,pEngineContext->recordNumber);
         } else {
           sprintf(tabTitle,"%s results (record %d/%d, measurement %d/%d, row %d/%d)",
-                  Feno->windowName,pEngineContext->indexRecord,pEngineContext->recordNumber,
+                  pFeno->windowName,pEngineContext->indexRecord,pEngineContext->recordNumber,
                   1+pEngineContext->recordInfo.i_alongtrack,pEngineContext->n_alongtrack,
                   1+pEngineContext->recordInfo.i_crosstrack,pEngineContext->n_crosstrack);
         }
 
-        displayFlag=Feno->displaySpectrum+                            //  force display spectrum
-          Feno->displayResidue+                                       //  force display residue
-          Feno->displayTrend+                                         //  force display trend
-          Feno->displayRefEtalon+                                     //  force display alignment of reference on etalon
-          Feno->displayFits+                                          //  force display fits
-          Feno->displayPredefined+                                    //  force display predefined parameters
-          Feno->displayRef;
+        displayFlag=pFeno->displaySpectrum+                            //  force display spectrum
+          pFeno->displayResidue+                                       //  force display residue
+          pFeno->displayTrend+                                         //  force display trend
+          pFeno->displayRefEtalon+                                     //  force display alignment of reference on etalon
+          pFeno->displayFits+                                          //  force display fits
+          pFeno->displayPredefined+                                    //  force display predefined parameters
+          pFeno->displayRef;
 
         if (displayFlag)
          mediateResponseLabelPage(indexPage,pEngineContext->fileInfo.fileName,tabTitle,responseHandle);
 
-        if (!Feno->hidden && (Feno->rcKurucz==ERROR_ID_NO) &&
-            ((Feno->useKurucz==ANLYS_KURUCZ_SPEC) || !Feno->rc)) {
-          memcpy(ANALYSE_absolu,ANALYSE_zeros,sizeof(double)*n_wavel);
+        if (!pFeno->hidden && (pFeno->rcKurucz==ERROR_ID_NO) &&
+            ((pFeno->useKurucz==ANLYS_KURUCZ_SPEC) || !pFeno->rc)) {
+          memcpy(pContext->absolu,ANALYSE_zeros,sizeof(double)*n_wavel);
 
-          if (Feno->amfFlag ||
-              ((Feno->useKurucz==ANLYS_KURUCZ_REF_AND_SPEC) && Feno->xsToConvolute) ||
-              ( (Feno->linear_offset_mode == LINEAR_OFFSET_RAD) && (Feno->analysisMethod==OPTICAL_DENSITY_FIT))) {
+          if (pFeno->amfFlag ||
+              ((pFeno->useKurucz==ANLYS_KURUCZ_REF_AND_SPEC) && pFeno->xsToConvolute) ||
+              ( (pFeno->linear_offset_mode == LINEAR_OFFSET_RAD) && (pFeno->analysisMethod==OPTICAL_DENSITY_FIT))) {
             // fit a linear offset using the inverse of the spectrum
-            Feno->Decomp=1;
+            pFeno->Decomp=1;
           }
 
           // Local variables initializations
 
           Niter=0;
           NbFeno++;
-          TabCross=Feno->TabCross;
-          Results=Feno->TabCrossResults;
+          TabCross=pFeno->TabCross;
+          Results=pFeno->TabCrossResults;
 
           // Reference spectrum
 
-          if (Feno->refSpectrumSelectionMode==ANLYS_REF_SELECTION_MODE_AUTOMATIC) {
+          if (pFeno->refSpectrumSelectionMode==ANLYS_REF_SELECTION_MODE_AUTOMATIC) {
             switch(pEngineContext->project.instrumental.readOutFormat) {
             case PRJCT_INSTR_FORMAT_OMPS:
               rc=ERROR_SetLast((char *)__func__, ERROR_TYPE_FATAL, ERROR_ID_NETCDF, "Automatic reference selection not implemented for this file format");
               break;
             case PRJCT_INSTR_FORMAT_GDP_BIN:                                          // GOME1NETCDF !!!!!!
-              rc = GDP_BIN_get_vza_ref(pRecord->gome.pixelType, WrkFeno, Feno);
+              rc = GDP_BIN_get_vza_ref(pRecord->gome.pixelType, WrkFeno, pFeno);
               break;
             case PRJCT_INSTR_FORMAT_GOME2:
-              rc = GOME2_get_vza_ref(pRecord->satellite.vza, WrkFeno, Feno);
+              rc = GOME2_get_vza_ref(pRecord->satellite.vza, WrkFeno, pFeno);
               break;
             case PRJCT_INSTR_FORMAT_SCIA_PDS:
-              rc = SCIA_get_vza_ref(pRecord->satellite.vza, WrkFeno, Feno);
+              rc = SCIA_get_vza_ref(pRecord->satellite.vza, WrkFeno, pFeno);
               break;
             default:
               break;
@@ -3874,9 +4498,9 @@ RC ANALYSE_Spectrum(ENGINE_CONTEXT *pEngineContext,void *responseHandle)
           if (rc)
             goto EndAnalysis;
 
-          memcpy(Sref,Feno->Sref,sizeof(double)*n_wavel);
-          Lambda=Feno->LambdaK;
-          LambdaSpec=Feno->Lambda;
+          memcpy(Sref,pFeno->Sref,sizeof(double)*n_wavel);
+          pContext->Lambda=pFeno->LambdaK;
+          pContext->LambdaSpec=pFeno->Lambda;
 
           // For OMI, OMPS, Tropomi and GOME-2, interpolate earthshine          // FRM4DOAS : check with Michel what to do with ASCII spectra
           // spectrum onto the solar reference wavelength grid
@@ -3891,7 +4515,7 @@ RC ANALYSE_Spectrum(ENGINE_CONTEXT *pEngineContext,void *responseHandle)
             double *spec_deriv2 = malloc(n_wavel * sizeof(*spec_deriv2));
             rc = SPLINE_Deriv2(pBuffers->lambda, pBuffers->spectrum, spec_deriv2, n_wavel, (char *)__func__);
             if (rc == ERROR_ID_NO)
-              rc = SPLINE_Vector(pBuffers->lambda, pBuffers->spectrum, spec_deriv2, n_wavel, Feno->LambdaRef, Spectre, n_wavel, SPLINE_CUBIC);
+              rc = SPLINE_Vector(pBuffers->lambda, pBuffers->spectrum, spec_deriv2, n_wavel, pFeno->LambdaRef, Spectre, n_wavel, SPLINE_CUBIC);
             free(spec_deriv2);
             if (rc == ERROR_ID_NO)
               rc=VECTOR_NormalizeVector(Spectre-1,n_wavel,&speNormFact,(char *)__func__);
@@ -3901,39 +4525,39 @@ RC ANALYSE_Spectrum(ENGINE_CONTEXT *pEngineContext,void *responseHandle)
             // after putting earthshine on reference grid, assign the
             // Kurucz-corrected reference grid LambdaK to the
             // earthshine spectrum as well
-            LambdaSpec = Feno->LambdaK;
+            pContext->LambdaSpec = pFeno->LambdaK;
           }
 
           // Make a backup of spectral window limits + gaps
 
-          old_range = spectrum_copy(Feno->fit_properties.specrange);
+          old_range = spectrum_copy(pFeno->fit_properties.specrange);
 
           if ((pInstrumental->readOutFormat==PRJCT_INSTR_FORMAT_OMI) &&
               pInstrumental->omi.pixelQFRejectionFlag &&
-              (pEngineContext->recordInfo.omi.omiPixelQF!=NULL) && (Feno->omiRejPixelsQF!=NULL)) {
+              (pEngineContext->recordInfo.omi.omiPixelQF!=NULL) && (pFeno->omiRejPixelsQF!=NULL)) {
             unsigned short *pixelQF=(unsigned short *)pEngineContext->recordInfo.omi.omiPixelQF;
 
-            memset(Feno->omiRejPixelsQF,0,sizeof(int)*Feno->NDET);
+            memset(pFeno->omiRejPixelsQF,0,sizeof(int)*pFeno->NDET);
             int start = spectrum_start(old_range);
             int end = spectrum_end(old_range);
             for (int j= start; j<= end; j++)
              if ( ((pixelQF[j]&pInstrumental->omi.pixelQFMask)!=0) &&
-                  (spectrum_num_windows(Feno->fit_properties.specrange)<=pInstrumental->omi.pixelQFMaxGaps))
+                  (spectrum_num_windows(pFeno->fit_properties.specrange)<=pInstrumental->omi.pixelQFMaxGaps))
               {
-               spectrum_remove_pixel(Feno->fit_properties.specrange,j);
-               Feno->omiRejPixelsQF[j]=1;
+               spectrum_remove_pixel(pFeno->fit_properties.specrange,j);
+               pFeno->omiRejPixelsQF[j]=1;
              }
 
-            if ((spectrum_num_windows(Feno->fit_properties.specrange) > pInstrumental->omi.pixelQFMaxGaps) ||
-                ((rc=reinit_analysis(Feno, n_wavel))!=ERROR_ID_NO))
+            if ((spectrum_num_windows(pFeno->fit_properties.specrange) > pInstrumental->omi.pixelQFMaxGaps) ||
+                ((rc=reinit_analysis(pContext,pFeno, n_wavel))!=ERROR_ID_NO))
              {
-              spectrum_destroy(Feno->fit_properties.specrange);
-              Feno->fit_properties.specrange = old_range;
+              spectrum_destroy(pFeno->fit_properties.specrange);
+              pFeno->fit_properties.specrange = old_range;
 
               rc=ERROR_SetLast((char *)__func__,ERROR_TYPE_WARNING,ERROR_ID_OMI_PIXELQF);
               goto EndAnalysis;
              }
-           } else if ((rc=ANALYSE_SvdInit(Feno,&Feno->fit_properties, n_wavel, Feno->LambdaK))!=ERROR_ID_NO)
+           } else if ((rc=ANALYSE_SvdInit(pContext,pFeno,&pFeno->fit_properties, n_wavel, pFeno->LambdaK))!=ERROR_ID_NO)
             goto EndAnalysis;
 
           // Global variables initializations
@@ -3957,22 +4581,22 @@ RC ANALYSE_Spectrum(ENGINE_CONTEXT *pEngineContext,void *responseHandle)
           // Display spectrum in the current analysis window
 
           if (strlen(pRecord->Nom))
-           sprintf(windowTitle,"Analysis of %s in %s window",pRecord->Nom,Feno->windowName);
+           sprintf(windowTitle,"Analysis of %s in %s window",pRecord->Nom,pFeno->windowName);
           else
-           sprintf(windowTitle,"Analysis of spectrum %d/%d in %s window",pEngineContext->indexRecord,pEngineContext->recordNumber,Feno->windowName);
+           sprintf(windowTitle,"Analysis of spectrum %d/%d in %s window",pEngineContext->indexRecord,pEngineContext->recordNumber,pFeno->windowName);
 
-          if (Feno->displaySpectrum)
+          if (pFeno->displaySpectrum)
            {
             double *spectre_plot = malloc(n_wavel * sizeof(double));
             // in case spectrum & reference have different wavelength grids (shift in pixels): interpolate Spectre on the grid of the reference
-            rc = SPLINE_Vector(LambdaSpec, Spectre, NULL, n_wavel, Feno->LambdaK, spectre_plot, n_wavel, SPLINE_LINEAR);
+            rc = SPLINE_Vector(pContext->LambdaSpec, Spectre, NULL, n_wavel, pFeno->LambdaK, spectre_plot, n_wavel, SPLINE_LINEAR);
 
-            double *curves[2][2] = {{Feno->LambdaK, spectre_plot},
-                                    {Feno->LambdaK, Sref}};
-            if (!Feno->longPathFlag)
-             plot_curves(indexPage, curves, 2, Spectrum, forceAutoScale, "Spectrum and reference", responseHandle, Feno->fit_properties.specrange);
+            double *curves[2][2] = {{pFeno->LambdaK, spectre_plot},
+                                    {pFeno->LambdaK, Sref}};
+            if (!pFeno->longPathFlag)
+             plot_curves(indexPage, curves, 2, Spectrum, forceAutoScale, "Spectrum and reference", responseHandle, pFeno->fit_properties.specrange);
             else
-             plot_curves(indexPage, curves, 1, Spectrum, forceAutoScale, "Spectrum", responseHandle, Feno->fit_properties.specrange);
+             plot_curves(indexPage, curves, 1, Spectrum, forceAutoScale, "Spectrum", responseHandle, pFeno->fit_properties.specrange);
 
             free(spectre_plot);
             if (rc)
@@ -3990,7 +4614,7 @@ RC ANALYSE_Spectrum(ENGINE_CONTEXT *pEngineContext,void *responseHandle)
           memcpy(residuals, ANALYSE_zeros, n_wavel * sizeof(double));
 
           for(i = 0; i<n_wavel;i++)
-           Feno->spikes[i] = 0;
+           pFeno->spikes[i] = 0;
 
           double rms_residual=0,rms_residual_old=0.;
           int max_repeats_spikes = MAX_REPEAT_CURFIT;
@@ -3998,157 +4622,157 @@ RC ANALYSE_Spectrum(ENGINE_CONTEXT *pEngineContext,void *responseHandle)
           int num_repeats_spikes = 0;
           int num_repeats_ring = 0;
 
-          if (Feno->molecularCorrection)
-           Analyse_Molecular_Ring_Init(Feno,Feno->LambdaK,n_wavel);
+          if (pFeno->molecularCorrection)
+           Analyse_Molecular_Ring_Init(pFeno,pFeno->LambdaK,n_wavel);
 
           do {
 
-            if ((num_repeats_ring && ((rc=Analyse_Molecular_Ring_Calculate(Feno,Feno->LambdaK,n_wavel,molecularRing_a))!=ERROR_ID_NO)) ||
-               ((rc=ANALYSE_CurFitMethod(indexFenoColumn,
-                                    (Feno->useKurucz==ANLYS_KURUCZ_REF_AND_SPEC)?SpectreK:Spectre, // raw spectrum
+            if ((num_repeats_ring && ((rc=Analyse_Molecular_Ring_Calculate(pFeno,pFeno->LambdaK,n_wavel,molecularRing_a))!=ERROR_ID_NO)) ||
+               ((rc=ANALYSE_CurFitMethod(pContext,indexFenoColumn,
+                                    (pFeno->useKurucz==ANLYS_KURUCZ_REF_AND_SPEC)?SpectreK:Spectre, // raw spectrum
                                     (pRecord->useErrors)?pBuffers->sigmaSpec:NULL, // error on raw spectrum
                                     Sref, // reference spectrum
                                     n_wavel,
                                     residuals,
-                                    &Feno->chiSquare, // returned stretch order 2
+                                    &pFeno->chiSquare, // returned stretch order 2
                                     &Niter, // number of iterations in Curfit
                                     speNormFact,
-                                    Feno->refNormFact,
-                                    &Feno->fit_properties))!=ERROR_ID_NO))
+                                    pFeno->refNormFact,
+                                    &pFeno->fit_properties))!=ERROR_ID_NO))
              break;
 
             rms_residual_old=rms_residual;
-            rms_residual = root_mean_square(residuals, Feno->fit_properties.specrange);
+            rms_residual = root_mean_square(residuals, pFeno->fit_properties.specrange);
           }
-          while(!Feno->hidden && !rc && // no spike removal, no molecular ring for calibration
+          while(!pFeno->hidden && !rc && // no spike removal, no molecular ring for calibration
 
                ((!num_repeats_ring &&                                                           // spike removal should be performed only one time before molecular ring loop
-                 remove_spikes(residuals, rms_residual * pAnalysisOptions->spike_tolerance, Feno->fit_properties.specrange, Feno->spikes) && // repeat as long as spikes are found
+                 remove_spikes(residuals, rms_residual * pAnalysisOptions->spike_tolerance, pFeno->fit_properties.specrange, pFeno->spikes) && // repeat as long as spikes are found
               (++num_repeats_spikes < max_repeats_spikes)) ||
-              (Feno->molecularCorrection && (++num_repeats_ring <= max_repeats_ring))) &&
+              (pFeno->molecularCorrection && (++num_repeats_ring <= max_repeats_ring))) &&
 
               ((num_repeats_ring<=1) || ((fabs(rms_residual_old)>EPSILON) && (fabs(rms_residual-rms_residual_old)>pAnalysisOptions->convergence))) &&
-              !(rc=reinit_analysis(Feno, n_wavel))); // SVD matrix must be initialized again when pixels are removed.
+              !(rc=reinit_analysis(pContext,pFeno, n_wavel))); // SVD matrix must be initialized again when pixels are removed.
 
           #if defined(__DEBUG_) && __DEBUG_
           // DEBUG_Stop("Test");
           #endif
 
-          if (Feno->molecularCorrection)
-           Analyse_Molecular_Ring_End(Feno,n_wavel);
+          if (pFeno->molecularCorrection)
+           Analyse_Molecular_Ring_End(pFeno,n_wavel);
 
           if (rc == THREAD_EVENT_STOP || ERROR_Fatal())
            goto EndAnalysis;
           else if (rc>THREAD_EVENT_STOP)
-           Feno->rc=rc;
+           pFeno->rc=rc;
 
-          pRecord->BestShift+=(double)Feno->TabCrossResults[Feno->indexSpectrum].Shift;
-          Feno->nIter=Niter;
+          pRecord->BestShift+=(double)pFeno->TabCrossResults[pFeno->indexSpectrum].Shift;
+          pFeno->nIter=Niter;
 
-          Feno->RMS = root_mean_square(ANALYSE_absolu, Feno->fit_properties.specrange);
+          pFeno->RMS = root_mean_square(pContext->absolu, pFeno->fit_properties.specrange);
 
           // Display residual spectrum
 
-          if  (Feno->displayResidue) {
-            if (Feno->analysisMethod!=OPTICAL_DENSITY_FIT)
-              for (int j=SvdPDeb;j<=SvdPFin;j++)
-                ANALYSE_absolu[j]=(ANALYSE_tc[j]!=(double)0.)?ANALYSE_absolu[j]/ANALYSE_tc[j]:(double)0.;
+          if  (pFeno->displayResidue) {
+            if (pFeno->analysisMethod!=OPTICAL_DENSITY_FIT)
+              for (int j=pContext->SvdPDeb;j<=pContext->SvdPFin;j++)
+                pContext->absolu[j]=(pContext->tc[j]!=(double)0.)?pContext->absolu[j]/pContext->tc[j]:(double)0.;
 
-            sprintf(graphTitle,"%s (%.2le)",(Feno->analysisMethod!=OPTICAL_DENSITY_FIT)?"Normalized Residual":"Residual",Feno->RMS);
+            sprintf(graphTitle,"%s (%.2le)",(pFeno->analysisMethod!=OPTICAL_DENSITY_FIT)?"Normalized Residual":"Residual",pFeno->RMS);
 
-            double *curves[1][2] = {{Feno->LambdaK,ANALYSE_absolu}};
-            plot_curves(indexPage,curves,1,Residual,0,graphTitle, responseHandle, Feno->fit_properties.specrange);
+            double *curves[1][2] = {{pFeno->LambdaK,pContext->absolu}};
+            plot_curves(indexPage,curves,1,Residual,0,graphTitle, responseHandle, pFeno->fit_properties.specrange);
           }
 
-          if (Feno->analysisMethod!=OPTICAL_DENSITY_FIT)
-           for (int j=SvdPDeb;j<=SvdPFin;j++)
-             ANALYSE_absolu[j]= (ANALYSE_t[j]>0.) ? log(ANALYSE_t[j]) : 0.;
+          if (pFeno->analysisMethod!=OPTICAL_DENSITY_FIT)
+           for (int j=pContext->SvdPDeb;j<=pContext->SvdPFin;j++)
+             pContext->absolu[j]= (pContext->t[j]>0.) ? log(pContext->t[j]) : 0.;
 
-          if (strlen(Feno->residualsFile) &&
-              ((rc=AnalyseSaveResiduals(Feno->residualsFile,pEngineContext,n_wavel))!=ERROR_ID_NO))
+          if (strlen(pFeno->residualsFile) &&
+              ((rc=AnalyseSaveResiduals(pContext,pFeno->residualsFile,pEngineContext,n_wavel))!=ERROR_ID_NO))
 
            goto EndAnalysis;
 
-          if  (Feno->displayResidue && (Feno->analysisMethod!=OPTICAL_DENSITY_FIT))
+          if  (pFeno->displayResidue && (pFeno->analysisMethod!=OPTICAL_DENSITY_FIT))
            {
-            double * curves[1][2] = {{Feno->LambdaK,ANALYSE_absolu}};
-            plot_curves(indexPage,curves,1,Residual,allowFixedScale,"OD Residual", responseHandle, Feno->fit_properties.specrange);
+            double * curves[1][2] = {{pFeno->LambdaK,pContext->absolu}};
+            plot_curves(indexPage,curves,1,Residual,allowFixedScale,"OD Residual", responseHandle, pFeno->fit_properties.specrange);
            }
 
           // Store fits
 
-          memcpy(ANALYSE_secX,ANALYSE_zeros,sizeof(double)*n_wavel);
+          memcpy(pContext->secX,ANALYSE_zeros,sizeof(double)*n_wavel);
           memcpy(Trend,ANALYSE_zeros,sizeof(double)*n_wavel);
           memcpy(offset,ANALYSE_zeros,sizeof(double)*n_wavel);
           maxOffset=(double)0.;
 
           // if analysis has failed, don't try to plot results (some
           // buffers contain garbage data which can make Qwt crash)
-          if (Feno->rc) goto SKIP_PLOTS;
+          if (pFeno->rc) goto SKIP_PLOTS;
 
           // Display Offset
 
-          if  (Feno->displayPredefined &&
-               ((Feno->indexOffsetConst!=ITEM_NONE) ||
-                (Feno->indexOffsetOrder1!=ITEM_NONE) ||
-                (Feno->indexOffsetOrder2!=ITEM_NONE)) &&
+          if  (pFeno->displayPredefined &&
+               ((pFeno->indexOffsetConst!=ITEM_NONE) ||
+                (pFeno->indexOffsetOrder1!=ITEM_NONE) ||
+                (pFeno->indexOffsetOrder2!=ITEM_NONE)) &&
 
-               ((TabCross[Feno->indexOffsetConst].FitParam!=ITEM_NONE) ||
-                (TabCross[Feno->indexOffsetOrder1].FitParam!=ITEM_NONE) ||
-                (TabCross[Feno->indexOffsetOrder2].FitParam!=ITEM_NONE) ||
-                (TabCross[Feno->indexOffsetConst].InitParam!=0.) ||
-                (TabCross[Feno->indexOffsetOrder1].InitParam!=0.) ||
-                (TabCross[Feno->indexOffsetOrder2].InitParam!=0.))) {
-             lambda0=Feno->lambda0;
+               ((TabCross[pFeno->indexOffsetConst].FitParam!=ITEM_NONE) ||
+                (TabCross[pFeno->indexOffsetOrder1].FitParam!=ITEM_NONE) ||
+                (TabCross[pFeno->indexOffsetOrder2].FitParam!=ITEM_NONE) ||
+                (TabCross[pFeno->indexOffsetConst].InitParam!=0.) ||
+                (TabCross[pFeno->indexOffsetOrder1].InitParam!=0.) ||
+                (TabCross[pFeno->indexOffsetOrder2].InitParam!=0.))) {
+             lambda0=pFeno->lambda0;
 
             doas_iterator my_iterator;
-            for (int l=iterator_start(&my_iterator, Feno->fit_properties.specrange); l != ITERATOR_FINISHED; l=iterator_next(&my_iterator)) {
+            for (int l=iterator_start(&my_iterator, pFeno->fit_properties.specrange); l != ITERATOR_FINISHED; l=iterator_next(&my_iterator)) {
               // log(I+offset)=log(I)+log(1+offset/I)
-              newVal = 1.-Feno->xmean*(Results[Feno->indexOffsetConst].Param+
-                                       Results[Feno->indexOffsetOrder1].Param*(ANALYSE_splineX[l]-lambda0)+
-                                       Results[Feno->indexOffsetOrder2].Param*(ANALYSE_splineX[l]-lambda0)*(ANALYSE_splineX[l]-lambda0))/Spectre[l];
+              newVal = 1.-pFeno->xmean*(Results[pFeno->indexOffsetConst].Param+
+                                       Results[pFeno->indexOffsetOrder1].Param*(pContext->splineX[l]-lambda0)+
+                                       Results[pFeno->indexOffsetOrder2].Param*(pContext->splineX[l]-lambda0)*(pContext->splineX[l]-lambda0))/Spectre[l];
 
-              ANALYSE_absolu[l]+=(newVal > 0. ? log(newVal) : 0. )-ANALYSE_secX[l];
-              ANALYSE_secX[l]=newVal > 0. ? log(newVal) : 0.;
+              pContext->absolu[l]+=(newVal > 0. ? log(newVal) : 0. )-pContext->secX[l];
+              pContext->secX[l]=newVal > 0. ? log(newVal) : 0.;
             }
 
-            double *curves[2][2] = {{Feno->LambdaK, ANALYSE_absolu},
-                                    {Feno->LambdaK, ANALYSE_secX}};
-            plot_curves(indexPage,curves,2,Residual,allowFixedScale,"Offset", responseHandle, Feno->fit_properties.specrange);
+            double *curves[2][2] = {{pFeno->LambdaK, pContext->absolu},
+                                    {pFeno->LambdaK, pContext->secX}};
+            plot_curves(indexPage,curves,2,Residual,allowFixedScale,"Offset", responseHandle, pFeno->fit_properties.specrange);
           }
 
           // Display fits
 
-          for (int i=0;i<Feno->NTabCross;i++) {
+          for (int i=0;i<pFeno->NTabCross;i++) {
             if (TabCross[i].IndSvdA) {
               if (((WorkSpace[TabCross[i].Comp].type==WRK_SYMBOL_CROSS) ||
                    (WorkSpace[TabCross[i].Comp].type==WRK_SYMBOL_PREDEFINED)) &&
-                  Feno->displayFits && TabCross[i].display) {
+                  pFeno->displayFits && TabCross[i].display) {
 
                 doas_iterator my_iterator;
-                for (int k=1,l=iterator_start(&my_iterator, Feno->fit_properties.specrange); l != ITERATOR_FINISHED; k++,l=iterator_next(&my_iterator)) {
-                  newVal=x[TabCross[i].IndSvdA]*Feno->fit_properties.A[TabCross[i].IndSvdA][k];
-                  ANALYSE_absolu[l]+=newVal-ANALYSE_secX[l];
-                  ANALYSE_secX[l]=newVal;
+                for (int k=1,l=iterator_start(&my_iterator, pFeno->fit_properties.specrange); l != ITERATOR_FINISHED; k++,l=iterator_next(&my_iterator)) {
+                  newVal=pContext->x[TabCross[i].IndSvdA]*pFeno->fit_properties.A[TabCross[i].IndSvdA][k];
+                  pContext->absolu[l]+=newVal-pContext->secX[l];
+                  pContext->secX[l]=newVal;
                 }
 
                 sprintf(graphTitle,"%s (%.2le)",WorkSpace[TabCross[i].Comp].symbolName,Results[i].SlntCol);
-                double *curves[2][2] = {{Feno->LambdaK, ANALYSE_absolu},
-                                        {Feno->LambdaK, ANALYSE_secX}};
-                plot_curves(indexPage,curves,2,Residual,allowFixedScale,graphTitle, responseHandle, Feno->fit_properties.specrange);
+                double *curves[2][2] = {{pFeno->LambdaK, pContext->absolu},
+                                        {pFeno->LambdaK, pContext->secX}};
+                plot_curves(indexPage,curves,2,Residual,allowFixedScale,graphTitle, responseHandle, pFeno->fit_properties.specrange);
 
-              } else if ((WorkSpace[TabCross[i].Comp].type==WRK_SYMBOL_CONTINUOUS) && Feno->displayTrend) {
+              } else if ((WorkSpace[TabCross[i].Comp].type==WRK_SYMBOL_CONTINUOUS) && pFeno->displayTrend) {
 
                 doas_iterator my_iterator;
                 if ((tolower(WorkSpace[TabCross[i].Comp].symbolName[0])=='x') ||
                     (tolower(WorkSpace[TabCross[i].Comp].symbolName[2])=='x')) { // polynomial
-                  for (int k=1,l=iterator_start(&my_iterator, Feno->fit_properties.specrange); l != ITERATOR_FINISHED; k++,l=iterator_next(&my_iterator))
-                    Trend[l]+=x[TabCross[i].IndSvdA]*Feno->fit_properties.A[TabCross[i].IndSvdA][k];
+                  for (int k=1,l=iterator_start(&my_iterator, pFeno->fit_properties.specrange); l != ITERATOR_FINISHED; k++,l=iterator_next(&my_iterator))
+                    Trend[l]+=pContext->x[TabCross[i].IndSvdA]*pFeno->fit_properties.A[TabCross[i].IndSvdA][k];
                 } else if (!strncmp( WorkSpace[TabCross[i].Comp].symbolName, "offl", 4) ) { // linear offset
-                  for (int k=1,l=iterator_start(&my_iterator, Feno->fit_properties.specrange); l != ITERATOR_FINISHED; k++,l=iterator_next(&my_iterator))
-                    offset[l]+=x[TabCross[i].IndSvdA]*Feno->fit_properties.A[TabCross[i].IndSvdA][k];
+                  for (int k=1,l=iterator_start(&my_iterator, pFeno->fit_properties.specrange); l != ITERATOR_FINISHED; k++,l=iterator_next(&my_iterator))
+                    offset[l]+=pContext->x[TabCross[i].IndSvdA]*pFeno->fit_properties.A[TabCross[i].IndSvdA][k];
 
-                  for (int l=iterator_start(&my_iterator, Feno->fit_properties.specrange); l != ITERATOR_FINISHED; l=iterator_next(&my_iterator))
+                  for (int l=iterator_start(&my_iterator, pFeno->fit_properties.specrange); l != ITERATOR_FINISHED; l=iterator_next(&my_iterator))
                     if (fabs(offset[l])>maxOffset)
                       maxOffset=fabs(offset[l]);
                 }
@@ -4158,40 +4782,40 @@ RC ANALYSE_Spectrum(ENGINE_CONTEXT *pEngineContext,void *responseHandle)
 
           // Display Trend
 
-          if (Feno->displayTrend) {
+          if (pFeno->displayTrend) {
             doas_iterator my_iterator;
-            for (int l=iterator_start(&my_iterator, Feno->fit_properties.specrange); l != ITERATOR_FINISHED; l=iterator_next(&my_iterator))
-             ANALYSE_absolu[l]+=Trend[l]-ANALYSE_secX[l];
+            for (int l=iterator_start(&my_iterator, pFeno->fit_properties.specrange); l != ITERATOR_FINISHED; l=iterator_next(&my_iterator))
+             pContext->absolu[l]+=Trend[l]-pContext->secX[l];
 
-            double *curves[2][2] = {{Feno->LambdaK,ANALYSE_absolu},
-                                    {Feno->LambdaK,Trend}};
-            plot_curves(indexPage,curves,2,Residual,allowFixedScale,"Polynomial", responseHandle, Feno->fit_properties.specrange);
+            double *curves[2][2] = {{pFeno->LambdaK,pContext->absolu},
+                                    {pFeno->LambdaK,Trend}};
+            plot_curves(indexPage,curves,2,Residual,allowFixedScale,"Polynomial", responseHandle, pFeno->fit_properties.specrange);
 
             if (maxOffset > 0.) {
               doas_iterator my_iterator;
-              if (Feno->analysisMethod==INTENSITY_FIT)
-               for (int l=iterator_start(&my_iterator, Feno->fit_properties.specrange); l != ITERATOR_FINISHED; l=iterator_next(&my_iterator))
+              if (pFeno->analysisMethod==INTENSITY_FIT)
+               for (int l=iterator_start(&my_iterator, pFeno->fit_properties.specrange); l != ITERATOR_FINISHED; l=iterator_next(&my_iterator))
                 offset[l]=-offset[l];           // inverse the sign in order to have the same display as in SVD method
 
 
-              for (int l=iterator_start(&my_iterator, Feno->fit_properties.specrange); l != ITERATOR_FINISHED; l=iterator_next(&my_iterator))
-               ANALYSE_absolu[l]+=offset[l]-Trend[l];
+              for (int l=iterator_start(&my_iterator, pFeno->fit_properties.specrange); l != ITERATOR_FINISHED; l=iterator_next(&my_iterator))
+               pContext->absolu[l]+=offset[l]-Trend[l];
 
-              double *curves[2][2] = {{Feno->LambdaK, ANALYSE_absolu},
-                                      {Feno->LambdaK, offset}};
-              plot_curves(indexPage, curves, 2, Residual, allowFixedScale, "Linear offset",responseHandle, Feno->fit_properties.specrange);
+              double *curves[2][2] = {{pFeno->LambdaK, pContext->absolu},
+                                      {pFeno->LambdaK, offset}};
+              plot_curves(indexPage, curves, 2, Residual, allowFixedScale, "Linear offset",responseHandle, pFeno->fit_properties.specrange);
             }
           }  // end displayTrend
 
          SKIP_PLOTS:
 
-          if (!Feno->rc)
+          if (!pFeno->rc)
            nrc++;
           else
            irc++;
 
           if (displayFlag && saveFlag) {
-            indexLine = Feno->displayLineIndex;
+            indexLine = pFeno->displayLineIndex;
             indexColumn=2;
 
             mediateResponseCellDataString(indexPage,indexLine,indexColumn,tabTitle,responseHandle);
@@ -4201,21 +4825,21 @@ RC ANALYSE_Spectrum(ENGINE_CONTEXT *pEngineContext,void *responseHandle)
              mediateResponseCellInfoNoLabel(indexPage,indexLine,indexColumn,responseHandle,
                                             "Spike removal: the following pixels were excluded after %d iterations",num_repeats_spikes);
              for (i = 0; i< n_wavel; i++)
-              if(Feno->spikes[i])
+              if(pFeno->spikes[i])
                mediateResponseCellInfoNoLabel(indexPage,indexLine++,indexColumn+1, responseHandle,"%d",i);
 
              indexLine++;
             }
 
-            if (Feno->molecularCorrection)
+            if (pFeno->molecularCorrection)
              {
               mediateResponseCellInfoNoLabel(indexPage,indexLine++,indexColumn,responseHandle,
                                             "Molecular ring processed in %d iterations",num_repeats_ring-1);
               indexLine++;
              }
 
-            mediateResponseCellInfo(indexPage,indexLine++,indexColumn,responseHandle,"OD ChiSquare","%.5le",Feno->chiSquare);
-            mediateResponseCellInfo(indexPage,indexLine++,indexColumn,responseHandle,"RMS Residual","%.5le",Feno->RMS);
+            mediateResponseCellInfo(indexPage,indexLine++,indexColumn,responseHandle,"OD ChiSquare","%.5le",pFeno->chiSquare);
+            mediateResponseCellInfo(indexPage,indexLine++,indexColumn,responseHandle,"RMS Residual","%.5le",pFeno->RMS);
             mediateResponseCellInfo(indexPage,indexLine,indexColumn,responseHandle,"Iterations","%d",Niter);
 
             indexLine+=2;
@@ -4226,7 +4850,7 @@ RC ANALYSE_Spectrum(ENGINE_CONTEXT *pEngineContext,void *responseHandle)
 
             indexLine++;
 
-            for (i=0;i<Feno->NTabCross;i++) {
+            for (i=0;i<pFeno->NTabCross;i++) {
               mediateResponseCellDataString(indexPage,indexLine,indexColumn,WorkSpace[TabCross[i].Comp].symbolName,responseHandle);
               // -------------------------------------------------------------------
               if (TabCross[i].IndSvdA)
@@ -4251,12 +4875,12 @@ RC ANALYSE_Spectrum(ENGINE_CONTEXT *pEngineContext,void *responseHandle)
 
           // Recover spectral window limits and gaps which were possibly modified after spike removal
 
-          if (!spectrum_isequal(old_range,Feno->fit_properties.specrange)) {
+          if (!spectrum_isequal(old_range,pFeno->fit_properties.specrange)) {
             //AnalyseCopyFenetre(Feno->fit_properties.Fenetre,&Feno->fit_properties.Z,oldFenetre,oldZ);
-            spectrum_destroy(Feno->fit_properties.specrange);
-            Feno->fit_properties.specrange = old_range;
-            Feno->fit_properties.DimL = spectrum_length(Feno->fit_properties.specrange);
-            Feno->Decomp = 1;
+            spectrum_destroy(pFeno->fit_properties.specrange);
+            pFeno->fit_properties.specrange = old_range;
+            pFeno->fit_properties.DimL = spectrum_length(pFeno->fit_properties.specrange);
+            pFeno->Decomp = 1;
           } else {
             spectrum_destroy(old_range);
           }
@@ -4312,9 +4936,11 @@ RC ANALYSE_Spectrum(ENGINE_CONTEXT *pEngineContext,void *responseHandle)
   DEBUG_FunctionStop((char *)__func__,rc);
 #endif
 
+  TIMING_Stop(TIMING_STAGE_ANALYSIS,timingStart);
+
   //  TO SIMULATE ERROR ON SPECTRA
   //  if ((pEngineContext->indexRecord%2)==0)
-  //   rc=ERROR_SetLast((char *)__func__,ERROR_TYPE_WARNING,ERROR_ID_LOG,analyseIndexRecord);
+  //   rc=ERROR_SetLast((char *)__func__,ERROR_TYPE_WARNING,ERROR_ID_LOG,pContext->indexRecord);
 
   return (irc)?-1:rc;
 }
@@ -4437,6 +5063,8 @@ void ANALYSE_ResetData(void)
          MEMORY_ReleaseDVector((char *)__func__,"molecularCrossSection",pTabCross->molecularCrossSection,0);
        }
 
+      XSCONV_SlitBankFree(&pTabFeno->slitBank);
+
       memset(pTabFeno,0,sizeof(FENO));
 
       pTabFeno->Shift=pTabFeno->Stretch=pTabFeno->Stretch2=0.;
@@ -4536,68 +5164,16 @@ void ANALYSE_ResetData(void)
 
   // Release global buffers
 
-  if (Fitp!=NULL)
-   MEMORY_ReleaseDVector((char *)__func__,"Fitp",Fitp,0);
-  if (FitDeltap!=NULL)
-   MEMORY_ReleaseDVector((char *)__func__,"FitDeltap",FitDeltap,0);
-  if (FitMinp!=NULL)
-   MEMORY_ReleaseDVector((char *)__func__,"FitMinp",FitMinp,0);
-  if (FitMaxp!=NULL)
-   MEMORY_ReleaseDVector((char *)__func__,"FitMaxp",FitMaxp,0);
-  if (a!=NULL)
-   MEMORY_ReleaseDVector((char *)__func__,"a",a,1);
-  if (b!=NULL)
-   MEMORY_ReleaseDVector((char *)__func__,"b",b,1);
-  if (x!=NULL)
-   MEMORY_ReleaseDVector((char *)__func__,"x",x,0);
-  if (Sigma!=NULL)
-   MEMORY_ReleaseDVector((char *)__func__,"Sigma",Sigma,0);
-  if (ANALYSE_shift!=NULL)
-   MEMORY_ReleaseDVector((char *)__func__,"ANALYSE_shift",ANALYSE_shift,0);
+  ANALYSE_ContextFree(&ANALYSE_context);
+
   if (ANALYSE_pixels!=NULL)
    MEMORY_ReleaseDVector((char *)__func__,"ANALYSE_pixels",ANALYSE_pixels,0);
-  if (ANALYSE_splineX!=NULL)
-   MEMORY_ReleaseDVector((char *)__func__,"ANALYSE_splineX",ANALYSE_splineX,0);
-  if (ANALYSE_absolu!=NULL)
-   MEMORY_ReleaseDVector((char *)__func__,"ANALYSE_absolu",ANALYSE_absolu,0);
-  if (ANALYSE_t!=NULL)
-   MEMORY_ReleaseDVector((char *)__func__,"ANALYSE_t",ANALYSE_t,0);
-  if (ANALYSE_tc!=NULL)
-   MEMORY_ReleaseDVector((char *)__func__,"ANALYSE_tc",ANALYSE_tc,0);
-  if (ANALYSE_xsTrav!=NULL)
-   MEMORY_ReleaseDVector((char *)__func__,"ANALYSE_xsTrav",ANALYSE_xsTrav,0);
-  if (ANALYSE_xsTrav2!=NULL)
-   MEMORY_ReleaseDVector((char *)__func__,"ANALYSE_xsTrav2",ANALYSE_xsTrav2,0);
-  if (ANALYSE_secX!=NULL)
-   MEMORY_ReleaseDVector((char *)__func__,"ANALYSE_secX",ANALYSE_secX,0);
-  if (SplineSpec!=NULL)
-   MEMORY_ReleaseDVector((char *)__func__,"SplineSpec",SplineSpec,0);
-  if (SplineRef!=NULL)
-   MEMORY_ReleaseDVector((char *)__func__,"SplineRef",SplineRef,0);
   if (ANALYSE_zeros!=NULL)
    MEMORY_ReleaseDVector((char *)__func__,"ANALYSE_zeros",ANALYSE_zeros,0);
   if (ANALYSE_ones!=NULL)
    MEMORY_ReleaseDVector((char *)__func__,"ANALYSE_ones",ANALYSE_ones,0);
 
-  Fitp=
-    FitDeltap=
-    FitMinp=
-    FitMaxp=
-    a=
-    b=
-    x=
-    Sigma=
-    ANALYSE_shift=
-    ANALYSE_pixels=
-    ANALYSE_splineX=
-    ANALYSE_absolu=
-    ANALYSE_secX=
-    ANALYSE_t=
-    ANALYSE_tc=
-    ANALYSE_xsTrav=
-    ANALYSE_xsTrav2=
-    SplineSpec=
-    SplineRef=
+  ANALYSE_pixels=
     ANALYSE_zeros=
     ANALYSE_ones=NULL;
 
@@ -6128,6 +6704,138 @@ RC ANALYSE_LoadRef(ENGINE_CONTEXT *pEngineContext,INDEX indexFenoColumn)
   return rc;
 }
 
+// ------------------------------------------------------------------------------
+// ANALYSE_LoadRefGrid : Wavelength calibration of the reference of a window
+// ------------------------------------------------------------------------------
+
+// Same grid as the one ANALYSE_LoadRef leaves in LambdaRef, but without setting up
+// the analysis window.  lambda holds the calibration of the row on input and the
+// grid of the reference on output.  Used to get the wavelength range of the
+// detector rows of imagers whose analysis windows are only loaded on demand.
+
+RC ANALYSE_LoadRefGrid(ENGINE_CONTEXT *pEngineContext,const char *ref1,const char *ref2,int useKurucz,int refSelectionMode,int n_wavel_ref1,INDEX indexFenoColumn,double *lambda)
+{
+  // Declarations
+
+  double *spectrum,*sigma,*lambdaRef;
+  double normFact;
+  int useEtalon;
+  const char *ptr;
+  RC rc;
+
+  // Initializations
+
+  const int n_wavel = NDET[indexFenoColumn];
+  const int format = pEngineContext->project.instrumental.readOutFormat;
+  int n_wavel_ref = n_wavel;
+
+  spectrum=sigma=lambdaRef=NULL;
+  useEtalon=0;
+  rc=ERROR_ID_NO;
+
+  // No reference file read, the grid of the row is kept
+
+  if ((((format==PRJCT_INSTR_FORMAT_MFC) || (format==PRJCT_INSTR_FORMAT_MFC_STD)) && strlen(ref1) && !strrchr(ref1,PATH_SEP)) ||
+      ((format==PRJCT_INSTR_FORMAT_MKZY) && !strlen(ref1) && !strlen(ref2)))
+   return rc;
+
+  if (((spectrum=(double *)MEMORY_AllocDVector((char *)__func__,"spectrum",0,n_wavel))==NULL) ||
+      ((sigma=(double *)MEMORY_AllocDVector((char *)__func__,"sigma",0,n_wavel))==NULL) ||
+      ((lambdaRef=(double *)MEMORY_AllocDVector((char *)__func__,"lambdaRef",0,n_wavel))==NULL))
+
+   rc=ERROR_ID_ALLOC;
+
+  else
+   {
+    // ====
+    // Ref1
+    // ====
+
+    memcpy(spectrum,ANALYSE_ones,sizeof(double)*n_wavel);
+
+    if ((useKurucz!=ANLYS_KURUCZ_SPEC) && (useKurucz!=ANLYS_KURUCZ_REF_AND_SPEC) && strlen(ref1))
+     {
+      switch(format) {
+      case PRJCT_INSTR_FORMAT_OMI:
+        rc=OMI_GetReference(pEngineContext->project.instrumental.omi.spectralType,ref1,indexFenoColumn,lambda,spectrum,sigma,&n_wavel_ref);
+        break;
+      case PRJCT_INSTR_FORMAT_APEX:
+        rc=apex_get_reference(ref1,indexFenoColumn,lambda,spectrum,&n_wavel_ref);
+        break;
+      case PRJCT_INSTR_FORMAT_TROPOMI:
+        rc=tropomi_get_reference(ref1,indexFenoColumn,lambda,spectrum,sigma,n_wavel_ref1,0);
+        n_wavel_ref=n_wavel_ref1;
+        if (!n_wavel_ref) {
+          pEngineContext->project.instrumental.use_row[indexFenoColumn] = false;
+        }
+        break;
+      case PRJCT_INSTR_FORMAT_GEMS:
+      case PRJCT_INSTR_FORMAT_GOME1_NETCDF:                                     // radiance as reference, interpolated on the grid of the row
+        break;
+      default:
+        rc=AnalyseLoadVector("ANALYSE_LoadRefGrid (ref1) ",ref1,lambda,spectrum,n_wavel,indexFenoColumn);
+        break;
+      }
+
+      if (!rc &&
+          !(rc=THRD_SpectrumCorrection(pEngineContext,spectrum,n_wavel)) &&
+          !(rc=VECTOR_NormalizeVector(spectrum-1,n_wavel_ref,&normFact,"ANALYSE_LoadRefGrid (ref1) ")))
+       useEtalon=1;
+     }
+
+    // ====
+    // Ref2
+    // ====
+
+    memcpy(lambdaRef,lambda,sizeof(double)*n_wavel);
+
+    if (!rc &&
+        (useKurucz!=ANLYS_KURUCZ_SPEC) &&
+        (refSelectionMode==ANLYS_REF_SELECTION_MODE_FILE) &&
+        strlen(ref2) &&
+
+        ((format!=PRJCT_INSTR_FORMAT_OMI) ||
+         (((ptr=strrchr(ref2,'.'))!=NULL) &&
+          (strlen(ptr)==4) && !strcasecmp(ptr,".ref"))))
+     {
+      switch(format) {
+      case PRJCT_INSTR_FORMAT_TROPOMI:
+      case PRJCT_INSTR_FORMAT_GOME1_NETCDF:
+      case PRJCT_INSTR_FORMAT_GEMS:                                             // radiance as reference, interpolated on the grid of the row
+        break;
+      case PRJCT_INSTR_FORMAT_APEX:
+        rc=apex_get_reference(ref2,indexFenoColumn,lambdaRef,spectrum,&n_wavel_ref);
+        break;
+      default:
+        rc=AnalyseLoadVector("ANALYSE_LoadRefGrid (ref2) ",ref2,lambdaRef,spectrum,n_wavel,indexFenoColumn);
+        break;
+      }
+
+      if (!rc &&
+          !(rc=THRD_SpectrumCorrection(pEngineContext,spectrum,n_wavel)) &&
+          !(rc=VECTOR_NormalizeVector(spectrum-1,n_wavel_ref,&normFact,"ANALYSE_LoadRefGrid (ref2) ")) &&
+          !useEtalon && (!is_satellite(format) ||
+                         (format==PRJCT_INSTR_FORMAT_OMI) ||
+                         (format==PRJCT_INSTR_FORMAT_GEMS) ||
+                         (format==PRJCT_INSTR_FORMAT_TROPOMI) ||
+                         (format==PRJCT_INSTR_FORMAT_APEX)))
+
+       memcpy(lambda,lambdaRef,sizeof(double)*n_wavel);
+     }
+   }
+
+  // Return
+
+  if (spectrum!=NULL)
+   MEMORY_ReleaseDVector((char *)__func__,"spectrum",spectrum,0);
+  if (sigma!=NULL)
+   MEMORY_ReleaseDVector((char *)__func__,"sigma",sigma,0);
+  if (lambdaRef!=NULL)
+   MEMORY_ReleaseDVector((char *)__func__,"lambdaRef",lambdaRef,0);
+
+  return rc;
+}
+
 // -----------------------------------------------------------------------------------------
 // AnalyseSetAnalysisType : Set the type of analysis to apply in the current analysis window
 // -----------------------------------------------------------------------------------------
@@ -6182,7 +6890,7 @@ RC ANALYSE_SetInit(ENGINE_CONTEXT *pEngineContext)
   // Initializations
 
   pEngineContext->analysisRef.refAuto=pEngineContext->analysisRef.refLon=0;
-  analyseIndexRecord=pEngineContext->indexRecord;
+  ANALYSE_context.indexRecord=pEngineContext->indexRecord;
   memset(&pEngineContext->analysisRef,0,sizeof(ANALYSIS_REF));
 
   rc=ERROR_ID_NO;
@@ -6383,12 +7091,16 @@ void ANALYSE_Free(void)
 //               undersampling cross sections should account for possible shift
 //               between Ref2 and Ref1;
 //               so this function is called after ANALYSE_Spectrum.
+//
+// The 2,ITEM_NONE combination uses the analysis window and the shifted grid
+// of the fit in progress, found in the given analysis context.
 // -----------------------------------------------------------------------------
-RC ANALYSE_UsampBuild(int analysisFlag,int gomeFlag,int indexFenoColumn)
+static RC AnalyseUsampBuild(const ANALYSE_CONTEXT *pContext,int analysisFlag,int gomeFlag,int indexFenoColumn)
 {
   // Declarations
 
   MATRIX_OBJECT khrConvoluted,slitMatrix[NSFP];
+  XSCACHE_KEY cacheKey;
   INDEX indexFeno,i,indexPixMin,indexPixMax,j;
   double slitParam[NSFP],*lambda,*lambda2,lambda0,x0;
   FENO *pTabFeno;
@@ -6403,6 +7115,7 @@ RC ANALYSE_UsampBuild(int analysisFlag,int gomeFlag,int indexFenoColumn)
   lambda2=NULL;
   memset(&slitMatrix,0,sizeof(MATRIX_OBJECT)*NSFP);
   memset(&khrConvoluted,0,sizeof(MATRIX_OBJECT));
+  memset(&cacheKey,0,sizeof(XSCACHE_KEY));
 
   for (i=0;i<NSFP;i++)
    slitParam[i]=(double)0.;
@@ -6435,7 +7148,7 @@ RC ANALYSE_UsampBuild(int analysisFlag,int gomeFlag,int indexFenoColumn)
          ((gomeFlag==ITEM_NONE) || (pTabFeno->gomeRefFlag==gomeFlag)) &&
          (((analysisFlag==0) && (pTabFeno->refSpectrumSelectionMode==ANLYS_REF_SELECTION_MODE_FILE) && (pUsamp->method==PRJCT_USAMP_FIXED)) ||
           ((analysisFlag==1) && (pTabFeno->refSpectrumSelectionMode==ANLYS_REF_SELECTION_MODE_AUTOMATIC) && (pUsamp->method==PRJCT_USAMP_FIXED)) ||
-          ((analysisFlag==2) && (pTabFeno==Feno))))
+          ((analysisFlag==2) && (pContext!=NULL) && (pTabFeno==pContext->Feno))))
       {
        // Build lambda for second phase
 
@@ -6460,7 +7173,7 @@ RC ANALYSE_UsampBuild(int analysisFlag,int gomeFlag,int indexFenoColumn)
         for (i=indexPixMin+1,lambda2[indexPixMin]=lambda[indexPixMin]-pUsamp->phase;i<indexPixMax;i++)
          lambda2[i]=lambda[i]-pUsamp->phase; //  (double)(1.-pUsamp->phase)*lambda[i-1]+pUsamp->phase*lambda[i];
        else
-        memcpy(lambda2,ANALYSE_shift,sizeof(double)*pTabFeno->NDET);
+        memcpy(lambda2,pContext->shift,sizeof(double)*pTabFeno->NDET);
 
        // Not allowed combinations :
        //
@@ -6485,10 +7198,23 @@ RC ANALYSE_UsampBuild(int analysisFlag,int gomeFlag,int indexFenoColumn)
         {
          memcpy(khrConvoluted.matrix[0],&ANALYSE_usampBuffers.hrSolar.matrix[0][ANALYSE_usampBuffers.lambdaRange[0][indexFeno]],sizeof(double)*khrConvoluted.nl);
 
+         // The convolved solar spectrum only depends on the project properties; it can be reused from one run to the other
+
+         if (XSCACHE_Enabled())
+          {
+           XSCACHE_KeyInit(&cacheKey,"ANALYSE_UsampBuild");
+           XSCACHE_KeyAdd(&cacheKey,khrConvoluted.matrix[0],sizeof(double)*khrConvoluted.nl);
+           XSCACHE_KeyAddMatrix(&cacheKey,&ANALYSE_usampBuffers.hrSolar);
+           AnalyseSlitKey(&cacheKey,ANALYSIS_slitMatrix,ANALYSIS_slitParam,pSlitOptions->slitFunction.slitType,pSlitOptions->slitFunction.slitWveDptFlag);
+          }
+
          // Convolution with slit function from slit tab page of project properties
 
-         rc=XSCONV_TypeStandard(&khrConvoluted,0,khrConvoluted.nl,&ANALYSE_usampBuffers.hrSolar,&ANALYSE_usampBuffers.hrSolar,NULL,
-                                 pSlitOptions->slitFunction.slitType,ANALYSIS_slitMatrix,ANALYSIS_slitParam,pSlitOptions->slitFunction.slitWveDptFlag);
+         if (!XSCACHE_Load(&cacheKey,khrConvoluted.matrix[1],khrConvoluted.nl) &&
+             !(rc=XSCONV_TypeStandard(&khrConvoluted,0,khrConvoluted.nl,&ANALYSE_usampBuffers.hrSolar,&ANALYSE_usampBuffers.hrSolar,NULL,
+                                      pSlitOptions->slitFunction.slitType,ANALYSIS_slitMatrix,ANALYSIS_slitParam,pSlitOptions->slitFunction.slitWveDptFlag,NULL)))
+
+          XSCACHE_Save(&cacheKey,khrConvoluted.matrix[1],khrConvoluted.nl);
         }
 
        else if (!(rc=MATRIX_Allocate(&slitMatrix[0],pTabFeno->NDET,(pKuruczOptions->fwhmType!=SLIT_TYPE_FILE)?2:3,0,0,1,(char *)__func__)) &&
@@ -6525,7 +7251,7 @@ RC ANALYSE_UsampBuild(int analysisFlag,int gomeFlag,int indexFenoColumn)
            slitMatrix[2].nl=pTabFeno->NDET;
           }
 
-         rc=XSCONV_TypeStandard(&khrConvoluted,0,khrConvoluted.nl,&ANALYSE_usampBuffers.hrSolar,&ANALYSE_usampBuffers.hrSolar,NULL,pKuruczOptions->fwhmType,slitMatrix,slitParam,1);
+         rc=XSCONV_TypeStandard(&khrConvoluted,0,khrConvoluted.nl,&ANALYSE_usampBuffers.hrSolar,&ANALYSE_usampBuffers.hrSolar,NULL,pKuruczOptions->fwhmType,slitMatrix,slitParam,1,NULL);
 
          for (i=0;i<NSFP;i++)
           MATRIX_Free(&slitMatrix[i],(char *)__func__);
@@ -6694,6 +7420,11 @@ RC ANALYSE_UsampGlobalAlloc(double lambdaMin,double lambdaMax,int size)
   return rc;
 }
 
+RC ANALYSE_UsampBuild(int analysisFlag,int gomeFlag,int indexFenoColumn)
+{
+  return AnalyseUsampBuild(&ANALYSE_context,analysisFlag,gomeFlag,indexFenoColumn);
+}
+
 // -----------------------------------------------------------------------------
 // FUNCTION      ANALYSE_UsampLocalAlloc
 // -----------------------------------------------------------------------------
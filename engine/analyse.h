@@ -3,6 +3,7 @@
 
 #include "doas.h"
 #include "matrix.h"
+#include "xsconv.h"
 #include "fit_properties.h"
 
 typedef struct anlyswin_cross_section ANALYSIS_CROSS;
@@ -207,6 +208,7 @@ struct _feno {
   int             xsToConvolute;                                                // flag set if high resolution cross sections to convolute real time
   int             xsToConvoluteI0;
   int             xsPukite;
+  SLIT_BANK       slitBank;                                                     // slit function at each wavelength of the grid of the last real time convolution
 
   double         *LambdaRef,                                                    // absolute reference wavelength scale
                  *LambdaK,                                                      // new wavelength scale after Kurucz
@@ -284,7 +286,53 @@ struct _feno {
 };
 #pragma pack(pop)
 
-extern FENO         **TabFeno,*Feno;
+// Analysis context
+// ----------------
+
+#define ANALYSE_MAX_NL_PARAMS (MAX_FIT*4)                                       // maximum number of non linear parameters (Fitp)
+
+// Everything that is written while fitting one spectrum.  Analysis windows,
+// cross sections and project options are set up once and only read during
+// the fit, so that several threads can analyse different ground pixels as
+// long as each of them works with its own context.
+
+typedef struct _analyseContext
+ {
+  FENO           *Feno;                                                         // analysis window currently fitted
+  doas_spectrum  *specrange;                                                    // fitting window and gaps of the current analysis window
+  int             SvdPDeb,SvdPFin;                                              // analysis window limits
+  int             LimMin,LimMax,LimN;                                           // analysis window limits extended for filtering and interpolation
+  int             hFilterSpecLog,hFilterRefLog;                                 // 1 if logarithms of spectrum/reference are filtered before ANALYSE_Function
+  INDEX           indexRecord;                                                  // index of the current record (error messages)
+  double          nFree;                                                        // number of free degrees
+  double          StretchFact1,StretchFact2;                                    // normalization factors of the stretch
+  double          ZM;                                                           // solar zenith angle of the current record
+  double         *Lambda,*LambdaSpec;                                           // wavelength calibrations of reference and spectrum
+  int             ndet;                                                         // size of the working buffers
+  double         *splineX,                                                      // abscissa used for spectra, in the units selected by user
+                 *shift,                                                        // abscissa after shift and stretch
+                 *absolu,                                                       // residual spectrum
+                 *secX,                                                         // residual spectrum + the contribution of a cross section for fit display
+                 *t,*tc,                                                        // residual transmission in Marquardt-Levenberg not linear method
+                 *xsTrav,*xsTrav2,                                              // temporary buffers for processing on cross sections
+                 *SplineSpec,*SplineRef,                                        // second derivatives of spectrum and reference
+                 *b,                                                            // right-hand side of the linear system
+                 *Fitp,*FitDeltap,*FitMinp,*FitMaxp,                            // initial values, steps and limits of non linear parameters
+                 *x,*Sigma,                                                     // linear parameters and their errors
+                 *scratch;                                                      // temporary buffers of the fitting function (see ANALYSE_ScratchAlloc)
+  int             scratchSize,scratchUsed;                                      // size and used part of scratch
+  double         *curfitWeight,                                                 // weights of the data points in Curfit
+                 *curfitB,*curfitBeta,                                          // new non linear parameters and gradient of the chi square in Curfit
+                **curfitAlpha,**curfitArray,                                    // curvature matrix and its normalized inverse in Curfit
+                **curfitDeriv;                                                  // derivatives of the fitting function w.r.t. the non linear parameters
+  int            *curfitIk,*curfitJk;                                           // pivots of CurfitMatinv
+  int             curfitSize;                                                   // number of non linear parameters the buffers of Curfit are allocated for
+  FFT            *pKuruczFft;                                                   // fft of the Kurucz sub-window in use when the slit function is fitted
+ }
+ANALYSE_CONTEXT;
+
+extern FENO         **TabFeno;
+extern ANALYSE_CONTEXT ANALYSE_context;                                         // context of the main thread
 
 extern int    ANALYSE_plotKurucz,ANALYSE_plotRef,ANALYSE_indexLine;
 extern int    ANALYSE_swathSize;
@@ -294,43 +342,47 @@ extern char *ANLYS_amf[ANLYS_AMF_TYPE_MAX];
 
 extern PRJCT_FILTER *ANALYSE_plFilter,*ANALYSE_phFilter;
 extern MATRIX_OBJECT ANALYSIS_slitMatrix[NSFP],O3TD;
-extern double *x,*Lambda,*LambdaSpec,
-                    ANALYSIS_slitParam[NSFP],
+extern double ANALYSIS_slitParam[NSFP],
                     *ANALYSE_pixels,
-                    *ANALYSE_splineX,              // abscissa used for spectra, in the units selected by user
-                    *ANALYSE_absolu,               // residual spectrum
-                    *ANALYSE_secX,                 // residual spectrum + the contribution of a cross section for fit display
-                    *ANALYSE_t,                    // residual transmission in Marquadt-Levenberg not linear method
-                    *ANALYSE_tc,                   // residual transmission in Marquadt-Levenberg not linear method
-                    *ANALYSE_xsTrav,
-                    *ANALYSE_shift,
                     *ANALYSE_zeros,
-                    *ANALYSE_ones,
-  ANALYSE_nFree;
+                    *ANALYSE_ones;
 
 // ----------
 // PROTOTYPES
 // ----------
 
-RC ANALYSE_Function (double *X, double *Y, const double *SigmaY, double *Yfit, int Npts,
+RC   ANALYSE_ContextAlloc(ANALYSE_CONTEXT *pContext,int ndet);
+void ANALYSE_ContextFree(ANALYSE_CONTEXT *pContext);
+RC   ANALYSE_CurfitAlloc(ANALYSE_CONTEXT *pContext,int nParams);
+double *ANALYSE_ScratchAlloc(ANALYSE_CONTEXT *pContext,int n);
+
+RC ANALYSE_Function (ANALYSE_CONTEXT *pContext,double *X, double *Y, const double *SigmaY, double *Yfit, int Npts,
                       double *fitParamsC, double *fitParamsF,INDEX indexFenoColumn, struct fit_properties *fitprops);
+int  ANALYSE_AnalyticDeriv(const ANALYSE_CONTEXT *pContext,INDEX indexTabCross,INDEX indexA);
+RC   ANALYSE_Deriv(ANALYSE_CONTEXT *pContext,double *spectrum_orig,double *reference,const double *SigmaY,int Npts,
+                   const double *fitParamsF,INDEX indexTabCross,INDEX indexA,double *deriv,INDEX indexFenoColumn,
+                   struct fit_properties *fitprops);
+RC   ShiftVector(ANALYSE_CONTEXT *pContext,const double *lambda, double *source, const double *deriv, double *target, const int n_wavel,
+                 double DSH,double DST,double DST2,double DSH_,double DST_,double DST2_,
+                 const double *Param,int fwhmDir,int kuruczFlag,INDEX indexFenoColumn);
 RC   ANALYSE_CheckLambda(WRK_SYMBOL *pWrkSymbol, const double *lambda, const int n_wavel);
 RC   ANALYSE_XsInterpolation(FENO *pTabFeno, const double *newLambda,INDEX indexFenoColumn);
 RC   ANALYSE_ConvoluteXs(const FENO *pTabFeno,int action,double conc,const MATRIX_OBJECT *pXs,
                          const MATRIX_OBJECT *slitMatrix,const double *slitParam, int slitType,
                          const double *newlambda, double *output, INDEX indexlambdaMin, INDEX indexlambdaMax, const int n_wavel,
-                         INDEX indexFenoColumn, int wveDptFlag);
+                         INDEX indexFenoColumn, int wveDptFlag, SLIT_BANK *pSlitBank);
 RC   ANALYSE_XsConvolution(FENO *pTabFeno,double *newLambda,MATRIX_OBJECT *slitMatrix,double *slitParam,int slitType,INDEX indexFenoColumn,int wveDptFlag);
-RC   ANALYSE_SvdInit(FENO *feno, struct fit_properties *fit, const int n_wavel, const double *lambda);
-RC   ANALYSE_CurFitMethod(INDEX indexFenoColumn, const double *Spectre, const double *SigmaSpec, const double *Sref, int n_wavel, double *residuals, double *Chisqr,int *pNiter,double speNormFact,double refNormFact, struct fit_properties *fit);
+RC   ANALYSE_SvdInit(ANALYSE_CONTEXT *pContext,FENO *feno, struct fit_properties *fit, const int n_wavel, const double *lambda);
+RC   ANALYSE_CurFitMethod(ANALYSE_CONTEXT *pContext,INDEX indexFenoColumn, const double *Spectre, const double *SigmaSpec, const double *Sref, int n_wavel, double *residuals, double *Chisqr,int *pNiter,double speNormFact,double refNormFact, struct fit_properties *fit);
 void ANALYSE_ResetData(void);
 RC   ANALYSE_SetInit(ENGINE_CONTEXT *pEngineContext);
-RC ANALYSE_fit_shift_stretch(int indexFeno, int indexFenoColumn, const double *spec1, const double *spec2, double *shift, double *stretch, double *stretch2, double *sigma_shift, double *sigma_stretch, double *sigma_stretch2);
+RC ANALYSE_fit_shift_stretch(ANALYSE_CONTEXT *pContext,int indexFeno, int indexFenoColumn, const double *spec1, const double *spec2, double *shift, double *stretch, double *stretch2, double *sigma_shift, double *sigma_stretch, double *sigma_stretch2);
 RC   ANALYSE_AlignReference(ENGINE_CONTEXT *pEngineContext,int refFlag,void *responseHandle,INDEX indexFenoColumn);
-RC   ANALYSE_Spectrum(ENGINE_CONTEXT *pEngineContext,void *responseHandle);
+RC   ANALYSE_Spectrum(ENGINE_CONTEXT *pEngineContext,ANALYSE_CONTEXT *pContext,void *responseHandle);
 
 void ANALYSE_SetAnalysisType(INDEX indexFenoColumn);
 RC   ANALYSE_LoadRef(ENGINE_CONTEXT *pEngineContext,INDEX indexFenoColumn);
+RC   ANALYSE_LoadRefGrid(ENGINE_CONTEXT *pEngineContext,const char *ref1,const char *ref2,int useKurucz,int refSelectionMode,int n_wavel_ref1,INDEX indexFenoColumn,double *lambda);
 RC   ANALYSE_LoadCross(ENGINE_CONTEXT *pEngineContext, const ANALYSIS_CROSS *crossSectionList,int nCross, const double *lambda,INDEX indexFenoColumn);
 RC   ANALYSE_LoadLinear(ANALYSE_LINEAR_PARAMETERS *linearList,int nLinear,INDEX indexFenoColumn);
 RC   ANALYSE_LoadNonLinear(ENGINE_CONTEXT *pEngineContext,ANALYSE_NON_LINEAR_PARAMETERS *nonLinearList,int nNonLinear,double *lambda,INDEX indexFenoColumn);
@@ -356,6 +408,6 @@ enum _pixelSelection {
 
 RC FNPixel (double *lambdaVector, double lambdaValue, int npts,int pixelSelection);
 
-extern double center_pixel_wavelength(int first, int last);
+extern double center_pixel_wavelength(const double *lambda,int first, int last);
 
 #endif
@@ -47,10 +47,25 @@
 //  FILE PROCESSING
 //  ===============
 //
+//  AsciiOffsetAdd - add a position to the offsets of the records;
+//  AsciiIndexLoad - load the offsets of the records from the cache directory;
+//  AsciiIndexSave - save the offsets of the records in the cache directory;
+//
 //  AsciiSkip - skip a given number of records in ASCII files;
 //  ASCII_Set - set file pointers for ASCII files and get the number of records;
 //  ASCII_Read - read a record from the ASCII file;
+//  ASCII_Free - release the buffers allocated for the current file.
+//
+//  ----------------------------------------------------------------------------
 //
+//  ASCII_Set reads the whole file once to count the records.  At the same
+//  time, it keeps the position of the start of each record (line format) or
+//  of each block of lines (column format), so that AsciiSkip only has to seek
+//  to the requested record.  When a cache directory is selected (option
+//  -cache of doas_cl), these offsets are saved with the number of records, so
+//  that the next runs don't have to read the file to open it.  The key of an
+//  index file includes the name, size and modification time of the spectra
+//  file and the format options.
 //  ----------------------------------------------------------------------------
 
 // =======
@@ -59,12 +74,15 @@
 
 #include <math.h>
 #include <string.h>
+#include <stdint.h>
+#include <sys/stat.h>
 
 #include "engine_context.h"
 #include "spectrum_files.h"
 #include "winthrd.h"
 #include "vector.h"
 #include "zenithal.h"
+#include "xscache.h"
 
 #include "doas.h"
 
@@ -85,6 +103,10 @@
 
 #define MAX_ASC_FIELDS 29
 
+#define ASCII_INDEX_MAGIC    "QDASCIDX"                                         // first bytes of an index file
+#define ASCII_INDEX_VERSION  1
+#define ASCII_INDEX_EXT      "aix"                                              // extension of the index files
+
 // ================
 // GLOBAL VARIABLES
 // ================
@@ -99,6 +121,21 @@ static INDEX asciiLastRecord=ITEM_NONE;
 static INDEX asciiLastDataSet=ITEM_NONE;
 static MATRIX_OBJECT asciiMatrix;
 
+static long *asciiOffset=NULL;                                                  // asciiOffset[i] is the position after the i first records or blocks of lines
+static int   asciiOffsetSize=0;                                                 // allocated size of asciiOffset
+static int   asciiOffsetNumber=0;                                               // number of offsets in asciiOffset
+
+typedef struct _asciiIndexHeader
+ {
+  char     magic[8];
+  uint32_t version;
+  uint64_t hash;                                                                // key of the index
+  int32_t  recordNumber;                                                        // number of records in the spectra file
+  int32_t  columnNumber;                                                        // number of columns (column format, 0 otherwise)
+  int32_t  offsetNumber;                                                        // number of offsets that follow the header
+ }
+ASCII_INDEX_HEADER;
+
 // ===============
 // FILE PROCESSING
 // ===============
@@ -115,6 +152,177 @@ static inline bool line_ends(FILE *fp) {
   }
 }
 
+// -----------------------------------------------------------------------------
+// FUNCTION        AsciiOffsetAdd
+// -----------------------------------------------------------------------------
+// PURPOSE         Add a position to the offsets of the records
+//
+// INPUT           offset : the position in the file
+//
+// RETURN          ERROR_ID_ALLOC if the buffer could not be extended;
+//                 ERROR_ID_NO in case of success.
+// -----------------------------------------------------------------------------
+
+static RC AsciiOffsetAdd(long offset)
+ {
+  long *newOffset;
+  int newSize;
+
+  if (asciiOffsetNumber==asciiOffsetSize)
+   {
+    newSize=(asciiOffsetSize)?2*asciiOffsetSize:1024;
+
+    if ((newOffset=(long *)MEMORY_AllocBuffer(__func__,"asciiOffset",newSize,sizeof(long),0,MEMORY_TYPE_LONG))==NULL)
+     return ERROR_ID_ALLOC;
+
+    if (asciiOffset!=NULL)
+     {
+      memcpy(newOffset,asciiOffset,sizeof(long)*asciiOffsetNumber);
+      MEMORY_ReleaseBuffer(__func__,"asciiOffset",asciiOffset);
+     }
+
+    asciiOffset=newOffset;
+    asciiOffsetSize=newSize;
+   }
+
+  asciiOffset[asciiOffsetNumber++]=offset;
+
+  return ERROR_ID_NO;
+ }
+
+// build the key of the index of a spectra file; returns 0 if the file can not be found
+
+static int AsciiIndexKey(XSCACHE_KEY *pKey,const ENGINE_CONTEXT *pEngineContext)
+ {
+  const PRJCT_ASCII *pAscii=&pEngineContext->project.instrumental.ascii;
+  const char *fileName=pEngineContext->fileInfo.fileName;
+  struct stat fileInfo;
+  int64_t fileDesc[2];
+  int32_t options[8];
+
+  if (stat(fileName,&fileInfo)==-1)
+   return 0;
+
+  fileDesc[0]=(int64_t)fileInfo.st_size;
+  fileDesc[1]=(int64_t)fileInfo.st_mtime;
+
+  options[0]=pAscii->format;
+  options[1]=NDET[0];
+  options[2]=pAscii->szaSaveFlag;
+  options[3]=pAscii->azimSaveFlag;
+  options[4]=pAscii->elevSaveFlag;
+  options[5]=pAscii->timeSaveFlag;
+  options[6]=pAscii->dateSaveFlag;
+  options[7]=pAscii->lambdaSaveFlag;
+
+  XSCACHE_KeyInit(pKey,"ascii");
+  XSCACHE_KeyAdd(pKey,fileName,strlen(fileName)+1);
+  XSCACHE_KeyAdd(pKey,fileDesc,sizeof(fileDesc));
+  XSCACHE_KeyAdd(pKey,options,sizeof(options));
+
+  return 1;
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION        AsciiIndexLoad
+// -----------------------------------------------------------------------------
+// PURPOSE         Load the offsets of the records from the cache directory
+//
+// INPUT           pEngineContext : information on the file to read
+//
+// OUTPUT          pRecordNumber  : the number of records in the file
+//                 pColumnNumber  : the number of columns (column format)
+//
+// RETURN          1 if the index has been found, 0 otherwise
+// -----------------------------------------------------------------------------
+
+static int AsciiIndexLoad(const ENGINE_CONTEXT *pEngineContext,int *pRecordNumber,int *pColumnNumber)
+ {
+  char fileName[XSCACHE_NAME_LEN];
+  ASCII_INDEX_HEADER header;
+  XSCACHE_KEY key;
+  int64_t offset;
+  FILE *fp;
+  int found;
+
+  found=0;
+
+  if (XSCACHE_Enabled() && AsciiIndexKey(&key,pEngineContext))
+   {
+    XSCACHE_EntryName(&key,ASCII_INDEX_EXT,fileName);
+
+    if ((fp=fopen(fileName,"rb"))!=NULL)
+     {
+      if ((fread(&header,sizeof(ASCII_INDEX_HEADER),1,fp)==1) &&
+          !memcmp(header.magic,ASCII_INDEX_MAGIC,sizeof(header.magic)) &&
+          (header.version==ASCII_INDEX_VERSION) &&
+          (header.hash==key.hash) &&
+          (header.offsetNumber>0))
+       {
+        found=1;
+
+        for (int i=0;found && (i<header.offsetNumber);i++)
+         if ((fread(&offset,sizeof(int64_t),1,fp)!=1) || AsciiOffsetAdd((long)offset))
+          found=0;
+
+        if (found)
+         {
+          *pRecordNumber=header.recordNumber;
+          *pColumnNumber=header.columnNumber;
+         }
+        else
+         asciiOffsetNumber=0;
+       }
+
+      fclose(fp);
+     }
+   }
+
+  return found;
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION        AsciiIndexSave
+// -----------------------------------------------------------------------------
+// PURPOSE         Save the offsets of the records in the cache directory
+//
+// INPUT           pEngineContext : information on the file read
+//                 columnNumber   : the number of columns (column format)
+//
+// REMARK          errors are ignored; the index will be built again next time
+// -----------------------------------------------------------------------------
+
+static void AsciiIndexSave(const ENGINE_CONTEXT *pEngineContext,int columnNumber)
+ {
+  char fileName[XSCACHE_NAME_LEN];
+  ASCII_INDEX_HEADER header;
+  XSCACHE_KEY key;
+  int64_t *offsets;
+
+  if (XSCACHE_Enabled() && (asciiOffsetNumber>0) && AsciiIndexKey(&key,pEngineContext) &&
+     ((offsets=(int64_t *)MEMORY_AllocBuffer(__func__,"offsets",asciiOffsetNumber,sizeof(int64_t),0,MEMORY_TYPE_LONG))!=NULL))
+   {
+    XSCACHE_EntryName(&key,ASCII_INDEX_EXT,fileName);
+
+    memset(&header,0,sizeof(ASCII_INDEX_HEADER));
+    memcpy(header.magic,ASCII_INDEX_MAGIC,sizeof(header.magic));
+    header.version=ASCII_INDEX_VERSION;
+    header.hash=key.hash;
+    header.recordNumber=pEngineContext->recordNumber;
+    header.columnNumber=columnNumber;
+    header.offsetNumber=asciiOffsetNumber;
+
+    // offsets are saved on 64 bits whatever the size of long
+
+    for (int i=0;i<asciiOffsetNumber;i++)
+     offsets[i]=(int64_t)asciiOffset[i];
+
+    XSCACHE_WriteEntry(fileName,&header,sizeof(ASCII_INDEX_HEADER),offsets,sizeof(int64_t)*asciiOffsetNumber);
+
+    MEMORY_ReleaseBuffer(__func__,"offsets",offsets);
+   }
+ }
+
 // -----------------------------------------------------------------------------
 // FUNCTION        AsciiSkip
 // -----------------------------------------------------------------------------
@@ -126,60 +334,27 @@ static inline bool line_ends(FILE *fp) {
 //
 // RETURN          ERROR_ID_FILE_NOT_FOUND if the input file pointer is NULL;
 //                 ERROR_ID_FILE_END if the end of file is reached;
-//                 ERROR_ID_ALLOC if the allocation of a buffer failed;
 //                 ERROR_ID_NO in case of success.
 // -----------------------------------------------------------------------------
 
 RC AsciiSkip(ENGINE_CONTEXT *pEngineContext,FILE *specFp,int nSkip)
  {
   // Declarations
-  int itemCount,recordCount,maxCount;                                           // counters
-  PRJCT_INSTRUMENTAL *pInstr;                                                   // pointer to the instrumental part of the pEngineContext structure
   RC rc;                                                                        // return code
 
   // Initializations
 
-  pInstr=&pEngineContext->project.instrumental;
-  maxCount=NDET[0]+pInstr->ascii.szaSaveFlag+pInstr->ascii.azimSaveFlag+pInstr->ascii.elevSaveFlag+pInstr->ascii.timeSaveFlag+pInstr->ascii.dateSaveFlag;
   rc=ERROR_ID_NO;
 
-  // Buffer allocation
-
   if (specFp==NULL)
    rc=ERROR_ID_FILE_NOT_FOUND;
-  else if (nSkip>=pEngineContext->recordNumber)
+  else if ((nSkip>=pEngineContext->recordNumber) || (nSkip>=asciiOffsetNumber))
    rc=ERROR_ID_FILE_END;
-  else
 
-  // Skip the nSkip first spectra
-   {
-    fseek(specFp,0L,SEEK_SET);
-    recordCount=0;
-    itemCount=0;
+  // Go to the position after the nSkip first spectra (offsets built by ASCII_Set)
 
-    char c[2];
-    int n_scan = 0;
-    while (recordCount<nSkip
-           && (n_scan = fscanf(specFp, " %1[^*;#\n\r]%*[^\n\r]", c) ) != EOF ) {
-      if (n_scan == 1) {
-        // no * or ; at start -> line is (part of) a record
-        if (pInstr->ascii.format==PRJCT_INSTR_ASCII_FORMAT_LINE) {
-          // Each line of the file is a spectrum record
-          ++recordCount;
-        } else {
-          // Spectra records are saved in successive columns
-          ++itemCount;
-          if (itemCount == maxCount) {
-            ++recordCount;
-            itemCount=0;
-          }
-        }
-      }
-    }
-    // Reach the end of the file
-    if (recordCount<nSkip)
-      rc=ERROR_ID_FILE_END;
-   }
+  else
+   fseek(specFp,asciiOffset[nSkip],SEEK_SET);
 
   // Return
 
@@ -189,7 +364,8 @@ RC AsciiSkip(ENGINE_CONTEXT *pEngineContext,FILE *specFp,int nSkip)
 // -----------------------------------------------------------------------------
 // FUNCTION        ASCII_Set
 // -----------------------------------------------------------------------------
-// PURPOSE         Set file pointers for ASCII files and get the number of records
+// PURPOSE         Set file pointers for ASCII files, get the number of records
+//                 and the position of each record
 //
 // INPUT           pEngineContext : information on the file to read
 //                 specFp    : pointer to the ASCII file
@@ -205,6 +381,7 @@ RC ASCII_Set(ENGINE_CONTEXT *pEngineContext,FILE *specFp)
  {
   // Declarations
   int itemCount,startCount,maxCount;                                            // counters
+  int lineCount,skipCount;                                                      // lines of the current block (column format) for the offsets of the records
   PRJCT_INSTRUMENTAL *pInstr;                                                   // pointer to the instrumental part of the pEngineContext structure
   double tempValue;
   int nc;
@@ -219,6 +396,7 @@ RC ASCII_Set(ENGINE_CONTEXT *pEngineContext,FILE *specFp)
   pInstr=&pEngineContext->project.instrumental;
   startCount=pInstr->ascii.szaSaveFlag+pInstr->ascii.azimSaveFlag+pInstr->ascii.elevSaveFlag+pInstr->ascii.timeSaveFlag+pInstr->ascii.dateSaveFlag;
   maxCount=NDET[0];
+  skipCount=NDET[0]+startCount;                                                 // number of lines of a record, as counted by AsciiSkip
   rc=ERROR_ID_NO;
   nc=0;
 
@@ -228,13 +406,24 @@ RC ASCII_Set(ENGINE_CONTEXT *pEngineContext,FILE *specFp)
 
   if (specFp==NULL)
     rc=ERROR_SetLast(__func__,ERROR_TYPE_WARNING,ERROR_ID_FILE_NOT_FOUND,pEngineContext->fileInfo.fileName);
+
+  // Number of records and offsets from the index saved by a previous run
+
+  else if (AsciiIndexLoad(pEngineContext,&pEngineContext->recordNumber,&nc)) {
+    if ((pInstr->ascii.format!=PRJCT_INSTR_ASCII_FORMAT_LINE) && (nc>pInstr->ascii.lambdaSaveFlag+1))
+      rc=MATRIX_Allocate(&asciiMatrix,NDET[0]+startCount,nc,0,0,0,__func__);
+  }
   else {
     // Get the number of records in the file
     fseek(specFp,0L,SEEK_SET);
     itemCount=0;
+    lineCount=0;
 
     char c[2];
     int n_scan = 0;
+    if ((rc=AsciiOffsetAdd(0L))!=ERROR_ID_NO)
+      return rc;
+
     while ( (n_scan = fscanf(specFp, " %1[^*;#\n\r]", c) ) != EOF) {
       if (n_scan == 0) {
         // commment, ignore and scan ahead until end of line
@@ -247,6 +436,9 @@ RC ASCII_Set(ENGINE_CONTEXT *pEngineContext,FILE *specFp)
         // Each line of the file is a spectrum record
         pEngineContext->recordNumber++;
         fscanf(specFp, "%*[^\n\r]");
+
+        if ((rc=AsciiOffsetAdd(ftell(specFp)))!=ERROR_ID_NO)
+          break;
       } else {
         // Spectra records are saved in successive columns
 
@@ -270,6 +462,12 @@ RC ASCII_Set(ENGINE_CONTEXT *pEngineContext,FILE *specFp)
         }
         ++itemCount;
 
+        if (++lineCount==skipCount) {
+          lineCount=0;
+          if ((rc=AsciiOffsetAdd(ftell(specFp)))!=ERROR_ID_NO)
+            break;
+        }
+
         // Matrix mode
         if (itemCount==maxCount) {
           itemCount=0;
@@ -280,6 +478,9 @@ RC ASCII_Set(ENGINE_CONTEXT *pEngineContext,FILE *specFp)
         }
       }
     }
+
+    if (!rc)
+      AsciiIndexSave(pEngineContext,nc);
   }
 
   // Return
@@ -596,4 +797,10 @@ RC ASCII_Read(ENGINE_CONTEXT *pEngineContext,int recordNo,int dateFlag,int local
 void ASCII_Free(const char *functionStr) {
   MATRIX_Free(&asciiMatrix,functionStr);
   memset(&asciiMatrix,0,sizeof(MATRIX_OBJECT));
+
+  if (asciiOffset!=NULL)
+    MEMORY_ReleaseBuffer(functionStr,"asciiOffset",asciiOffset);
+
+  asciiOffset=NULL;
+  asciiOffsetSize=asciiOffsetNumber=0;
 }
@@ -245,6 +245,7 @@ SHORT_DATE;
 
 #define ERROR_ID_SVD_ILLCONDITIONED           1101                              // ill-conditionned matrix
 #define ERROR_ID_SVD_ARG                       1102                             // bad arguments
+#define ERROR_ID_QR_SINGULAR                   1103                             // singular matrix in the QR decomposition
 #define ERROR_ID_SPLINE                        1110                             // spline interpolation requests increasing absissae
 #define ERROR_ID_VOIGT                         1111                             // Voigt function failed
 #define ERROR_ID_ERF                           1112                             // error with the calculation of the erf function
@@ -402,6 +403,7 @@ ERROR_DESCRIPTION;
 RC ERROR_DisplayMessage(void *responseHandle);
 RC ERROR_SetLast(const char *callingFunction,int errorType,RC errorId,...);
 RC ERROR_GetLast(ERROR_DESCRIPTION *pError);
+RC ERROR_Push(const ERROR_DESCRIPTION *pError);
 bool ERROR_Fatal(void);
 
 // ===============
@@ -464,6 +466,8 @@ RC       MEMORY_Alloc(void);
 RC       MEMORY_End(void);
 
 RC       MEMORY_GetInfo(DEBUG_VARIABLE *pVariable,char *pBuffer);
+void     MEMORY_GetStatistics(long *pAllocations,long *pReleases,long *pBytes);
+void     MEMORY_SetSampling(int n);
 
 #if defined(_cplusplus) || defined(__cplusplus)
 }
@@ -77,6 +77,7 @@
 #include "doas.h"
 #include "winthrd.h"
 #include "analyse.h"
+#include "timing.h"
 
 #include "curfit.h"
 
@@ -171,18 +172,19 @@ double Fchisq(int mode,int nFree,double *Y,double *Yfit,double *sigmaY,int nY)
 //
 // INPUT         array   - the original matrix to inverse
 //               nOrder  - the degree of the matrix (order of its determinant)
+//               ik, jk  - work buffers of nOrder items for the indexes of the pivots
 //
 // OUTPUT        array   - the inverse of the input matrix
+//               pDet    - the determinant of the matrix (0 if it is singular)
 //
-// RETURN        ERROR_ID_NO if there is no allocation problem
-//               ERROR_ID_ALLOC if the allocation of a vector failed
+// RETURN        ERROR_ID_NO
 // -----------------------------------------------------------------------------
 
-RC CurfitMatinv(double **array,int nOrder,double *pDet)
+RC CurfitMatinv(double **array,int nOrder,int *ik,int *jk,double *pDet)
  {
  	// Declarations
 
-  int    *ik, *jk, i, j, k, l;                                                  // indexes for loops and array
+  int     i, j, k, l;                                                           // indexes for loops and array
   double  amax,                                                                 // the largest element of a matrix
           saveArray;                                                            // temporary variable for swapping elements of the matrix
   RC      rc;                                                                   // return code
@@ -190,134 +192,116 @@ RC CurfitMatinv(double **array,int nOrder,double *pDet)
   // Initializations
 
   *pDet=(double)1.;                                                             // to avoid division by 0
-  jk=NULL;
   rc=ERROR_ID_NO;
 
-  // Allocate buffers for indexes of selected rows or columns of the matrix
+ 	// Reorganize the matrix in order to have the largest element in the diagonal
+ 	// in order to improve the computational precision
 
-  if (((ik=(int *)MEMORY_AllocBuffer("CurfitMatinv","ik",nOrder,sizeof(int),0,MEMORY_TYPE_INT))==NULL) ||
-      ((jk=(int *)MEMORY_AllocBuffer("CurfitMatinv","jk",nOrder,sizeof(int),0,MEMORY_TYPE_INT))==NULL))
-
-   rc=ERROR_ID_ALLOC;
-
-  else
+  for (k=0;k<nOrder;k++)
    {
-   	// Reorganize the matrix in order to have the largest element in the diagonal
-   	// in order to improve the computational precision
+   	// search for the largest element in the matrix array(k:nOrder,k:nOrder)
 
-    for (k=0;k<nOrder;k++)
+    do
      {
-     	// search for the largest element in the matrix array(k:nOrder,k:nOrder)
-
-      do
-       {
-        amax=(double)0.;
-
-        for (i=k;i<nOrder;i++)
-         for (j=k;j<nOrder;j++)
-          if (fabs(amax)<=fabs(array[i][j]))
-           {
-           	amax=array[i][j];
-           	ik[k]=i;
-           	jk[k]=j;
-           }
+      amax=(double)0.;
 
-        if (amax==(double)0.)
+      for (i=k;i<nOrder;i++)
+       for (j=k;j<nOrder;j++)
+        if (fabs(amax)<=fabs(array[i][j]))
          {
-         	*pDet=(double)0.;                                                     // a error message will be returned by the calling function
-         	return rc;
+         	amax=array[i][j];
+         	ik[k]=i;
+         	jk[k]=j;
          }
 
-        // Reorganize the matrix in order to have the largest element in array[k][k] (make it a diagonal element)
+      if (amax==(double)0.)
+       {
+       	*pDet=(double)0.;                                                     // a error message will be returned by the calling function
+       	return rc;
+       }
 
-        i=ik[k];
+      // Reorganize the matrix in order to have the largest element in array[k][k] (make it a diagonal element)
 
-        if (i>k)
+      i=ik[k];
+
+      if (i>k)
+       {
+        for (j=0;j<nOrder;j++)
          {
-          for (j=0;j<nOrder;j++)
-           {
-            saveArray =(double)array[k][j];
-            array[k][j]=(double)array[i][j];
-            array[i][j]=(double)-saveArray;
-           }
+          saveArray =(double)array[k][j];
+          array[k][j]=(double)array[i][j];
+          array[i][j]=(double)-saveArray;
          }
+       }
 
-        j=jk[k];
+      j=jk[k];
 
-        if ((j>k) && (i>=k))
+      if ((j>k) && (i>=k))
+       {
+        for (i=0;i<nOrder;i++)
          {
-          for (i=0;i<nOrder;i++)
-           {
-            saveArray =(double)array[i][k];
-            array[i][k]=(double)array[i][j];
-            array[i][j]=(double)-saveArray;
-           }
+          saveArray =(double)array[i][k];
+          array[i][k]=(double)array[i][j];
+          array[i][j]=(double)-saveArray;
          }
        }
-      while ((ik[k]<k) || (jk[k]<k));
+     }
+    while ((ik[k]<k) || (jk[k]<k));
 
-      // Gauss-Jordan elimination : accumulate elements of inverse matrix
+    // Gauss-Jordan elimination : accumulate elements of inverse matrix
 
-      for (i=0;i<nOrder;i++)
-       if (i!=k)
-        array[i][k]/=(double)(-amax);
+    for (i=0;i<nOrder;i++)
+     if (i!=k)
+      array[i][k]/=(double)(-amax);
 
-      for (i=0;i<nOrder;i++)
+    for (i=0;i<nOrder;i++)
+      {
+       if (i!=k)
         {
-         if (i!=k)
-          {
-           for (j=0;j<nOrder;j++)
-            if (j!=k)
-             array[i][j]+=(array[i][k]*array[k][j]);
-          }
+         for (j=0;j<nOrder;j++)
+          if (j!=k)
+           array[i][j]+=(array[i][k]*array[k][j]);
         }
+      }
 
-      for (j=0;j<nOrder;j++)
-       if (j!=k)
-        array[k][j]/=(double)amax;
+    for (j=0;j<nOrder;j++)
+     if (j!=k)
+      array[k][j]/=(double)amax;
 
-      array[k][k]=(double)1./amax;
-      *pDet*=(double)amax;
-     }
+    array[k][k]=(double)1./amax;
+    *pDet*=(double)amax;
+   }
 
-    // Restore the ordering of the matrix
+  // Restore the ordering of the matrix
 
-    for (l=0;l<nOrder;l++)
-     {
-      k=nOrder-l-1;
-      j=ik[k];
+  for (l=0;l<nOrder;l++)
+   {
+    k=nOrder-l-1;
+    j=ik[k];
 
-      if (j>k)
+    if (j>k)
+     {
+      for (i=0;i<nOrder;i++)
        {
-        for (i=0;i<nOrder;i++)
-         {
-          saveArray =(double)array[i][k];
-          array[i][k]=(double)-array[i][j];
-          array[i][j]=(double)saveArray;
-         }
+        saveArray =(double)array[i][k];
+        array[i][k]=(double)-array[i][j];
+        array[i][j]=(double)saveArray;
        }
+     }
 
-      i=jk[k];
+    i=jk[k];
 
-      if (i>k)
-       {
-        for (j=0;j<nOrder;j++)
-          {
-           saveArray =(double)array[k][j];
-           array[k][j]=(double)-array[i][j];
-           array[i][j]=(double)saveArray;
-          }
-       }
+    if (i>k)
+     {
+      for (j=0;j<nOrder;j++)
+        {
+         saveArray =(double)array[k][j];
+         array[k][j]=(double)-array[i][j];
+         array[i][j]=(double)saveArray;
+        }
      }
    }
 
-  // Release the allocated buffers
-
-  if (ik!=NULL)
-   MEMORY_ReleaseBuffer("CurfitMatinv","ik",ik);
-  if (jk!=NULL)
-   MEMORY_ReleaseBuffer("CurfitMatinv","jk",jk);
-
   // Return
 
   return rc;
@@ -337,7 +321,7 @@ RC CurfitMatinv(double **array,int nOrder,double *pDet)
 // RETURN        a pointer to the final error message
 // -----------------------------------------------------------------------------
 
-char *CurfitError(char *string,INDEX indexError,double *p,double *deltap)
+char *CurfitError(const ANALYSE_CONTEXT *pContext,char *string,INDEX indexError,double *p,double *deltap)
  {
  	// Declarations
 
@@ -352,9 +336,9 @@ char *CurfitError(char *string,INDEX indexError,double *p,double *deltap)
 
   // Browse parameters to fit
 
-  for (i=0;i<Feno->NTabCross;i++)
+  for (i=0;i<pContext->Feno->NTabCross;i++)
    {
-    pTabCross=&Feno->TabCross[i];
+    pTabCross=&pContext->Feno->TabCross[i];
 
     if (pTabCross->FitShift==indexError)
      strcpy(param,"Shift");
@@ -400,13 +384,14 @@ char *CurfitError(char *string,INDEX indexError,double *p,double *deltap)
 //               ERROR_ID_NO if successful
 // -----------------------------------------------------------------------------
 
-static RC CurfitNumDeriv(double *specX, double *srefX, const double *sigmaY, int nY, const double *Yfit,
+static RC CurfitNumDeriv(ANALYSE_CONTEXT *pContext,double *specX, double *srefX, const double *sigmaY, int nY, const double *Yfit,
                          double *P, double *A, double *deltaA,int indexA,double **deriv,INDEX indexFenoColumn, struct fit_properties *fitprops)
  {
   // Declarations
 
   int      i;                                                                   // browse pixels
   double  *Yfit2;                                                       // results of the fitting function evaluated for Aj+Dj
+  const int scratchUsed=pContext->scratchUsed;                                  // to release Yfit2
   RC       rc;                                                                  // return code
 
   #if defined(__DEBUG_) && __DEBUG_
@@ -419,8 +404,8 @@ static RC CurfitNumDeriv(double *specX, double *srefX, const double *sigmaY, int
 
   // Buffers allocation
 
-  if ((Yfit2=MEMORY_AllocDVector(__func__,"Yfit2",0,nY-1))==NULL) {
-    rc = ERROR_ID_ALLOC;
+  if ((Yfit2=ANALYSE_ScratchAlloc(pContext,nY))==NULL) {
+    rc = ERROR_SetLast(__func__,ERROR_TYPE_FATAL,ERROR_ID_ALLOC,"scratch");
   } else {
 
     memcpy(Yfit2,ANALYSE_zeros,sizeof(double)*nY);
@@ -434,7 +419,7 @@ static RC CurfitNumDeriv(double *specX, double *srefX, const double *sigmaY, int
 
     A[indexA]=Aj+Dj;
 
-    if ((rc=ANALYSE_Function(specX,srefX,sigmaY,Yfit2,nY,P,A,indexFenoColumn,fitprops))>=THREAD_EVENT_STOP)
+    if ((rc=ANALYSE_Function(pContext,specX,srefX,sigmaY,Yfit2,nY,P,A,indexFenoColumn,fitprops))>=THREAD_EVENT_STOP)
      goto EndNumDeriv;
 
      // Calculate the partial derivative of the function for the non linear parameter
@@ -452,8 +437,7 @@ static RC CurfitNumDeriv(double *specX, double *srefX, const double *sigmaY, int
 
   // Release allocated buffer
 
-  if (Yfit2!=NULL)
-   MEMORY_ReleaseDVector(__func__,"Yfit2",Yfit2,0);
+  pContext->scratchUsed=scratchUsed;
 
 #if defined(__DEBUG_) && __DEBUG_
   DEBUG_FunctionStop((char *)__func__,rc);
@@ -491,12 +475,34 @@ static RC CurfitNumDeriv(double *specX, double *srefX, const double *sigmaY, int
 //               ERROR_ID_NO if successful
 // -----------------------------------------------------------------------------
 
-static RC CurfitDerivFunc(double *specX, double *srefX, double *sigmaY,int nY, const double *Yfit,
+static RC CurfitDerivFunc(ANALYSE_CONTEXT *pContext,double *specX, double *srefX, double *sigmaY,int nY, const double *Yfit,
                    double *P, double *A, double *deltaA,double **deriv,INDEX indexFenoColumn,struct fit_properties *fitprops) {
 
-  CROSS_REFERENCE *TabCross=Feno->TabCross; // the list of cross sections involved in the fitting
+  FENO *pFeno=pContext->Feno;                // the analysis window being fitted
+  CROSS_REFERENCE *TabCross=pFeno->TabCross; // the list of cross sections involved in the fitting
+
+  // ====================
+  // Analytic derivatives
+  // ====================
+
+  //    shift and stretch of the spectrum and of the reference, offset (optical density fitting only, see ANALYSE_AnalyticDeriv);
+  //    calculated first because they rely on the linear system of the last evaluation of the fitting function in A,
+  //    which is modified by numeric derivatives
+
+  for (int i=0;i<pFeno->NTabCross;i++) {
+    const INDEX indexA[4]={TabCross[i].FitShift,TabCross[i].FitStretch,TabCross[i].FitStretch2,TabCross[i].FitParam};
+
+    for (int j=0;j<4;j++) {
+      int rc = ERROR_ID_NO;
+
+      if (ANALYSE_AnalyticDeriv(pContext,i,indexA[j]) &&
+         ((rc=ANALYSE_Deriv(pContext,specX,srefX,sigmaY,nY,A,i,indexA[j],deriv[indexA[j]],indexFenoColumn,fitprops))>=THREAD_EVENT_STOP))
+
+        return rc;
+     }
+   }
 
-  for (int i=0;i<Feno->NTabCross;i++) {
+  for (int i=0;i<pFeno->NTabCross;i++) {
     int rc = ERROR_ID_NO;
 
     // ===============================================
@@ -506,29 +512,30 @@ static RC CurfitDerivFunc(double *specX, double *srefX, double *sigmaY,int nY, c
     //    concentrations of the molecules in the case of SVD+Marquardt analysis method
     //    predefined parameters as offset, undersampling, raman, common residual are fitted linearly
 
-    if (((Feno->analysisMethod==INTENSITY_FIT) &&
-         (TabCross[i].FitConc!=ITEM_NONE) && ((rc=CurfitNumDeriv(specX,srefX,sigmaY,nY, Yfit, P,A,deltaA,TabCross[i].FitConc,deriv,indexFenoColumn,fitprops))>=THREAD_EVENT_STOP)) ||
+    if (((pFeno->analysisMethod==INTENSITY_FIT) &&
+         (TabCross[i].FitConc!=ITEM_NONE) && ((rc=CurfitNumDeriv(pContext,specX,srefX,sigmaY,nY, Yfit, P,A,deltaA,TabCross[i].FitConc,deriv,indexFenoColumn,fitprops))>=THREAD_EVENT_STOP)) ||
 
     // SVD : concentrations of molecules fitted linearly
     //       second derivatives of non linear parameters (predefined parameters, shift, stretch)
     //         calculated numerically
 
         ((TabCross[i].FitParam!=ITEM_NONE) &&
-       (((i!=Feno->indexOffsetConst) &&
-         (i!=Feno->indexOffsetOrder1) &&
-         (i!=Feno->indexOffsetOrder2) &&
-         (i!=Feno->indexCommonResidual) &&
-         (i!=Feno->indexUsamp1) &&
-         (i!=Feno->indexUsamp2) &&
-         (i!=Feno->indexResol)) ||
-         (Feno->analysisMethod==OPTICAL_DENSITY_FIT)) &&
-         ((rc=CurfitNumDeriv(specX,srefX,sigmaY,nY, Yfit, P,A,deltaA,TabCross[i].FitParam,deriv,indexFenoColumn,fitprops))>=THREAD_EVENT_STOP)) ||
-
-    //    derivatives of the fitting function in shift, stretch and scaling are always numeric undependantly on the method of analysis
-
-        ((TabCross[i].FitShift!=ITEM_NONE) && ((rc=CurfitNumDeriv(specX,srefX,sigmaY,nY, Yfit, P,A,deltaA,TabCross[i].FitShift,deriv,indexFenoColumn,fitprops))>=THREAD_EVENT_STOP)) ||
-        ((TabCross[i].FitStretch!=ITEM_NONE) && ((rc=CurfitNumDeriv(specX,srefX,sigmaY,nY,Yfit, P,A,deltaA,TabCross[i].FitStretch,deriv,indexFenoColumn,fitprops))>=THREAD_EVENT_STOP)) ||
-        ((TabCross[i].FitStretch2!=ITEM_NONE) && ((rc=CurfitNumDeriv(specX,srefX,sigmaY,nY, Yfit, P,A,deltaA,TabCross[i].FitStretch2,deriv,indexFenoColumn,fitprops))>=THREAD_EVENT_STOP)))
+       (((i!=pFeno->indexOffsetConst) &&
+         (i!=pFeno->indexOffsetOrder1) &&
+         (i!=pFeno->indexOffsetOrder2) &&
+         (i!=pFeno->indexCommonResidual) &&
+         (i!=pFeno->indexUsamp1) &&
+         (i!=pFeno->indexUsamp2) &&
+         (i!=pFeno->indexResol)) ||
+         (pFeno->analysisMethod==OPTICAL_DENSITY_FIT)) &&
+         !ANALYSE_AnalyticDeriv(pContext,i,TabCross[i].FitParam) &&
+         ((rc=CurfitNumDeriv(pContext,specX,srefX,sigmaY,nY, Yfit, P,A,deltaA,TabCross[i].FitParam,deriv,indexFenoColumn,fitprops))>=THREAD_EVENT_STOP)) ||
+
+    //    derivatives of the fitting function in shift, stretch and scaling are numeric when they can't be calculated analytically
+
+        ((TabCross[i].FitShift!=ITEM_NONE) && !ANALYSE_AnalyticDeriv(pContext,i,TabCross[i].FitShift) && ((rc=CurfitNumDeriv(pContext,specX,srefX,sigmaY,nY, Yfit, P,A,deltaA,TabCross[i].FitShift,deriv,indexFenoColumn,fitprops))>=THREAD_EVENT_STOP)) ||
+        ((TabCross[i].FitStretch!=ITEM_NONE) && !ANALYSE_AnalyticDeriv(pContext,i,TabCross[i].FitStretch) && ((rc=CurfitNumDeriv(pContext,specX,srefX,sigmaY,nY,Yfit, P,A,deltaA,TabCross[i].FitStretch,deriv,indexFenoColumn,fitprops))>=THREAD_EVENT_STOP)) ||
+        ((TabCross[i].FitStretch2!=ITEM_NONE) && !ANALYSE_AnalyticDeriv(pContext,i,TabCross[i].FitStretch2) && ((rc=CurfitNumDeriv(pContext,specX,srefX,sigmaY,nY, Yfit, P,A,deltaA,TabCross[i].FitStretch2,deriv,indexFenoColumn,fitprops))>=THREAD_EVENT_STOP)))
 
       return rc;
    }
@@ -576,14 +583,15 @@ static RC CurfitDerivFunc(double *specX, double *srefX, double *sigmaY,int nY, c
 //               pNiter  - number of iterations
 //
 // RETURN        0 if the algorithm successfully converged
-//               ERROR_ID_ALLOC if the allocation of a vector failed
+//               ERROR_ID_ALLOC if the buffers of the context are too small
 //               THREAD_EVENT_STOP on user intervention
 //               ERROR_ID_SQRT_ARG on sqrt argument error
 //               ERROR_ID_MATINV if the inversion of the matrix of non linear parameters failed
 //               ERROR_ID_CONVERGENCE if the algorithm can not converge
 // -----------------------------------------------------------------------------
 
-RC Curfit(int     mode,                                                         // I   method of weighting least-squares fit
+RC Curfit(ANALYSE_CONTEXT *pContext,                                          // I/O working buffers and state of the fit
+          int     mode,                                                         // I   method of weighting least-squares fit
           int niter,                                                            // current number of iterations
           int     nFree,                                                        // I   the number of degrees of freedom
           double *specX,                                                        // I   the spectrum to evaluate
@@ -630,25 +638,25 @@ RC Curfit(int     mode,
 
   // Initializations
 
-  mode2use=(sigmaY==NULL)?PRJCT_ANLYS_FIT_WEIGHTING_NONE:mode;
+  const double timingStart=TIMING_Start();
 
-  B=beta=NULL;
-  alpha=array=deriv=NULL;
+  mode2use=(sigmaY==NULL)?PRJCT_ANLYS_FIT_WEIGHTING_NONE:mode;
   chisqr=(double)0.;
 
-  // Allocate needed vectors and matrices
+  // Vectors and matrices belong to the analysis context and are sized from the number of non linear parameters
 
-  if (((weight=(double *)MEMORY_AllocDVector(__func__,"weight",0,nY-1))==NULL) ||
-      ((B=(double *)MEMORY_AllocDVector(__func__,"B",0,nA-1))==NULL) ||
-      ((beta=(double *)MEMORY_AllocDVector(__func__,"beta",0,nA-1))==NULL) ||
-      ((alpha=(double **)MEMORY_AllocDMatrix(__func__,"alpha",0,nA-1,0,nA-1))==NULL) ||
-      ((array=(double **)MEMORY_AllocDMatrix(__func__,"array",0,nA-1,0,nA-1))==NULL) ||
-      ((deriv=(double **)MEMORY_AllocDMatrix(__func__,"deriv",0,nY-1,0,nA-1))==NULL))
-
-   rc=ERROR_ID_ALLOC;
+  if ((nY>pContext->ndet) || (ANALYSE_CurfitAlloc(pContext,nA)!=ERROR_ID_NO))
+   rc=ERROR_SetLast(__func__,ERROR_TYPE_FATAL,ERROR_ID_ALLOC,"curfit");
 
   else
    {
+    weight=pContext->curfitWeight;
+    B=pContext->curfitB;
+    beta=pContext->curfitBeta;
+    alpha=pContext->curfitAlpha;
+    array=pContext->curfitArray;
+    deriv=pContext->curfitDeriv;
+
     for (j=0;j<nA;j++)
      B[j]=(double)A[j];
 
@@ -683,11 +691,11 @@ RC Curfit(int     mode,
      }
 
     if (niter == 0) // Only for the first iteration: initial evaluation of fit function.
-      rc=ANALYSE_Function(specX,srefX,sigmaY,Yfit,nY,P,A,indexFenoColumn,fitprops);
+      rc=ANALYSE_Function(pContext,specX,srefX,sigmaY,Yfit,nY,P,A,indexFenoColumn,fitprops);
     if (rc >= THREAD_EVENT_STOP)
       goto EndCurfit;
 
-    rc=CurfitDerivFunc(specX,srefX,sigmaY,nY, Yfit, P,A,deltaA,deriv,indexFenoColumn,fitprops);
+    rc=CurfitDerivFunc(pContext,specX,srefX,sigmaY,nY, Yfit, P,A,deltaA,deriv,indexFenoColumn,fitprops);
     if (rc>=THREAD_EVENT_STOP )
       goto EndCurfit;
 
@@ -722,7 +730,7 @@ RC Curfit(int     mode,
          {
           if (alpha[j][j]*alpha[k][k]<=0.)
            {
-            rc=ERROR_SetLast("Curfit1",ERROR_TYPE_WARNING,ERROR_ID_SQRT_ARG,CurfitError(string,(alpha[j][j]<=0.)?j:k,A,deltaA));
+            rc=ERROR_SetLast("Curfit1",ERROR_TYPE_WARNING,ERROR_ID_SQRT_ARG,CurfitError(pContext,string,(alpha[j][j]<=0.)?j:k,A,deltaA));
             goto EndCurfit;
            }
 
@@ -732,7 +740,7 @@ RC Curfit(int     mode,
         array[j][j]=(double)1.+*pLambda;
        }
 
-      if (((rc=CurfitMatinv(array,nA,&det))>=THREAD_EVENT_STOP) || (det==(double)0.))
+      if (((rc=CurfitMatinv(array,nA,pContext->curfitIk,pContext->curfitJk,&det))>=THREAD_EVENT_STOP) || (det==(double)0.))
        {
        	rc=ERROR_SetLast(__func__,ERROR_TYPE_WARNING,ERROR_ID_MATINV);
         goto EndCurfit;
@@ -745,7 +753,7 @@ RC Curfit(int     mode,
          {
           if (alpha[j][j]*alpha[k][k]<=0.)
            {
-            rc=ERROR_SetLast("Curfit2",ERROR_TYPE_WARNING,ERROR_ID_SQRT_ARG,CurfitError(string,(alpha[j][j]<=0.)?j:k,A,deltaA));
+            rc=ERROR_SetLast("Curfit2",ERROR_TYPE_WARNING,ERROR_ID_SQRT_ARG,CurfitError(pContext,string,(alpha[j][j]<=0.)?j:k,A,deltaA));
             goto EndCurfit;
            }
 
@@ -755,7 +763,7 @@ RC Curfit(int     mode,
 
       // If the Chi square increased,increase pLambda and try again
 
-      if ((rc=ANALYSE_Function(specX,srefX,sigmaY,Yfit,nY,P,B,indexFenoColumn,fitprops))>=THREAD_EVENT_STOP) goto EndCurfit;
+      if ((rc=ANALYSE_Function(pContext,specX,srefX,sigmaY,Yfit,nY,P,B,indexFenoColumn,fitprops))>=THREAD_EVENT_STOP) goto EndCurfit;
 
       chisqr=(double)Fchisq(mode,nFree,Y,Yfit,sigmaY,nY);
       if (chisq1<chisqr)
@@ -792,7 +800,7 @@ RC Curfit(int     mode,
 
     if (outOfRange)
      {
-       if ((rc=ANALYSE_Function(specX,srefX,sigmaY,Yfit,nY,P,B,indexFenoColumn,fitprops))>=THREAD_EVENT_STOP)
+       if ((rc=ANALYSE_Function(pContext,specX,srefX,sigmaY,Yfit,nY,P,B,indexFenoColumn,fitprops))>=THREAD_EVENT_STOP)
        goto EndCurfit;
       chisqr=(double)Fchisq(mode,nFree,Y,Yfit,sigmaY,nY);
      }
@@ -805,7 +813,7 @@ RC Curfit(int     mode,
 
       if (array[j][j]/alpha[j][j]*chisqr<=0.)
        {
-       	rc=ERROR_SetLast("Curfit3",ERROR_TYPE_WARNING,ERROR_ID_SQRT_ARG,CurfitError(string,j,A,deltaA));
+       	rc=ERROR_SetLast("Curfit3",ERROR_TYPE_WARNING,ERROR_ID_SQRT_ARG,CurfitError(pContext,string,j,A,deltaA));
         goto EndCurfit;
        }
 
@@ -817,21 +825,13 @@ RC Curfit(int     mode,
 
   EndCurfit :
 
-  // Release the allocated vectors and matrices
-
-  MEMORY_ReleaseDVector(__func__,"weight",weight,0);
-  MEMORY_ReleaseDVector(__func__,"B",B,0);
-  MEMORY_ReleaseDVector(__func__,"beta",beta,0);
-
-  MEMORY_ReleaseDMatrix(__func__,"deriv",deriv,0,0);
-  MEMORY_ReleaseDMatrix(__func__,"alpha",alpha,0,0);
-  MEMORY_ReleaseDMatrix(__func__,"array",array,0,0);
-
   // Return
 
   if (pChisqr!=NULL)
    *pChisqr=chisqr;
 
+  TIMING_Stop(TIMING_STAGE_CURFIT,timingStart);
+
   #if defined(__DEBUG_) && __DEBUG_
   DEBUG_FunctionStop(__func__,rc);
   #endif
@@ -2,10 +2,12 @@
 #define CURFIT_H
 
 #include "comdefs.h"
+#include "analyse.h"
 
 double Fchisq(int mode,int nFree,double *Y,double *Yfit,double *sigmay,int nY);
 
-RC Curfit(int     mode,                                                         // I   method of weighting least-squares fit
+RC Curfit(ANALYSE_CONTEXT *pContext,                                          // I/O working buffers and state of the fit
+          int     mode,                                                         // I   method of weighting least-squares fit
           int niter,                                                            // current number of iterations
           int     nFree,                                                        // I   the number of degrees of freedom
           double *specX,                                                        // I   the spectrum to evaluate
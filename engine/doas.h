@@ -80,6 +80,7 @@ typedef struct _prjctExport PRJCT_EXPORT;
 typedef struct _matrix MATRIX_OBJECT;
 
 typedef struct _FFT FFT;
+typedef struct _slitBank SLIT_BANK;
 
 typedef struct _feno FENO;
 typedef struct _KuruczFeno KURUCZ_FENO;
@@ -96,7 +97,7 @@ typedef struct _engineContext ENGINE_CONTEXT;
 // ----------------
 extern int NWorkSpace;
 extern int NDET[MAX_SWATHSIZE];
-extern int NFeno,SvdPDeb,SvdPFin;
+extern int NFeno;
 extern WRK_SYMBOL   *WorkSpace;
 
 extern PRJCT_ANLYS  *pAnalysisOptions;             // analysis options
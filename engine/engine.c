@@ -82,6 +82,7 @@
 #include "kurucz.h"
 #include "mediate.h"
 #include "stdfunc.h"
+#include "timing.h"
 #include "zenithal.h"
 #include "output.h"
 #include "frm4doas_read.h"
@@ -108,25 +109,25 @@ char ENGINE_dbgFile[DOAS_MAX_PATH_LEN+1];
 double ENGINE_localNoon;
 
 // -----------------------------------------------------------------------------
-// FUNCTION      EngineResetContext
+// FUNCTION      EngineReleaseContext
 // -----------------------------------------------------------------------------
-// PURPOSE       Destroy the context of the current engine
+// PURPOSE       Release the buffers of an engine context
 //
 // INPUT         pEngineContext     pointer to the engine context
-//               closeFiles         1 to close files, 0 otherwise (in order not to close files twice)
+//
+// NB            unlike EngineResetContext, this function doesn't reset the
+//               modules shared by all contexts (ASCII files); it can be used
+//               to destroy the copies of the engine context used by the
+//               analysis threads.
 // -----------------------------------------------------------------------------
 
-void EngineResetContext(ENGINE_CONTEXT *pEngineContext)
+void EngineReleaseContext(ENGINE_CONTEXT *pEngineContext)
  {
    // Declarations
 
    BUFFERS *pBuffers;                                                            // pointer to the buffers part of the engine context
    RECORD_INFO *pRecord;                                                         // pointer to the record part of the engine context
 
-#if defined(__DEBUG_) && __DEBUG_
-   DEBUG_FunctionBegin("EngineResetContext",DEBUG_FCTTYPE_FILE);
-#endif
-
    // Initializations
 
    pRecord=&pEngineContext->recordInfo;
@@ -181,12 +182,30 @@ void EngineResetContext(ENGINE_CONTEXT *pEngineContext)
 
    MFC_ResetFiles(pEngineContext);
    CCD_ResetInstrumental(&pRecord->ccd);
-   ASCII_Free("EngineResetContext");
-   ASCII_QDOAS_Reset();
 
    // Reset structure
 
    memset(pEngineContext,0,sizeof(ENGINE_CONTEXT));
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      EngineResetContext
+// -----------------------------------------------------------------------------
+// PURPOSE       Destroy the context of the current engine
+//
+// INPUT         pEngineContext     pointer to the engine context
+// -----------------------------------------------------------------------------
+
+void EngineResetContext(ENGINE_CONTEXT *pEngineContext)
+ {
+#if defined(__DEBUG_) && __DEBUG_
+   DEBUG_FunctionBegin("EngineResetContext",DEBUG_FCTTYPE_FILE);
+#endif
+
+   EngineReleaseContext(pEngineContext);
+
+   ASCII_Free("EngineResetContext");
+   ASCII_QDOAS_Reset();
 
 #if defined(__DEBUG_) && __DEBUG_
    DEBUG_FunctionStop("EngineResetContext",0);
@@ -832,7 +851,7 @@ RC EngineSetFile(ENGINE_CONTEXT *pEngineContext,const char *fileName,void *respo
 //                                  reference spectrum to search for
 // -----------------------------------------------------------------------------
 
-RC EngineReadFile(ENGINE_CONTEXT *pEngineContext,int indexRecord,int dateFlag,int localCalDay)
+static RC EngineReadRecord(ENGINE_CONTEXT *pEngineContext,int indexRecord,int dateFlag,int localCalDay)
  {
    // Declarations
 
@@ -1060,6 +1079,16 @@ RC EngineReadFile(ENGINE_CONTEXT *pEngineContext,int indexRecord,int dateFlag,in
    return pRecord->rc;
  }
 
+RC EngineReadFile(ENGINE_CONTEXT *pEngineContext,int indexRecord,int dateFlag,int localCalDay)
+ {
+   const double timingStart=TIMING_Start();
+   const RC rc=EngineReadRecord(pEngineContext,indexRecord,dateFlag,localCalDay);
+
+   TIMING_Stop(TIMING_STAGE_READ,timingStart);
+
+   return rc;
+ }
+
 // -----------------------------------------------------------------------------
 // FUNCTION      EngineRequestBeginBrowseSpectra
 // -----------------------------------------------------------------------------
@@ -1185,6 +1214,12 @@ RC EngineRequestEndBrowseSpectra(ENGINE_CONTEXT *pEngineContext)
    pRef=&pEngineContext->analysisRef;
    rc=ERROR_ID_NO;
 
+   // The TROPOMI reader may still be reading radiances in the background; the netCDF library
+   // can't be used by two threads at once
+
+   if (pEngineContext->project.instrumental.readOutFormat==PRJCT_INSTR_FORMAT_TROPOMI)
+    tropomi_wait_prefetch();
+
    if ((THRD_id!=THREAD_TYPE_NONE) && (THRD_id!=THREAD_TYPE_SPECTRA))
     {
      rc=OUTPUT_FlushBuffers(pEngineContext);   // For export option (without lambda and spectra), format is similar as ASCII results
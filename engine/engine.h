@@ -22,6 +22,7 @@ extern double         ENGINE_localNoon;
 // ==========
 
 RC              EngineCopyContext(ENGINE_CONTEXT *pEngineContextTarget,ENGINE_CONTEXT *pEngineContextSource);
+void            EngineReleaseContext(ENGINE_CONTEXT *pEngineContext);
 RC              EngineSetProject(ENGINE_CONTEXT *pEngineContext);
 RC              EngineReadFile(ENGINE_CONTEXT *pEngineContext,int indexRecord,int dateFlag,int localCalDay);
 RC              EngineRequestBeginBrowseSpectra(ENGINE_CONTEXT *pEngineContext,const char *spectraFileName,void *responseHandle);
@@ -222,6 +222,8 @@ struct _prjctAsciiResults {
   int fieldsFlag[PRJCT_RESULTS_MAX];                                            // fields used in output
   enum output_format file_format;
   char swath_name[HDFEOS_OBJ_LEN_MAX];
+  enum output_chunking chunking;                                                // chunk layout (netCDF and HDF-EOS5)
+  int compressionLevel,shuffleFlag;                                             // deflate level (0 for no compression) and shuffle filter (netCDF and HDF-EOS5)
 };
 
 // Export spectra
@@ -41,6 +41,7 @@
 //
 //  ERROR_SetLast - save the information on the last error in a stack;
 //  ERROR_GetLast - retrieve the information about the last error in order to process it;
+//  ERROR_Push - put back in the stack an error retrieved by ERROR_GetLast;
 //
 //  ----------------------------------------------------------------------------
 //
@@ -165,6 +166,7 @@ ERROR_TABLE errorTable[]=
 
   { ERROR_ID_SVD_ILLCONDITIONED       , "ill-conditioned matrix"                                                                                            },
   { ERROR_ID_SVD_ARG                   , "the number of lines of the matrix to decompose is expected to be higher than the number of columns (%d x %d)"       },
+  { ERROR_ID_QR_SINGULAR               , "singular matrix in the QR decomposition (column %d)"                                                                },
   { ERROR_ID_SPLINE                    , "spline interpolation requests increasing absissae (indexes : %d - %d, values : %g - %g)"                            },
   { ERROR_ID_VOIGT                     , "Voigt function failed (x=%g,y=%g)"                                                                                  },
   { ERROR_ID_ERF                       , "error with the calculation of the erf function (%s)"                                                                },
@@ -222,8 +224,11 @@ ERROR_TABLE errorTable[]=
 
 // Definition of a structure for holding the last error
 
-static ERROR_DESCRIPTION errorStack[ERROR_MAX_ERRORS+1];                        // the error stack
-static int errorStackN=0;                                                       // the number of errors in the stack
+// Each thread has its own stack so that errors raised while analysing several
+// records in parallel are reported with the record they belong to.
+
+static __thread ERROR_DESCRIPTION errorStack[ERROR_MAX_ERRORS+1];               // the error stack
+static __thread int errorStackN=0;                                              // the number of errors in the stack
 
 RC ERROR_DisplayMessage(void *responseHandle)
  {
@@ -358,6 +363,36 @@ RC ERROR_GetLast(ERROR_DESCRIPTION *pError)
   return (pError!=NULL)?pError->errorId:0;
  }
 
+// -----------------------------------------------------------------------------
+// FUNCTION      ERROR_Push
+// -----------------------------------------------------------------------------
+// PURPOSE       Put back in the stack an error retrieved by ERROR_GetLast, for
+//               example to pass the errors of a worker thread to the thread that
+//               reports them;
+//
+// INPUT         pError : the description of the error
+//
+// RETURN        the error id
+// -----------------------------------------------------------------------------
+
+RC ERROR_Push(const ERROR_DESCRIPTION *pError)
+ {
+  INDEX i;
+
+  if ((pError!=NULL) && (pError->errorId!=ERROR_ID_NO))
+   {
+    for (i=0;i<errorStackN;i++)
+     if (errorStack[i].errorId==pError->errorId
+         && errorStack[i].errorType == pError->errorType)
+      break;
+
+    if ((i==errorStackN) && (errorStackN<=ERROR_MAX_ERRORS))
+     memcpy(&errorStack[errorStackN++],pError,sizeof(ERROR_DESCRIPTION));
+   }
+
+  return (pError!=NULL)?pError->errorId:0;
+ }
+
 // check if the error stack contains a fatal error
 bool ERROR_Fatal(void) {
   for(int i=0; i<errorStackN; ++i) {
@@ -60,6 +60,7 @@
 //  FilterSavitskyGolay - build a Savitsky-Golay filter function
 //  FilterPascalTriangle - build a Pascal binomial filter function
 //  FILTER_Build - build a filter function
+//  FilterWorkBuffer - work buffer of FILTER_Vector for the current thread
 //  FilterConv - apply a filter function on a vector by convolution on pixels
 //  FILTER_Vector - apply a filter function on a vector
 //
@@ -69,8 +70,10 @@
 // INCLUDE HEADERS
 // ===============
 
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
 
 #include "filter.h"
 #include "engine_context.h"
@@ -709,6 +712,49 @@ RC FILTER_Build(PRJCT_FILTER *pFilter,double fa1,double fa2,double fa3)
   return rc;
  }
 
+// -----------------------------------------------------------------------------
+// FUNCTION      FilterWorkBuffer
+// -----------------------------------------------------------------------------
+// PURPOSE       Get the work buffer of FILTER_Vector for the current thread
+//
+// INPUT         size             the number of doubles needed
+//
+// RETURN        the buffer, NULL if the allocation failed
+// -----------------------------------------------------------------------------
+
+// The filters are shared by the analysis threads, so each thread has its own
+// work buffer; it grows with the size of the vectors to filter and is released
+// when the thread ends.
+
+static __thread double *filterWork=NULL;                                        // work buffer of the current thread
+static __thread int filterWorkSize=0;                                           // its size
+static pthread_key_t filterWorkKey;                                             // to release the buffer when a thread ends
+static pthread_once_t filterWorkKeyOnce=PTHREAD_ONCE_INIT;
+
+static void FilterWorkKeyCreate(void)
+ {
+  pthread_key_create(&filterWorkKey,free);
+ }
+
+static double *FilterWorkBuffer(int size)
+ {
+  double *buffer;
+
+  if (size>filterWorkSize)
+   {
+    if ((buffer=(double *)realloc(filterWork,sizeof(double)*size))==NULL)
+     return NULL;
+
+    pthread_once(&filterWorkKeyOnce,FilterWorkKeyCreate);
+    pthread_setspecific(filterWorkKey,buffer);
+
+    filterWork=buffer;
+    filterWorkSize=size;
+   }
+
+  return filterWork;
+ }
+
 // -----------------------------------------------------------------------------
 // FUNCTION      FilterConv
 // -----------------------------------------------------------------------------
@@ -718,59 +764,80 @@ RC FILTER_Build(PRJCT_FILTER *pFilter,double fa1,double fa2,double fa3)
 //               Input            vector to filter
 //               Size             the size of input vector
 //
-// OUTPUT        output           the filtered vector
+// OUTPUT        output           the filtered vector (should not overlap Input)
 //
-// RETURN        ERROR_ID_ALLOC if buffer allocation failed,
-//               0 on success
+// The filter function is symmetric : filterFunction[1] is the weight of the
+// pixel itself and filterFunction[d+1] the weight of its neighbours at d pixels.
+// Near the edges, a missing neighbour is replaced by the one on the other side
+// of the pixel.  Far enough from the edges, the same terms are summed in the
+// same order without the tests on the indexes, one filter coefficient at a
+// time over all the pixels so that the compiler vectorizes the loops; the
+// results are identical to the ones of the edges code applied everywhere.
 // -----------------------------------------------------------------------------
 
-RC FilterConv(PRJCT_FILTER *pFilter,double *Input,double *Output,int Size)
+static double FilterConvPixel(const double *filterFunction,int filterSize,const double *Input,int Size,int i)
  {
-  // Declarations
+  double sum;
+  int j,k;
 
-  int     i,j,k;
-  double *ftemp;
-  RC      rc;
+  j=-(filterSize-1);
+  sum=(i-j<Size)?Input[(i-j)]*filterFunction[-j+1]:(double)0.;
 
-  // Initialization
+  for (j=j+1;j<filterSize;j++)
+   {
+    k=((i-j<Size)&&(i-j>=0))?i-j:i+j;
 
-  rc=ERROR_ID_NO;
+    if ((k<Size) && (k>=0))
+     sum+=Input[k]*filterFunction[(j<=0)?-j+1:j+1];
+   }
 
-  // Temporary buffer allocation
+  return sum;
+ }
 
-  if ((ftemp=(double *)MEMORY_AllocDVector("FILTER_Conv ","ftemp",0,Size-1))==NULL)
-   rc=ERROR_ID_ALLOC;
-  else
-   {
-    // Initialize the temporary buffer
+static void FilterConv(const PRJCT_FILTER *pFilter,const double *restrict Input,double *restrict Output,int Size)
+ {
+  // Declarations
 
-    VECTOR_Init(ftemp,(double)0.,Size);
+  const double *filterFunction;
+  int filterSize,iMin,iMax,i,j;
 
-    // Filtering by convolution
+  // Initializations
 
-    for ( i=0; i<Size; i++ )
-      {
-        j=-(pFilter->filterSize-1);
-        ftemp[i]=(i-j<Size)?Input[(i-j)]*pFilter->filterFunction[-j+1]:(double)0.;
-        for (j=j+1;j<pFilter->filterSize;j++)
-         {
-          k=((i-j<Size)&&(i-j>=0))?i-j:i+j;
+  filterFunction=pFilter->filterFunction;
+  filterSize=pFilter->filterSize;
 
-          if ((k<Size) && (k>=0))
-           ftemp[i]+=Input[k]*pFilter->filterFunction[(j<=0)?-j+1:j+1];
-         }
-      }
+  iMin=filterSize-1;                                                            // first pixel with all its neighbours
+  iMax=Size-filterSize;                                                         // last pixel with all its neighbours
 
-    memcpy(Output,ftemp,Size*sizeof(double));
+  if (iMin>iMax)
+   iMin=Size;
 
-    // Release allocated buffer
+  // Edges
 
-    MEMORY_ReleaseDVector("FILTER_Conv ","ftemp",ftemp,0);
-   }
+  for (i=0;(i<iMin) && (i<Size);i++)
+   Output[i]=FilterConvPixel(filterFunction,filterSize,Input,Size,i);
+  for (i=max(iMax+1,iMin);i<Size;i++)
+   Output[i]=FilterConvPixel(filterFunction,filterSize,Input,Size,i);
 
-  // return
+  // Inner pixels
 
-  return rc;
+  if (iMin<=iMax)
+   {
+    const double coef=filterFunction[filterSize];
+    const double *restrict source=Input+filterSize-1;
+
+    for (i=iMin;i<=iMax;i++)
+     Output[i]=source[i]*coef;
+
+    for (j=-(filterSize-2);j<filterSize;j++)
+     {
+      const double coef=filterFunction[(j<=0)?-j+1:j+1];
+      const double *restrict source=Input-j;
+
+      for (i=iMin;i<=iMax;i++)
+       Output[i]+=source[i]*coef;
+     }
+   }
  }
 
 // -----------------------------------------------------------------------------
@@ -795,13 +862,12 @@ RC FILTER_Vector(PRJCT_FILTER *pFilter,double *Input,double *Output,double *tmpV
  {
   // Declarations
 
-  double *tempVector;
+  double *workBuffer,*tempVector,*convVector,*swapVector;
   INDEX i,j;
   RC rc;
 
   // Initializations
 
-  tempVector=NULL;
   rc=ERROR_ID_NO;
 
   if (Size>0)
@@ -810,36 +876,40 @@ RC FILTER_Vector(PRJCT_FILTER *pFilter,double *Input,double *Output,double *tmpV
      for (i=0;i<Size;i++)
       tmpVector[i]=(double)0.;
 
-    if ((tempVector=(double *)MEMORY_AllocDVector("FILTER_vector ","tempVector",0,Size-1))==NULL)
-     rc=ERROR_ID_ALLOC;
+    if ((workBuffer=FilterWorkBuffer(2*Size))==NULL)
+     rc=ERROR_SetLast(__func__,ERROR_TYPE_FATAL,ERROR_ID_ALLOC,"filterWork");
     else
      {
+      // The filter is applied alternately from one half of the work buffer to the other
+
+      tempVector=workBuffer;
+      convVector=workBuffer+Size;
+
       memcpy(tempVector,Input,sizeof(double)*Size);
-      for (i=0;(i<pFilter->filterNTimes) && !rc;i++)
-       rc=FilterConv(pFilter,tempVector,tempVector,Size);
 
-      if (i==pFilter->filterNTimes)
+      for (i=0;i<pFilter->filterNTimes;i++)
        {
-        if (tmpVector!=NULL)
-         memcpy(tmpVector,tempVector,sizeof(double)*Size);
-
-        if (outputType==PRJCT_FILTER_OUTPUT_LOW)
-         memcpy(Output,tempVector,sizeof(double)*Size);
-        else if (outputType==PRJCT_FILTER_OUTPUT_HIGH_SUB)
-         for (j=0;j<Size;j++)
-          Output[j]=Input[j]-tempVector[j];
-        else if (outputType==PRJCT_FILTER_OUTPUT_HIGH_DIV)
-         for (j=0;j<Size;j++)
-          Output[j]=(tempVector[j]!=(double)0.)?Input[j]/tempVector[j]:(double)0.;
+        FilterConv(pFilter,tempVector,convVector,Size);
+
+        swapVector=tempVector;
+        tempVector=convVector;
+        convVector=swapVector;
        }
+
+      if (tmpVector!=NULL)
+       memcpy(tmpVector,tempVector,sizeof(double)*Size);
+
+      if (outputType==PRJCT_FILTER_OUTPUT_LOW)
+       memcpy(Output,tempVector,sizeof(double)*Size);
+      else if (outputType==PRJCT_FILTER_OUTPUT_HIGH_SUB)
+       for (j=0;j<Size;j++)
+        Output[j]=Input[j]-tempVector[j];
+      else if (outputType==PRJCT_FILTER_OUTPUT_HIGH_DIV)
+       for (j=0;j<Size;j++)
+        Output[j]=(tempVector[j]!=(double)0.)?Input[j]/tempVector[j]:(double)0.;
      }
    }
 
-  // Release allocated vector
-
-  if (tempVector!=NULL)
-   MEMORY_ReleaseDVector("FILTER_vector ","tempVector",tempVector,0);
-
   // Return
 
   return rc;
@@ -1067,7 +1067,7 @@ static RC GdpBinNewRef(const ENGINE_CONTEXT *pEngineContext,void *responseHandle
 
         // align ref w.r.t irradiance reference:
         double sigma_shift, sigma_stretch, sigma_stretch2; // not used here...
-        rc = ANALYSE_fit_shift_stretch(1, 0, pTabFeno->SrefEtalon, ref->spectrum,
+        rc = ANALYSE_fit_shift_stretch(&ANALYSE_context,1, 0, pTabFeno->SrefEtalon, ref->spectrum,
                                        &ref->shift, &ref->stretch, &ref->stretch2, \
                                        &sigma_shift, &sigma_stretch, &sigma_stretch2);
       }
@@ -0,0 +1,248 @@
+
+//  ----------------------------------------------------------------------------
+//
+//  Product/Project   :  QDOAS
+//  Module purpose    :  GEOLOCATION INDEX OF ORBIT FILES FOR THE AUTOMATIC REFERENCE
+//  Name of module    :  GEOINDEX.C
+//  Compiler          :  MinGW (GNU compiler)
+//
+//  QDOAS is a cross-platform application developed in QT for DOAS retrieval
+//  (Differential Optical Absorption Spectroscopy).
+//
+//  The QT version of the program has been developed jointly by the Belgian
+//  Institute for Space Aeronomy (BIRA-IASB) and the Science and Technology
+//  company (S[&]T) - Copyright (C) 2007
+//
+//      BIRA-IASB                                   S[&]T
+//      Belgian Institute for Space Aeronomy        Science [&] Technology
+//      Avenue Circulaire, 3                        Postbus 608
+//      1180     UCCLE                              2600 AP Delft
+//      BELGIUM                                     THE NETHERLANDS
+//      caroline.fayt@aeronomie.be                  info@stcorp.nl
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 2
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software Foundation,
+//  Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+//  ----------------------------------------------------------------------------
+//  FUNCTIONS
+//
+//  GEOINDEX_Alloc - allocate the records of an index;
+//  GEOINDEX_Free - release the records of an index;
+//
+//  GEOINDEX_Load - load the index of an orbit file from the cache directory;
+//  GEOINDEX_Save - save the index of an orbit file in the cache directory.
+//
+//  ----------------------------------------------------------------------------
+//
+//  Indexes are kept in the cache directory of the convolved cross sections
+//  (option -cache of doas_cl).  The name of an index file is the hash of the
+//  tag given by the reader (instrument, spectral band,...), of the full name of
+//  the orbit file and of its size and modification time, so that an orbit file
+//  which is replaced gets a new index.  An index file contains :
+//
+//      - a header (magic string, version, key, description of the orbit file,
+//        number of records);
+//      - the records (in the native byte order).
+//
+//  As for the cross sections, files are written by XSCACHE_WriteEntry under a
+//  temporary name and then renamed.  A missing or inconsistent index is simply rebuilt by the
+//  reader from the orbit file.
+//  ----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "geoindex.h"
+#include "xscache.h"
+
+// =====================
+// CONSTANTS DEFINITIONS
+// =====================
+
+#define GEOINDEX_MAGIC    "QDGEOIDX"                                            // first bytes of an index file
+#define GEOINDEX_VERSION  2                                                     // to increase when GEOINDEX_RECORD changes
+#define GEOINDEX_EXT      "gix"                                                 // extension of the index files
+
+// ===================
+// STRUCTURES AND DATA
+// ===================
+
+typedef struct _geoindexHeader
+ {
+  char     magic[8];
+  uint32_t version;
+  int32_t  nRecords;                                                            // number of records in the file
+  uint64_t hash;                                                                // key of the index
+  int32_t  dim[4];                                                              // see GEOINDEX
+ }
+GEOINDEX_HEADER;
+
+// ==========
+// ALLOCATION
+// ==========
+
+// -----------------------------------------------------------------------------
+// FUNCTION      GEOINDEX_Alloc
+// -----------------------------------------------------------------------------
+// PURPOSE       Allocate the records of an index
+//
+// INPUT         nRecords : the number of records
+//
+// OUTPUT        pIndex   : the index (dim is set to 0)
+//
+// RETURN        ERROR_ID_ALLOC if the allocation failed, ERROR_ID_NO otherwise
+// -----------------------------------------------------------------------------
+
+RC GEOINDEX_Alloc(GEOINDEX *pIndex,int nRecords)
+ {
+  RC rc;
+
+  rc=ERROR_ID_NO;
+  memset(pIndex,0,sizeof(GEOINDEX));
+
+  if ((nRecords>0) &&
+     ((pIndex->records=(GEOINDEX_RECORD *)MEMORY_AllocBuffer(__func__,"records",nRecords,sizeof(GEOINDEX_RECORD),0,MEMORY_TYPE_STRUCT))==NULL))
+   rc=ERROR_ID_ALLOC;
+  else
+   pIndex->nRecords=nRecords;
+
+  return rc;
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      GEOINDEX_Free
+// -----------------------------------------------------------------------------
+// PURPOSE       Release the records of an index
+// -----------------------------------------------------------------------------
+
+void GEOINDEX_Free(GEOINDEX *pIndex)
+ {
+  if (pIndex->records!=NULL)
+   MEMORY_ReleaseBuffer(__func__,"records",pIndex->records);
+
+  pIndex->records=NULL;
+  pIndex->nRecords=0;
+ }
+
+// =====
+// FILES
+// =====
+
+// build the key of the index of an orbit file; returns 0 if the orbit file can not be found
+
+static int GeoindexKey(XSCACHE_KEY *pKey,const char *tag,const char *orbitFile)
+ {
+  struct stat fileInfo;
+  int64_t fileDesc[2];
+
+  if (stat(orbitFile,&fileInfo)==-1)
+   return 0;
+
+  fileDesc[0]=(int64_t)fileInfo.st_size;
+  fileDesc[1]=(int64_t)fileInfo.st_mtime;
+
+  XSCACHE_KeyInit(pKey,"geoindex");
+  XSCACHE_KeyAdd(pKey,tag,strlen(tag)+1);
+  XSCACHE_KeyAdd(pKey,orbitFile,strlen(orbitFile)+1);
+  XSCACHE_KeyAdd(pKey,fileDesc,sizeof(fileDesc));
+
+  return 1;
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      GEOINDEX_Load
+// -----------------------------------------------------------------------------
+// PURPOSE       Load the index of an orbit file from the cache directory
+//
+// INPUT         tag       : identifies the reader and its options (instrument,
+//                           spectral band,...)
+//               orbitFile : the name of the orbit file
+//
+// OUTPUT        pIndex    : the index (to release with GEOINDEX_Free)
+//
+// RETURN        1 if the index has been found, 0 otherwise (pIndex is then empty)
+// -----------------------------------------------------------------------------
+
+int GEOINDEX_Load(GEOINDEX *pIndex,const char *tag,const char *orbitFile)
+ {
+  char fileName[XSCACHE_NAME_LEN];
+  GEOINDEX_HEADER header;
+  XSCACHE_KEY key;
+  FILE *fp;
+  int found;
+
+  memset(pIndex,0,sizeof(GEOINDEX));
+  found=0;
+
+  if (XSCACHE_Enabled() && GeoindexKey(&key,tag,orbitFile))
+   {
+    XSCACHE_EntryName(&key,GEOINDEX_EXT,fileName);
+
+    if ((fp=fopen(fileName,"rb"))!=NULL)
+     {
+      if ((fread(&header,sizeof(GEOINDEX_HEADER),1,fp)==1) &&
+          !memcmp(header.magic,GEOINDEX_MAGIC,sizeof(header.magic)) &&
+          (header.version==GEOINDEX_VERSION) &&
+          (header.hash==key.hash) &&
+          (header.nRecords>0) &&
+          !GEOINDEX_Alloc(pIndex,header.nRecords))
+       {
+        memcpy(pIndex->dim,header.dim,sizeof(pIndex->dim));
+
+        if (fread(pIndex->records,sizeof(GEOINDEX_RECORD),pIndex->nRecords,fp)==(size_t)pIndex->nRecords)
+         found=1;
+        else
+         GEOINDEX_Free(pIndex);
+       }
+
+      fclose(fp);
+     }
+   }
+
+  return found;
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      GEOINDEX_Save
+// -----------------------------------------------------------------------------
+// PURPOSE       Save the index of an orbit file in the cache directory
+//
+// INPUT         pIndex    : the index
+//               tag       : identifies the reader and its options (see GEOINDEX_Load)
+//               orbitFile : the name of the orbit file
+//
+// REMARK        errors are ignored; the index will be built again next time
+// -----------------------------------------------------------------------------
+
+void GEOINDEX_Save(const GEOINDEX *pIndex,const char *tag,const char *orbitFile)
+ {
+  char fileName[XSCACHE_NAME_LEN];
+  GEOINDEX_HEADER header;
+  XSCACHE_KEY key;
+
+  if (XSCACHE_Enabled() && (pIndex->nRecords>0) && GeoindexKey(&key,tag,orbitFile))
+   {
+    XSCACHE_EntryName(&key,GEOINDEX_EXT,fileName);
+
+    memset(&header,0,sizeof(GEOINDEX_HEADER));
+    memcpy(header.magic,GEOINDEX_MAGIC,sizeof(header.magic));
+    header.version=GEOINDEX_VERSION;
+    header.nRecords=pIndex->nRecords;
+    header.hash=key.hash;
+    memcpy(header.dim,pIndex->dim,sizeof(header.dim));
+
+    XSCACHE_WriteEntry(fileName,&header,sizeof(GEOINDEX_HEADER),pIndex->records,sizeof(GEOINDEX_RECORD)*pIndex->nRecords);
+   }
+ }
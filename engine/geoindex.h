@@ -0,0 +1,48 @@
+#ifndef GEOINDEX_H
+#define GEOINDEX_H
+
+#include <stdint.h>
+
+#include "comdefs.h"
+
+#if defined(_cplusplus) || defined(__cplusplus)
+extern "C" {
+#endif
+
+// Geolocation index of an orbit file : the information needed to select the
+// spectra of the automatic reference, kept in the cache directory (see xscache.h)
+// so that the reference orbits do not have to be read again for each orbit
+// analysed with the same reference.
+
+// The values are kept in double precision so that the spectra selected from the
+// index are exactly the ones selected from the orbit files.
+
+typedef struct _geoindexRecord
+ {
+  double  latitude,longitude;                                                   // centre of the ground pixel (longitude as compared by the reader, 0-360 for OMI and GOME-2)
+  double  sza,vza;                                                              // solar and viewing zenith angles
+  double  cloudFraction;                                                        // -1 if not available
+  int32_t flags;                                                                // instrument specific quality flags
+  int32_t record;                                                               // position of the spectrum in the orbit file
+ }
+GEOINDEX_RECORD;
+
+typedef struct _geoindex
+ {
+  int32_t dim[4];                                                               // instrument specific description of the orbit file (dimensions,...)
+  int     nRecords;                                                             // number of records in the index
+  GEOINDEX_RECORD *records;
+ }
+GEOINDEX;
+
+RC   GEOINDEX_Alloc(GEOINDEX *pIndex,int nRecords);
+void GEOINDEX_Free(GEOINDEX *pIndex);
+
+int  GEOINDEX_Load(GEOINDEX *pIndex,const char *tag,const char *orbitFile);
+void GEOINDEX_Save(const GEOINDEX *pIndex,const char *tag,const char *orbitFile);
+
+#if defined(_cplusplus) || defined(__cplusplus)
+}
+#endif
+
+#endif
@@ -21,6 +21,10 @@
 //!            \li  GEODATA : %Geolocation coordinates and angles
 //!            \li  CLOUDDATA : information on clouds
 //!            \li  OBSERVATIONS : with the radiance information
+//! \details   In automatic reference mode, all the orbit files of the directory are candidates
+//!            for the reference spectra.  Their geolocation index (see geoindex.h) is kept in the
+//!            cache directory, if any : the next runs only read the orbit files that contain
+//!            selected spectra or that are analysed.
 //! \details
 //! \authors   Caroline FAYT (qdoas@aeronomie.be)
 //! \date      22/01/2018 (creation date)
@@ -106,6 +110,7 @@ extern "C" {
 #include "zenithal.h"
 #include "kurucz.h"
 #include "ref_list.h"
+#include "geoindex.h"
 }
 
 using std::string;
@@ -250,6 +255,8 @@ namespace
     //                    *gdpBinRefError;                                           //!< \details errors on irradiance spectra
     int specNumber;                                                               //!< \details total number of spectra in the file
     int n_alongtrack;                                                             //!< \details total number of spectra per row (pixel type)
+    GEOINDEX geoIndex;                                                            //!< \details geolocation index for the automatic reference selection (see geoindex.h)
+    bool indexOnly;                                                               //!< \details true if only the geolocation index of the file has been loaded
     RC rc;
   }
   GOME1NETCDF_ORBIT_FILE;
@@ -603,22 +610,22 @@ static void get_ref_info(GOME1NETCDF_ORBIT_FILE *pOrbitFile)
  }
 
 // -----------------------------------------------------------------------------
-// FUNCTION GOME1NETCDF_Set
+// FUNCTION Gome1NetcdfLoadOrbitFile
 // -----------------------------------------------------------------------------
 //!
-//! \fn      RC GOME1NETCDF_Set(ENGINE_CONTEXT *pEngineContext)
-//! \details Open the netCDF file, get the number of records, load metadata variables and irradiance.\n
-//! \param   [in]  pEngineContext  pointer to the engine context; some fields are affected by this function.\n
-//! \return  ERROR_ID_NETCDF on run time error (opening of the file didn't succeed, missing variable...)\n
-//!          ERROR_ID_NO on success
+//! \fn      static RC Gome1NetcdfLoadOrbitFile(ENGINE_CONTEXT *pEngineContext,GOME1NETCDF_ORBIT_FILE *pOrbitFile)
+//! \details Open an orbit file, load its metadata (wavelength grids, irradiance, geolocations and clouds) and sort its records on the scanline number\n
+//! \param   [in]  pEngineContext  pointer to the engine context\n
+//! \param   [in]  pOrbitFile      pointer to the orbit file; errors specific to this file are returned in pOrbitFile->rc\n
+//! \return  ERROR_ID_ALLOC if a buffer can not be allocated\n
+//!          ERROR_ID_NO otherwise
 //!
 // -----------------------------------------------------------------------------
 
-RC GOME1NETCDF_Set(ENGINE_CONTEXT *pEngineContext)
+static RC Gome1NetcdfLoadOrbitFile(ENGINE_CONTEXT *pEngineContext,GOME1NETCDF_ORBIT_FILE *pOrbitFile)
  {
   // Declarations
 
-  GOME1NETCDF_ORBIT_FILE *pOrbitFile;
   PRJCT_INSTRUMENTAL *pInstrumental;
   NetCDFGroup root_group;
   NetCDFGroup band_group;
@@ -642,332 +649,448 @@ RC GOME1NETCDF_Set(ENGINE_CONTEXT *pEngineContext)
   pInstrumental=&pEngineContext->project.instrumental;
   selected_band=pInstrumental->gomenetcdf.bandType;
 
-  // Define the channel index from the requested type of band
+  pOrbitFile->indexOnly=false;
+  pOrbitFile->specNumber=0;
+  pOrbitFile->rc=0;
+  iscan=iscan_bs=NULL;
 
-  if ((selected_band==PRJCT_INSTR_GDP_BAND_1A) || (selected_band==PRJCT_INSTR_GDP_BAND_1B))
-   channel_index=0;
-  else if ((selected_band==PRJCT_INSTR_GDP_BAND_2A) || (selected_band==PRJCT_INSTR_GDP_BAND_2B))
-   channel_index=1;
-  else if (selected_band==PRJCT_INSTR_GDP_BAND_3)
-   channel_index=2;
-  else if (selected_band==PRJCT_INSTR_GDP_BAND_4)
-   channel_index=3;
-  else
-   channel_index=2;
+  // Try to open the file and load metadata
 
-  pEngineContext->recordNumber=0;
-  gome1netCDF_loadReferenceFlag=0;
-  gome1netCDF_currentFileIndex=ITEM_NONE;
+  try
+   {
+    pOrbitFile->current_file = NetCDFFile(pOrbitFile->fileName,NC_NOWRITE);                 // open file
+    pOrbitFile->root_name = pOrbitFile->current_file.getName();                             // get the root name (should be the file name)
+    root_group = pOrbitFile->current_file.getGroup(pOrbitFile->root_name);                  // go to the root
+    set_reference_time(pOrbitFile,pOrbitFile->current_file.getAttText("time_reference"));   // get the reference time
 
-  // In automatic reference selection, the file has maybe already loaded
+    pOrbitFile->scan_size=
+    pOrbitFile->scan_size_bs=
+    pOrbitFile->pixel_size=
+    pOrbitFile->pixel_size_bs=(size_t)0;
 
-  if ((THRD_id==THREAD_TYPE_ANALYSIS) && pEngineContext->analysisRef.refAuto)
-   {
-    int indexFile = 0;
-    for (;indexFile<gome1netCDF_orbitFilesN;indexFile++)
-      if (!strcasecmp(pEngineContext->fileInfo.fileName,gome1netCDF_orbitFiles[indexFile].fileName) )
-        break;
+    // Load the wavelengths grids
 
-    if (indexFile<gome1netCDF_orbitFilesN)
-      gome1netCDF_currentFileIndex=indexFile;
-   }
+    calib_group=pOrbitFile->current_file.getGroup(pOrbitFile->root_name+"/CALIBRATION");
+    pOrbitFile->calibration=GOME1NETCDF_Read_Calib(calib_group);
 
-  // File has not been loaded already -> load a new file.
+    // Load the irradiance spectrum
 
-  if (gome1netCDF_currentFileIndex==ITEM_NONE)
-   {
-    // Release old buffers
-    GOME1NETCDF_Cleanup();
+    irrad_group=pOrbitFile->current_file.getGroup(pOrbitFile->root_name+"/IRRADIANCE");
+    pOrbitFile->irradiance=GOME1NETCDF_Read_Irrad(irrad_group,channel_index);
 
-    if ((THRD_id==THREAD_TYPE_ANALYSIS) && pEngineContext->analysisRef.refAuto)
+    // MODE_NADIR or MODE_NARROW_SWATH ?
+
+    if (pOrbitFile->current_file.groupID(pOrbitFile->root_name+"/MODE_NADIR/"+gome1netcdf_bandName[selected_band])!=-1)
+     pOrbitFile->mode="/MODE_NADIR/";
+    else if (pOrbitFile->current_file.groupID(pOrbitFile->root_name+"/MODE_NARROW_SWATH/"+gome1netcdf_bandName[selected_band])!=-1)
+     pOrbitFile->mode="/MODE_NARROW_SWATH/";
+    else
+     pOrbitFile->mode="";
+
+    if (pOrbitFile->current_file.groupID(pOrbitFile->root_name+"/MODE_NADIR_BACKSCAN/"+gome1netcdf_bandName[selected_band])!=-1)
+     pOrbitFile->mode_bs="/MODE_NADIR_BACKSCAN/";
+    else if (pOrbitFile->current_file.groupID(pOrbitFile->root_name+"/MODE_NARROW_SWATH_BACKSCAN/"+gome1netcdf_bandName[selected_band])!=-1)
+     pOrbitFile->mode_bs="/MODE_NARROW_SWATH_BACKSCAN/";
+    else
+     pOrbitFile->mode_bs="";
+
+    if (!pOrbitFile->mode.length() && pOrbitFile->mode_bs.length())
+     return rc;
+
+         // Dimensions of spectra are 'time' x 'scan_size' x 'pixel_size ' x 'spectral_channel'
+         // For example : 1 x 552 x 3 x 832
+
+    // Read ground pixels geodata and clouddata
+
+    if (pInstrumental->gomenetcdf.pixelType!=PRJCT_INSTR_GOME1_PIXEL_BACKSCAN)   // if not backscan pixels only
      {
-      gome1netCDF_loadReferenceFlag=1;
+      band_group = pOrbitFile->current_file.getGroup(pOrbitFile->root_name+pOrbitFile->mode+gome1netcdf_bandName[selected_band]);
 
-      char filePath[MAX_STR_SHORT_LEN+1];
-      strcpy(filePath,pEngineContext->fileInfo.fileName);
+/*          pEngineContext->project.instrumental.use_row[0]=
+      pEngineContext->project.instrumental.use_row[1]=
+      pEngineContext->project.instrumental.use_row[2]=true; */
 
-      char *ptr = strrchr(filePath, PATH_SEP);
-      if (ptr == NULL)
-       strcpy(filePath,".");
+      if ((band_group.dimLen("time")!=1) || (band_group.dimLen("ground_pixel")!=3))
+       pOrbitFile->rc = ERROR_SetLast(__func__, ERROR_TYPE_FATAL, ERROR_ID_FILE_FORMAT, "Dimensions of ground pixels in the GOME1 netCDF file are not the expected ones");  // in case of error, capture the message
       else
-       *ptr = '\0';
-
-      DIR *hDir=opendir(filePath);
-      struct dirent *fileInfo = NULL;
-      while (hDir!=NULL && ((fileInfo=readdir(hDir))!=NULL) )
        {
-        sprintf(gome1netCDF_orbitFiles[gome1netCDF_orbitFilesN].fileName,"%s/%s",filePath,fileInfo->d_name);
-        if (!STD_IsDir(gome1netCDF_orbitFiles[gome1netCDF_orbitFilesN].fileName))
-          ++gome1netCDF_orbitFilesN;
-       }
+        // Get the different groups
 
-      if (hDir != NULL)
-        closedir(hDir);
-     }
+        geodata_group = pOrbitFile->current_file.getGroup(pOrbitFile->root_name+pOrbitFile->mode+gome1netcdf_bandName[selected_band]+"/GEODATA");
+        clouddata_group = pOrbitFile->current_file.getGroup(pOrbitFile->root_name+pOrbitFile->mode+gome1netcdf_bandName[selected_band]+"/CLOUDDATA");
+        obs_group = pOrbitFile->current_file.getGroup(pOrbitFile->root_name+pOrbitFile->mode+gome1netcdf_bandName[selected_band]+"/OBSERVATIONS");
 
-    if (!gome1netCDF_orbitFilesN)
-     {
-      gome1netCDF_orbitFilesN=1;
-      strcpy(gome1netCDF_orbitFiles[0].fileName,pEngineContext->fileInfo.fileName);
+        // Get the scanline and pixel size for ground pixel
+
+        pOrbitFile->scan_size=band_group.dimLen("scanline");
+        pOrbitFile->pixel_size=band_group.dimLen("ground_pixel");
+        pOrbitFile->det_size=band_group.dimLen("spectral_channel");
+
+        // Read the metadata
+
+        pOrbitFile->ground_geodata=GOME1NETCDF_Read_Geodata(geodata_group,pOrbitFile->scan_size,pOrbitFile->pixel_size);
+        pOrbitFile->ground_clouddata=GOME1NETCDF_Read_Clouddata(clouddata_group,pOrbitFile->scan_size,pOrbitFile->pixel_size);
+
+        // Get the scanline indexes
+
+        const size_t start[] = {0,0,0};
+        const size_t count[] = {1,pOrbitFile->scan_size,pOrbitFile->pixel_size};
+
+        obs_group.getVar("scanline",start,count,2,(int)-1,scanline);
+        obs_group.getVar("delta_time",start,count,3,(double)0.,deltatime);
+        band_group.getVar("start_pixel",start,count,1,(short)0,startpixel);
+       }
      }
 
-    // Load files
+    // Read backscans geodata and clouddata
 
-    gome1netCDF_totalRecordNumber=0;
-    for (int indexFile=0;(indexFile<gome1netCDF_orbitFilesN) && !rc;indexFile++)
+    if (pInstrumental->gomenetcdf.pixelType!=PRJCT_INSTR_GOME1_PIXEL_GROUND)     // if not ground pixels only
      {
-      pOrbitFile=&gome1netCDF_orbitFiles[indexFile];
-      pOrbitFile->specNumber=0;
-      pOrbitFile->rc=0;
-      iscan=iscan_bs=NULL;
-
-      // Try to open the file and load metadata
+      band_group = pOrbitFile->current_file.getGroup(pOrbitFile->root_name+pOrbitFile->mode_bs+gome1netcdf_bandName[selected_band]);
+//          pEngineContext->project.instrumental.use_row[3]=true;
 
-      try
+      if ((band_group.dimLen("time")!=1) || (band_group.dimLen("ground_pixel")!=1))
+       pOrbitFile->rc = ERROR_SetLast(__func__, ERROR_TYPE_FATAL, ERROR_ID_FILE_FORMAT, "Dimensions of backscan pixels in the GOME1 netCDF file are not the expected ones");  // in case of error, capture the message
+      else
        {
-        pOrbitFile->current_file = NetCDFFile(pOrbitFile->fileName,NC_NOWRITE);                 // open file
-        pOrbitFile->root_name = pOrbitFile->current_file.getName();                             // get the root name (should be the file name)
-        root_group = pOrbitFile->current_file.getGroup(pOrbitFile->root_name);                  // go to the root
-        set_reference_time(pOrbitFile,pOrbitFile->current_file.getAttText("time_reference"));   // get the reference time
+        // Get the different groups
 
-        pOrbitFile->scan_size=
-        pOrbitFile->scan_size_bs=
-        pOrbitFile->pixel_size=
-        pOrbitFile->pixel_size_bs=(size_t)0;
+        geodata_group = pOrbitFile->current_file.getGroup(pOrbitFile->root_name+pOrbitFile->mode_bs+gome1netcdf_bandName[selected_band]+"/GEODATA");
+        clouddata_group = pOrbitFile->current_file.getGroup(pOrbitFile->root_name+pOrbitFile->mode_bs+gome1netcdf_bandName[selected_band]+"/CLOUDDATA");
+        obs_group = pOrbitFile->current_file.getGroup(pOrbitFile->root_name+pOrbitFile->mode_bs+gome1netcdf_bandName[selected_band]+"/OBSERVATIONS");
 
-        // Load the wavelengths grids
+        // Get the scanline and pixel size for backscans
 
-        calib_group=pOrbitFile->current_file.getGroup(pOrbitFile->root_name+"/CALIBRATION");
-        pOrbitFile->calibration=GOME1NETCDF_Read_Calib(calib_group);
+        pOrbitFile->scan_size_bs=band_group.dimLen("scanline");
+        pOrbitFile->pixel_size_bs=band_group.dimLen("ground_pixel");
+        pOrbitFile->det_size=band_group.dimLen("spectral_channel");
 
-        // Load the irradiance spectrum
+        // Read the metadata
 
-        irrad_group=pOrbitFile->current_file.getGroup(pOrbitFile->root_name+"/IRRADIANCE");
-        pOrbitFile->irradiance=GOME1NETCDF_Read_Irrad(irrad_group,channel_index);
+        pOrbitFile->backscan_geodata=GOME1NETCDF_Read_Geodata(geodata_group,pOrbitFile->scan_size_bs,pOrbitFile->pixel_size_bs);
+        pOrbitFile->backscan_clouddata=GOME1NETCDF_Read_Clouddata(clouddata_group,pOrbitFile->scan_size_bs,pOrbitFile->pixel_size_bs);
 
-        // MODE_NADIR or MODE_NARROW_SWATH ?
+        // Get the scanline indexes
 
-        if (pOrbitFile->current_file.groupID(pOrbitFile->root_name+"/MODE_NADIR/"+gome1netcdf_bandName[selected_band])!=-1)
-         pOrbitFile->mode="/MODE_NADIR/";
-        else if (pOrbitFile->current_file.groupID(pOrbitFile->root_name+"/MODE_NARROW_SWATH/"+gome1netcdf_bandName[selected_band])!=-1)
-         pOrbitFile->mode="/MODE_NARROW_SWATH/";
-        else
-         pOrbitFile->mode="";
+        const size_t start[] = {0,0,0};
+        const size_t count[] = {1,pOrbitFile->scan_size_bs,pOrbitFile->pixel_size_bs};
 
-        if (pOrbitFile->current_file.groupID(pOrbitFile->root_name+"/MODE_NADIR_BACKSCAN/"+gome1netcdf_bandName[selected_band])!=-1)
-         pOrbitFile->mode_bs="/MODE_NADIR_BACKSCAN/";
-        else if (pOrbitFile->current_file.groupID(pOrbitFile->root_name+"/MODE_NARROW_SWATH_BACKSCAN/"+gome1netcdf_bandName[selected_band])!=-1)
-         pOrbitFile->mode_bs="/MODE_NARROW_SWATH_BACKSCAN/";
-        else
-         pOrbitFile->mode_bs="";
+        obs_group.getVar("scanline",start,count,2,(int)-1,scanline_bs);
+        obs_group.getVar("delta_time",start,count,3,(double)0.,deltatime_bs);
+        band_group.getVar("start_pixel",start,count,1,(short)0,startpixel);
+       }
+     }
 
-        if (!pOrbitFile->mode.length() && pOrbitFile->mode_bs.length())
-         continue;
+    // Assign size and allocate buffers to keep information as long as the file is open
 
-             // Dimensions of spectra are 'time' x 'scan_size' x 'pixel_size ' x 'spectral_channel'
-             // For example : 1 x 552 x 3 x 832
+    pOrbitFile->specNumber=pOrbitFile->scan_size*pOrbitFile->pixel_size+pOrbitFile->scan_size_bs*pOrbitFile->pixel_size_bs;  // get the total number of records (ground pixels + backscans)
 
-        // Read ground pixels geodata and clouddata
+    if  ((THRD_id==THREAD_TYPE_ANALYSIS) && pEngineContext->analysisRef.refAuto &&
 
-        if (pInstrumental->gomenetcdf.pixelType!=PRJCT_INSTR_GOME1_PIXEL_BACKSCAN)   // if not backscan pixels only
-         {
-          band_group = pOrbitFile->current_file.getGroup(pOrbitFile->root_name+pOrbitFile->mode+gome1netcdf_bandName[selected_band]);
+       (((pInstrumental->gomenetcdf.pixelType!=PRJCT_INSTR_GOME1_PIXEL_BACKSCAN) &&
+       (((pOrbitFile->refInfo[0]=(GOME1NETCDF_REF *)MEMORY_AllocBuffer(__func__,"refInfo[0]",pOrbitFile->specNumber,sizeof(GOME1NETCDF_REF),0,MEMORY_TYPE_STRUCT))==NULL) ||
+        ((pOrbitFile->refInfo[1]=(GOME1NETCDF_REF *)MEMORY_AllocBuffer(__func__,"refInfo[1]",pOrbitFile->specNumber,sizeof(GOME1NETCDF_REF),0,MEMORY_TYPE_STRUCT))==NULL) ||
+        ((pOrbitFile->refInfo[2]=(GOME1NETCDF_REF *)MEMORY_AllocBuffer(__func__,"refInfo[2]",pOrbitFile->specNumber,sizeof(GOME1NETCDF_REF),0,MEMORY_TYPE_STRUCT))==NULL)))  ||
 
-/*          pEngineContext->project.instrumental.use_row[0]=
-          pEngineContext->project.instrumental.use_row[1]=
-          pEngineContext->project.instrumental.use_row[2]=true; */
+        ((pInstrumental->gomenetcdf.pixelType!=PRJCT_INSTR_GOME1_PIXEL_GROUND) &&
+        ((pOrbitFile->refInfo[3]=(GOME1NETCDF_REF *)MEMORY_AllocBuffer(__func__,"refInfo[3]",pOrbitFile->specNumber,sizeof(GOME1NETCDF_REF),0,MEMORY_TYPE_STRUCT))==NULL))))
 
-          if ((band_group.dimLen("time")!=1) || (band_group.dimLen("ground_pixel")!=3))
-           pOrbitFile->rc = ERROR_SetLast(__func__, ERROR_TYPE_FATAL, ERROR_ID_FILE_FORMAT, "Dimensions of ground pixels in the GOME1 netCDF file are not the expected ones");  // in case of error, capture the message
-          else
-           {
-            // Get the different groups
+     rc= pOrbitFile->rc = ERROR_ID_ALLOC;  // in case of error, capture the message
+    else
+     {
+      pOrbitFile->start_pixel=startpixel[0];
 
-            geodata_group = pOrbitFile->current_file.getGroup(pOrbitFile->root_name+pOrbitFile->mode+gome1netcdf_bandName[selected_band]+"/GEODATA");
-            clouddata_group = pOrbitFile->current_file.getGroup(pOrbitFile->root_name+pOrbitFile->mode+gome1netcdf_bandName[selected_band]+"/CLOUDDATA");
-            obs_group = pOrbitFile->current_file.getGroup(pOrbitFile->root_name+pOrbitFile->mode+gome1netcdf_bandName[selected_band]+"/OBSERVATIONS");
+      pOrbitFile->scanline_indexes.resize(pOrbitFile->specNumber);
+      pOrbitFile->scanline_pixtype.resize(pOrbitFile->specNumber);
+      pOrbitFile->scanline_pixnum.resize(pOrbitFile->specNumber);
+      pOrbitFile->alongtrack_indexes.resize(pOrbitFile->specNumber);
+      pOrbitFile->delta_time.resize(pOrbitFile->specNumber);
 
-            // Get the scanline and pixel size for ground pixel
+      auto delta_time_scan=reinterpret_cast<const double(*)[pOrbitFile->pixel_size]>(deltatime.data());
+      auto delta_time_scan_bs = reinterpret_cast<const double(*)[pOrbitFile->pixel_size_bs]>(deltatime_bs.data());
 
-            pOrbitFile->scan_size=band_group.dimLen("scanline");
-            pOrbitFile->pixel_size=band_group.dimLen("ground_pixel");
-            pOrbitFile->det_size=band_group.dimLen("spectral_channel");
+      pOrbitFile->n_alongtrack=0;
 
-            // Read the metadata
+      // Get the maximum scanline number
 
-            pOrbitFile->ground_geodata=GOME1NETCDF_Read_Geodata(geodata_group,pOrbitFile->scan_size,pOrbitFile->pixel_size);
-            pOrbitFile->ground_clouddata=GOME1NETCDF_Read_Clouddata(clouddata_group,pOrbitFile->scan_size,pOrbitFile->pixel_size);
+      maxscan=0;
+      if (pOrbitFile->scan_size && (scanline[(int)pOrbitFile->scan_size-1]>maxscan))
+       maxscan=scanline[(int)pOrbitFile->scan_size-1];
+      if (pOrbitFile->scan_size_bs && (scanline_bs[(int)pOrbitFile->scan_size_bs-1]>maxscan))
+       maxscan=scanline_bs[(int)pOrbitFile->scan_size_bs-1];
+      maxscan++;
 
-            // Get the scanline indexes
+      // Allocate scanline buffers to sort ground pixels and backscans on the scanline number
 
-            const size_t start[] = {0,0,0};
-            const size_t count[] = {1,pOrbitFile->scan_size,pOrbitFile->pixel_size};
+      if (((iscan=(int *)malloc(sizeof(int)*maxscan))==NULL) ||
+          ((iscan_bs=(int *)malloc(sizeof(int)*maxscan))==NULL))
 
-            obs_group.getVar("scanline",start,count,2,(int)-1,scanline);
-            obs_group.getVar("delta_time",start,count,3,(double)0.,deltatime);
-            band_group.getVar("start_pixel",start,count,1,(short)0,startpixel);
-           }
-         }
+       rc=ERROR_ID_ALLOC;
+      else
+       {
+        // Initialize scanline buffers
 
-        // Read backscans geodata and clouddata
+        for (i=0;i<maxscan;i++)
+         iscan[i]=iscan_bs[i]=ITEM_NONE;
 
-        if (pInstrumental->gomenetcdf.pixelType!=PRJCT_INSTR_GOME1_PIXEL_GROUND)     // if not ground pixels only
+        // Consider ground pixels and fill scanline buffer with the indexes of ground pixels
+
+        if (pOrbitFile->scan_size)
+         for (i=0;i<(int)pOrbitFile->scan_size;i++)
+          iscan[scanline[i]]=i;
+
+        // Consider backscan pixels and fill scanline buffer with the indexes of backscan pixels
+
+        if (pOrbitFile->scan_size_bs)
+         for (i=0;i<(int)pOrbitFile->scan_size_bs;i++)
+          iscan_bs[scanline_bs[i]]=i;
+
+        // The following loop browse scanline and sort them
+
+        for (i=k=0;i<maxscan;i++)
          {
-          band_group = pOrbitFile->current_file.getGroup(pOrbitFile->root_name+pOrbitFile->mode_bs+gome1netcdf_bandName[selected_band]);
-//          pEngineContext->project.instrumental.use_row[3]=true;
+          // Consider ground pixels
 
-          if ((band_group.dimLen("time")!=1) || (band_group.dimLen("ground_pixel")!=1))
-           pOrbitFile->rc = ERROR_SetLast(__func__, ERROR_TYPE_FATAL, ERROR_ID_FILE_FORMAT, "Dimensions of backscan pixels in the GOME1 netCDF file are not the expected ones");  // in case of error, capture the message
-          else
+          if ((j=iscan[i])!=ITEM_NONE)
            {
-            // Get the different groups
+            for (n=0;n<(int)pOrbitFile->pixel_size;n++)
+             {
+              pOrbitFile->scanline_indexes[k+n]=j;
+              pOrbitFile->scanline_pixtype[k+n]=n;
+              pOrbitFile->scanline_pixnum[k+n]=i;
+              pOrbitFile->alongtrack_indexes[k+n]=pOrbitFile->n_alongtrack;
+              pOrbitFile->delta_time[k+n]=delta_time_scan[j][n];
+             }
+            k+=pOrbitFile->pixel_size;
+           }
 
-            geodata_group = pOrbitFile->current_file.getGroup(pOrbitFile->root_name+pOrbitFile->mode_bs+gome1netcdf_bandName[selected_band]+"/GEODATA");
-            clouddata_group = pOrbitFile->current_file.getGroup(pOrbitFile->root_name+pOrbitFile->mode_bs+gome1netcdf_bandName[selected_band]+"/CLOUDDATA");
-            obs_group = pOrbitFile->current_file.getGroup(pOrbitFile->root_name+pOrbitFile->mode_bs+gome1netcdf_bandName[selected_band]+"/OBSERVATIONS");
+          // Consider backscan pixels
 
-            // Get the scanline and pixel size for backscans
+          if ((j=iscan_bs[i])!=ITEM_NONE)
+           {
+            pOrbitFile->scanline_indexes[k]=j;
+            pOrbitFile->scanline_pixtype[k]=3;
+            pOrbitFile->scanline_pixnum[k]=i;
+            pOrbitFile->alongtrack_indexes[k]=pOrbitFile->n_alongtrack;
+            pOrbitFile->delta_time[k]=delta_time_scan_bs[j][0];
+            k++;
+           }
 
-            pOrbitFile->scan_size_bs=band_group.dimLen("scanline");
-            pOrbitFile->pixel_size_bs=band_group.dimLen("ground_pixel");
-            pOrbitFile->det_size=band_group.dimLen("spectral_channel");
+          if ((iscan[i]!=ITEM_NONE) || (iscan_bs[i]!=ITEM_NONE))
+           pOrbitFile->n_alongtrack++;
+         }
+       }
 
-            // Read the metadata
+      // Sort ground pixels and backscans using scanline
 
-            pOrbitFile->backscan_geodata=GOME1NETCDF_Read_Geodata(geodata_group,pOrbitFile->scan_size_bs,pOrbitFile->pixel_size_bs);
-            pOrbitFile->backscan_clouddata=GOME1NETCDF_Read_Clouddata(clouddata_group,pOrbitFile->scan_size_bs,pOrbitFile->pixel_size_bs);
+      pOrbitFile->start_pixel=startpixel[0];
+     }
 
-            // Get the scanline indexes
+    // get_ref_info(pOrbitFile);
+   }
+  catch (std::runtime_error& e)
+   {
+    pOrbitFile->rc = ERROR_SetLast(__func__, ERROR_TYPE_FATAL, ERROR_ID_NETCDF, e.what());  // in case of error, capture the message
+   }
 
-            const size_t start[] = {0,0,0};
-            const size_t count[] = {1,pOrbitFile->scan_size_bs,pOrbitFile->pixel_size_bs};
+  // Release the scanline buffers
 
-            obs_group.getVar("scanline",start,count,2,(int)-1,scanline_bs);
-            obs_group.getVar("delta_time",start,count,3,(double)0.,deltatime_bs);
-            band_group.getVar("start_pixel",start,count,1,(short)0,startpixel);
-           }
-         }
+  if (iscan!=NULL)
+   free(iscan);
+  if (iscan_bs!=NULL)
+   free(iscan_bs);
 
-        // Assign size and allocate buffers to keep information as long as the file is open
+  return rc;
+ }
 
-        pOrbitFile->specNumber=pOrbitFile->scan_size*pOrbitFile->pixel_size+pOrbitFile->scan_size_bs*pOrbitFile->pixel_size_bs;  // get the total number of records (ground pixels + backscans)
+// -----------------------------------------------------------------------------
+// FUNCTION Gome1NetcdfBuildIndex
+// -----------------------------------------------------------------------------
+//!
+//! \fn      static RC Gome1NetcdfBuildIndex(GOME1NETCDF_ORBIT_FILE *pOrbitFile)
+//! \details Build the geolocation index of an orbit file (see geoindex.h) with the information useful for the automatic reference selection\n
+//! \param   [in]  pOrbitFile : pointer to the orbit file\n
+//! \return  ERROR_ID_ALLOC if the allocation of the index failed\n
+//!          ERROR_ID_NO otherwise
+//!
+// -----------------------------------------------------------------------------
 
-        if  ((THRD_id==THREAD_TYPE_ANALYSIS) && pEngineContext->analysisRef.refAuto &&
+static RC Gome1NetcdfBuildIndex(GOME1NETCDF_ORBIT_FILE *pOrbitFile)
+ {
+  // Declarations
 
-           (((pInstrumental->gomenetcdf.pixelType!=PRJCT_INSTR_GOME1_PIXEL_BACKSCAN) &&
-           (((pOrbitFile->refInfo[0]=(GOME1NETCDF_REF *)MEMORY_AllocBuffer(__func__,"refInfo[0]",pOrbitFile->specNumber,sizeof(GOME1NETCDF_REF),0,MEMORY_TYPE_STRUCT))==NULL) ||
-            ((pOrbitFile->refInfo[1]=(GOME1NETCDF_REF *)MEMORY_AllocBuffer(__func__,"refInfo[1]",pOrbitFile->specNumber,sizeof(GOME1NETCDF_REF),0,MEMORY_TYPE_STRUCT))==NULL) ||
-            ((pOrbitFile->refInfo[2]=(GOME1NETCDF_REF *)MEMORY_AllocBuffer(__func__,"refInfo[2]",pOrbitFile->specNumber,sizeof(GOME1NETCDF_REF),0,MEMORY_TYPE_STRUCT))==NULL)))  ||
+  GEOINDEX *pIndex;
+  RC rc;
 
-            ((pInstrumental->gomenetcdf.pixelType!=PRJCT_INSTR_GOME1_PIXEL_GROUND) &&
-            ((pOrbitFile->refInfo[3]=(GOME1NETCDF_REF *)MEMORY_AllocBuffer(__func__,"refInfo[3]",pOrbitFile->specNumber,sizeof(GOME1NETCDF_REF),0,MEMORY_TYPE_STRUCT))==NULL))))
+  // Declare substition variables for ground pixels
 
-         rc= pOrbitFile->rc = ERROR_ID_ALLOC;  // in case of error, capture the message
-        else
-         {
-          pOrbitFile->start_pixel=startpixel[0];
+  auto sza_gr = reinterpret_cast<const float(*)[3][3]>(pOrbitFile->ground_geodata.sza.data());
+  auto lat_gr =  reinterpret_cast<const float(*)[3]>(pOrbitFile->ground_geodata.lat.data());
+  auto lon_gr =  reinterpret_cast<const float(*)[3]>(pOrbitFile->ground_geodata.lon.data());
+  auto cloud_gr =  reinterpret_cast<const float(*)[3]>(pOrbitFile->ground_clouddata.cloud_frac.data());
 
-          pOrbitFile->scanline_indexes.resize(pOrbitFile->specNumber);
-          pOrbitFile->scanline_pixtype.resize(pOrbitFile->specNumber);
-          pOrbitFile->scanline_pixnum.resize(pOrbitFile->specNumber);
-          pOrbitFile->alongtrack_indexes.resize(pOrbitFile->specNumber);
-          pOrbitFile->delta_time.resize(pOrbitFile->specNumber);
+  // Declare substition variables for backscan pixels
 
-          auto delta_time_scan=reinterpret_cast<const double(*)[pOrbitFile->pixel_size]>(deltatime.data());
-          auto delta_time_scan_bs = reinterpret_cast<const double(*)[pOrbitFile->pixel_size_bs]>(deltatime_bs.data());
+  auto sza_bs = reinterpret_cast<const float(*)[1][3]>(pOrbitFile->backscan_geodata.sza.data());
+  auto lat_bs =  reinterpret_cast<const float(*)[1]>(pOrbitFile->backscan_geodata.lat.data());
+  auto lon_bs =  reinterpret_cast<const float(*)[1]>(pOrbitFile->backscan_geodata.lon.data());
+  auto cloud_bs =  reinterpret_cast<const float(*)[1]>(pOrbitFile->backscan_clouddata.cloud_frac.data());
 
-          pOrbitFile->n_alongtrack=0;
+  pIndex=&pOrbitFile->geoIndex;
+  GEOINDEX_Free(pIndex);
 
-          // Get the maximum scanline number
+  if (!(rc=GEOINDEX_Alloc(pIndex,pOrbitFile->specNumber)))
+   {
+    pIndex->dim[0]=pOrbitFile->n_alongtrack;
 
-          maxscan=0;
-          if (pOrbitFile->scan_size && (scanline[(int)pOrbitFile->scan_size-1]>maxscan))
-           maxscan=scanline[(int)pOrbitFile->scan_size-1];
-          if (pOrbitFile->scan_size_bs && (scanline_bs[(int)pOrbitFile->scan_size_bs-1]>maxscan))
-           maxscan=scanline_bs[(int)pOrbitFile->scan_size_bs-1];
-          maxscan++;
+    for (int i=0;i<pIndex->nRecords;i++)
+     {
+      size_t scanIndex=pOrbitFile->scanline_indexes[i];                         // index in the ground pixel scanlines or backscan scanlines
+      int    pixelType=pOrbitFile->scanline_pixtype[i];                         // pixel type
+      size_t pixelIndex=(pixelType==3)?0:pixelType;                             // index of the pixel in the scan : should be 0,1,2 for ground pixels and 0 for backscans
+      GEOINDEX_RECORD *record=&pIndex->records[i];
+
+      record->latitude=(pixelType==3)?lat_bs[scanIndex][pixelIndex]:lat_gr[scanIndex][pixelIndex];
+      record->longitude=(pixelType==3)?lon_bs[scanIndex][pixelIndex]:lon_gr[scanIndex][pixelIndex];
+      record->sza=(pixelType==3)?sza_bs[scanIndex][pixelIndex][1]:sza_gr[scanIndex][pixelIndex][1];
+      record->vza=0.;
+      record->cloudFraction=(pixelType==3)?cloud_bs[scanIndex][pixelIndex]:cloud_gr[scanIndex][pixelIndex];
+      record->flags=pixelType;
+      record->record=i;
+     }
+   }
 
-          // Allocate scanline buffers to sort ground pixels and backscans on the scanline number
+  return rc;
+ }
 
-          if (((iscan=(int *)malloc(sizeof(int)*maxscan))==NULL) ||
-              ((iscan_bs=(int *)malloc(sizeof(int)*maxscan))==NULL))
+// -----------------------------------------------------------------------------
+// FUNCTION GOME1NETCDF_Set
+// -----------------------------------------------------------------------------
+//!
+//! \fn      RC GOME1NETCDF_Set(ENGINE_CONTEXT *pEngineContext)
+//! \details Open the netCDF file, get the number of records, load metadata variables and irradiance.\n
+//! \param   [in]  pEngineContext  pointer to the engine context; some fields are affected by this function.\n
+//! \return  ERROR_ID_NETCDF on run time error (opening of the file didn't succeed, missing variable...)\n
+//!          ERROR_ID_NO on success
+//!
+// -----------------------------------------------------------------------------
 
-           rc=ERROR_ID_ALLOC;
-          else
-           {
-            // Initialize scanline buffers
+RC GOME1NETCDF_Set(ENGINE_CONTEXT *pEngineContext)
+ {
+  // Declarations
 
-            for (i=0;i<maxscan;i++)
-             iscan[i]=iscan_bs[i]=ITEM_NONE;
+  GOME1NETCDF_ORBIT_FILE *pOrbitFile;
+  PRJCT_INSTRUMENTAL *pInstrumental;
+  RC rc = ERROR_ID_NO;
+  int selected_band;
+  int i;
 
-            // Consider ground pixels and fill scanline buffer with the indexes of ground pixels
+  // Initializations
 
-            if (pOrbitFile->scan_size)
-             for (i=0;i<(int)pOrbitFile->scan_size;i++)
-              iscan[scanline[i]]=i;
+  pInstrumental=&pEngineContext->project.instrumental;
+  selected_band=pInstrumental->gomenetcdf.bandType;
 
-            // Consider backscan pixels and fill scanline buffer with the indexes of backscan pixels
+  // Define the channel index from the requested type of band
+
+  if ((selected_band==PRJCT_INSTR_GDP_BAND_1A) || (selected_band==PRJCT_INSTR_GDP_BAND_1B))
+   channel_index=0;
+  else if ((selected_band==PRJCT_INSTR_GDP_BAND_2A) || (selected_band==PRJCT_INSTR_GDP_BAND_2B))
+   channel_index=1;
+  else if (selected_band==PRJCT_INSTR_GDP_BAND_3)
+   channel_index=2;
+  else if (selected_band==PRJCT_INSTR_GDP_BAND_4)
+   channel_index=3;
+  else
+   channel_index=2;
 
-            if (pOrbitFile->scan_size_bs)
-             for (i=0;i<(int)pOrbitFile->scan_size_bs;i++)
-              iscan_bs[scanline_bs[i]]=i;
+  pEngineContext->recordNumber=0;
+  gome1netCDF_loadReferenceFlag=0;
+  gome1netCDF_currentFileIndex=ITEM_NONE;
 
-            // The following loop browse scanline and sort them
+  // In automatic reference selection, the file has maybe already loaded
 
-            for (i=k=0;i<maxscan;i++)
-             {
-              // Consider ground pixels
-
-              if ((j=iscan[i])!=ITEM_NONE)
-               {
-                for (n=0;n<(int)pOrbitFile->pixel_size;n++)
-                 {
-                  pOrbitFile->scanline_indexes[k+n]=j;
-                  pOrbitFile->scanline_pixtype[k+n]=n;
-                  pOrbitFile->scanline_pixnum[k+n]=i;
-                  pOrbitFile->alongtrack_indexes[k+n]=pOrbitFile->n_alongtrack;
-                  pOrbitFile->delta_time[k+n]=delta_time_scan[j][n];
-                 }
-                k+=pOrbitFile->pixel_size;
-               }
-
-              // Consider backscan pixels
-
-              if ((j=iscan_bs[i])!=ITEM_NONE)
-               {
-                pOrbitFile->scanline_indexes[k]=j;
-                pOrbitFile->scanline_pixtype[k]=3;
-                pOrbitFile->scanline_pixnum[k]=i;
-                pOrbitFile->alongtrack_indexes[k]=pOrbitFile->n_alongtrack;
-                pOrbitFile->delta_time[k]=delta_time_scan_bs[j][0];
-                k++;
-               }
-
-              if ((iscan[i]!=ITEM_NONE) || (iscan_bs[i]!=ITEM_NONE))
-               pOrbitFile->n_alongtrack++;
-             }
-           }
+  if ((THRD_id==THREAD_TYPE_ANALYSIS) && pEngineContext->analysisRef.refAuto)
+   {
+    int indexFile = 0;
+    for (;indexFile<gome1netCDF_orbitFilesN;indexFile++)
+      if (!strcasecmp(pEngineContext->fileInfo.fileName,gome1netCDF_orbitFiles[indexFile].fileName) )
+        break;
 
-          // Sort ground pixels and backscans using scanline
+    if (indexFile<gome1netCDF_orbitFilesN)
+     {
+      gome1netCDF_currentFileIndex=indexFile;
 
-          pOrbitFile->start_pixel=startpixel[0];
-         }
+      // only the geolocation index of this file has been loaded so far
 
-        // get_ref_info(pOrbitFile);
-       }
-      catch (std::runtime_error& e)
+      if (gome1netCDF_orbitFiles[indexFile].indexOnly &&
+        ((rc=Gome1NetcdfLoadOrbitFile(pEngineContext,&gome1netCDF_orbitFiles[indexFile]))!=ERROR_ID_NO))
+       return rc;
+     }
+   }
+
+  // File has not been loaded already -> load a new file.
+
+  if (gome1netCDF_currentFileIndex==ITEM_NONE)
+   {
+    // Release old buffers
+    GOME1NETCDF_Cleanup();
+
+    if ((THRD_id==THREAD_TYPE_ANALYSIS) && pEngineContext->analysisRef.refAuto)
+     {
+      gome1netCDF_loadReferenceFlag=1;
+
+      char filePath[MAX_STR_SHORT_LEN+1];
+      strcpy(filePath,pEngineContext->fileInfo.fileName);
+
+      char *ptr = strrchr(filePath, PATH_SEP);
+      if (ptr == NULL)
+       strcpy(filePath,".");
+      else
+       *ptr = '\0';
+
+      DIR *hDir=opendir(filePath);
+      struct dirent *fileInfo = NULL;
+      while (hDir!=NULL && ((fileInfo=readdir(hDir))!=NULL) )
        {
-        pOrbitFile->rc = ERROR_SetLast(__func__, ERROR_TYPE_FATAL, ERROR_ID_NETCDF, e.what());  // in case of error, capture the message
+        sprintf(gome1netCDF_orbitFiles[gome1netCDF_orbitFilesN].fileName,"%s/%s",filePath,fileInfo->d_name);
+        if (!STD_IsDir(gome1netCDF_orbitFiles[gome1netCDF_orbitFilesN].fileName))
+          ++gome1netCDF_orbitFilesN;
        }
 
-      // Return
+      if (hDir != NULL)
+        closedir(hDir);
+     }
+
+    if (!gome1netCDF_orbitFilesN)
+     {
+      gome1netCDF_orbitFilesN=1;
+      strcpy(gome1netCDF_orbitFiles[0].fileName,pEngineContext->fileInfo.fileName);
+     }
+
+    // Load files; in automatic reference selection, the other files of the
+    // directory are only candidates for the reference : when their geolocation
+    // index is found in the cache, they are only read if they contain selected spectra
+
+    char indexTag[MAX_STR_SHORT_LEN+1];                                         // the geolocation index depends on the band and on the type of pixels
+    sprintf(indexTag,"gome1netcdf %d %d",selected_band,pInstrumental->gomenetcdf.pixelType);
 
-      if (iscan!=NULL)
-       free(iscan);
-      if (iscan_bs!=NULL)
-       free(iscan_bs);
+    gome1netCDF_totalRecordNumber=0;
+    for (int indexFile=0;(indexFile<gome1netCDF_orbitFilesN) && !rc;indexFile++)
+     {
+      pOrbitFile=&gome1netCDF_orbitFiles[indexFile];
+      const int currentFile=!strcasecmp(pEngineContext->fileInfo.fileName,pOrbitFile->fileName);
+
+      if (gome1netCDF_loadReferenceFlag && !currentFile && GEOINDEX_Load(&pOrbitFile->geoIndex,indexTag,pOrbitFile->fileName))
+       {
+        pOrbitFile->indexOnly=true;
+        pOrbitFile->specNumber=pOrbitFile->geoIndex.nRecords;
+        pOrbitFile->rc=ERROR_ID_NO;
+       }
+      else if (!(rc=Gome1NetcdfLoadOrbitFile(pEngineContext,pOrbitFile)) && gome1netCDF_loadReferenceFlag &&
+                !pOrbitFile->rc && (pOrbitFile->specNumber>0) && !(pOrbitFile->rc=Gome1NetcdfBuildIndex(pOrbitFile)))
+       GEOINDEX_Save(&pOrbitFile->geoIndex,indexTag,pOrbitFile->fileName);
 
-      if (!strcasecmp(pEngineContext->fileInfo.fileName,pOrbitFile->fileName))
+      if (currentFile)
        gome1netCDF_currentFileIndex=indexFile;
 
       gome1netCDF_totalRecordNumber+=pOrbitFile->specNumber;
@@ -1218,6 +1341,9 @@ void GOME1NETCDF_Cleanup(void)
     pOrbitFile->alongtrack_indexes.clear();
     pOrbitFile->delta_time.clear();
     pOrbitFile->current_file.close();
+
+    GEOINDEX_Free(&pOrbitFile->geoIndex);
+    pOrbitFile->indexOnly=false;
    }
 
   gome1netCDF_orbitFilesN=0;
@@ -1269,70 +1395,7 @@ static void free_vza_refs(void) {
   vza_refs=NULL;
 }
 
-// -----------------------------------------------------------------------------
-// FUNCTION get_ref_info
-// -----------------------------------------------------------------------------
-//!
-//! \fn      RC get_ref_info(GOME1NETCDF_ORBIT_FILE *pOrbitFile,GOME1NETCDF_REF *ref_list)
-//! \details Browse spectra of the current orbit file and collect information for the automatic reference selection
-//! \param   [out] ref_list  the information on spectra useful for the automatic reference selection\n
-//! \param   [in]  pOrbitFile : pointer to the current orbit file\n
-//!
-// -----------------------------------------------------------------------------
-
-static void get_ref_info2(GOME1NETCDF_ORBIT_FILE *pOrbitFile,GOME1NETCDF_REF *ref_list)
- {
-  // Global declarations
-
-  GOME1NETCDF_REF *pRef;
-  geodata geo;
-  int pixelSize;
-
-  // Declare substition variables for ground pixels
-
-  geo=pOrbitFile->ground_geodata;                                               // do not work ???
-  pixelSize=3;
-
-  auto sza_gr = reinterpret_cast<const float(*)[pixelSize][3]>(geo.sza.data());
-  auto lat_gr =  reinterpret_cast<const float(*)[pixelSize]>(geo.lat.data());
-  auto lon_gr =  reinterpret_cast<const float(*)[pixelSize]>(geo.lon.data());
-  auto cloud_gr =  reinterpret_cast<const float(*)[pixelSize]>(pOrbitFile->ground_clouddata.cloud_frac.data());
-
-  // Declare substition variables for backscan pixels
-
-  geo=pOrbitFile->backscan_geodata;
-  pixelSize=1;
-
-  auto sza_bs = reinterpret_cast<const float(*)[pixelSize][3]>(geo.sza.data());
-  auto lat_bs =  reinterpret_cast<const float(*)[pixelSize]>(geo.lat.data());
-  auto lon_bs =  reinterpret_cast<const float(*)[pixelSize]>(geo.lon.data());
-
-  auto cloud_bs =  reinterpret_cast<const float(*)[pixelSize]>(pOrbitFile->backscan_clouddata.cloud_frac.data());
-
-  for (int i=0;i<pOrbitFile->specNumber;i++)
-   {
-    // Declarations
-
-    size_t scanIndex=pOrbitFile->scanline_indexes[i];                           // index in the ground pixel scanlines or backscan scanlines
-    int    pixelType=pOrbitFile->scanline_pixtype[i];                           // pixel type
-    size_t pixelIndex=(pixelType==3)?0:pixelType;                               // index of the pixel in the scan : should be 0,1,2 for ground pixels and 0 for backscans
-
-    // Get useful information for automatic reference selection
-
-    pRef=&ref_list[i];
-
-    pRef->pixelType=pixelType;
-    pRef->sza=(pixelType==3)?sza_bs[scanIndex][pixelIndex][1]:sza_gr[scanIndex][pixelIndex][1];
-    pRef->latitude=(pixelType==3)?lat_bs[scanIndex][pixelIndex]:lat_gr[scanIndex][pixelIndex];
-    pRef->longitude=(pixelType==3)?lon_bs[scanIndex][pixelIndex]:lon_gr[scanIndex][pixelIndex];
-    pRef->cloudFraction=(pixelType==3)?cloud_bs[scanIndex][pixelIndex]:cloud_gr[scanIndex][pixelIndex];
-
-   }
-
-
- }
-
-static bool use_as_reference(GOME1NETCDF_REF *pRef,const FENO *feno)
+static bool use_as_reference(const GEOINDEX_RECORD *pRef,const FENO *feno)
  {
   const double latDelta = fabs(feno->refLatMin - feno->refLatMax);
   const double lonDelta = fabs(feno->refLonMin - feno->refLonMax);
@@ -1366,64 +1429,72 @@ static int find_ref_spectra(struct ref_list *(*selected_spectra)[NUM_VZA_REFS],
   // iterate over all orbit files in same directory
   for (int i=0; i<gome1netCDF_orbitFilesN; ++i) {
     GOME1NETCDF_ORBIT_FILE *pOrbitFile=&gome1netCDF_orbitFiles[i];
-    size_t n_wavel = pOrbitFile->calibration.channel_size;
-    GOME1NETCDF_REF *refList;
-
-    if ((refList=(GOME1NETCDF_REF *)malloc(pOrbitFile->specNumber*sizeof(GOME1NETCDF_REF)))!=NULL)
-     {
-      get_ref_info2(pOrbitFile,refList);
-
-      for (int j=0; j<pOrbitFile->specNumber; ++j) {
-        // each spectrum can be used for multiple analysis windows, so
-        // we use one copy, and share the pointer between the different
-        // analysis windows. We initialize as NULL, it becomes not-null
-        // as soon as it is used in one or more analysis windows:
-        struct ref_spectrum *ref = NULL;
-        RC rc;
-
-        // check if this spectrum satisfies constraints for one of the analysis windows:
-        for(int analysis_window = 0; analysis_window<NFeno; analysis_window++) {
-          const int pixel_type = pOrbitFile->scanline_pixtype[j];
-          const FENO *pTabFeno = &TabFeno[pixel_type][analysis_window];
-
-          if (!pTabFeno->hidden
-              && pTabFeno->useKurucz!=ANLYS_KURUCZ_SPEC
-              && pTabFeno->refSpectrumSelectionMode==ANLYS_REF_SELECTION_MODE_AUTOMATIC
-              && use_as_reference(&refList[j],pTabFeno) ) {
-
-            if (ref == NULL) {
-              // ref hasn't been initialized yet for another analysis window, so do that now:
-              ref = (struct ref_spectrum *)malloc(sizeof(struct ref_spectrum));
-              ref->lambda = (double *)malloc(n_wavel*sizeof(*ref->lambda));
-              ref->spectrum = (double *)malloc(n_wavel*sizeof(*ref->spectrum));
-
-              // store the new reference at the front of the linked list:
-              struct ref_list *newRef = (struct ref_list *)malloc(sizeof(*newRef));
-              newRef->ref = ref;
-              newRef->next = *list_handle;
-              *list_handle = newRef;
-
-              if ((rc = GOME1NETCDF_Read(&ENGINE_contextRef, j, i))!= ERROR_ID_NO)
+    const GEOINDEX *pIndex=&pOrbitFile->geoIndex;
+
+    // browse the geolocation index; the file is only read (if only its index
+    // was loaded) when one of its spectra is selected
+
+    for (int j=0; j<pIndex->nRecords; ++j) {
+      // each spectrum can be used for multiple analysis windows, so
+      // we use one copy, and share the pointer between the different
+      // analysis windows. We initialize as NULL, it becomes not-null
+      // as soon as it is used in one or more analysis windows:
+      struct ref_spectrum *ref = NULL;
+      const GEOINDEX_RECORD *record = &pIndex->records[j];
+      RC rc;
+
+      // check if this spectrum satisfies constraints for one of the analysis windows:
+      for(int analysis_window = 0; analysis_window<NFeno; analysis_window++) {
+        const int pixel_type = record->flags;
+        const FENO *pTabFeno = &TabFeno[pixel_type][analysis_window];
+
+        if (!pTabFeno->hidden
+            && pTabFeno->useKurucz!=ANLYS_KURUCZ_SPEC
+            && pTabFeno->refSpectrumSelectionMode==ANLYS_REF_SELECTION_MODE_AUTOMATIC
+            && use_as_reference(record,pTabFeno) ) {
+
+          if (ref == NULL) {
+            if (pOrbitFile->indexOnly) {
+              if ((rc=Gome1NetcdfLoadOrbitFile(&ENGINE_contextRef,pOrbitFile))!=ERROR_ID_NO)
                return rc;
-
-              for (int k=0; k<(int)n_wavel; ++k)
-               {
-                ref->lambda[k] = ENGINE_contextRef.buffers.lambda[k];
-                ref->spectrum[k] = ENGINE_contextRef.buffers.spectrum[k];
-               }
+              if (pOrbitFile->rc) // the file can not be used
+               goto next_file;
             }
 
-            // store ref at the front of the list of selected references for this analysis window and vza bin.
-            struct ref_list *list_item = (struct ref_list *)malloc(sizeof(struct ref_list));
-            list_item->ref = ref;
-            list_item->next = selected_spectra[analysis_window][pixel_type];
-            selected_spectra[analysis_window][pixel_type] = list_item;
+            const size_t n_wavel = pOrbitFile->calibration.channel_size;
+
+            // ref hasn't been initialized yet for another analysis window, so do that now:
+            ref = (struct ref_spectrum *)malloc(sizeof(struct ref_spectrum));
+            ref->lambda = (double *)malloc(n_wavel*sizeof(*ref->lambda));
+            ref->spectrum = (double *)malloc(n_wavel*sizeof(*ref->spectrum));
+
+            // store the new reference at the front of the linked list:
+            struct ref_list *newRef = (struct ref_list *)malloc(sizeof(*newRef));
+            newRef->ref = ref;
+            newRef->next = *list_handle;
+            *list_handle = newRef;
+
+            if ((rc = GOME1NETCDF_Read(&ENGINE_contextRef, record->record, i))!= ERROR_ID_NO)
+             return rc;
+
+            for (int k=0; k<(int)n_wavel; ++k)
+             {
+              ref->lambda[k] = ENGINE_contextRef.buffers.lambda[k];
+              ref->spectrum[k] = ENGINE_contextRef.buffers.spectrum[k];
+             }
           }
+
+          // store ref at the front of the list of selected references for this analysis window and vza bin.
+          struct ref_list *list_item = (struct ref_list *)malloc(sizeof(struct ref_list));
+          list_item->ref = ref;
+          list_item->next = selected_spectra[analysis_window][pixel_type];
+          selected_spectra[analysis_window][pixel_type] = list_item;
         }
       }
+    }
 
-      free(refList);
-     }
+  next_file:
+    ;
   }
 
   return ERROR_ID_NO;
@@ -1557,7 +1628,7 @@ RC GOME1NETCDF_NewRef(ENGINE_CONTEXT *pEngineContext,void *responseHandle) {
           // align ref w.r.t irradiance reference:
           double sigma_shift, sigma_stretch, sigma_stretch2; // not used here...
 
-          rc = ANALYSE_fit_shift_stretch(1, 0, pTabFeno->SrefEtalon, ref->spectrum,
+          rc = ANALYSE_fit_shift_stretch(&ANALYSE_context,1, 0, pTabFeno->SrefEtalon, ref->spectrum,
                                          &ref->shift, &ref->stretch, &ref->stretch2,
                                          &sigma_shift, &sigma_stretch, &sigma_stretch2);
 
@@ -35,6 +35,11 @@
 //  and Andreas Richter (richter@iup.physik.uni-bremen.de) from IFE/IUP Uni Bremen.  These routines
 //  are based on based on the CODA library.
 //
+//  In automatic reference mode, all the orbit files of the directory are
+//  candidates for the reference spectra.  Their geolocation index (see
+//  geoindex.h) is kept in the cache directory, if any: the next runs only read
+//  the orbit files that contain selected spectra or that are analysed.
+//
 //  ----------------------------------------------------------------------------
 
 // ========
@@ -62,6 +67,7 @@
 #include "zenithal.h"
 #include "winthrd.h"
 #include "ref_list.h"
+#include "geoindex.h"
 
 #include "coda.h"
 
@@ -191,6 +197,7 @@ typedef struct _GOME2OrbitFiles {
   GOME2_INFO          gome2Info;                                                // all internal information about the PDS file like data offsets etc.
   double             *gome2SunRef,*gome2SunWve;                                 // the sun reference spectrum and calibration
   struct gome2_geolocation *gome2Geolocations;                                        // geolocations
+  GEOINDEX            gome2Index;                                               // geolocation index for the automatic reference
   int                 specNumber;
   coda_ProductFile   *gome2Pf;                                                  // GOME2 product file pointer
   coda_Cursor         gome2Cursor;                                              // GOME2 file cursor
@@ -1181,6 +1188,8 @@ void GOME2_ReleaseBuffers(void) {
     if (pOrbitFile->gome2SunWve!=NULL)
       MEMORY_ReleaseBuffer(__func__,"gome2SunWve",pOrbitFile->gome2SunWve);
 
+    GEOINDEX_Free(&pOrbitFile->gome2Index);
+
     // Close the current file
 
     if (pOrbitFile->gome2Pf!=NULL) {
@@ -1202,6 +1211,93 @@ void GOME2_ReleaseBuffers(void) {
 #endif
 }
 
+// -----------------------------------------------------------------------------
+// FUNCTION      Gome2LoadOrbitFile
+// -----------------------------------------------------------------------------
+// PURPOSE       Read the orbit information, the irradiance and the
+//               geolocations of an orbit file; the file is closed again
+//
+// INPUT         indexBand    the user selected band
+//
+// INPUT/OUTPUT  pOrbitFile   the orbit file; pOrbitFile->rc is the error on
+//                            its content
+//
+// RETURN        the error returned by Gome2Open
+// -----------------------------------------------------------------------------
+
+static RC Gome2LoadOrbitFile(GOME2_ORBIT_FILE *pOrbitFile,INDEX indexBand) {
+  RC rc;
+
+  pOrbitFile->gome2Pf=NULL;
+  pOrbitFile->specNumber=0;
+
+  // Open the file
+
+  if (!(rc=Gome2Open(&pOrbitFile->gome2Pf,pOrbitFile->gome2FileName,&pOrbitFile->version))) {
+    coda_cursor_set_product(&pOrbitFile->gome2Cursor,pOrbitFile->gome2Pf);
+
+    Gome2ReadOrbitInfo(pOrbitFile,indexBand);
+    NDET[0] = pOrbitFile->gome2Info.no_of_pixels;
+    Gome2BrowseMDR(pOrbitFile,indexBand);
+
+    if ((pOrbitFile->specNumber= (THRD_browseType==THREAD_BROWSE_DARK) ?1:pOrbitFile->gome2Info.total_nadir_obs) >0) {
+      if ( (pOrbitFile->gome2Geolocations= MEMORY_AllocBuffer(__func__,"geoloc",pOrbitFile->specNumber,sizeof(*pOrbitFile->gome2Geolocations),0,MEMORY_TYPE_STRUCT)) ==NULL )
+        rc=ERROR_ID_ALLOC;
+      else if (!(rc=Gome2ReadSunRef(pOrbitFile)))
+        Gome2ReadGeoloc(pOrbitFile,indexBand);
+    }
+
+    if (pOrbitFile->gome2Pf!=NULL) {
+      coda_close(pOrbitFile->gome2Pf);
+      pOrbitFile->gome2Pf=NULL;
+    }
+
+    pOrbitFile->rc=rc;
+    rc=ERROR_ID_NO;
+  }
+
+  return rc;
+}
+
+// -----------------------------------------------------------------------------
+// FUNCTION      Gome2BuildIndex
+// -----------------------------------------------------------------------------
+// PURPOSE       Build the geolocation index of an orbit file from its
+//               geolocations (automatic reference selection)
+//
+// INPUT/OUTPUT  pOrbitFile   the orbit file
+//
+// RETURN        ERROR_ID_ALLOC if the allocation of the index failed;
+//               ERROR_ID_NO    otherwise.
+// -----------------------------------------------------------------------------
+
+static RC Gome2BuildIndex(GOME2_ORBIT_FILE *pOrbitFile) {
+  GEOINDEX *pIndex=&pOrbitFile->gome2Index;
+  RC rc;
+
+  GEOINDEX_Free(pIndex);
+
+  if (!(rc=GEOINDEX_Alloc(pIndex,pOrbitFile->specNumber))) {
+    pIndex->dim[0]=pOrbitFile->gome2Info.no_of_pixels;
+    pIndex->dim[1]=pOrbitFile->version;
+
+    for (int i=0; i<pIndex->nRecords; i++) {
+      const struct gome2_geolocation *geolocation=&pOrbitFile->gome2Geolocations[i];
+      GEOINDEX_RECORD *record=&pIndex->records[i];
+
+      record->latitude=geolocation->latCenter;
+      record->longitude=(geolocation->lonCenter>0) ?geolocation->lonCenter:360.+geolocation->lonCenter;
+      record->sza=geolocation->solZen[1];
+      record->vza=geolocation->sat_vza;                                         // scanner angle, negative for the left scan
+      record->cloudFraction=geolocation->cloudFraction;
+      record->flags=geolocation->scanDirection;
+      record->record=i;
+    }
+  }
+
+  return rc;
+}
+
 // =======================
 // GOME2 READ OUT ROUTINES
 // =======================
@@ -1235,6 +1331,9 @@ RC GOME2_Set(ENGINE_CONTEXT *pEngineContext) {
 
   RC rc=ERROR_ID_NO;
 
+  const INDEX indexBand= (INDEX) pEngineContext->project.instrumental.user;
+  const int refAuto= (THRD_id==THREAD_TYPE_ANALYSIS) && pEngineContext->analysisRef.refAuto;
+
   int previous_file=gome2CurrentFileIndex;
   gome2CurrentFileIndex=ITEM_NONE;
 
@@ -1248,7 +1347,7 @@ RC GOME2_Set(ENGINE_CONTEXT *pEngineContext) {
 
   // In automatic reference selection, the file has maybe already loaded
 
-  if ((THRD_id==THREAD_TYPE_ANALYSIS) && pEngineContext->analysisRef.refAuto) {
+  if (refAuto) {
 
     // Close the previous file
     if (gome2OrbitFilesN && (previous_file!=ITEM_NONE) && (previous_file<gome2OrbitFilesN) &&
@@ -1264,8 +1363,15 @@ RC GOME2_Set(ENGINE_CONTEXT *pEngineContext) {
         break;
     }
 
-    if (indexFile<gome2OrbitFilesN) // found it
+    if (indexFile<gome2OrbitFilesN) { // found it
+      GOME2_ORBIT_FILE *pOrbitFile=&gome2OrbitFiles[indexFile];
       gome2CurrentFileIndex=indexFile;
+
+      // only the geolocation index of this file has been loaded so far
+      if (!pOrbitFile->rc && (pOrbitFile->specNumber>0) && (pOrbitFile->gome2Geolocations==NULL) &&
+          ((rc=Gome2LoadOrbitFile(pOrbitFile,indexBand))!=ERROR_ID_NO))
+        return rc;
+    }
   }
 
   if (gome2CurrentFileIndex==ITEM_NONE) { // the file was not found amongst the previously opened files
@@ -1274,7 +1380,7 @@ RC GOME2_Set(ENGINE_CONTEXT *pEngineContext) {
     GOME2_ReleaseBuffers();
 
     // In automatic reference mode, get the list of files to load
-    if ((THRD_id==THREAD_TYPE_ANALYSIS) && pEngineContext->analysisRef.refAuto) {
+    if (refAuto) {
       // if this file was not previously loaded, we are in this
       // directory for the first time, so we need to generate a new
       // reference
@@ -1308,41 +1414,35 @@ RC GOME2_Set(ENGINE_CONTEXT *pEngineContext) {
     }
 
     // Load files
+    char indexTag[MAX_STR_SHORT_LEN+1];                                         // the geolocation index depends on the band
+    sprintf(indexTag,"gome2 %s",gome2BandName[indexBand]);
+
     gome2TotalRecordNumber=0;
     for (int i=0; i<gome2OrbitFilesN; i++) {
       GOME2_ORBIT_FILE *pOrbitFile=&gome2OrbitFiles[i];
+      const int currentFile=!strcasecmp(pEngineContext->fileInfo.fileName,pOrbitFile->gome2FileName);
 
-      pOrbitFile->gome2Pf=NULL;
-      pOrbitFile->specNumber=0;
-
-      // Open the file
-
-      if (!(rc=Gome2Open(&pOrbitFile->gome2Pf,pOrbitFile->gome2FileName,&pOrbitFile->version))) {
-        coda_cursor_set_product(&pOrbitFile->gome2Cursor,pOrbitFile->gome2Pf);
+      // The other files of the directory are only candidates for the
+      // automatic reference : when their geolocation index is found in the
+      // cache, they are only read if they contain selected spectra
 
-        Gome2ReadOrbitInfo(pOrbitFile, (int) pEngineContext->project.instrumental.user);
-        NDET[0] = pOrbitFile->gome2Info.no_of_pixels;
-        Gome2BrowseMDR(pOrbitFile, (int) pEngineContext->project.instrumental.user);
+      if (refAuto && !currentFile && GEOINDEX_Load(&pOrbitFile->gome2Index,indexTag,pOrbitFile->gome2FileName)) {
+        pOrbitFile->gome2Pf=NULL;
+        pOrbitFile->specNumber=pOrbitFile->gome2Index.nRecords;
+        pOrbitFile->rc=ERROR_ID_NO;
 
-        if ((pOrbitFile->specNumber= (THRD_browseType==THREAD_BROWSE_DARK) ?1:pOrbitFile->gome2Info.total_nadir_obs) >0) {
-          if ( (pOrbitFile->gome2Geolocations= MEMORY_AllocBuffer(__func__,"geoloc",pOrbitFile->specNumber,sizeof(*pOrbitFile->gome2Geolocations),0,MEMORY_TYPE_STRUCT)) ==NULL )
-            rc=ERROR_ID_ALLOC;
-          else if (!(rc=Gome2ReadSunRef(pOrbitFile)))
-            Gome2ReadGeoloc(pOrbitFile, (int) pEngineContext->project.instrumental.user);
-        }
-
-        if (pOrbitFile->gome2Pf!=NULL) {
-          coda_close(pOrbitFile->gome2Pf);
-          pOrbitFile->gome2Pf=NULL;
-        }
+        gome2TotalRecordNumber+=pOrbitFile->specNumber;
+        continue;
+      }
 
-        if (!strcasecmp(pEngineContext->fileInfo.fileName,pOrbitFile->gome2FileName))
+      if (!(rc=Gome2LoadOrbitFile(pOrbitFile,indexBand))) {
+        if (currentFile)
           gome2CurrentFileIndex=i;
 
         gome2TotalRecordNumber+=pOrbitFile->specNumber;
 
-        pOrbitFile->rc=rc;
-        rc=ERROR_ID_NO;
+        if (refAuto && !pOrbitFile->rc && (pOrbitFile->specNumber>0) && !(pOrbitFile->rc=Gome2BuildIndex(pOrbitFile)))
+          GEOINDEX_Save(&pOrbitFile->gome2Index,indexTag,pOrbitFile->gome2FileName);
       }
     }
   }
@@ -1614,16 +1714,15 @@ RC GOME2_get_vza_ref(double scanner_angle, int index_feno, FENO *feno) {
   return ERROR_ID_NO;
 }
 
-static bool use_as_reference(const struct gome2_geolocation *record, const FENO *feno) {
+static bool use_as_reference(const GEOINDEX_RECORD *record, const FENO *feno) {
   const double latDelta = fabs(feno->refLatMin - feno->refLatMax);
   const double lonDelta = fabs(feno->refLonMin - feno->refLonMax);
   const double cloudDelta = feno->cloudFractionMax-feno->cloudFractionMin;
 
-   // SCIA longitudes are in range -180-180 -> convert to range 0-360.
-  const double lon = (record->lonCenter > 0) ? record->lonCenter : 360.0+record->lonCenter;
+  const double lon = record->longitude; // already in the range 0-360 (see Gome2BuildIndex)
 
   const bool match_lat = (latDelta <= EPSILON)
-    || (record->latCenter >= feno->refLatMin && record->latCenter <= feno->refLatMax);
+    || (record->latitude >= feno->refLatMin && record->latitude <= feno->refLatMax);
   const bool match_lon = (lonDelta <= EPSILON)
     || ( (feno->refLonMin < feno->refLonMax
         && lon >=feno->refLonMin && lon <= feno->refLonMax)
@@ -1631,11 +1730,11 @@ static bool use_as_reference(const struct gome2_geolocation *record, const FENO
        (feno->refLonMin >= feno->refLonMax
         && (lon >= feno->refLonMin || lon <= feno->refLonMax) ) ); // if refLonMin > refLonMax, we have either lonMin < lon < 360, or 0 < lon < refLonMax
   const bool match_sza = (feno->refSZADelta <= EPSILON)
-    || ( fabs(record->solZen[1] - feno->refSZA) <= feno->refSZADelta);
+    || ( fabs(record->sza - feno->refSZA) <= feno->refSZADelta);
   const bool match_cloud = (cloudDelta <= EPSILON)
     || (record->cloudFraction >= feno->cloudFractionMin && record->cloudFraction <= feno->cloudFractionMax);
 
-  return (record->scanDirection == 1) && match_lat && match_lon && match_sza && match_cloud;
+  return (record->flags == 1) && match_lat && match_lon && match_sza && match_cloud;  // forward scan
 }
 
 // create a list of all spectra that match reference selection criteria for one or more analysis windows.
@@ -1655,23 +1754,18 @@ static int find_ref_spectra(struct ref_list *selected_spectra[NFeno][NUM_VZA_REF
     if (orbit->rc || !orbit->specNumber)
       continue;
 
+    // the file is only opened (and read, if only its index was loaded) when
+    // one of its spectra is selected
     bool close_current_file = false;
-    if (orbit->gome2Pf == NULL) { // open file if needed
-      int rc = Gome2Open(&orbit->gome2Pf, orbit->gome2FileName, &orbit->version);
-      if (rc)
-        return rc;
-      coda_cursor_set_product(&orbit->gome2Cursor,orbit->gome2Pf);
-      close_current_file = true; // if we opened the file here, remember to close it again later.
-    }
 
-    // Browse spectra
-    for(int j=0; j<orbit->specNumber; ++j) {
+    // Browse the geolocation index
+    for(int j=0; j<orbit->gome2Index.nRecords; ++j) {
       // each spectrum can be used for multiple analysis windows, so
       // we use one copy, and share the pointer between the different
       // analysis windows. We initialize as NULL, it becomes not-null
       // as soon as it is used in one or more analysis windows:
       struct ref_spectrum *ref = NULL;
-      const struct gome2_geolocation *record = &orbit->gome2Geolocations[j];
+      const GEOINDEX_RECORD *record = &orbit->gome2Index.records[j];
 
       // check if this spectrum satisfies constraints for one of the analysis windows:
       for(int analysis_window = 0; analysis_window<NFeno; analysis_window++) {
@@ -1685,8 +1779,24 @@ static int find_ref_spectra(struct ref_list *selected_spectra[NFeno][NUM_VZA_REF
           if (ref == NULL) {
             // ref hasn't been initialized yet for another analysis window, so do that now:
 
+            if (orbit->gome2Geolocations == NULL) { // only the index of this file has been loaded
+              int rc = Gome2LoadOrbitFile(orbit, (INDEX) ENGINE_contextRef.project.instrumental.user);
+              if (rc)
+                return rc;
+              if (orbit->rc) // the file can not be used
+                goto next_file;
+            }
+
+            if (orbit->gome2Pf == NULL) { // open file if needed
+              int rc = Gome2Open(&orbit->gome2Pf, orbit->gome2FileName, &orbit->version);
+              if (rc)
+                return rc;
+              coda_cursor_set_product(&orbit->gome2Cursor,orbit->gome2Pf);
+              close_current_file = true; // if we opened the file here, remember to close it again later.
+            }
+
             // read spectrum, exit if it cannot be used.
-            int rc = GOME2_Read(&ENGINE_contextRef, j, i);
+            int rc = GOME2_Read(&ENGINE_contextRef, record->record, i);
             if (rc == ERROR_ID_FILE_RECORD) {
               // ERROR_ID_FILE_RECORD is a non-fatal error to signal
               // that the current spectrum can not be used. => just
@@ -1721,7 +1831,7 @@ static int find_ref_spectra(struct ref_list *selected_spectra[NFeno][NUM_VZA_REF
           // store ref at the front of the list of selected references for this analysis window and vza bin.
           struct ref_list *list_item = malloc(sizeof(*list_item));
           list_item->ref = ref;
-          const size_t bin = find_bin(fabs(record->sat_vza));
+          const size_t bin = find_bin(fabs(record->vza));
 
           // add the reference to the list for the right VZA bin:
           //
@@ -1729,13 +1839,14 @@ static int find_ref_spectra(struct ref_list *selected_spectra[NFeno][NUM_VZA_REF
           // 0 = nadir,
           // (1, NUM_VZA_BINS( = left scan
           // (NUM_VZA_BINS,2*NUM_VZA_BINS-1( = right scan
-          const size_t vza_offset = (bin == 0 || record->sat_vza < 0.) ? bin : (NUM_VZA_BINS-1 + bin);
+          const size_t vza_offset = (bin == 0 || record->vza < 0.) ? bin : (NUM_VZA_BINS-1 + bin);
           list_item->next = selected_spectra[analysis_window][vza_offset];
           selected_spectra[analysis_window][vza_offset] = list_item;
         }
       }
     next_spectrum: ;
     }
+  next_file:
     if (close_current_file) {
       coda_close(orbit->gome2Pf);
       orbit->gome2Pf=NULL;
@@ -1809,7 +1920,7 @@ RC Gome2NewRef(ENGINE_CONTEXT *pEngineContext,void *responseHandle) {
 
         // align ref w.r.t irradiance reference:
         double sigma_shift, sigma_stretch, sigma_stretch2; // not used here...
-        rc = ANALYSE_fit_shift_stretch(1, 0, pTabFeno->SrefEtalon, ref->spectrum,
+        rc = ANALYSE_fit_shift_stretch(&ANALYSE_context,1, 0, pTabFeno->SrefEtalon, ref->spectrum,
                                        &ref->shift, &ref->stretch, &ref->stretch2, \
                                        &sigma_shift, &sigma_stretch, &sigma_stretch2);
       }
@@ -41,6 +41,7 @@
 //  =================
 //
 //  KURUCZ_SearchReference - search for a reference spectrum in analysis windows on which Kurucz has already been applied;
+//  KURUCZ_SetThreadsNumber - set the number of threads used to fit the calibration sub-windows;
 //  KURUCZ_Spectrum - apply Kurucz for building a new wavelength scale to a spectrum;
 //  KURUCZ_ApplyCalibration - apply the new calibration to cross sections to interpolate or to convolute and recalculate gaps;
 //  KURUCZ_Reference - browse analysis windows and apply Kurucz if needed on reference spectrum;
@@ -56,6 +57,7 @@
 
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
 
 #include "kurucz.h"
 #include "analyse.h"
@@ -69,15 +71,28 @@
 #include "vector.h"
 #include "winthrd.h"
 #include "output.h"
+#include "timing.h"
 
 // ================
 // GLOBAL VARIABLES
 // ================
 
 KURUCZ KURUCZ_buffers[MAX_SWATHSIZE];
-FFT *pKURUCZ_fft;
 int KURUCZ_indexLine=1;
 
+// ================
+// STATIC VARIABLES
+// ================
+
+// The high resolution solar spectrum and the slit function file are the same for
+// all rows when the solar reference has only one spectrum column : the first row
+// that loads them keeps the buffers, the other rows use them read-only and
+// KURUCZ_Free releases them once.
+
+static INDEX kuruczSolarRow=ITEM_NONE;                                          // row that owns the shared high resolution solar spectrum
+static double kuruczSolarRange[2];                                              // wavelength range of the shared solar spectrum
+static INDEX kuruczSlitRow=ITEM_NONE;                                           // row that owns the shared slit function
+
 // ===========================
 // CALCULATION OF THE PRESHIFT
 // ===========================
@@ -708,6 +723,7 @@ RC KuruczConvolveSolarSpectrum(MATRIX_OBJECT *pSolar,double *newlambda,int n_wav
  {
  	// Declarations
 
+ 	FENO *pFeno;
  	CROSS_REFERENCE *TabCross;
   MATRIX_OBJECT slitMatrix[NSFP],*pSlitMatrix;
   double slitParam[NSFP];
@@ -724,8 +740,8 @@ RC KuruczConvolveSolarSpectrum(MATRIX_OBJECT *pSolar,double *newlambda,int n_wav
   // Initializations
 
   pKurucz=&KURUCZ_buffers[indexFenoColumn];
-  Feno=&TabFeno[indexFenoColumn][pKurucz->indexKurucz];
-  TabCross=Feno->TabCross;
+  pFeno=&TabFeno[indexFenoColumn][pKurucz->indexKurucz];
+  TabCross=pFeno->TabCross;
   rc=ERROR_ID_NO;
 
   memset(slitMatrix,0,sizeof(MATRIX_OBJECT)*NSFP);
@@ -746,8 +762,8 @@ RC KuruczConvolveSolarSpectrum(MATRIX_OBJECT *pSolar,double *newlambda,int n_wav
 
     shiftIndex=(nc==2)?0:1;
 
-    fwhmStretch1=(Feno->indexFwhmParam[0]!=ITEM_NONE)?(double)TabCross[Feno->indexFwhmParam[0]].InitParam:(double)1.;
-    fwhmStretch2=(Feno->indexFwhmParam[1]!=ITEM_NONE)?(double)TabCross[Feno->indexFwhmParam[1]].InitParam:(double)1.;
+    fwhmStretch1=(pFeno->indexFwhmParam[0]!=ITEM_NONE)?(double)TabCross[pFeno->indexFwhmParam[0]].InitParam:(double)1.;
+    fwhmStretch2=(pFeno->indexFwhmParam[1]!=ITEM_NONE)?(double)TabCross[pFeno->indexFwhmParam[1]].InitParam:(double)1.;
 
     pSlitMatrix=&slitMatrix[0];
 
@@ -794,9 +810,9 @@ RC KuruczConvolveSolarSpectrum(MATRIX_OBJECT *pSolar,double *newlambda,int n_wav
 
     slitOptions.slitType=slitType;
     slitOptions.slitFile[0]=0;
-    slitOptions.slitParam=TabCross[Feno->indexFwhmParam[0]].InitParam;
-    slitOptions.slitParam2=(slitType==SLIT_TYPE_GAUSS)?(double)0.:TabCross[Feno->indexFwhmParam[1]].InitParam;
-    slitOptions.slitParam3=(slitType==SLIT_TYPE_SUPERGAUSS)?TabCross[Feno->indexFwhmParam[2]].InitParam:(double)0.;
+    slitOptions.slitParam=TabCross[pFeno->indexFwhmParam[0]].InitParam;
+    slitOptions.slitParam2=(slitType==SLIT_TYPE_GAUSS)?(double)0.:TabCross[pFeno->indexFwhmParam[1]].InitParam;
+    slitOptions.slitParam3=(slitType==SLIT_TYPE_SUPERGAUSS)?TabCross[pFeno->indexFwhmParam[2]].InitParam:(double)0.;
 
     rc=XSCONV_LoadSlitFunction(slitMatrix,&slitOptions,NULL,&slitType);
    }
@@ -804,7 +820,7 @@ RC KuruczConvolveSolarSpectrum(MATRIX_OBJECT *pSolar,double *newlambda,int n_wav
   // convolution of the solar spectrum
 
   if (!rc)
-   rc=XSCONV_TypeStandard(pSolar,0,n_wavel,&KURUCZ_buffers[indexFenoColumn].hrSolar,&KURUCZ_buffers[indexFenoColumn].hrSolar,NULL,slitType,slitMatrix,slitParam,0);
+   rc=XSCONV_TypeStandard(pSolar,0,n_wavel,&KURUCZ_buffers[indexFenoColumn].hrSolar,&KURUCZ_buffers[indexFenoColumn].hrSolar,NULL,slitType,slitMatrix,slitParam,0,&KURUCZ_buffers[indexFenoColumn].slitBank);
 
   // Release allocated buffers
 
@@ -990,12 +1006,641 @@ INDEX KuruczSearchReference(INDEX indexRefFeno,INDEX indexRefColumn)
   return indexFeno;
  }
 
+// ==================================
+// FIT OF THE CALIBRATION SUB-WINDOWS
+// ==================================
+
+// By default (one thread), the sub-windows of the calibration interval are fitted
+// one after the other and each fit starts from the initial values of the fitted
+// parameters (InitParam, InitShift, InitStretch,...) left by the previous one.
+//
+// When several threads are allowed (KURUCZ_SetThreadsNumber), the sub-windows are
+// fitted independently of each other : every sub-window is fitted with its own
+// analysis context and its own copy of the calibration window taken before the
+// first fit, so the initial values are not carried over and the result does not
+// depend on the number of threads (but may differ slightly from the serial fit).
+// Each fit only writes its own items of the per sub-window results (shift, fwhm,
+// iterations,...); the buffers shared by overlapping sub-windows (residual, offset,
+// fits of cross sections) are gathered in the order of the sub-windows.
+
+#define KURUCZ_JOB_ERRORS 16                                                    // the error stack of a thread can not hold more
+
+// Everything the fit of a sub-window needs from KURUCZ_Spectrum
+
+typedef struct _kuruczWindowsFit
+ {
+  KURUCZ       *pKurucz;                                                        // calibration buffers of the detector row
+  INDEX         indexFeno,indexFenoColumn;                                      // analysis window and detector row
+  int           n_wavel,                                                        // size of the spectrum
+                maxParam;                                                       // number of slit function parameters to fit
+  char          displayFlag;                                                    // 1 to keep the fits for display
+  double        shiftSign;
+  const double *oldLambda;                                                      // original calibration
+  const double *spectrum,*solar;                                                // spectrum to calibrate and solar reference
+  double       *calib_shift,*calib_stretch,*calib_stretch2;                     // shift and stretch found in each sub-window
+ }
+KURUCZ_WINDOWS_FIT;
+
+// Private copy of the buffers written by the fit of a sub-window
+
+typedef struct _kuruczWindowJob
+ {
+  ANALYSE_CONTEXT   context;                                                    // working buffers of the fit
+  FENO              feno;                                                       // copy of the calibration window
+  double           *offset,                                                     // offset to display
+                  **crossFits;                                                  // fits of cross sections to display
+  ERROR_DESCRIPTION errors[KURUCZ_JOB_ERRORS];                                  // errors raised by the thread that fitted the sub-window (last first)
+  int               nErrors;
+  RC                rc;                                                         // return code of the fit
+ }
+KURUCZ_WINDOW_JOB;
+
+typedef struct _kuruczWindowsPool
+ {
+  const KURUCZ_WINDOWS_FIT *pFit;
+  KURUCZ_WINDOW_JOB        *jobs;                                               // one job per sub-window
+  int                       nJobs,nextJob;
+  pthread_mutex_t           lock;                                               // protects nextJob
+ }
+KURUCZ_WINDOWS_POOL;
+
+static int kuruczThreadsNumber=1;                                               // maximum number of threads for fitting the sub-windows
+
+// -----------------------------------------------------------------------------
+// FUNCTION      KURUCZ_SetThreadsNumber
+// -----------------------------------------------------------------------------
+// PURPOSE       Set the maximum number of threads used by KURUCZ_Spectrum to fit
+//               the calibration sub-windows (1, the default, to fit them one after
+//               the other from the state left by the previous sub-window)
+//
+// REMARK        should not be called while a calibration is running
+// -----------------------------------------------------------------------------
+
+void KURUCZ_SetThreadsNumber(int threadsNumber)
+ {
+  kuruczThreadsNumber=(threadsNumber>1)?threadsNumber:1;
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      KuruczFitWindow
+// -----------------------------------------------------------------------------
+// PURPOSE       Fit one sub-window of the calibration interval
+//
+// INPUT         pFit        the data common to all sub-windows;
+//               indexWindow the sub-window to fit;
+//
+// INPUT/OUTPUT  pContext    working buffers of the fit;
+//               pFeno       the calibration window;
+//               offset      offset to display;
+//               crossFits   fits of cross sections to display (NULL if none)
+//
+// RETURN        the return code of the fit
+// -----------------------------------------------------------------------------
+
+static RC KuruczFitWindow(const KURUCZ_WINDOWS_FIT *pFit,ANALYSE_CONTEXT *pContext,FENO *pFeno,INDEX indexWindow,double *offset,double **crossFits)
+ {
+  // Declarations
+
+  KURUCZ *pKurucz;
+  KURUCZ_FENO *pKuruczFeno;
+  struct fit_properties *subwindow_fit;
+  CROSS_REFERENCE *TabCross,*pTabCross;
+  CROSS_RESULTS *Results,*pResults;
+  double *dispAbsolu,*dispSecX,*pixMid,*VLambda,*VShift;
+  const double *spectrum,*oldLambda;
+  double Square,j0,lambda0;
+  INDEX indexParam,indexTabCross,indexCrossFit,i,k;
+  int n_wavel;
+  RC rc;
+
+  // Initializations
+
+  pKurucz=pFit->pKurucz;
+  pKuruczFeno=&pKurucz->KuruczFeno[pFit->indexFeno];
+  subwindow_fit=pKuruczFeno->subwindow_fits;
+  spectrum=pFit->spectrum;
+  oldLambda=pFit->oldLambda;
+  n_wavel=pFit->n_wavel;
+
+  pixMid=pKurucz->pixMid;
+  VLambda=pKurucz->VLambda;
+  VShift=pKurucz->VShift;
+
+  pContext->Feno=pFeno;
+  TabCross=pFeno->TabCross;
+  Results=pFeno->TabCrossResults;
+  pResults=&pFeno->TabCrossResults[(pFeno->indexSpectrum!=ITEM_NONE)?pFeno->indexSpectrum:pFeno->indexReference];
+
+  pFeno->Decomp=1;
+  pKurucz->NIter[indexWindow]=0;
+  Square=(double)0.;
+
+  dispAbsolu=pKurucz->dispAbsolu[indexWindow];
+  dispSecX=pKurucz->dispSecX[indexWindow];
+
+  for (i=0;i<n_wavel;i++)
+   dispAbsolu[i]=dispSecX[i]=(double)0.;
+
+  if (pKuruczOptions->fwhmFit)
+   pContext->pKuruczFft=&pKuruczFeno->fft[indexWindow];
+
+  // Global initializations
+
+  if (((rc=ANALYSE_SvdInit(pContext,pFeno,&subwindow_fit[indexWindow],n_wavel,pContext->Lambda))!=ERROR_ID_NO) ||
+
+      // Analysis method
+
+      ((rc=ANALYSE_CurFitMethod(pContext,pFit->indexFenoColumn,                  // to change a little bit later for OMI
+                                spectrum,                                       // spectrum
+                                NULL,                                           // no error on previous spectrum
+                                pFit->solar,                                    // reference (Kurucz)
+                                n_wavel,
+                                NULL,
+                                &Square,                                        // returned stretch order 2
+                                &pKurucz->NIter[indexWindow],
+                                1.,1.,
+                                &subwindow_fit[indexWindow]))>0))
+
+   return rc;
+
+  // Fill A SVD system
+
+  pixMid[indexWindow+1]=(double)( spectrum_start(subwindow_fit[indexWindow].specrange)
+                                  + spectrum_end(subwindow_fit[indexWindow].specrange) )*0.5;
+
+  pKurucz->VSig[indexWindow+1]=pResults->SigmaShift;
+
+  pFit->calib_shift[indexWindow] = pResults->Shift;
+  pFit->calib_stretch[indexWindow] = pResults->Stretch;
+  pFit->calib_stretch2[indexWindow] = pResults->Stretch2;
+
+  VShift[indexWindow+1]=pResults->Shift;                          // In order to be in accordance with the preshift, we keep the sign now.  Before (Feno->indexSpectrum!=ITEM_NONE)?(double)-pResults->Shift:(double)pResults->Shift;
+
+  // TODO:
+  //
+  //  - VLambda is used to fit FWHM as function of Lambda, but could be done as function of pixel, too?
+  VLambda[indexWindow+1]=(fabs(pixMid[indexWindow+1]-floor(pixMid[indexWindow+1]))<(double)0.1)?
+    (double)oldLambda[(INDEX)pixMid[indexWindow+1]]-pFit->shiftSign*VShift[indexWindow+1]:
+    (double)0.5*(oldLambda[(INDEX)floor(pixMid[indexWindow+1])]+oldLambda[(INDEX)floor(pixMid[indexWindow+1]+1.)])-pFit->shiftSign*VShift[indexWindow+1];
+
+  // Store fwhm for future use
+
+  if (pKuruczOptions->fwhmFit)
+    for (indexParam=0;indexParam<pFit->maxParam;indexParam++) {
+      if ((indexParam==1) && (pKuruczOptions->fwhmType==SLIT_TYPE_AGAUSS))
+        pKurucz->fwhm[indexParam][indexWindow]=pFeno->TabCrossResults[pFeno->indexFwhmParam[indexParam]].Param;  // asymmetric factor can be negatif for asymmetric gaussian
+      else
+        pKurucz->fwhm[indexParam][indexWindow]=fabs(pFeno->TabCrossResults[pFeno->indexFwhmParam[indexParam]].Param);
+
+      pKurucz->fwhmSigma[indexParam][indexWindow]=pFeno->TabCrossResults[pFeno->indexFwhmParam[indexParam]].SigmaParam;
+    }
+
+  // Store fit for display
+
+  if (pFit->displayFlag) {
+    if (pKurucz->method==OPTICAL_DENSITY_FIT)
+     {
+      for (i=pContext->SvdPDeb;i<=pContext->SvdPFin;i++)
+       {
+        dispAbsolu[i]=pContext->absolu[i];
+        dispSecX[i]=pContext->secX[i]=exp(log(spectrum[i])+pContext->absolu[i]);
+       }
+     }
+    else
+     {
+     	for (i=pContext->SvdPDeb;i<=pContext->SvdPFin;i++)
+     	 {
+        dispAbsolu[i]=pContext->absolu[i]=(pContext->tc[i]!=(double)0.)?pContext->absolu[i]/pContext->tc[i]:(double)0.;
+        dispSecX[i]=pContext->secX[i]=exp(log(spectrum[i])+pContext->absolu[i]/pContext->tc[i]); // spectrum[i]+solar[i]*ANALYSE_absolu[i]/ANALYSE_tc[i];
+       }
+     }
+
+    j0=(double)(pContext->SvdPDeb+pContext->SvdPFin)*0.5;
+    lambda0=(fabs(j0-floor(j0))<(double)0.1)?
+      (double)pContext->splineX[(INDEX)j0]:
+      (double)0.5*(pContext->splineX[(INDEX)floor(j0)]+pContext->splineX[(INDEX)floor(j0+1.)]);
+
+    if ((pFeno->indexOffsetConst!=ITEM_NONE) &&
+        (pFeno->indexOffsetOrder1!=ITEM_NONE) &&
+        (pFeno->indexOffsetOrder2!=ITEM_NONE) &&
+
+        ((TabCross[pFeno->indexOffsetConst].FitParam!=ITEM_NONE) ||
+         (TabCross[pFeno->indexOffsetOrder1].FitParam!=ITEM_NONE) ||
+         (TabCross[pFeno->indexOffsetOrder2].FitParam!=ITEM_NONE) ||
+         (TabCross[pFeno->indexOffsetConst].InitParam!=(double)0.) ||
+         (TabCross[pFeno->indexOffsetOrder1].InitParam!=(double)0.) ||
+         (TabCross[pFeno->indexOffsetOrder2].InitParam!=(double)0.)))
+
+      for (i=pContext->SvdPDeb;i<=pContext->SvdPFin;i++) {
+        offset[i]=(double)1.-pFeno->xmean*(Results[pFeno->indexOffsetConst].Param+
+                                          Results[pFeno->indexOffsetOrder1].Param*(pContext->splineX[i]-lambda0)+
+                                          Results[pFeno->indexOffsetOrder2].Param*(pContext->splineX[i]-lambda0)*(pContext->splineX[i]-lambda0))/spectrum[i];
+        offset[i]=(offset[i]>(double)0.)?log(offset[i]):(double)0.;
+      }
+
+    if (crossFits!=NULL)
+
+      for (indexTabCross=indexCrossFit=0;(indexTabCross<pFeno->NTabCross) && (indexCrossFit<pKurucz->crossFits.nc);indexTabCross++) {
+        pTabCross=&TabCross[indexTabCross];
+
+        if (pTabCross->IndSvdA && (WorkSpace[pTabCross->Comp].type==WRK_SYMBOL_CROSS) && pTabCross->display) {
+          for (i=pContext->SvdPDeb,k=1;i<=pContext->SvdPFin;i++,k++)
+            crossFits[indexCrossFit][i]=pContext->x[pTabCross->IndSvdA]*subwindow_fit[indexWindow].A[pTabCross->IndSvdA][k];
+
+          indexCrossFit++;
+        }
+      }
+  }
+
+  // Results safe keeping
+
+  memcpy(pKuruczFeno->results[indexWindow],pFeno->TabCrossResults,sizeof(CROSS_RESULTS)*pFeno->NTabCross);
+
+  pKuruczFeno->wve[indexWindow]=VLambda[indexWindow+1];
+  pKuruczFeno->chiSquare[indexWindow]=Square;
+  pKuruczFeno->rms[indexWindow]=(Square>(double)0.)?sqrt(Square):(double)0.;
+  pKuruczFeno->nIter[indexWindow]=pKurucz->NIter[indexWindow];
+
+  return rc;
+ }
+
+// KuruczCopyVector : allocate a copy of a vector of the calibration window (nothing to do if the vector is not used)
+
+static RC KuruczCopyVector(double **pCopy,const double *vector,int n)
+ {
+  RC rc=ERROR_ID_NO;
+
+  *pCopy=NULL;
+
+  if (vector!=NULL)
+   {
+    if ((*pCopy=(double *)MEMORY_AllocDVector(__func__,"vector",0,n-1))==NULL)
+     rc=ERROR_ID_ALLOC;
+    else
+     memcpy(*pCopy,vector,sizeof(double)*n);
+   }
+
+  return rc;
+ }
+
+// KuruczReleaseVector : release a vector allocated by KuruczCopyVector
+
+static void KuruczReleaseVector(double **pVector)
+ {
+  if (*pVector!=NULL)
+   MEMORY_ReleaseDVector(__func__,"vector",*pVector,0);
+
+  *pVector=NULL;
+ }
+
+// KuruczJobFree : release the buffers of a sub-window job
+
+static void KuruczJobFree(KURUCZ_WINDOW_JOB *pJob)
+ {
+  CROSS_REFERENCE *pTabCross;
+  INDEX indexTabCross;
+
+  for (indexTabCross=0;indexTabCross<pJob->feno.NTabCross;indexTabCross++)
+   {
+    pTabCross=&pJob->feno.TabCross[indexTabCross];
+
+    KuruczReleaseVector(&pTabCross->vector);
+    KuruczReleaseVector(&pTabCross->Deriv2);
+    KuruczReleaseVector(&pTabCross->vectorBackup);
+    KuruczReleaseVector(&pTabCross->Deriv2Backup);
+    KuruczReleaseVector(&pTabCross->molecularCrossSection);
+   }
+
+  XSCONV_SlitBankFree(&pJob->feno.slitBank);
+  KuruczReleaseVector(&pJob->offset);
+
+  if (pJob->crossFits!=NULL)
+   MEMORY_ReleaseDMatrix(__func__,"crossFits",pJob->crossFits,0,0);
+
+  ANALYSE_ContextFree(&pJob->context);
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      KuruczJobAlloc
+// -----------------------------------------------------------------------------
+// PURPOSE       Prepare a sub-window job : copy the state of the calibration window
+//               and of the analysis context before the sub-windows are fitted
+// -----------------------------------------------------------------------------
+
+static RC KuruczJobAlloc(KURUCZ_WINDOW_JOB *pJob,const ANALYSE_CONTEXT *pContext,const FENO *pFeno,int n_wavel,int nCrossFits)
+ {
+  CROSS_REFERENCE *pTabCross;
+  const CROSS_REFERENCE *pOrigCross;
+  INDEX indexTabCross,i;
+  int ndet,n;
+  RC rc;
+
+  ndet=pContext->ndet;
+  n=pFeno->NDET;
+
+  // Copy the calibration window; vectors are duplicated below because they can be modified by the fit
+
+  memcpy(&pJob->feno,pFeno,sizeof(FENO));
+  memset(&pJob->feno.slitBank,0,sizeof(SLIT_BANK));
+
+  for (indexTabCross=0;indexTabCross<pFeno->NTabCross;indexTabCross++)
+   {
+    pTabCross=&pJob->feno.TabCross[indexTabCross];
+    pTabCross->vector=pTabCross->Deriv2=pTabCross->vectorBackup=pTabCross->Deriv2Backup=pTabCross->molecularCrossSection=NULL;
+   }
+
+  pJob->offset=NULL;
+  pJob->crossFits=NULL;
+  pJob->nErrors=0;
+  pJob->rc=ERROR_ID_NO;
+
+  if ((rc=ANALYSE_ContextAlloc(&pJob->context,ndet))!=ERROR_ID_NO)
+   return rc;
+
+  for (indexTabCross=0;(indexTabCross<pFeno->NTabCross) && !rc;indexTabCross++)
+   {
+    pTabCross=&pJob->feno.TabCross[indexTabCross];
+    pOrigCross=&pFeno->TabCross[indexTabCross];
+
+    if (!(rc=KuruczCopyVector(&pTabCross->vector,pOrigCross->vector,n)) &&
+        !(rc=KuruczCopyVector(&pTabCross->Deriv2,pOrigCross->Deriv2,n)) &&
+        !(rc=KuruczCopyVector(&pTabCross->vectorBackup,pOrigCross->vectorBackup,n)) &&
+        !(rc=KuruczCopyVector(&pTabCross->Deriv2Backup,pOrigCross->Deriv2Backup,n)))
+     rc=KuruczCopyVector(&pTabCross->molecularCrossSection,pOrigCross->molecularCrossSection,n);
+   }
+
+  if (!rc && (((pJob->offset=(double *)MEMORY_AllocDVector(__func__,"offset",0,n_wavel-1))==NULL) ||
+              ((nCrossFits>0) && ((pJob->crossFits=MEMORY_AllocDMatrix(__func__,"crossFits",0,n_wavel-1,0,nCrossFits-1))==NULL))))
+   rc=ERROR_ID_ALLOC;
+
+  if (!rc)
+   {
+    // State of the context before the first sub-window
+
+    pJob->context.Lambda=pContext->Lambda;                                      // not modified by the fit
+    pJob->context.LambdaSpec=pContext->LambdaSpec;
+    pJob->context.hFilterSpecLog=pContext->hFilterSpecLog;
+    pJob->context.hFilterRefLog=pContext->hFilterRefLog;
+    pJob->context.indexRecord=pContext->indexRecord;
+    pJob->context.ZM=pContext->ZM;
+
+    memcpy(pJob->context.absolu,pContext->absolu,sizeof(double)*ndet);
+    memcpy(pJob->context.secX,pContext->secX,sizeof(double)*ndet);
+    memcpy(pJob->context.t,pContext->t,sizeof(double)*ndet);
+    memcpy(pJob->context.tc,pContext->tc,sizeof(double)*ndet);
+
+    for (i=0;i<n_wavel;i++)
+     pJob->offset[i]=(double)0.;
+
+    for (indexTabCross=0;indexTabCross<nCrossFits;indexTabCross++)
+     for (i=0;i<n_wavel;i++)
+      pJob->crossFits[indexTabCross][i]=(double)0.;
+   }
+
+  return rc;
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      KuruczJobRestore
+// -----------------------------------------------------------------------------
+// PURPOSE       Copy the state left by the fit of the last sub-window into the
+//               calibration window and the analysis context, as if the sub-windows
+//               had been fitted one after the other
+// -----------------------------------------------------------------------------
+
+static void KuruczJobRestore(const KURUCZ_WINDOW_JOB *pJob,ANALYSE_CONTEXT *pContext,FENO *pFeno)
+ {
+  const ANALYSE_CONTEXT *pJobContext;
+  const CROSS_REFERENCE *pJobCross;
+  CROSS_REFERENCE *pTabCross,saveCross;
+  INDEX indexTabCross;
+  int n;
+
+  pJobContext=&pJob->context;
+  n=pFeno->NDET;
+
+  // Calibration window
+
+  for (indexTabCross=0;indexTabCross<pFeno->NTabCross;indexTabCross++)
+   {
+    pTabCross=&pFeno->TabCross[indexTabCross];
+    pJobCross=&pJob->feno.TabCross[indexTabCross];
+
+    memcpy(&saveCross,pTabCross,sizeof(CROSS_REFERENCE));
+    memcpy(pTabCross,pJobCross,sizeof(CROSS_REFERENCE));
+
+    pTabCross->vector=saveCross.vector;
+    pTabCross->Deriv2=saveCross.Deriv2;
+    pTabCross->vectorBackup=saveCross.vectorBackup;
+    pTabCross->Deriv2Backup=saveCross.Deriv2Backup;
+    pTabCross->molecularCrossSection=saveCross.molecularCrossSection;
+
+    if (pTabCross->vector!=NULL)
+     memcpy(pTabCross->vector,pJobCross->vector,sizeof(double)*n);
+    if (pTabCross->Deriv2!=NULL)
+     memcpy(pTabCross->Deriv2,pJobCross->Deriv2,sizeof(double)*n);
+   }
+
+  memcpy(pFeno->TabCrossResults,pJob->feno.TabCrossResults,sizeof(CROSS_RESULTS)*MAX_FIT);
+
+  pFeno->xmean=pJob->feno.xmean;
+  pFeno->ymean=pJob->feno.ymean;
+  pFeno->Decomp=pJob->feno.Decomp;
+
+  // Analysis context
+
+  pContext->Feno=pFeno;
+  pContext->specrange=pJobContext->specrange;
+  pContext->SvdPDeb=pJobContext->SvdPDeb;
+  pContext->SvdPFin=pJobContext->SvdPFin;
+  pContext->LimMin=pJobContext->LimMin;
+  pContext->LimMax=pJobContext->LimMax;
+  pContext->LimN=pJobContext->LimN;
+  pContext->nFree=pJobContext->nFree;
+  pContext->StretchFact1=pJobContext->StretchFact1;
+  pContext->StretchFact2=pJobContext->StretchFact2;
+  pContext->pKuruczFft=pJobContext->pKuruczFft;
+
+  memcpy(pContext->splineX,pJobContext->splineX,sizeof(double)*pContext->ndet);
+  memcpy(pContext->x,pJobContext->x,sizeof(double)*MAX_FIT);
+  memcpy(pContext->Sigma,pJobContext->Sigma,sizeof(double)*MAX_FIT);
+ }
+
+// KuruczNextJob : the next sub-window to fit (nJobs when all sub-windows have been dispatched)
+
+static int KuruczNextJob(KURUCZ_WINDOWS_POOL *pPool)
+ {
+  int indexJob;
+
+  pthread_mutex_lock(&pPool->lock);
+  indexJob=pPool->nextJob;
+  if (pPool->nextJob<pPool->nJobs)
+   pPool->nextJob++;
+  pthread_mutex_unlock(&pPool->lock);
+
+  return indexJob;
+ }
+
+// KuruczWindowsThread : fit sub-windows until all of them have been dispatched
+
+static void *KuruczWindowsThread(void *pArg)
+ {
+  KURUCZ_WINDOWS_POOL *pPool=(KURUCZ_WINDOWS_POOL *)pArg;
+  KURUCZ_WINDOW_JOB *pJob;
+  int indexJob;
+
+  while ((indexJob=KuruczNextJob(pPool))<pPool->nJobs)
+   {
+    pJob=&pPool->jobs[indexJob];
+    pJob->rc=KuruczFitWindow(pPool->pFit,&pJob->context,&pJob->feno,indexJob,pJob->offset,pJob->crossFits);
+
+    // The error stack belongs to this thread : move the errors to the job
+
+    while ((pJob->nErrors<KURUCZ_JOB_ERRORS) && ERROR_GetLast(&pJob->errors[pJob->nErrors]))
+     pJob->nErrors++;
+   }
+
+  return NULL;
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      KuruczFitWindows
+// -----------------------------------------------------------------------------
+// PURPOSE       Fit the sub-windows of the calibration interval with several threads,
+//               each one from the state of the calibration window before the first fit
+//
+// INPUT         pFit          the data common to all sub-windows;
+//               threadsNumber the maximum number of threads to use;
+//
+// INPUT/OUTPUT  pContext      working buffers of the calibration;
+//               pFeno         the calibration window
+//
+// RETURN        the return code of the fit of the last sub-window, or the first
+//               error in the order of the sub-windows
+// -----------------------------------------------------------------------------
+
+static RC KuruczFitWindows(const KURUCZ_WINDOWS_FIT *pFit,ANALYSE_CONTEXT *pContext,FENO *pFeno,int threadsNumber)
+ {
+  // Declarations
+
+  KURUCZ_WINDOWS_POOL pool;
+  KURUCZ_WINDOW_JOB *pJob;
+  KURUCZ *pKurucz;
+  pthread_t *threads;
+  int nCrossFits,nJobs,nThreads,indexJob,indexThread,indexError;
+  INDEX indexCrossFit,i;
+  RC rc;
+
+  // Initializations
+
+  pKurucz=pFit->pKurucz;
+  nJobs=pKurucz->Nb_Win;
+  nCrossFits=(pKurucz->crossFits.matrix!=NULL)?pKurucz->crossFits.nc:0;
+  threads=NULL;
+  rc=ERROR_ID_NO;
+
+  memset(&pool,0,sizeof(KURUCZ_WINDOWS_POOL));
+  pool.pFit=pFit;
+  pool.nJobs=nJobs;
+  pthread_mutex_init(&pool.lock,NULL);
+
+  if (((pool.jobs=(KURUCZ_WINDOW_JOB *)MEMORY_AllocBuffer(__func__,"jobs",nJobs,sizeof(KURUCZ_WINDOW_JOB),0,MEMORY_TYPE_STRUCT))==NULL) ||
+      ((threads=(pthread_t *)MEMORY_AllocBuffer(__func__,"threads",threadsNumber,sizeof(pthread_t),0,MEMORY_TYPE_STRUCT))==NULL))
+   {
+    rc=ERROR_ID_ALLOC;
+    goto EndFitWindows;
+   }
+
+  memset(pool.jobs,0,sizeof(KURUCZ_WINDOW_JOB)*nJobs);
+
+  for (indexJob=0;(indexJob<nJobs) && !rc;indexJob++)
+   rc=KuruczJobAlloc(&pool.jobs[indexJob],pContext,pFeno,pFit->n_wavel,nCrossFits);
+
+  if (rc)
+   goto EndFitWindows;
+
+  // Dispatch the sub-windows
+
+  for (nThreads=0;nThreads<min(threadsNumber,nJobs);nThreads++)
+   if (pthread_create(&threads[nThreads],NULL,KuruczWindowsThread,&pool))
+    break;
+
+  if (!nThreads)
+
+   // No thread available : fit the jobs in the calling thread (its errors stay on its own stack);
+   // stop at the first error as the results of the next sub-windows are not gathered
+
+   for (indexJob=0;indexJob<nJobs;indexJob++)
+    {
+     pJob=&pool.jobs[indexJob];
+
+     if ((pJob->rc=KuruczFitWindow(pFit,&pJob->context,&pJob->feno,indexJob,pJob->offset,pJob->crossFits))>0)
+      break;
+    }
+
+  for (indexThread=0;indexThread<nThreads;indexThread++)
+   pthread_join(threads[indexThread],NULL);
+
+  // Gather the results in the order of the sub-windows
+
+  for (indexJob=0;indexJob<nJobs;indexJob++)
+   {
+    pJob=&pool.jobs[indexJob];
+
+    for (indexError=pJob->nErrors-1;indexError>=0;indexError--)
+     ERROR_Push(&pJob->errors[indexError]);
+
+    if ((rc=pJob->rc)>0)
+     break;
+
+    for (i=pJob->context.SvdPDeb;i<=pJob->context.SvdPFin;i++)
+     {
+      pContext->absolu[i]=pJob->context.absolu[i];
+      pContext->secX[i]=pJob->context.secX[i];
+      pContext->t[i]=pJob->context.t[i];
+      pContext->tc[i]=pJob->context.tc[i];
+     }
+
+    if (pFit->displayFlag)
+     for (i=pJob->context.SvdPDeb;i<=pJob->context.SvdPFin;i++)
+      {
+       pKurucz->offset[i]=pJob->offset[i];
+
+       for (indexCrossFit=0;indexCrossFit<nCrossFits;indexCrossFit++)
+        pKurucz->crossFits.matrix[indexCrossFit][i]=pJob->crossFits[indexCrossFit][i];
+      }
+   }
+
+  if (indexJob==nJobs)
+   KuruczJobRestore(&pool.jobs[nJobs-1],pContext,pFeno);
+
+  // Release the jobs
+
+ EndFitWindows :
+
+  if (pool.jobs!=NULL)
+   {
+    for (indexJob=0;indexJob<nJobs;indexJob++)
+     KuruczJobFree(&pool.jobs[indexJob]);
+
+    MEMORY_ReleaseBuffer(__func__,"jobs",pool.jobs);
+   }
+
+  if (threads!=NULL)
+   MEMORY_ReleaseBuffer(__func__,"threads",threads);
+
+  pthread_mutex_destroy(&pool.lock);
+
+  return rc;
+ }
+
 // ----------------------------------------------------------------------------
 // FUNCTION        KURUCZ_Spectrum
 // ----------------------------------------------------------------------------
 // PURPOSE         apply Kurucz for building a new wavelength scale to a spectrum
 //
-// INPUT           oldLambda      old calibration associated to reference;
+// INPUT           pContext       working buffers and state of the fit;
+//                 oldLambda      old calibration associated to reference;
 //                 spectrum       spectrum to shift;
 //                 reference      reference spectrum;
 //                 instrFunction  instrumental function for correcting reference
@@ -1009,21 +1654,20 @@ INDEX KuruczSearchReference(INDEX indexRefFeno,INDEX indexRefColumn)
 // RETURN          return code
 // ----------------------------------------------------------------------------
 
-RC KURUCZ_Spectrum(const double *oldLambda,double *newLambda,double *spectrum,const double *reference,double *instrFunction,
+RC KURUCZ_Spectrum(ANALYSE_CONTEXT *pContext,const double *oldLambda,double *newLambda,double *spectrum,const double *reference,double *instrFunction,
                    char displayFlag, const char *windowTitle,double **coeff,double **fwhmVector,double **fwhmDeriv2,int saveFlag,INDEX indexFeno,void *responseHandle,INDEX indexFenoColumn)
 {
   // Declarations
 
   char            string[MAX_ITEM_TEXT_LEN];
+  FENO            *pFeno;                                                       // the calibration window
   CROSS_REFERENCE *TabCross,*pTabCross;
-  CROSS_RESULTS   *pResults,*Results;                                           // pointer to results associated to a symbol
+  KURUCZ_WINDOWS_FIT windowsFit;                                                // data common to the fits of the sub-windows
   double slitParam[NSFP],
     *shiftPoly,
-    *dispAbsolu,*dispSecX,
     **fwhm,**fwhmSigma,                                            // substitution vectors
     *solar,                                                       // solar spectrum
-    *offset,                                                      // offset
-    Square;                                                      // Chi square returned by 'CurFitMethod'
+    *offset;                                                      // offset
   int              Nb_Win,maxParam,pixMin,pixMax,                                             // number of little windows
                   *NIter;                                                       // number of iterations
   INDEX            indexWindow,                                                 // browse little windows
@@ -1031,8 +1675,8 @@ RC KURUCZ_Spectrum(const double *oldLambda,double *newLambda,double *spectrum,co
                    indexTabCross,
                    indexCrossFit,
                    indexLine,indexColumn,                                       // position in the spreadsheet for information to write
-                   i,j,k;                                                    // temporary indexes
-  double j0,lambda0,shiftSign;
+                   i,j;                                                      // temporary indexes
+  double shiftSign;
   RC               rc;                                                          // return code
   plot_data_t      *spectrumData;
   KURUCZ *pKurucz;
@@ -1055,6 +1699,8 @@ RC KURUCZ_Spectrum(const double *oldLambda,double *newLambda,double *spectrum,co
   slitParam[1]=pSlitOptions->slitFunction.slitParam2;
   slitParam[2]=pSlitOptions->slitFunction.slitParam3;
 
+  const double timingStart=TIMING_Start();
+
   pKurucz->KuruczFeno[indexFeno].have_calibration = true;
 
   // store calibration shift/stretch factors:
@@ -1071,15 +1717,12 @@ RC KURUCZ_Spectrum(const double *oldLambda,double *newLambda,double *spectrum,co
 
   // Use substitution variables
 
-  Feno=&TabFeno[indexFenoColumn][pKurucz->indexKurucz];
-  shiftSign=(Feno->indexSpectrum!=ITEM_NONE)?(double)-1.:(double)1.;            // very important !!!
-  TabCross=Feno->TabCross;
-
-  memcpy(Feno->LambdaK,oldLambda,sizeof(double)*oldNDET);
-  rc=ANALYSE_XsInterpolation(Feno,oldLambda,indexFenoColumn);
+  pContext->Feno=pFeno=&TabFeno[indexFenoColumn][pKurucz->indexKurucz];
+  shiftSign=(pFeno->indexSpectrum!=ITEM_NONE)?(double)-1.:(double)1.;            // very important !!!
+  TabCross=pFeno->TabCross;
 
-  Results=Feno->TabCrossResults;
-  pResults=&Feno->TabCrossResults[(Feno->indexSpectrum!=ITEM_NONE)?Feno->indexSpectrum:Feno->indexReference];
+  memcpy(pFeno->LambdaK,oldLambda,sizeof(double)*oldNDET);
+  rc=ANALYSE_XsInterpolation(pFeno,oldLambda,indexFenoColumn);
 
   double *VSig = pKurucz->VSig;
   double *Pcalib = pKurucz->Pcalib; // polynomial coefficients computation
@@ -1099,14 +1742,14 @@ RC KURUCZ_Spectrum(const double *oldLambda,double *newLambda,double *spectrum,co
   const int n_wavel = TabFeno[indexFenoColumn][indexFeno].NDET;
 
   for (maxParam=0;maxParam<MAX_KURUCZ_FWHM_PARAM;maxParam++)
-    if ((fwhmVector[maxParam]!=NULL) && (Feno->indexFwhmParam[maxParam]!=ITEM_NONE))
-      VECTOR_Init(fwhmVector[maxParam],TabCross[Feno->indexFwhmParam[maxParam]].InitParam,n_wavel);
+    if ((fwhmVector[maxParam]!=NULL) && (pFeno->indexFwhmParam[maxParam]!=ITEM_NONE))
+      VECTOR_Init(fwhmVector[maxParam],TabCross[pFeno->indexFwhmParam[maxParam]].InitParam,n_wavel);
     else
       break;
 
   // Instrumental correction
 
-  memcpy(ANALYSE_absolu,ANALYSE_zeros,sizeof(double)*n_wavel);
+  memcpy(pContext->absolu,ANALYSE_zeros,sizeof(double)*n_wavel);
   memcpy(offset,ANALYSE_zeros,sizeof(double)*n_wavel);
 
   if (instrFunction!=NULL)
@@ -1115,10 +1758,10 @@ RC KURUCZ_Spectrum(const double *oldLambda,double *newLambda,double *spectrum,co
 
   // Always restart from the original calibration
 
-  Lambda=newLambda;
-  LambdaSpec=newLambda;
-  memcpy(Lambda,oldLambda,sizeof(double)*n_wavel);
-  memcpy(ANALYSE_secX,spectrum,sizeof(double)*n_wavel);
+  pContext->Lambda=newLambda;
+  pContext->LambdaSpec=newLambda;
+  memcpy(pContext->Lambda,oldLambda,sizeof(double)*n_wavel);
+  memcpy(pContext->secX,spectrum,sizeof(double)*n_wavel);
 
   // Set solar spectrum
 
@@ -1135,7 +1778,7 @@ RC KURUCZ_Spectrum(const double *oldLambda,double *newLambda,double *spectrum,co
       // 20130208 : a high resolution spectrum is now loaded from the slit page of project properties and convolved
       rc=ANALYSE_ConvoluteXs(NULL,ANLYS_CROSS_ACTION_CONVOLUTE,(double)0.,&pKurucz->hrSolar,
                              ANALYSIS_slitMatrix,slitParam,pSlitOptions->slitFunction.slitType,
-                             oldLambda,solar,0,n_wavel,n_wavel,0,pSlitOptions->slitFunction.slitWveDptFlag);
+                             oldLambda,solar,0,n_wavel,n_wavel,0,pSlitOptions->slitFunction.slitWveDptFlag,&pKurucz->slitBank);
     }
   } else {
     memcpy(solar,reference,sizeof(double)*n_wavel);
@@ -1150,8 +1793,8 @@ RC KURUCZ_Spectrum(const double *oldLambda,double *newLambda,double *spectrum,co
     for (indexTabCross=0;indexTabCross<pKurucz->crossFits.nc;indexTabCross++)
       memcpy(pKurucz->crossFits.matrix[indexTabCross],ANALYSE_zeros,sizeof(double)*n_wavel);
 
-  memcpy(ANALYSE_t,ANALYSE_zeros,sizeof(double)*n_wavel);
-  memcpy(ANALYSE_tc,ANALYSE_zeros,sizeof(double)*n_wavel);
+  memcpy(pContext->t,ANALYSE_zeros,sizeof(double)*n_wavel);
+  memcpy(pContext->tc,ANALYSE_zeros,sizeof(double)*n_wavel);
 
   ANALYSE_plotKurucz=(pKurucz->displaySpectra || pKurucz->displayResidual || pKurucz->displayFit || pKurucz->displayShift)?1:0;
 
@@ -1181,10 +1824,10 @@ RC KURUCZ_Spectrum(const double *oldLambda,double *newLambda,double *spectrum,co
         mediateResponseCellDataString(plotPageCalib,indexLine,indexColumn++,string,responseHandle);
       }
 
-    if ((Feno->indexOffsetConst!=ITEM_NONE) && (Feno->TabCross[Feno->indexOffsetConst].FitParam!=ITEM_NONE))
+    if ((pFeno->indexOffsetConst!=ITEM_NONE) && (pFeno->TabCross[pFeno->indexOffsetConst].FitParam!=ITEM_NONE))
       mediateResponseCellDataString(plotPageCalib,indexLine,indexColumn++,"Offset",responseHandle);
 
-    for (indexTabCross=0;indexTabCross<Feno->NTabCross;indexTabCross++) {
+    for (indexTabCross=0;indexTabCross<pFeno->NTabCross;indexTabCross++) {
       pTabCross=&TabCross[indexTabCross];
 
       if (pTabCross->IndSvdA && (WorkSpace[pTabCross->Comp].type==WRK_SYMBOL_CROSS))
@@ -1194,152 +1837,34 @@ RC KURUCZ_Spectrum(const double *oldLambda,double *newLambda,double *spectrum,co
 
   // Browse little windows
 
-  for (indexWindow=0,Square=(double)0.;(indexWindow<Nb_Win) && (rc<THREAD_EVENT_STOP);indexWindow++) {
-    Feno->Decomp=1;
-    NIter[indexWindow]=0;
-
-    dispAbsolu=pKurucz->dispAbsolu[indexWindow];
-    dispSecX=pKurucz->dispSecX[indexWindow];
-
-    for (int i=0;i<n_wavel;i++)
-     dispAbsolu[i]=dispSecX[i]=(double)0.;
-
-    if (pKuruczOptions->fwhmFit)
-      pKURUCZ_fft=&pKurucz->KuruczFeno[indexFeno].fft[indexWindow];
-
-    // Global initializations
-
-#if defined(__DEBUG_) && __DEBUG_
-    // DEBUG_Start(ENGINE_dbgFile,"Kurucz",DEBUG_FCTTYPE_MATH|DEBUG_FCTTYPE_APPL,5,DEBUG_DVAR_YES,0); // !debugResetFlag++);
-#endif
-
-    if (((rc=ANALYSE_SvdInit(&TabFeno[indexFenoColumn][pKurucz->indexKurucz], &subwindow_fit[indexWindow], n_wavel, Lambda))!=ERROR_ID_NO) ||
-
-        // Analysis method
-
-        ((rc=ANALYSE_CurFitMethod(indexFenoColumn,                            // to change a little bit later for OMI
-                                  spectrum,                                   // spectrum
-                                  NULL,                                       // no error on previous spectrum
-                                  solar,                                      // reference (Kurucz)
-                                  n_wavel,
-                                  NULL,
-                                  &Square,                                     // returned stretch order 2
-                                  &NIter[indexWindow],
-                                  1.,1.,
-                                  &subwindow_fit[indexWindow]))>0))
-      break;
-
-#if defined(__DEBUG_) && __DEBUG_
-    // DEBUG_Stop("Kurucz");
-#endif
-
-
-    // Fill A SVD system
-
-    pixMid[indexWindow+1]=(double)( spectrum_start(subwindow_fit[indexWindow].specrange)
-                                    + spectrum_end(subwindow_fit[indexWindow].specrange) )*0.5;
-
-    VSig[indexWindow+1]=pResults->SigmaShift;
-
-    calib_shift[indexWindow] = pResults->Shift;
-    calib_stretch[indexWindow] = pResults->Stretch;
-    calib_stretch2[indexWindow] = pResults->Stretch2;
-
-    VShift[indexWindow+1]=pResults->Shift;                          // In order to be in accordance with the preshift, we keep the sign now.  Before (Feno->indexSpectrum!=ITEM_NONE)?(double)-pResults->Shift:(double)pResults->Shift;
-
-    // TODO:
-    //
-    //  - VLambda is used to fit FWHM as function of Lambda, but could be done as function of pixel, too?
-    VLambda[indexWindow+1]=(fabs(pixMid[indexWindow+1]-floor(pixMid[indexWindow+1]))<(double)0.1)?
-      (double)oldLambda[(INDEX)pixMid[indexWindow+1]]-shiftSign*VShift[indexWindow+1]:
-      (double)0.5*(oldLambda[(INDEX)floor(pixMid[indexWindow+1])]+oldLambda[(INDEX)floor(pixMid[indexWindow+1]+1.)])-shiftSign*VShift[indexWindow+1];
-
-    // Store fwhm for future use
-
-    if (pKuruczOptions->fwhmFit)
-      for (indexParam=0;indexParam<maxParam;indexParam++) {
-        if ((indexParam==1) && (pKuruczOptions->fwhmType==SLIT_TYPE_AGAUSS))
-          fwhm[indexParam][indexWindow]=Feno->TabCrossResults[Feno->indexFwhmParam[indexParam]].Param;  // asymmetric factor can be negatif for asymmetric gaussian
-        else
-          fwhm[indexParam][indexWindow]=fabs(Feno->TabCrossResults[Feno->indexFwhmParam[indexParam]].Param);
-
-        fwhmSigma[indexParam][indexWindow]=Feno->TabCrossResults[Feno->indexFwhmParam[indexParam]].SigmaParam;
-      }
-
-    // Store fit for display
-
-    if (displayFlag) {
-      if (pKurucz->method==OPTICAL_DENSITY_FIT)
-       {
-        for (i=SvdPDeb;i<=SvdPFin;i++)
-         {
-          dispAbsolu[i]=ANALYSE_absolu[i];
-          dispSecX[i]=ANALYSE_secX[i]=exp(log(spectrum[i])+ANALYSE_absolu[i]);
-         }
-       }
-      else
-       {
-       	for (i=SvdPDeb;i<=SvdPFin;i++)
-       	 {
-          dispAbsolu[i]=ANALYSE_absolu[i]=(ANALYSE_tc[i]!=(double)0.)?ANALYSE_absolu[i]/ANALYSE_tc[i]:(double)0.;
-          dispSecX[i]=ANALYSE_secX[i]=exp(log(spectrum[i])+ANALYSE_absolu[i]/ANALYSE_tc[i]); // spectrum[i]+solar[i]*ANALYSE_absolu[i]/ANALYSE_tc[i];
-         }
-       }
-
-      j0=(double)(SvdPDeb+SvdPFin)*0.5;
-      lambda0=(fabs(j0-floor(j0))<(double)0.1)?
-        (double)ANALYSE_splineX[(INDEX)j0]:
-        (double)0.5*(ANALYSE_splineX[(INDEX)floor(j0)]+ANALYSE_splineX[(INDEX)floor(j0+1.)]);
-
-      if ((Feno->indexOffsetConst!=ITEM_NONE) &&
-          (Feno->indexOffsetOrder1!=ITEM_NONE) &&
-          (Feno->indexOffsetOrder2!=ITEM_NONE) &&
-
-          ((TabCross[Feno->indexOffsetConst].FitParam!=ITEM_NONE) ||
-           (TabCross[Feno->indexOffsetOrder1].FitParam!=ITEM_NONE) ||
-           (TabCross[Feno->indexOffsetOrder2].FitParam!=ITEM_NONE) ||
-           (TabCross[Feno->indexOffsetConst].InitParam!=(double)0.) ||
-           (TabCross[Feno->indexOffsetOrder1].InitParam!=(double)0.) ||
-           (TabCross[Feno->indexOffsetOrder2].InitParam!=(double)0.)))
-
-        for (i=SvdPDeb;i<=SvdPFin;i++) {
-          offset[i]=(double)1.-Feno->xmean*(Results[Feno->indexOffsetConst].Param+
-                                            Results[Feno->indexOffsetOrder1].Param*(ANALYSE_splineX[i]-lambda0)+
-                                            Results[Feno->indexOffsetOrder2].Param*(ANALYSE_splineX[i]-lambda0)*(ANALYSE_splineX[i]-lambda0))/spectrum[i];
-          offset[i]=(offset[i]>(double)0.)?log(offset[i]):(double)0.;
-        }
-
-      if (pKurucz->crossFits.matrix!=NULL)
-
-        for (indexTabCross=indexCrossFit=0;(indexTabCross<Feno->NTabCross) && (indexCrossFit<pKurucz->crossFits.nc);indexTabCross++) {
-          pTabCross=&TabCross[indexTabCross];
-
-          if (pTabCross->IndSvdA && (WorkSpace[pTabCross->Comp].type==WRK_SYMBOL_CROSS) && pTabCross->display) {
-            for (i=SvdPDeb,k=1;i<=SvdPFin;i++,k++)
-              pKurucz->crossFits.matrix[indexCrossFit][i]=x[pTabCross->IndSvdA]*subwindow_fit[indexWindow].A[pTabCross->IndSvdA][k];
-
-            indexCrossFit++;
-          }
-        }
-    }
-
-    // Results safe keeping
-
-    memcpy(pKurucz->KuruczFeno[indexFeno].results[indexWindow],Feno->TabCrossResults,sizeof(CROSS_RESULTS)*Feno->NTabCross);
-
-    pKurucz->KuruczFeno[indexFeno].wve[indexWindow]=VLambda[indexWindow+1];
-    pKurucz->KuruczFeno[indexFeno].chiSquare[indexWindow]=Square;
-    pKurucz->KuruczFeno[indexFeno].rms[indexWindow]=(Square>(double)0.)?sqrt(Square):(double)0.;
-    pKurucz->KuruczFeno[indexFeno].nIter[indexWindow]=NIter[indexWindow];
+  windowsFit.pKurucz=pKurucz;
+  windowsFit.indexFeno=indexFeno;
+  windowsFit.indexFenoColumn=indexFenoColumn;
+  windowsFit.n_wavel=n_wavel;
+  windowsFit.maxParam=maxParam;
+  windowsFit.displayFlag=displayFlag;
+  windowsFit.shiftSign=shiftSign;
+  windowsFit.oldLambda=oldLambda;
+  windowsFit.spectrum=spectrum;
+  windowsFit.solar=solar;
+  windowsFit.calib_shift=calib_shift;
+  windowsFit.calib_stretch=calib_stretch;
+  windowsFit.calib_stretch2=calib_stretch2;
+
+  if ((kuruczThreadsNumber>1) && (Nb_Win>1))
+   rc=KuruczFitWindows(&windowsFit,pContext,pFeno,kuruczThreadsNumber);
+  else
+   for (indexWindow=0;(indexWindow<Nb_Win) && (rc<THREAD_EVENT_STOP);indexWindow++)
+    if ((rc=KuruczFitWindow(&windowsFit,pContext,pFeno,indexWindow,offset,pKurucz->crossFits.matrix))>0)
+     break;
 
-    pKurucz->KuruczFeno[indexFeno].rc=rc;
-  }  // End for (indexWindow=...
+  pKurucz->KuruczFeno[indexFeno].rc=rc;                                          // set after the join, in the order of the sub-windows
 
   if (rc)
     goto EndKuruczSpectrum;
 
-  SvdPDeb=spectrum_start(subwindow_fit[0].specrange);
-  SvdPFin=spectrum_end(subwindow_fit[Nb_Win-1].specrange);
+  pContext->SvdPDeb=spectrum_start(subwindow_fit[0].specrange);
+  pContext->SvdPFin=spectrum_end(subwindow_fit[Nb_Win-1].specrange);
 
   // New wavelength scale (corrected calibration)
   // NB : we fit a polynomial in Lambda+shift point but it's possible to fit a polynomial in shift points by replacing
@@ -1350,7 +1875,7 @@ RC KURUCZ_Spectrum(const double *oldLambda,double *newLambda,double *spectrum,co
 
   if (pKuruczOptions->fwhmFit) {
     for (indexParam=0;indexParam<maxParam;indexParam++)
-      if (TabCross[Feno->indexFwhmParam[indexParam]].FitParam!=ITEM_NONE) {
+      if (TabCross[pFeno->indexFwhmParam[indexParam]].FitParam!=ITEM_NONE) {
         memcpy(coeff[indexParam],ANALYSE_zeros,sizeof(double)*(pKurucz->fwhmDegree+1));
         memcpy(fwhmVector[indexParam],ANALYSE_zeros,sizeof(double)*n_wavel);
 
@@ -1368,18 +1893,18 @@ RC KURUCZ_Spectrum(const double *oldLambda,double *newLambda,double *spectrum,co
       for (j=pKurucz->shiftDegree;j>=1;j--) {
         shiftPoly[i]=shiftPoly[i]*(double)i+Pcalib[j];
       }
-      Lambda[i]=oldLambda[i]-shiftSign*shiftPoly[i];
+      pContext->Lambda[i]=oldLambda[i]-shiftSign*shiftPoly[i];
     }
   } else {
     // if Nb_Win == 1, use fitted shift/stretch from calibration procedure to create corrected lambda grid:
 
-    int i_center = floor(0.5*(SvdPDeb + SvdPFin));
+    int i_center = floor(0.5*(pContext->SvdPDeb + pContext->SvdPFin));
     double lambda0 = 0.5*(oldLambda[i_center] + oldLambda[1+i_center]);
 
     for (int i=0; i<n_wavel; ++i) {
       const double x0 = oldLambda[i] - lambda0;
       shiftPoly[i] = calib_shift[0] + calib_stretch[0]*x0 + calib_stretch2[0]*x0*x0;
-      Lambda[i] = oldLambda[i] - shiftSign*shiftPoly[i];
+      pContext->Lambda[i] = oldLambda[i] - shiftSign*shiftPoly[i];
     }
   }
 
@@ -1394,8 +1919,8 @@ RC KURUCZ_Spectrum(const double *oldLambda,double *newLambda,double *spectrum,co
 
      if (pKuruczOptions->divisionMode==PRJCT_CALIB_WINDOWS_CONTIGUOUS)
       {
-       mediateAllocateAndSetPlotData(&spectrumData[0],"Spectrum",&Lambda[0],&spectrum[0],n_wavel,Line);
-       mediateAllocateAndSetPlotData(&spectrumData[1],"Adjusted Kurucz",&Lambda[0],&ANALYSE_secX[0],n_wavel,Line);
+       mediateAllocateAndSetPlotData(&spectrumData[0],"Spectrum",&pContext->Lambda[0],&spectrum[0],n_wavel,Line);
+       mediateAllocateAndSetPlotData(&spectrumData[1],"Adjusted Kurucz",&pContext->Lambda[0],&pContext->secX[0],n_wavel,Line);
 
        mediateResponsePlotData(plotPageCalib,spectrumData,2,Spectrum,forceAutoScale,string,"Wavelength (nm)","Intensity", responseHandle);
        mediateReleasePlotData(&spectrumData[0]);
@@ -1408,8 +1933,8 @@ RC KURUCZ_Spectrum(const double *oldLambda,double *newLambda,double *spectrum,co
          pixMin=spectrum_start(subwindow_fit[indexWindow].specrange);
          pixMax=spectrum_end(subwindow_fit[indexWindow].specrange);
 
-         mediateAllocateAndSetNumberedPlotData(&spectrumData[(indexWindow<<1)],"Spectrum",&Lambda[pixMin],&spectrum[pixMin],pixMax-pixMin+1,(indexWindow%2)?DashLine:Line,0);
-         mediateAllocateAndSetNumberedPlotData(&spectrumData[(indexWindow<<1)+1],"Adjusted Kurucz",&Lambda[pixMin],&pKurucz->dispSecX[indexWindow][pixMin],pixMax-pixMin+1,(indexWindow%2)?DashLine:Line,1);
+         mediateAllocateAndSetNumberedPlotData(&spectrumData[(indexWindow<<1)],"Spectrum",&pContext->Lambda[pixMin],&spectrum[pixMin],pixMax-pixMin+1,(indexWindow%2)?DashLine:Line,0);
+         mediateAllocateAndSetNumberedPlotData(&spectrumData[(indexWindow<<1)+1],"Adjusted Kurucz",&pContext->Lambda[pixMin],&pKurucz->dispSecX[indexWindow][pixMin],pixMax-pixMin+1,(indexWindow%2)?DashLine:Line,1);
         }
        mediateResponsePlotData(plotPageCalib,spectrumData,Nb_Win*2,Spectrum,forceAutoScale,string,"Wavelength (nm)","Intensity", responseHandle);
 
@@ -1432,7 +1957,7 @@ RC KURUCZ_Spectrum(const double *oldLambda,double *newLambda,double *spectrum,co
 
       if (pKuruczOptions->divisionMode==PRJCT_CALIB_WINDOWS_CONTIGUOUS)
        {
-        mediateAllocateAndSetPlotData(&spectrumData[0],"Residual",&Lambda[0],&ANALYSE_absolu[0],n_wavel,Line);
+        mediateAllocateAndSetPlotData(&spectrumData[0],"Residual",&pContext->Lambda[0],&pContext->absolu[0],n_wavel,Line);
         mediateResponsePlotData(plotPageCalib,spectrumData,1,Spectrum,forceAutoScale,string,"Wavelength (nm)","", responseHandle);
         mediateReleasePlotData(&spectrumData[0]);
        }
@@ -1443,7 +1968,7 @@ RC KURUCZ_Spectrum(const double *oldLambda,double *newLambda,double *spectrum,co
          	pixMin=spectrum_start(subwindow_fit[indexWindow].specrange);
           pixMax=spectrum_end(subwindow_fit[indexWindow].specrange);
 
-          mediateAllocateAndSetNumberedPlotData(&spectrumData[indexWindow],"Residual",&Lambda[pixMin],&pKurucz->dispAbsolu[indexWindow][pixMin],pixMax-pixMin+1,(indexWindow%2)?DashLine:Line,0);
+          mediateAllocateAndSetNumberedPlotData(&spectrumData[indexWindow],"Residual",&pContext->Lambda[pixMin],&pKurucz->dispAbsolu[indexWindow][pixMin],pixMax-pixMin+1,(indexWindow%2)?DashLine:Line,0);
          }
 
         mediateResponsePlotData(plotPageCalib,spectrumData,Nb_Win,Spectrum,forceAutoScale,string,"Wavelength (nm)","", responseHandle);
@@ -1453,21 +1978,21 @@ RC KURUCZ_Spectrum(const double *oldLambda,double *newLambda,double *spectrum,co
        }
     }
 
-    memcpy(ANALYSE_secX,ANALYSE_zeros,sizeof(double)*n_wavel);
+    memcpy(pContext->secX,ANALYSE_zeros,sizeof(double)*n_wavel);
 
     // Display Offset
 
     if  (// Feno->displayOffset &&
-         (Feno->indexOffsetConst!=ITEM_NONE) &&
-         (Feno->indexOffsetOrder1!=ITEM_NONE) &&
-         (Feno->indexOffsetOrder2!=ITEM_NONE) &&
+         (pFeno->indexOffsetConst!=ITEM_NONE) &&
+         (pFeno->indexOffsetOrder1!=ITEM_NONE) &&
+         (pFeno->indexOffsetOrder2!=ITEM_NONE) &&
 
-         ((TabCross[Feno->indexOffsetConst].FitParam!=ITEM_NONE) ||
-          (TabCross[Feno->indexOffsetOrder1].FitParam!=ITEM_NONE) ||
-          (TabCross[Feno->indexOffsetOrder2].FitParam!=ITEM_NONE) ||
-          (TabCross[Feno->indexOffsetConst].InitParam!=(double)0.) ||
-          (TabCross[Feno->indexOffsetOrder1].InitParam!=(double)0.) ||
-          (TabCross[Feno->indexOffsetOrder2].InitParam!=(double)0.))) {
+         ((TabCross[pFeno->indexOffsetConst].FitParam!=ITEM_NONE) ||
+          (TabCross[pFeno->indexOffsetOrder1].FitParam!=ITEM_NONE) ||
+          (TabCross[pFeno->indexOffsetOrder2].FitParam!=ITEM_NONE) ||
+          (TabCross[pFeno->indexOffsetConst].InitParam!=(double)0.) ||
+          (TabCross[pFeno->indexOffsetOrder1].InitParam!=(double)0.) ||
+          (TabCross[pFeno->indexOffsetOrder2].InitParam!=(double)0.))) {
 
       if (pKurucz->displayFit) {
         if (ANALYSE_swathSize==1)
@@ -1477,14 +2002,14 @@ RC KURUCZ_Spectrum(const double *oldLambda,double *newLambda,double *spectrum,co
 
         if (pKuruczOptions->divisionMode==PRJCT_CALIB_WINDOWS_CONTIGUOUS)
          {
-          for (j=SvdPDeb;j<=SvdPFin;j++) // !!!!!!!!!!!!!!!!!!! to test
+          for (j=pContext->SvdPDeb;j<=pContext->SvdPFin;j++) // !!!!!!!!!!!!!!!!!!! to test
            {
-            ANALYSE_absolu[j]+=offset[j]-ANALYSE_secX[j];
-            ANALYSE_secX[j]=offset[j];
+            pContext->absolu[j]+=offset[j]-pContext->secX[j];
+            pContext->secX[j]=offset[j];
            }
 
-          mediateAllocateAndSetPlotData(&spectrumData[0],"Measured",&Lambda[0],&ANALYSE_absolu[0],n_wavel,Line);
-          mediateAllocateAndSetPlotData(&spectrumData[1],"Calculated",&Lambda[0],&ANALYSE_secX[0],n_wavel,Line);
+          mediateAllocateAndSetPlotData(&spectrumData[0],"Measured",&pContext->Lambda[0],&pContext->absolu[0],n_wavel,Line);
+          mediateAllocateAndSetPlotData(&spectrumData[1],"Calculated",&pContext->Lambda[0],&pContext->secX[0],n_wavel,Line);
           mediateResponsePlotData(plotPageCalib,spectrumData,2,Spectrum,forceAutoScale,string,"Wavelength (nm)","",responseHandle);
           mediateReleasePlotData(&spectrumData[1]);
           mediateReleasePlotData(&spectrumData[0]);
@@ -1502,8 +2027,8 @@ RC KURUCZ_Spectrum(const double *oldLambda,double *newLambda,double *spectrum,co
               pKurucz->dispSecX[indexWindow][j]=offset[j];
              }
 
-            mediateAllocateAndSetNumberedPlotData(&spectrumData[(indexWindow<<1)],"Measured",&Lambda[pixMin],&pKurucz->dispAbsolu[indexWindow][pixMin],pixMax-pixMin+1,(indexWindow%2)?DashLine:Line,0);
-            mediateAllocateAndSetNumberedPlotData(&spectrumData[(indexWindow<<1)+1],"Calculated",&Lambda[pixMin],&pKurucz->dispSecX[indexWindow][pixMin],pixMax-pixMin+1,(indexWindow%2)?DashLine:Line,0);
+            mediateAllocateAndSetNumberedPlotData(&spectrumData[(indexWindow<<1)],"Measured",&pContext->Lambda[pixMin],&pKurucz->dispAbsolu[indexWindow][pixMin],pixMax-pixMin+1,(indexWindow%2)?DashLine:Line,0);
+            mediateAllocateAndSetNumberedPlotData(&spectrumData[(indexWindow<<1)+1],"Calculated",&pContext->Lambda[pixMin],&pKurucz->dispSecX[indexWindow][pixMin],pixMax-pixMin+1,(indexWindow%2)?DashLine:Line,0);
            }
 
           mediateResponsePlotData(plotPageCalib,spectrumData,Nb_Win,Spectrum,forceAutoScale,string,"Wavelength (nm)","", responseHandle);
@@ -1520,7 +2045,7 @@ RC KURUCZ_Spectrum(const double *oldLambda,double *newLambda,double *spectrum,co
     // Display subwindow_fits
 
     if (pKurucz->crossFits.matrix!=NULL) {
-      for (indexTabCross=indexCrossFit=0;(indexTabCross<Feno->NTabCross) && (indexCrossFit<pKurucz->crossFits.nc);indexTabCross++) {
+      for (indexTabCross=indexCrossFit=0;(indexTabCross<pFeno->NTabCross) && (indexCrossFit<pKurucz->crossFits.nc);indexTabCross++) {
         pTabCross=&TabCross[indexTabCross];
 
         if (pTabCross->IndSvdA && (WorkSpace[pTabCross->Comp].type==WRK_SYMBOL_CROSS) && pTabCross->display) {
@@ -1532,13 +2057,13 @@ RC KURUCZ_Spectrum(const double *oldLambda,double *newLambda,double *spectrum,co
 
           if (pKuruczOptions->divisionMode==PRJCT_CALIB_WINDOWS_CONTIGUOUS)
            {
-            for (j=SvdPDeb;j<=SvdPFin;j++) {
-              ANALYSE_absolu[j]+=pKurucz->crossFits.matrix[indexCrossFit][j]-ANALYSE_secX[j];
-              ANALYSE_secX[j]=pKurucz->crossFits.matrix[indexCrossFit][j];
+            for (j=pContext->SvdPDeb;j<=pContext->SvdPFin;j++) {
+              pContext->absolu[j]+=pKurucz->crossFits.matrix[indexCrossFit][j]-pContext->secX[j];
+              pContext->secX[j]=pKurucz->crossFits.matrix[indexCrossFit][j];
             }
 
-             mediateAllocateAndSetPlotData(&spectrumData[0],"Measured",&Lambda[0],&ANALYSE_absolu[0],n_wavel,Line);
-             mediateAllocateAndSetPlotData(&spectrumData[1],"Calculated",&Lambda[0],&ANALYSE_secX[0],n_wavel,Line);
+             mediateAllocateAndSetPlotData(&spectrumData[0],"Measured",&pContext->Lambda[0],&pContext->absolu[0],n_wavel,Line);
+             mediateAllocateAndSetPlotData(&spectrumData[1],"Calculated",&pContext->Lambda[0],&pContext->secX[0],n_wavel,Line);
              mediateResponsePlotData(plotPageCalib,spectrumData,2,Spectrum,forceAutoScale,string,"Wavelength (nm)","", responseHandle);
              mediateReleasePlotData(&spectrumData[1]);
              mediateReleasePlotData(&spectrumData[0]);
@@ -1557,8 +2082,8 @@ RC KURUCZ_Spectrum(const double *oldLambda,double *newLambda,double *spectrum,co
                 pKurucz->dispSecX[indexWindow][j]=pKurucz->crossFits.matrix[indexCrossFit][j];
                }
 
-              mediateAllocateAndSetNumberedPlotData(&spectrumData[(indexWindow<<1)],"Measured",&Lambda[pixMin],&pKurucz->dispAbsolu[indexWindow][pixMin],pixMax-pixMin+1,(indexWindow%2)?DashLine:Line,0);
-              mediateAllocateAndSetNumberedPlotData(&spectrumData[(indexWindow<<1)+1],"Calculated",&Lambda[pixMin],&pKurucz->dispSecX[indexWindow][pixMin],pixMax-pixMin+1,(indexWindow%2)?DashLine:Line,1);
+              mediateAllocateAndSetNumberedPlotData(&spectrumData[(indexWindow<<1)],"Measured",&pContext->Lambda[pixMin],&pKurucz->dispAbsolu[indexWindow][pixMin],pixMax-pixMin+1,(indexWindow%2)?DashLine:Line,0);
+              mediateAllocateAndSetNumberedPlotData(&spectrumData[(indexWindow<<1)+1],"Calculated",&pContext->Lambda[pixMin],&pKurucz->dispSecX[indexWindow][pixMin],pixMax-pixMin+1,(indexWindow%2)?DashLine:Line,1);
              }
 
             mediateResponsePlotData(plotPageCalib,spectrumData,Nb_Win,Spectrum,forceAutoScale,string,"Wavelength (nm)","", responseHandle);
@@ -1583,7 +2108,7 @@ RC KURUCZ_Spectrum(const double *oldLambda,double *newLambda,double *spectrum,co
       else
         sprintf(string,"Shift (%d/%d)",indexFenoColumn+1,ANALYSE_swathSize);
 
-      mediateAllocateAndSetPlotData(&spectrumData[0],"Polynomial fitting individual shift points",&Lambda[0],&shiftPoly[0],n_wavel,Line);
+      mediateAllocateAndSetPlotData(&spectrumData[0],"Polynomial fitting individual shift points",&pContext->Lambda[0],&shiftPoly[0],n_wavel,Line);
       mediateAllocateAndSetPlotData(&spectrumData[1],"Shift calculated in the individual small windows",VLambda+1,VShift+1,Nb_Win,Point);
       mediateResponsePlotData(plotPageCalib,spectrumData,2,Spectrum,forceAutoScale,string,"Wavelength (nm)","Shift (nm)", responseHandle);
       mediateReleasePlotData(&spectrumData[1]);
@@ -1599,19 +2124,19 @@ RC KURUCZ_Spectrum(const double *oldLambda,double *newLambda,double *spectrum,co
         else
           sprintf(string,"SFP %d (%d/%d)",indexParam+1,indexFenoColumn+1,ANALYSE_swathSize);
 
-        if (TabCross[Feno->indexFwhmParam[indexParam]].FitParam!=ITEM_NONE) {
+        if (TabCross[pFeno->indexFwhmParam[indexParam]].FitParam!=ITEM_NONE) {
           for (i=0;i<n_wavel;i++) {
             fwhmVector[indexParam][i]=(double)coeff[indexParam][pKurucz->fwhmDegree];
             for (j=pKurucz->fwhmDegree-1;j>=0;j--)
-              fwhmVector[indexParam][i]=fwhmVector[indexParam][i]*(double)Lambda[i]+coeff[indexParam][j];
+              fwhmVector[indexParam][i]=fwhmVector[indexParam][i]*(double)pContext->Lambda[i]+coeff[indexParam][j];
           }
 
-          if ((rc=SPLINE_Deriv2(Lambda,fwhmVector[indexParam],fwhmDeriv2[indexParam],n_wavel,__func__))!=0)
+          if ((rc=SPLINE_Deriv2(pContext->Lambda,fwhmVector[indexParam],fwhmDeriv2[indexParam],n_wavel,__func__))!=0)
             goto EndKuruczSpectrum;
         }
 
         if (pKurucz->displayShift) {
-          mediateAllocateAndSetPlotData(&spectrumData[0],"Polynomial fitting individual FWHM points",&Lambda[0],&fwhmVector[indexParam][0],n_wavel,Line);
+          mediateAllocateAndSetPlotData(&spectrumData[0],"Polynomial fitting individual FWHM points",&pContext->Lambda[0],&fwhmVector[indexParam][0],n_wavel,Line);
           mediateAllocateAndSetPlotData(&spectrumData[1],"FWHM calculated in the individual small windows",VLambda+1,fwhm[indexParam],Nb_Win,Point);
           mediateResponsePlotData(plotPageCalib,spectrumData,2,Spectrum,forceAutoScale,string,"Wavelength (nm)","SFP (nm)", responseHandle);
           mediateReleasePlotData(&spectrumData[1]);
@@ -1634,10 +2159,10 @@ RC KURUCZ_Spectrum(const double *oldLambda,double *newLambda,double *spectrum,co
       for (indexParam=0;indexParam<maxParam;indexParam++)
         mediateResponseCellInfoNoLabel(plotPageCalib,indexLine,indexColumn++,responseHandle,"%10.3e+/-%10.3e",fwhm[indexParam][indexWindow],fwhmSigma[indexParam][indexWindow]);
 
-      if ((Feno->indexOffsetConst!=ITEM_NONE) && (Feno->TabCross[Feno->indexOffsetConst].FitParam!=ITEM_NONE))
-        mediateResponseCellInfoNoLabel(plotPageCalib,indexLine,indexColumn++,responseHandle,"%10.3e+/-%10.3e",Feno->TabCrossResults[Feno->indexOffsetConst].Param,Feno->TabCrossResults[Feno->indexOffsetConst].SigmaParam);
+      if ((pFeno->indexOffsetConst!=ITEM_NONE) && (pFeno->TabCross[pFeno->indexOffsetConst].FitParam!=ITEM_NONE))
+        mediateResponseCellInfoNoLabel(plotPageCalib,indexLine,indexColumn++,responseHandle,"%10.3e+/-%10.3e",pFeno->TabCrossResults[pFeno->indexOffsetConst].Param,pFeno->TabCrossResults[pFeno->indexOffsetConst].SigmaParam);
 
-      for (indexTabCross=0;indexTabCross<Feno->NTabCross;indexTabCross++) {
+      for (indexTabCross=0;indexTabCross<pFeno->NTabCross;indexTabCross++) {
         pTabCross=&TabCross[indexTabCross];
 
         if (pTabCross->IndSvdA && (WorkSpace[pTabCross->Comp].type==WRK_SYMBOL_CROSS))
@@ -1665,6 +2190,8 @@ RC KURUCZ_Spectrum(const double *oldLambda,double *newLambda,double *spectrum,co
 
   NDET[indexFenoColumn]=oldNDET;
 
+  TIMING_Stop(TIMING_STAGE_KURUCZ,timingStart);
+
 #if defined(__DEBUG_) && __DEBUG_
   DEBUG_FunctionStop((char *)__func__,rc);
 #endif
@@ -1942,11 +2469,11 @@ RC KURUCZ_Reference(double *instrFunction,INDEX refFlag,int saveFlag,int gomeFla
 
             if (!rc &&
                 !(rc=KuruczCalculatePreshift(calibratedMatrix.matrix[0],calibratedMatrix.matrix[1],reference,pTabFeno->NDET,pKuruczOptions->preshiftMin,pKuruczOptions->preshiftMax,0.2,(double)pKuruczOptions->lambdaLeft,(double)pKuruczOptions->lambdaRight,&pTabFeno->preshift))) {
-              if ((pKuruczFeno->indexSpectrum!=ITEM_NONE) && (TabCross[Feno->indexSpectrum].FitShift!=ITEM_NONE))
-                TabCross[Feno->indexSpectrum].InitShift=pTabFeno->preshift;
-              if ((pKuruczFeno->indexReference!=ITEM_NONE) && (TabCross[Feno->indexReference].FitShift!=ITEM_NONE)) {
+              if ((pKuruczFeno->indexSpectrum!=ITEM_NONE) && (TabCross[pKuruczFeno->indexSpectrum].FitShift!=ITEM_NONE))
+                TabCross[pKuruczFeno->indexSpectrum].InitShift=pTabFeno->preshift;
+              if ((pKuruczFeno->indexReference!=ITEM_NONE) && (TabCross[pKuruczFeno->indexReference].FitShift!=ITEM_NONE)) {
                 pTabFeno->preshift=-pTabFeno->preshift;
-                TabCross[Feno->indexReference].InitShift=pTabFeno->preshift;
+                TabCross[pKuruczFeno->indexReference].InitShift=pTabFeno->preshift;
               }
             }
 
@@ -1954,7 +2481,7 @@ RC KURUCZ_Reference(double *instrFunction,INDEX refFlag,int saveFlag,int gomeFla
           }
 
           // Apply Kurucz for building new calibration for reference
-          if ((rc=pTabFeno->rcKurucz=KURUCZ_Spectrum(pTabFeno->LambdaRef,pTabFeno->LambdaK,reference,pKurucz->solar,instrFunction,
+          if ((rc=pTabFeno->rcKurucz=KURUCZ_Spectrum(&ANALYSE_context,pTabFeno->LambdaRef,pTabFeno->LambdaK,reference,pKurucz->solar,instrFunction,
                                                      1,pTabFeno->windowName,pTabFeno->fwhmPolyRef,pTabFeno->fwhmVector,pTabFeno->fwhmDeriv2,saveFlag,indexFeno,responseHandle,indexFenoColumn))!=ERROR_ID_NO)
 
             goto EndKuruczReference;
@@ -2111,6 +2638,7 @@ RC KURUCZ_Alloc(const PROJECT *pProject, const double *lambda,INDEX indexKurucz,
 
   memset(&pKurucz->hrSolar,0,sizeof(MATRIX_OBJECT));
   memset(&pKurucz->slitFunction,0,sizeof(MATRIX_OBJECT));
+  pKurucz->hrSolarShared=pKurucz->slitFunctionShared=false;
 
   FENO *pKuruczFeno=&TabFeno[indexFenoColumn][indexKurucz]; // analysis window with Kurucz description
 
@@ -2145,9 +2673,14 @@ RC KURUCZ_Alloc(const PROJECT *pProject, const double *lambda,INDEX indexKurucz,
 
       if (!strlen(slitFile))
        rc=ERROR_SetLast(__func__,ERROR_TYPE_FATAL,ERROR_ID_MSGBOX_FIELDEMPTY,"Slit File");
-      else
-       rc=MATRIX_Load(slitFile,&pKurucz->slitFunction,0,0,
-                     -9999.,9999.,1,0,__func__);
+      else if (kuruczSlitRow!=ITEM_NONE)
+       {
+        pKurucz->slitFunction=KURUCZ_buffers[kuruczSlitRow].slitFunction;       // same file for all rows
+        pKurucz->slitFunctionShared=true;
+       }
+      else if (!(rc=MATRIX_Load(slitFile,&pKurucz->slitFunction,0,0,
+                     -9999.,9999.,1,0,__func__)))
+       kuruczSlitRow=indexFenoColumn;
      }
 
     if (rc!=ERROR_ID_NO)
@@ -2240,17 +2773,28 @@ RC KURUCZ_Alloc(const PROJECT *pProject, const double *lambda,INDEX indexKurucz,
 
   // Load and normalize solar spectrum
 
-  // allocate matrix for pKurucz->hrSolar: (number of wavelengths)x(2)
-  rc = MATRIX_Allocate(&pKurucz->hrSolar, hr_solar->nl, 2, 0, 0, 1, __func__);
-  if( !rc) {
-    // copy wavelengths and one spectrum column from pre-loaded hr_solar into pKurucz->hrSolar
-    int index_row = (hr_solar->nc > 1+indexFenoColumn) ? 1+indexFenoColumn:1;
-    memcpy(pKurucz->hrSolar.matrix[0], hr_solar->matrix[0], hr_solar->nl * sizeof(hr_solar->matrix[0][0]));
-    memcpy(pKurucz->hrSolar.matrix[1], hr_solar->matrix[index_row], hr_solar->nl * sizeof(hr_solar->matrix[0][0]));
+  const int index_row = (hr_solar->nc > 1+indexFenoColumn) ? 1+indexFenoColumn:1;
+  const double solarRange[2] = { lambdaMin-7.-step*pKurucz->solarFGap, lambdaMax+7.+step*pKurucz->solarFGap };
 
-    rc=XSCONV_ConvertCrossSectionFile(&pKurucz->hrSolar,lambdaMin-7.-step*pKurucz->solarFGap,lambdaMax+7.+step*pKurucz->solarFGap,(double)0.,CONVOLUTION_CONVERSION_NONE);
+  // the same solar spectrum on the same range has already been prepared for another row
+
+  if ((index_row==1) && (kuruczSolarRow!=ITEM_NONE) &&
+      (solarRange[0]==kuruczSolarRange[0]) && (solarRange[1]==kuruczSolarRange[1])) {
+    pKurucz->hrSolar=KURUCZ_buffers[kuruczSolarRow].hrSolar;
+    pKurucz->hrSolarShared=true;
+    rc=ERROR_ID_NO;
+  } else {
+    // allocate matrix for pKurucz->hrSolar: (number of wavelengths)x(2)
+    rc = MATRIX_Allocate(&pKurucz->hrSolar, hr_solar->nl, 2, 0, 0, 1, __func__);
+    if( !rc) {
+      // copy wavelengths and one spectrum column from pre-loaded hr_solar into pKurucz->hrSolar
+      memcpy(pKurucz->hrSolar.matrix[0], hr_solar->matrix[0], hr_solar->nl * sizeof(hr_solar->matrix[0][0]));
+      memcpy(pKurucz->hrSolar.matrix[1], hr_solar->matrix[index_row], hr_solar->nl * sizeof(hr_solar->matrix[0][0]));
+
+      rc=XSCONV_ConvertCrossSectionFile(&pKurucz->hrSolar,solarRange[0],solarRange[1],(double)0.,CONVOLUTION_CONVERSION_NONE);
+    }
   }
-  if( !rc) {
+  if( !rc && !pKurucz->hrSolarShared) {
     // If the fwhm of the slit function is fitted, then we can use the same high resolution solar
     // spectrum.  If we do not fit the slit function, the solar spectrum has to be preconvolved.
     // For OMI, the number of rows is 60 and the number of preconvolved spectra should be 60 too.
@@ -2262,6 +2806,14 @@ RC KURUCZ_Alloc(const PROJECT *pProject, const double *lambda,INDEX indexKurucz,
 
      goto EndKuruczAlloc;
 
+    if ((index_row==1) && (kuruczSolarRow==ITEM_NONE)) {
+      kuruczSolarRow=indexFenoColumn;
+      kuruczSolarRange[0]=solarRange[0];
+      kuruczSolarRange[1]=solarRange[1];
+    }
+  }
+  if( !rc) {
+
     memcpy(pKurucz->solar,ANALYSE_zeros,sizeof(double)*n_wavel);
 
     // Initialize other fields of global structure
@@ -2477,8 +3029,19 @@ void KURUCZ_Free(void)
    {
    	pKurucz=&KURUCZ_buffers[indexFenoColumn];
 
-    MATRIX_Free(&pKurucz->hrSolar,"KURUCZ_Free");
-    MATRIX_Free(&pKurucz->slitFunction,"KURUCZ_Free");
+    // buffers shared with another row are released with that row
+
+    if (pKurucz->hrSolarShared)
+     memset(&pKurucz->hrSolar,0,sizeof(MATRIX_OBJECT));
+    else
+     MATRIX_Free(&pKurucz->hrSolar,"KURUCZ_Free");
+
+    if (pKurucz->slitFunctionShared)
+     memset(&pKurucz->slitFunction,0,sizeof(MATRIX_OBJECT));
+    else
+     MATRIX_Free(&pKurucz->slitFunction,"KURUCZ_Free");
+
+    pKurucz->hrSolarShared=pKurucz->slitFunctionShared=false;
 
     if (pKurucz->solar!=NULL)
      MEMORY_ReleaseDVector("KURUCZ_Free ","solar",pKurucz->solar,0);
@@ -2597,9 +3160,13 @@ void KURUCZ_Free(void)
       MEMORY_ReleaseBuffer("KURUCZ_Free ","KuruczFeno",pKurucz->KuruczFeno);
      }
 
+    XSCONV_SlitBankFree(&pKurucz->slitBank);
+
     memset(pKurucz,0,sizeof(KURUCZ));
    }
 
+  kuruczSolarRow=kuruczSlitRow=ITEM_NONE;
+
 #if defined(__DEBUG_) && __DEBUG_
   DEBUG_FunctionStop((char *)__func__,0);
 #endif
@@ -4,6 +4,7 @@
 #include "doas.h"
 #include "engine_context.h"
 #include "fit_properties.h"
+#include "analyse.h"
 
 struct _KuruczFeno {
   struct fit_properties * subwindow_fits; // fit properties for calibration subwindows
@@ -23,6 +24,8 @@ struct _Kurucz {
   KURUCZ_FENO *KuruczFeno;
   MATRIX_OBJECT hrSolar;                        // high resolution kurucz spectrum for convolution
   MATRIX_OBJECT slitFunction;                   // user-defined slit function (file option)
+  bool   hrSolarShared,slitFunctionShared;      // true if the buffers of hrSolar/slitFunction belong to another row (see KURUCZ_Alloc)
+  SLIT_BANK slitBank;                           // slit function at each wavelength of the grid of the convolved solar spectrum
   double *solar,                                // convolved kurucz spectrum
          *lambdaF,
          *solarF,                               // filtered solar spectrum (high pass filtering)
@@ -61,14 +64,13 @@ extern KURUCZ KURUCZ_buffers[MAX_SWATHSIZE];
 // GLOBAL DECLARATIONS
 // -------------------
 
-extern FFT *pKURUCZ_fft;
 extern int KURUCZ_indexLine;
 
 // ----------
 // PROTOTYPES
 // ----------
 
-RC   KURUCZ_Spectrum(const double *oldLambda, double *newLambda, double *spectrum, const double *reference, double *instrFunction,
+RC   KURUCZ_Spectrum(ANALYSE_CONTEXT *pContext,const double *oldLambda, double *newLambda, double *spectrum, const double *reference, double *instrFunction,
                    char displayFlag,const char *windowTitle,double **coeff,double **fwhmVector,double **fwhmDeriv2,int saveFlag,
                    INDEX indexFeno,void *responseHandle,INDEX indexFenoColumn);
 RC   KURUCZ_ApplyCalibration(FENO *pTabFeno,double *newLambda,INDEX indexFenoColumn);
@@ -77,5 +79,6 @@ RC   KURUCZ_Alloc(const PROJECT *pProject, const double *lambda, INDEX indexKuru
                   INDEX indexFenoColumn, const MATRIX_OBJECT *hr_solar);
 void KURUCZ_Init(int gomeFlag,INDEX indexFenoColumn);
 void KURUCZ_Free(void);
+void KURUCZ_SetThreadsNumber(int threadsNumber);
 
 #endif
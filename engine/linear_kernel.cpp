@@ -0,0 +1,248 @@
+/* Copyright (C) 2017 Royal Belgian Institute for Space Aeronomy
+ * (BIRA-IASB)
+ *
+ * BIRA-IASB
+ * Ringlaan 3 Avenue Circulaire
+ * 1180 Uccle
+ * Belgium
+ * qdoas@aeronomie.be
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if defined WIN32
+#include <malloc.h>
+#endif
+
+#include "linear_kernel.h"
+
+// Householder QR decomposition as in LAPACK dgeqr2/dormqr (and
+// gsl_linalg_QR_decomp, which the generic DECOMP_QR code uses), so
+// that both give the same results up to rounding.
+//
+// Each kernel is a template on the number of columns N; N=0 is the
+// generic version where the number of columns is only known at run
+// time.  The loops over the rows are written on contiguous, aligned,
+// non-aliased arrays so that the compiler vectorizes them.
+
+#define ALIGNMENT 64 // bytes, a cache line (and the widest vector registers)
+
+namespace {
+
+  const int align_doubles = ALIGNMENT / sizeof(double);
+
+  inline double dot(const double *__restrict x, const double *__restrict y, int n) {
+    double s = 0.;
+    for (int i = 0; i < n; ++i)
+      s += x[i] * y[i];
+    return s;
+  }
+
+  // y += alpha * x
+  inline void axpy(double alpha, const double *__restrict x, double *__restrict y, int n) {
+    for (int i = 0; i < n; ++i)
+      y[i] += alpha * x[i];
+  }
+
+  inline void scale(double alpha, double *__restrict x, int n) {
+    for (int i = 0; i < n; ++i)
+      x[i] *= alpha;
+  }
+
+  template<int N>
+  int normalize(double *a, int ld, int m, int n, double *norms) {
+    if (N)
+      n = N;
+
+    for (int j = 0; j < n; ++j) {
+      double *col = a + j * ld;
+      const double norm = std::sqrt(dot(col, col, m));
+      if (norm == 0.)
+        return 1;
+      norms[j] = norm;
+      scale(1. / norm, col, m);
+    }
+    return 0;
+  }
+
+  template<int N>
+  void qr_decomp(double *a, int ld, int m, int n, double *tau) {
+    if (N)
+      n = N;
+
+    for (int k = 0; k < n; ++k) {
+      // Householder reflection H = I - tau * v * v' with v[0]=1, such that
+      // H * a[k..m-1][k] = (beta, 0, ..., 0)
+      double *v = a + k * ld + k;
+      const int len = m - k;
+      const double alpha = v[0];
+      const double xnorm = std::sqrt(dot(v + 1, v + 1, len - 1));
+
+      if (xnorm == 0.) {
+        tau[k] = 0.;
+        continue;
+      }
+
+      const double beta = -std::copysign(std::hypot(alpha, xnorm), alpha);
+      tau[k] = (beta - alpha) / beta;
+      scale(1. / (alpha - beta), v + 1, len - 1);
+      v[0] = beta;
+
+      // apply the reflection to the next columns
+      for (int j = k + 1; j < n; ++j) {
+        double *c = a + j * ld + k;
+        const double w = tau[k] * (c[0] + dot(v + 1, c + 1, len - 1));
+        c[0] -= w;
+        axpy(-w, v + 1, c + 1, len - 1);
+      }
+    }
+  }
+
+  template<int N>
+  int qr_covar(const double *a, int ld, int n, double *covar) {
+    if (N)
+      n = N;
+
+    // inverse of the upper triangular matrix R, stored by columns
+    double rinv_fixed[N ? N * N : 1];
+    std::vector<double> rinv_generic(N ? 0 : n * n);
+    double *rinv = N ? rinv_fixed : rinv_generic.data();
+    std::fill(rinv, rinv + n * n, 0.);
+
+    for (int j = 0; j < n; ++j) {
+      const double *r = a + j * ld;
+      if (r[j] == 0.)
+        return j + 1;
+      rinv[j * n + j] = 1. / r[j];
+    }
+
+    for (int j = 0; j < n; ++j) {
+      // column j of R^-1 by back substitution of R * x = e_j
+      for (int i = j - 1; i >= 0; --i) {
+        double s = 0.;
+        for (int k = i + 1; k <= j; ++k)
+          s += a[k * ld + i] * rinv[j * n + k];
+        rinv[j * n + i] = -s * rinv[i * n + i];
+      }
+    }
+
+    // covar = R^-1 * R^-T
+    for (int i = 0; i < n; ++i) {
+      for (int j = i; j < n; ++j) {
+        double s = 0.;
+        for (int k = j; k < n; ++k)
+          s += rinv[k * n + i] * rinv[k * n + j];
+        covar[i * n + j] = covar[j * n + i] = s;
+      }
+    }
+    return 0;
+  }
+
+  template<int N>
+  void qr_solve(const double *a, int ld, int m, int n, const double *tau, double *b, double *x) {
+    if (N)
+      n = N;
+
+    // b = Q' * b = H_n-1 * ... * H_0 * b
+    for (int k = 0; k < n; ++k) {
+      if (tau[k] == 0.)
+        continue;
+      const double *v = a + k * ld + k;
+      const double w = tau[k] * (b[k] + dot(v + 1, b + k + 1, m - k - 1));
+      b[k] -= w;
+      axpy(-w, v + 1, b + k + 1, m - k - 1);
+    }
+
+    // R * x = b
+    for (int i = n - 1; i >= 0; --i) {
+      double s = b[i];
+      for (int k = i + 1; k < n; ++k)
+        s -= a[k * ld + i] * x[k];
+      x[i] = s / a[i * ld + i];
+    }
+  }
+
+  // instantiations for 0 (generic), 1, ..., LINEAR_KERNEL_MAX_COLUMNS columns
+#define KERNEL_TABLE(kernel) {                                          \
+    kernel<0>, kernel<1>, kernel<2>, kernel<3>, kernel<4>, kernel<5>,   \
+    kernel<6>, kernel<7>, kernel<8>, kernel<9>, kernel<10>, kernel<11>, \
+    kernel<12>, kernel<13>, kernel<14>, kernel<15>, kernel<16> }
+
+  typedef int (*normalize_fn)(double *, int, int, int, double *);
+  typedef void (*qr_decomp_fn)(double *, int, int, int, double *);
+  typedef int (*qr_covar_fn)(const double *, int, int, double *);
+  typedef void (*qr_solve_fn)(const double *, int, int, int, const double *, double *, double *);
+
+  const normalize_fn normalize_kernels[] = KERNEL_TABLE(normalize);
+  const qr_decomp_fn qr_decomp_kernels[] = KERNEL_TABLE(qr_decomp);
+  const qr_covar_fn qr_covar_kernels[] = KERNEL_TABLE(qr_covar);
+  const qr_solve_fn qr_solve_kernels[] = KERNEL_TABLE(qr_solve);
+
+  static_assert(sizeof(normalize_kernels) / sizeof(normalize_kernels[0]) == LINEAR_KERNEL_MAX_COLUMNS + 1,
+                "one kernel per number of columns");
+
+  template<typename F>
+  inline F select(const F kernels[], int n) {
+    return (n <= LINEAR_KERNEL_MAX_COLUMNS) ? kernels[n] : kernels[0];
+  }
+}
+
+double *LINEAR_kernel_alloc(int m, int n, int *ld) {
+  *ld = (m + align_doubles - 1) / align_doubles * align_doubles;
+
+  const size_t size = (size_t)*ld * n * sizeof(double);
+  void *a;
+
+#if defined WIN32
+  if ((a = _aligned_malloc(size, ALIGNMENT)) == NULL)
+    return NULL;
+#else
+  if (posix_memalign(&a, ALIGNMENT, size))
+    return NULL;
+#endif
+
+  std::memset(a, 0, size);
+  return static_cast<double *>(a);
+}
+
+void LINEAR_kernel_free(double *a) {
+#if defined WIN32
+  _aligned_free(a);
+#else
+  free(a);
+#endif
+}
+
+int LINEAR_kernel_normalize(double *a, int ld, int m, int n, double *norms) {
+  return select(normalize_kernels, n)(a, ld, m, n, norms);
+}
+
+void LINEAR_kernel_qr_decomp(double *a, int ld, int m, int n, double *tau) {
+  select(qr_decomp_kernels, n)(a, ld, m, n, tau);
+}
+
+int LINEAR_kernel_qr_covar(const double *a, int ld, int n, double *covar) {
+  return select(qr_covar_kernels, n)(a, ld, n, covar);
+}
+
+void LINEAR_kernel_qr_solve(const double *a, int ld, int m, int n, const double *tau, double *b, double *x) {
+  select(qr_solve_kernels, n)(a, ld, m, n, tau, b, x);
+}
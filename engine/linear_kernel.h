@@ -0,0 +1,72 @@
+/* Copyright (C) 2017 Royal Belgian Institute for Space Aeronomy
+ * (BIRA-IASB)
+ *
+ * BIRA-IASB
+ * Ringlaan 3 Avenue Circulaire
+ * 1180 Uccle
+ * Belgium
+ * qdoas@aeronomie.be
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef LINEAR_KERNEL_H
+#define LINEAR_KERNEL_H
+
+// Householder QR kernels for the small linear systems of the DOAS fit
+// (a few hundred equations, a few unknowns), used by linear_system.c
+//
+// The matrix is stored column by column in a single aligned block:
+// element (i,j) is a[j*ld+i], where the leading dimension ld is the
+// number of equations rounded up so that each column is aligned.  The
+// kernels are instantiated for each number of unknowns up to
+// LINEAR_KERNEL_MAX_COLUMNS, so that the loops over the columns are
+// unrolled and the loops over the equations are vectorized.  Larger
+// systems use a generic version of the same code.
+
+#define LINEAR_KERNEL_MAX_COLUMNS 16
+
+#if defined(_cplusplus) || defined(__cplusplus)
+extern "C" {
+#endif
+
+// allocate a zeroed block of n columns of m values;
+// *ld receives the leading dimension.  Release with LINEAR_kernel_free
+double *LINEAR_kernel_alloc(int m, int n, int *ld);
+void LINEAR_kernel_free(double *a);
+
+// normalize the columns of a[m x n] to unit length, norms[0..n-1]
+// receives the original norms.  Returns 1 if a column is null.
+int LINEAR_kernel_normalize(double *a, int ld, int m, int n, double *norms);
+
+// QR decomposition of a[m x n] (m >= n): on return, the upper triangle
+// contains R and the columns below the diagonal contain the Householder
+// vectors, tau[0..n-1] the Householder coefficients
+void LINEAR_kernel_qr_decomp(double *a, int ld, int m, int n, double *tau);
+
+// covariance (R' * R)^-1 = R^-1 * R^-T, covar[n x n] (row i at
+// covar[i*n]).  Returns 0, or the column (1..n) of the first null
+// diagonal element if R is singular.
+int LINEAR_kernel_qr_covar(const double *a, int ld, int n, double *covar);
+
+// least squares solution x[0..n-1] of a*x=b.  b[0..m-1] is overwritten
+// by Q' * b.
+void LINEAR_kernel_qr_solve(const double *a, int ld, int m, int n, const double *tau, double *b, double *x);
+
+#if defined(_cplusplus) || defined(__cplusplus)
+}
+#endif
+
+#endif
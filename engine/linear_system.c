@@ -49,11 +49,13 @@
 #include <assert.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "gsl/gsl_matrix.h"
 #include "gsl/gsl_linalg.h"
 
 #include "linear_system.h"
+#include "linear_kernel.h"
 #include "comdefs.h"
 #include "svd.h"
 #include "vector.h"
@@ -65,13 +67,24 @@ struct qr {
   gsl_vector *tau;
 };
 
+// QR decomposition of systems with at most LINEAR_KERNEL_MAX_COLUMNS
+// unknowns, using the kernels of linear_kernel.h
+struct qr_small {
+  double *A; // column-major, leading dimension ld
+  double *tau;
+  double *work; // right hand side, m values
+  int ld;
+};
+
 // linear system of m equations and n unknowns
 struct linear_system {
   int m, n;
   double *norms; // colums of matrix are normalized to avoid numerical issues.
   enum linear_fit_mode mode;
+  bool small; // DECOMP_QR with decomposition.qr_small
   union {
     struct qr qr;
+    struct qr_small qr_small;
     struct svd svd;
   } decomposition;
 };
@@ -87,6 +100,7 @@ struct linear_system*LINEAR_alloc(int m, int n, enum linear_fit_mode mode) {
   s->m = m;
   s->n = n;
   s->mode = mode;
+  s->small = (mode == DECOMP_QR) && (n <= LINEAR_KERNEL_MAX_COLUMNS);
 
   switch (mode) {
   case DECOMP_SVD:
@@ -104,8 +118,15 @@ struct linear_system*LINEAR_alloc(int m, int n, enum linear_fit_mode mode) {
     }
     break;
   case DECOMP_QR:
-    s->decomposition.qr.A = gsl_matrix_alloc(m, n);
-    s->decomposition.qr.tau = gsl_vector_alloc(n);
+    if (s->small) {
+      int ld;
+      s->decomposition.qr_small.A = LINEAR_kernel_alloc(m, n, &s->decomposition.qr_small.ld);
+      s->decomposition.qr_small.tau = LINEAR_kernel_alloc(n, 1, &ld);
+      s->decomposition.qr_small.work = LINEAR_kernel_alloc(m, 1, &ld);
+    } else {
+      s->decomposition.qr.A = gsl_matrix_alloc(m, n);
+      s->decomposition.qr.tau = gsl_vector_alloc(n);
+    }
     break;
   }
 
@@ -129,9 +150,15 @@ struct linear_system *LINEAR_from_matrix(const double * const *a, int m, int n,
     }
     break;
   case DECOMP_QR:
-    for (int i=0; i<s->m; ++i) {
+    if (s->small) {
       for (int j=0; j<s->n; ++j) {
-        gsl_matrix_set(s->decomposition.qr.A, i, j, a[1+j][1+i]);
+        LINEAR_set_column(s, 1+j, a[1+j]);
+      }
+    } else {
+      for (int i=0; i<s->m; ++i) {
+        for (int j=0; j<s->n; ++j) {
+          gsl_matrix_set(s->decomposition.qr.A, i, j, a[1+j][1+i]);
+        }
       }
     }
     break;
@@ -154,8 +181,14 @@ void LINEAR_free(struct linear_system *s) {
     MEMORY_ReleaseDVector(__func__,"W",s->decomposition.svd.W,1);
     break;
   case DECOMP_QR:
-    gsl_matrix_free(s->decomposition.qr.A);
-    gsl_vector_free(s->decomposition.qr.tau);
+    if (s->small) {
+      LINEAR_kernel_free(s->decomposition.qr_small.A);
+      LINEAR_kernel_free(s->decomposition.qr_small.tau);
+      LINEAR_kernel_free(s->decomposition.qr_small.work);
+    } else {
+      gsl_matrix_free(s->decomposition.qr.A);
+      gsl_vector_free(s->decomposition.qr.tau);
+    }
     break;
   }
 
@@ -175,6 +208,10 @@ void LINEAR_set_column(struct linear_system *s, int n, const double *values) {
     }
     break;
   case DECOMP_QR:
+    if (s->small) {
+      memcpy(s->decomposition.qr_small.A + (n-1)*s->decomposition.qr_small.ld, values+1, s->m*sizeof(double));
+      break;
+    }
     for (int i=0; i<s->m; ++i) {
       gsl_matrix_set(s->decomposition.qr.A,i, n-1, values[1+i]);
     }
@@ -196,6 +233,14 @@ void LINEAR_set_weight(struct linear_system *s, const double *sigma) {
     }
     break;
   case DECOMP_QR:
+    if (s->small) {
+      for (int j=0; j< s->n; ++j) {
+        double *col = s->decomposition.qr_small.A + j*s->decomposition.qr_small.ld;
+        for (int i=0; i< s->m; ++i)
+          col[i] /= sigma[i];
+      }
+      break;
+    }
     for (int i=0; i< s->m; ++i) {
       gsl_vector_view rowi = gsl_matrix_row(s->decomposition.qr.A, i);
       gsl_vector_scale(&rowi.vector, 1.0/sigma[i]);
@@ -204,6 +249,90 @@ void LINEAR_set_weight(struct linear_system *s, const double *sigma) {
   }
 }
 
+// QR decomposition with the kernels of linear_kernel.h (see LINEAR_decompose)
+static int decompose_small(struct linear_system *s, double *sigmasquare, double **covar) {
+  struct qr_small *qr = &s->decomposition.qr_small;
+  double cov[LINEAR_KERNEL_MAX_COLUMNS*LINEAR_KERNEL_MAX_COLUMNS];
+
+  if (LINEAR_kernel_normalize(qr->A, qr->ld, s->m, s->n, s->norms))
+    return ERROR_SetLast(__func__, ERROR_TYPE_WARNING, ERROR_ID_NORMALIZE);
+
+  LINEAR_kernel_qr_decomp(qr->A, qr->ld, s->m, s->n, qr->tau);
+
+  // covariance (A' * A)^-1 = (R' * R)^-1
+  const int singular = LINEAR_kernel_qr_covar(qr->A, qr->ld, s->n, cov);
+  if (singular)
+    return ERROR_SetLast(__func__, ERROR_TYPE_WARNING, ERROR_ID_QR_SINGULAR, singular);
+
+  for (int i=0; i<s->n; ++i) {
+    if (covar != NULL) {
+      for (int j=0; j<s->n; ++j) {
+        covar[1+i][1+j]=cov[i*s->n+j] / (s->norms[i]*s->norms[j]);
+      }
+    }
+    if (sigmasquare != NULL) {
+      sigmasquare[1+i] = cov[i*s->n+i] / (s->norms[i]*s->norms[i]);
+    }
+  }
+  return ERROR_ID_NO;
+}
+
+// QR decomposition with GSL (see LINEAR_decompose)
+static int decompose_qr(struct linear_system *s, double *sigmasquare, double **covar) {
+  int rc=ERROR_ID_NO;
+
+  // normalisation
+  for (int j=0; j<s->n; ++j) {
+    gsl_vector_view colj = gsl_matrix_column(s->decomposition.qr.A, j);
+    s->norms[j]=0.;
+    for (int i=0; i<s->m; ++i) {
+      
+      s->norms[j] += gsl_vector_get(&colj.vector, i)*gsl_vector_get(&colj.vector, i);
+//      if (i>=s->m-6) printf("j:%d  s->norms[%d]=%lf\n",j,i,s->norms[j]);
+    }
+    if (s->norms[j] == 0.)
+      return ERROR_SetLast(__func__, ERROR_TYPE_WARNING, ERROR_ID_NORMALIZE);
+    s->norms[j] = sqrt(s->norms[j]);
+    gsl_vector_scale(&colj.vector, 1.0/s->norms[j]);
+  }
+  int rc_gsl = gsl_linalg_QR_decomp(s->decomposition.qr.A, s->decomposition.qr.tau);
+  if (rc_gsl)
+    rc = ERROR_ID_SVD_ILLCONDITIONED; // TODO: specific error conditions for QR
+
+  // calculate covariance (A' * A)^-1 = (R' * R)^-1 using cholesky inversion method
+  gsl_matrix *cholesky = gsl_matrix_alloc(s->n, s->n);
+  for(int i=0; i<s->n; ++i) {
+    // after gsl_linalg_QR_decomp(), the diagonal & upper triangle of A contain the matrix R.
+    for (int j=i; j<s->n; ++j) { // diagonal & upper triangle: copy from A:
+      gsl_matrix_set(cholesky, i, j, gsl_matrix_get(s->decomposition.qr.A,i, j));
+    }
+    for (int j=0;j<i; ++j) { // lower triangle part: copy from previous upper triangle:
+      gsl_matrix_set(cholesky, i, j, gsl_matrix_get(cholesky, j, i));
+    }
+  }
+  rc_gsl = gsl_linalg_cholesky_invert(cholesky);
+  if (rc_gsl) {
+    rc = ERROR_ID_SVD_ILLCONDITIONED; // TODO: specific error conditions for QR
+    goto cleanup_qr;
+  }
+
+  if (covar != NULL) {
+    for (int i=0; i<s->n; ++i) {
+      for (int j=0; j<s->n; ++j) {
+        covar[1+i][1+j]=gsl_matrix_get(cholesky, i, j) / (s->norms[i]*s->norms[j]);
+      }
+    }
+  }
+  if (sigmasquare != NULL) {
+    for (int i=0; i<s->n; ++i) {
+      sigmasquare[1+i] = gsl_matrix_get(cholesky, i, i) / (s->norms[i]*s->norms[i]);
+    }
+  }
+ cleanup_qr:
+  gsl_matrix_free(cholesky);
+  return rc;
+}
+
 int LINEAR_decompose(struct linear_system *s, double *sigmasquare, double **covar) {
   int rc=ERROR_ID_NO;
 
@@ -229,59 +358,39 @@ int LINEAR_decompose(struct linear_system *s, double *sigmasquare, double **cova
       }
     }
     break;
-  case DECOMP_QR: {
-    // normalisation
-    for (int j=0; j<s->n; ++j) {
-      gsl_vector_view colj = gsl_matrix_column(s->decomposition.qr.A, j);
-      s->norms[j]=0.;
-      for (int i=0; i<s->m; ++i) {
-        
-        s->norms[j] += gsl_vector_get(&colj.vector, i)*gsl_vector_get(&colj.vector, i);
-//        if (i>=s->m-6) printf("j:%d  s->norms[%d]=%lf\n",j,i,s->norms[j]);
-      }
-      if (s->norms[j] == 0.)
-        return ERROR_SetLast(__func__, ERROR_TYPE_WARNING, ERROR_ID_NORMALIZE);
-      s->norms[j] = sqrt(s->norms[j]);
-      gsl_vector_scale(&colj.vector, 1.0/s->norms[j]);
-    }
-    int rc_gsl = gsl_linalg_QR_decomp(s->decomposition.qr.A, s->decomposition.qr.tau);
-    if (rc_gsl)
-      rc = ERROR_ID_SVD_ILLCONDITIONED; // TODO: specific error conditions for QR
-
-    // calculate covariance (A' * A)^-1 = (R' * R)^-1 using cholesky inversion method
-    gsl_matrix *cholesky = gsl_matrix_alloc(s->n, s->n);
-    for(int i=0; i<s->n; ++i) {
-      // after gsl_linalg_QR_decomp(), the diagonal & upper triangle of A contain the matrix R.
-      for (int j=i; j<s->n; ++j) { // diagonal & upper triangle: copy from A:
-        gsl_matrix_set(cholesky, i, j, gsl_matrix_get(s->decomposition.qr.A,i, j));
-      }
-      for (int j=0;j<i; ++j) { // lower triangle part: copy from previous upper triangle:
-        gsl_matrix_set(cholesky, i, j, gsl_matrix_get(cholesky, j, i));
-      }
-    }
-    rc_gsl = gsl_linalg_cholesky_invert(cholesky);
-    if (rc_gsl) {
-      rc = ERROR_ID_SVD_ILLCONDITIONED; // TODO: specific error conditions for QR
-      goto cleanup_qr;
-    }
+  case DECOMP_QR:
+    rc = s->small ? decompose_small(s, sigmasquare, covar) : decompose_qr(s, sigmasquare, covar);
+    break;
+  }
+  return rc;
+}
 
-    if (covar != NULL) {
-      for (int i=0; i<s->n; ++i) {
-        for (int j=0; j<s->n; ++j) {
-          covar[1+i][1+j]=gsl_matrix_get(cholesky, i, j) / (s->norms[i]*s->norms[j]);
-        }
-      }
-    }
-    if (sigmasquare != NULL) {
-      for (int i=0; i<s->n; ++i) {
-        sigmasquare[1+i] = gsl_matrix_get(cholesky, i, i) / (s->norms[i]*s->norms[i]);
-      }
-    }
-    cleanup_qr:
-    gsl_matrix_free(cholesky);
+// least squares solution with the kernels of linear_kernel.h (see LINEAR_solve)
+static int solve_small(const struct linear_system *s, const double *b, double *x) {
+  const struct qr_small *qr = &s->decomposition.qr_small;
+  memcpy(qr->work, b+1, s->m*sizeof(double));
+  LINEAR_kernel_qr_solve(qr->A, qr->ld, s->m, s->n, qr->tau, qr->work, x+1);
+  return ERROR_ID_NO;
+}
+
+// least squares solution with GSL (see LINEAR_solve)
+static int solve_qr(const struct linear_system *s, const double *b, double *x) {
+  int rc=ERROR_ID_NO;
+  gsl_vector *vx = gsl_vector_alloc(s->n);
+  gsl_vector *vb = gsl_vector_alloc(s->m);
+  gsl_vector *residual = gsl_vector_alloc(s->m);
+  for (int i=0; i<s->m; ++i) {
+    gsl_vector_set(vb, i, b[1+i]);
   }
-    break;
+  int rc_gsl = gsl_linalg_QR_lssolve(s->decomposition.qr.A, s->decomposition.qr.tau, vb, vx, residual);
+  if (rc_gsl)
+    rc = ERROR_ID_SVD_ILLCONDITIONED; // TODO: specific error conditions for QR
+  for (int i=0; i<s->n; ++i) {
+    x[1+i] = gsl_vector_get(vx, i);
   }
+  gsl_vector_free(vb);
+  gsl_vector_free(vx);
+  gsl_vector_free(residual);
   return rc;
 }
 
@@ -291,23 +400,8 @@ int LINEAR_solve(const struct linear_system *s, const double *b, double *x) {
   case DECOMP_SVD:
     rc=SVD_Bksb(&s->decomposition.svd, s->m, s->n, b, x);
     break;
-  case DECOMP_QR: {
-    gsl_vector *vx = gsl_vector_alloc(s->n);
-    gsl_vector *vb = gsl_vector_alloc(s->m);
-    gsl_vector *residual = gsl_vector_alloc(s->m);
-    for (int i=0; i<s->m; ++i) {
-      gsl_vector_set(vb, i, b[1+i]);
-    }
-    int rc_gsl = gsl_linalg_QR_lssolve(s->decomposition.qr.A, s->decomposition.qr.tau, vb, vx, residual);
-    if (rc_gsl)
-      rc = ERROR_ID_SVD_ILLCONDITIONED; // TODO: specific error conditions for QR
-    for (int i=0; i<s->n; ++i) {
-      x[1+i] = gsl_vector_get(vx, i);
-    }
-    gsl_vector_free(vb);
-    gsl_vector_free(vx);
-    gsl_vector_free(residual);
-  }
+  case DECOMP_QR:
+    rc = s->small ? solve_small(s, b, x) : solve_qr(s, b, x);
     break;
   }
 
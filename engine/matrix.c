@@ -41,6 +41,18 @@
 //  This module allows to load data dynamically from files to matrix objects and
 //  also pre-calculate second derivatives for future spline interpolation.
 //
+//  Besides text files, MATRIX_Load reads a binary format written by
+//  MATRIX_SaveBinary (tool doas_binmatrix) : a header (magic string, version,
+//  dimensions, size and modification time of the text file it was converted
+//  from), the columns of the matrix and, optionally, the second derivatives of
+//  the columns 1..nc-1 (native byte order).  A binary file can be given
+//  instead of the text file, or be saved next to it under the same name
+//  followed by MATRIX_BINARY_EXT; this companion file is used as long as the
+//  size and modification time of the text file don't change.  Binary files
+//  are mapped in memory (read in one block on Windows) and the selected lines
+//  are copied to the matrix, so that large solar spectra and cross sections
+//  don't have to be parsed again for each analysis window and each row.
+//
 //  ----------------------------------------------------------------------------
 //
 //  FUNCTIONS
@@ -48,7 +60,8 @@
 //  MATRIX_Allocate - allocate buffers for a matrix object;
 //  MATRIX_Free - release the buffers allocated for a matrix;
 //  MATRIX_Copy - copy the content of a matrix in another one;
-//  MATRIX_Load - load a matrix from file
+//  MATRIX_Load - load a matrix from file;
+//  MATRIX_SaveBinary - save a matrix in the binary format
 //
 //  ----------------------------------------------------------------------------
 
@@ -59,8 +72,16 @@
 #include "winfiles.h"
 #include "stdfunc.h"
 
+#include <math.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#if !defined WIN32
+#include <sys/mman.h>
+#endif
 
 // format string for fscanf: read a single number and skip over any
 // following characters that are not part of a number and not a
@@ -68,8 +89,21 @@
 #define NEXT_DOUBLE "%lf%*[^0-9.-+\n]"
 #define COMMENT_LINE " %1[*;#]%*[^\n]\n"
 
+#define MATRIX_BINARY_MAGIC   "QDMATRIX"                                       // first bytes of a binary file
+#define MATRIX_BINARY_VERSION 1
+
 int test_matrix=0;
 
+typedef struct _matrixBinaryHeader
+ {
+  char     magic[8];
+  uint32_t version;
+  int32_t  nl,nc;                                                               // dimensions of the matrix
+  int32_t  deriv2;                                                              // 1 if the second derivatives follow the columns
+  int64_t  sourceSize,sourceTime;                                               // size and modification time of the text file (0 if none)
+ }
+MATRIX_BINARY_HEADER;
+
 // ==================
 // BUFFERS PROCESSING
 // ==================
@@ -376,6 +410,253 @@ int MATRIX_GetColumnsNumbers(FILE *fp,double *pFirstValue)
   return nc;
  }
 
+// -----------------------------------------------------------------------------
+// FUNCTION      MatrixLoadBinary
+// -----------------------------------------------------------------------------
+// PURPOSE       Load a matrix from a binary file
+//
+// INPUT         fileName        : the name of the binary file
+//               sourceFile      : the text file the binary file should have been
+//                                 converted from (NULL if fileName is given by the user)
+//               nl,nc,xMin,xMax,allocateDeriv2,reverseFlag,callingFunction :
+//                                 see MATRIX_Load
+//
+// OUTPUT        pMatrix, the matrix loaded from the file
+//               pRc, the return code of the load (see MATRIX_Load)
+//
+// RETURN        1 if fileName is a binary file that matches the request (the
+//               result of the load is then in pRc), 0 to read the text file
+// -----------------------------------------------------------------------------
+
+static int MatrixLoadBinary(const char *fileName,const char *sourceFile,MATRIX_OBJECT *pMatrix,
+                            int nl,int nc,double xMin,double xMax,
+                            int allocateDeriv2,int reverseFlag,const char *callingFunction,RC *pRc)
+ {
+  // Declarations
+
+  MATRIX_BINARY_HEADER header;                                                  // header of the binary file
+  struct stat fileInfo;                                                         // size and modification time of the files
+  const double *data,*lambda;                                                   // columns of the matrix in the file
+  double **matrix,tempValue;
+  void *buffer;                                                                 // the mapped file (or the buffer on Windows)
+  size_t dataSize;
+  int nlSelected,allLines;
+  INDEX i,j,k;
+  FILE *fp;
+  RC rc;
+
+  // Initializations
+
+  *pRc=rc=ERROR_ID_NO;
+  buffer=NULL;
+  data=NULL;
+
+  // Check the header
+
+  if ((fp=fopen(fileName,"rb"))==NULL)
+   return 0;
+
+  if ((fread(&header,sizeof(MATRIX_BINARY_HEADER),1,fp)!=1) ||
+       memcmp(header.magic,MATRIX_BINARY_MAGIC,sizeof(header.magic)) ||
+      (header.version!=MATRIX_BINARY_VERSION) ||
+      (header.nl<=0) || (header.nc<=0) ||
+     ((sourceFile!=NULL) && ((stat(sourceFile,&fileInfo)==-1) ||
+                             (header.sourceSize!=(int64_t)fileInfo.st_size) ||
+                             (header.sourceTime!=(int64_t)fileInfo.st_mtime))))
+   {
+    fclose(fp);
+    return 0;
+   }
+
+  // The number of columns is not the expected one : report it for a binary file
+  // selected by the user, read the text file otherwise (as for a text file, the
+  // error is reported by the caller)
+
+  if (nl && nc && (nc!=header.nc))
+   {
+    fclose(fp);
+
+    if (sourceFile!=NULL)
+     return 0;
+
+    *pRc=ERROR_SetLast(__func__,ERROR_TYPE_FATAL,ERROR_ID_FILE_BAD_LENGTH,fileName);
+    return 1;
+   }
+
+  dataSize=sizeof(double)*(size_t)header.nl*(header.nc+((header.deriv2)?header.nc-1:0));
+
+  // Map the file
+
+  #if defined WIN32
+  if (((buffer=malloc(dataSize))!=NULL) && (fread(buffer,dataSize,1,fp)!=1))
+   {
+    free(buffer);
+    buffer=NULL;
+   }
+  data=(const double *)buffer;
+  #else
+  if ((fstat(fileno(fp),&fileInfo)!=-1) && ((size_t)fileInfo.st_size>=sizeof(MATRIX_BINARY_HEADER)+dataSize) &&
+     ((buffer=mmap(NULL,sizeof(MATRIX_BINARY_HEADER)+dataSize,PROT_READ,MAP_PRIVATE,fileno(fp),0))!=MAP_FAILED))
+   data=(const double *)((const char *)buffer+sizeof(MATRIX_BINARY_HEADER));
+  else
+   buffer=NULL;
+  #endif
+
+  fclose(fp);
+
+  if (data==NULL)
+   return 0;
+
+  // Select the lines in the range [xMin..xMax] (as MATRIX_Load does for text files)
+
+  lambda=data;
+
+  for (i=nlSelected=0;i<header.nl;i++)
+   if ((fabs(xMin-xMax)<EPSILON) || ((lambda[i]>=xMin) && (lambda[i]<=xMax)))
+    nlSelected++;
+
+  if (!nl || !nc)
+   {
+    if (!nlSelected || (nlSelected<nl) || (header.nc<nc))
+     rc=ERROR_SetLast(__func__,ERROR_TYPE_WARNING,ERROR_ID_FILE_EMPTY,fileName);
+
+    nl=nlSelected;
+    nc=header.nc;
+   }
+  else if (nlSelected<nl)
+   rc=ERROR_SetLast(__func__,ERROR_TYPE_FATAL,ERROR_ID_FILE_BAD_LENGTH,fileName);
+
+  allLines=(nl==header.nl)?1:0;
+
+  // Copy the selected lines
+
+  if (!rc && !(rc=MATRIX_Allocate(pMatrix,nl,nc,0,0,allocateDeriv2,callingFunction)))
+   {
+    matrix=pMatrix->matrix;
+
+    if (allLines)
+     for (j=0;j<nc;j++)
+      memcpy(matrix[j],data+(size_t)j*header.nl,sizeof(double)*nl);
+    else
+     for (i=k=0;(i<header.nl) && (k<nl);i++)
+      if ((fabs(xMin-xMax)<EPSILON) || ((lambda[i]>=xMin) && (lambda[i]<=xMax)))
+       {
+        for (j=0;j<nc;j++)
+         matrix[j][k]=data[(size_t)j*header.nl+i];
+        k++;
+       }
+
+    // Flip up/down the matrix
+
+    if (reverseFlag && (nl>1) && (matrix[0][0]>matrix[0][1]))
+     {
+      allLines=0;                                                               // the saved second derivatives are those of the matrix in the order of the file
+
+      for (i=0;i<nl/2;i++)
+       for (j=0;j<nc;j++)
+        {
+         tempValue=matrix[j][i];
+         matrix[j][i]=matrix[j][nl-1-i];
+         matrix[j][nl-1-i]=tempValue;
+        }
+     }
+
+    // Second derivatives : saved in the file if all lines are loaded, calculated otherwise
+
+    if (allocateDeriv2)
+     for (j=1;(j<nc) && !rc;j++)
+      {
+       if (allLines && header.deriv2)
+        memcpy(pMatrix->deriv2[j],data+(size_t)(header.nc+j-1)*header.nl,sizeof(double)*nl);
+       else
+        rc=SPLINE_Deriv2(matrix[0],matrix[j],pMatrix->deriv2[j],nl,callingFunction);
+      }
+   }
+
+  // Release the mapping
+
+  #if defined WIN32
+  free(buffer);
+  #else
+  munmap(buffer,sizeof(MATRIX_BINARY_HEADER)+dataSize);
+  #endif
+
+  if (rc)
+   MATRIX_Free(pMatrix,__func__);
+
+  // Return
+
+  *pRc=rc;
+
+  return 1;
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      MATRIX_SaveBinary
+// -----------------------------------------------------------------------------
+// PURPOSE       Save a matrix in the binary format read by MATRIX_Load
+//
+// INPUT         fileName   : the name of the binary file
+//               pMatrix    : the matrix (as loaded by MATRIX_Load, with or
+//                            without second derivatives)
+//               sourceFile : the text file the matrix has been loaded from, to
+//                            save its size and modification time (binary
+//                            companion of the text file); NULL otherwise
+//
+// RETURN        ERROR_ID_FILE_OPEN if the file can not be written;
+//               ERROR_ID_NO otherwise
+// -----------------------------------------------------------------------------
+
+RC MATRIX_SaveBinary(const char *fileName,const MATRIX_OBJECT *pMatrix,const char *sourceFile)
+ {
+  // Declarations
+
+  MATRIX_BINARY_HEADER header;
+  struct stat fileInfo;
+  FILE *fp;
+  INDEX j;
+  int ok;
+
+  // Header
+
+  memset(&header,0,sizeof(MATRIX_BINARY_HEADER));
+  memcpy(header.magic,MATRIX_BINARY_MAGIC,sizeof(header.magic));
+  header.version=MATRIX_BINARY_VERSION;
+  header.nl=pMatrix->nl;
+  header.nc=pMatrix->nc;
+  header.deriv2=(pMatrix->deriv2!=NULL)?1:0;
+
+  if ((sourceFile!=NULL) && (stat(sourceFile,&fileInfo)!=-1))
+   {
+    header.sourceSize=(int64_t)fileInfo.st_size;
+    header.sourceTime=(int64_t)fileInfo.st_mtime;
+   }
+
+  // Columns and second derivatives
+
+  if ((pMatrix->matrix==NULL) || (fp=fopen(fileName,"wb"))==NULL)
+   return ERROR_SetLast(__func__,ERROR_TYPE_FATAL,ERROR_ID_FILE_OPEN,fileName);
+
+  ok=(fwrite(&header,sizeof(MATRIX_BINARY_HEADER),1,fp)==1)?1:0;
+
+  for (j=0;ok && (j<pMatrix->nc);j++)
+   ok=(fwrite(pMatrix->matrix[pMatrix->basec+j]+pMatrix->basel,sizeof(double),pMatrix->nl,fp)==(size_t)pMatrix->nl)?1:0;
+
+  for (j=1;ok && header.deriv2 && (j<pMatrix->nc);j++)
+   ok=(fwrite(pMatrix->deriv2[pMatrix->basec+j]+pMatrix->basel,sizeof(double),pMatrix->nl,fp)==(size_t)pMatrix->nl)?1:0;
+
+  if (fclose(fp))
+   ok=0;
+
+  if (!ok)
+   {
+    remove(fileName);
+    return ERROR_SetLast(__func__,ERROR_TYPE_FATAL,ERROR_ID_FILE_OPEN,fileName);
+   }
+
+  return ERROR_ID_NO;
+ }
+
 // -----------------------------------------------------------------------------
 // FUNCTION      MATRIX_Load
 // -----------------------------------------------------------------------------
@@ -398,6 +679,10 @@ int MATRIX_GetColumnsNumbers(FILE *fp,double *pFirstValue)
 //               ERROR_ID_WAVELENGTH if the wavelength calibration of the input file
 //                                   doesn't cover the analysis spectral range
 //               ERROR_ID_NO otherwise
+//
+// REMARK        the binary file (see MATRIX_SaveBinary) is used instead of the
+//               text file if fileName is a binary file or if an up to date
+//               binary companion of the text file exists
 // -----------------------------------------------------------------------------
 
 RC MATRIX_Load(const char *fileName,MATRIX_OBJECT *pMatrix,
@@ -406,6 +691,7 @@ RC MATRIX_Load(const char *fileName,MATRIX_OBJECT *pMatrix,
   // Declarations
 
   char     fullPath[MAX_ITEM_TEXT_LEN];                                         // the complete file name to load
+  char     binaryPath[MAX_ITEM_TEXT_LEN+sizeof(MATRIX_BINARY_EXT)];             // the binary companion of the file
   int      nlMin,ncMin;                                                         // resp. the minimum numbers of lines and columns to load from the file
   INDEX    i,j;                                                                 // indexes for browsing lines and columns in matrix
   double **matrix,**deriv2,                                                     // resp. pointers to the matrix to load and to the second derivatives
@@ -424,6 +710,7 @@ RC MATRIX_Load(const char *fileName,MATRIX_OBJECT *pMatrix,
   // Initializations
 
   FILES_RebuildFileName(fullPath,fileName,1);                                   // build the complete path and file name
+  sprintf(binaryPath,"%s%s",fullPath,MATRIX_BINARY_EXT);
 
   #if defined(__DEBUG_) && __DEBUG_
   DEBUG_Print("File to load : %s\n",fullPath);
@@ -441,9 +728,15 @@ RC MATRIX_Load(const char *fileName,MATRIX_OBJECT *pMatrix,
 
   MATRIX_Free(pMatrix, __func__);
 
+  // Binary file or binary companion of the text file
+
+  if (MatrixLoadBinary(fullPath,NULL,pMatrix,nl,nc,xMin,xMax,allocateDeriv2,reverseFlag,callingFunction,&rc) ||
+      MatrixLoadBinary(binaryPath,fullPath,pMatrix,nl,nc,xMin,xMax,allocateDeriv2,reverseFlag,callingFunction,&rc))
+   fp=NULL;
+
   // File open
 
-  if ((fp=fopen(fullPath,"rt"))==NULL)
+  else if ((fp=fopen(fullPath,"rt"))==NULL)
    rc=ERROR_SetLast(__func__,ERROR_TYPE_WARNING,ERROR_ID_FILE_NOT_FOUND,fullPath);
   else if (!STD_FileLength(fp) )
    rc=ERROR_SetLast(__func__,ERROR_TYPE_WARNING,ERROR_ID_FILE_EMPTY,fullPath);
@@ -10,6 +10,10 @@
 extern "C" {
 #endif
 
+// Extension of the binary companion of a text file (see MATRIX_SaveBinary)
+
+#define MATRIX_BINARY_EXT ".qdm"
+
 // Structures definitions
 // ----------------------
 
@@ -29,6 +33,7 @@ RC   MATRIX_Allocate(MATRIX_OBJECT *pMatrix,int nl,int nc,int basel,int basec,in
 void MATRIX_Free(MATRIX_OBJECT *pMatrix, const char *callingFunctionShort);
 RC   MATRIX_Copy(MATRIX_OBJECT *pTarget,MATRIX_OBJECT *pSource, const char *callingFunction);
 RC   MATRIX_Load(const char *fileName,MATRIX_OBJECT *pMatrix,int nl,int nc,double xmin,double xmax,int allocateDeriv2,int reverseFlag, const char *callingFunction);
+RC   MATRIX_SaveBinary(const char *fileName,const MATRIX_OBJECT *pMatrix,const char *sourceFile);
 
 #if defined(_cplusplus) || defined(__cplusplus)
 }
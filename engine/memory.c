@@ -48,6 +48,15 @@
 //  been replaced by new ones handling a stack of allocated objects and keeping
 //  a trace of the calling function.
 //
+//  In production (MEMORY_Alloc not called), allocations only update counters
+//  of the calling thread, which are summed by MEMORY_GetStatistics.  When the
+//  control is active, the allocated objects are registered in a hash table
+//  indexed by the address of the buffer, so that they are found in constant
+//  time at release.  Buckets are protected by a set of locks so that analysis
+//  threads don't wait for each other.  MEMORY_SetSampling allows to register
+//  only one allocation out of n of each thread, for leak tracking at a lower
+//  cost.
+//
 //  REFERENCE
 //
 //  Numerical Recipes in C
@@ -65,6 +74,8 @@
 //  MEMORY_Alloc - allocate memory for a stack in view of debugging the allocation/release application buffers;
 //  MEMORY_End - release the memory allocated for the stack by MEMORY_Alloc;
 //  MEMORY_GetInfo - retrieve from the stack the information about an allocated object;
+//  MEMORY_GetStatistics - number of allocations, releases and allocated bytes;
+//  MEMORY_SetSampling - register one allocation out of n in the stack;
 //
 //  ----------------------------------------------------------------------------
 
@@ -77,6 +88,7 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdio.h>
+#include <pthread.h>
 
 // ================
 // GLOBAL VARIABLES
@@ -101,17 +113,123 @@ const char *MEMORY_types[MEMORY_TYPE_MAX]=
 // STATIC VARIABLES
 // ================
 
-static MEMORY *memoryStack=NULL;                                                // stack with current allocated objects
-static int     memoryStackObjectsNumber=0;                                      // number of objects currently in the stack
-static int32_t    memoryStackBytesNumber=0;                                        // total size used by objects currently in the stack
-static int32_t    memoryMaxBytes=0;                                                // maximum number of bytes allocated in one time
-static int     memoryMaxObjects=0;                                              // maximum number of objects allocated in one time
-static int32_t    memoryMaxObjectsSize=0;                                          // total size used when maximum number of objects is reached
+#define MEMORY_HASH_SIZE  4096                                                  // number of buckets of the registry (power of 2)
+#define MEMORY_LOCKS_SIZE   64                                                  // number of locks protecting the buckets (power of 2)
+
+typedef struct _memoryNode
+ {
+  MEMORY object;                                                                // information on the allocated object
+  struct _memoryNode *next;                                                     // next object in the same bucket
+ }
+MEMORY_NODE;
+
+static MEMORY_NODE **memoryStack=NULL;                                          // registry of allocated objects (buckets)
+static pthread_mutex_t memoryStackLocks[MEMORY_LOCKS_SIZE];                     // locks for the buckets of the registry
+static long    memoryStackObjectsNumber=0;                                      // number of objects currently in the registry
+static long    memoryStackBytesNumber=0;                                        // total size used by objects currently in the registry
+static long    memoryMaxBytes=0;                                                // maximum number of bytes allocated in one time
+static long    memoryMaxObjects=0;                                              // maximum number of objects allocated in one time
+static long    memoryMaxObjectsSize=0;                                          // total size used when maximum number of objects is reached
+static int     memorySampling=1;                                                // register one allocated object out of memorySampling
+
+// Statistics of the calls to MEMORY_AllocBuffer and MEMORY_ReleaseBuffer.  Each
+// thread updates its own counters, so that threads don't share a cache line
+// at each allocation; MEMORY_GetStatistics sums the counters of all threads.
+
+typedef struct _memoryThread
+ {
+  long allocations;                                                             // number of calls to MEMORY_AllocBuffer
+  long releases;                                                                // number of calls to MEMORY_ReleaseBuffer
+  long bytes;                                                                   // total number of bytes requested to MEMORY_AllocBuffer
+  struct _memoryThread *next;                                                   // next thread in the list
+ }
+MEMORY_THREAD;
+
+static MEMORY_THREAD *memoryThreads=NULL;                                       // counters of the running threads
+static MEMORY_THREAD memoryFinished;                                            // counters of the threads that have ended
+static pthread_mutex_t memoryThreadsLock=PTHREAD_MUTEX_INITIALIZER;             // protect the list of threads
+static pthread_key_t memoryThreadKey;                                           // to release the counters when a thread ends
+static pthread_once_t memoryThreadKeyOnce=PTHREAD_ONCE_INIT;
+static __thread MEMORY_THREAD *memoryThread=NULL;                               // counters of the current thread
+
+// counters of the registry are updated by several threads without lock;
+// counters of a thread are only written by this thread and read by MEMORY_GetStatistics
+
+#define MEMORY_ATOMIC_ADD(counter,value) __atomic_add_fetch(&(counter),(value),__ATOMIC_RELAXED)
+#define MEMORY_ATOMIC_GET(counter)       __atomic_load_n(&(counter),__ATOMIC_RELAXED)
+#define MEMORY_THREAD_ADD(counter,value) __atomic_store_n(&(counter),(counter)+(value),__ATOMIC_RELAXED)
 
 // =========
 // FUNCTIONS
 // =========
 
+// bucket of the registry for a buffer
+
+static inline unsigned int MemoryHash(const void *pBuffer)
+ {
+  return (unsigned int)((((uintptr_t)pBuffer>>4)*2654435761u)&(MEMORY_HASH_SIZE-1));
+ }
+
+static inline pthread_mutex_t *MemoryLock(unsigned int bucket)
+ {
+  return &memoryStackLocks[bucket&(MEMORY_LOCKS_SIZE-1)];
+ }
+
+// MemoryThreadEnd : add the counters of a thread that ends to the counters of the finished threads
+
+static void MemoryThreadEnd(void *block)
+ {
+  MEMORY_THREAD *pThread=(MEMORY_THREAD *)block,**ppThread;
+
+  pthread_mutex_lock(&memoryThreadsLock);
+
+  for (ppThread=&memoryThreads;*ppThread!=NULL;ppThread=&(*ppThread)->next)
+   if (*ppThread==pThread)
+    {
+     *ppThread=pThread->next;
+     break;
+    }
+
+  memoryFinished.allocations+=pThread->allocations;
+  memoryFinished.releases+=pThread->releases;
+  memoryFinished.bytes+=pThread->bytes;
+
+  pthread_mutex_unlock(&memoryThreadsLock);
+
+  free(pThread);
+ }
+
+static void MemoryThreadKeyCreate(void)
+ {
+  pthread_key_create(&memoryThreadKey,MemoryThreadEnd);
+ }
+
+// MemoryThreadGet : counters of the current thread (registered at the first call)
+
+static MEMORY_THREAD *MemoryThreadGet(void)
+ {
+  if ((memoryThread==NULL) && ((memoryThread=(MEMORY_THREAD *)calloc(1,sizeof(MEMORY_THREAD)))!=NULL))
+   {
+    pthread_once(&memoryThreadKeyOnce,MemoryThreadKeyCreate);
+    pthread_setspecific(memoryThreadKey,memoryThread);
+
+    pthread_mutex_lock(&memoryThreadsLock);
+    memoryThread->next=memoryThreads;
+    memoryThreads=memoryThread;
+    pthread_mutex_unlock(&memoryThreadsLock);
+   }
+
+  return memoryThread;
+ }
+
+// keep the maximum of a counter
+
+static inline void MemoryMax(long *pMax,long value)
+ {
+  long max=MEMORY_ATOMIC_GET(*pMax);
+
+  while ((value>max) && !__atomic_compare_exchange_n(pMax,&max,value,0,__ATOMIC_RELAXED,__ATOMIC_RELAXED));
+ }
 
 // -----------------------------------------------------------------------------
 // FUNCTION      MEMORY_AllocBuffer
@@ -134,7 +252,9 @@ void *MEMORY_AllocBuffer(const char *callingFunctionName, const char *bufferName
 
   int totalSize;                                                                // requested total size in bytes number for the object
   char *pBuffer;                                                               // pointer to the new allocated buffer
-  MEMORY *pMemory;                                                              // pointer to the new allocated object
+  MEMORY_NODE *pNode;                                                           // pointer to the new registered object
+  long objectsNumber,bytesNumber;                                               // registry size after the allocation
+  unsigned int bucket;                                                          // bucket of the new object in the registry
 
   // Debugging
 
@@ -151,47 +271,64 @@ void *MEMORY_AllocBuffer(const char *callingFunctionName, const char *bufferName
 
   if ((totalSize<=0) || ((pBuffer=(char *)malloc(totalSize))==NULL))
    ERROR_SetLast(callingFunctionName,ERROR_TYPE_FATAL,ERROR_ID_ALLOC,bufferName,itemNumber,itemSize);
-  else if (memoryStack!=NULL)
+  else
    {
-    // Control the number of objects already allocated
-
-    if (memoryStackObjectsNumber==MEMORY_stackSize)
-     ERROR_SetLast(callingFunctionName,ERROR_TYPE_DEBUG,ERROR_ID_BUFFER_FULL,"allocated objects");
+    MEMORY_THREAD *pThread=MemoryThreadGet();
+    long allocations=0;
 
-    // Register the allocated object in the stack
+    if (pThread!=NULL)
+     {
+      allocations=pThread->allocations+1;
+      MEMORY_THREAD_ADD(pThread->allocations,1);
+      MEMORY_THREAD_ADD(pThread->bytes,totalSize);
+     }
 
-    else
+    if ((memoryStack!=NULL) && ((memorySampling<=1) || (allocations%memorySampling==0)))
      {
-      // Save data on the new allocated object
+      // Control the number of objects already registered
 
-      pMemory=&memoryStack[memoryStackObjectsNumber];
+      if (MEMORY_ATOMIC_GET(memoryStackObjectsNumber)>=MEMORY_stackSize)
+       ERROR_SetLast(callingFunctionName,ERROR_TYPE_DEBUG,ERROR_ID_BUFFER_FULL,"allocated objects");
 
-      memset(pMemory,0,sizeof(MEMORY));
+      // Register the allocated object
 
-      strncpy(pMemory->callingFunctionName,callingFunctionName,MAX_FCT_LEN);
-      strncpy(pMemory->bufferName,bufferName,MAX_VAR_LEN);
+      else if ((pNode=(MEMORY_NODE *)malloc(sizeof(MEMORY_NODE)))!=NULL)
+       {
+        // Save data on the new allocated object
 
-      pMemory->pBuffer=(char *)pBuffer;
-      pMemory->itemNumber=itemNumber;
-      pMemory->itemSize=itemSize;
-      pMemory->offset=offset;
-      pMemory->type=type;
+        memset(pNode,0,sizeof(MEMORY_NODE));
 
-      memoryStackObjectsNumber++;
-      memoryStackBytesNumber+=totalSize;
+        strncpy(pNode->object.callingFunctionName,callingFunctionName,MAX_FCT_LEN);
+        strncpy(pNode->object.bufferName,bufferName,MAX_VAR_LEN);
 
-      // maximum number of objects allocated in one time
+        pNode->object.pBuffer=(char *)pBuffer;
+        pNode->object.itemNumber=itemNumber;
+        pNode->object.itemSize=itemSize;
+        pNode->object.offset=offset;
+        pNode->object.type=type;
 
-      if (memoryStackObjectsNumber>memoryMaxObjects)
-       {
-        memoryMaxObjects=memoryStackObjectsNumber;
-        memoryMaxObjectsSize=memoryStackBytesNumber;
-       }
+        bucket=MemoryHash(pBuffer);
+
+        pthread_mutex_lock(MemoryLock(bucket));
+        pNode->next=memoryStack[bucket];
+        memoryStack[bucket]=pNode;
+        pthread_mutex_unlock(MemoryLock(bucket));
+
+        objectsNumber=MEMORY_ATOMIC_ADD(memoryStackObjectsNumber,1);
+        bytesNumber=MEMORY_ATOMIC_ADD(memoryStackBytesNumber,totalSize);
+
+        // maximum number of objects allocated in one time
 
-      // maximum number of bytes allocated in one time
+        if (objectsNumber>MEMORY_ATOMIC_GET(memoryMaxObjects))
+         {
+          MemoryMax(&memoryMaxObjects,objectsNumber);
+          __atomic_store_n(&memoryMaxObjectsSize,bytesNumber,__ATOMIC_RELAXED);
+         }
 
-      if (memoryStackBytesNumber>memoryMaxBytes)
-       memoryMaxBytes=memoryStackBytesNumber;
+        // maximum number of bytes allocated in one time
+
+        MemoryMax(&memoryMaxBytes,bytesNumber);
+       }
      }
    }
 
@@ -199,7 +336,7 @@ void *MEMORY_AllocBuffer(const char *callingFunctionName, const char *bufferName
 
   #if defined(__DEBUG_) && __DEBUG_
   DEBUG_Print("Allocate %s (%d bytes) --- Address %08X --- Stack size %d objects (%d bytes)\n",
-               bufferName,totalSize,pBuffer,memoryStackObjectsNumber,memoryStackBytesNumber);
+               bufferName,totalSize,pBuffer,(int)memoryStackObjectsNumber,(int)memoryStackBytesNumber);
   DEBUG_FunctionStop("MEMORY_AllocBuffer",(RC)pBuffer);
   #endif
 
@@ -225,9 +362,8 @@ void MEMORY_ReleaseBuffer(const char *callingFunctionName, const char *bufferNam
  {
   // Declarations
 
-  INDEX   indexObjects;                                                         // Browse objects in the stack
-  MEMORY *pMemory;                                                              // pointer to an object in the stack
-  uint32_t   totalSize;                                                            // total size in bytes of the pointed object
+  MEMORY_NODE **ppNode,*pNode;                                                  // browse objects in the bucket
+  unsigned int bucket;                                                          // bucket of the object in the registry
 
   // Debugging
 
@@ -235,31 +371,40 @@ void MEMORY_ReleaseBuffer(const char *callingFunctionName, const char *bufferNam
   DEBUG_FunctionBegin("MEMORY_ReleaseBuffer",DEBUG_FCTTYPE_MEM);
   #endif
 
+  if ((pBuffer!=NULL) && (MemoryThreadGet()!=NULL))
+   MEMORY_THREAD_ADD(memoryThread->releases,1);
+
   if (memoryStack!=NULL)
    {
-    // Initializations
+    bucket=MemoryHash(pBuffer);
+    pNode=NULL;
 
-    // browse objects in the stack
+    // remove object from its bucket
 
-    for (indexObjects=memoryStackObjectsNumber-1;indexObjects>=0;indexObjects--)
-     if (memoryStack[indexObjects].pBuffer==(char *)pBuffer)
-      break;
+    pthread_mutex_lock(MemoryLock(bucket));
 
-    // remove object from the stack
+    for (ppNode=&memoryStack[bucket];*ppNode!=NULL;ppNode=&(*ppNode)->next)
+     if ((*ppNode)->object.pBuffer==(char *)pBuffer)
+      {
+       pNode=*ppNode;
+       *ppNode=pNode->next;
+       break;
+      }
 
-    if (indexObjects<0){
-     ERROR_SetLast(callingFunctionName,ERROR_TYPE_DEBUG,ERROR_ID_MEMORY_RELEASE,bufferName,pBuffer);
-    }
-    else
-     {
-      pMemory=&memoryStack[indexObjects];
-      totalSize=pMemory->itemSize*pMemory->itemNumber;
+    pthread_mutex_unlock(MemoryLock(bucket));
 
-      memoryStackBytesNumber-=totalSize;
-      memoryStackObjectsNumber--;
+    // with sampling, most of the objects are not registered
 
-      if (indexObjects<memoryStackObjectsNumber)
-       memcpy(pMemory,&memoryStack[indexObjects+1],sizeof(MEMORY)*(memoryStackObjectsNumber-indexObjects));
+    if (pNode==NULL)
+     {
+      if (memorySampling<=1)
+       ERROR_SetLast(callingFunctionName,ERROR_TYPE_DEBUG,ERROR_ID_MEMORY_RELEASE,bufferName,pBuffer);
+     }
+    else
+     {
+      MEMORY_ATOMIC_ADD(memoryStackBytesNumber,-(long)pNode->object.itemSize*pNode->object.itemNumber);
+      MEMORY_ATOMIC_ADD(memoryStackObjectsNumber,-1);
+      free(pNode);
      }
    }
 
@@ -272,7 +417,7 @@ void MEMORY_ReleaseBuffer(const char *callingFunctionName, const char *bufferNam
   // Debugging
 
   #if defined(__DEBUG_) && __DEBUG_
-  DEBUG_Print("Release %s --- Address %08X --- Stack size %d objects (%d bytes)\n",bufferName,pBuffer,memoryStackObjectsNumber,memoryStackBytesNumber);
+  DEBUG_Print("Release %s --- Address %08X --- Stack size %d objects (%d bytes)\n",bufferName,pBuffer,(int)memoryStackObjectsNumber,(int)memoryStackBytesNumber);
   DEBUG_FunctionStop("MEMORY_ReleaseBuffer",0);
   #endif
  }
@@ -489,10 +634,13 @@ RC MEMORY_Alloc(void)
     memoryMaxObjects=
     memoryMaxObjectsSize=0;
 
-    // Allocate the stack
+    for (int i=0;i<MEMORY_LOCKS_SIZE;i++)
+     pthread_mutex_init(&memoryStackLocks[i],NULL);
+
+    // Allocate the buckets of the registry
 
-    if ((memoryStack=(MEMORY *)malloc(MEMORY_stackSize*sizeof(MEMORY)))==NULL)
-     rc=ERROR_SetLast("MEMORY_Alloc",ERROR_TYPE_DEBUG,ERROR_ID_ALLOC,"memoryStack",MEMORY_stackSize,sizeof(MEMORY));
+    if ((memoryStack=(MEMORY_NODE **)calloc(MEMORY_HASH_SIZE,sizeof(MEMORY_NODE *)))==NULL)
+     rc=ERROR_SetLast("MEMORY_Alloc",ERROR_TYPE_DEBUG,ERROR_ID_ALLOC,"memoryStack",MEMORY_HASH_SIZE,sizeof(MEMORY_NODE *));
    }
 
   // Return
@@ -516,7 +664,7 @@ RC MEMORY_End(void)
  {
   // Declarations
 
-  INDEX   indexObjects;                                                         // browse remaining objects in the stack
+  MEMORY_NODE *pNode,*pNext;                                                    // browse remaining objects in the registry
   MEMORY *pMemory;                                                              // pointer to an allocated object
   RC rc;                                                                        // return code
 
@@ -534,31 +682,42 @@ RC MEMORY_End(void)
    rc=ERROR_SetLast("MEMORY_End",ERROR_TYPE_DEBUG,ERROR_ID_MEMORY_STACKNOTALLOCATED);
   else
    {
-   	// Browse remaining objects in the stack
+   	// Browse remaining objects in the registry
+
+   	DEBUG_Print("Number of remaining objects in the stack : %ld\n",memoryStackObjectsNumber);
+    long allocations,releases;
 
-   	DEBUG_Print("Number of remaining objects in the stack : %d\n",memoryStackObjectsNumber);
+    MEMORY_GetStatistics(&allocations,&releases,NULL);
+   	DEBUG_Print("Allocations : %ld, releases : %ld, maximum size : %ld bytes\n",allocations,releases,memoryMaxBytes);
 
    	if (memoryStackObjectsNumber>0)
    	 {
-   	  rc=ERROR_SetLast("MEMORY_End",ERROR_TYPE_DEBUG,ERROR_ID_MEMORY_STACKNOTEMPTY,memoryStackObjectsNumber);
+   	  rc=ERROR_SetLast("MEMORY_End",ERROR_TYPE_DEBUG,ERROR_ID_MEMORY_STACKNOTEMPTY,(int)memoryStackObjectsNumber);
       DEBUG_Print("Allocation/Release error(s) : \n");
+     }
 
-      for (indexObjects=0;indexObjects<memoryStackObjectsNumber;indexObjects++)
-       {
-        pMemory=&memoryStack[indexObjects];
+    for (int i=0;i<MEMORY_HASH_SIZE;i++)
+     for (pNode=memoryStack[i];pNode!=NULL;pNode=pNext)
+      {
+       pMemory=&pNode->object;
+       pNext=pNode->next;
 
-        DEBUG_Print("%-32s %-32s %#8.3fK %08x\n",
-                    pMemory->callingFunctionName,
-                    pMemory->bufferName,
-             (float)pMemory->itemNumber*pMemory->itemSize/1024.,
-                    pMemory->pBuffer);
-       }
-     }
+       DEBUG_Print("%-32s %-32s %#8.3fK %08x\n",
+                   pMemory->callingFunctionName,
+                   pMemory->bufferName,
+            (float)pMemory->itemNumber*pMemory->itemSize/1024.,
+                   pMemory->pBuffer);
 
-    // Release the allocated stack
+       free(pNode);
+      }
+
+    // Release the allocated registry
 
     free(memoryStack);
 
+    for (int i=0;i<MEMORY_LOCKS_SIZE;i++)
+     pthread_mutex_destroy(&memoryStackLocks[i]);
+
  	  // Reinitialize all the static variables handling the stack
 
     memoryStackObjectsNumber=
@@ -602,7 +761,7 @@ RC MEMORY_GetInfo(DEBUG_VARIABLE *pVariable,char *pBuffer)
  	// Declarations
 
   MEMORY *pMemory;                                                              // pointer to an object in the stack
- 	INDEX i;                                                                      // browse objects in the stack
+  MEMORY_NODE *pNode;                                                           // browse objects in the registry
  	RC rc;                                                                        // return code
 
  	// Initialization
@@ -617,21 +776,29 @@ RC MEMORY_GetInfo(DEBUG_VARIABLE *pVariable,char *pBuffer)
    {
     memset(pVariable,0,sizeof(DEBUG_VARIABLE));
 
-   	// Browse objects in the stack
+   	// Browse objects in the registry (pBuffer is shifted by the base index, so it is
+   	// not the key of the hash table)
 
-   	for (i=0;i<memoryStackObjectsNumber;i++)
-   	 if (memoryStack[i].pBuffer-memoryStack[i].offset*memoryStack[i].itemSize==pBuffer)
-   	  break;
+   	pNode=NULL;
+
+   	for (int i=0;(i<MEMORY_HASH_SIZE) && (pNode==NULL);i++)
+   	 {
+   	  pthread_mutex_lock(MemoryLock(i));
+   	  for (pNode=memoryStack[i];pNode!=NULL;pNode=pNode->next)
+   	   if (pNode->object.pBuffer-pNode->object.offset*pNode->object.itemSize==pBuffer)
+   	    break;
+   	  pthread_mutex_unlock(MemoryLock(i));
+   	 }
 
    	// Object not found
 
-   	if (i>=memoryStackObjectsNumber)
+   	if (pNode==NULL)
    	 rc=ERROR_SetLast("MEMORY_GetInfo",ERROR_TYPE_DEBUG,ERROR_ID_MEMORY_OBJECTNOTFOUND,pBuffer);
    	else
    	 {
    	  // Retrieve information on the found object
 
-   	  pMemory=&memoryStack[i];
+   	  pMemory=&pNode->object;
 
    	  strncpy(pVariable->varName,pMemory->bufferName,MAX_VAR_LEN);
    	  pVariable->varData.ucharVector=(char *)pMemory->pBuffer;
@@ -651,23 +818,11 @@ RC MEMORY_GetInfo(DEBUG_VARIABLE *pVariable,char *pBuffer)
    	    pVariable->varMatrixFlag=0;
    	   }
 
-   	  // The variable to debug is a matrix
+   	  // The variable to debug is a matrix: the buffer with the columns is
+   	  // allocated by MEMORY_AllocDMatrix but not registered
 
-   	  else if (i+1>=memoryStackObjectsNumber)
-   	   rc=ERROR_SetLast("MEMORY_GetInfo",ERROR_TYPE_DEBUG,ERROR_ID_MEMORY_DEFMATRIX,pMemory->bufferName);
    	  else
-   	   {
-   	    pVariable->varType=(pMemory+1)->type;
-   	    pVariable->varNl=(pMemory+1)->itemNumber;
-   	    pVariable->varNlOff=(pMemory+1)->offset;
-   	    pVariable->varNc=pMemory->itemNumber;
-   	    pVariable->varNcOff=pMemory->offset;
-   	    pVariable->varNlMin=0;
-   	    pVariable->varNlMax=pVariable->varNl-1;
-   	    pVariable->varNcMin=0;
-   	    pVariable->varNcMax=pVariable->varNc-1;
-   	    pVariable->varMatrixFlag=1;
-   	   }
+   	   rc=ERROR_SetLast("MEMORY_GetInfo",ERROR_TYPE_DEBUG,ERROR_ID_MEMORY_DEFMATRIX,pMemory->bufferName);
    	 }
    }
 
@@ -675,3 +830,55 @@ RC MEMORY_GetInfo(DEBUG_VARIABLE *pVariable,char *pBuffer)
 
   return rc;
  }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      MEMORY_GetStatistics
+// -----------------------------------------------------------------------------
+// PURPOSE       Retrieve the number of calls to MEMORY_AllocBuffer and
+//               MEMORY_ReleaseBuffer and the total number of bytes allocated
+//
+// OUTPUT        pAllocations, pReleases, pBytes (can be NULL)
+//
+// NB            available also when the stack is not allocated; counters of the
+//               threads that are running are read while they may change
+// -----------------------------------------------------------------------------
+
+void MEMORY_GetStatistics(long *pAllocations,long *pReleases,long *pBytes)
+ {
+  MEMORY_THREAD total;
+
+  pthread_mutex_lock(&memoryThreadsLock);
+
+  total=memoryFinished;
+
+  for (MEMORY_THREAD *pThread=memoryThreads;pThread!=NULL;pThread=pThread->next)
+   {
+    total.allocations+=MEMORY_ATOMIC_GET(pThread->allocations);
+    total.releases+=MEMORY_ATOMIC_GET(pThread->releases);
+    total.bytes+=MEMORY_ATOMIC_GET(pThread->bytes);
+   }
+
+  pthread_mutex_unlock(&memoryThreadsLock);
+
+  if (pAllocations!=NULL)
+   *pAllocations=total.allocations;
+  if (pReleases!=NULL)
+   *pReleases=total.releases;
+  if (pBytes!=NULL)
+   *pBytes=total.bytes;
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      MEMORY_SetSampling
+// -----------------------------------------------------------------------------
+// PURPOSE       Register only one allocation out of n of each thread in the
+//               stack of allocated objects (1 to register all of them)
+//
+// NB            should be set before MEMORY_Alloc; with sampling, releasing an
+//               object that is not registered is not an error
+// -----------------------------------------------------------------------------
+
+void MEMORY_SetSampling(int n)
+ {
+  memorySampling=(n>1)?n:1;
+ }
@@ -262,6 +262,16 @@ void NetCDFGroup::defVarChunking(const string& name, int storage, size_t *chunks
   defVarChunking(varID(name), storage, chunksizes);
 }
 
+void NetCDFGroup::inqVarChunking(int varid, int *storage, size_t *chunksizes) const {
+  if (nc_inq_var_chunking(groupid, varid, storage, chunksizes) != NC_NOERR) {
+    throw std::runtime_error("Error reading variable chunking for '" + varName(varid) + "' in group '" + name + "'");
+  }
+}
+
+void NetCDFGroup::inqVarChunking(const string& name, int *storage, size_t *chunksizes) const {
+  inqVarChunking(varID(name), storage, chunksizes);
+}
+
 void NetCDFGroup::defVarDeflate(int varid, int shuffle, int deflate, int deflate_level) {
   assert(deflate_level && deflate_level <= 9);
   if (nc_def_var_deflate(groupid, varid, shuffle, deflate, deflate_level) != NC_NOERR) {
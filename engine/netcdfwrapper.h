@@ -52,6 +52,8 @@ public:
   int defVar(const std::string& name, const std::vector<std::string>& dimnames, nc_type xtype);
   void defVarChunking(int varid, int storage, size_t *chunksizes);
   void defVarChunking(const std::string& name, int storage, size_t *chunksizes);
+  void inqVarChunking(int varid, int *storage, size_t *chunksizes) const;
+  void inqVarChunking(const std::string& name, int *storage, size_t *chunksizes) const;
   void defVarDeflate(int varid, int shuffle=1, int deflate=1, int deflate_level=7);
   void defVarDeflate(const std::string& name, int shuffle=1, int deflate=1, int deflate_level=7);
   void defVarFletcher32(int varid, int fletcher32=NC_FLETCHER32);
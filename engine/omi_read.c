@@ -51,6 +51,7 @@
 #include <mfhdf.h>
 
 #include "omi_read.h"
+#include "geoindex.h"
 
 #include "engine_context.h"
 #include "spline.h"
@@ -193,6 +194,7 @@ static bool automatic_reference_ok[OMI_TOTAL_ROWS]; // array to keep track if au
 
 int omiSwathOld=ITEM_NONE;
 
+static RC OmiAttachSwath(struct omi_orbit_file *pOrbitFile,const char *swathName);
 static RC OmiOpen(struct omi_orbit_file *pOrbitFile,const char *swathName, const ENGINE_CONTEXT *pEngineContext);
 static void omi_free_swath_data(struct omi_swath_earth *pSwath);
 static void omi_calculate_wavelengths(float32 wavelength_coeff[], int16 refcol, int32 n_wavel, double* lambda);
@@ -543,6 +545,8 @@ static RC read_reference_orbit_files(const char *spectrum_file) {
             sprintf(file_name,"%s%c%s",current_dir,PATH_SEP,fileInfo->d_name);
             reference_orbit_files[num_reference_orbit_files]->omiFileName = file_name;
             reference_orbit_files[num_reference_orbit_files]->omiSwath = NULL;
+            reference_orbit_files[num_reference_orbit_files]->swf_id = 0;
+            reference_orbit_files[num_reference_orbit_files]->sw_id = 0;
             num_reference_orbit_files++;
           }
       }
@@ -555,7 +559,7 @@ static RC read_reference_orbit_files(const char *spectrum_file) {
 }
 
 // check if a given spectrum matches the criteria to use it in the automatic reference spectrum
-static bool use_as_reference(struct omi_orbit_file *orbit_file, int recordnumber, FENO *pTabFeno, enum omi_xtrack_mode xtrack_mode) {
+static bool use_as_reference(const GEOINDEX_RECORD *record, FENO *pTabFeno, enum omi_xtrack_mode xtrack_mode) {
   float lon_min = pTabFeno->refLonMin;
   float lon_max = pTabFeno->refLonMax;
   float lat_min = pTabFeno->refLatMin;
@@ -563,11 +567,11 @@ static bool use_as_reference(struct omi_orbit_file *orbit_file, int recordnumber
   float sza_min = pTabFeno->refSZA - pTabFeno->refSZADelta;
   float sza_max = pTabFeno->refSZA + pTabFeno->refSZADelta;
 
-  float lon = orbit_file->omiSwath->dataFields.longitude[recordnumber];
-  float lat = orbit_file->omiSwath->dataFields.latitude[recordnumber];
-  float sza = orbit_file->omiSwath->dataFields.solarZenithAngle[recordnumber];
+  float lon = record->longitude;
+  float lat = record->latitude;
+  float sza = record->sza;
 
-  int xTrackQF = orbit_file->omiSwath->dataFields.xtrackQualityFlags[recordnumber];
+  int xTrackQF = record->flags;
 
   bool use_row = omi_use_track(xTrackQF, xtrack_mode);
 
@@ -644,56 +648,95 @@ static void free_row_references(struct omi_ref_list *(*row_references)[NFeno][OM
   free(row_references);
 }
 
-/* Read the geolocation data of all spectra in an orbit file and store
- * spectra matching the search criteria for the automatic reference
- * spectrum for one or more analysis windows in a list.
+/* Build the geolocation index of an orbit file (see geoindex.h) from
+ * its swath data.  dim holds the dimensions of the swath and a flag
+ * telling if the file has XTrackQualityFlags.
  */
-static RC find_matching_spectra(const ENGINE_CONTEXT *pEngineContext, struct omi_orbit_file *orbit_file, struct omi_ref_list *(*row_references)[NFeno][OMI_TOTAL_ROWS], struct omi_ref_spectrum **first)
+static RC build_geolocation_index(const struct omi_orbit_file *orbit_file, GEOINDEX *index)
+{
+  const struct omi_data *data = &orbit_file->omiSwath->dataFields;
+
+  RC rc = GEOINDEX_Alloc(index, orbit_file->specNumber);
+  if (rc)
+    return rc;
+
+  index->dim[0] = orbit_file->nMeasurements;
+  index->dim[1] = orbit_file->nXtrack;
+  index->dim[2] = orbit_file->nWavel;
+  index->dim[3] = data->have_xtrack_quality_flags;
+
+  for (int i=0; i < index->nRecords; i++) {
+    GEOINDEX_RECORD *record = &index->records[i];
+    record->latitude = data->latitude[i];
+    record->longitude = data->longitude[i]; // already in the range 0-360
+    record->sza = data->solarZenithAngle[i];
+    record->vza = data->viewingZenithAngle[i];
+    record->cloudFraction = -1.;
+    record->flags = data->have_xtrack_quality_flags ? data->xtrackQualityFlags[i] : 0;
+    record->record = i;
+  }
+
+  return rc;
+}
+
+/* Look in the geolocation index of an orbit file for the spectra
+ * matching the search criteria for the automatic reference spectrum
+ * for one or more analysis windows, and read them into a list.  The
+ * swath is only attached when a spectrum has to be read.
+ */
+static RC find_matching_spectra(const ENGINE_CONTEXT *pEngineContext, struct omi_orbit_file *orbit_file, const GEOINDEX *index, struct omi_ref_list *(*row_references)[NFeno][OMI_TOTAL_ROWS], struct omi_ref_spectrum **first)
 {
   RC rc = 0;
 
   enum omi_xtrack_mode xtrack_mode = pEngineContext->project.instrumental.omi.xtrack_mode;
 
-  for (int measurement=0; measurement < orbit_file->nMeasurements; measurement++) {
-    for(int row = 0; row < orbit_file->nXtrack; row++) {
-      if (pEngineContext->project.instrumental.use_row[row]) {
-
-        int recordnumber = measurement*orbit_file->nXtrack + row;
-        struct omi_ref_spectrum *newref = NULL; // will be allocated and used only if the spectrum is used in the automatic reference calculation for one of the analysis windows.
-
-        // loop over all analysis windows and look if the current
-        // spectrum can be used in the automatic reference for any of
-        // them.
-        for(int analysis_window = 0; analysis_window<NFeno; analysis_window++) {
-
-          FENO *pTabFeno = &TabFeno[row][analysis_window];
-          if (!pTabFeno->hidden
-              && pTabFeno->useKurucz!=ANLYS_KURUCZ_SPEC
-              && pTabFeno->refSpectrumSelectionMode==ANLYS_REF_SELECTION_MODE_AUTOMATIC
-              && use_as_reference(orbit_file,recordnumber,pTabFeno, xtrack_mode)) {
-
-            // create new spectrum structure if needed.  If the spectrum is already used for another analysis window, we can reuse the existing spectrum.
-            if(newref == NULL) {
-              newref = malloc(sizeof (struct omi_ref_spectrum));
-              newref->measurement_number = measurement;
-              newref->next = *first;
-              *first = newref; // add spectrum to the list of all spectra
-              newref->orbit_file = orbit_file;
-              newref->spectrum = malloc(orbit_file->nWavel * sizeof(*newref->spectrum));
-              newref->errors = malloc(orbit_file->nWavel * sizeof(*newref->errors));
-              newref->wavelengths = malloc(orbit_file->nWavel * sizeof(*newref->wavelengths));
-
-              rc = omi_load_spectrum(OMI_SPEC_RAD, orbit_file->sw_id, measurement, row, orbit_file->nWavel, newref->wavelengths, newref->spectrum, newref->errors, NULL);
-
-              if(rc)
+  for (int i=0; i < index->nRecords; i++) {
+    const GEOINDEX_RECORD *record = &index->records[i];
+    const int measurement = record->record / orbit_file->nXtrack;
+    const int row = record->record % orbit_file->nXtrack;
+
+    if (pEngineContext->project.instrumental.use_row[row]) {
+
+      struct omi_ref_spectrum *newref = NULL; // will be allocated and used only if the spectrum is used in the automatic reference calculation for one of the analysis windows.
+
+      // loop over all analysis windows and look if the current
+      // spectrum can be used in the automatic reference for any of
+      // them.
+      for(int analysis_window = 0; analysis_window<NFeno; analysis_window++) {
+
+        FENO *pTabFeno = &TabFeno[row][analysis_window];
+        if (!pTabFeno->hidden
+            && pTabFeno->useKurucz!=ANLYS_KURUCZ_SPEC
+            && pTabFeno->refSpectrumSelectionMode==ANLYS_REF_SELECTION_MODE_AUTOMATIC
+            && use_as_reference(record,pTabFeno, xtrack_mode)) {
+
+          // create new spectrum structure if needed.  If the spectrum is already used for another analysis window, we can reuse the existing spectrum.
+          if(newref == NULL) {
+            if (orbit_file->sw_id == 0) {
+              rc = OmiAttachSwath(orbit_file,OMI_EarthSwaths[pEngineContext->project.instrumental.omi.spectralType]);
+              if (rc)
                 goto end_find_matching_spectra;
             }
 
-            struct omi_ref_list *list_item = malloc(sizeof(struct omi_ref_list));
-            list_item->reference = newref;
-            list_item->next = (*row_references)[analysis_window][row];
-            (*row_references)[analysis_window][row] = list_item; // add reference to the list of spectra for this analysis window/row
+            newref = malloc(sizeof (struct omi_ref_spectrum));
+            newref->measurement_number = measurement;
+            newref->next = *first;
+            *first = newref; // add spectrum to the list of all spectra
+            newref->orbit_file = orbit_file;
+            newref->spectrum = malloc(orbit_file->nWavel * sizeof(*newref->spectrum));
+            newref->errors = malloc(orbit_file->nWavel * sizeof(*newref->errors));
+            newref->wavelengths = malloc(orbit_file->nWavel * sizeof(*newref->wavelengths));
+
+            rc = omi_load_spectrum(OMI_SPEC_RAD, orbit_file->sw_id, measurement, row, orbit_file->nWavel, newref->wavelengths, newref->spectrum, newref->errors, NULL);
+
+            if(rc)
+              goto end_find_matching_spectra;
           }
+
+          struct omi_ref_list *list_item = malloc(sizeof(struct omi_ref_list));
+          list_item->reference = newref;
+          list_item->next = (*row_references)[analysis_window][row];
+          (*row_references)[analysis_window][row] = list_item; // add reference to the list of spectra for this analysis window/row
         }
       }
     }
@@ -767,19 +810,46 @@ static RC setup_automatic_reference(ENGINE_CONTEXT *pEngineContext, void *respon
   if(rc)
     goto end_setup_automatic_reference;
 
-  // open each reference orbit file; find & read matching spectra in the file
+  // find & read matching spectra in each reference orbit file
+  const char *swathName = OMI_EarthSwaths[pEngineContext->project.instrumental.omi.spectralType];
   for(int i = 0; i < num_reference_orbit_files; i++) {
     struct omi_orbit_file *orbit_file = reference_orbit_files[i];
-    rc = OmiOpen(orbit_file,OMI_EarthSwaths[pEngineContext->project.instrumental.omi.spectralType], pEngineContext);
-    if (rc)
-      goto end_setup_automatic_reference;
+    GEOINDEX index;
+
+    // The geolocation index of the orbit file is kept in the cache
+    // directory, if any: when it is found, the orbit file is only
+    // opened to read the selected spectra.
+    if (GEOINDEX_Load(&index, swathName, orbit_file->omiFileName)) {
+      orbit_file->nMeasurements = index.dim[0];
+      orbit_file->nXtrack = index.dim[1];
+      orbit_file->nWavel = index.dim[2];
+      orbit_file->specNumber = orbit_file->nMeasurements*orbit_file->nXtrack;
+
+      if (!index.dim[3] && pEngineContext->project.instrumental.omi.xtrack_mode != XTRACKQF_IGNORE) {
+        rc = ERROR_SetLast(__func__, ERROR_TYPE_FATAL, ERROR_ID_HDFEOS, "XTrackQualityFlags", orbit_file->omiFileName,
+                           "File does not contain XTrackQualityFlags", "");
+        GEOINDEX_Free(&index);
+        goto end_setup_automatic_reference;
+      }
+    } else {
+      rc = OmiOpen(orbit_file, swathName, pEngineContext);
+      if (!rc)
+        rc = build_geolocation_index(orbit_file, &index);
+      if (rc)
+        goto end_setup_automatic_reference;
+
+      GEOINDEX_Save(&index, swathName, orbit_file->omiFileName);
+
+      // the index holds everything needed to select the spectra, so we can free the swath data
+      omi_free_swath_data(orbit_file->omiSwath);
+      orbit_file->omiSwath = NULL;
+    }
 
     // add matching spectra in this orbit file to the lists row_references & ref_candidates
-    find_matching_spectra(pEngineContext, orbit_file, row_references, &ref_candidates);
+    find_matching_spectra(pEngineContext, orbit_file, &index, row_references, &ref_candidates);
 
-    // relevant data has been copied to ref_candidates, so we can free the swath data, and close the orbit file
-    omi_free_swath_data(orbit_file->omiSwath);
-    orbit_file->omiSwath = NULL;
+    // relevant data has been copied to ref_candidates, so we can close the orbit file
+    GEOINDEX_Free(&index);
     omi_close_orbit_file(reference_orbit_files[i]);
   }
 
@@ -954,7 +1024,8 @@ static RC OmiGetSwathData(struct omi_orbit_file *pOrbitFile, const ENGINE_CONTEX
   return rc;
 }
 
-  static RC OmiOpen(struct omi_orbit_file *pOrbitFile,const char *swathName, const ENGINE_CONTEXT *pEngineContext)
+// Open an orbit file, attach the requested swath and get its dimensions (no data is read).
+static RC OmiAttachSwath(struct omi_orbit_file *pOrbitFile,const char *swathName)
 {
   RC rc = ERROR_ID_NO;
 
@@ -962,7 +1033,7 @@ static RC OmiGetSwathData(struct omi_orbit_file *pOrbitFile, const ENGINE_CONTEX
   int32 swf_id = SWopen(pOrbitFile->omiFileName, DFACC_READ);
   if (swf_id == FAIL) {
     rc = ERROR_SetLast(__func__,ERROR_TYPE_FATAL,ERROR_ID_HDFEOS,__func__,pOrbitFile->omiFileName,"SWopen");
-    goto end_OmiOpen;
+    goto end_OmiAttachSwath;
   }
   pOrbitFile->swf_id = swf_id;
 
@@ -971,7 +1042,7 @@ static RC OmiGetSwathData(struct omi_orbit_file *pOrbitFile, const ENGINE_CONTEX
   int nswath = SWinqswath(pOrbitFile->omiFileName, NULL, &strbufsize);
   if(nswath == FAIL) {
     rc = ERROR_SetLast(__func__, ERROR_TYPE_FATAL, ERROR_ID_HDFEOS, "SWinqswath", pOrbitFile->omiFileName);
-    goto end_OmiOpen;
+    goto end_OmiAttachSwath;
   } else {
     char swathlist[strbufsize+1];
     SWinqswath(pOrbitFile->omiFileName, swathlist, &strbufsize);
@@ -984,7 +1055,7 @@ static RC OmiGetSwathData(struct omi_orbit_file *pOrbitFile, const ENGINE_CONTEX
     char *swath_full_name = strstr(swathlist,swathName);
     if (swath_full_name == NULL) {
     rc = ERROR_SetLast(__func__,ERROR_TYPE_FATAL,ERROR_ID_HDFEOS,__func__,pOrbitFile->omiFileName,"find swath");
-    goto end_OmiOpen;
+    goto end_OmiAttachSwath;
     }
     char *end_name = strpbrk(swath_full_name,",");
 
@@ -994,7 +1065,7 @@ static RC OmiGetSwathData(struct omi_orbit_file *pOrbitFile, const ENGINE_CONTEX
     int32 sw_id = SWattach(swf_id, swath_full_name); // attach the swath
     if (sw_id == FAIL) {
       rc = ERROR_SetLast(__func__, ERROR_TYPE_FATAL,ERROR_ID_HDFEOS,__func__,pOrbitFile->omiFileName,"SWattach");
-      goto end_OmiOpen;
+      goto end_OmiAttachSwath;
     }
     pOrbitFile->sw_id = sw_id;
 
@@ -1005,7 +1076,7 @@ static RC OmiGetSwathData(struct omi_orbit_file *pOrbitFile, const ENGINE_CONTEX
     intn swrc = SWfieldinfo(sw_id, (char *) "RadianceMantissa",&rank,dims,&numbertype , dimlist);
     if(swrc == FAIL) {
       rc=ERROR_SetLast(__func__, ERROR_TYPE_FATAL, ERROR_ID_FILE_EMPTY,pOrbitFile->omiFileName);
-      goto end_OmiOpen;
+      goto end_OmiAttachSwath;
     }
 
     pOrbitFile->nMeasurements=(long)dims[0];
@@ -1014,24 +1085,33 @@ static RC OmiGetSwathData(struct omi_orbit_file *pOrbitFile, const ENGINE_CONTEX
 
     pOrbitFile->specNumber=pOrbitFile->nMeasurements*pOrbitFile->nXtrack;
     if (!pOrbitFile->specNumber) {
-      return ERROR_SetLast(__func__,ERROR_TYPE_FATAL,ERROR_ID_FILE_EMPTY,pOrbitFile->omiFileName);
+      rc=ERROR_SetLast(__func__,ERROR_TYPE_FATAL,ERROR_ID_FILE_EMPTY,pOrbitFile->omiFileName);
     }
+  }
+
+ end_OmiAttachSwath:
+  return rc;
+}
 
+static RC OmiOpen(struct omi_orbit_file *pOrbitFile,const char *swathName, const ENGINE_CONTEXT *pEngineContext)
+{
+  RC rc = OmiAttachSwath(pOrbitFile,swathName);
+
+  if (!rc) {
     // Allocate data
     rc=OMI_AllocateSwath(&pOrbitFile->omiSwath,pOrbitFile->nMeasurements,pOrbitFile->nXtrack,pOrbitFile->nWavel);
+  }
 
-    if (!rc) {
-      // Retrieve information on records from Data fields and Geolocation fields
-      rc=OmiGetSwathData(pOrbitFile, pEngineContext);
-    }
+  if (!rc) {
+    // Retrieve information on records from Data fields and Geolocation fields
+    rc=OmiGetSwathData(pOrbitFile, pEngineContext);
+  }
 
-    if (!rc) {
-      // Read orbit number and date from HDF-EOS metadata
-      rc=read_orbit_metadata(pOrbitFile);
-    }
+  if (!rc) {
+    // Read orbit number and date from HDF-EOS metadata
+    rc=read_orbit_metadata(pOrbitFile);
   }
 
- end_OmiOpen:
   return rc;
 }
 
@@ -85,6 +85,7 @@
 #include "vector.h"
 #include "winthrd.h"
 #include "zenithal.h"
+#include "timing.h"
 
 #include "tropomi_read.h"
 #include "gdp_bin_read.h"
@@ -115,6 +116,16 @@ const char *output_file_extensions[] = { [ASCII] = ".ASC",
                                          [HDFEOS5] = ".he5",
                                          [NETCDF] = ".nc" };
 
+const char *output_chunking_names[] = { [OUTPUT_CHUNKS_DEFAULT] = "default",
+                                        [OUTPUT_CHUNKS_SCANLINES] = "scanlines",
+                                        [OUTPUT_CHUNKS_ORBIT] = "orbit" };
+
+/*! \brief Size in bytes of the chunks of the ::OUTPUT_CHUNKS_SCANLINES
+    and ::OUTPUT_CHUNKS_ORBIT layouts: the default size of the HDF5
+    chunk cache, so that a chunk is decompressed only once when it is
+    read piecewise.*/
+#define OUTPUT_CHUNK_SIZE (1024*1024)
+
 struct output_field output_data_analysis[MAX_FIELDS];
 unsigned int output_num_fields = 0;
 struct output_field output_data_calib[MAX_CALIB_FIELDS];
@@ -135,6 +146,12 @@ static double OUTPUT_fluxes[MAX_FLUXES], /*!< \brief fluxes */
   OUTPUT_cic[MAX_CIC][2];  /*!< \brief color indexes */
 static int OUTPUT_NFluxes, /*!< \brief number of fluxes in OUTPUT_fluxes array */
   OUTPUT_NCic; /*!< \brief number of color indexes in OUTPUT_cic array */
+static unsigned int outputStreamRecords; /*!< \brief Maximum number of records kept in memory with streaming output, 0 to keep all records of a file.*/
+static int outputStreaming, /*!< \brief ==1 if the records of the current file are written to output by blocks */
+  outputStreamStatus; /*!< \brief streaming output: 0 before the first block, 1 when the output file is open, -1 if it could not be opened */
+static int outputStaging, /*!< \brief ==1 if the output files are written to temporary files renamed by OUTPUT_CommitStaging */
+  outputStagedNumber; /*!< \brief number of temporary files in #outputStagedFiles */
+static char outputStagedFiles[OUTPUT_MAX_STAGED_FILES][DOAS_MAX_PATH_LEN+1]; /*!< \brief names of the temporary output files (final name followed by #OUTPUT_STAGED_SUFFIX) */
 
 #include "output_private.h"
 
@@ -163,6 +180,7 @@ typedef void (*func_string)(struct output_field *this_field, char **datbuf,const
 #define FORMAT_INT "%#6d"
 
 static void save_calibration(void);
+static RC OutputStreamFlush(ENGINE_CONTEXT *pEngineContext,int lastBlock);
 static void output_field_clear(struct output_field *this_field);
 static void output_field_free(struct output_field *this_field);
 struct field_attribute *copy_attributes(const struct field_attribute *attributes, int num_attributes);
@@ -2040,6 +2058,83 @@ static RC get_orbit_date(const ENGINE_CONTEXT *pEngineContext, int *orbit_year,
   return rc;
 }
 
+/*! \brief Check if the output path asks for an automatic output file
+    name (file name empty or "automatic"). */
+static int OutputAutomaticName(const char *outputPath) {
+  const char *fileNameStart;
+
+  if ((fileNameStart=strrchr(outputPath,PATH_SEP))==NULL)
+    fileNameStart=outputPath;
+  else
+    fileNameStart++;
+
+  return (!strlen(fileNameStart) || !strcasecmp(fileNameStart,"automatic"))?1:0;
+}
+
+/*! \brief Check if the analysis results of each spectra file are
+    written in their own output file, named by
+    OUTPUT_SpectraFileOutputName.
+
+  This is the case for an automatic output file name, except for the
+  files by site and month of the ground-based measurements and of the
+  satellite overpasses (see OUTPUT_FlushBuffers).
+
+  \param [in] readOutFormat the format of the spectra files
+  \param [in] outputPath    the output path of the project
+  \param [in] spectraMode   the selection mode of the spectra (PRJCT_SPECTRA_MODES_...)
+  \param [in] radius        the radius around the observation sites (satellites)
+  \param [in] fileNameFlag  1 to name the output files after the spectra files (ground-based)
+  \param [in] siteFound     1 if the observation site of the project is registered
+
+  \retval 1 if each spectra file has its own output file, 0 otherwise
+*/
+int OUTPUT_FileNamePerSpectraFile(int readOutFormat,const char *outputPath,int spectraMode,double radius,int fileNameFlag,int siteFound) {
+  int satelliteFlag=is_satellite(readOutFormat);
+
+  return (OutputAutomaticName(outputPath) &&
+          ((satelliteFlag && ((spectraMode!=PRJCT_SPECTRA_MODES_OBSLIST) || (radius<=1.))) ||
+           (!satelliteFlag && (fileNameFlag || !siteFound))))?1:0;
+}
+
+/*! \brief Build the automatic output file name of a spectra file,
+    without path and extension.
+
+  The name of the spectra file without its extension, except for
+  SCIAMACHY PDS files, named after the date of the first record and the
+  orbit number.  When the date is not known yet (year 0), the name only
+  includes the orbit number : all files with the same output file name
+  have then the same name.
+
+  \param [in] readOutFormat   the format of the spectra files
+  \param [in] spectraFileName the name of the spectra file (path allowed)
+  \param [in] orbitNumber     the orbit number (SCIAMACHY PDS), ITEM_NONE to name the output file after the spectra file
+  \param [in] year, month, day date of the first record (SCIAMACHY PDS)
+
+  \param [out] outputName     the output file name
+*/
+void OUTPUT_SpectraFileOutputName(int readOutFormat,const char *spectraFileName,int orbitNumber,int year,int month,int day,char *outputName) {
+  const char *inputFileName;
+  char *extension_start;
+
+  if ((readOutFormat==PRJCT_INSTR_FORMAT_SCIA_PDS) && (orbitNumber!=ITEM_NONE)) {
+    if (year)
+      sprintf(outputName,"SCIA_%d%02d%02d_%05d",year,month,day,orbitNumber);
+    else
+      sprintf(outputName,"SCIA_%05d",orbitNumber);
+  } else {
+    if ((inputFileName=strrchr(spectraFileName,PATH_SEP))==NULL)
+      inputFileName=spectraFileName;
+    else
+      inputFileName++;
+
+    strcpy(outputName,inputFileName);
+
+    // remove original level1 filename extension, if present
+    if ((extension_start=strrchr(outputName,'.'))!=NULL)
+      *extension_start='\0';
+  }
+}
+
 /*! For satellite measurements, automatically build a file name for
   the output file and create the necessary directory structure.
 
@@ -2077,18 +2172,10 @@ RC OutputBuildFileName(const ENGINE_CONTEXT *pEngineContext,char *outputPath)
 
   dirFlag=(THRD_id==THREAD_TYPE_EXPORT)?pExport->directoryFlag:pResults->dirFlag;
 
-  if ((!strlen(fileNameStart) || !strcasecmp(fileNameStart,"automatic")) &&
-      ((THRD_id==THREAD_TYPE_EXPORT) ||
-       (satelliteFlag && ((pProject->spectra.mode!=PRJCT_SPECTRA_MODES_OBSLIST) || (pProject->spectra.radius<=1.))) ||
-       (!satelliteFlag && (pResults->fileNameFlag || (SITES_GetIndex(pProject->instrumental.observationSite)==ITEM_NONE))))) {
-
-    const char *inputFileName;
-
-    if ((inputFileName=strrchr(pEngineContext->fileInfo.fileName,PATH_SEP))==NULL) {
-      inputFileName=pEngineContext->fileInfo.fileName;
-    } else {
-      inputFileName++;
-    }
+  if ((THRD_id==THREAD_TYPE_EXPORT) ?
+      OutputAutomaticName(pEngineContext->outputPath) :
+      OUTPUT_FileNamePerSpectraFile(pProject->instrumental.readOutFormat,pEngineContext->outputPath,pProject->spectra.mode,pProject->spectra.radius,
+                                    pResults->fileNameFlag,SITES_GetIndex(pProject->instrumental.observationSite)!=ITEM_NONE)) {
 
     if (satelliteFlag && dirFlag) {
       // get date for the current orbit file
@@ -2128,17 +2215,11 @@ RC OutputBuildFileName(const ENGINE_CONTEXT *pEngineContext,char *outputPath)
     if ((pProject->instrumental.readOutFormat==PRJCT_INSTR_FORMAT_SCIA_PDS) && (outputRecords!=NULL) && (outputNbRecords>0))
      {
       const OUTPUT_INFO* pOutput=&outputRecords[0];
-      sprintf(fileNameStart,"SCIA_%d%02d%02d_%05d",pOutput->year,pOutput->month,pOutput->day,pEngineContext->recordInfo.satellite.orbit_number);
+      OUTPUT_SpectraFileOutputName(pProject->instrumental.readOutFormat,pEngineContext->fileInfo.fileName,pEngineContext->recordInfo.satellite.orbit_number,
+                                   pOutput->year,pOutput->month,pOutput->day,fileNameStart);
      }
-    else {
-      sprintf(fileNameStart,"%s",inputFileName);
-
-      // remove original level1 filename extension, if present
-      char *extension_start=strrchr(fileNameStart, '.');
-      if (extension_start != NULL) {
-        *extension_start ='\0';
-      }
-    }
+    else
+      OUTPUT_SpectraFileOutputName(pProject->instrumental.readOutFormat,pEngineContext->fileInfo.fileName,ITEM_NONE,0,0,0,fileNameStart);
 
   } else { // user-chosen filename
     if ((THRD_id!=THREAD_TYPE_EXPORT) && (pProject->asciiResults.file_format!=ASCII))
@@ -2316,7 +2397,7 @@ RC OUTPUT_CheckPath(ENGINE_CONTEXT *pEngineContext,char *path,int format) {
   return rc;
 }
 
-RC OUTPUT_FlushBuffers(ENGINE_CONTEXT *pEngineContext)
+static RC OutputFlushBuffers(ENGINE_CONTEXT *pEngineContext)
 {
   const PROJECT *pProject = &pEngineContext->project; // pointer to project data
   const PRJCT_EXPORT *pExport = &pProject->exportSpectra;
@@ -2329,6 +2410,21 @@ RC OUTPUT_FlushBuffers(ENGINE_CONTEXT *pEngineContext)
 
   pEngineContext->outputPath=(THRD_id==THREAD_TYPE_EXPORT)? pExport->path: pResults->path;
 
+  // streaming output: write the last block and close the file
+
+  if (outputStreaming) {
+    if (outputNbRecords || outputStreamStatus)
+      rc=OutputStreamFlush(pEngineContext,1);
+    if (outputStreamStatus==1)
+      output_close_file();
+
+    outputStreaming=outputStreamStatus=0;
+    outputNbRecords=0;
+    pEngineContext->lastSavedRecord=0;
+
+    return rc;
+  }
+
   // select records for output according to date/site
   bool selected_records[outputNbRecords];
 
@@ -2425,6 +2521,133 @@ RC OUTPUT_FlushBuffers(ENGINE_CONTEXT *pEngineContext)
   return rc;
 }
 
+RC OUTPUT_FlushBuffers(ENGINE_CONTEXT *pEngineContext)
+{
+  const double timingStart=TIMING_Start();
+  const RC rc=OutputFlushBuffers(pEngineContext);
+
+  TIMING_Stop(TIMING_STAGE_OUTPUT,timingStart);
+
+  return rc;
+}
+
+/*! \brief Check if the records of the current file can be written to
+    output by blocks.
+
+  Streaming is only used for netCDF results of the analysis written to a
+  single file (not in the automatic mode where records are distributed
+  over files by site and month), and if the number of records of the
+  file exceeds the number of records to keep in memory (see
+  OUTPUT_SetStreamRecords).
+*/
+static int OutputStreamAllowed(const ENGINE_CONTEXT *pEngineContext) {
+  const PROJECT *pProject = &pEngineContext->project;
+  const PRJCT_RESULTS *pResults = &pProject->asciiResults;
+
+  if (!outputStreamRecords || (outputStreamRecords>=(unsigned int)pEngineContext->recordNumber) ||
+      (THRD_id!=THREAD_TYPE_ANALYSIS) || !pResults->analysisFlag || (pResults->file_format!=NETCDF))
+    return 0;
+
+  // the file chosen by the user or the file of the spectra file (same rules as OutputBuildFileName)
+
+  return !OutputAutomaticName(pResults->path) ||
+    OUTPUT_FileNamePerSpectraFile(pProject->instrumental.readOutFormat,pResults->path,pProject->spectra.mode,pProject->spectra.radius,
+                                  pResults->fileNameFlag,SITES_GetIndex(pProject->instrumental.observationSite)!=ITEM_NONE);
+}
+
+/*! \brief Streaming output: write a block of records to the output file
+    and release them.
+
+  The output file is opened with the first block.  Unless this is the
+  last block of the file, the records of the last scanline are kept in
+  the buffers so that this scanline can be written at once with the
+  next block.
+
+  \param [in] pEngineContext structure including information on the current file
+  \param [in] lastBlock ==1 to write all remaining records
+
+  Once the output file could not be created or a block could not be
+  written, the records of the next blocks are discarded and every call
+  returns a fatal error so that the analysis is stopped.
+
+  \retval ERROR_ID_FILE_OPEN if the output file can not be created or a previous block was not written
+  \retval ERROR_ID_NETCDF if the records could not be written
+  \retval ERROR_ID_NO on success
+*/
+static RC OutputStreamFlush(ENGINE_CONTEXT *pEngineContext,int lastBlock) {
+  const PRJCT_RESULTS *pResults = &pEngineContext->project.asciiResults;
+  char outputFileName[MAX_ITEM_TEXT_LEN] = {0};
+  unsigned int nFlushed,indexRecord;
+  RC rc=ERROR_ID_NO;
+
+  // the netCDF library must not be used while TROPOMI radiances are read in the background
+
+  tropomi_wait_prefetch();
+
+  // Create the output file with the first block
+
+  if (!outputStreamStatus) {
+    selected_format = pResults->file_format;
+    pEngineContext->outputPath=pResults->path;
+
+    if (!(rc=OutputBuildFileName(pEngineContext,outputFileName)) && !(rc=open_output_file(pEngineContext,outputFileName)))
+      outputStreamStatus=1;
+    else {
+      outputStreamStatus=-1;
+      rc=ERROR_SetLast(__func__,ERROR_TYPE_FATAL,ERROR_ID_FILE_OPEN,outputFileName);
+    }
+  }
+  else if (outputStreamStatus==-1)
+    rc=ERROR_SetLast(__func__,ERROR_TYPE_FATAL,ERROR_ID_FILE_OPEN,pEngineContext->outputPath);
+
+  // Keep the records of the last scanline, which may not be complete
+
+  nFlushed=outputNbRecords;
+
+  if (!lastBlock && nFlushed && (outputRecords[nFlushed-1].i_alongtrack!=ITEM_NONE)) {
+    indexRecord=nFlushed-1;
+    while ((indexRecord>0) && (outputRecords[indexRecord-1].i_alongtrack==outputRecords[nFlushed-1].i_alongtrack))
+      indexRecord--;
+    if (indexRecord>0)
+      nFlushed=indexRecord;
+  }
+
+  if ((outputStreamStatus==1) && nFlushed) {
+    bool selected_records[nFlushed];
+    for (indexRecord=0;indexRecord<nFlushed;indexRecord++)
+      selected_records[indexRecord]=true;
+    rc=netcdf_write_analysis_block(selected_records,nFlushed,outputRecords);
+
+    if (rc!=ERROR_ID_NO) {
+      output_close_file();
+      outputStreamStatus=-1;
+    }
+  }
+
+  // Release the records written to output and move the other ones to the beginning of the buffers
+
+  for (unsigned int i=0; i<output_num_fields; i++) {
+    struct output_field *pfield = &output_data_analysis[i];
+    size_t recordSize = pfield->data_cols*output_get_size(pfield->memory_type);
+    char *data = pfield->data;
+
+    if (data==NULL)
+      continue;
+
+    if (pfield->memory_type==OUTPUT_STRING)
+      for (size_t j=0; j<nFlushed*pfield->data_cols; j++)
+        free(((char **)data)[j]);
+
+    memmove(data,data+nFlushed*recordSize,(outputNbRecords-nFlushed)*recordSize);
+    memset(data+(outputNbRecords-nFlushed)*recordSize,0,nFlushed*recordSize);
+  }
+
+  memmove(outputRecords,outputRecords+nFlushed,(outputNbRecords-nFlushed)*sizeof(OUTPUT_INFO));
+  outputNbRecords-=nFlushed;
+
+  return rc;
+}
+
 /*! \brief Save all calibration data to the calibration output buffers.*/
 void save_calibration(void) {
   for(unsigned int i=0; i<calib_num_fields; i++) {
@@ -2477,6 +2700,14 @@ RC OUTPUT_SaveResults(ENGINE_CONTEXT *pEngineContext,INDEX indexFenoColumn)
       Spectrum[i]/=(double)pRecordInfo->Tint;
   }
 
+  // Streaming output: write the records of the complete scanlines when the buffers are full
+
+  if (outputStreaming && (outputNbRecords>=outputStreamRecords)) {
+    RC rcStream=OutputStreamFlush(pEngineContext,0);
+    if (rcStream!=ERROR_ID_NO)
+      rc=rcStream;
+  }
+
   if (outputNbRecords<pEngineContext->recordNumber)
     OutputSaveRecord(pEngineContext,indexFenoColumn);
 
@@ -2656,6 +2887,18 @@ RC OUTPUT_LocalAlloc(ENGINE_CONTEXT *pEngineContext)
   if ((THRD_id==THREAD_TYPE_EXPORT) || pResults->analysisFlag || pResults->calibFlag) {
     assert(output_data_rows > 0);
 
+    // output file of the previous file not closed (processing interrupted)
+
+    if (outputStreamStatus==1)
+      output_close_file();
+
+    outputStreamStatus=0;
+
+    // with streaming output, only a block of records is kept in memory
+
+    if ((outputStreaming=OutputStreamAllowed(pEngineContext))!=0)
+      output_data_rows = outputStreamRecords;
+
     if (outputRecords!=NULL)
       MEMORY_ReleaseBuffer(__func__,"outputRecords",outputRecords);
     outputRecords=NULL;
@@ -2722,6 +2965,146 @@ void OUTPUT_Free(void)
   outputRecords=NULL;
 }
 
+/*! \brief Select the number of records kept in memory by the netCDF
+    output.
+
+  When a file contains more records, the results of the complete
+  scanlines are written to the output file each time this number of
+  records is reached, instead of writing all results at the end of the
+  file.
+
+  \param [in] nRecords number of records, 0 to keep all records of a file in memory
+*/
+void OUTPUT_SetStreamRecords(int nRecords)
+{
+  outputStreamRecords=(nRecords>0)?(unsigned int)nRecords:0;
+}
+
+/*! \brief Write the output files to temporary files.
+
+  Used by the worker processes of doas_cl -p : the results are written
+  to "<output file>.part" and the final output files are only replaced
+  by OUTPUT_CommitStaging once all the spectra files have been
+  analysed, so that a job started again after a failure does not
+  append its results to the partial output of the failed attempt.
+
+  \param [in] stagingFlag 1 to write to temporary files, 0 to write to the output files directly (default)
+*/
+void OUTPUT_SetStaging(int stagingFlag)
+{
+  outputStaging=stagingFlag;
+}
+
+/*! \brief Copy a file; returns 0 on failure.*/
+static int OutputCopyFile(const char *source,const char *target)
+{
+  char buffer[BUFSIZ];
+  FILE *fpIn,*fpOut;
+  size_t n;
+  int ok;
+
+  if ((fpIn=fopen(source,"rb"))==NULL)
+    return 0;
+
+  ok=((fpOut=fopen(target,"wb"))!=NULL)?1:0;
+
+  while (ok && ((n=fread(buffer,1,sizeof(buffer),fpIn))>0))
+    ok=(fwrite(buffer,1,n,fpOut)==n)?1:0;
+
+  if (ok && ferror(fpIn))
+    ok=0;
+  if ((fpOut!=NULL) && fclose(fpOut))
+    ok=0;
+
+  fclose(fpIn);
+
+  return ok;
+}
+
+/*! \brief Name of the file to open instead of the output file \a fileName.
+
+  Without staging, this is \a fileName itself.  With staging, the
+  first time an output file is opened by the process, any temporary
+  file left by a failed attempt is replaced by a copy of the output
+  file if it already exists (so that the results are still appended
+  to it as without staging), or removed.  The next times, the same
+  temporary file is used again.
+
+  \param [in] fileName complete name of the output file, with its extension
+  \return the name of the file to open, NULL if the temporary file can not be created
+*/
+const char *OUTPUT_StagedFileName(const char *fileName)
+{
+  char stagedName[DOAS_MAX_PATH_LEN+1];
+  FILE *fp;
+  int i;
+
+  if (!outputStaging)
+    return fileName;
+
+  if (strlen(fileName)+strlen(OUTPUT_STAGED_SUFFIX)>DOAS_MAX_PATH_LEN)
+    return NULL;
+
+  sprintf(stagedName,"%s%s",fileName,OUTPUT_STAGED_SUFFIX);
+
+  for (i=0;i<outputStagedNumber;i++)
+    if (!strcmp(outputStagedFiles[i],stagedName))
+      return outputStagedFiles[i];
+
+  if (outputStagedNumber==OUTPUT_MAX_STAGED_FILES)
+    return NULL;
+
+  remove(stagedName);
+
+  if ((fp=fopen(fileName,"rb"))!=NULL) {
+    fclose(fp);
+
+    if (!OutputCopyFile(fileName,stagedName)) {
+      remove(stagedName);
+      return NULL;
+    }
+  }
+
+  strcpy(outputStagedFiles[outputStagedNumber],stagedName);
+
+  return outputStagedFiles[outputStagedNumber++];
+}
+
+/*! \brief Rename the temporary output files to their final names, or
+    remove them.
+
+  \param [in] successFlag 1 to replace the output files by the temporary files, 0 to discard the temporary files and keep the output files unchanged
+  \return ERROR_ID_FILE_OPEN if a temporary file can not be renamed
+*/
+RC OUTPUT_CommitStaging(int successFlag)
+{
+  char fileName[DOAS_MAX_PATH_LEN+1];
+  RC rc;
+  int i;
+
+  rc=ERROR_ID_NO;
+
+  for (i=0;i<outputStagedNumber;i++) {
+    if (!successFlag)
+      remove(outputStagedFiles[i]);
+    else {
+      strcpy(fileName,outputStagedFiles[i]);
+      fileName[strlen(fileName)-strlen(OUTPUT_STAGED_SUFFIX)]='\0';
+
+#if defined WIN32
+      remove(fileName);                                                         // rename does not replace an existing file on Windows
+#endif
+
+      if (rename(outputStagedFiles[i],fileName))
+        rc=ERROR_SetLast(__func__,ERROR_TYPE_FATAL,ERROR_ID_FILE_OPEN,fileName);
+    }
+  }
+
+  outputStagedNumber=0;
+
+  return rc;
+}
+
 /*! \brief Get the format corresponding to a file extension.
 
   We look for the given extension in the array
@@ -2737,6 +3120,50 @@ enum output_format output_get_format(const char *fileext) {
     return -1; // not found
 }
 
+/*! \brief Get the chunk layout corresponding to a name (see
+    #output_chunking_names), -1 if the name is unknown.*/
+enum output_chunking output_get_chunking(const char *name) {
+  size_t num_layouts = sizeof(output_chunking_names)/sizeof(output_chunking_names[0]);
+  const char **array_offset = (const char **) lfind(name, output_chunking_names, &num_layouts, sizeof(output_chunking_names[0]), &compare_string);
+  if (array_offset)
+    return array_offset - output_chunking_names;
+  else
+    return -1; // not found
+}
+
+/*! \brief Get the chunk sizes along and across track of an analysis
+    output field.
+
+  With ::OUTPUT_CHUNKS_SCANLINES, a chunk contains complete scanlines
+  (all detector rows), with ::OUTPUT_CHUNKS_ORBIT it contains complete
+  detector rows (the whole orbit).  The other dimension of the chunk is
+  adjusted so that a chunk holds about #OUTPUT_CHUNK_SIZE bytes.  The
+  columns of the field and the fields of date/time data are never split
+  over several chunks.*/
+void output_get_chunk_shape(const struct output_field *thefield, enum output_chunking layout,
+                            size_t n_alongtrack, size_t n_crosstrack,
+                            size_t *chunk_alongtrack, size_t *chunk_crosstrack) {
+  size_t record_size = thefield->data_cols * output_get_size(thefield->memory_type);
+  size_t n_records = (record_size < OUTPUT_CHUNK_SIZE) ? OUTPUT_CHUNK_SIZE / record_size : 1;
+
+  if (n_alongtrack < 1)
+    n_alongtrack = 1;
+  if (n_crosstrack < 1)
+    n_crosstrack = 1;
+
+  if (layout == OUTPUT_CHUNKS_ORBIT) {
+    *chunk_alongtrack = (n_alongtrack < n_records) ? n_alongtrack : n_records;
+    *chunk_crosstrack = n_records / *chunk_alongtrack;
+    if (*chunk_crosstrack > n_crosstrack)
+      *chunk_crosstrack = n_crosstrack;
+  } else {
+    *chunk_crosstrack = (n_crosstrack < n_records) ? n_crosstrack : n_records;
+    *chunk_alongtrack = n_records / *chunk_crosstrack;
+    if (*chunk_alongtrack > n_alongtrack)
+      *chunk_alongtrack = n_alongtrack;
+  }
+}
+
 /*! \brief Make a deep copy of an attribute list. */
 struct field_attribute *copy_attributes(const struct field_attribute *attributes, int num_attributes) {
   struct field_attribute *copy = malloc(num_attributes * sizeof(*copy));
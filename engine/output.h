@@ -7,6 +7,10 @@
 
 /*! \file output.h \brief Output module interface.*/
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 void OUTPUT_ResetData(void);
 
 RC OUTPUT_CheckPath(ENGINE_CONTEXT *pEngineContext,char *path,int format);
@@ -33,6 +37,30 @@ RC OUTPUT_LocalAlloc(ENGINE_CONTEXT *pEngineContext);
 RC OUTPUT_Alloc(void);
 void OUTPUT_Free(void);
 
+/*! \brief Select the number of records kept in memory by the netCDF
+    output (0 to write all results at the end of each file). */
+void OUTPUT_SetStreamRecords(int nRecords);
+
+/*! \brief Write the output files to temporary files, renamed by
+    OUTPUT_CommitStaging (worker processes of doas_cl -p). */
+void OUTPUT_SetStaging(int stagingFlag);
+
+/*! \brief Name of the file to open instead of an output file (the
+    temporary file with staging). */
+const char *OUTPUT_StagedFileName(const char *fileName);
+
+/*! \brief Rename the temporary output files to their final names, or
+    remove them. */
+RC OUTPUT_CommitStaging(int successFlag);
+
+/*! \brief Check if each spectra file has its own output file (automatic
+    output file name). */
+int OUTPUT_FileNamePerSpectraFile(int readOutFormat,const char *outputPath,int spectraMode,double radius,int fileNameFlag,int siteFound);
+
+/*! \brief Build the automatic output file name of a spectra file,
+    without path and extension. */
+void OUTPUT_SpectraFileOutputName(int readOutFormat,const char *spectraFileName,int orbitNumber,int year,int month,int day,char *outputName);
+
 /*! \brief For GOME-2/Sciamachy automatic reference spectrum: file
     from which the reference was generated. */
 extern char OUTPUT_refFile[DOAS_MAX_PATH_LEN+1];
@@ -63,6 +91,9 @@ extern AMF_SYMBOL *OUTPUT_AmfSpace;
 
 #define     MAX_FLUXES    20
 #define     MAX_CIC       20
+#define     OUTPUT_MAX_STAGED_FILES    64      // maximum number of temporary output files of a process (cfr OUTPUT_SetStaging)
+#define     OUTPUT_STAGED_SUFFIX   ".part"
+
 #define     MAX_RESULTS  500   // 250 measurements the morning; 250 measurements the afternoon.
 
 // Fill values, copied from the netCDF default fill values (NC_FILL_BYTE etc in netcdf.h)
@@ -79,4 +110,8 @@ extern const long long QDOAS_FILL_INT64;
 extern const unsigned long long QDOAS_FILL_UINT64;
 extern const char *QDOAS_FILL_STRING;
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
@@ -32,8 +32,9 @@ RC ascii_open(const ENGINE_CONTEXT *pEngineContext, char *filename) {
     strcat(ptr, output_file_extensions[ASCII]);
 
   const PROJECT *pProject= &pEngineContext->project;
+  const char *stagedName = OUTPUT_StagedFileName(filename); // temporary file of the worker processes of doas_cl -p
 
-  output_file = fopen(filename, "a+t");
+  output_file = (stagedName != NULL) ? fopen(stagedName, "a+t") : NULL;
   if (output_file == NULL) {
     return ERROR_ID_FILE_OPEN;
   }
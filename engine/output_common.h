@@ -170,6 +170,13 @@ extern struct output_field output_data_calib[MAX_CALIB_FIELDS];
 /*! \brief returns the number of bytes used by an output datatype. */
 size_t output_get_size(enum output_datatype datatype);
 
+/*! \brief chunk sizes along and across track of an analysis output
+    field for the ::OUTPUT_CHUNKS_SCANLINES and ::OUTPUT_CHUNKS_ORBIT
+    layouts. */
+void output_get_chunk_shape(const struct output_field *thefield, enum output_chunking layout,
+                            size_t n_alongtrack, size_t n_crosstrack,
+                            size_t *chunk_alongtrack, size_t *chunk_crosstrack);
+
 /** @name Open output file.*/
 //!@{
 /** \brief Open the output file and, prepare different output fields
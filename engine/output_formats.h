@@ -23,6 +23,19 @@ extern "C" {
   enum output_format output_get_format(const char *fileext);
   extern const char *output_file_extensions[]; // defined in output.c
 
+  /*! \brief Chunk layouts of the variables in netCDF and HDF-EOS5 output files.*/
+  enum output_chunking {
+    OUTPUT_CHUNKS_DEFAULT,   // layout of the previous versions
+    OUTPUT_CHUNKS_SCANLINES, // chunks of complete scanlines: suited to reading a few scanlines at a time
+    OUTPUT_CHUNKS_ORBIT,     // chunks of complete detector rows: suited to reading a variable across the whole orbit
+    LAST_OUTPUT_CHUNKS = OUTPUT_CHUNKS_ORBIT
+  };
+
+  enum output_chunking output_get_chunking(const char *name);
+  extern const char *output_chunking_names[]; // defined in output.c
+
+#define OUTPUT_COMPRESSION_DEFAULT -1 // deflate level chosen by each output format
+
 #if defined(_cplusplus) || defined(__cplusplus)
 }
 #endif
@@ -31,6 +31,7 @@ static hid_t get_hdfeos5_type(enum output_datatype datatype);
 static void get_hdfeos5_dimension_calibration(char *dimension, const struct output_field *thefield);
 static void get_hdfeos5_dimension_analysis(char *dimension, const struct output_field *thefield);
 static void get_chunkdims(hsize_t chunkdims[], const struct output_field *thefield);
+static herr_t set_compression(hid_t swath);
 static void get_edge_calibration(hsize_t edge[], const struct output_field *thefield);
 static void get_edge_analysis(hsize_t edge[], const struct output_field *thefield);
 static int get_rank(const struct output_field *thefield);
@@ -47,6 +48,10 @@ static size_t nXtrack;
 static size_t nTimes;
 /*! \brief length of calibration data */
 static size_t nCalibWindows;
+/*! \brief chunk layout of the analysis data fields */
+static enum output_chunking chunking;
+/*! \brief deflate level (0 for no compression) and shuffle filter */
+static int deflateLevel, shuffleFlag;
 
 /* todo:
  *  - fill values/default values for fields
@@ -64,6 +69,12 @@ RC hdfeos5_open(const ENGINE_CONTEXT *pEngineContext, const char *filename) {
   // initialize swath dimensions:
   nXtrack = ANALYSE_swathSize;
   nTimes = pEngineContext->recordNumber / nXtrack;
+
+  // chunking and compression options
+  chunking = pEngineContext->project.asciiResults.chunking;
+  deflateLevel = (pEngineContext->project.asciiResults.compressionLevel == OUTPUT_COMPRESSION_DEFAULT)
+    ? 9 : pEngineContext->project.asciiResults.compressionLevel;
+  shuffleFlag = pEngineContext->project.asciiResults.shuffleFlag;
   // find first used row and get number of calibration windows
   for(int firstrow = 0; firstrow<ANALYSE_swathSize; firstrow++) {
     if ( pEngineContext->project.instrumental.readOutFormat!=PRJCT_INSTR_FORMAT_OMI ||
@@ -73,11 +84,16 @@ RC hdfeos5_open(const ENGINE_CONTEXT *pEngineContext, const char *filename) {
     }
   }
 
+  // temporary file of the worker processes of doas_cl -p
+  const char *staged_name = OUTPUT_StagedFileName(filename_ext);
+  if (staged_name == NULL)
+    return ERROR_SetLast(__func__, ERROR_TYPE_FATAL, ERROR_ID_FILE_OPEN, filename_ext);
+
   // test if file exists; if it already exists, size should be 0.
-  rc = hdfeos5_allow_file(filename_ext);
+  rc = hdfeos5_allow_file(staged_name);
   if (rc == ERROR_ID_NO) {
     // new file, go ahead
-    hid_t result_open = HE5_SWopen(filename_ext, H5F_ACC_TRUNC);
+    hid_t result_open = HE5_SWopen(staged_name, H5F_ACC_TRUNC);
     if(result_open != FAIL) {
       output_file = result_open;
     } else {
@@ -313,12 +329,11 @@ RC write_calibration_data(void) {
       get_hdfeos5_dimension_calibration(calib_dimensions, &calibfield);
 
       int chunkrank = get_rank(&calibfield) ;
-      int compparm[5] = {9, 0, 0, 0, 0}; // in practice, only compparm[0] is used?
       // chunking and compression
       hsize_t chunkdims[HE5_DTSETRANKMAX] = {nCalibWindows, nXtrack}; // for calibration: 1 chunk (nCalibWindows x nXtrack)
       get_chunkdims(&chunkdims[2], &calibfield); // other chunk dimensions determined based on field properties
       herr_t result = HE5_SWdefchunk(swath_id, chunkrank, chunkdims);
-      result |= HE5_SWdefcomp(swath_id, HE5_HDFE_COMP_SHUF_DEFLATE, compparm);
+      result |= set_compression(swath_id);
 
       hid_t dtype = get_hdfeos5_type(calibfield.memory_type);
       enum fieldtype type = get_fieldtype(calibfield.resulttype);
@@ -366,15 +381,22 @@ RC create_analysis_data_fields(void) {
 
     // set chunking and compression
     int chunkrank = get_rank(&thefield) ;
-    int compparm[5] = {9, 0, 0, 0, 0}; // in practice, only compparm[0] is used?
     hsize_t chunkdims[HE5_DTSETRANKMAX] = {0};
     int index_dim = 0;
-    chunkdims[index_dim++] = (nTimes > 100) ? 100 : nTimes; // chunks of length 100 along track (settings used for OMI)
-    if(nXtrack > 1)
-      chunkdims[index_dim++] = (nXtrack > 4) ? nXtrack/4  : 1; // about 4-5 chunks across track
+    if (chunking == OUTPUT_CHUNKS_DEFAULT) {
+      chunkdims[index_dim++] = (nTimes > 100) ? 100 : nTimes; // chunks of length 100 along track (settings used for OMI)
+      if(nXtrack > 1)
+        chunkdims[index_dim++] = (nXtrack > 4) ? nXtrack/4  : 1; // about 4-5 chunks across track
+    } else {
+      size_t chunkTimes, chunkXtrack;
+      output_get_chunk_shape(&thefield, chunking, nTimes, nXtrack, &chunkTimes, &chunkXtrack);
+      chunkdims[index_dim++] = chunkTimes;
+      if(nXtrack > 1)
+        chunkdims[index_dim++] = chunkXtrack;
+    }
     get_chunkdims(&chunkdims[index_dim], &thefield); // other chunk dimensions determined based on field properties
     HE5_SWdefchunk(swath_id, chunkrank, chunkdims);
-    HE5_SWdefcomp(swath_id, HE5_HDFE_COMP_SHUF_DEFLATE, compparm);
+    set_compression(swath_id);
 
     herr_t result = set_fill_value(swath_id, he5_fieldname, &thefield);
     if(result)
@@ -675,6 +697,18 @@ int get_rank(const struct output_field *thefield) {
   return rank;
 }
 
+/*! \brief Select the compression of the next field defined in the swath.
+
+    HDF-EOS5 has no shuffle filter without deflate: without
+    compression, no filter is used.  */
+herr_t set_compression(hid_t swath) {
+  if (deflateLevel <= 0)
+    return 0;
+
+  int compparm[5] = {deflateLevel, 0, 0, 0, 0}; // in practice, only compparm[0] is used?
+  return HE5_SWdefcomp(swath, shuffleFlag ? HE5_HDFE_COMP_SHUF_DEFLATE : HE5_HDFE_COMP_DEFLATE, compparm);
+}
+
 /*! \brief Get size of a chunk along each dimension of the output field.
 
     We use a single chunk for the columns of datafields with multiple
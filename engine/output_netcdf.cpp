@@ -24,6 +24,11 @@ static NetCDFFile output_file,output_file_calib;
 static NetCDFGroup output_group;
 
 static size_t n_alongtrack, n_crosstrack, n_calib;
+static size_t first_unwritten; // streaming output: first scanline not yet written by netcdf_write_analysis_block
+
+// chunk layout and compression of the variables, from the project properties
+static enum output_chunking chunking;
+static int deflate_level, shuffle;
 
 const static string calib_subgroup_name = "Calib";
 
@@ -142,7 +147,7 @@ static void define_variable(NetCDFGroup &group, const struct output_field& thefi
 
     dimids.push_back(get_dimid("n_calib"));
     chunksizes.push_back(std::max<size_t>(100, n_calib));
-  } else {
+  } else if (chunking == OUTPUT_CHUNKS_DEFAULT) {
     dimids.push_back(get_dimid("n_alongtrack"));
     chunksizes.push_back(std::max<size_t>(100, n_alongtrack));
 
@@ -150,13 +155,25 @@ static void define_variable(NetCDFGroup &group, const struct output_field& thefi
       dimids.push_back(get_dimid("n_crosstrack"));
       chunksizes.push_back(std::max<size_t>(100, n_crosstrack));
     }
+  } else {
+    size_t chunk_alongtrack, chunk_crosstrack;
+    output_get_chunk_shape(&thefield, chunking, n_alongtrack, n_crosstrack, &chunk_alongtrack, &chunk_crosstrack);
+
+    dimids.push_back(get_dimid("n_alongtrack"));
+    chunksizes.push_back(chunk_alongtrack);
+
+    if (n_crosstrack > 1) {
+      dimids.push_back(get_dimid("n_crosstrack"));
+      chunksizes.push_back(chunk_crosstrack);
+    }
   }
   getDims(thefield, dimids, chunksizes);
 
   const int varid = group.defVar(varname, dimids, getNCType(thefield.memory_type));
 
   group.defVarChunking(varid, NC_CHUNKED, chunksizes.data());
-  group.defVarDeflate(varid);
+  if (deflate_level > 0)
+    group.defVarDeflate(varid, shuffle, 1, deflate_level);
   group.defVarFletcher32(varid, NC_FLETCHER32);
 
   switch (thefield.memory_type) {
@@ -385,12 +402,24 @@ void create_subgroups(const ENGINE_CONTEXT *pEngineContext,NetCDFGroup &group) {
 }
 
 RC netcdf_open(const ENGINE_CONTEXT *pEngineContext, const char *filename) {
+  const string filename_ext = filename + string(output_file_extensions[NETCDF]);
+  const char *staged_name = OUTPUT_StagedFileName(filename_ext.c_str()); // temporary file of the worker processes of doas_cl -p
+
+  if (staged_name == NULL)
+    return ERROR_SetLast(__func__, ERROR_TYPE_FATAL, ERROR_ID_FILE_OPEN, filename_ext.c_str());
+
   try {
-    output_file = NetCDFFile(filename + string(output_file_extensions[NETCDF]), NC_WRITE );
+    output_file = NetCDFFile(staged_name, NC_WRITE );
     output_group = output_file.defGroup(pEngineContext->project.asciiResults.swath_name);
 
     n_crosstrack = pEngineContext->n_crosstrack; // ANALYSE_swathSize;
     n_alongtrack = pEngineContext->n_alongtrack;
+    first_unwritten = 0;
+
+    const PRJCT_RESULTS *pResults = &pEngineContext->project.asciiResults;
+    chunking = pResults->chunking;
+    deflate_level = (pResults->compressionLevel == OUTPUT_COMPRESSION_DEFAULT) ? 7 : pResults->compressionLevel;
+    shuffle = pResults->shuffleFlag ? 1 : 0;
 
     n_calib = 0;
     if ((pEngineContext->project.instrumental.readOutFormat!=PRJCT_INSTR_FORMAT_OMI) &&
@@ -518,8 +547,64 @@ static void write_data_field(const struct output_field& datafield, NetCDFGroup &
   }
 }
 
+// Write a block of n_scanlines scanlines starting at first_alongtrack,
+// across the full extent of the other dimensions of the variable.
+template<typename T>
+static void put_scanlines(NetCDFGroup &group, const string& varname, size_t first_alongtrack, size_t n_scanlines,
+                          size_t ncols, size_t dimension, T *buffer) {
+
+  if (first_alongtrack == 0 && n_scanlines == n_alongtrack) {
+    group.putVar(varname, buffer );   // This causes erros under Windows
+    return;
+  }
+
+  vector<size_t> start { first_alongtrack };
+  vector<size_t> count { n_scanlines };
+  if (n_crosstrack > 1) {
+    start.push_back(0);
+    count.push_back(n_crosstrack);
+  }
+  if (ncols > 1) {
+    start.push_back(0);
+    count.push_back(ncols);
+  }
+  if (dimension > 1) {
+    start.push_back(0);
+    count.push_back(dimension);
+  }
+  group.putVar(varname, start.data(), count.data(), buffer);
+}
+
+// Write the values of a single record, for a scanline which has
+// already been written by a previous call to put_scanlines().
+template<typename T>
+static void put_record(NetCDFGroup &group, const string& varname, size_t i_alongtrack, size_t i_crosstrack,
+                       size_t ncols, size_t dimension, T *buffer) {
+
+  vector<size_t> start { i_alongtrack };
+  vector<size_t> count { 1 };
+  if (n_crosstrack > 1) {
+    start.push_back(i_crosstrack);
+    count.push_back(1);
+  }
+  if (ncols > 1) {
+    start.push_back(0);
+    count.push_back(ncols);
+  }
+  if (dimension > 1) {
+    start.push_back(0);
+    count.push_back(dimension);
+  }
+  group.putVar(varname, start.data(), count.data(), buffer);
+}
+
+// Write the selected records of an output field.  Records belonging to
+// scanlines [first_alongtrack, first_alongtrack+n_scanlines) are
+// collected in a buffer covering these scanlines (initialized with the
+// fill value), other records are written one by one.
 template<typename T, typename U = T>
-static void write_buffer(const struct output_field *thefield, const bool selected[], int num_records, const OUTPUT_INFO *recordinfo) {
+static void write_buffer(const struct output_field *thefield, const bool selected[], int num_records, const OUTPUT_INFO *recordinfo,
+                         size_t first_alongtrack, size_t n_scanlines) {
 
   size_t ncols = thefield->data_cols;
   size_t dimension = vardimension<U>();
@@ -532,44 +617,39 @@ static void write_buffer(const struct output_field *thefield, const bool selecte
   string varname { get_netcdf_varname(thefield->fieldname) };
   T fill = group.getFillValue<T>(group.varID(varname));
 
-  // buffer will hold all output data for this variable
-  vector<T> buffer(n_alongtrack * n_crosstrack * ncols * dimension, fill);
+  // buffer will hold the output data of these scanlines for this variable
+  vector<T> buffer(n_scanlines * n_crosstrack * ncols * dimension, fill);
+  vector<T> record_buffer(ncols * dimension);
 
   for (int record=0; record < num_records; ++record) {
     if (selected[record] && (recordinfo[record].i_crosstrack!=ITEM_NONE) && (recordinfo[record].i_alongtrack!=ITEM_NONE)) {
 
-      int i_crosstrack = recordinfo[record].i_crosstrack; // (recordinfo[record].specno-1) % n_crosstrack; //specno is 1-based
-      int i_alongtrack = recordinfo[record].i_alongtrack; // (recordinfo[record].specno-1) / n_crosstrack;
+      size_t i_crosstrack = recordinfo[record].i_crosstrack; // (recordinfo[record].specno-1) % n_crosstrack; //specno is 1-based
+      size_t i_alongtrack = recordinfo[record].i_alongtrack; // (recordinfo[record].specno-1) / n_crosstrack;
 
-      for (size_t i=0; i< ncols; ++i) {
-        // write into the buffer at the correct index position, using
-        // the correct layout for the type of data stored:
-        int index = i_alongtrack*n_crosstrack*ncols + i_crosstrack*ncols + i;
-        assign_buffer(&buffer[dimension*index], static_cast<U*>(thefield->data)[record*ncols+i]);
+      if (i_alongtrack >= first_alongtrack && i_alongtrack < first_alongtrack + n_scanlines) {
+        for (size_t i=0; i< ncols; ++i) {
+          // write into the buffer at the correct index position, using
+          // the correct layout for the type of data stored:
+          size_t index = (i_alongtrack-first_alongtrack)*n_crosstrack*ncols + i_crosstrack*ncols + i;
+          assign_buffer(&buffer[dimension*index], static_cast<U*>(thefield->data)[record*ncols+i]);
+        }
+      } else if (i_alongtrack < n_alongtrack) {
+        for (size_t i=0; i< ncols; ++i)
+          assign_buffer(&record_buffer[dimension*i], static_cast<U*>(thefield->data)[record*ncols+i]);
+        put_record(group, varname, i_alongtrack, i_crosstrack, ncols, dimension, record_buffer.data());
       }
     }
   }
 
-
-  //  vector<int> dimids(output_group.dimIDs(varname));
-  //  vector<size_t> start(dimids.size());
-  //  start[0] = thefield->index_row;
-  //  vector<size_t> count;
-  //  for (auto dim : dimids) {
-  //    if (n_crosstrack > 1 && dim == get_dimid("n_crosstrack")) {
-  //      count.push_back(1);
-  //    } else { // we want to write across the full extent of each dimension, except crosstrack
-  //      count.push_back(group.dimLen(dim));
-  //    }
-  //  }
-  //
-  // write_data_field(*thefield, output_group, varname, start, count);
-  group.putVar(varname, buffer.data() );   // This causes erros under Windows
+  if (n_scanlines)
+    put_scanlines(group, varname, first_alongtrack, n_scanlines, ncols, dimension, buffer.data());
 }
 
 // specialization to deal with string variable types...
 template<>
-void write_buffer<const char*>(const struct output_field *thefield, const bool selected[], int num_records, const OUTPUT_INFO *recordinfo) {
+void write_buffer<const char*>(const struct output_field *thefield, const bool selected[], int num_records, const OUTPUT_INFO *recordinfo,
+                               size_t first_alongtrack, size_t n_scanlines) {
 
   size_t ncols = thefield->data_cols;
 
@@ -579,64 +659,107 @@ void write_buffer<const char*>(const struct output_field *thefield, const bool s
   string varname { get_netcdf_varname(thefield->fieldname) };
   string fill = group.getFillValue<string>(group.varID(varname));
 
-  // buffer will hold all output data for this variable
-  vector<const char*> buffer(n_alongtrack * n_crosstrack * ncols, fill.c_str());
+  // buffer will hold the output data of these scanlines for this variable
+  vector<const char*> buffer(n_scanlines * n_crosstrack * ncols, fill.c_str());
+  vector<const char*> record_buffer(ncols);
 
   for (int record=0; record < num_records; ++record) {
     if (selected[record] && (recordinfo[record].i_crosstrack!=ITEM_NONE) && (recordinfo[record].i_alongtrack!=ITEM_NONE)) {
 
-      int i_crosstrack = recordinfo[record].i_crosstrack; // (recordinfo[record].specno-1) % n_crosstrack; //specno is 1-based
-      int i_alongtrack = recordinfo[record].i_alongtrack; // (recordinfo[record].specno-1) / n_crosstrack;
+      size_t i_crosstrack = recordinfo[record].i_crosstrack; // (recordinfo[record].specno-1) % n_crosstrack; //specno is 1-based
+      size_t i_alongtrack = recordinfo[record].i_alongtrack; // (recordinfo[record].specno-1) / n_crosstrack;
 
-      for (size_t i=0; i< ncols; ++i) {
-        // write into the buffer at the correct index position, using
-        // the correct layout for the type of data stored:
-        int index = i_alongtrack*n_crosstrack*ncols + i_crosstrack*ncols + i;
-        assign_buffer(&buffer[index], static_cast<const char**>(thefield->data)[record*ncols+i]);
+      if (i_alongtrack >= first_alongtrack && i_alongtrack < first_alongtrack + n_scanlines) {
+        for (size_t i=0; i< ncols; ++i) {
+          // write into the buffer at the correct index position, using
+          // the correct layout for the type of data stored:
+          size_t index = (i_alongtrack-first_alongtrack)*n_crosstrack*ncols + i_crosstrack*ncols + i;
+          assign_buffer(&buffer[index], static_cast<const char**>(thefield->data)[record*ncols+i]);
+        }
+      } else if (i_alongtrack < n_alongtrack) {
+        for (size_t i=0; i< ncols; ++i)
+          assign_buffer(&record_buffer[i], static_cast<const char**>(thefield->data)[record*ncols+i]);
+        put_record(group, varname, i_alongtrack, i_crosstrack, ncols, 1, record_buffer.data());
       }
     }
   }
 
-  group.putVar(varname, buffer.data() );
+  if (n_scanlines)
+    put_scanlines(group, varname, first_alongtrack, n_scanlines, ncols, 1, buffer.data());
+}
+
+static void write_analysis_fields(const bool selected_records[], int num_records, const OUTPUT_INFO *recordinfo,
+                                  size_t first_alongtrack, size_t n_scanlines) {
+
+  for (unsigned int i=0; i<output_num_fields; ++i) {
+    struct output_field *thefield = &output_data_analysis[i];
+
+    switch(thefield->memory_type) {
+    case OUTPUT_INT:
+      write_buffer<int>(thefield, selected_records, num_records, recordinfo, first_alongtrack, n_scanlines);
+      break;
+    case OUTPUT_SHORT:
+      write_buffer<short>(thefield, selected_records, num_records, recordinfo, first_alongtrack, n_scanlines);
+      break;
+    case OUTPUT_USHORT:
+      write_buffer<unsigned short>(thefield, selected_records, num_records, recordinfo, first_alongtrack, n_scanlines);
+      break;
+    case OUTPUT_STRING:
+      write_buffer<const char*>(thefield, selected_records, num_records, recordinfo, first_alongtrack, n_scanlines);
+      break;
+    case OUTPUT_FLOAT:
+      write_buffer<float>(thefield, selected_records, num_records, recordinfo, first_alongtrack, n_scanlines);
+      break;
+    case OUTPUT_DOUBLE:
+      write_buffer<double>(thefield, selected_records, num_records, recordinfo, first_alongtrack, n_scanlines);
+      break;
+    case OUTPUT_DATE:
+      write_buffer<int, struct date>(thefield, selected_records, num_records, recordinfo, first_alongtrack, n_scanlines);
+      break;
+    case OUTPUT_TIME:
+      write_buffer<int, struct time>(thefield, selected_records, num_records, recordinfo, first_alongtrack, n_scanlines);
+      break;
+    case OUTPUT_DATETIME:
+      write_buffer<int, struct datetime>(thefield, selected_records, num_records, recordinfo, first_alongtrack, n_scanlines);
+      break;
+    }
+  }
 }
 
 RC netcdf_write_analysis_data(const bool selected_records[], int num_records, const OUTPUT_INFO *recordinfo) {
   int rc = ERROR_ID_NO;
 
   try {
-    for (unsigned int i=0; i<output_num_fields; ++i) {
-      struct output_field *thefield = &output_data_analysis[i];
+    write_analysis_fields(selected_records, num_records, recordinfo, 0, n_alongtrack);
+  } catch (std::runtime_error& e) {
+    rc =  ERROR_SetLast(__func__, ERROR_TYPE_FATAL, ERROR_ID_NETCDF, e.what());
+  }
 
-      switch(thefield->memory_type) {
-      case OUTPUT_INT:
-        write_buffer<int>(thefield, selected_records, num_records, recordinfo);
-        break;
-      case OUTPUT_SHORT:
-        write_buffer<short>(thefield, selected_records, num_records, recordinfo);
-        break;
-      case OUTPUT_USHORT:
-        write_buffer<unsigned short>(thefield, selected_records, num_records, recordinfo);
-        break;
-      case OUTPUT_STRING:
-        write_buffer<const char*>(thefield, selected_records, num_records, recordinfo);
-        break;
-      case OUTPUT_FLOAT:
-        write_buffer<float>(thefield, selected_records, num_records, recordinfo);
-        break;
-      case OUTPUT_DOUBLE:
-        write_buffer<double>(thefield, selected_records, num_records, recordinfo);
-        break;
-      case OUTPUT_DATE:
-        write_buffer<int, struct date>(thefield, selected_records, num_records, recordinfo);
-        break;
-      case OUTPUT_TIME:
-        write_buffer<int, struct time>(thefield, selected_records, num_records, recordinfo);
-        break;
-      case OUTPUT_DATETIME:
-        write_buffer<int, struct datetime>(thefield, selected_records, num_records, recordinfo);
-        break;
-      }
-    }
+  return rc;
+}
+
+// Streaming output: write a block of records to the file opened by
+// netcdf_open.  The scanlines of the block which were not present in
+// previous blocks are written at once, records of scanlines already
+// written (a scanline split between two blocks) are added one by one.
+// The file is synchronized after each block, so that the results
+// written so far are not lost if the processing is interrupted.
+RC netcdf_write_analysis_block(const bool selected_records[], int num_records, const OUTPUT_INFO *recordinfo) {
+  int rc = ERROR_ID_NO;
+
+  size_t end_alongtrack = first_unwritten;
+  for (int record=0; record < num_records; ++record) {
+    if (selected_records[record] && (recordinfo[record].i_crosstrack!=ITEM_NONE) && (recordinfo[record].i_alongtrack!=ITEM_NONE))
+      end_alongtrack = std::max(end_alongtrack, (size_t)recordinfo[record].i_alongtrack+1);
+  }
+  end_alongtrack = std::min(end_alongtrack, n_alongtrack);
+
+  try {
+    write_analysis_fields(selected_records, num_records, recordinfo, first_unwritten, end_alongtrack - first_unwritten);
+    first_unwritten = end_alongtrack;
+
+    if (nc_sync(output_file.groupID()) != NC_NOERR)
+      throw std::runtime_error("Cannot synchronize netCDF output file '" + output_file.getFile() + "'");
   } catch (std::runtime_error& e) {
     rc =  ERROR_SetLast(__func__, ERROR_TYPE_FATAL, ERROR_ID_NETCDF, e.what());
   }
@@ -15,6 +15,7 @@ extern "C" {
   void netcdf_close_file(void);
 
   RC netcdf_write_analysis_data(const bool selected_records[], int num_records, const OUTPUT_INFO *outputRecords);
+  RC netcdf_write_analysis_block(const bool selected_records[], int num_records, const OUTPUT_INFO *outputRecords);
 
   RC netcdf_allow_file(const char *filename, const PRJCT_RESULTS *results);
   RC netcdf_save_calib(double *lambda,double *reference,int indexFenoColumn,int n_wavel);
@@ -493,11 +493,13 @@ static inline void get_shift(struct output_field *this_field, double *shift, con
   *shift = ( pTabCrossResults ) ? pTabCrossResults->Shift : QDOAS_FILL_DOUBLE;
 }
 
+// wavelength of the center pixel of the fitting window, on the calibration of the analysis window (LambdaK)
 static inline void get_center_wavelength(struct output_field *this_field, double *lambda, const ENGINE_CONTEXT *pEngineContext __attribute__ ((unused)), int indexFenoColumn, int index_calib) {
   CROSS_RESULTS *pTabCrossResults = this_field->get_cross_results(this_field, indexFenoColumn, index_calib);
-  struct fit_properties *fit  = &this_field->get_tabfeno(this_field, indexFenoColumn)->fit_properties;
+  const FENO *pTabFeno = this_field->get_tabfeno(this_field, indexFenoColumn);
+  const struct fit_properties *fit  = &pTabFeno->fit_properties;
   *lambda  =pTabCrossResults
-    ? center_pixel_wavelength(spectrum_start(fit->specrange), spectrum_end(fit->specrange))
+    ? center_pixel_wavelength(pTabFeno->LambdaK,spectrum_start(fit->specrange), spectrum_end(fit->specrange))
     : QDOAS_FILL_DOUBLE;
 }
 
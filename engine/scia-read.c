@@ -59,6 +59,7 @@
 //               load the irradiance spectrum measured at the specified channel
 //
 //  SCIA_ReadPDS - SCIAMACHY calibrated level 1 data read out;
+//  SCIA_GetOrbitNumber - read the absolute orbit number in the main product header;
 //
 //  REFERENCE
 //
@@ -1028,6 +1029,51 @@ RC SciaReadNadirMDS(ENGINE_CONTEXT *pEngineContext,INDEX indexState,INDEX indexR
   return rc;
  }
 
+// -----------------------------------------------------------------------------
+// FUNCTION      SCIA_GetOrbitNumber
+// -----------------------------------------------------------------------------
+// PURPOSE       Read the absolute orbit number in the main product header of a
+//               PDS file, without loading the file (the output file name of the
+//               file depends on it, see OUTPUT_SpectraFileOutputName)
+//
+// INPUT         fileName     the name of the PDS file
+// OUTPUT        pOrbitNumber the absolute orbit number
+//
+// RETURN        ERROR_ID_FILE_NOT_FOUND  if the file can not be opened;
+//               ERROR_ID_PDS             if the main product header can not be read;
+//               ERROR_ID_NO              otherwise.
+// -----------------------------------------------------------------------------
+
+RC SCIA_GetOrbitNumber(const char *fileName,int *pOrbitNumber)
+ {
+  // Declarations
+
+  MPH mph;
+  FILE *fp;
+  RC rc;
+
+  // Initializations
+
+  rc=ERROR_ID_NO;
+  *pOrbitNumber=ITEM_NONE;
+
+  if ((fp=fopen(fileName,"rb"))==NULL)
+   rc=ERROR_SetLast(__func__,ERROR_TYPE_WARNING,ERROR_ID_FILE_NOT_FOUND,fileName);
+  else
+   {
+    if (Read_MPH(fp,&mph)!=OK)
+     rc=ERROR_SetLast(__func__,ERROR_TYPE_WARNING,ERROR_ID_PDS,"Read_MPH",fileName);
+    else
+     *pOrbitNumber=atoi(mph.abs_orbit);
+
+    fclose(fp);
+   }
+
+  // Return
+
+  return rc;
+ }
+
 // -----------------------------------------------------------------------------
 // FUNCTION      SCIA_SetPDS
 // -----------------------------------------------------------------------------
@@ -1577,7 +1623,7 @@ RC SciaNewRef(ENGINE_CONTEXT *pEngineContext,void *responseHandle) {
 
         // align ref w.r.t irradiance reference:
         double sigma_shift, sigma_stretch, sigma_stretch2; // not used here...
-        rc = ANALYSE_fit_shift_stretch(1, 0, pTabFeno->SrefEtalon, ref->spectrum,
+        rc = ANALYSE_fit_shift_stretch(&ANALYSE_context,1, 0, pTabFeno->SrefEtalon, ref->spectrum,
                                        &ref->shift, &ref->stretch, &ref->stretch2, \
                                        &sigma_shift, &sigma_stretch, &sigma_stretch2);
       }
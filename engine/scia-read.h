@@ -5,6 +5,7 @@ void SCIA_ReleaseBuffers(char format);
 RC   SCIA_SetPDS(ENGINE_CONTEXT *pEngineContext);
 RC   SCIA_ReadPDS(ENGINE_CONTEXT *pEngineContext,int recordNo);
 void SCIA_get_orbit_date(int *year, int *month, int *day);
+RC   SCIA_GetOrbitNumber(const char *fileName,int *pOrbitNumber);
 RC SCIA_LoadAnalysis(ENGINE_CONTEXT *pEngineContext,void *responseHandle);
 RC SCIA_get_vza_ref(double esm_pos, int index_feno, FENO *feno);
 
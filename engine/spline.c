@@ -53,6 +53,7 @@
 //
 //  SPLINE_Deriv2  calculates the second derivatives needed for cubic spline interpolation
 //  SPLINE_Vector  function for linear and cubic interpolation;
+//  SPLINE_VectorDeriv  first derivative of the linear or cubic interpolant;
 //
 //  ----------------------------------------------------------------------------
 
@@ -194,6 +195,71 @@ unsigned int log2_ceil (unsigned long x) {
   return (8*sizeof(x))-__builtin_clzl(x-1);
 }
 
+/*! \brief locate the interval of a tabulated function containing x
+
+  binary search for xlo such that *xlo < x <= xlo[1]; x is expected
+  to lie strictly inside ]xa[0],xa[na-1][.
+
+  \param[in] num_steps log2_ceil(na)
+
+  \retval the index of xlo in xa
+*/
+static inline int spline_locate(const double *restrict xa,int na,unsigned int num_steps,double x) {
+  const double *xlo=xa;
+
+  // special case for the first step, in case na is not a power of 2:
+
+  // 1. find the largest power of 2 which is smaller than 'na'
+  size_t size = (1ul << (num_steps - 1) );
+
+  // 2. reduce the search to a search in a sequence of length 'size'
+  double start = xa[na - size];
+  if (start < x) // if mid < x, look in the sequence (start, start+size[
+    xlo += na-size;
+  // else: look in (xa, xa+size[
+
+  // 3. we now search in a sequence of 'size' elements, where 'size'
+  // is a power of 2.  'size' is halved in each iteration.
+  for (unsigned j=num_steps-1; j != 0; --j) {
+    size/=2;
+    double mid = xlo[size];
+    if (mid < x)
+      xlo += size;
+  }
+
+  return xlo-xa;
+}
+
+// number of points interpolated per block by SPLINE_Vector
+
+#define SPLINE_BLOCK 64
+
+// maximum number of intervals browsed linearly from the interval of the previous point before using a binary search
+
+#define SPLINE_WALK 8
+
+/*! \brief locate the interval containing x, starting from the interval of the previous point
+
+  Target grids are most of the time sorted and close to the tabulated
+  grid : the interval of x is then found by browsing a few intervals
+  from the interval k of the previous point.  Otherwise (first point,
+  unsorted grid, large gap), fall back on spline_locate.
+
+  \param[in] k interval of the previous point, -1 if none
+
+  \retval the index of xlo in xa
+*/
+static inline int spline_walk(const double *restrict xa,int na,unsigned int num_steps,int k,double x) {
+  if ((k>=0) && (xa[k]<x)) {
+    for (int n=0; (n<SPLINE_WALK) && (xa[k+1]<x); n++)
+      k++;
+    if (x<=xa[k+1])
+      return k;
+  }
+
+  return spline_locate(xa,na,num_steps,x);
+}
+
 /*! \brief linear or cubic spline interpolation
 
   \param[in] xa,ya x and y values of the tabulated function
@@ -209,6 +275,13 @@ unsigned int log2_ceil (unsigned long x) {
 
   \param[in] type SPLINE_LINEAR or SPLINE_CUBIC
 
+  The new abscissae are processed by blocks : intervals and ratios are
+  first determined for the whole block (spline_walk), then the
+  interpolation is evaluated in a loop without branches, that the
+  compiler can vectorize.  Abscissae out of the boundaries of xa are
+  evaluated on the first or last interval and then replaced by ya[0]
+  or ya[na-1].
+
   \retval ERROR_ID_NO
 */
 RC SPLINE_Vector(const double *restrict xa, const double *restrict ya, const double *restrict y2a,int na, const double *restrict xb, double *restrict yb,int nb,int type)
@@ -221,55 +294,98 @@ RC SPLINE_Vector(const double *restrict xa, const double *restrict ya, const dou
   // of the next power of 2.
   const unsigned int num_steps = log2_ceil(na);
 
-  // Browse new absissae
-  for (int i=0; i<nb; ++i) {
-    const double x=xb[i];
+  int    kBlock[SPLINE_BLOCK];                                                  // interval of each point of the block
+  double aBlock[SPLINE_BLOCK];                                                  // ratio (xa[k+1]-x)/h
+  int    outBlock[SPLINE_BLOCK];                                                // points of the block out of boundaries
+  int    k=-1;
+
+  // Browse new absissae by blocks
+  for (int i0=0; i0<nb; i0+=SPLINE_BLOCK) {
+    const int n=(nb-i0<SPLINE_BLOCK)?nb-i0:SPLINE_BLOCK;
+    const double *restrict x=xb+i0;
+    double *restrict y=yb+i0;
+    int nOut=0;
+
+    // 1. intervals and ratios
+
+    for (int i=0; i<n; ++i) {
+      if (x[i]<=xa[0]) {                                                        // new absissae is out of boundaries
+        kBlock[i]=0;
+        aBlock[i]=1.;
+        outBlock[nOut++]=i;
+      } else if (x[i]>=xa[na-1]) {
+        kBlock[i]=na-2;
+        aBlock[i]=0.;
+        outBlock[nOut++]=i;
+      } else {
+        k=spline_walk(xa,na,num_steps,k,x[i]);
+        kBlock[i]=k;
+        aBlock[i]=(xa[k+1]-x[i])/(xa[k+1]-xa[k]);
+      }
+    }
 
-    // new absissae is out of boundaries
-    if (x<=xa[0]) {
-      yb[i]=ya[0];
-      continue;
-    } else if (x>=xa[na-1]) {
-      yb[i]=ya[na-1];
-      continue;
+    // 2. interpolation
+
+    if (type==SPLINE_CUBIC) {
+      for (int i=0; i<n; ++i) {
+        const int kk=kBlock[i];
+        const double h=xa[kk+1]-xa[kk];
+        const double a=aBlock[i];
+        const double b=1.-a;
+        y[i]=a*ya[kk]+b*ya[kk+1]+((a*a*a-a)*y2a[kk]+(b*b*b-b)*y2a[kk+1])*(h*h)/6.;
+      }
+    } else {                                                                    // assume type == SPLINE_LINEAR
+      for (int i=0; i<n; ++i) {
+        const int kk=kBlock[i];
+        const double a=aBlock[i];
+        y[i]=a*ya[kk]+(1.-a)*ya[kk+1];
+      }
     }
 
-    // binary search for xlo such that *xlo < x <= xlo[1],
-    const double *xlo=xa;
+    // 3. boundaries
+
+    for (int j=0; j<nOut; ++j) {
+      const int i=outBlock[j];
+      y[i]=(x[i]<=xa[0])?ya[0]:ya[na-1];
+    }
+  }
+
+  return ERROR_ID_NO;
+}
+
+/*! \brief first derivative of the linear or cubic spline interpolant
 
-    // special case for the first step, in case na is not a power of 2:
+  Same arguments as SPLINE_Vector, but dyb receives dy/dx of the
+  interpolating function at xb.  Outside the tabulated range,
+  SPLINE_Vector returns a constant, so the derivative is 0.
 
-    // 1. find the largest power of 2 which is smaller than 'na'
-    size_t size = (1ul << (num_steps - 1) );
+  \retval ERROR_ID_NO
+*/
+RC SPLINE_VectorDeriv(const double *restrict xa, const double *restrict ya, const double *restrict y2a,int na, const double *restrict xb, double *restrict dyb,int nb,int type)
+{
+  assert(na >= 2);
 
-    // 2. reduce the search to a search in a sequence of length 'size'
-    double start = xa[na - size];
-    if (start < x) // if mid < x, look in the sequence (start, start+size[
-      xlo += na-size;
-    // else: look in (xa, xa+size[
+  const unsigned int num_steps = log2_ceil(na);
+  int k=-1;
 
-    // 3. we now search in a sequence of 'size' elements, where 'size'
-    // is a power of 2.  'size' is halved in each iteration.
-    for (unsigned j=num_steps-1; j != 0; --j) {
-      size/=2;
-      double mid = xlo[size];
-      if (mid < x)
-        xlo += size;
+  for (int i=0; i<nb; ++i) {
+    const double x=xb[i];
+
+    if ((x<=xa[0]) || (x>=xa[na-1])) {
+      dyb[i]=0.;
+      continue;
     }
 
-    int k = xlo-xa;
-    double xhi=xlo[1];
-    double h=xhi-*xlo;
-    
-    // get ratios        
-    double a = (xhi-x)/h;
-    double b = 1.-a; // (x-(*xlo) )/h;
-      
-    // interpolation
-       
-    yb[i] = a*ya[k]+b*ya[k+1]; // assume type == SPLINE_LINEAR or SPLINE_CUBIC
+    k = spline_walk(xa,na,num_steps,k,x);
+    double h=xa[k+1]-xa[k];
+    double a = (xa[k+1]-x)/h;
+    double b = 1.-a;
+
+    // da/dx=-1/h, db/dx=1/h
+
+    dyb[i] = (ya[k+1]-ya[k])/h;
     if (type==SPLINE_CUBIC)
-      yb[i] += ((a*a*a-a)*y2a[k]+(b*b*b-b)*y2a[k+1])*(h*h)/6.;
+      dyb[i] += ((1.-3.*a*a)*y2a[k]+(3.*b*b-1.)*y2a[k+1])*h/6.;
   }
 
   return ERROR_ID_NO;
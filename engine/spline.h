@@ -16,6 +16,7 @@ extern "C" {
   
   RC SPLINE_Deriv2(const double *X, const double *Y, double *Y2,int n, const char *callingFunction);
   RC SPLINE_Vector(const double *xa, const double *ya, const double *y2a,int na, const double *xb,double *yb,int nb,int type);
+  RC SPLINE_VectorDeriv(const double *xa, const double *ya, const double *y2a,int na, const double *xb,double *dyb,int nb,int type);
   
 #if defined(_cplusplus) || defined(__cplusplus)
 }
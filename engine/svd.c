@@ -96,7 +96,7 @@
 // STATIC VARIABLES
 // ================
 
-static double at, bt, ct, maxarg1, maxarg2;
+static __thread double at, bt, ct, maxarg1, maxarg2;                           // used by PYTHAG and SMAX (one copy per thread)
 
 // -----------------------------------------------------------------------------
 // FUNCTION      SVD_Bksb
@@ -0,0 +1,275 @@
+//  ----------------------------------------------------------------------------
+//
+//  Product/Project   :  QDOAS
+//  Module purpose    :  TIME SPENT IN THE MAIN STAGES OF THE PROCESSING
+//  Name of module    :  TIMING.C
+//  Compiler          :  MinGW (GNU compiler)
+//
+//  QDOAS is a cross-platform application developed in QT for DOAS retrieval
+//  (Differential Optical Absorption Spectroscopy).
+//
+//  The QT version of the program has been developed jointly by the Belgian
+//  Institute for Space Aeronomy (BIRA-IASB) and the Science and Technology
+//  company (S[&]T) - Copyright (C) 2007
+//
+//      BIRA-IASB                                   S[&]T
+//      Belgian Institute for Space Aeronomy        Science [&] Technology
+//      Avenue Circulaire, 3                        Postbus 608
+//      1180     UCCLE                              2600 AP Delft
+//      BELGIUM                                     THE NETHERLANDS
+//      caroline.fayt@aeronomie.be                  info@stcorp.nl
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 2
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software Foundation,
+//  Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+//  ----------------------------------------------------------------------------
+//  FUNCTIONS
+//
+//  TIMING_SetFormat - enable the timing and select the format of the summary;
+//  TIMING_GetFormat - format of the summary (TIMING_FORMAT_NONE if disabled);
+//  TIMING_Reset - reset the counters of all threads;
+//
+//  TIMING_Start - start timing a stage;
+//  TIMING_Stop - add the time elapsed since TIMING_Start to a stage;
+//
+//  TIMING_Print - print the summary.
+//
+//  ----------------------------------------------------------------------------
+//
+//  Each thread accumulates its times in its own block of counters, so that
+//  TIMING_Stop doesn't need any lock.  Blocks are registered in a list the
+//  first time a thread stops a timer; when a thread ends, its counters are
+//  added to those of the finished threads and its block is released.
+//  TIMING_Print should be called when the analysis threads are done.
+//  ----------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "timing.h"
+
+// ================
+// STATIC VARIABLES
+// ================
+
+typedef struct _timingThread
+ {
+  double seconds[TIMING_STAGE_MAX];                                             // time spent in each stage
+  long   calls[TIMING_STAGE_MAX];                                               // number of calls of each stage
+  struct _timingThread *next;                                                   // next thread in the list
+ }
+TIMING_THREAD;
+
+static const char *timingStageNames[TIMING_STAGE_MAX]=
+ {
+  "read",
+  "analysis",
+  "curfit",
+  "fit_function",
+  "calibration",
+  "convolution",
+  "output"
+ };
+
+static int timingFormat=TIMING_FORMAT_NONE;
+static TIMING_THREAD *timingThreads=NULL;                                       // counters of the running threads
+static TIMING_THREAD timingFinished;                                            // counters of the threads that have ended
+static pthread_mutex_t timingLock=PTHREAD_MUTEX_INITIALIZER;                    // protect the list of threads
+static pthread_key_t timingKey;                                                 // to release the block when a thread ends
+static pthread_once_t timingKeyOnce=PTHREAD_ONCE_INIT;
+static __thread TIMING_THREAD *timingThread=NULL;                               // counters of the current thread
+
+// =========
+// FUNCTIONS
+// =========
+
+static double TimingNow(void)
+ {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC,&now);
+
+  return (double)now.tv_sec+1.e-9*now.tv_nsec;
+ }
+
+// TimingThreadEnd : add the counters of a thread that ends to the counters of the finished threads
+
+static void TimingThreadEnd(void *block)
+ {
+  TIMING_THREAD *pThread=(TIMING_THREAD *)block,**ppThread;
+
+  pthread_mutex_lock(&timingLock);
+
+  for (ppThread=&timingThreads;*ppThread!=NULL;ppThread=&(*ppThread)->next)
+   if (*ppThread==pThread)
+    {
+     *ppThread=pThread->next;
+     break;
+    }
+
+  for (int i=0;i<TIMING_STAGE_MAX;i++)
+   {
+    timingFinished.seconds[i]+=pThread->seconds[i];
+    timingFinished.calls[i]+=pThread->calls[i];
+   }
+
+  pthread_mutex_unlock(&timingLock);
+
+  free(pThread);
+ }
+
+static void TimingKeyCreate(void)
+ {
+  pthread_key_create(&timingKey,TimingThreadEnd);
+ }
+
+// TimingThreadGet : counters of the current thread (registered at the first call)
+
+static TIMING_THREAD *TimingThreadGet(void)
+ {
+  if ((timingThread==NULL) && ((timingThread=(TIMING_THREAD *)calloc(1,sizeof(TIMING_THREAD)))!=NULL))
+   {
+    pthread_once(&timingKeyOnce,TimingKeyCreate);
+    pthread_setspecific(timingKey,timingThread);
+
+    pthread_mutex_lock(&timingLock);
+    timingThread->next=timingThreads;
+    timingThreads=timingThread;
+    pthread_mutex_unlock(&timingLock);
+   }
+
+  return timingThread;
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      TIMING_SetFormat
+// -----------------------------------------------------------------------------
+// PURPOSE       Enable the timing (TIMING_FORMAT_TEXT or TIMING_FORMAT_JSON) or
+//               disable it (TIMING_FORMAT_NONE)
+// -----------------------------------------------------------------------------
+
+void TIMING_SetFormat(int format)
+ {
+  timingFormat=format;
+ }
+
+int TIMING_GetFormat(void)
+ {
+  return timingFormat;
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      TIMING_Reset
+// -----------------------------------------------------------------------------
+// PURPOSE       Reset the counters of all threads
+// -----------------------------------------------------------------------------
+
+void TIMING_Reset(void)
+ {
+  pthread_mutex_lock(&timingLock);
+
+  for (TIMING_THREAD *pThread=timingThreads;pThread!=NULL;pThread=pThread->next)
+   {
+    memset(pThread->seconds,0,sizeof(pThread->seconds));
+    memset(pThread->calls,0,sizeof(pThread->calls));
+   }
+
+  memset(&timingFinished,0,sizeof(timingFinished));
+
+  pthread_mutex_unlock(&timingLock);
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      TIMING_Start
+// -----------------------------------------------------------------------------
+// PURPOSE       Start timing a stage
+//
+// RETURN        the current time to give to TIMING_Stop (0 if timing is disabled)
+// -----------------------------------------------------------------------------
+
+double TIMING_Start(void)
+ {
+  return (timingFormat!=TIMING_FORMAT_NONE)?TimingNow():(double)0.;
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      TIMING_Stop
+// -----------------------------------------------------------------------------
+// PURPOSE       Add the time elapsed since TIMING_Start to a stage
+//
+// INPUT         stage : the stage (cfr enum _timingStages)
+//               start : the value returned by TIMING_Start
+// -----------------------------------------------------------------------------
+
+void TIMING_Stop(int stage,double start)
+ {
+  TIMING_THREAD *pThread;
+
+  if ((start!=(double)0.) && (stage>=0) && (stage<TIMING_STAGE_MAX) && ((pThread=TimingThreadGet())!=NULL))
+   {
+    pThread->seconds[stage]+=TimingNow()-start;
+    pThread->calls[stage]++;
+   }
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      TIMING_Print
+// -----------------------------------------------------------------------------
+// PURPOSE       Print the time spent in each stage, summed over all threads
+//
+// INPUT         fp     : the output stream
+//               format : TIMING_FORMAT_TEXT or TIMING_FORMAT_JSON
+// -----------------------------------------------------------------------------
+
+void TIMING_Print(FILE *fp,int format)
+ {
+  TIMING_THREAD total;
+
+  pthread_mutex_lock(&timingLock);
+
+  total=timingFinished;
+
+  for (TIMING_THREAD *pThread=timingThreads;pThread!=NULL;pThread=pThread->next)
+   for (int i=0;i<TIMING_STAGE_MAX;i++)
+    {
+     total.seconds[i]+=pThread->seconds[i];
+     total.calls[i]+=pThread->calls[i];
+    }
+
+  pthread_mutex_unlock(&timingLock);
+
+  if (format==TIMING_FORMAT_JSON)
+   {
+    fprintf(fp,"{\"stages\": {");
+
+    for (int i=0;i<TIMING_STAGE_MAX;i++)
+     fprintf(fp,"%s\n  \"%s\": {\"calls\": %ld, \"seconds\": %.6f}",(i>0)?",":"",timingStageNames[i],total.calls[i],total.seconds[i]);
+
+    fprintf(fp,"\n}}\n");
+   }
+  else if (format==TIMING_FORMAT_TEXT)
+   {
+    fprintf(fp,"%-16s %12s %14s %14s\n","stage","calls","total (s)","mean (ms)");
+
+    for (int i=0;i<TIMING_STAGE_MAX;i++)
+     fprintf(fp,"%-16s %12ld %14.3f %14.4f\n",timingStageNames[i],total.calls[i],total.seconds[i],
+            (total.calls[i]>0)?1000.*total.seconds[i]/total.calls[i]:(double)0.);
+
+    fprintf(fp,"(times summed over all threads, nested stages included in the enclosing ones)\n");
+   }
+
+  fflush(fp);
+ }
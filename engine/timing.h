@@ -0,0 +1,52 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdio.h>
+
+#if defined(_cplusplus) || defined(__cplusplus)
+extern "C" {
+#endif
+
+// Time spent in the main stages of the processing, accumulated by each
+// thread without lock.  Stages can be nested (the time of the fitting function
+// is included in the time of Curfit, which is included in the time of
+// ANALYSE_Spectrum).  When timing is disabled (default), TIMING_Start and
+// TIMING_Stop don't read the clock.
+//
+//   double timingStart=TIMING_Start();
+//   ...
+//   TIMING_Stop(TIMING_STAGE_CURFIT,timingStart);
+
+enum _timingStages
+ {
+  TIMING_STAGE_READ,                                                            // EngineReadFile
+  TIMING_STAGE_ANALYSIS,                                                        // ANALYSE_Spectrum
+  TIMING_STAGE_CURFIT,                                                          // Curfit (non linear fit)
+  TIMING_STAGE_FUNCTION,                                                        // ANALYSE_Function (evaluations of the fitting function)
+  TIMING_STAGE_KURUCZ,                                                          // KURUCZ_Spectrum (wavelength calibration)
+  TIMING_STAGE_CONVOLUTION,                                                     // XSCONV_TypeStandard
+  TIMING_STAGE_OUTPUT,                                                          // OUTPUT_FlushBuffers
+  TIMING_STAGE_MAX
+ };
+
+enum _timingFormats
+ {
+  TIMING_FORMAT_NONE,                                                           // timing disabled
+  TIMING_FORMAT_TEXT,                                                           // table
+  TIMING_FORMAT_JSON                                                            // JSON object
+ };
+
+void   TIMING_SetFormat(int format);
+int    TIMING_GetFormat(void);
+void   TIMING_Reset(void);
+
+double TIMING_Start(void);
+void   TIMING_Stop(int stage,double start);
+
+void   TIMING_Print(FILE *fp,int format);
+
+#if defined(_cplusplus) || defined(__cplusplus)
+}
+#endif
+
+#endif
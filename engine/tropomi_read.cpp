@@ -31,6 +31,8 @@
 #include <stdexcept>
 #include <algorithm>
 #include <sstream>
+#include <future>
+#include <atomic>
 
 #include <cassert>
 #include <cmath>
@@ -67,6 +69,10 @@ const char* band_names[] = {
 
 static const size_t MAX_GROUNDPIXEL = 450;
 
+// minimum number of scanlines of radiances read at once (rounded up to a multiple of the
+// number of scanlines per netCDF chunk)
+static const size_t BLOCK_SCANLINES = 8;
+
 //static map<string,vector<vector<double>>> reference_matrix;
 //static map<string,vector<vector<double>>> reference_wavelengths;
 
@@ -84,21 +90,32 @@ namespace {
     vector<double> sigma;
   };
 
-  // earthshine spectrum to be used in earthshine reference:
-  struct earth_ref {
-    const vector<float>& wavelength;
-    const vector<float>& spectrum;
-    const vector<float>& error;
+  // earthshine spectra of one detector row selected in one orbit
+  // file, stored one after the other in scanline order.
+  struct row_refs {
+    vector<float> wavelength; // nominal wavelength of the row
+    vector<float> spectra;
+    vector<float> errors;
+    vector<unsigned char> use_window; // for each spectrum, NFeno flags for the analysis windows it is used in
+  };
+
+  // earthshine spectra selected in one orbit file
+  struct orbit_refs {
     // Because fill values could, in principle, change between different
     // orbit files, we store the fill values together with the spectra.
-    const float fill_wavelength;
-    const float fill_spectrum;
-    const float fill_error;
-    earth_ref(const vector<float>& w,
-              const vector<float>& s,
-              const vector<float>& e, float fw, float fs, float fe) :
-      wavelength(w), spectrum(s), error(e),
-      fill_wavelength(fw), fill_spectrum(fs), fill_error(fe) {};
+    float fill_wavelength;
+    float fill_spectrum;
+    float fill_error;
+    vector<row_refs> rows;
+  };
+
+  // sum of the earthshine reference spectra and of their variances
+  // for one row and analysis window
+  struct ref_sum {
+    ref_sum() : sum(), variance(), count(0) {};
+    vector<double> sum;
+    vector<double> variance;
+    size_t count;
   };
 
   struct geodata {
@@ -107,6 +124,16 @@ namespace {
       lon_bounds, lat_bounds,
       sat_lon, sat_lat, sat_alt;
   };
+
+  // radiances and radiance noise of consecutive scanlines, stored as
+  // (scanline, ground_pixel, spectral_channel)
+  struct scanline_block {
+    scanline_block() : first(0), count(0), rad(), rad_noise() {};
+    size_t first; // first scanline of the block
+    size_t count; // number of scanlines in the block
+    vector<float> rad;
+    vector<float> rad_noise;
+  };
 }
 
 // ground_pixel_quality flag meanings
@@ -138,6 +165,21 @@ static double fill_nominal_wavelengths; // fill value for L1B radiance wavelengt
 
 static geodata current_geodata;
 
+// Radiances are read by blocks of scanlines instead of one spectrum at a
+// time: each chunk of the file is then decompressed only once.  While the
+// records of current_block are analysed, the next block is read by a
+// background thread.  The netCDF library is not thread-safe, so the main
+// thread must not call it while next_block is being read: see
+// wait_prefetch().
+static NetCDFGroup current_obs_group;
+static double fill_rad, fill_noise; // fill values of radiance and radiance_noise
+static size_t block_scanlines; // number of scanlines per block
+static scanline_block current_block;
+static std::future<scanline_block> next_block;
+
+// number of threads used to sum the spectra of the automatic reference
+static int reference_threads = 1;
+
 static size_t size_spectral; // number of wavelengths per spectrum
 static size_t size_scanline; // number of measurements (i.e. along track)
 static size_t size_groundpixel; // number of detector rows (i.e. cross-track)
@@ -238,9 +280,60 @@ static geodata read_geodata(const NetCDFGroup& geo_group, size_t n_scanline, siz
   return result;
 }
 
+static scanline_block read_block(size_t first) {
+  scanline_block block;
+  block.first = first;
+  block.count = std::min(block_scanlines, size_scanline - first);
+  block.rad.resize(block.count * size_groundpixel * size_spectral);
+  block.rad_noise.resize(block.rad.size());
+
+  const size_t start[] = {0, first, 0, 0};
+  const size_t count[] = {1, block.count, size_groundpixel, size_spectral};
+  current_obs_group.getVar("radiance", start, count, block.rad.data());
+  current_obs_group.getVar("radiance_noise", start, count, block.rad_noise.data());
+
+  return block;
+}
+
+// wait until the background thread has finished reading the next block.
+static void wait_prefetch() {
+  if (next_block.valid())
+    next_block.wait();
+}
+
+// make sure current_block holds the given scanline and start reading the
+// next block in the background.
+static void load_scanline(size_t scanline) {
+  if (current_block.count && scanline >= current_block.first && scanline < current_block.first + current_block.count)
+    return;
+
+  const size_t first = scanline - scanline % block_scanlines;
+
+  if (next_block.valid()) {
+    scanline_block block = next_block.get(); // rethrows errors of the background thread
+    if (block.first == first)
+      current_block = std::move(block);
+  }
+  if (!current_block.count || current_block.first != first) {
+    current_block = scanline_block(); // release memory before reading
+    current_block = read_block(first);
+  }
+
+  if (first + block_scanlines < size_scanline)
+    next_block = std::async(std::launch::async, read_block, first + block_scanlines);
+}
+
+static void reset_blocks() {
+  wait_prefetch();
+  next_block = std::future<scanline_block>();
+  current_block = scanline_block();
+}
+
 int tropomi_set(ENGINE_CONTEXT *pEngineContext) {
 
   int rc = 0;
+  reset_blocks();
+
   try {
     current_file = NetCDFFile(pEngineContext->fileInfo.fileName);
     current_filename=pEngineContext->fileInfo.fileName;
@@ -255,6 +348,17 @@ int tropomi_set(ENGINE_CONTEXT *pEngineContext) {
     size_spectral = obsGroup.dimLen("spectral_channel");
     size_groundpixel = obsGroup.dimLen("ground_pixel");
 
+    current_obs_group = obsGroup;
+    fill_rad = obsGroup.getFillValue<double>("radiance");
+    fill_noise = obsGroup.getFillValue<double>("radiance_noise");
+
+    // align blocks on the chunks of the radiance variable
+    int storage;
+    size_t chunksizes[4];
+    obsGroup.inqVarChunking("radiance", &storage, chunksizes);
+    const size_t chunk_scanlines = (storage == NC_CHUNKED && chunksizes[1] > 0) ? chunksizes[1] : 1;
+    block_scanlines = chunk_scanlines * ((BLOCK_SCANLINES + chunk_scanlines - 1) / chunk_scanlines);
+
     pEngineContext->recordNumber = size_groundpixel * size_scanline;
     pEngineContext->n_alongtrack= size_scanline;
     pEngineContext->n_crosstrack= size_groundpixel;
@@ -312,8 +416,6 @@ int tropomi_read(ENGINE_CONTEXT *pEngineContext,int record) {
   assert(record > 0); // record is the requested record number, starting from 1
   int rc = 0;
 
-  NetCDFGroup obsGroup = current_file.getGroup(current_band + "_RADIANCE/STANDARD_MODE/OBSERVATIONS");
-
   const size_t indexScanline = (record - 1) / size_groundpixel;
   const size_t indexPixel = (record - 1) % size_groundpixel;
   size_t n_wavel = 0;
@@ -336,25 +438,19 @@ int tropomi_read(ENGINE_CONTEXT *pEngineContext,int record) {
     n_wavel = size_spectral;
   }
 
-  // dimensions of radiance & error are
-  // ('time','scanline','ground_pixel','spectral_channel')
-  const size_t start[] = {0,indexScanline, indexPixel, 0};
-  const size_t count[] = {1, 1, 1, size_spectral};
-
-  vector<double> rad(size_spectral);
-  vector<double> rad_noise(size_spectral);
-
   try {
-    obsGroup.getVar("radiance", start, count, rad.data() );
-    obsGroup.getVar("radiance_noise", start, count, rad_noise.data() );
+    // dimensions of radiance & error are
+    // ('time','scanline','ground_pixel','spectral_channel')
+    load_scanline(indexScanline);
 
-    const double fill_rad = obsGroup.getFillValue<double>("radiance");
-    const double fill_noise = obsGroup.getFillValue<double>("radiance_noise");
+    const size_t offset = ((indexScanline - current_block.first) * size_groundpixel + indexPixel) * size_spectral;
+    const float *rad = current_block.rad.data() + offset;
+    const float *rad_noise = current_block.rad_noise.data() + offset;
     const vector<double>& lambda = nominal_wavelengths.at(indexPixel);
 
     // copy non-fill values to buffers:
     size_t j=0;
-    for (size_t i=0; i<rad.size() && j<n_wavel; ++i) {
+    for (size_t i=0; i<size_spectral && j<n_wavel; ++i) {
       double li = lambda[i];
       double ri = rad[i];
       double ni = rad_noise[i];
@@ -665,231 +761,267 @@ std::pair<size_t,size_t> get_window_limits(const FENO *pTabFeno, const vector<fl
                                    std::distance(row_wavelengths.begin(), i_after));
 }
 
-// for each of the 450 possible detector rows, and for each analysis
-// window, gather a list of spectra matching the search criteria.
+// Select, in one orbit file, the earthshine spectra to use for the
+// automatic reference of each detector row and analysis window.
 //
-// \param pEngineContext ENGINE_CONTEXT containing criteria for the reference.
-// \param orbit_files List of file names in which to look.
-// \param cache A set that will hold all vectors of wavelengths, spectra and errors, for memory management.
+// The geolocation and ground pixel quality flags are read for the
+// whole orbit; radiances, radiance errors and spectral channel
+// quality flags are then read by blocks of consecutive scanlines,
+// restricted to the rows that contain selected ground pixels.
 //
-// One complication is that each analysis window may have its own
-// criteria for reference selection (even though this option is rarely
-// used).  Therefore, we need to keep a separate list of reference
-// spectra for each analysis window, but we do not want to keep
-// multiple copies of same spectrum in memory if it is used for
-// multiple analysis windows.  Therefore, we store every spectrum (as
-// well as wavelength grids and estimated errors) once in a 'cache',
-// and keep a list of references to the data in this cache for every
-// analysis window.  We use std::set to store the cache, because
-// references to elements of a std::set stay valid as the set grows.
-static vector<std::array<vector<earth_ref>, MAX_GROUNDPIXEL>> find_matching_spectra(ENGINE_CONTEXT *pEngineContext,const int nfiles,
-                                                                             set<vector<float>>& cache) {
-  assert(size_groundpixel <= MAX_GROUNDPIXEL);
-  vector<std::array<vector<earth_ref>, MAX_GROUNDPIXEL>> result(NFeno);
-
-  for (const string & fname : reference_orbit_files) {
-
-    NetCDFFile orbit(fname);
-    string bname=basename(fname);
-
-    // !!! old loop from Thomas; the problem is that it is difficult to come back to the file name
-    // for (const auto & orbit : orbit_files) {
-
-    // 1. read "nominal wavelength" for each row:
-    std::array<const vector<float>*, MAX_GROUNDPIXEL> nominal_wavelengths { nullptr };
-    NetCDFGroup instrGroup(orbit.getGroup(current_band + "_RADIANCE/STANDARD_MODE/INSTRUMENT"));
-    NetCDFGroup obsGroup(orbit.getGroup(current_band + "_RADIANCE/STANDARD_MODE/OBSERVATIONS"));
-
-    const size_t orbit_spectral = obsGroup.dimLen("spectral_channel");
-    const size_t orbit_groundpixel = obsGroup.dimLen("ground_pixel");
-    const size_t orbit_scanline = obsGroup.dimLen("scanline");
-
-    if (orbit_groundpixel != size_groundpixel || orbit_spectral != size_spectral) continue;
+// Returns false if the orbit does not have the dimensions of the
+// orbit being processed.
+static bool read_orbit_refs(const ENGINE_CONTEXT *pEngineContext, const string& fname, orbit_refs& refs) {
+  NetCDFFile orbit(fname);
 
-    for(size_t i=0; i<size_groundpixel; ++i) {
-      vector<float> wl(size_spectral);
-      const size_t start_wl[] = {0, i, 0};
-      const size_t count_wl[] = {1, 1, size_spectral};
-      instrGroup.getVar("nominal_wavelength", start_wl, count_wl, wl.data());
-      const auto& wavelengths = *cache.insert(wl).first;
-      nominal_wavelengths[i] = &wavelengths;
-    }
+  NetCDFGroup instrGroup(orbit.getGroup(current_band + "_RADIANCE/STANDARD_MODE/INSTRUMENT"));
+  NetCDFGroup obsGroup(orbit.getGroup(current_band + "_RADIANCE/STANDARD_MODE/OBSERVATIONS"));
 
-    const auto orbit_fill_wavelengths = instrGroup.getFillValue<float>("nominal_wavelength");
-    const auto orbit_fill_spectra = obsGroup.getFillValue<float>("radiance");
-    const auto orbit_fill_errors = obsGroup.getFillValue<float>("radiance_noise");
-
-    // 2. read geolocation data and flags required to evaluate which
-    // spectra should be used for the reference.
-    const size_t num_obs = orbit_scanline*size_groundpixel;
-    vector<float> lons(num_obs), lats(num_obs), szas(num_obs);
-    vector<unsigned char> ground_pixel_quality(num_obs);
-    // start and  count arguments for variables with observation dimensions (i.e. scanline x row):
-    const size_t start_obs[] = {0, 0, 0};
-    const size_t count_obs[] = {1, orbit_scanline, size_groundpixel };
-
-    NetCDFGroup geo_group(orbit.getGroup(current_band + "_RADIANCE/STANDARD_MODE/GEODATA"));
-    geo_group.getVar("latitude", start_obs, count_obs, lats.data());
-    geo_group.getVar("longitude", start_obs, count_obs, lons.data());
-    geo_group.getVar("solar_zenith_angle", start_obs, count_obs, szas.data());
-    obsGroup.getVar("ground_pixel_quality", start_obs, count_obs, ground_pixel_quality.data());
-
-    auto latitudes = reinterpret_cast<float (*)[size_groundpixel]>(lats.data());
-    auto longitudes = reinterpret_cast<float (*)[size_groundpixel]>(lons.data());
-    auto szangles = reinterpret_cast<float (*)[size_groundpixel]>(szas.data());
-    auto groundpixelqualityflags = reinterpret_cast<unsigned char (*)[size_groundpixel]>(ground_pixel_quality.data());
-    const static unsigned char groundpixel_quality_mask = SOLAR_ECLIPSE | DESCENDING | NIGHT
-      | GEO_BOUNDARY_CROSSING | GEOLOCATION_ERROR; // filter everything except SUN_GLINT_POSSIBLE
-
-    // Get indices of nominal_wavelengths corresponding to analysis window limits:
-    vector<std::array<std::pair<size_t,size_t>, MAX_GROUNDPIXEL>> window_limits(NFeno);
-    for (size_t row=0; row != size_groundpixel; ++row) {
-      for (int win=0; win!=NFeno; ++win) {
-        const FENO *pTabFeno = &TabFeno[row][win];
-        if (pTabFeno->hidden || (!pEngineContext->project.instrumental.use_row[row])) continue; // skip Kurucz calibration windows
-        window_limits.at(win).at(row) = get_window_limits(pTabFeno, *nominal_wavelengths.at(row), row);
-      }
-    }
-
-    int found=0;
-
-    // 3. read radiance & error for matching spectra
-    vector<unsigned char> spec_quality(size_spectral); // Temporary buffer for spectral_channel_quality flags
-    for (size_t scan=0; scan != orbit_scanline; ++scan) {
-
-      for (size_t row=0; row != size_groundpixel; ++row) {
-
-        if (!pEngineContext->project.instrumental.use_row[row]) continue;
-
-        // start and count indices to read along spectral dimension
-        // for one observation:
-        const size_t start[] = {0, scan, row, 0};
-        const size_t count[] = {1, 1, 1, size_spectral };
-
-        // TODO: check use_row[row]?
-        auto lat=latitudes[scan][row];
-        auto lon=longitudes[scan][row];
-        if (lon <= 0.0)
-          lon += 360.0;
-        auto sza=szangles[scan][row];
-
-        // Because we keep a separate list of reference spectra for
-        // each analysis window, it is possible that a spectrum is
-        // used as a reference for mutliple analysis windows.
-        //
-        // To keep track of this, i_spec is initialized to
-        // cache.end().  Once the spectrum and errors for this
-        // scanline and row have been read and stored in the cache,
-        // i_spec will point tot that element of the cache instead.
-        auto i_spec = cache.end();
-        auto i_err = cache.end();
-
-        // We want to read spectral_channel_quality flags just once,
-        // for each spectrum that satisfies all other criteria
-        // (reading these flags for all spectra is *much* too slow).
-        // We use a bool to keep track of that:
-        bool read_quality_flags = true;
+  const size_t orbit_spectral = obsGroup.dimLen("spectral_channel");
+  const size_t orbit_groundpixel = obsGroup.dimLen("ground_pixel");
+  const size_t orbit_scanline = obsGroup.dimLen("scanline");
 
-        for (int win=0; win!=NFeno; ++win) {
-          const FENO *pTabFeno = &TabFeno[row][win];
-          if (pTabFeno->hidden) continue;
+  if (orbit_groundpixel != size_groundpixel || orbit_spectral != size_spectral) {
+    orbit.close();
+    return false;
+  }
 
-          if(pTabFeno->useKurucz!=ANLYS_KURUCZ_SPEC
-             && pTabFeno->refSpectrumSelectionMode==ANLYS_REF_SELECTION_MODE_AUTOMATIC
-             && !(groundpixelqualityflags[scan][row] & groundpixel_quality_mask) // Skip spectra which are flagged in groundpixelqualityflags
-             && use_as_reference(lon,lat,sza,pTabFeno)) {
+  refs.rows.assign(size_groundpixel, row_refs());
+
+  // 1. read "nominal wavelength" of all rows
+  vector<float> wl(size_groundpixel*size_spectral);
+  const size_t start_wl[] = {0, 0, 0};
+  const size_t count_wl[] = {1, size_groundpixel, size_spectral};
+  instrGroup.getVar("nominal_wavelength", start_wl, count_wl, wl.data());
+  for (size_t row=0; row != size_groundpixel; ++row)
+    refs.rows[row].wavelength.assign(wl.begin() + row*size_spectral, wl.begin() + (row+1)*size_spectral);
+
+  refs.fill_wavelength = instrGroup.getFillValue<float>("nominal_wavelength");
+  refs.fill_spectrum = obsGroup.getFillValue<float>("radiance");
+  refs.fill_error = obsGroup.getFillValue<float>("radiance_noise");
+
+  // 2. read geolocation data and flags required to evaluate which
+  // spectra should be used for the reference.
+  const size_t num_obs = orbit_scanline*size_groundpixel;
+  vector<float> lons(num_obs), lats(num_obs), szas(num_obs);
+  vector<unsigned char> ground_pixel_quality(num_obs);
+  // start and  count arguments for variables with observation dimensions (i.e. scanline x row):
+  const size_t start_obs[] = {0, 0, 0};
+  const size_t count_obs[] = {1, orbit_scanline, size_groundpixel };
+
+  NetCDFGroup geo_group(orbit.getGroup(current_band + "_RADIANCE/STANDARD_MODE/GEODATA"));
+  geo_group.getVar("latitude", start_obs, count_obs, lats.data());
+  geo_group.getVar("longitude", start_obs, count_obs, lons.data());
+  geo_group.getVar("solar_zenith_angle", start_obs, count_obs, szas.data());
+  obsGroup.getVar("ground_pixel_quality", start_obs, count_obs, ground_pixel_quality.data());
+
+  const static unsigned char groundpixel_quality_mask = SOLAR_ECLIPSE | DESCENDING | NIGHT
+    | GEO_BOUNDARY_CROSSING | GEOLOCATION_ERROR; // filter everything except SUN_GLINT_POSSIBLE
+
+  // Get indices of nominal_wavelengths corresponding to analysis window limits:
+  vector<std::array<std::pair<size_t,size_t>, MAX_GROUNDPIXEL>> window_limits(NFeno);
+  for (size_t row=0; row != size_groundpixel; ++row) {
+    for (int win=0; win!=NFeno; ++win) {
+      const FENO *pTabFeno = &TabFeno[row][win];
+      if (pTabFeno->hidden || (!pEngineContext->project.instrumental.use_row[row])) continue; // skip Kurucz calibration windows
+      window_limits.at(win).at(row) = get_window_limits(pTabFeno, refs.rows[row].wavelength, row);
+    }
+  }
 
-            if (read_quality_flags) {
-              obsGroup.getVar("spectral_channel_quality", start, count, spec_quality.data() );
-              read_quality_flags = false;
-            }
+  // 3. select ground pixels on geolocation and ground pixel quality:
+  // selected[obs*NFeno+win] is 1 if ground pixel 'obs' is a candidate
+  // for analysis window 'win'.  For each scanline, keep the range of
+  // rows with candidates.
+  vector<unsigned char> selected(num_obs*NFeno, 0);
+  vector<size_t> first_row(orbit_scanline, size_groundpixel), last_row(orbit_scanline, 0);
 
-            // For spectra matching all criteria, check if wavelengths inside our analysis window are flagged:
-            auto window_start = window_limits.at(win).at(row).first;
-            auto window_end = window_limits.at(win).at(row).second;
-            // Check if all spectral channel flags inside the wavelength interval for this analysis window are zero:
-            if (std::all_of(spec_quality.begin() + window_start, spec_quality.begin() + window_end,
-                            [] (unsigned char flag) { return flag == 0; })) {
+  for (size_t scan=0; scan != orbit_scanline; ++scan) {
+    for (size_t row=0; row != size_groundpixel; ++row) {
+      if (!pEngineContext->project.instrumental.use_row[row]) continue;
 
-              if (i_spec == cache.end()) {
-                // spectrum was not yet read, so do that now:
-                vector<float> spec(size_spectral), err(size_spectral);
-                obsGroup.getVar("radiance", start, count, spec.data() );
-                obsGroup.getVar("radiance_noise", start, count, err.data() );
+      const size_t obs = scan*size_groundpixel + row;
+      if (ground_pixel_quality[obs] & groundpixel_quality_mask) continue; // Skip spectra which are flagged in groundpixelqualityflags
 
-//                 std::cout << "; scan " << scan << " row " << row << " lat " << lat << " long " << lon << " sza " << sza << std::endl;
-//                 for (auto i = spec.begin(); i != spec.end(); ++i)
-//                    std::cout << *i << ' ';
-//                 std::cout << std::endl;
+      auto lat=lats[obs];
+      auto lon=lons[obs];
+      if (lon <= 0.0)
+        lon += 360.0;
+      auto sza=szas[obs];
 
-                i_spec = cache.insert(std::move(spec)).first;
-                i_err = cache.insert(std::move(err)).first;
+      for (int win=0; win!=NFeno; ++win) {
+        const FENO *pTabFeno = &TabFeno[row][win];
+        if (pTabFeno->hidden || !pTabFeno->useRefRow) continue;
+
+        if(pTabFeno->useKurucz!=ANLYS_KURUCZ_SPEC
+           && pTabFeno->refSpectrumSelectionMode==ANLYS_REF_SELECTION_MODE_AUTOMATIC
+           && use_as_reference(lon,lat,sza,pTabFeno)) {
+          selected[obs*NFeno+win] = 1;
+          first_row[scan] = std::min(first_row[scan], row);
+          last_row[scan] = std::max(last_row[scan], row);
+        }
+      }
+    }
+  }
 
-              }
+  // 4. read radiance, error and spectral channel quality flags for the
+  // candidates, by blocks of consecutive scanlines
+  vector<unsigned char> spec_quality;
+  vector<float> rad, rad_noise;
 
-              // std::cout << "assert" << std::endl;
-              // At this point, i_spec and i_err must point to valid elements of our cache.
+  for (size_t scan=0; scan != orbit_scanline; ) {
+    if (first_row[scan] > last_row[scan]) {
+      ++scan;
+      continue;
+    }
 
+    size_t block_first = scan, block_end = scan+1;
+    size_t row_first = first_row[scan], row_last = last_row[scan];
+    while (block_end != orbit_scanline && block_end - block_first < BLOCK_SCANLINES && first_row[block_end] <= last_row[block_end]) {
+      row_first = std::min(row_first, first_row[block_end]);
+      row_last = std::max(row_last, last_row[block_end]);
+      ++block_end;
+    }
 
-              assert(i_spec != cache.end() && i_err != cache.end());
-              result[win][row].push_back(earth_ref( *(nominal_wavelengths[row]), *i_spec, *i_err,
-                                                  orbit_fill_wavelengths, orbit_fill_spectra, orbit_fill_errors));
-              found=1;
-            }
+    const size_t block_rows = row_last - row_first + 1;
+    const size_t block_size = (block_end - block_first)*block_rows*size_spectral;
+    const size_t start[] = {0, block_first, row_first, 0};
+    const size_t count[] = {1, block_end - block_first, block_rows, size_spectral };
+
+    spec_quality.resize(block_size);
+    rad.resize(block_size);
+    rad_noise.resize(block_size);
+    obsGroup.getVar("spectral_channel_quality", start, count, spec_quality.data());
+    obsGroup.getVar("radiance", start, count, rad.data());
+    obsGroup.getVar("radiance_noise", start, count, rad_noise.data());
+
+    for (size_t s=block_first; s != block_end; ++s) {
+      for (size_t row=first_row[s]; row <= last_row[s]; ++row) {
+        const size_t obs = s*size_groundpixel + row;
+        const size_t offset = ((s - block_first)*block_rows + (row - row_first))*size_spectral;
+
+        // For spectra matching all criteria, check if wavelengths inside the analysis windows are flagged:
+        bool use_spectrum = false;
+        for (int win=0; win!=NFeno; ++win) {
+          if (!selected[obs*NFeno+win]) continue;
+
+          auto window_start = window_limits.at(win).at(row).first;
+          auto window_end = window_limits.at(win).at(row).second;
+          // Check if all spectral channel flags inside the wavelength interval for this analysis window are zero:
+          if (!std::all_of(spec_quality.begin() + offset + window_start, spec_quality.begin() + offset + window_end,
+                           [] (unsigned char flag) { return flag == 0; }))
+            selected[obs*NFeno+win] = 0;
+          else
+            use_spectrum = true;
+        }
 
-          }
+        if (use_spectrum) {
+          row_refs& rr = refs.rows[row];
+          rr.spectra.insert(rr.spectra.end(), rad.begin() + offset, rad.begin() + offset + size_spectral);
+          rr.errors.insert(rr.errors.end(), rad_noise.begin() + offset, rad_noise.begin() + offset + size_spectral);
+          rr.use_window.insert(rr.use_window.end(), selected.begin() + obs*NFeno, selected.begin() + (obs+1)*NFeno);
         }
       }
     }
 
-    orbit.close();
+    scan = block_end;
   }
 
-  return result;
+  orbit.close();
+
+  return true;
 }
 
-// Interpolate reference spectra (and errors) onto a common wavelength grid and sum them.
-static void sum_refs(vector<double>& sum, vector<double>& variance, const vector<earth_ref>&  spectra, const vector<double>& wavelength_grid) {
-  // Initialize results to 0.
-  std::fill(sum.begin(), sum.end(), 0.);
-  std::fill(variance.begin(), variance.end(), 0.);
+// Interpolate the reference spectra (and errors) of one orbit and one
+// row onto the wavelength grid of each analysis window and add them
+// to the sums of this row.
+static void sum_row_refs(const orbit_refs& refs, size_t row, vector<ref_sum>& sums) {
+  const row_refs& rr = refs.rows[row];
+  const size_t n_spectra = rr.spectra.size()/size_spectral;
+  const int n_wavel = NDET[row];
 
   // We need temporary buffers to copy the reference spectra,
-  // excluding fill values, and t9o hold the interpolated spectra,
-  // before we ad them to the sum.
+  // excluding fill values, and to hold the interpolated spectra,
+  // before we add them to the sum.
   vector<double> tempspec, templambda, temperr, derivs;
-  vector<double> interpspec(wavelength_grid.size()), interperr(wavelength_grid.size());
-  for (const auto &ref : spectra) {
+  vector<double> interpspec(n_wavel), interperr(n_wavel);
+  for (size_t ispec=0; ispec != n_spectra; ++ispec) {
+    const float *spectrum = rr.spectra.data() + ispec*size_spectral;
+    const float *error = rr.errors.data() + ispec*size_spectral;
     tempspec.clear(); templambda.clear(); temperr.clear();
 
     // copy non-fillvalued data to the temporary buffers
-    for (size_t i=0; i!=ref.wavelength.size(); ++i) {
-      const auto li=ref.wavelength[i];
-      const auto si=ref.spectrum[i];
-      const auto ei=ref.error[i];
-      if (li != ref.fill_wavelength && si != ref.fill_spectrum && ei != ref.fill_error) {
+    for (size_t i=0; i!=size_spectral; ++i) {
+      const auto li=rr.wavelength[i];
+      const auto si=spectrum[i];
+      const auto ei=error[i];
+      if (li != refs.fill_wavelength && si != refs.fill_spectrum && ei != refs.fill_error) {
         templambda.push_back(li);
         tempspec.push_back(si);
         temperr.push_back(si/(std::pow(10.0, ei/10.0)));
       }
     }
 
-    // interpolate
+    // second derivatives do not depend on the analysis window
     derivs.resize(templambda.size());
     int rc = SPLINE_Deriv2(templambda.data(), tempspec.data(), derivs.data(), derivs.size(), __func__);
     if (rc) throw(std::runtime_error("Error interpolating earthshine spectrum for reference onto common wavelength grid."));
-    SPLINE_Vector(templambda.data(), tempspec.data(), derivs.data(), templambda.size(),
-                  wavelength_grid.data(), interpspec.data(), wavelength_grid.size(), SPLINE_CUBIC);
-    // linear interpolation for errors.
-    SPLINE_Vector(templambda.data(), temperr.data(), NULL, templambda.size(),
-                  wavelength_grid.data(), interperr.data(), wavelength_grid.size(), SPLINE_LINEAR);
-    for (size_t i=0; i!= sum.size(); ++i) {
-      sum[i] += interpspec[i];
-      variance[i] += interperr[i] * interperr[i];
+
+    for (int win=0; win!=NFeno; ++win) {
+      if (!rr.use_window[ispec*NFeno+win]) continue;
+
+      const double *wavelength_grid = TabFeno[row][win].LambdaRef;
+      ref_sum& rs = sums[win];
+      if (rs.sum.empty()) {
+        rs.sum.assign(n_wavel, 0.);
+        rs.variance.assign(n_wavel, 0.);
+      }
+
+      // interpolate
+      SPLINE_Vector(templambda.data(), tempspec.data(), derivs.data(), templambda.size(),
+                    wavelength_grid, interpspec.data(), n_wavel, SPLINE_CUBIC);
+      // linear interpolation for errors.
+      SPLINE_Vector(templambda.data(), temperr.data(), NULL, templambda.size(),
+                    wavelength_grid, interperr.data(), n_wavel, SPLINE_LINEAR);
+      for (int i=0; i!=n_wavel; ++i) {
+        rs.sum[i] += interpspec[i];
+        rs.variance[i] += interperr[i] * interperr[i];
+      }
+      ++rs.count;
     }
   }
 }
 
+// Add the reference spectra of one orbit to the sums of all rows.
+//
+// The rows are shared out between n_threads threads; the sums of a
+// row are only updated by the thread that took the row, so that no
+// locking is needed, and the spectra of a row are always added in the
+// order of the scanlines (the result does not depend on n_threads).
+static void sum_orbit_refs(const orbit_refs& refs, vector<vector<ref_sum>>& sums, int n_threads) {
+  if (n_threads <= 1) {
+    for (size_t row=0; row != size_groundpixel; ++row)
+      if (!refs.rows[row].spectra.empty())
+        sum_row_refs(refs, row, sums[row]);
+    return;
+  }
+
+  std::atomic<size_t> next_row(0);
+  auto task = [&refs, &sums, &next_row] () {
+    for (size_t row=next_row++; row < size_groundpixel; row=next_row++)
+      if (!refs.rows[row].spectra.empty())
+        sum_row_refs(refs, row, sums[row]);
+  };
+
+  vector<std::future<void>> tasks;
+  for (int i=0; i!=n_threads; ++i)
+    tasks.push_back(std::async(std::launch::async, task));
+
+  for (auto& t : tasks)
+    t.wait();
+  for (auto& t : tasks)
+    t.get(); // rethrow errors
+}
+
 int tropomi_prepare_automatic_reference(ENGINE_CONTEXT *pEngineContext, void *responseHandle) {
 
   // A radiance reference for Tropomi is created, either
@@ -922,39 +1054,59 @@ int tropomi_prepare_automatic_reference(ENGINE_CONTEXT *pEngineContext, void *re
   }
 
   // If we reach this point, we must create a new reference spectrum
+  wait_prefetch();
+
   try {
-    set<vector<float>> cache;
-    auto earth_spectra = find_matching_spectra(pEngineContext,get_reference_orbits(pEngineContext->project.instrumental.use_row,
-                                                                                   pEngineContext->fileInfo.fileName,
-                                                                                   pEngineContext->project.instrumental.tropomi.spectralBand,
-                                                                                   pEngineContext->project.instrumental.tropomi.reference_orbit_dir), cache);
+    get_reference_orbits(pEngineContext->project.instrumental.use_row,
+                         pEngineContext->fileInfo.fileName,
+                         pEngineContext->project.instrumental.tropomi.spectralBand,
+                         pEngineContext->project.instrumental.tropomi.reference_orbit_dir);
+
+    assert(size_groundpixel <= MAX_GROUNDPIXEL);
+
+    // Sums of the reference spectra, per row and analysis window.
+    //
+    // The orbit files are read one at a time (the netCDF library is
+    // not thread safe); with more than one thread, the spectra of the
+    // previous orbit are summed while the next one is being read.
+    vector<vector<ref_sum>> sums(size_groundpixel, vector<ref_sum>(NFeno));
+    orbit_refs refs[2];
+    std::future<void> summing;
+    int current=0;
+
+    for (const string & fname : reference_orbit_files) {
+      if (!read_orbit_refs(pEngineContext, fname, refs[current])) continue;
+
+      if (summing.valid())
+        summing.get();
+
+      if (reference_threads > 1) {
+        const orbit_refs& orbit = refs[current];
+        summing = std::async(std::launch::async, [&orbit, &sums] () { sum_orbit_refs(orbit, sums, reference_threads); });
+        current = 1 - current;
+      } else {
+        sum_orbit_refs(refs[current], sums, 1);
+      }
+    }
+    if (summing.valid())
+      summing.get();
 
-    vector<double> wavelength_grid, sum, variance;
     for (size_t row = 0; row!=size_groundpixel; ++row) {
       const int n_wavel=NDET[row];
-      wavelength_grid.resize(n_wavel);
-      sum.resize(wavelength_grid.size());
-      variance.resize(wavelength_grid.size());
 
       for(int window=0; window < NFeno; ++window) {
         FENO *pTabFeno = &TabFeno[row][window];
         if (!pTabFeno->useRefRow) continue;
         if (pTabFeno->hidden || !pTabFeno->refSpectrumSelectionMode == ANLYS_REF_SELECTION_MODE_AUTOMATIC) continue;
-        const vector<earth_ref>& refs = earth_spectra[window][row];
-//        if (!(rc=tropomi_get_reference(pTabFeno->ref2,row,pTabFeno->LambdaRef,pTabFeno->Sref,pTabFeno->SrefSigma,&n_wavel,0))){
-           if (refs.size()) {
-             for (size_t i=0; i!=wavelength_grid.size(); ++i) {
-               wavelength_grid[i] = pTabFeno->LambdaRef[i];
-             }
-             sum_refs(sum, variance, refs, wavelength_grid);
-             for (size_t i=0; i!=sum.size(); ++i) {
-               pTabFeno->Sref[i]=sum[i]/refs.size();
-               pTabFeno->SrefSigma[i]=std::sqrt(variance[i])/refs.size();
-             }
-
-             VECTOR_NormalizeVector(pTabFeno->Sref-1,n_wavel,&pTabFeno->refNormFact, __func__);
-           }
-//        }
+        const ref_sum& rs = sums[row][window];
+        if (rs.count) {
+          for (int i=0; i!=n_wavel; ++i) {
+            pTabFeno->Sref[i]=rs.sum[i]/rs.count;
+            pTabFeno->SrefSigma[i]=std::sqrt(rs.variance[i])/rs.count;
+          }
+
+          VECTOR_NormalizeVector(pTabFeno->Sref-1,n_wavel,&pTabFeno->refNormFact, __func__);
+        }
       }
     }
 
@@ -975,12 +1127,12 @@ int tropomi_prepare_automatic_reference(ENGINE_CONTEXT *pEngineContext, void *re
         if (firstRow==ITEM_NONE)
          firstRow=row;
 
-        const vector<earth_ref>& refs = earth_spectra[window][row];
+        const size_t n_refs = sums[row][window].count;
         std::stringstream desc;
-        desc << refs.size() << " radiances used";
+        desc << n_refs << " radiances used";
         free(pTabFeno->ref_description);
         pTabFeno->ref_description = strdup(desc.str().c_str());
-        if (!refs.size())
+        if (!n_refs)
           failed_rows.push_back(row);
       }
       if (!failed_rows.empty() && (firstRow!=ITEM_NONE)) {
@@ -1014,6 +1166,8 @@ int tropomi_get_reference(const char *filename, int pixel, double *lambda, doubl
   auto& radiance_reference = reference_radiance[filename];
   auto& wavelength_reference = reference_wavelength[filename];
 
+  wait_prefetch();
+
   try {
     if (radAsRef){
        NetCDFFile refFile(filename);
@@ -1052,6 +1206,7 @@ int tropomi_get_reference(const char *filename, int pixel, double *lambda, doubl
 int tropomi_get_orbit_date(int *orbit_year, int *orbit_month, int *orbit_day) {
   if (current_filename!="")
    {
+    wait_prefetch();
     std::istringstream orbit_start(current_file.getAttText("time_coverage_start"));
     // time_coverage_start is formatted as "YYYY-MM-DD"
     char tmp; // to skip "-" chars
@@ -1062,7 +1217,18 @@ int tropomi_get_orbit_date(int *orbit_year, int *orbit_month, int *orbit_day) {
    return(0);
 }
 
+void tropomi_wait_prefetch(void) {
+  wait_prefetch();
+}
+
+void tropomi_set_reference_threads(int threads) {
+  reference_threads = (threads > 1) ? threads : 1;
+}
+
 void tropomi_cleanup(void) {
+  reset_blocks();
+  current_obs_group = NetCDFGroup();
+
   current_file.close();
   current_filename="";
 
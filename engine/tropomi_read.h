@@ -45,6 +45,13 @@ extern "C" {
 
   int tropomi_get_orbit_date(int *orbit_year, int *orbit_month, int *orbit_day);
 
+  // wait until the radiances read in the background are available: to call
+  // before using the netCDF library for something else (e.g. writing output)
+  void tropomi_wait_prefetch(void);
+
+  // number of threads used to build the automatic earthshine reference
+  void tropomi_set_reference_threads(int threads);
+
   void tropomi_cleanup(void);
 
 #ifdef __cplusplus
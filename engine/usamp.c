@@ -245,7 +245,7 @@ RC USAMP_Build(double *phase1,
 
     if (!(rc=XSCONV_LoadSlitFunction(slitMatrix,pSlit,&slitParam[0],&slitType)) &&
 //        !(rc=XSCONV_TypeStandardFFT(&usampFFT,slitType,pSlit->slitParam,pSlit->slitParam2,kuruczLambda,kuruczConvolved,nKurucz)) &&
-        !(rc=XSCONV_TypeStandard(&xsnew,0,nKurucz,pKuruczMatrix,pKuruczMatrix,NULL,slitType,slitMatrix,slitParam,pSlit->slitWveDptFlag)) &&
+        !(rc=XSCONV_TypeStandard(&xsnew,0,nKurucz,pKuruczMatrix,pKuruczMatrix,NULL,slitType,slitMatrix,slitParam,pSlit->slitWveDptFlag,NULL)) &&
         !(rc=SPLINE_Deriv2(kuruczLambda,xsnew.matrix[1],xsnew.deriv2[1],nKurucz,"USAMP_Build (kuruczConvolved) ")) &&
         !(rc=SPLINE_Vector(kuruczLambda,xsnew.matrix[1],xsnew.deriv2[1],nKurucz,gomeLambda,resample,nGome,SPLINE_CUBIC)) && // calculate solar spectrum at GOME positions
         !(rc=SPLINE_Deriv2(gomeLambda,resample,d2res,nGome,"USAMP_Build (resample 1) ")))
@@ -0,0 +1,345 @@
+
+//  ----------------------------------------------------------------------------
+//
+//  Product/Project   :  QDOAS
+//  Module purpose    :  ON-DISK CACHE OF CONVOLVED CROSS SECTIONS
+//  Name of module    :  XSCACHE.C
+//  Compiler          :  MinGW (GNU compiler)
+//
+//  QDOAS is a cross-platform application developed in QT for DOAS retrieval
+//  (Differential Optical Absorption Spectroscopy).
+//
+//  The QT version of the program has been developed jointly by the Belgian
+//  Institute for Space Aeronomy (BIRA-IASB) and the Science and Technology
+//  company (S[&]T) - Copyright (C) 2007
+//
+//      BIRA-IASB                                   S[&]T
+//      Belgian Institute for Space Aeronomy        Science [&] Technology
+//      Avenue Circulaire, 3                        Postbus 608
+//      1180     UCCLE                              2600 AP Delft
+//      BELGIUM                                     THE NETHERLANDS
+//      caroline.fayt@aeronomie.be                  info@stcorp.nl
+//
+//  This program is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU General Public License
+//  as published by the Free Software Foundation; either version 2
+//  of the License, or (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software Foundation,
+//  Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+//
+//  ----------------------------------------------------------------------------
+//  FUNCTIONS
+//
+//  XSCACHE_SetDirectory - select the directory of the cache (empty to disable it);
+//  XSCACHE_Enabled - check if the cache is used;
+//
+//  XSCACHE_KeyInit - start a new key;
+//  XSCACHE_KeyAdd - add a buffer to a key;
+//  XSCACHE_KeyAddMatrix - add the content of a matrix to a key;
+//
+//  XSCACHE_EntryName - build the name of the file of an entry;
+//  XSCACHE_WriteEntry - write the file of an entry (header and data);
+//  XSCACHE_Load - load a vector from the cache;
+//  XSCACHE_Save - save a vector in the cache.
+//
+//  ----------------------------------------------------------------------------
+//
+//  Each entry of the cache is a binary file named after the 64 bits key :
+//
+//      - a header (magic string, version, size of the vector, key);
+//      - the vector itself (doubles in the native byte order).
+//
+//  Files are written under a temporary name and then renamed so that processes
+//  sharing the same cache directory (doas_cl -p) never read a partial entry.
+//  A missing or inconsistent entry is simply recalculated by the caller.
+//  ----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+#include "xscache.h"
+#include "matrix.h"
+
+// =====================
+// CONSTANTS DEFINITIONS
+// =====================
+
+#define XSCACHE_MAGIC    "QDXSCACH"                                             // first bytes of a cache file
+#define XSCACHE_VERSION  1                                                      // to increase when the convolution results change
+
+#define XSCACHE_FNV_BASIS ((uint64_t)14695981039346656037ULL)
+#define XSCACHE_FNV_PRIME ((uint64_t)1099511628211ULL)
+
+
+// ===================
+// STRUCTURES AND DATA
+// ===================
+
+typedef struct _xscacheHeader
+ {
+  char     magic[8];
+  uint32_t version;
+  int32_t  n;                                                                   // number of doubles in the file
+  uint64_t hash;                                                                // key of the entry
+ }
+XSCACHE_HEADER;
+
+static char xscacheDirectory[DOAS_MAX_PATH_LEN+1]="";                           // empty if the cache is not used
+static __thread char xscacheThreadId;                                           // its address identifies the calling thread in temporary file names
+
+// ===============
+// CACHE DIRECTORY
+// ===============
+
+// -----------------------------------------------------------------------------
+// FUNCTION      XSCACHE_SetDirectory
+// -----------------------------------------------------------------------------
+// PURPOSE       Select the directory of the cache
+//
+// INPUT         directory : an existing directory, NULL or empty to disable the cache
+//
+// REMARK        should be called before the analysis starts (not thread-safe)
+// -----------------------------------------------------------------------------
+
+void XSCACHE_SetDirectory(const char *directory)
+ {
+  size_t len;
+
+  xscacheDirectory[0]='\0';
+
+  if ((directory!=NULL) && ((len=strlen(directory))>0) && (len<=DOAS_MAX_PATH_LEN))
+   {
+    strcpy(xscacheDirectory,directory);
+
+    if ((xscacheDirectory[len-1]=='/') || (xscacheDirectory[len-1]=='\\'))
+     xscacheDirectory[len-1]='\0';
+   }
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      XSCACHE_Enabled
+// -----------------------------------------------------------------------------
+// RETURN        1 if a cache directory has been selected, 0 otherwise
+// -----------------------------------------------------------------------------
+
+int XSCACHE_Enabled(void)
+ {
+  return (xscacheDirectory[0]!='\0')?1:0;
+ }
+
+// ====
+// KEYS
+// ====
+
+// -----------------------------------------------------------------------------
+// FUNCTION      XSCACHE_KeyInit
+// -----------------------------------------------------------------------------
+// PURPOSE       Start a new key
+//
+// INPUT         tag : identifies the kind of vector (distinguishes the callers)
+// -----------------------------------------------------------------------------
+
+void XSCACHE_KeyInit(XSCACHE_KEY *pKey,const char *tag)
+ {
+  const uint32_t version=XSCACHE_VERSION;
+
+  pKey->hash=XSCACHE_FNV_BASIS;
+
+  XSCACHE_KeyAdd(pKey,&version,sizeof(version));
+  XSCACHE_KeyAdd(pKey,tag,strlen(tag)+1);
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      XSCACHE_KeyAdd
+// -----------------------------------------------------------------------------
+// PURPOSE       Add the content of a buffer to a key
+// -----------------------------------------------------------------------------
+
+void XSCACHE_KeyAdd(XSCACHE_KEY *pKey,const void *data,size_t size)
+ {
+  const unsigned char *p=(const unsigned char *)data;
+  uint64_t hash=pKey->hash;
+  size_t i;
+
+  for (i=0;i<size;i++)
+   hash=(hash^p[i])*XSCACHE_FNV_PRIME;
+
+  pKey->hash=hash;
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      XSCACHE_KeyAddMatrix
+// -----------------------------------------------------------------------------
+// PURPOSE       Add the dimensions and the columns of a matrix to a key
+//               (second derivatives are calculated from the columns)
+// -----------------------------------------------------------------------------
+
+void XSCACHE_KeyAddMatrix(XSCACHE_KEY *pKey,const MATRIX_OBJECT *pMatrix)
+ {
+  int dim[2]={0,0};
+  INDEX j;
+
+  if ((pMatrix!=NULL) && (pMatrix->matrix!=NULL))
+   {
+    dim[0]=pMatrix->nl;
+    dim[1]=pMatrix->nc;
+   }
+
+  XSCACHE_KeyAdd(pKey,dim,sizeof(dim));
+
+  for (j=0;j<dim[1];j++)
+   XSCACHE_KeyAdd(pKey,&pMatrix->matrix[pMatrix->basec+j][pMatrix->basel],sizeof(double)*dim[0]);
+ }
+
+// =======
+// ENTRIES
+// =======
+
+// -----------------------------------------------------------------------------
+// FUNCTION      XSCACHE_EntryName
+// -----------------------------------------------------------------------------
+// PURPOSE       Build the name of the file of an entry in the cache directory
+//
+// INPUT         pKey      : the key of the entry
+//               extension : distinguishes the kind of entries ("xsc" for vectors)
+//
+// OUTPUT        fileName  : the name of the file (XSCACHE_NAME_LEN characters)
+// -----------------------------------------------------------------------------
+
+void XSCACHE_EntryName(const XSCACHE_KEY *pKey,const char *extension,char *fileName)
+ {
+  snprintf(fileName,XSCACHE_NAME_LEN,"%s%c%016llx.%s",xscacheDirectory,PATH_SEP,(unsigned long long)pKey->hash,extension);
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      XSCACHE_WriteEntry
+// -----------------------------------------------------------------------------
+// PURPOSE       Write the file of an entry in the cache directory
+//
+// INPUT         fileName   : the name of the entry (see XSCACHE_EntryName)
+//               header     : the header of the entry
+//               headerSize : the size in bytes of the header
+//               data       : the data that follow the header
+//               dataSize   : the size in bytes of the data
+//
+// RETURN        1 if the entry has been written, 0 otherwise
+//
+// REMARK        the file is written under a temporary name (process and thread)
+//               and then renamed, so that readers never see a partial entry
+// -----------------------------------------------------------------------------
+
+int XSCACHE_WriteEntry(const char *fileName,const void *header,size_t headerSize,const void *data,size_t dataSize)
+ {
+  char tmpFileName[XSCACHE_NAME_LEN+32];
+  FILE *fp;
+  int ok;
+
+  ok=0;
+  snprintf(tmpFileName,sizeof(tmpFileName),"%s.%d.%llx",fileName,(int)getpid(),(unsigned long long)(uintptr_t)&xscacheThreadId);
+
+  if ((fp=fopen(tmpFileName,"wb"))!=NULL)
+   {
+    ok=((fwrite(header,headerSize,1,fp)==1) &&
+        (!dataSize || (fwrite(data,dataSize,1,fp)==1)))?1:0;
+
+    if (fclose(fp))
+     ok=0;
+
+    // rename fails on Windows if another process has just created the entry
+
+    if (!ok || rename(tmpFileName,fileName))
+     {
+      remove(tmpFileName);
+      ok=0;
+     }
+   }
+
+  return ok;
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      XSCACHE_Load
+// -----------------------------------------------------------------------------
+// PURPOSE       Load a vector from the cache
+//
+// INPUT         pKey   : the key of the entry
+//               n      : the expected size of the vector
+//
+// OUTPUT        vector : the vector read from the cache
+//
+// RETURN        1 if the entry has been found, 0 otherwise (vector is then undefined)
+// -----------------------------------------------------------------------------
+
+int XSCACHE_Load(const XSCACHE_KEY *pKey,double *vector,int n)
+ {
+  char fileName[XSCACHE_NAME_LEN];
+  XSCACHE_HEADER header;
+  FILE *fp;
+  int found;
+
+  found=0;
+
+  if (XSCACHE_Enabled() && (n>0))
+   {
+    XSCACHE_EntryName(pKey,"xsc",fileName);
+
+    if ((fp=fopen(fileName,"rb"))!=NULL)
+     {
+      found=((fread(&header,sizeof(XSCACHE_HEADER),1,fp)==1) &&
+             !memcmp(header.magic,XSCACHE_MAGIC,sizeof(header.magic)) &&
+             (header.version==XSCACHE_VERSION) &&
+             (header.n==n) &&
+             (header.hash==pKey->hash) &&
+             (fread(vector,sizeof(double),n,fp)==(size_t)n))?1:0;
+
+      fclose(fp);
+     }
+   }
+
+  return found;
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      XSCACHE_Save
+// -----------------------------------------------------------------------------
+// PURPOSE       Save a vector in the cache
+//
+// INPUT         pKey   : the key of the entry
+//               vector : the vector to save
+//               n      : the size of the vector
+//
+// REMARK        errors are ignored; the vector will be calculated again next time
+// -----------------------------------------------------------------------------
+
+void XSCACHE_Save(const XSCACHE_KEY *pKey,const double *vector,int n)
+ {
+  char fileName[XSCACHE_NAME_LEN];
+  XSCACHE_HEADER header;
+
+  if (XSCACHE_Enabled() && (n>0))
+   {
+    XSCACHE_EntryName(pKey,"xsc",fileName);
+
+    memset(&header,0,sizeof(XSCACHE_HEADER));
+    memcpy(header.magic,XSCACHE_MAGIC,sizeof(header.magic));
+    header.version=XSCACHE_VERSION;
+    header.n=n;
+    header.hash=pKey->hash;
+
+    XSCACHE_WriteEntry(fileName,&header,sizeof(XSCACHE_HEADER),vector,sizeof(double)*n);
+   }
+ }
@@ -0,0 +1,43 @@
+#ifndef XSCACHE_H
+#define XSCACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "comdefs.h"
+#include "doas.h"
+
+#if defined(_cplusplus) || defined(__cplusplus)
+extern "C" {
+#endif
+
+// On-disk cache of convolved vectors.  An entry is a file of the cache directory
+// whose name is the hash of everything the vector depends on (input cross
+// section, slit function, target wavelength grid, convolution type,...).
+
+#define XSCACHE_NAME_LEN  (DOAS_MAX_PATH_LEN+128)                               // directory, key and suffix of temporary files
+
+typedef struct _xscacheKey
+ {
+  uint64_t hash;                                                                // FNV-1a hash of the data added to the key
+ }
+XSCACHE_KEY;
+
+void XSCACHE_SetDirectory(const char *directory);
+int  XSCACHE_Enabled(void);
+
+void XSCACHE_KeyInit(XSCACHE_KEY *pKey,const char *tag);
+void XSCACHE_KeyAdd(XSCACHE_KEY *pKey,const void *data,size_t size);
+void XSCACHE_KeyAddMatrix(XSCACHE_KEY *pKey,const MATRIX_OBJECT *pMatrix);
+
+void XSCACHE_EntryName(const XSCACHE_KEY *pKey,const char *extension,char *fileName);
+int  XSCACHE_WriteEntry(const char *fileName,const void *header,size_t headerSize,const void *data,size_t dataSize);
+
+int  XSCACHE_Load(const XSCACHE_KEY *pKey,double *vector,int n);
+void XSCACHE_Save(const XSCACHE_KEY *pKey,const double *vector,int n);
+
+#if defined(_cplusplus) || defined(__cplusplus)
+}
+#endif
+
+#endif
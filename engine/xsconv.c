@@ -68,7 +68,8 @@
 //
 //  XSCONV_TypeNone - apply no convolution, interpolation only;
 //  XSCONV_TypeGauss - gaussian convolution with variable half way up width;
-//  XSCONV_TypeStandard - standard convolution of cross section with a slit function;
+//  XSCONV_TypeStandard - standard convolution of cross section with a slit function (direct method or FFT by blocks);
+//  XSCONV_SlitBankFree - release the slit function calculated at each wavelength of a final grid;
 //  XSCONV_RealTimeXs - real time cross sections convolution;
 //
 //  XsconvTypeI0Correction - convolution of cross sections with I0 correction;
@@ -149,6 +150,7 @@
 #include "filter.h"
 #include "erf.h"
 #include "vector.h"
+#include "timing.h"
 
 // =====================
 // CONSTANTS DEFINITIONS
@@ -1065,13 +1067,252 @@ RC GetNewF(double *pNewF,
   return rc;
  }
 
-// --------------------------------------------------------------------------------
-// XSCONV_TypeStandard : Standard convolution of cross section with a slit function
-// --------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+// SLIT FUNCTION BANK
+// -----------------------------------------------------------------------------
+//
+// Wavelength dependent slit functions (parameters interpolated at the final
+// wavelength, stretched slit files) and multi-column slit files have to be
+// rebuilt at each wavelength of the final grid.  The bank keeps them for one
+// slit function and one final grid, so that the next convolutions with the same
+// slit on the same grid (other cross sections, next records) reuse them.  The
+// slit function is calculated at a final wavelength the first time it is needed.
+
+// XSCONV_SlitBankFree : release the buffers of a slit function bank
+
+void XSCONV_SlitBankFree(SLIT_BANK *pSlitBank)
+ {
+  if (pSlitBank->slitDef!=NULL)
+   MEMORY_ReleaseDVector("XSCONV_SlitBankFree ","slitDef",pSlitBank->slitDef,0);
+  if (pSlitBank->lambda!=NULL)
+   MEMORY_ReleaseDVector("XSCONV_SlitBankFree ","lambda",pSlitBank->lambda,0);
+  if (pSlitBank->done!=NULL)
+   MEMORY_ReleaseBuffer("XSCONV_SlitBankFree ","done",pSlitBank->done);
+  if (pSlitBank->param!=NULL)
+   MEMORY_ReleaseDVector("XSCONV_SlitBankFree ","param",pSlitBank->param,0);
+  if (pSlitBank->slitLambda!=NULL)
+   MEMORY_ReleaseDVector("XSCONV_SlitBankFree ","slitLambda",pSlitBank->slitLambda,0);
+  if (pSlitBank->slitVector!=NULL)
+   MEMORY_ReleaseDVector("XSCONV_SlitBankFree ","slitVector",pSlitBank->slitVector,0);
+  if (pSlitBank->slitDeriv2!=NULL)
+   MEMORY_ReleaseDVector("XSCONV_SlitBankFree ","slitDeriv2",pSlitBank->slitDeriv2,0);
+
+  memset(pSlitBank,0,sizeof(SLIT_BANK));
+ }
+
+// XsconvSlitDef : compare the slit function matrices with the copy in the bank (copy is 0) or copy them (copy is 1)
+
+static int XsconvSlitDef(SLIT_BANK *pSlitBank,const MATRIX_OBJECT *slitMatrix,int copy)
+ {
+  double *slitDef;
+  INDEX i,j,n;
+
+  for (i=n=0,slitDef=pSlitBank->slitDef;i<NSFP;i++)
+   {
+    if (copy)
+     {
+      slitDef[n]=(double)slitMatrix[i].nl;
+      slitDef[n+1]=(double)slitMatrix[i].nc;
+     }
+    else if ((slitDef[n]!=(double)slitMatrix[i].nl) || (slitDef[n+1]!=(double)slitMatrix[i].nc))
+     return 0;
+
+    n+=2;
+
+    for (j=0;(slitMatrix[i].nl>0) && (j<slitMatrix[i].nc);j++,n+=slitMatrix[i].nl)
+     {
+      if (copy)
+       memcpy(slitDef+n,slitMatrix[i].matrix[j],sizeof(double)*slitMatrix[i].nl);
+      else if (memcmp(slitDef+n,slitMatrix[i].matrix[j],sizeof(double)*slitMatrix[i].nl))
+       return 0;
+     }
+   }
+
+  return 1;
+ }
+
+// XsconvSlitBankInit : prepare the bank for a slit function and a final grid (nothing to do if the bank was built for them)
+
+static RC XsconvSlitBankInit(SLIT_BANK *pSlitBank,const MATRIX_OBJECT *pXsnew,int slitType,const MATRIX_OBJECT *slitMatrix,const double *slitParam,int wveDptFlag)
+ {
+  INDEX i;
+  int slitDefSize,slitNDET,n;
+  RC rc;
+
+  for (i=0,slitDefSize=0;i<NSFP;i++)
+   slitDefSize+=2+((slitMatrix[i].nl>0)?slitMatrix[i].nl*slitMatrix[i].nc:0);
+
+  slitNDET=(slitType!=SLIT_TYPE_FILE)?0:((slitMatrix[0].nc>2)?slitMatrix[0].nl-1:slitMatrix[0].nl);
+  n=pXsnew->nl;
+  rc=ERROR_ID_NO;
+
+  if ((pSlitBank->lambda==NULL) || (pSlitBank->slitType!=slitType) || (pSlitBank->wveDptFlag!=wveDptFlag) ||
+      (pSlitBank->nl!=n) || memcmp(pSlitBank->lambda,pXsnew->matrix[0],sizeof(double)*n) ||
+      memcmp(pSlitBank->slitParam,slitParam,sizeof(double)*NSFP) ||
+      (pSlitBank->slitDefSize!=slitDefSize) || !XsconvSlitDef(pSlitBank,slitMatrix,0))
+   {
+    XSCONV_SlitBankFree(pSlitBank);
+
+    if (((pSlitBank->slitDef=(double *)MEMORY_AllocDVector("XsconvSlitBankInit ","slitDef",0,slitDefSize-1))==NULL) ||
+        ((pSlitBank->lambda=(double *)MEMORY_AllocDVector("XsconvSlitBankInit ","lambda",0,n-1))==NULL) ||
+        ((pSlitBank->done=(int *)MEMORY_AllocBuffer("XsconvSlitBankInit ","done",n,sizeof(int),0,MEMORY_TYPE_INT))==NULL) ||
+        ((pSlitBank->param=(double *)MEMORY_AllocDVector("XsconvSlitBankInit ","param",0,n*NSFP-1))==NULL) ||
+        (slitNDET && (((pSlitBank->slitLambda=(double *)MEMORY_AllocDVector("XsconvSlitBankInit ","slitLambda",0,n*slitNDET-1))==NULL) ||
+                      ((pSlitBank->slitVector=(double *)MEMORY_AllocDVector("XsconvSlitBankInit ","slitVector",0,n*slitNDET-1))==NULL) ||
+                      ((pSlitBank->slitDeriv2=(double *)MEMORY_AllocDVector("XsconvSlitBankInit ","slitDeriv2",0,n*slitNDET-1))==NULL))))
+     {
+      XSCONV_SlitBankFree(pSlitBank);
+      rc=ERROR_ID_ALLOC;
+     }
+    else
+     {
+      pSlitBank->slitType=slitType;
+      pSlitBank->wveDptFlag=wveDptFlag;
+      pSlitBank->slitDefSize=slitDefSize;
+      pSlitBank->nl=n;
+      pSlitBank->slitNDET=slitNDET;
+
+      memcpy(pSlitBank->slitParam,slitParam,sizeof(double)*NSFP);
+      memcpy(pSlitBank->lambda,pXsnew->matrix[0],sizeof(double)*n);
+      memset(pSlitBank->done,0,sizeof(int)*n);
+
+      XsconvSlitDef(pSlitBank,slitMatrix,1);
+     }
+   }
+
+  return rc;
+ }
+
+// XsconvSlitBankGet : calculate the slit function at a wavelength of the final grid if not done yet
+
+static RC XsconvSlitBankGet(SLIT_BANK *pSlitBank,const MATRIX_OBJECT *slitMatrix,INDEX indexLambda)
+ {
+  // Declarations
+
+  const double *lambda_orig,*slit_col1;
+  double *param,*slitLambda,*slitVector,*slitDeriv2,
+          lambda,slitStretch1,slitStretch2,fwhm,lambda_center,slit_max,delta_lambda;
+  int slitNDET;
+  INDEX i;
+  RC rc;
+
+  if (pSlitBank->done[indexLambda])
+   return ERROR_ID_NO;
+
+  // Initializations
+
+  lambda=pSlitBank->lambda[indexLambda];
+  param=pSlitBank->param+indexLambda*NSFP;
+  slitNDET=pSlitBank->slitNDET;
+  rc=ERROR_ID_NO;
+
+  memcpy(param,pSlitBank->slitParam,sizeof(double)*NSFP);
+
+  if (pSlitBank->slitType==SLIT_TYPE_FILE)
+   {
+    slitLambda=pSlitBank->slitLambda+indexLambda*slitNDET;
+    slitVector=pSlitBank->slitVector+indexLambda*slitNDET;
+    slitDeriv2=pSlitBank->slitDeriv2+indexLambda*slitNDET;
+
+    lambda_orig=slitMatrix[0].matrix[0];
+    slit_col1=slitMatrix[0].matrix[1];
+
+    // Multicolumns files : interpolate the slit function at the final wavelength
+
+    if (slitMatrix[0].nc>2)
+     {
+      // the matrix[0:ncols][0] contains the central wavelengths -> shift lambda_orig and slit_col1 by one position
+
+      lambda_orig+=1;
+      slit_col1+=1;
+
+      memcpy(slitLambda,lambda_orig,sizeof(double)*slitNDET);
+
+      for (i=0;i<slitNDET;i++)
+       slitVector[i]=(double)VECTOR_Table2((double **)slitMatrix[0].matrix,slitMatrix[0].nl,slitMatrix[0].nc,slitMatrix[0].matrix[0][i+1],lambda);
+
+      if (!(rc=SPLINE_Deriv2(slitLambda,slitVector,slitDeriv2,slitNDET,"XsconvSlitBankGet")))
+       rc=XSCONV_GetFwhm(slitLambda,slitVector,slitDeriv2,slitNDET,SLIT_TYPE_FILE,&fwhm);
+     }
+    else
+     {
+      memcpy(slitLambda,slitMatrix[0].matrix[0],sizeof(double)*slitNDET);
+      memcpy(slitVector,slitMatrix[0].matrix[1],sizeof(double)*slitNDET);
+      memcpy(slitDeriv2,slitMatrix[0].deriv2[1],sizeof(double)*slitNDET);
+     }
+
+    if (!rc && pSlitBank->wveDptFlag)
+     {
+      param[2]=(double)0.;
+      slitStretch1=slitStretch2=(double)1.;
+
+      if (slitMatrix[1].nl>0)
+       {
+        SPLINE_Vector(slitMatrix[1].matrix[0],slitMatrix[1].matrix[1],slitMatrix[1].deriv2[1],slitMatrix[1].nl,&lambda,&slitStretch1,1,SPLINE_CUBIC);
+
+        if (slitMatrix[1].nc>2)
+         SPLINE_Vector(slitMatrix[1].matrix[0],slitMatrix[1].matrix[2],slitMatrix[1].deriv2[2],slitMatrix[1].nl,&lambda,&slitStretch2,1,SPLINE_CUBIC);
+        else
+         slitStretch2=slitStretch1;
+       }
+
+      // Apply slitStretch1 or slitStretch2 depending on whether we
+      // are in the "left" or "right" wing of the slit function.  We
+      // do this by recalculating the wavelength grid around the center
+      // wavelength, defined as the wavelength corresponding to the maximum
+      // value of slit_col1 (to match what is done during calibration in
+      // KuruczConvolveSolarSpectrum)
+
+      for (i=0,lambda_center=slit_max=(double)0.;i<slitNDET;i++)
+       if (slit_col1[i]>slit_max)
+        {
+         slit_max=slit_col1[i];
+         lambda_center=lambda_orig[i];
+        }
+
+      for (i=0;i<slitNDET;i++)
+       {
+        delta_lambda=lambda_orig[i]-lambda_center;
+        delta_lambda*=(delta_lambda<(double)0.)?slitStretch1:slitStretch2;
+        slitLambda[i]=lambda_center+delta_lambda;
+       }
+
+      // Recalculate second derivatives and the FWHM
+
+      if (!(rc=SPLINE_Deriv2(slitLambda,slitVector,slitDeriv2,slitNDET,"XsconvSlitBankGet ")))
+       rc=XSCONV_GetFwhm(slitLambda,slitVector,slitDeriv2,slitNDET,SLIT_TYPE_FILE,&param[0]);
+     }
+   }
+
+  // Wavelength dependent parameters of a slit function
+
+  else
+   {
+    if ((pSlitBank->slitType==SLIT_TYPE_SUPERGAUSS) && (slitMatrix[2].nl>0))
+     SPLINE_Vector(slitMatrix[2].matrix[0],slitMatrix[2].matrix[1],slitMatrix[2].deriv2[1],slitMatrix[2].nl,&lambda,&param[2],1,SPLINE_CUBIC);
+    else
+     param[2]=(double)0.;
+
+    if (slitMatrix[1].nl>0)
+     SPLINE_Vector(slitMatrix[1].matrix[0],slitMatrix[1].matrix[1],slitMatrix[1].deriv2[1],slitMatrix[1].nl,&lambda,&param[1],1,SPLINE_CUBIC);
+    if (slitMatrix[0].nl>0)
+     SPLINE_Vector(slitMatrix[0].matrix[0],slitMatrix[0].matrix[1],slitMatrix[0].deriv2[1],slitMatrix[0].nl,&lambda,&param[0],1,SPLINE_CUBIC);
+   }
+
+  pSlitBank->done[indexLambda]=(rc==ERROR_ID_NO)?1:0;
+
+  // Return
+
+  return rc;
+ }
+
+// ----------------------------------------------------------------------------------------------------
+// XsconvTypeStandardDirect : Standard convolution of cross section with a slit function (direct method)
+// ----------------------------------------------------------------------------------------------------
 
 //
-// RC XSCONV_TypeStandard(XS *pXsnew,XS *pXshr,XS *pSlit,XS *pI,double *Ic,
-//                        int slitType,double slitWidth,double slitParam)
+// RC XsconvTypeStandardDirect(XS *pXsnew,XS *pXshr,XS *pSlit,XS *pI,double *Ic,
+//                             int slitType,double slitWidth,double slitParam)
 //
 // with :
 //
@@ -1083,6 +1324,7 @@ RC GetNewF(double *pNewF,
 //
 //  - pSlit : if wveDptFlag=1 : wavelength dependent slit function parameters (wavelength scale, slit vector and second derivatives);
 //  - slitParam : if wveDptFlag=0 : slit function parameters (constants)
+//  - pBank : slit function at each final wavelength for wavelength dependent slit functions and multi-column slit files (NULL otherwise)
 //
 //  - pI,Ic : these extra parameters are mainly used when I0 correction is applied in order to speed up total convolution
 //            work because integrals of I and I0 can be computed simultaneously;
@@ -1097,20 +1339,21 @@ RC GetNewF(double *pNewF,
 // NB : pI->lambda==pXshr->lambda.
 //
 
-RC XSCONV_TypeStandard(MATRIX_OBJECT *pXsnew,INDEX indexLambdaMin,INDEX indexLambdaMax,const MATRIX_OBJECT *pXshr,
-                          const MATRIX_OBJECT *pI, double *Ic,int slitType,const MATRIX_OBJECT *slitMatrix, double *slitParam,int wveDptFlag)
+static RC XsconvTypeStandardDirect(MATRIX_OBJECT *pXsnew,INDEX indexLambdaMin,INDEX indexLambdaMax,const MATRIX_OBJECT *pXshr,
+                                   const MATRIX_OBJECT *pI, double *Ic,int slitType,const MATRIX_OBJECT *slitMatrix, const double *slitParam,SLIT_BANK *pBank)
  {
   // Declarations
-  MATRIX_OBJECT slitTmp;
+  const double *slitGrid;
   double *xsnewLambda,*xsnewVector,
          *xshrLambda,*xshrVector,*xshrDeriv2,
          *slitLambda[NSFP],*slitVector[NSFP],*slitDeriv2[NSFP],
+          param[NSFP],
           slitWidth,dist,
          *IVector,*IDeriv2,
           crossFIntegral,IFIntegral,FIntegral,
           oldF,newF,oldIF,newIF,stepF,h,fwhm,
           slitCenter,
-          stepXshr,slitStretch1,slitStretch2,
+          stepXshr,
           lambdaMin,lambdaMax,oldXshr,newXshr;
   INDEX   xshrPixMin,
           xsnewIndex,indexOld,indexNew,
@@ -1118,7 +1361,7 @@ RC XSCONV_TypeStandard(MATRIX_OBJECT *pXsnew,INDEX indexLambdaMin,INDEX indexLam
   int     xshrNDET,xsnewNDET,slitNDET[NSFP];
   RC      rc;
 
-  memset(&slitTmp,0,sizeof(MATRIX_OBJECT));
+  memcpy(param,slitParam,sizeof(double)*NSFP);
   fwhm=slitWidth=(double)0.;
   rc=ERROR_ID_NO;
 
@@ -1154,45 +1397,15 @@ RC XSCONV_TypeStandard(MATRIX_OBJECT *pXsnew,INDEX indexLambdaMin,INDEX indexLam
    	   slitLambda[i]=slitVector[i]=slitDeriv2[i]=NULL;
    	 }
 
-   	if ((slitType!=SLIT_TYPE_FILE) || (slitMatrix[0].nc==2))
-   	 {
-      if (wveDptFlag)
-       {
-        if ((rc=MATRIX_Allocate(&slitTmp,slitMatrix[0].nl,2,0,0,1,"XSCONV_TypeStandard"))!=0)
-         goto EndTypeStandard;
-        else
-         {
-          slitLambda[0]=slitTmp.matrix[0];
-          slitVector[0]=slitTmp.matrix[1];
-          slitDeriv2[0]=slitTmp.deriv2[1];
-          slitNDET[0]=slitTmp.nl;
-
-          memcpy(slitTmp.matrix[0],(double *)slitMatrix[0].matrix[0],sizeof(double)*(slitMatrix[0].nl));
-          memcpy(slitTmp.matrix[1],(double *)slitMatrix[0].matrix[1],sizeof(double)*(slitMatrix[0].nl));
-          memcpy(slitTmp.deriv2[1],(double *)slitMatrix[0].deriv2[1],sizeof(double)*(slitMatrix[0].nl));
-         }
-       }
-
-      if (slitType==SLIT_TYPE_FILE)
-       rc=XSCONV_GetFwhm(slitLambda[0],slitVector[0],slitDeriv2[0],slitNDET[0],SLIT_TYPE_FILE,&fwhm);
-     }
+    // Slit functions that change with the wavelength are taken from the bank for each final wavelength
 
-    // Multicolumns files
-
-    else if ((rc=MATRIX_Allocate(&slitTmp,slitMatrix[0].nl-1,2,0,0,1,"XSCONV_TypeStandard"))!=0)
-     goto EndTypeStandard;
-    else
-     {
-      slitLambda[0]=slitTmp.matrix[0];
-      slitVector[0]=slitTmp.matrix[1];
-      slitDeriv2[0]=slitTmp.deriv2[1];
-      slitNDET[0]=slitTmp.nl;
-
-      memcpy(slitTmp.matrix[0],(double *)slitMatrix[0].matrix[0]+1,sizeof(double)*(slitMatrix[0].nl-1));
-     }
+    if (pBank!=NULL)
+     slitNDET[0]=pBank->slitNDET;
+    else if (slitType==SLIT_TYPE_FILE)
+     rc=XSCONV_GetFwhm(slitLambda[0],slitVector[0],slitDeriv2[0],slitNDET[0],SLIT_TYPE_FILE,&fwhm);
    }
   else
-   fwhm=(slitType!=SLIT_TYPE_ERF)?slitParam[0]:sqrt(slitParam[0]*slitParam[0]+slitParam[1]*slitParam[1]);
+   fwhm=(slitType!=SLIT_TYPE_ERF)?param[0]:sqrt(param[0]*param[0]+param[1]*param[1]);
 
   xsnewNDET=pXsnew->nl;
   xshrNDET=pXshr->nl;
@@ -1204,8 +1417,10 @@ RC XSCONV_TypeStandard(MATRIX_OBJECT *pXsnew,INDEX indexLambdaMin,INDEX indexLam
 
   if (slitType==SLIT_TYPE_FILE)
    {
+    slitGrid=((pBank!=NULL) && (slitMatrix[0].nc>2))?slitMatrix[0].matrix[0]+1:slitLambda[0];   // multicolumns files : the first line contains the central wavelengths
+
     for (i=1,stepF=(double)0.;i<slitNDET[0];i++)
-     stepF+=(slitLambda[0][i]-slitLambda[0][i-1]);
+     stepF+=(slitGrid[i]-slitGrid[i-1]);
 
     stepF/=(slitNDET[0]-1);
    }
@@ -1236,91 +1451,26 @@ RC XSCONV_TypeStandard(MATRIX_OBJECT *pXsnew,INDEX indexLambdaMin,INDEX indexLam
 
   for (xsnewIndex=max(0,indexLambdaMin);(xsnewIndex<xsnewNDET) && (xsnewIndex<indexLambdaMax) && !rc;xsnewIndex++) {
     double lambda=xsnewLambda[xsnewIndex];
-    slitStretch1=slitStretch2=(double)1.;
-
-    if ((slitType==SLIT_TYPE_FILE) && (slitMatrix[0].nc>2))
-     {
-      for (i=0;i<slitTmp.nl;i++)
-       slitVector[0][i]=(double)VECTOR_Table2((double **)slitMatrix[0].matrix,slitMatrix[0].nl,slitMatrix[0].nc,slitMatrix[0].matrix[0][i+1],lambda);
-
-      // memcpy(slitLambda[0],(double *)slitMatrix[0].matrix[0]+1,sizeof(double)*(slitMatrix[0].nl-1));
-      if (!(rc=SPLINE_Deriv2(slitLambda[0],slitVector[0],slitDeriv2[0],slitNDET[0],"XSCONV_TypeStandard")))
-       rc=XSCONV_GetFwhm(slitLambda[0],slitVector[0],slitDeriv2[0],slitNDET[0],SLIT_TYPE_FILE,&fwhm);
-     }
 
-    // Interpolate wavelength dependent parameters at value lambda:
-    if (wveDptFlag) {
+    // Slit function at this wavelength
 
-      if ((slitType==SLIT_TYPE_SUPERGAUSS) && (slitLambda[2]!=NULL))
-        SPLINE_Vector(slitLambda[2],slitVector[2],slitDeriv2[2],slitNDET[2],&lambda,&slitParam[2],1,SPLINE_CUBIC);
-      else
-        slitParam[2]=(double)0.;
-
-      if (slitLambda[1]!=NULL) {
-        if (slitType!=SLIT_TYPE_FILE)
-          SPLINE_Vector(slitLambda[1],slitVector[1],slitDeriv2[1],slitNDET[1],&lambda,&slitParam[1],1,SPLINE_CUBIC);
-        else {
-          SPLINE_Vector(slitLambda[1],slitMatrix[1].matrix[1],slitMatrix[1].deriv2[1],slitNDET[1],&lambda,&slitStretch1,1,SPLINE_CUBIC);
-          if (slitMatrix[1].nc>2)
-            SPLINE_Vector(slitLambda[1],slitMatrix[1].matrix[2],slitMatrix[1].deriv2[2],slitNDET[1],&lambda,&slitStretch2,1,SPLINE_CUBIC);
-          else
-            slitStretch2=slitStretch1;
-        }
-      }
-
-      if (slitType==SLIT_TYPE_FILE) {
-        // Apply slitStretch1 or slitStretch2 depending on whether we
-        // are in the "left" or "right" wing of the slit function.  We
-        // do this by recalculating the wavelength grid
-
-        const double *lambda_orig = slitMatrix[0].matrix[0];
-        const double *slit_col1 = slitMatrix[0].matrix[1];
-        if (slitMatrix[0].nc>2) {
-          // If we have a matrix of slit functions for different
-          // central wavelengths, the matrix[0:ncols][0] contains the
-          // central wavelenghts -> shift lambda_orig and slit_col1 by
-          // one position:
-          lambda_orig += 1;
-          slit_col1 += 1;
-        }
-
-        // calculate center wavelength, defined as wavelength
-        // corresponding to the maximum value
-        //
-        // We always use slit_col1 here, to match what is done during
-        // calibration (KuruczConvolveSolarSpectrum in kurucz.c).
-        //
-        // TODO: for low-sampled slit functions, lambda of maximum
-        // might not be a good measure of the center => perform an
-        // interpolation here and in KuruczConvolveSolarSpectrum.
-        double lambda_center = 0.;
-        double slit_max = 0.;
-        for (int i=0; i<slitTmp.nl; ++i) {
-          if (slit_col1[i] > slit_max) {
-            slit_max = slit_col1[i];
-            lambda_center = lambda_orig[i];
-          }
-        }
+    if (pBank!=NULL)
+     {
+      if ((rc=XsconvSlitBankGet(pBank,slitMatrix,xsnewIndex))!=ERROR_ID_NO)
+       break;
 
-        for (i=0;i<slitTmp.nl;i++) {
-          // stretch wavelength grid around the center wavelength,
-          // using slitStretch1 on the left, and slitStretch2 on the
-          // right:
-          double delta_lambda = lambda_orig[i] - lambda_center;
-          delta_lambda *= (delta_lambda < 0.) ? slitStretch1 : slitStretch2;
-          slitLambda[0][i] = lambda_center + delta_lambda;
-        }
+      memcpy(param,pBank->param+xsnewIndex*NSFP,sizeof(double)*NSFP);
 
-        // Recalculate second derivatives and the FWHM
-        if (!(rc=SPLINE_Deriv2(slitLambda[0],slitVector[0],slitDeriv2[0],slitNDET[0],"XSCONV_TypeStandard ")))
-          rc=XSCONV_GetFwhm(slitLambda[0],slitVector[0],slitDeriv2[0],slitNDET[0],SLIT_TYPE_FILE,&slitParam[0]);
-      }
-      else if (slitLambda[0]!=NULL)
-        SPLINE_Vector(slitLambda[0],slitVector[0],slitDeriv2[0],slitNDET[0],&lambda,&slitParam[0],1,SPLINE_CUBIC);
-    }
+      if (slitType==SLIT_TYPE_FILE)
+       {
+        slitLambda[0]=pBank->slitLambda+xsnewIndex*pBank->slitNDET;
+        slitVector[0]=pBank->slitVector+xsnewIndex*pBank->slitNDET;
+        slitDeriv2[0]=pBank->slitDeriv2+xsnewIndex*pBank->slitNDET;
+       }
+     }
 
     if (slitType!=SLIT_TYPE_FILE) {
-      fwhm=(slitType!=SLIT_TYPE_ERF)?slitParam[0]:sqrt(slitParam[0]*slitParam[0]+slitParam[1]*slitParam[1]);
+      fwhm=(slitType!=SLIT_TYPE_ERF)?param[0]:sqrt(param[0]*param[0]+param[1]*param[1]);
       stepF=fwhm/(double)NFWHM;            // number of points/FWHM
       slitWidth=(double)0.5*NFWHM*fwhm; // 3.*fwhm; // slitWidth=(double)3.*fwhm;
 
@@ -1362,7 +1512,7 @@ RC XSCONV_TypeStandard(MATRIX_OBJECT *pXsnew,INDEX indexLambdaMin,INDEX indexLam
       dist=(double)slitCenter-(xshrLambda[indexOld]-lambda); // !!! slit function is inversed for convolution
 
       rc=GetNewF(&newF,slitType,slitLambda[0],slitVector[0],slitDeriv2[0],slitNDET[0],
-                  dist,slitParam[0],slitParam[1],slitParam[2],xshrLambda[xshrPixMin+1]-xshrLambda[xshrPixMin]);
+                  dist,param[0],param[1],param[2],xshrLambda[xshrPixMin+1]-xshrLambda[xshrPixMin]);
 
       // browse the grid of the high resolution cross section
 
@@ -1375,7 +1525,7 @@ RC XSCONV_TypeStandard(MATRIX_OBJECT *pXsnew,INDEX indexLambdaMin,INDEX indexLam
         // Convolution
 
         if (!(rc=GetNewF(&newF,slitType,slitLambda[0],slitVector[0],slitDeriv2[0],slitNDET[0],
-                          dist,slitParam[0],slitParam[1],slitParam[2],xshrLambda[indexNew]-xshrLambda[indexOld])))
+                          dist,param[0],param[1],param[2],xshrLambda[indexNew]-xshrLambda[indexOld])))
          {
           h=(xshrLambda[indexNew]-xshrLambda[indexOld])*0.5;  // use trapezium formula for surface computation (B+b)*H/2
           crossFIntegral+=(xshrVector[indexOld]*oldF+xshrVector[indexNew]*newF)*h;
@@ -1410,7 +1560,7 @@ RC XSCONV_TypeStandard(MATRIX_OBJECT *pXsnew,INDEX indexLambdaMin,INDEX indexLam
         dist=lambda-slitWidth;
 
         if ((rc=GetNewF(&oldF,slitType,slitLambda[0],slitVector[0],slitDeriv2[0],slitNDET[0],
-                        dist-lambda,slitParam[0],slitParam[1],slitParam[2],stepF))!=ERROR_ID_NO)
+                        dist-lambda,param[0],param[1],param[2],stepF))!=ERROR_ID_NO)
 
          goto EndTypeStandard;
        }
@@ -1448,7 +1598,7 @@ RC XSCONV_TypeStandard(MATRIX_OBJECT *pXsnew,INDEX indexLambdaMin,INDEX indexLam
           h=stepF*0.5;
 
           if ((rc=GetNewF(&newF,slitType,slitLambda[0],slitVector[0],slitDeriv2[0],slitNDET[0],
-                           dist-lambda,slitParam[0],slitParam[1],slitParam[2],stepF))!=ERROR_ID_NO)
+                           dist-lambda,param[0],param[1],param[2],stepF))!=ERROR_ID_NO)
 
            goto EndTypeStandard;
 
@@ -1488,7 +1638,345 @@ RC XSCONV_TypeStandard(MATRIX_OBJECT *pXsnew,INDEX indexLambdaMin,INDEX indexLam
 
   EndTypeStandard :
 
-  MATRIX_Free(&slitTmp,"XSCONV_TypeStandard");
+  // Return
+
+  return rc;
+ }
+
+// -----------------------------------------------------------------------------
+// FFT CONVOLUTION
+// -----------------------------------------------------------------------------
+//
+// On a regular high resolution grid, gaussian and error function slit
+// functions are applied to the Fourier transform of the cross section by
+// XSCONV_TypeStandardFFT (as for the calibration with fitted slit function).
+// The transform is calculated on segments of the grid extended by the
+// half-width of the slit function on both sides, so that the final wavelengths
+// are not affected by the edges of the segment.
+//
+// Wavelength dependent slit functions are processed by blocks of final
+// wavelengths in which the slit function parameters vary by less than
+// XSCONV_FFT_SLIT_TOL (relative); each block is convolved with the slit
+// function calculated at its central wavelength.
+//
+// Accepted error : the first, central and last wavelengths of each block are
+// calculated again with the direct method.  If one of them differs by more than
+// XSCONV_FFT_TOL times the largest absolute value of the block, the whole block
+// is calculated with the direct method.  The largest relative deviation of the
+// blocks that are kept is written in the debug trace.  In between control points, the error
+// is bounded by the variation of the slit function within the block and by the
+// cubic interpolation of a signal sampled at least NFWHM/2 times per FWHM
+// (case 1 of the direct method).
+//
+// Other slit function types and the I0 correction are always calculated with
+// the direct method.
+
+#define XSCONV_FFT_TOL        1.e-4                                             // maximum relative difference with the direct method at the control points of a block
+#define XSCONV_FFT_SLIT_TOL   1.e-3                                             // maximum relative variation of the slit function parameters within a block
+#define XSCONV_FFT_GRID_TOL   1.e-3                                             // maximum deviation of the high resolution wavelengths from a regular grid (in steps)
+#define XSCONV_FFT_MIN_POINTS 32                                                // minimum number of final wavelengths in a block
+#define XSCONV_FFT_SEGMENT    16384                                             // maximum number of high resolution pixels covered by a block
+
+// XsconvRegularGrid : check that a wavelength grid is regularly spaced and return its step
+
+static int XsconvRegularGrid(const double *lambda,int n,double *pStep)
+ {
+  double step;
+  INDEX i;
+
+  if (n<2)
+   return 0;
+
+  step=(lambda[n-1]-lambda[0])/(n-1);
+
+  for (i=1;(i<n-1) && (fabs(lambda[i]-lambda[0]-i*step)<=XSCONV_FFT_GRID_TOL*step);i++);
+
+  *pStep=step;
+
+  return ((step>(double)0.) && (i==n-1))?1:0;
+ }
+
+// XsconvSlitParam : slit function parameters at a wavelength of the final grid
+
+static RC XsconvSlitParam(SLIT_BANK *pBank,const MATRIX_OBJECT *slitMatrix,INDEX indexLambda,const double *slitParam,double *param)
+ {
+  RC rc;
+
+  rc=ERROR_ID_NO;
+
+  if (pBank==NULL)
+   memcpy(param,slitParam,sizeof(double)*NSFP);
+  else if (!(rc=XsconvSlitBankGet(pBank,slitMatrix,indexLambda)))
+   memcpy(param,pBank->param+indexLambda*NSFP,sizeof(double)*NSFP);
+
+  return rc;
+ }
+
+// XsconvSlitWidth : half-width of the slit function and step of the direct method
+
+static void XsconvSlitWidth(int slitType,const MATRIX_OBJECT *slitMatrix,const double *param,double *pSlitWidth,double *pStepF)
+ {
+  const double *slitLambda;
+  double fwhm;
+  int slitNDET;
+
+  if (slitType==SLIT_TYPE_FILE)
+   {
+    slitLambda=slitMatrix[0].matrix[0];
+    slitNDET=slitMatrix[0].nl;
+
+    *pSlitWidth=max(fabs(slitLambda[0]),fabs(slitLambda[slitNDET-1]));
+    *pStepF=(slitLambda[slitNDET-1]-slitLambda[0])/(slitNDET-1);
+   }
+  else
+   {
+    fwhm=(slitType!=SLIT_TYPE_ERF)?param[0]:sqrt(param[0]*param[0]+param[1]*param[1]);
+
+    *pSlitWidth=(double)0.5*NFWHM*fwhm;
+    *pStepF=fwhm/(double)NFWHM;
+   }
+ }
+
+// XsconvFFTBlock : convolution of a block of final wavelengths by FFT (XSCONV_TypeStandardFFT)
+
+static RC XsconvFFTBlock(MATRIX_OBJECT *pXsnew,INDEX indexMin,INDEX indexMax,const MATRIX_OBJECT *pXshr,double stepXshr,
+                         int slitType,const double *param,double slitWidth)
+ {
+  // Declarations
+
+  const double *xshrLambda,*xshrVector;
+  INDEX klo,khi,i;
+  FFT fft;
+  int xshrNDET,nIn;
+  RC rc;
+
+  // Initializations
+
+  xshrLambda=pXshr->matrix[0];
+  xshrVector=pXshr->matrix[1];
+  xshrNDET=pXshr->nl;
+
+  memset(&fft,0,sizeof(FFT));
+
+  // Segment of the cross section the block depends on (with two extra pixels on both sides for the interpolation)
+
+  klo=max(0,(int)floor((pXsnew->matrix[0][indexMin]-slitWidth-xshrLambda[0])/stepXshr)-2);
+  khi=min(xshrNDET-1,(int)ceil((pXsnew->matrix[0][indexMax-1]+slitWidth-xshrLambda[0])/stepXshr)+2);
+
+  nIn=fft.oldSize=khi-klo+1;
+  fft.fftSize=(int)pow((double)2.,ceil(log((double)nIn)/log((double)2.)));
+
+  if (((fft.fftIn=(double *)MEMORY_AllocDVector("XsconvFFTBlock ","fftIn",1,fft.fftSize))==NULL) ||
+      ((fft.fftOut=(double *)MEMORY_AllocDVector("XsconvFFTBlock ","fftOut",1,fft.fftSize))==NULL) ||
+      ((fft.invFftIn=(double *)MEMORY_AllocDVector("XsconvFFTBlock ","invFftIn",1,fft.fftSize))==NULL) ||
+      ((fft.invFftOut=(double *)MEMORY_AllocDVector("XsconvFFTBlock ","invFftOut",1,fft.fftSize))==NULL))
+
+   rc=ERROR_ID_ALLOC;
+
+  else
+   {
+    // Fourier transform of the segment (extended by symmetry as for the calibration)
+
+    memcpy(fft.fftIn+1,xshrVector+klo,sizeof(double)*nIn);
+
+    for (i=nIn+1;i<=fft.fftSize;i++)
+     fft.fftIn[i]=fft.fftIn[2*nIn-i];
+
+    realft(fft.fftIn,fft.fftOut,fft.fftSize,1);
+
+    memcpy(fft.fftIn+1,xshrLambda+klo,sizeof(double)*nIn);                     // reuse fftIn for the high resolution wavelengths
+
+    // Convolution with the slit function and interpolation on the final wavelength grid
+
+    rc=XSCONV_TypeStandardFFT(&fft,slitType,param[0],param[1],pXsnew->matrix[0]+indexMin,pXsnew->matrix[1]+indexMin,indexMax-indexMin);
+   }
+
+  // Release allocated buffers
+
+  if (fft.fftIn!=NULL)
+   MEMORY_ReleaseDVector("XsconvFFTBlock ","fftIn",fft.fftIn,1);
+  if (fft.fftOut!=NULL)
+   MEMORY_ReleaseDVector("XsconvFFTBlock ","fftOut",fft.fftOut,1);
+  if (fft.invFftIn!=NULL)
+   MEMORY_ReleaseDVector("XsconvFFTBlock ","invFftIn",fft.invFftIn,1);
+  if (fft.invFftOut!=NULL)
+   MEMORY_ReleaseDVector("XsconvFFTBlock ","invFftOut",fft.invFftOut,1);
+
+  // Return
+
+  return rc;
+ }
+
+// -----------------------------------------------------------------------------
+// XSCONV_TypeStandard : Standard convolution of cross section with a slit function
+// -----------------------------------------------------------------------------
+//
+// Same arguments as XsconvTypeStandardDirect, with wveDptFlag set for
+// wavelength dependent slit functions; the FFT convolution is used for the
+// blocks of final wavelengths it can be applied to (see above) and the other
+// wavelengths are calculated with the direct method.
+//
+// pSlitBank, if not NULL, keeps the slit function calculated at each final
+// wavelength for the next calls with the same slit function and final grid.
+//
+
+RC XSCONV_TypeStandard(MATRIX_OBJECT *pXsnew,INDEX indexLambdaMin,INDEX indexLambdaMax,const MATRIX_OBJECT *pXshr,
+                          const MATRIX_OBJECT *pI, double *Ic,int slitType,const MATRIX_OBJECT *slitMatrix, double *slitParam,int wveDptFlag,SLIT_BANK *pSlitBank)
+ {
+  // Declarations
+
+  SLIT_BANK slitBank,*pBank;
+  const double *xsnewLambda,*xshrLambda;
+  double *xsnewVector,
+          blockParam[NSFP],param[NSFP],
+          stepXshr,slitWidth,stepF,lambda,fftValue,maxValue,
+          deviation,blockDeviation,maxDeviation;                                // relative deviations from the direct method at the control points
+  INDEX   indexMin,indexMax,indexBlock,indexEnd,indexCheck[3],i;
+  int     xshrNDET,fftFailed,fftBlocks,fftRejected;
+  RC      rc;
+
+  const double timingStart=TIMING_Start();
+
+  memset(&slitBank,0,sizeof(SLIT_BANK));
+
+  indexMin=max(0,indexLambdaMin);
+  indexMax=min(pXsnew->nl,indexLambdaMax);
+
+  xsnewLambda=pXsnew->matrix[0];
+  xsnewVector=pXsnew->matrix[1];
+  xshrLambda=pXshr->matrix[0];
+  xshrNDET=pXshr->nl;
+
+  pBank=NULL;
+  maxDeviation=(double)0.;
+  fftBlocks=fftRejected=0;
+  rc=ERROR_ID_NO;
+
+  // Slit functions that change with the wavelength are calculated once for each final wavelength (in the bank of the caller if any)
+
+  if ((slitMatrix!=NULL) && (wveDptFlag || ((slitType==SLIT_TYPE_FILE) && (slitMatrix[0].nc>2))))
+   {
+    pBank=(pSlitBank!=NULL)?pSlitBank:&slitBank;
+    rc=XsconvSlitBankInit(pBank,pXsnew,slitType,slitMatrix,slitParam,wveDptFlag);
+   }
+
+  // The FFT convolution is restricted to regular high resolution grids, without I0 correction and with gaussian or error function slit functions
+
+  if (!rc && ((Ic!=NULL) || (indexMax-indexMin<XSCONV_FFT_MIN_POINTS) ||
+              ((slitType!=SLIT_TYPE_GAUSS) && (slitType!=SLIT_TYPE_ERF)) ||
+               !XsconvRegularGrid(xshrLambda,xshrNDET,&stepXshr)))
+
+   rc=XsconvTypeStandardDirect(pXsnew,indexLambdaMin,indexLambdaMax,pXshr,pI,Ic,slitType,slitMatrix,slitParam,pBank);
+
+  // Browse blocks of final wavelengths
+
+  else
+   for (indexBlock=indexMin;(indexBlock<indexMax) && !rc;indexBlock=indexEnd)
+   {
+    // Wavelengths for which the slit function doesn't fit in the high resolution grid or is not sampled enough by this grid (case 2 of the direct method)
+
+    for (indexEnd=indexBlock;(indexEnd<indexMax) && !(rc=XsconvSlitParam(pBank,slitMatrix,indexEnd,slitParam,param));indexEnd++)
+     {
+      lambda=xsnewLambda[indexEnd];
+
+      XsconvSlitWidth(slitType,slitMatrix,param,&slitWidth,&stepF);
+
+      if ((lambda-slitWidth>=xshrLambda[0]) && (lambda+slitWidth<=xshrLambda[xshrNDET-1]) && (2*stepF-stepXshr>EPSILON))
+       break;
+     }
+
+    if (rc)
+     break;
+    else if (indexEnd>indexBlock)
+     {
+      rc=XsconvTypeStandardDirect(pXsnew,indexBlock,indexEnd,pXshr,pI,Ic,slitType,slitMatrix,slitParam,pBank);
+      continue;
+     }
+
+    // Extend the block while the slit function doesn't change and wavelengths are increasing
+
+    memcpy(blockParam,param,sizeof(double)*NSFP);
+
+    for (indexEnd=indexBlock+1;(indexEnd<indexMax) && !(rc=XsconvSlitParam(pBank,slitMatrix,indexEnd,slitParam,param));indexEnd++)
+     {
+      lambda=xsnewLambda[indexEnd];
+
+      XsconvSlitWidth(slitType,slitMatrix,param,&slitWidth,&stepF);
+
+      for (i=0;(i<NSFP) && (fabs(param[i]-blockParam[i])<=XSCONV_FFT_SLIT_TOL*fabs(blockParam[i]));i++);
+
+      if ((i<NSFP) || (lambda<=xsnewLambda[indexEnd-1]) || (lambda+slitWidth>xshrLambda[xshrNDET-1]) ||
+          (lambda-xsnewLambda[indexBlock]>XSCONV_FFT_SEGMENT*stepXshr))
+       break;
+     }
+
+    if (rc)
+     break;
+    else if ((indexEnd-indexBlock<XSCONV_FFT_MIN_POINTS) || (blockParam[0]<=(double)0.) || ((slitType==SLIT_TYPE_ERF) && (blockParam[1]<=(double)0.)))
+     {
+      rc=XsconvTypeStandardDirect(pXsnew,indexBlock,indexEnd,pXshr,pI,Ic,slitType,slitMatrix,slitParam,pBank);
+      continue;
+     }
+
+    // Convolve the block with the slit function at its central wavelength
+
+    if ((rc=XsconvSlitParam(pBank,slitMatrix,(indexBlock+indexEnd-1)/2,slitParam,param))!=ERROR_ID_NO)
+     break;
+
+    XsconvSlitWidth(slitType,slitMatrix,param,&slitWidth,&stepF);
+
+    if ((rc=XsconvFFTBlock(pXsnew,indexBlock,indexEnd,pXshr,stepXshr,slitType,param,slitWidth))!=ERROR_ID_NO)
+     break;
+
+    // Check the result at the control points
+
+    for (i=indexBlock,maxValue=(double)0.;i<indexEnd;i++)
+     maxValue=max(maxValue,fabs(xsnewVector[i]));
+
+    indexCheck[0]=indexBlock;
+    indexCheck[1]=(indexBlock+indexEnd-1)/2;
+    indexCheck[2]=indexEnd-1;
+
+    for (i=0,fftFailed=0,blockDeviation=(double)0.;(i<3) && !fftFailed && !rc;i++)
+     {
+      fftValue=xsnewVector[indexCheck[i]];
+
+      if (!(rc=XsconvTypeStandardDirect(pXsnew,indexCheck[i],indexCheck[i]+1,pXshr,pI,Ic,slitType,slitMatrix,slitParam,pBank)))
+       {
+        deviation=fabs(fftValue-xsnewVector[indexCheck[i]]);
+        fftFailed=(deviation>XSCONV_FFT_TOL*maxValue)?1:0;
+
+        if (maxValue>(double)0.)
+         blockDeviation=max(blockDeviation,deviation/maxValue);
+       }
+     }
+
+    fftBlocks++;
+
+    // Otherwise, use the direct method for the whole block
+
+    if (fftFailed && !rc)
+     {
+      rc=XsconvTypeStandardDirect(pXsnew,indexBlock,indexEnd,pXshr,pI,Ic,slitType,slitMatrix,slitParam,pBank);
+      fftRejected++;
+     }
+    else
+     maxDeviation=max(maxDeviation,blockDeviation);
+   }
+
+  // Accuracy of the blocks kept from the FFT convolution
+
+  #if defined(__DEBUG_) && __DEBUG_
+  if (!rc && fftBlocks)
+   DEBUG_Print("FFT convolution of %d blocks (%d rejected) : largest relative deviation from the direct method %.2e (tolerance %.2e)\n",
+                fftBlocks,fftRejected,maxDeviation,XSCONV_FFT_TOL);
+  #endif
+
+  // Release the bank if it is not kept by the caller
+
+  XSCONV_SlitBankFree(&slitBank);
+
+  TIMING_Stop(TIMING_STAGE_CONVOLUTION,timingStart);
 
   // Return
 
@@ -1499,7 +1987,7 @@ RC XSCONV_TypeStandard(MATRIX_OBJECT *pXsnew,INDEX indexLambdaMin,INDEX indexLam
 // XsconvTypeI0Correction : Convolution of cross sections with I0 correction
 // -------------------------------------------------------------------------
 
-RC XSCONV_TypeI0Correction(MATRIX_OBJECT *pXsnew,MATRIX_OBJECT *pXshr,MATRIX_OBJECT *pI0,double conc,int slitType,MATRIX_OBJECT *slitMatrix,double *slitParam,int wveDptFlag)
+RC XSCONV_TypeI0Correction(MATRIX_OBJECT *pXsnew,MATRIX_OBJECT *pXshr,MATRIX_OBJECT *pI0,double conc,int slitType,MATRIX_OBJECT *slitMatrix,double *slitParam,int wveDptFlag,SLIT_BANK *pSlitBank)
  {
   // Declarations
 
@@ -1581,7 +2069,7 @@ RC XSCONV_TypeI0Correction(MATRIX_OBJECT *pXsnew,MATRIX_OBJECT *pXshr,MATRIX_OBJ
 
     if (!rc &&
         !(rc=SPLINE_Deriv2(ILambda,IVector,IDeriv2,INDET,"XSCONV_TypeI0Correction ")) &&               // I second derivatives calculation
-        !(rc=XSCONV_TypeStandard(&I0c,0,xsnewNDET,pI0,&I,IcVector,slitType,slitMatrix,slitParam,wveDptFlag)))    // I0 and I convolution
+        !(rc=XSCONV_TypeStandard(&I0c,0,xsnewNDET,pI0,&I,IcVector,slitType,slitMatrix,slitParam,wveDptFlag,pSlitBank)))    // I0 and I convolution
      {
       // Cross section convolution
 
@@ -33,8 +33,9 @@ extern "C" {
   RC   XSCONV_GetFwhm(double *lambda,double *slit,double *deriv2,int nl,int slitType,double *slitParam);
   RC   XSCONV_TypeNone(MATRIX_OBJECT *pXsnew,MATRIX_OBJECT *pXshr);
   RC   XSCONV_TypeGauss(const double *lambda, const double *Spec, const double *SDeriv2,double lambdaj,double dldj,double *SpecConv,double fwhm,double n,int slitType, int ndet);
-  RC   XSCONV_TypeStandard(MATRIX_OBJECT *pXsnew,INDEX indexLambdaMin,INDEX indexLambdaMax,const MATRIX_OBJECT *pXshr,const MATRIX_OBJECT *pI, double *Ic,int slitType,const MATRIX_OBJECT *slitMatrix, double *slitParam,int wveDptFlag);
-  RC   XSCONV_TypeI0Correction(MATRIX_OBJECT *pXsnew,MATRIX_OBJECT *pXshr,MATRIX_OBJECT *pI0,double conc,int slitType,MATRIX_OBJECT *slitMatrix,double *slitParam,int wveDptFlag);
+  RC   XSCONV_TypeStandard(MATRIX_OBJECT *pXsnew,INDEX indexLambdaMin,INDEX indexLambdaMax,const MATRIX_OBJECT *pXshr,const MATRIX_OBJECT *pI, double *Ic,int slitType,const MATRIX_OBJECT *slitMatrix, double *slitParam,int wveDptFlag,SLIT_BANK *pSlitBank);
+  RC   XSCONV_TypeI0Correction(MATRIX_OBJECT *pXsnew,MATRIX_OBJECT *pXshr,MATRIX_OBJECT *pI0,double conc,int slitType,MATRIX_OBJECT *slitMatrix,double *slitParam,int wveDptFlag,SLIT_BANK *pSlitBank);
+  void XSCONV_SlitBankFree(SLIT_BANK *pSlitBank);
 
   // Cross section to convolute
   struct _FFT {
@@ -46,6 +47,21 @@ extern "C" {
     int     oldSize;
   };
 
+  // Slit function calculated at each wavelength of a final grid (wavelength dependent slit functions, multi-column slit files)
+  struct _slitBank {
+    int     slitType;                                                           // type of the slit function
+    int     wveDptFlag;                                                         // 1 for a wavelength dependent slit function
+    double  slitParam[NSFP];                                                    // slit function parameters given for the convolution
+    double *slitDef;                                                            // copy of the slit function matrices, to detect a new slit function
+    int     slitDefSize;                                                        // size of the previous vector
+    double *lambda;                                                             // final wavelength grid
+    int     nl;                                                                 // number of wavelengths in the final grid
+    int     slitNDET;                                                           // number of points of the slit function (slit files only)
+    int    *done;                                                               // 1 if the slit function has already been calculated at the wavelength
+    double *param;                                                              // slit function parameters at each wavelength (NSFP per wavelength)
+    double *slitLambda,*slitVector,*slitDeriv2;                                 // slit function at each wavelength (slitNDET per wavelength, slit files only)
+  };
+
 #if defined(_cplusplus) || defined(__cplusplus)
 }
 #endif
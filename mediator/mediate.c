@@ -36,7 +36,9 @@
 #include "output.h"
 #include "kurucz.h"
 #include "svd.h"
+#include "xscache.h"
 #include "winthrd.h"
+#include "timing.h"
 
 #include "omi_read.h"
 #include "tropomi_read.h"
@@ -45,6 +47,8 @@
 #include "gems_read.h"
 #include "mfc-read.h"
 
+static void mediateRequestReleaseAnalysisRows(void);
+
 int mediateRequestDisplaySpecInfo(void *engineContext,int page,void *responseHandle)
  {
    // Declarations
@@ -582,6 +586,8 @@ int mediateRequestCreateEngineContext(void **engineContext, void *responseHandle
 
 int mediateRequestDestroyEngineContext(void *engineContext, void *responseHandle)
  {
+   mediateRequestReleaseAnalysisRows();
+
    return (!EngineDestroyContext((ENGINE_CONTEXT *)engineContext))?0:-1;
  }
 
@@ -1302,6 +1308,9 @@ void setMediateProjectOutput(PRJCT_RESULTS *pEngineOutput,const mediate_project_
    strcpy(pEngineOutput->swath_name,pMediateOutput->swath_name);
 
    pEngineOutput->file_format=pMediateOutput->file_format;
+   pEngineOutput->chunking=pMediateOutput->chunking;
+   pEngineOutput->compressionLevel=pMediateOutput->compressionLevel;
+   pEngineOutput->shuffleFlag=pMediateOutput->shuffleFlag;
 
    pEngineOutput->analysisFlag=pMediateOutput->analysisFlag;
    pEngineOutput->calibFlag=pMediateOutput->calibrationFlag;
@@ -1618,6 +1627,433 @@ RC mediateRequestSetAnalysisNonLinearDoas(ENGINE_CONTEXT *pEngineContext, const
    return rc;
  }
 
+// =============================================
+// SET UP OF THE ANALYSIS WINDOWS OF A DETECTOR ROW
+// =============================================
+
+// For imagers, the analysis windows are set up for each detector row used
+// (reference, cross sections interpolated and convolved on the grid of the
+// row, wavelength calibration, alignment of the reference).  By default, all
+// rows are set up by mediateRequestSetAnalysisWindows.  In lazy mode, only the
+// first row is set up there; for the other rows, only the grid of the
+// reference is read (ANALYSE_LoadRefGrid), so that the wavelength range of the
+// preloaded solar spectrum is the same as by default.  These rows are loaded
+// and aligned the first time one of their records is analysed
+// (mediateRequestPrepareAnalysisRow), with the options and the copy of the
+// analysis windows kept in mediateAnalysisRows.
+
+enum _mediateRowStates
+ {
+  MEDIATE_ROW_NONE,                                                             // row not set up yet
+  MEDIATE_ROW_LOADED,                                                           // analysis windows loaded
+  MEDIATE_ROW_READY                                                             // calibration and reference alignment done
+ };
+
+typedef struct _mediateAnalysisRows
+ {
+  const mediate_analysis_window_t *analysisWindows;                             // analysis windows from the user interface
+  mediate_analysis_window_t *lazyWindows;                                       // copy of the analysis windows kept in lazy mode
+  mediate_analysis_window_t calibWindows;                                       // calibration parameters
+  int numberOfWindows;                                                          // number of analysis windows
+  int n_wavel_ref1,n_wavel_ref2;                                                // size of the references loaded for imagers
+  double lambdaMin,lambdaMax;                                                   // wavelength range of the analysis windows of all the rows
+  int useKurucz,                                                                // flag set if Kurucz is to be used in at least one analysis window
+      useUsamp,                                                                 // flag set if undersampling correction is requested in at least one analysis window
+      xsToConvolute,                                                            // flag set if at least one cross section has to be convolved in at least one analysis window
+      xsToConvoluteI0,                                                          // flag set if at least one cross section has to be I0-convolved in at least one analysis window
+      saveFlag;
+  INDEX indexKurucz;                                                            // index of the calibration window
+  MATRIX_OBJECT hrSolar;                                                        // high resolution solar spectrum preloaded for KURUCZ_Alloc
+  int lazyFlag;                                                                 // 1 if the rows are loaded and aligned on demand
+  int ndet;                                                                     // size of the buffers of the engine context
+  double *lambda;                                                               // wavelength calibration of the engine context after the load of the rows
+  char rowState[MAX_SWATHSIZE];                                                 // state of each row (cfr enum _mediateRowStates)
+ }
+MEDIATE_ANALYSIS_ROWS;
+
+static MEDIATE_ANALYSIS_ROWS mediateAnalysisRows;
+static int mediateLazyRows=0;                                                   // option set by mediateRequestSetLazyRows
+
+// -----------------------------------------------------------------------------
+// FUNCTION      mediateRequestReleaseAnalysisRows
+// -----------------------------------------------------------------------------
+// PURPOSE       Release the buffers kept to set up the detector rows
+// -----------------------------------------------------------------------------
+
+static void mediateRequestReleaseAnalysisRows(void)
+ {
+   MEDIATE_ANALYSIS_ROWS *pSetup=&mediateAnalysisRows;
+
+   if (pSetup->lambda!=NULL)
+    MEMORY_ReleaseDVector(__func__,"lambda",pSetup->lambda,0);
+   if (pSetup->lazyWindows!=NULL)
+    MEMORY_ReleaseBuffer(__func__,"lazyWindows",pSetup->lazyWindows);
+
+   MATRIX_Free(&pSetup->hrSolar,__func__);
+
+   memset(pSetup,0,sizeof(MEDIATE_ANALYSIS_ROWS));
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      mediateRequestLoadAnalysisRow
+// -----------------------------------------------------------------------------
+// PURPOSE       Load the analysis windows of a detector row (reference, cross
+//               sections, fitting parameters)
+// -----------------------------------------------------------------------------
+
+static RC mediateRequestLoadAnalysisRow(ENGINE_CONTEXT *pEngineContext,INDEX indexFenoColumn)
+ {
+   // Declarations
+
+   MEDIATE_ANALYSIS_ROWS *pSetup=&mediateAnalysisRows;
+   PRJCT_INSTRUMENTAL *pInstrumental;
+   const mediate_analysis_window_t *pAnalysisWindows;                            // pointer to the current analysis window from the user interface
+   FENO *pTabFeno;                                                               // pointer to the description of an analysis window
+   int indexFeno;                                                                // browse analysis windows
+   RC rc;                                                                        // return code
+
+   // Initializations
+
+   pInstrumental=&pEngineContext->project.instrumental;
+   rc=ERROR_ID_NO;
+
+   NFeno=0;
+
+   for (indexFeno=0;(indexFeno<pSetup->numberOfWindows+1) && !rc;indexFeno++) {
+     // Pointers initialization
+
+     pTabFeno=&TabFeno[indexFenoColumn][NFeno];
+
+     pTabFeno->hidden=!indexFeno;
+     pAnalysisWindows=(!pTabFeno->hidden)? &pSetup->analysisWindows[indexFeno-1]: &pSetup->calibWindows;
+
+     pTabFeno->NDET=NDET[indexFenoColumn];
+     pTabFeno->n_wavel_ref1=pSetup->n_wavel_ref1;
+     pTabFeno->n_wavel_ref2=pSetup->n_wavel_ref2;
+     const int n_wavel = pTabFeno->NDET;
+
+     if ((pTabFeno->hidden<2) && ((THRD_id==THREAD_TYPE_ANALYSIS) || (pTabFeno->hidden==1))) {
+       // QDOAS : avoid the load of disabled analysis windows with hidden==2
+
+       if (pTabFeno->hidden) {                                                     // if indexFeno==0, load calibration parameters
+         strcpy(pTabFeno->windowName,"Calibration description");                   // like WinDOAS
+         pTabFeno->analysisMethod=pKuruczOptions->analysisMethod;
+       } else {                                                                    // otherwise, load analysis windows from analysisWindows[indexFeno-1]
+         // Load data from analysis windows panels
+
+         strcpy(pTabFeno->windowName,pAnalysisWindows->name);
+         strcpy(pTabFeno->residualsFile,pAnalysisWindows->residualFile);
+         strcpy(pTabFeno->ref1,pAnalysisWindows->refOneFile);
+         strcpy(pTabFeno->ref2,pAnalysisWindows->refTwoFile);
+
+         pTabFeno->resolFwhm=pAnalysisWindows->resolFwhm;
+         pTabFeno->lambda0=pAnalysisWindows->lambda0;
+
+         if (fabs(pTabFeno->lambda0)<EPSILON)
+          pTabFeno->lambda0=(double)0.5*(pAnalysisWindows->fitMinWavelength+pAnalysisWindows->fitMaxWavelength);
+
+         if ((pTabFeno->refSpectrumSelectionMode=pAnalysisWindows->refSpectrumSelection)==ANLYS_REF_SELECTION_MODE_AUTOMATIC) {
+             if (((pEngineContext->project.instrumental.readOutFormat!=PRJCT_INSTR_FORMAT_ASCII) && is_maxdoas(pEngineContext->project.instrumental.readOutFormat)) ||
+                 ((pEngineContext->project.instrumental.readOutFormat==PRJCT_INSTR_FORMAT_ASCII) && (pEngineContext->project.instrumental.ascii.elevSaveFlag || (pEngineContext->project.instrumental.ascii.format==PRJCT_INSTR_ASCII_FORMAT_COLUMN_EXTENDED)))) {
+
+           //if ((pEngineContext->project.instrumental.readOutFormat==PRJCT_INSTR_FORMAT_CCD_EEV) || (pEngineContext->project.instrumental.readOutFormat==PRJCT_INSTR_FORMAT_MFC) || (pEngineContext->project.instrumental.readOutFormat==PRJCT_INSTR_FORMAT_MFC_STD) || (pEngineContext->project.instrumental.readOutFormat==PRJCT_INSTR_FORMAT_MFC_BIRA) ||
+           //    (pEngineContext->project.instrumental.readOutFormat==PRJCT_INSTR_FORMAT_BIRA_MOBILE) || (pEngineContext->project.instrumental.readOutFormat==PRJCT_INSTR_FORMAT_BIRA_AIRBORNE) || (pEngineContext->project.instrumental.readOutFormat==PRJCT_INSTR_FORMAT_FRM4DOAS_NETCDF) ||
+           //   ((pEngineContext->project.instrumental.readOutFormat==PRJCT_INSTR_FORMAT_ASCII) && (pEngineContext->project.instrumental.ascii.elevSaveFlag || (pEngineContext->project.instrumental.ascii.format==PRJCT_INSTR_ASCII_FORMAT_COLUMN_EXTENDED)))) {
+
+             if ((pTabFeno->refMaxdoasSelectionMode=pAnalysisWindows->refMaxdoasSelection)==ANLYS_MAXDOAS_REF_SCAN)
+               pEngineContext->analysisRef.refScan++;
+             else if (pTabFeno->refMaxdoasSelectionMode==ANLYS_MAXDOAS_REF_SZA)
+               pEngineContext->analysisRef.refSza++;
+           }
+
+           pTabFeno->refSpectrumSelectionScanMode=pAnalysisWindows->refSpectrumSelectionScanMode;
+
+           pTabFeno->refSZA=(double)pAnalysisWindows->refSzaCenter;
+           pTabFeno->refSZADelta=(double)pAnalysisWindows->refSzaDelta;
+
+           pTabFeno->refLatMin=pAnalysisWindows->refMinLatitude;
+           pTabFeno->refLatMax=pAnalysisWindows->refMaxLatitude;
+           pTabFeno->refLonMin=pAnalysisWindows->refMinLongitude;
+           pTabFeno->refLonMax=pAnalysisWindows->refMaxLongitude;
+
+           pTabFeno->cloudFractionMin=pAnalysisWindows->cloudFractionMin;
+           pTabFeno->cloudFractionMax=pAnalysisWindows->cloudFractionMax;
+
+           pEngineContext->analysisRef.refAuto++;
+
+           if ((fabs(pTabFeno->refLonMax-pTabFeno->refLonMin)>1.e-5) ) // && (fabs(pTabFeno->refLonMax-pTabFeno->refLonMin)<359.))
+             pEngineContext->analysisRef.refLon++;
+         }
+
+         if (pEngineContext->project.spectra.displayFitFlag) {
+
+           pTabFeno->displaySpectrum=pAnalysisWindows->requireSpectrum;
+           pTabFeno->displayResidue=pAnalysisWindows->requireResidual;
+           pTabFeno->displayTrend=pAnalysisWindows->requirePolynomial;
+           pTabFeno->displayRefEtalon=pAnalysisWindows->requireRefRatio;
+           pTabFeno->displayFits=pAnalysisWindows->requireFit;
+           pTabFeno->displayPredefined=pAnalysisWindows->requirePredefined;
+
+           pTabFeno->displayFlag=pTabFeno->displaySpectrum+
+             pTabFeno->displayResidue+
+             pTabFeno->displayTrend+
+             pTabFeno->displayRefEtalon+
+             pTabFeno->displayFits+
+             pTabFeno->displayPredefined;
+         }
+
+         pTabFeno->useKurucz=pAnalysisWindows->kuruczMode;
+
+         pTabFeno->analysisMethod=pAnalysisOptions->method;
+         pSetup->useKurucz+=pAnalysisWindows->kuruczMode;
+       }  // if (pTabFeno->hidden)
+
+       pTabFeno->Decomp=1;
+
+       // spikes buffer
+       if ((pTabFeno->spikes == NULL) &&
+           ((pTabFeno->spikes=(bool *)MEMORY_AllocBuffer(__func__,"spikes",n_wavel,sizeof(int),0,MEMORY_TYPE_INT))==NULL)) {
+         rc = ERROR_ID_ALLOC;
+         break;
+       }
+
+       // Wavelength scales read out
+
+       if (((pTabFeno->Lambda==NULL) && ((pTabFeno->Lambda=MEMORY_AllocDVector(__func__,"Lambda",0,n_wavel-1))==NULL)) ||
+           ((pTabFeno->LambdaK==NULL) && ((pTabFeno->LambdaK=MEMORY_AllocDVector(__func__,"LambdaK",0,n_wavel-1))==NULL)) ||
+           ((pTabFeno->LambdaRef==NULL) && ((pTabFeno->LambdaRef=MEMORY_AllocDVector(__func__,"LambdaRef",0,n_wavel-1))==NULL)) ||
+
+           // omi rejected pixels
+
+           ((pEngineContext->project.instrumental.readOutFormat==PRJCT_INSTR_FORMAT_OMI) && pEngineContext->project.instrumental.omi.pixelQFRejectionFlag &&
+            (pTabFeno->omiRejPixelsQF == NULL) && ((pTabFeno->omiRejPixelsQF=(bool *)MEMORY_AllocBuffer(__func__,"omiRejPixelsQF",n_wavel,sizeof(int),0,MEMORY_TYPE_INT))==NULL))) {
+         rc=ERROR_ID_ALLOC;
+         break;
+       }
+
+       if ( pInstrumental->readOutFormat==PRJCT_INSTR_FORMAT_OMI
+            && strlen(pInstrumental->calibrationFile) ) {
+         int n_wavel_ref;
+         rc=OMI_GetReference(pInstrumental->omi.spectralType,pInstrumental->calibrationFile,indexFenoColumn,pEngineContext->buffers.lambda,pEngineContext->buffers.spectrum,pEngineContext->buffers.sigmaSpec, &n_wavel_ref);
+
+         if (rc != 0) {
+           break;
+         }
+
+       }
+
+       memcpy(pTabFeno->LambdaRef,pEngineContext->buffers.lambda,sizeof(double)*n_wavel);
+       memcpy(pTabFeno->Lambda,pEngineContext->buffers.lambda,sizeof(double)*n_wavel);
+
+       // TODO: ANALYSE_LoadRef can change NDET[] -> should n_wavel be updated here?
+       if (!(rc=ANALYSE_LoadRef(pEngineContext,indexFenoColumn)) &&   // eventually, modify LambdaRef for continuous functions
+           !(rc=ANALYSE_LoadCross(pEngineContext,pAnalysisWindows->crossSectionList.crossSection,pAnalysisWindows->crossSectionList.nCrossSection,pTabFeno->LambdaRef,indexFenoColumn)) &&
+           !(rc=mediateRequestSetAnalysisLinear(&pAnalysisWindows->linear,indexFenoColumn)) &&
+
+           // Caro : int the future, replace structures anlyswin_nonlinear and calibration_sfp with the following one more flexible
+           //        mediateRequestSetAnalysisNonLinearDoas and mediateRequestSetAnalysisNonLinearCalib would be replaced by only one call to ANALYSE_LoadNonLinear
+
+           ((!pTabFeno->hidden && !(rc=mediateRequestSetAnalysisNonLinearDoas(pEngineContext,&pAnalysisWindows->nonlinear,pTabFeno->LambdaRef,indexFenoColumn))) ||
+            (pTabFeno->hidden && !(rc=mediateRequestSetAnalysisNonLinearCalib(pEngineContext,pEngineContext->calibFeno.sfp,pTabFeno->LambdaRef,indexFenoColumn)))) &&
+
+           !(rc=ANALYSE_LoadShiftStretch(pAnalysisWindows->shiftStretchList.shiftStretch,pAnalysisWindows->shiftStretchList.nShiftStretch,indexFenoColumn)) &&
+           !(rc=ANALYSE_LoadOutput(pAnalysisWindows->outputList.output,pAnalysisWindows->outputList.nOutput,indexFenoColumn)) &&
+           (pTabFeno->hidden ||
+            (!(rc=ANALYSE_LoadGaps(pEngineContext,pAnalysisWindows->gapList.gap,pAnalysisWindows->gapList.nGap,pTabFeno->LambdaRef,pAnalysisWindows->fitMinWavelength,pAnalysisWindows->fitMaxWavelength,indexFenoColumn)) &&
+
+             (!pTabFeno->gomeRefFlag || !(rc=FIT_PROPERTIES_alloc(__func__,&pTabFeno->fit_properties)))
+             ))) {
+         if (pTabFeno->hidden==1) {
+           pSetup->indexKurucz=NFeno;
+         } else {
+           pSetup->useUsamp+=pTabFeno->useUsamp;
+           pSetup->xsToConvolute+=pTabFeno->xsToConvolute;
+           pSetup->xsToConvoluteI0+=pTabFeno->xsToConvoluteI0;
+
+           if (pTabFeno->gomeRefFlag || pEngineContext->refFlag) {
+             memcpy(pTabFeno->Lambda,pTabFeno->LambdaRef,sizeof(double)*n_wavel);
+             memcpy(pTabFeno->LambdaK,pTabFeno->LambdaRef,sizeof(double)*n_wavel);
+
+             if (pTabFeno->LambdaRef[n_wavel-1]-pTabFeno->Lambda[0]+1!=n_wavel){
+               rc=ANALYSE_XsInterpolation(pTabFeno,pTabFeno->LambdaRef,indexFenoColumn);
+             }
+           }
+         }
+
+         ANALYSE_SetAnalysisType(indexFenoColumn);
+         if (!pTabFeno->hidden) {
+           pSetup->lambdaMin=min(pSetup->lambdaMin,pTabFeno->LambdaRef[0]);
+           pSetup->lambdaMax=max(pSetup->lambdaMax,pTabFeno->LambdaRef[n_wavel-1]);
+         }
+
+         NFeno++;
+       }
+     } // if ((pTabFeno->hidden<2) && ((THRD_id==THREAD_TYPE_ANALYSIS) || (pTabFeno->hidden==1)))
+   }  // for (indexFeno=0;(indexFeno<pSetup->numberOfWindows+1) && !rc;indexFeno++)
+
+   if (!rc)
+    pSetup->rowState[indexFenoColumn]=MEDIATE_ROW_LOADED;
+
+   // Return
+
+   return rc;
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      mediateRequestAlignAnalysisRow
+// -----------------------------------------------------------------------------
+// PURPOSE       Convolve the cross sections, run the wavelength calibration and
+//               align the reference of a detector row
+//
+// OUTPUT        imager_err : set if the calibration of the row failed; the
+//                          other rows can still be analysed
+// -----------------------------------------------------------------------------
+
+static RC mediateRequestAlignAnalysisRow(ENGINE_CONTEXT *pEngineContext,INDEX indexFenoColumn,void *responseHandle,bool *imager_err)
+ {
+   // Declarations
+
+   MEDIATE_ANALYSIS_ROWS *pSetup=&mediateAnalysisRows;
+   FENO *pTabFeno;
+   INDEX indexWindow;
+   RC rc;
+
+   // Initializations
+
+   rc=ERROR_ID_NO;
+
+   if ((pSetup->xsToConvolute && !pSetup->useKurucz) || !pKuruczOptions->fwhmFit)
+     for (indexWindow=0;(indexWindow<NFeno) && !rc;indexWindow++) {
+       pTabFeno=&TabFeno[indexFenoColumn][indexWindow];
+
+       if ((pSlitOptions->slitFunction.slitType==SLIT_TYPE_NONE) && pTabFeno->xsToConvolute)
+         rc = ERROR_SetLast(__func__, ERROR_TYPE_FATAL, ERROR_ID_CONVOLUTION);
+       else if ((pTabFeno->gomeRefFlag || pEngineContext->refFlag) &&         // test on pTabFeno->xsToConvolute done in ANALYSE_XsConvolution (molecular ring done in this function for both convolution and interpolation)
+               ((rc=ANALYSE_XsConvolution(pTabFeno,pTabFeno->LambdaRef,ANALYSIS_slitMatrix,ANALYSIS_slitParam,pSlitOptions->slitFunction.slitType,indexFenoColumn,pSlitOptions->slitFunction.slitWveDptFlag))!=0))
+         break;
+     }
+
+   if (!rc) {
+     // Allocate Kurucz buffers on Run Calibration or
+     //                            Run Analysis and wavelength calibration is different from None at least for one spectral window
+     //
+     // Apply the calibration procedure on the reference spectrum if the wavelength calibration is different from None at least for one spectral window
+
+     if ((THRD_id==THREAD_TYPE_KURUCZ) || pSetup->useKurucz) {
+       rc=KURUCZ_Alloc(&pEngineContext->project,pEngineContext->buffers.lambda,pSetup->indexKurucz,pSetup->lambdaMin,pSetup->lambdaMax,indexFenoColumn, &pSetup->hrSolar);
+
+       if (!rc && pSetup->useKurucz) {
+         rc=KURUCZ_Reference(pEngineContext->buffers.instrFunction,0,pSetup->saveFlag,1,responseHandle,indexFenoColumn);
+       }
+       // make failure of KURUCZ_Alloc on any row a fatal error? (only possible for configurations with errors/bad input files?)
+     }
+
+     if (!rc && (THRD_id!=THREAD_TYPE_KURUCZ)) {
+       rc=ANALYSE_AlignReference(pEngineContext,0,responseHandle,indexFenoColumn);
+     }
+   }
+
+   if ( (ANALYSE_swathSize > 1) && rc) {
+     // Error on one irradiance spectrum shouldn't stop the analysis of other spectra
+     ERROR_SetLast(__func__, ERROR_TYPE_WARNING, ERROR_ID_IMAGER_CALIB, 1+indexFenoColumn);
+     *imager_err = true;
+     for (indexWindow=0;indexWindow<NFeno;indexWindow++)
+       TabFeno[indexFenoColumn][indexWindow].rcKurucz=rc;
+     rc=ERROR_ID_NO;
+   }
+
+   if (!rc)
+    pSetup->rowState[indexFenoColumn]=MEDIATE_ROW_READY;
+
+   // Return
+
+   return rc;
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      mediateRequestAnalysisRowRange
+// -----------------------------------------------------------------------------
+// PURPOSE       Update the wavelength range of the analysis windows with the
+//               grid of the reference of a detector row that is not loaded yet
+//               (same grid as the one set by mediateRequestLoadAnalysisRow)
+// -----------------------------------------------------------------------------
+
+static RC mediateRequestAnalysisRowRange(ENGINE_CONTEXT *pEngineContext,INDEX indexFenoColumn)
+ {
+   // Declarations
+
+   MEDIATE_ANALYSIS_ROWS *pSetup=&mediateAnalysisRows;
+   PRJCT_INSTRUMENTAL *pInstrumental;
+   const mediate_analysis_window_t *pAnalysisWindows;                            // pointer to the current analysis window from the user interface
+   double *lambda;                                                               // grid of the reference of the current analysis window
+   int indexWindow;                                                              // browse analysis windows
+   int n_wavel,n_wavel_ref;
+   RC rc;
+
+   // Initializations
+
+   pInstrumental=&pEngineContext->project.instrumental;
+   lambda=NULL;
+   rc=ERROR_ID_NO;
+
+   // initial calibration of the row, as in mediateRequestLoadAnalysisRow
+
+   if ((pInstrumental->readOutFormat==PRJCT_INSTR_FORMAT_OMI) && strlen(pInstrumental->calibrationFile))
+    rc=OMI_GetReference(pInstrumental->omi.spectralType,pInstrumental->calibrationFile,indexFenoColumn,pEngineContext->buffers.lambda,pEngineContext->buffers.spectrum,pEngineContext->buffers.sigmaSpec,&n_wavel_ref);
+
+   n_wavel=NDET[indexFenoColumn];
+
+   if (!rc && ((lambda=MEMORY_AllocDVector(__func__,"lambda",0,n_wavel))==NULL))
+    rc=ERROR_ID_ALLOC;
+
+   for (indexWindow=0;(indexWindow<pSetup->numberOfWindows) && !rc;indexWindow++) {
+     pAnalysisWindows=&pSetup->analysisWindows[indexWindow];
+
+     memcpy(lambda,pEngineContext->buffers.lambda,sizeof(double)*n_wavel);
+
+     if (!(rc=ANALYSE_LoadRefGrid(pEngineContext,pAnalysisWindows->refOneFile,pAnalysisWindows->refTwoFile,pAnalysisWindows->kuruczMode,
+                                  pAnalysisWindows->refSpectrumSelection,pSetup->n_wavel_ref1,indexFenoColumn,lambda))) {
+       pSetup->lambdaMin=min(pSetup->lambdaMin,lambda[0]);
+       pSetup->lambdaMax=max(pSetup->lambdaMax,lambda[n_wavel-1]);
+     }
+   }
+
+   if (lambda!=NULL)
+    MEMORY_ReleaseDVector(__func__,"lambda",lambda,0);
+
+   // Return
+
+   return rc;
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      mediateRequestLazyAnalysisAllowed
+// -----------------------------------------------------------------------------
+// PURPOSE       Check if the set up of the detector rows can be delayed until
+//               their first record
+//
+// RETURN        1 if the lazy mode is requested and possible, 0 otherwise
+// -----------------------------------------------------------------------------
+
+static int mediateRequestLazyAnalysisAllowed(const ENGINE_CONTEXT *pEngineContext,int numberOfWindows,const mediate_analysis_window_t *analysisWindows)
+ {
+   int lazyFlag,indexWindow;
+
+   lazyFlag=(mediateLazyRows &&
+             (ANALYSE_swathSize>1) &&
+             (THRD_id==THREAD_TYPE_ANALYSIS) &&
+             (numberOfWindows>0) &&
+             !pEngineContext->project.asciiResults.calibFlag)?1:0;              // the calibration results of all the rows are registered before the first record
+
+   // the automatic reference is built for all the rows when a file is opened
+
+   for (indexWindow=0;(indexWindow<numberOfWindows) && lazyFlag;indexWindow++)
+    if (analysisWindows[indexWindow].refSpectrumSelection==ANLYS_REF_SELECTION_MODE_AUTOMATIC)
+     lazyFlag=0;
+
+   return lazyFlag;
+ }
+
 int mediateRequestSetAnalysisWindows(void *engineContext,
 				     int numberOfWindows,
 				     const mediate_analysis_window_t *analysisWindows,
@@ -1626,21 +2062,11 @@ int mediateRequestSetAnalysisWindows(void *engineContext,
  {
    // Declarations
 
-   double lambdaMin,lambdaMax;
-   int useKurucz,                                                               // flag set if Kurucz is to be used in at least one analysis window
-       useUsamp,                                                                // flag set if undersampling correction is requested in at least one analysis window
-       xsToConvolute,                                                           // flag set if at least one cross section has to be convolved in at least one analysis window
-       xsToConvoluteI0,                                                         // flag set if at least one cross section has to be I0-convolved in at least one analysis window
-       saveFlag;
-   INDEX indexKurucz,indexWindow;
+   MEDIATE_ANALYSIS_ROWS *pSetup;                                                // options and buffers kept to set up the detector rows
    ENGINE_CONTEXT *pEngineContext;                                               // engine context
    PRJCT_INSTRUMENTAL *pInstrumental;
-   const mediate_analysis_window_t *pAnalysisWindows;                            // pointer to the current analysis window from the user interface
-   mediate_analysis_window_t calibWindows;                                       // pointer to the calibration parameters
-   FENO *pTabFeno;                                                               // pointer to the description of an analysis window
-   int indexFeno,indexFenoColumn;                                                // browse analysis windows
-   int n_wavel_temp1, n_wavel_temp2;                                             // temporary spectral channel
-   MATRIX_OBJECT hr_solar_temp; // to preload high res solar spectrum
+   int indexFenoColumn;                                                          // browse detector rows
+   INDEX firstRow;                                                               // first detector row used
    RC rc;                                                                        // return code
 
    // Initializations
@@ -1649,34 +2075,35 @@ int mediateRequestSetAnalysisWindows(void *engineContext,
    DEBUG_Start(ENGINE_dbgFile,"mediateRequestSetAnalysisWindows",DEBUG_FCTTYPE_MEM,15,DEBUG_DVAR_YES,0);
     #endif
 
-   lambdaMin=1000;
-   lambdaMax=0;
+   mediateRequestReleaseAnalysisRows();
+
+   pSetup=&mediateAnalysisRows;
    pEngineContext=(ENGINE_CONTEXT *)engineContext;
    pInstrumental=&pEngineContext->project.instrumental;
-   saveFlag=(int)pEngineContext->project.spectra.displayDataFlag;
-   useKurucz=useUsamp=xsToConvolute=xsToConvoluteI0=0;
-   indexKurucz=ITEM_NONE;
+
+   pSetup->analysisWindows=analysisWindows;
+   pSetup->numberOfWindows=numberOfWindows;
+   pSetup->lambdaMin=1000;
+   pSetup->lambdaMax=0;
+   pSetup->saveFlag=(int)pEngineContext->project.spectra.displayDataFlag;
+   pSetup->indexKurucz=ITEM_NONE;
+   firstRow=ITEM_NONE;
 
    // for imagers, it is possible that errors occur for only some of
    // the rows.  In that case, analysis can continue for the other
    // rows, but we still want to display a warning message.
    bool imager_err = false;
 
-   memset(&calibWindows,0,sizeof(mediate_analysis_window_t));
-   memset(&hr_solar_temp, 0, sizeof(hr_solar_temp));
-
-   memcpy(&calibWindows.crossSectionList,&pEngineContext->calibFeno.crossSectionList,sizeof(cross_section_list_t));
-   memcpy(&calibWindows.linear,&pEngineContext->calibFeno.linear,sizeof(struct anlyswin_linear));
-   memcpy(&calibWindows.shiftStretchList,&pEngineContext->calibFeno.shiftStretchList,sizeof(shift_stretch_list_t));
-   memcpy(&calibWindows.outputList,&pEngineContext->calibFeno.outputList,sizeof(output_list_t));
+   memcpy(&pSetup->calibWindows.crossSectionList,&pEngineContext->calibFeno.crossSectionList,sizeof(cross_section_list_t));
+   memcpy(&pSetup->calibWindows.linear,&pEngineContext->calibFeno.linear,sizeof(struct anlyswin_linear));
+   memcpy(&pSetup->calibWindows.shiftStretchList,&pEngineContext->calibFeno.shiftStretchList,sizeof(shift_stretch_list_t));
+   memcpy(&pSetup->calibWindows.outputList,&pEngineContext->calibFeno.outputList,sizeof(output_list_t));
 
    // Reinitialize all global variables used for the analysis, release old buffers and allocate new ones
 
    KURUCZ_indexLine=1;
    rc=ANALYSE_SetInit(pEngineContext);
 
-   n_wavel_temp1 = 0;
-   n_wavel_temp2 = 0;
    // if the user wants to write output to a file, check if the path is valid before starting analysis
    if ( (THRD_id==THREAD_TYPE_ANALYSIS && pEngineContext->project.asciiResults.analysisFlag) ||
         (THRD_id==THREAD_TYPE_KURUCZ && pEngineContext->project.asciiResults.calibFlag) ) {
@@ -1692,21 +2119,21 @@ int mediateRequestSetAnalysisWindows(void *engineContext,
    case PRJCT_INSTR_FORMAT_GOME1_NETCDF:
      ANALYSE_swathSize = 4;   // the number of pixel types
      if (strlen(analysisWindows[0].refOneFile))
-       rc = GOME1NETCDF_InitRef(analysisWindows[0].refOneFile,&n_wavel_temp1,pEngineContext);
+       rc = GOME1NETCDF_InitRef(analysisWindows[0].refOneFile,&pSetup->n_wavel_ref1,pEngineContext);
      if (strlen(analysisWindows[0].refTwoFile))
-       rc = GOME1NETCDF_InitRef(analysisWindows[0].refTwoFile,&n_wavel_temp2,pEngineContext);
+       rc = GOME1NETCDF_InitRef(analysisWindows[0].refTwoFile,&pSetup->n_wavel_ref2,pEngineContext);
      break;
 // TODO: generalize for different analysis windows TROPOMI and APEX
    case PRJCT_INSTR_FORMAT_TROPOMI:
      pEngineContext->radAsRefFlag=0;
      if (strlen(analysisWindows[0].refOneFile)){
-       rc = tropomi_init(analysisWindows[0].refOneFile,pEngineContext,&n_wavel_temp1);
+       rc = tropomi_init(analysisWindows[0].refOneFile,pEngineContext,&pSetup->n_wavel_ref1);
      } else {
         rc=ERROR_SetLast(__func__,ERROR_TYPE_FATAL,ERROR_ID_FILE_AUTOMATIC);
      }
      if (strlen(analysisWindows[0].refTwoFile)){
        pEngineContext->radAsRefFlag=1;
-       rc = tropomi_init(analysisWindows[0].refTwoFile,pEngineContext,&n_wavel_temp2);
+       rc = tropomi_init(analysisWindows[0].refTwoFile,pEngineContext,&pSetup->n_wavel_ref2);
      }
      break;
    case PRJCT_INSTR_FORMAT_OMPS:
@@ -1731,187 +2158,37 @@ int mediateRequestSetAnalysisWindows(void *engineContext,
      goto handle_errors;
    }
 
-   // Load analysis windows
-
-   for (indexFenoColumn=0;(indexFenoColumn<ANALYSE_swathSize) && !rc;indexFenoColumn++) {
-
-     // check if we have to skip this column
-     if (!pEngineContext->project.instrumental.use_row[indexFenoColumn])
-       continue;
-
-     NFeno=0;
-
-     for (indexFeno=0;(indexFeno<numberOfWindows+1) && !rc;indexFeno++) {
-       // Pointers initialization
-
-       pTabFeno=&TabFeno[indexFenoColumn][NFeno];
-
-       pTabFeno->hidden=!indexFeno;
-       pAnalysisWindows=(!pTabFeno->hidden)? &analysisWindows[indexFeno-1]: &calibWindows;
-
-       pTabFeno->NDET=NDET[indexFenoColumn];
-       pTabFeno->n_wavel_ref1=n_wavel_temp1;
-       pTabFeno->n_wavel_ref2=n_wavel_temp2;
-       const int n_wavel = pTabFeno->NDET;
-
-       if ((pTabFeno->hidden<2) && ((THRD_id==THREAD_TYPE_ANALYSIS) || (pTabFeno->hidden==1))) {
-         // QDOAS : avoid the load of disabled analysis windows with hidden==2
-
-         if (pTabFeno->hidden) {                                                     // if indexFeno==0, load calibration parameters
-           strcpy(pTabFeno->windowName,"Calibration description");                   // like WinDOAS
-           pTabFeno->analysisMethod=pKuruczOptions->analysisMethod;
-         } else {                                                                    // otherwise, load analysis windows from analysisWindows[indexFeno-1]
-           // Load data from analysis windows panels
-
-           strcpy(pTabFeno->windowName,pAnalysisWindows->name);
-           strcpy(pTabFeno->residualsFile,pAnalysisWindows->residualFile);
-           strcpy(pTabFeno->ref1,pAnalysisWindows->refOneFile);
-           strcpy(pTabFeno->ref2,pAnalysisWindows->refTwoFile);
-
-           pTabFeno->resolFwhm=pAnalysisWindows->resolFwhm;
-           pTabFeno->lambda0=pAnalysisWindows->lambda0;
-
-           if (fabs(pTabFeno->lambda0)<EPSILON)
-            pTabFeno->lambda0=(double)0.5*(pAnalysisWindows->fitMinWavelength+pAnalysisWindows->fitMaxWavelength);
-
-           if ((pTabFeno->refSpectrumSelectionMode=pAnalysisWindows->refSpectrumSelection)==ANLYS_REF_SELECTION_MODE_AUTOMATIC) {
-               if (((pEngineContext->project.instrumental.readOutFormat!=PRJCT_INSTR_FORMAT_ASCII) && is_maxdoas(pEngineContext->project.instrumental.readOutFormat)) ||
-                   ((pEngineContext->project.instrumental.readOutFormat==PRJCT_INSTR_FORMAT_ASCII) && (pEngineContext->project.instrumental.ascii.elevSaveFlag || (pEngineContext->project.instrumental.ascii.format==PRJCT_INSTR_ASCII_FORMAT_COLUMN_EXTENDED)))) {
-
-             //if ((pEngineContext->project.instrumental.readOutFormat==PRJCT_INSTR_FORMAT_CCD_EEV) || (pEngineContext->project.instrumental.readOutFormat==PRJCT_INSTR_FORMAT_MFC) || (pEngineContext->project.instrumental.readOutFormat==PRJCT_INSTR_FORMAT_MFC_STD) || (pEngineContext->project.instrumental.readOutFormat==PRJCT_INSTR_FORMAT_MFC_BIRA) ||
-             //    (pEngineContext->project.instrumental.readOutFormat==PRJCT_INSTR_FORMAT_BIRA_MOBILE) || (pEngineContext->project.instrumental.readOutFormat==PRJCT_INSTR_FORMAT_BIRA_AIRBORNE) || (pEngineContext->project.instrumental.readOutFormat==PRJCT_INSTR_FORMAT_FRM4DOAS_NETCDF) ||
-             //   ((pEngineContext->project.instrumental.readOutFormat==PRJCT_INSTR_FORMAT_ASCII) && (pEngineContext->project.instrumental.ascii.elevSaveFlag || (pEngineContext->project.instrumental.ascii.format==PRJCT_INSTR_ASCII_FORMAT_COLUMN_EXTENDED)))) {
-
-               if ((pTabFeno->refMaxdoasSelectionMode=pAnalysisWindows->refMaxdoasSelection)==ANLYS_MAXDOAS_REF_SCAN)
-                 pEngineContext->analysisRef.refScan++;
-               else if (pTabFeno->refMaxdoasSelectionMode==ANLYS_MAXDOAS_REF_SZA)
-                 pEngineContext->analysisRef.refSza++;
-             }
-
-             pTabFeno->refSpectrumSelectionScanMode=pAnalysisWindows->refSpectrumSelectionScanMode;
-
-             pTabFeno->refSZA=(double)pAnalysisWindows->refSzaCenter;
-             pTabFeno->refSZADelta=(double)pAnalysisWindows->refSzaDelta;
-
-             pTabFeno->refLatMin=pAnalysisWindows->refMinLatitude;
-             pTabFeno->refLatMax=pAnalysisWindows->refMaxLatitude;
-             pTabFeno->refLonMin=pAnalysisWindows->refMinLongitude;
-             pTabFeno->refLonMax=pAnalysisWindows->refMaxLongitude;
-
-             pTabFeno->cloudFractionMin=pAnalysisWindows->cloudFractionMin;
-             pTabFeno->cloudFractionMax=pAnalysisWindows->cloudFractionMax;
-
-             pEngineContext->analysisRef.refAuto++;
-
-             if ((fabs(pTabFeno->refLonMax-pTabFeno->refLonMin)>1.e-5) ) // && (fabs(pTabFeno->refLonMax-pTabFeno->refLonMin)<359.))
-               pEngineContext->analysisRef.refLon++;
-           }
-
-           if (pEngineContext->project.spectra.displayFitFlag) {
-
-             pTabFeno->displaySpectrum=pAnalysisWindows->requireSpectrum;
-             pTabFeno->displayResidue=pAnalysisWindows->requireResidual;
-             pTabFeno->displayTrend=pAnalysisWindows->requirePolynomial;
-             pTabFeno->displayRefEtalon=pAnalysisWindows->requireRefRatio;
-             pTabFeno->displayFits=pAnalysisWindows->requireFit;
-             pTabFeno->displayPredefined=pAnalysisWindows->requirePredefined;
-
-             pTabFeno->displayFlag=pTabFeno->displaySpectrum+
-               pTabFeno->displayResidue+
-               pTabFeno->displayTrend+
-               pTabFeno->displayRefEtalon+
-               pTabFeno->displayFits+
-               pTabFeno->displayPredefined;
-           }
-
-           pTabFeno->useKurucz=pAnalysisWindows->kuruczMode;
-
-           pTabFeno->analysisMethod=pAnalysisOptions->method;
-           useKurucz+=pAnalysisWindows->kuruczMode;
-         }  // if (pTabFeno->hidden)
-
-         pTabFeno->Decomp=1;
-
-         // spikes buffer
-         if ((pTabFeno->spikes == NULL) &&
-             ((pTabFeno->spikes=(bool *)MEMORY_AllocBuffer(__func__,"spikes",n_wavel,sizeof(int),0,MEMORY_TYPE_INT))==NULL)) {
-           rc = ERROR_ID_ALLOC;
-           break;
-         }
-
-         // Wavelength scales read out
+   for (indexFenoColumn=0;(indexFenoColumn<ANALYSE_swathSize) && (firstRow==ITEM_NONE);indexFenoColumn++)
+     if (pEngineContext->project.instrumental.use_row[indexFenoColumn])
+       firstRow=indexFenoColumn;
 
-         if (((pTabFeno->Lambda==NULL) && ((pTabFeno->Lambda=MEMORY_AllocDVector(__func__,"Lambda",0,n_wavel-1))==NULL)) ||
-             ((pTabFeno->LambdaK==NULL) && ((pTabFeno->LambdaK=MEMORY_AllocDVector(__func__,"LambdaK",0,n_wavel-1))==NULL)) ||
-             ((pTabFeno->LambdaRef==NULL) && ((pTabFeno->LambdaRef=MEMORY_AllocDVector(__func__,"LambdaRef",0,n_wavel-1))==NULL)) ||
+   pSetup->lazyFlag=((firstRow!=ITEM_NONE) && mediateRequestLazyAnalysisAllowed(pEngineContext,numberOfWindows,analysisWindows))?1:0;
 
-             // omi rejected pixels
-
-             ((pEngineContext->project.instrumental.readOutFormat==PRJCT_INSTR_FORMAT_OMI) && pEngineContext->project.instrumental.omi.pixelQFRejectionFlag &&
-              (pTabFeno->omiRejPixelsQF == NULL) && ((pTabFeno->omiRejPixelsQF=(bool *)MEMORY_AllocBuffer(__func__,"omiRejPixelsQF",n_wavel,sizeof(int),0,MEMORY_TYPE_INT))==NULL))) {
-           rc=ERROR_ID_ALLOC;
-           break;
-         }
+   // in lazy mode, keep a copy of the analysis windows for the rows loaded later
 
-         if ( pInstrumental->readOutFormat==PRJCT_INSTR_FORMAT_OMI
-              && strlen(pInstrumental->calibrationFile) ) {
-           int n_wavel_ref;
-           rc=OMI_GetReference(pInstrumental->omi.spectralType,pInstrumental->calibrationFile,indexFenoColumn,pEngineContext->buffers.lambda,pEngineContext->buffers.spectrum,pEngineContext->buffers.sigmaSpec, &n_wavel_ref);
+   if (pSetup->lazyFlag) {
+     if ((pSetup->lazyWindows=(mediate_analysis_window_t *)MEMORY_AllocBuffer(__func__,"lazyWindows",numberOfWindows,sizeof(mediate_analysis_window_t),0,MEMORY_TYPE_STRUCT))==NULL) {
+       rc=ERROR_ID_ALLOC;
+       goto handle_errors;
+     }
 
-           if (rc != 0) {
-             break;
-           }
+     memcpy(pSetup->lazyWindows,analysisWindows,sizeof(mediate_analysis_window_t)*numberOfWindows);
+     pSetup->analysisWindows=pSetup->lazyWindows;
+   }
 
-         }
+   // Load analysis windows of all the rows.  In lazy mode, only the grid of the
+   // reference of the rows after the first one is read : the wavelength range of
+   // the preloaded solar spectrum is the union of the grids of the rows
 
-         memcpy(pTabFeno->LambdaRef,pEngineContext->buffers.lambda,sizeof(double)*n_wavel);
-         memcpy(pTabFeno->Lambda,pEngineContext->buffers.lambda,sizeof(double)*n_wavel);
-
-         // TODO: ANALYSE_LoadRef can change NDET[] -> should n_wavel be updated here?
-         if (!(rc=ANALYSE_LoadRef(pEngineContext,indexFenoColumn)) &&   // eventually, modify LambdaRef for continuous functions
-             !(rc=ANALYSE_LoadCross(pEngineContext,pAnalysisWindows->crossSectionList.crossSection,pAnalysisWindows->crossSectionList.nCrossSection,pTabFeno->LambdaRef,indexFenoColumn)) &&
-             !(rc=mediateRequestSetAnalysisLinear(&pAnalysisWindows->linear,indexFenoColumn)) &&
-
-             // Caro : int the future, replace structures anlyswin_nonlinear and calibration_sfp with the following one more flexible
-             //        mediateRequestSetAnalysisNonLinearDoas and mediateRequestSetAnalysisNonLinearCalib would be replaced by only one call to ANALYSE_LoadNonLinear
-
-             ((!pTabFeno->hidden && !(rc=mediateRequestSetAnalysisNonLinearDoas(pEngineContext,&pAnalysisWindows->nonlinear,pTabFeno->LambdaRef,indexFenoColumn))) ||
-              (pTabFeno->hidden && !(rc=mediateRequestSetAnalysisNonLinearCalib(pEngineContext,pEngineContext->calibFeno.sfp,pTabFeno->LambdaRef,indexFenoColumn)))) &&
-
-             !(rc=ANALYSE_LoadShiftStretch(pAnalysisWindows->shiftStretchList.shiftStretch,pAnalysisWindows->shiftStretchList.nShiftStretch,indexFenoColumn)) &&
-             !(rc=ANALYSE_LoadOutput(pAnalysisWindows->outputList.output,pAnalysisWindows->outputList.nOutput,indexFenoColumn)) &&
-             (pTabFeno->hidden ||
-              (!(rc=ANALYSE_LoadGaps(pEngineContext,pAnalysisWindows->gapList.gap,pAnalysisWindows->gapList.nGap,pTabFeno->LambdaRef,pAnalysisWindows->fitMinWavelength,pAnalysisWindows->fitMaxWavelength,indexFenoColumn)) &&
-
-               (!pTabFeno->gomeRefFlag || !(rc=FIT_PROPERTIES_alloc(__func__,&pTabFeno->fit_properties)))
-               ))) {
-           if (pTabFeno->hidden==1) {
-             indexKurucz=NFeno;
-           } else {
-             useUsamp+=pTabFeno->useUsamp;
-             xsToConvolute+=pTabFeno->xsToConvolute;
-             xsToConvoluteI0+=pTabFeno->xsToConvoluteI0;
-
-             if (pTabFeno->gomeRefFlag || pEngineContext->refFlag) {
-               memcpy(pTabFeno->Lambda,pTabFeno->LambdaRef,sizeof(double)*n_wavel);
-               memcpy(pTabFeno->LambdaK,pTabFeno->LambdaRef,sizeof(double)*n_wavel);
-
-               if (pTabFeno->LambdaRef[n_wavel-1]-pTabFeno->Lambda[0]+1!=n_wavel){
-                 rc=ANALYSE_XsInterpolation(pTabFeno,pTabFeno->LambdaRef,indexFenoColumn);
-               }
-             }
-           }
+   for (indexFenoColumn=0;(indexFenoColumn<ANALYSE_swathSize) && !rc;indexFenoColumn++) {
 
-           ANALYSE_SetAnalysisType(indexFenoColumn);
-           if (!pTabFeno->hidden) {
-             lambdaMin=min(lambdaMin,pTabFeno->LambdaRef[0]);
-             lambdaMax=max(lambdaMax,pTabFeno->LambdaRef[n_wavel-1]);
-           }
+     // check if we have to skip this column
+     if (!pEngineContext->project.instrumental.use_row[indexFenoColumn])
+       continue;
 
-           NFeno++;
-         }
-       } // if ((pTabFeno->hidden<2) && ((THRD_id==THREAD_TYPE_ANALYSIS) || (pTabFeno->hidden==1)))
-     }  // for (indexFeno=0;(indexFeno<numberOfWindows+1) && !rc;indexFeno++)
+     rc=(!pSetup->lazyFlag || (indexFenoColumn==firstRow))?
+         mediateRequestLoadAnalysisRow(pEngineContext,indexFenoColumn):
+         mediateRequestAnalysisRowRange(pEngineContext,indexFenoColumn);
    } // for (indexFenoColumn=0;(indexFenoColumn<ANALYSE_swathSize) && !rc;indexFenoColumn++)
 
    if (rc)
@@ -1923,25 +2200,39 @@ int mediateRequestSetAnalysisWindows(void *engineContext,
        max_ndet = NDET[i];
    }
 
-   if (lambdaMin>=lambdaMax) {
-     lambdaMin=pEngineContext->buffers.lambda[0];
-     lambdaMax=pEngineContext->buffers.lambda[max_ndet-1];
+   if (pSetup->lambdaMin>=pSetup->lambdaMax) {
+     pSetup->lambdaMin=pEngineContext->buffers.lambda[0];
+     pSetup->lambdaMax=pEngineContext->buffers.lambda[max_ndet-1];
+   }
+
+   // in lazy mode, keep the wavelength calibration seen by the alignment of
+   // the rows for the rows aligned later
+
+   if (pSetup->lazyFlag) {
+     pSetup->ndet=max_ndet;
+
+     if ((pSetup->lambda=MEMORY_AllocDVector(__func__,"lambda",0,max_ndet-1))==NULL) {
+       rc=ERROR_ID_ALLOC;
+       goto handle_errors;
+     }
+
+     memcpy(pSetup->lambda,pEngineContext->buffers.lambda,sizeof(double)*max_ndet);
    }
 
    // load slit function from project properties -> slit page?
    // calibration procedure with FWHM fit -> Kurucz (and xs) are convolved with the fitted slit function
    // no calibration procedure and no xs to convolve -> nothing to do with the slit function in the slit page
    // other cases:
-   if ( ( (useKurucz || THRD_id==THREAD_TYPE_KURUCZ) && !pKuruczOptions->fwhmFit) // calibration procedure but FWHM not fitted
-        || (!useKurucz  && xsToConvolute) ) {   // no calibration procedure and xs to convolve
+   if ( ( (pSetup->useKurucz || THRD_id==THREAD_TYPE_KURUCZ) && !pKuruczOptions->fwhmFit) // calibration procedure but FWHM not fitted
+        || (!pSetup->useKurucz  && pSetup->xsToConvolute) ) {   // no calibration procedure and xs to convolve
      // -> use the slit function in the slit page of project properties to convolve
      //    solar spectrum and xs
-     rc=ANALYSE_LoadSlit(pSlitOptions,useKurucz||xsToConvoluteI0);
+     rc=ANALYSE_LoadSlit(pSlitOptions,pSetup->useKurucz||pSetup->xsToConvoluteI0);
    }
    if (rc)
      goto handle_errors;
 
-   if ((THRD_id==THREAD_TYPE_KURUCZ) || useKurucz) {
+   if ((THRD_id==THREAD_TYPE_KURUCZ) || pSetup->useKurucz) {
      // pre-load multi-row Kurucz reference spectrum one time, reuse it for each indexFenoColumn in KURUCZ_Alloc
      char kurucz_file[MAX_ITEM_TEXT_LEN];
      FILES_RebuildFileName(kurucz_file,(pKuruczOptions->fwhmFit)?pKuruczOptions->file:pSlitOptions->kuruczFile,1);
@@ -1949,71 +2240,37 @@ int mediateRequestSetAnalysisWindows(void *engineContext,
      if ( !strlen(kurucz_file) ) {
        rc = ERROR_SetLast(__func__, ERROR_TYPE_FATAL, ERROR_ID_MSGBOX_FIELDEMPTY, "Solar Ref. File");
      } else {
-       rc = MATRIX_Load(kurucz_file, &hr_solar_temp, 0, 0, lambdaMin, lambdaMax, 1, 0, __func__);
+       rc = MATRIX_Load(kurucz_file, &pSetup->hrSolar, 0, 0, pSetup->lambdaMin, pSetup->lambdaMax, 1, 0, __func__);
      }
    }
 
    if (rc)
      goto handle_errors;
 
-   for (indexFenoColumn=0;(indexFenoColumn<ANALYSE_swathSize) && !rc;indexFenoColumn++) {
-
-     if (!pEngineContext->project.instrumental.use_row[indexFenoColumn])
-       continue;
-
-     if ((xsToConvolute && !useKurucz) || !pKuruczOptions->fwhmFit)
-       for (indexWindow=0;(indexWindow<NFeno) && !rc;indexWindow++) {
-         pTabFeno=&TabFeno[indexFenoColumn][indexWindow];
-
-         if ((pSlitOptions->slitFunction.slitType==SLIT_TYPE_NONE) && pTabFeno->xsToConvolute)
-           rc = ERROR_SetLast(__func__, ERROR_TYPE_FATAL, ERROR_ID_CONVOLUTION);
-         else if ((pTabFeno->gomeRefFlag || pEngineContext->refFlag) &&         // test on pTabFeno->xsToConvolute done in ANALYSE_XsConvolution (molecular ring done in this function for both convolution and interpolation)
-                 ((rc=ANALYSE_XsConvolution(pTabFeno,pTabFeno->LambdaRef,ANALYSIS_slitMatrix,ANALYSIS_slitParam,pSlitOptions->slitFunction.slitType,indexFenoColumn,pSlitOptions->slitFunction.slitWveDptFlag))!=0))
-           break;
-       }
-
-     if (!rc) {
-       // Allocate Kurucz buffers on Run Calibration or
-       //                            Run Analysis and wavelength calibration is different from None at least for one spectral window
-       //
-       // Apply the calibration procedure on the reference spectrum if the wavelength calibration is different from None at least for one spectral window
-
-       if ((THRD_id==THREAD_TYPE_KURUCZ) || useKurucz) {
-         rc=KURUCZ_Alloc(&pEngineContext->project,pEngineContext->buffers.lambda,indexKurucz,lambdaMin,lambdaMax,indexFenoColumn, &hr_solar_temp);
+   // in lazy mode, only the first row is loaded and aligned here
 
-         if (!rc && useKurucz) {
-           rc=KURUCZ_Reference(pEngineContext->buffers.instrFunction,0,saveFlag,1,responseHandle,indexFenoColumn);
-         }
-         // make failure of KURUCZ_Alloc on any row a fatal error? (only possible for configurations with errors/bad input files?)
-       }
-
-       if (!rc && (THRD_id!=THREAD_TYPE_KURUCZ)) {
-         rc=ANALYSE_AlignReference(pEngineContext,0,responseHandle,indexFenoColumn);
-       }
-     }
+   for (indexFenoColumn=0;(indexFenoColumn<ANALYSE_swathSize) && !rc;indexFenoColumn++) {
 
-     if ( (ANALYSE_swathSize > 1) && rc) {
-       // Error on one irradiance spectrum shouldn't stop the analysis of other spectra
-       ERROR_SetLast(__func__, ERROR_TYPE_WARNING, ERROR_ID_IMAGER_CALIB, 1+indexFenoColumn);
-       imager_err = true;
-       for (indexWindow=0;indexWindow<NFeno;indexWindow++)
-         TabFeno[indexFenoColumn][indexWindow].rcKurucz=rc;
-       rc=ERROR_ID_NO;
-     }
+     if (pSetup->rowState[indexFenoColumn]==MEDIATE_ROW_LOADED)
+       rc=mediateRequestAlignAnalysisRow(pEngineContext,indexFenoColumn,responseHandle,&imager_err);
    }
 
    // OMI SEE LATER
 
    if (!rc && !(rc=OUTPUT_RegisterData(pEngineContext)) &&
-       (pEngineContext->project.instrumental.readOutFormat!=PRJCT_INSTR_FORMAT_OMI) && useUsamp &&
-       !(rc=ANALYSE_UsampGlobalAlloc(lambdaMin,lambdaMax,max_ndet)) &&
+       (pEngineContext->project.instrumental.readOutFormat!=PRJCT_INSTR_FORMAT_OMI) && pSetup->useUsamp &&
+       !(rc=ANALYSE_UsampGlobalAlloc(pSetup->lambdaMin,pSetup->lambdaMax,max_ndet)) &&
        !(rc=ANALYSE_UsampLocalAlloc(1)))
     rc=ANALYSE_UsampBuild(0,1,0);   // !!! ACCOUNT FOR UNDERSAMPLING ???
 
  handle_errors:
 
 //   GEMS_CloseReferences();
-   MATRIX_Free(&hr_solar_temp, __func__);
+
+   // the solar spectrum is only needed later for the rows aligned on demand
+
+   if (rc || !pSetup->lazyFlag)
+     mediateRequestReleaseAnalysisRows();
 
    if (rc!=ERROR_ID_NO) {
      ERROR_DisplayMessage(responseHandle);
@@ -2028,6 +2285,81 @@ int mediateRequestSetAnalysisWindows(void *engineContext,
    return (rc!=ERROR_ID_NO)?-1:0;    // supposed that an error at the level of the load of projects stops the current session
  }
 
+// -----------------------------------------------------------------------------
+// FUNCTION      mediateRequestPrepareAnalysisRow
+// -----------------------------------------------------------------------------
+// PURPOSE       In lazy mode, load and align the detector row of the current
+//               record if it is not ready yet
+//
+// INPUT         indexFenoColumn : the detector row of the current record
+//
+// RETURN        ERROR_ID_NO if the row can be analysed; an error on the
+//               calibration of the row only sets rcKurucz, as for the rows
+//               set up by mediateRequestSetAnalysisWindows
+// -----------------------------------------------------------------------------
+
+static RC mediateRequestPrepareAnalysisRow(ENGINE_CONTEXT *pEngineContext,INDEX indexFenoColumn,void *responseHandle)
+ {
+   // Declarations
+
+   MEDIATE_ANALYSIS_ROWS *pSetup;
+   BUFFERS *pBuffers;
+   double *recordBuffers;                                                        // lambda, spectrum and sigmaSpec of the current record
+   bool imager_err;
+   int ndet;
+   RC rc;
+
+   // Initializations
+
+   pSetup=&mediateAnalysisRows;
+
+   if (!pSetup->lazyFlag || (indexFenoColumn<0) || (indexFenoColumn>=ANALYSE_swathSize) ||
+       !pEngineContext->project.instrumental.use_row[indexFenoColumn] ||
+       (pSetup->rowState[indexFenoColumn]==MEDIATE_ROW_READY))
+    return ERROR_ID_NO;
+
+   pBuffers=&pEngineContext->buffers;
+   ndet=pSetup->ndet;
+   imager_err=false;
+
+   // The load and the alignment of a row use the buffers of the engine context, that hold the current record
+
+   if ((recordBuffers=MEMORY_AllocDVector(__func__,"recordBuffers",0,3*ndet-1))==NULL)
+    return ERROR_ID_ALLOC;
+
+   memcpy(recordBuffers,pBuffers->lambda,sizeof(double)*ndet);
+   memcpy(recordBuffers+ndet,pBuffers->spectrum,sizeof(double)*ndet);
+   if (pBuffers->sigmaSpec!=NULL)
+    memcpy(recordBuffers+2*ndet,pBuffers->sigmaSpec,sizeof(double)*ndet);
+
+   memcpy(pBuffers->lambda,pSetup->lambda,sizeof(double)*ndet);
+
+   rc=(pSetup->rowState[indexFenoColumn]==MEDIATE_ROW_NONE)?mediateRequestLoadAnalysisRow(pEngineContext,indexFenoColumn):ERROR_ID_NO;
+
+   // same wavelength range and preloaded solar spectrum as the rows aligned by mediateRequestSetAnalysisWindows
+
+   if (!rc) {
+     memcpy(pBuffers->lambda,pSetup->lambda,sizeof(double)*ndet);
+     rc=mediateRequestAlignAnalysisRow(pEngineContext,indexFenoColumn,responseHandle,&imager_err);
+   }
+
+   // Restore the current record
+
+   memcpy(pBuffers->lambda,recordBuffers,sizeof(double)*ndet);
+   memcpy(pBuffers->spectrum,recordBuffers+ndet,sizeof(double)*ndet);
+   if (pBuffers->sigmaSpec!=NULL)
+    memcpy(pBuffers->sigmaSpec,recordBuffers+2*ndet,sizeof(double)*ndet);
+
+   MEMORY_ReleaseDVector(__func__,"recordBuffers",recordBuffers,0);
+
+   if (imager_err)
+    ERROR_DisplayMessage(responseHandle);
+
+   // Return
+
+   return rc;
+ }
+
 // ===============================================================
 // TRANSFER OF THE LIST OF SYMBOLS FROM THE MEDIATOR TO THE ENGINE
 // ===============================================================
@@ -2237,11 +2569,15 @@ int mediateRequestNextMatchingSpectrum(ENGINE_CONTEXT *pEngineContext,void *resp
 
        int indexFenoColumn=(pEngineContext->recordNumber - 1) % ANALYSE_swathSize;
 
-       for (int indexFeno=0;indexFeno<NFeno;indexFeno++)
-         if (!TabFeno[indexFenoColumn][indexFeno].hidden)
-           TabFeno[indexFenoColumn][indexFeno].rc=ERROR_ID_FILE_RECORD;             // force the output to default values
+       if (mediateRequestPrepareAnalysisRow(pEngineContext,indexFenoColumn,responseHandle)!=ERROR_ID_NO)
+         rc = ERROR_DisplayMessage(responseHandle);
+       else {
+         for (int indexFeno=0;indexFeno<NFeno;indexFeno++)
+           if (!TabFeno[indexFenoColumn][indexFeno].hidden)
+             TabFeno[indexFenoColumn][indexFeno].rc=ERROR_ID_FILE_RECORD;             // force the output to default values
 
-       OUTPUT_SaveResults(pEngineContext,indexFenoColumn);
+         OUTPUT_SaveResults(pEngineContext,indexFenoColumn);
+       }
      }
 
      // try the next record
@@ -2407,8 +2743,16 @@ int mediateRequestNextMatchingAnalyseSpectrum(void *engineContext,
     {
      mediateRequestPlotSpectra(pEngineContext,responseHandle);
 
+     // in lazy mode, set up the detector row of this record the first time
+
+     if (mediateRequestPrepareAnalysisRow(pEngineContext,pEngineContext->recordInfo.i_crosstrack,responseHandle)!=ERROR_ID_NO)
+      {
+       ERROR_DisplayMessage(responseHandle);
+       return -1;
+      }
+
      if (!pEngineContext->analysisRef.refAuto || pEngineContext->satelliteFlag || ((pEngineContext->recordInfo.rc=EngineNewRef(pEngineContext,responseHandle))==ERROR_ID_NO))
-      pEngineContext->recordInfo.rc=ANALYSE_Spectrum(pEngineContext,responseHandle);
+      pEngineContext->recordInfo.rc=ANALYSE_Spectrum(pEngineContext,&ANALYSE_context,responseHandle);
 
     if ((pEngineContext->mfcDoasisFlag || (pEngineContext->lastSavedRecord!=pEngineContext->indexRecord)) &&
         (   ((THRD_id==THREAD_TYPE_ANALYSIS) && pEngineContext->project.asciiResults.analysisFlag && (!pEngineContext->project.asciiResults.successFlag || !pEngineContext->recordInfo.rc )) // (!pEngineContext->project.asciiResults.successFlag /* || nrc */))
@@ -2419,8 +2763,10 @@ int mediateRequestNextMatchingAnalyseSpectrum(void *engineContext,
 //    if (!rc)
 //      rc=rcOutput;
 
-     if (pEngineContext->recordInfo.rc!=ERROR_ID_NO)
-      ERROR_DisplayMessage(responseHandle);
+     // the results can not be saved (output file not created or not written) : stop the analysis
+
+     if ((pEngineContext->recordInfo.rc!=ERROR_ID_NO) && (ERROR_DisplayMessage(responseHandle)==-1))
+      return -1;
     }
 
    // NB if the function returns -1, the problem is that it is not possible to process
@@ -2435,6 +2781,351 @@ int mediateRequestPrevMatchingAnalyseSpectrum(void *engineContext,
    return 0;
  }
 
+// =============================
+// CROSS-TRACK PARALLEL ANALYSIS
+// =============================
+
+// For imagers (ANALYSE_swathSize>1), analysis windows, cross sections and
+// Kurucz buffers are set up per detector row.  The records of one scanline
+// can then be fitted at the same time by several threads provided that each
+// thread works with its own copy of the engine context and its own analysis
+// context.  Records are read and results are saved by the calling thread in
+// the original order; only ANALYSE_Spectrum is executed by the workers.
+
+typedef struct _analysisWorker
+ {
+  ENGINE_CONTEXT  engineContext;                                                // snapshot of the engine context for the record to analyse
+  ANALYSE_CONTEXT analyseContext;                                               // buffers written during the fit
+  int             record;                                                       // record number loaded in the worker
+ }
+ANALYSIS_WORKER;
+
+// -----------------------------------------------------------------------------
+// FUNCTION      mediateRequestParallelAnalysisAllowed
+// -----------------------------------------------------------------------------
+// PURPOSE       Check if the records of the current file can be analysed by
+//               several threads
+//
+// RETURN        1 if the current project and file allow it, 0 otherwise
+// -----------------------------------------------------------------------------
+
+int mediateRequestParallelAnalysisAllowed(void *engineContext)
+ {
+   ENGINE_CONTEXT *pEngineContext = (ENGINE_CONTEXT *)engineContext;
+
+   return ((ANALYSE_swathSize>1) &&
+           (THRD_id==THREAD_TYPE_ANALYSIS) &&
+           (pEngineContext->project.usamp.method!=PRJCT_USAMP_AUTOMATIC) &&     // the undersampling cross sections are rebuilt in shared buffers
+           (!pEngineContext->analysisRef.refAuto || pEngineContext->satelliteFlag))?1:0;
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      mediateRequestCreateAnalysisWorker
+// -----------------------------------------------------------------------------
+// PURPOSE       Allocate the contexts used by an analysis thread
+//
+// RETURN        a handle on the new worker, NULL on allocation error
+// -----------------------------------------------------------------------------
+
+void *mediateRequestCreateAnalysisWorker(void *engineContext,void *responseHandle)
+ {
+   ANALYSIS_WORKER *pWorker;
+
+   if ((pWorker=(ANALYSIS_WORKER *)MEMORY_AllocBuffer(__func__,"pWorker",1,sizeof(ANALYSIS_WORKER),0,MEMORY_TYPE_STRUCT))!=NULL)
+    {
+     memset(pWorker,0,sizeof(ANALYSIS_WORKER));
+
+     if ((EngineCopyContext(&pWorker->engineContext,(ENGINE_CONTEXT *)engineContext)!=ERROR_ID_NO) ||
+         (ANALYSE_ContextAlloc(&pWorker->analyseContext,ANALYSE_context.ndet)!=ERROR_ID_NO))
+      {
+       mediateRequestDestroyAnalysisWorker(pWorker);
+       pWorker=NULL;
+      }
+    }
+
+   if (pWorker==NULL)
+    ERROR_DisplayMessage(responseHandle);
+
+   return (void *)pWorker;
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      mediateRequestDestroyAnalysisWorker
+// -----------------------------------------------------------------------------
+// PURPOSE       Release the contexts allocated by mediateRequestCreateAnalysisWorker
+// -----------------------------------------------------------------------------
+
+void mediateRequestDestroyAnalysisWorker(void *worker)
+ {
+   ANALYSIS_WORKER *pWorker = (ANALYSIS_WORKER *)worker;
+
+   if (pWorker!=NULL)
+    {
+     EngineReleaseContext(&pWorker->engineContext);
+     ANALYSE_ContextFree(&pWorker->analyseContext);
+     MEMORY_ReleaseBuffer(__func__,"pWorker",pWorker);
+    }
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      mediateRequestNextMatchingLoadSpectrum
+// -----------------------------------------------------------------------------
+// PURPOSE       Read the next record matching the selection criteria and keep
+//               a copy of it in a worker for a later analysis
+//
+// RETURN        the record number, 0 if no matching record is found
+// -----------------------------------------------------------------------------
+
+int mediateRequestNextMatchingLoadSpectrum(void *engineContext,void *worker,void *responseHandle)
+ {
+   ENGINE_CONTEXT *pEngineContext = (ENGINE_CONTEXT *)engineContext;
+   ANALYSIS_WORKER *pWorker = (ANALYSIS_WORKER *)worker;
+   ENGINE_CONTEXT *pWorkerContext = &pWorker->engineContext;
+
+   int rec = mediateRequestNextMatchingSpectrum(pEngineContext,responseHandle);
+
+   if (pEngineContext->project.instrumental.readOutFormat==PRJCT_INSTR_FORMAT_OMI &&
+       pEngineContext->analysisRef.refAuto)
+    while( !omi_has_automatic_reference(pEngineContext->recordInfo.i_crosstrack) && rec > 0 )
+     rec = mediateRequestNextMatchingSpectrum(pEngineContext,responseHandle);
+
+   pWorker->record=0;
+
+   if (rec > 0 && (pEngineContext->indexRecord<=pEngineContext->recordNumber))
+    {
+     mediateRequestPlotSpectra(pEngineContext,responseHandle);
+
+     // the rows are set up by the reading thread, before the workers share them
+
+     if ((mediateRequestPrepareAnalysisRow(pEngineContext,pEngineContext->recordInfo.i_crosstrack,responseHandle)!=ERROR_ID_NO) ||
+         (EngineCopyContext(pWorkerContext,pEngineContext)!=ERROR_ID_NO))
+      {
+       ERROR_DisplayMessage(responseHandle);
+       rec=-1;
+      }
+     else
+      {
+       // Fields not duplicated by EngineCopyContext but used by the analysis and the output
+
+       pWorkerContext->satelliteFlag=pEngineContext->satelliteFlag;
+       pWorkerContext->maxdoasFlag=pEngineContext->maxdoasFlag;
+       pWorkerContext->mfcDoasisFlag=pEngineContext->mfcDoasisFlag;
+       pWorkerContext->n_alongtrack=pEngineContext->n_alongtrack;
+       pWorkerContext->n_crosstrack=pEngineContext->n_crosstrack;
+       pWorkerContext->refFlag=pEngineContext->refFlag;
+       pWorkerContext->radAsRefFlag=pEngineContext->radAsRefFlag;
+       pWorkerContext->outputPath=pEngineContext->outputPath;
+
+       pWorker->record=rec;
+      }
+    }
+
+   return rec;
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      mediateRequestAnalysisWorkerRow
+// -----------------------------------------------------------------------------
+// RETURN        the detector row of the record loaded in the worker
+// -----------------------------------------------------------------------------
+
+int mediateRequestAnalysisWorkerRow(void *worker)
+ {
+   return ((ANALYSIS_WORKER *)worker)->engineContext.recordInfo.i_crosstrack;
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      mediateRequestAnalyseWorkerSpectrum
+// -----------------------------------------------------------------------------
+// PURPOSE       Analyse the record loaded in a worker
+//
+// NB            can be called from any thread; workers analysing records at
+//               the same time should hold different detector rows.
+// -----------------------------------------------------------------------------
+
+void mediateRequestAnalyseWorkerSpectrum(void *worker,void *responseHandle)
+ {
+   ANALYSIS_WORKER *pWorker = (ANALYSIS_WORKER *)worker;
+   ENGINE_CONTEXT *pWorkerContext = &pWorker->engineContext;
+
+   if (pWorker->record>0)
+    {
+     pWorkerContext->recordInfo.rc=ANALYSE_Spectrum(pWorkerContext,&pWorker->analyseContext,responseHandle);
+
+     if (pWorkerContext->recordInfo.rc!=ERROR_ID_NO)
+      ERROR_DisplayMessage(responseHandle);
+    }
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      mediateRequestSaveWorkerResults
+// -----------------------------------------------------------------------------
+// PURPOSE       Save the results of the record analysed by a worker
+//
+// NB            should be called by the thread that reads the records, in the
+//               order the records have been read.
+//
+// RETURN        the record number, -1 if the results could not be saved or if
+//               the next records can not be processed
+// -----------------------------------------------------------------------------
+
+int mediateRequestSaveWorkerResults(void *engineContext,void *worker,void *responseHandle)
+ {
+   ENGINE_CONTEXT *pEngineContext = (ENGINE_CONTEXT *)engineContext;
+   ANALYSIS_WORKER *pWorker = (ANALYSIS_WORKER *)worker;
+   ENGINE_CONTEXT *pWorkerContext = &pWorker->engineContext;
+   RC rc;
+
+   if (pWorker->record<=0)
+    return pWorker->record;
+
+   pWorkerContext->lastSavedRecord=pEngineContext->lastSavedRecord;
+
+   if ((pWorkerContext->mfcDoasisFlag || (pWorkerContext->lastSavedRecord!=pWorkerContext->indexRecord)) &&
+        pWorkerContext->project.asciiResults.analysisFlag &&
+       (!pWorkerContext->project.asciiResults.successFlag || !pWorkerContext->recordInfo.rc))
+    {
+     rc=OUTPUT_SaveResults(pWorkerContext,pWorkerContext->recordInfo.i_crosstrack);
+     pEngineContext->lastSavedRecord=pWorkerContext->lastSavedRecord;
+
+     if (rc!=ERROR_ID_NO)
+      {
+       pWorkerContext->recordInfo.rc=rc;
+
+       if (ERROR_DisplayMessage(responseHandle)==-1)
+        return -1;
+      }
+    }
+
+   return ((pWorkerContext->recordInfo.rc != ERROR_ID_REF_ALIGNMENT) || pWorkerContext->analysisRef.refScan) ? pWorker->record : -1;
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      mediateRequestSetCacheDirectory
+// -----------------------------------------------------------------------------
+// PURPOSE       Select the directory where convolved cross sections and
+//               geolocation indexes of reference orbits are kept from one run
+//               to the other (NULL or empty to disable the cache)
+// -----------------------------------------------------------------------------
+
+void mediateRequestSetCacheDirectory(const char *directory)
+ {
+   XSCACHE_SetDirectory(directory);
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      mediateRequestSetCalibrationThreads
+// -----------------------------------------------------------------------------
+// PURPOSE       Set the number of threads used to fit the sub-windows of the
+//               wavelength calibration (1 to fit them one after the other)
+// -----------------------------------------------------------------------------
+
+void mediateRequestSetCalibrationThreads(int threadsNumber)
+ {
+   KURUCZ_SetThreadsNumber(threadsNumber);
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      mediateRequestSetReferenceThreads
+// -----------------------------------------------------------------------------
+// PURPOSE       Set the number of threads used to build the automatic
+//               earthshine reference of TROPOMI
+// -----------------------------------------------------------------------------
+
+void mediateRequestSetReferenceThreads(int threadsNumber)
+ {
+   tropomi_set_reference_threads(threadsNumber);
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      mediateRequestSetOutputStreaming
+// -----------------------------------------------------------------------------
+// PURPOSE       Set the number of records kept in memory by the netCDF output
+//               (0 to write all results at the end of each file)
+// -----------------------------------------------------------------------------
+
+void mediateRequestSetOutputStreaming(int recordsNumber)
+ {
+   OUTPUT_SetStreamRecords(recordsNumber);
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      mediateRequestSetOutputStaging
+// -----------------------------------------------------------------------------
+// PURPOSE       Write the output files to temporary files renamed by
+//               mediateRequestCommitOutputStaging (worker processes of
+//               doas_cl -p)
+// -----------------------------------------------------------------------------
+
+void mediateRequestSetOutputStaging(int stagingFlag)
+ {
+   OUTPUT_SetStaging(stagingFlag);
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      mediateRequestCommitOutputStaging
+// -----------------------------------------------------------------------------
+// PURPOSE       Rename the temporary output files to the output files
+//               (successFlag=1) or remove them (successFlag=0)
+//
+// RETURN        -1 if a temporary file can not be renamed, 0 otherwise
+// -----------------------------------------------------------------------------
+
+int mediateRequestCommitOutputStaging(int successFlag)
+ {
+   return (OUTPUT_CommitStaging(successFlag)!=ERROR_ID_NO)?-1:0;
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      mediateRequestSetLazyRows
+// -----------------------------------------------------------------------------
+// PURPOSE       Align the detector rows of imagers the first time one of their
+//               records is analysed instead of aligning all rows before the
+//               first record (0 by default)
+// -----------------------------------------------------------------------------
+
+void mediateRequestSetLazyRows(int lazyFlag)
+ {
+   mediateLazyRows=lazyFlag;
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      mediateRequestSetTiming
+// -----------------------------------------------------------------------------
+// PURPOSE       Enable the timing of the main stages of the processing and select
+//               the format of the summary (TIMING_FORMAT_NONE to disable it)
+// -----------------------------------------------------------------------------
+
+void mediateRequestSetTiming(int format)
+ {
+   TIMING_SetFormat(format);
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      mediateRequestSetMemorySampling
+// -----------------------------------------------------------------------------
+// PURPOSE       Register only one allocation out of samplingRate in the stack of
+//               allocated buffers (debug builds)
+// -----------------------------------------------------------------------------
+
+void mediateRequestSetMemorySampling(int samplingRate)
+ {
+   MEMORY_SetSampling(samplingRate);
+ }
+
+// -----------------------------------------------------------------------------
+// FUNCTION      mediateRequestPrintTiming
+// -----------------------------------------------------------------------------
+// PURPOSE       Print the time spent in the main stages of the processing on the
+//               standard output (nothing if the timing is disabled)
+// -----------------------------------------------------------------------------
+
+void mediateRequestPrintTiming(void)
+ {
+   if (TIMING_GetFormat()!=TIMING_FORMAT_NONE)
+    TIMING_Print(stdout,TIMING_GetFormat());
+ }
+
 int mediateRequestBeginCalibrateSpectra(void *engineContext,
 					const char *spectraFileName,
 					void *responseHandle)
@@ -2462,7 +3153,7 @@ int mediateRequestNextMatchingCalibrateSpectrum(void *engineContext,
     {
      mediateRequestPlotSpectra(pEngineContext,responseHandle);
 
-     if ((rc = ANALYSE_Spectrum(pEngineContext,responseHandle))!=ERROR_ID_NO)
+     if ((rc = ANALYSE_Spectrum(pEngineContext,&ANALYSE_context,responseHandle))!=ERROR_ID_NO)
       ERROR_DisplayMessage(responseHandle);
     }
 
@@ -18,9 +18,13 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 */
 
 #include <string.h>
+#include <strings.h>
 
 #include "mediate_project.h"
 #include "constants.h"
+#include "doas.h"
+#include "output.h"
+#include "scia-read.h"
 
 // ==========================================================
 // INITIALIZATIONS OF NON-ZERO VALUES AND float/DOUBLE FIELDS
@@ -156,6 +160,8 @@ void initializeMediateProjectOutput(mediate_project_output_t *d)
   // non-zero defaults:
   strcpy(d->swath_name, OUTPUT_HDF5_DEFAULT_GROUP);
 
+  d->compressionLevel=OUTPUT_COMPRESSION_DEFAULT;
+  d->shuffleFlag=1;
   d->successFlag=1;
   d->bandWidth=1.;
 }
@@ -187,3 +193,28 @@ void initializeMediateProject(mediate_project_t *d, const char *config_file, con
   initializeMediateProjectOutput(&(d->output));
   initializeMediateProjectExport(&(d->export_spectra));
 }
+
+// Analysis results are written in a file named after the spectra file when the
+// output file name is 'automatic' (cfr OutputBuildFileName in output.c).
+// siteFound should be 1 if the observation site of the project is registered.
+
+int mediateProjectOutputPerSpectraFile(const mediate_project_t *d, int siteFound)
+{
+  return OUTPUT_FileNamePerSpectraFile(d->instrumental.format, d->output.path, d->selection.geo.mode,
+                                       d->selection.geo.sites.radius, d->output.filenameFlag, siteFound);
+}
+
+// Name of the output file of a spectra file when mediateProjectOutputPerSpectraFile
+// is true, without path and extension.  The date in the name of SCIAMACHY PDS
+// output files is only known after the analysis, so these files are identified
+// by their orbit : spectra files with the same output file have the same name.
+
+void mediateProjectOutputFileName(const mediate_project_t *d, const char *spectraFileName, char *outputName)
+{
+  int orbitNumber = ITEM_NONE;
+
+  if (d->instrumental.format == PRJCT_INSTR_FORMAT_SCIA_PDS)
+    SCIA_GetOrbitNumber(spectraFileName, &orbitNumber);
+
+  OUTPUT_SpectraFileOutputName(d->instrumental.format, spectraFileName, orbitNumber, 0, 0, 0, outputName);
+}
@@ -472,6 +472,9 @@ extern "C" {
     int configurationFlag;
     enum output_format file_format;
     char swath_name[HDFEOS_OBJ_LEN_MAX];  // for HDF-EOS5 output
+    enum output_chunking chunking;        // chunk layout (netCDF and HDF-EOS5 output)
+    int compressionLevel;                 // deflate level, 0 for no compression, OUTPUT_COMPRESSION_DEFAULT for the default of the output format
+    int shuffleFlag;                      // shuffle filter before compression (default)
     int directoryFlag;
     int filenameFlag;
     int successFlag;      // write only successful records (default)
@@ -531,6 +534,9 @@ extern "C" {
   void initializeMediateProjectSlit(mediate_project_slit_t *d);
   void initializeMediateProjectOutput(mediate_project_output_t *d);
 
+  int mediateProjectOutputPerSpectraFile(const mediate_project_t *d, int siteFound);
+  void mediateProjectOutputFileName(const mediate_project_t *d, const char *spectraFileName, char *outputName);
+
 #if defined(_cplusplus) || defined(__cplusplus)
 }
 #endif
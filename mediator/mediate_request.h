@@ -288,6 +288,132 @@ int mediateRequestNextMatchingAnalyseSpectrum(void *engineContext, void *respons
 
 int mediateRequestPrevMatchingAnalyseSpectrum(void *engineContext, void *responseHandle);
 
+//----------------------------------------------------------
+// Cross-track parallel analysis interface
+//----------------------------------------------------------
+
+// For imager formats, the records of one scanline (one record per detector row) can be
+// analysed by several threads. A worker holds a copy of the engine context for one record.
+//
+// mediateRequestParallelAnalysisAllowed returns 1 if the current project and spectra file
+// allow the records to be analysed by workers, 0 otherwise (the records should then be
+// processed with mediateRequestNextMatchingAnalyseSpectrum).
+//
+// mediateRequestNextMatchingLoadSpectrum reads the next matching record (same return values
+// as mediateRequestNextMatchingAnalyseSpectrum) and copies it into the worker;
+// mediateRequestAnalysisWorkerRow returns the detector row of that record.
+//
+// mediateRequestAnalyseWorkerSpectrum can be called from any thread, as long as the workers
+// analysed at the same time hold different detector rows.
+//
+// mediateRequestSaveWorkerResults saves the results of a worker in the output file. It
+// should be called by the thread that reads the records, in the order of the records. It
+// returns the record number, or -1 if the results could not be saved or if the next records
+// can not be processed.
+
+int   mediateRequestParallelAnalysisAllowed(void *engineContext);
+void *mediateRequestCreateAnalysisWorker(void *engineContext, void *responseHandle);
+void  mediateRequestDestroyAnalysisWorker(void *worker);
+int   mediateRequestNextMatchingLoadSpectrum(void *engineContext, void *worker, void *responseHandle);
+int   mediateRequestAnalysisWorkerRow(void *worker);
+void  mediateRequestAnalyseWorkerSpectrum(void *worker, void *responseHandle);
+int   mediateRequestSaveWorkerResults(void *engineContext, void *worker, void *responseHandle);
+
+//----------------------------------------------------------
+// Convolution cache interface
+//----------------------------------------------------------
+
+// mediateRequestSetCacheDirectory selects the directory where the cross sections convolved
+// with the slit function of the project properties are saved, so that the next runs can load
+// them instead of convolving them again. The geolocation indexes of the OMI, GOME-2 and GOME
+// netCDF orbit files used for the automatic reference are kept in the same directory. NULL or an empty
+// string disables the cache.
+
+void  mediateRequestSetCacheDirectory(const char *directory);
+
+//----------------------------------------------------------
+// Calibration threads interface
+//----------------------------------------------------------
+
+// mediateRequestSetCalibrationThreads sets the number of threads used to fit the sub-windows
+// of the wavelength calibration (Kurucz). With 1 (the default), the sub-windows are fitted one
+// after the other, each one from the initial values left by the previous one. With more threads,
+// every sub-window is fitted from the same initial state, so the results do not depend on the
+// number of threads but may differ slightly from the serial fit. KURUCZ_Spectrum may then be
+// called at the same time by the threads analysing the detector rows.
+
+void  mediateRequestSetCalibrationThreads(int threadsNumber);
+
+// mediateRequestSetReferenceThreads sets the number of threads used to sum the spectra of
+// the automatic earthshine reference (TROPOMI). The orbit files are still read one at a time.
+
+void  mediateRequestSetReferenceThreads(int threadsNumber);
+
+//----------------------------------------------------------
+// Output streaming interface
+//----------------------------------------------------------
+
+// mediateRequestSetOutputStreaming sets the number of records kept in memory by the netCDF
+// output. Each time this number is reached, the results of the completed scanlines are
+// written to the output file, so that the memory used does not grow with the size of the
+// file and the results already written are kept if the processing is interrupted. 0 keeps
+// all results of a file in memory until the end of the file (default).
+
+void  mediateRequestSetOutputStreaming(int recordsNumber);
+
+// mediateRequestSetOutputStaging writes the output files to temporary files ("<output
+// file>.part") when stagingFlag is 1. It is used by the worker processes of doas_cl -p, so
+// that a job started again after a failure does not write its results on top of the partial
+// output of the failed attempt. mediateRequestCommitOutputStaging renames the temporary files
+// to the output files when successFlag is 1, or removes them and leaves the output files
+// unchanged when it is 0; it returns -1 if a temporary file can not be renamed.
+
+void  mediateRequestSetOutputStaging(int stagingFlag);
+int   mediateRequestCommitOutputStaging(int successFlag);
+
+//----------------------------------------------------------
+// Lazy set up of the detector rows
+//----------------------------------------------------------
+
+// mediateRequestSetLazyRows selects when the analysis windows of the detector rows of imagers
+// are set up (reference and cross sections on the grid of the row, convolution, wavelength
+// calibration, alignment of the reference). With 0 (default), all rows selected by the track
+// selection are set up by mediateRequestSetAnalysisWindows. With 1, only the first of them is
+// set up there; for the other rows, only the wavelength grid of the reference is read, to get
+// the same wavelength range of the solar spectrum as by default. These rows are set up the
+// first time one of their records is analysed, so that only the rows actually analysed cost
+// the load and the alignment. The results are the same in both modes. The automatic reference
+// and the output of the calibration results need all the rows: with these options, all rows
+// are set up as usual.
+
+void  mediateRequestSetLazyRows(int lazyFlag);
+
+//----------------------------------------------------------
+// Timing interface
+//----------------------------------------------------------
+
+// mediateRequestSetTiming enables the timing of the main stages of the processing (reading
+// of the records, analysis, non linear fit, fitting function, wavelength calibration,
+// convolution and output). format is one of the TIMING_FORMAT_... values of timing.h;
+// TIMING_FORMAT_NONE disables the timing (default).
+
+void  mediateRequestSetTiming(int format);
+
+// mediateRequestPrintTiming prints the number of calls and the time spent in each stage,
+// summed over all analysis threads, on the standard output.
+
+void  mediateRequestPrintTiming(void);
+
+//----------------------------------------------------------
+// Memory control interface
+//----------------------------------------------------------
+
+// mediateRequestSetMemorySampling registers only one allocation out of samplingRate of each
+// thread in the stack used to check the allocations and releases of the buffers (debug
+// builds only), so that leaks are tracked at a lower cost. 1 registers all of them (default).
+
+void  mediateRequestSetMemorySampling(int samplingRate);
+
 //----------------------------------------------------------
 // Calibrate Interface
 //----------------------------------------------------------
@@ -461,11 +461,11 @@ RC mediateConvolutionCalculate(void *engineContext,void *responseHandle)
         break;
      // ----------------------------------------------------------------------
         case CONVOLUTION_TYPE_STANDARD :
-         rc=XSCONV_TypeStandard(pXsnew,0,pXsnew->nl,&XSCONV_xshr,&XSCONV_xshr,NULL,slitType,XSCONV_slitMatrix,slitParam,pSlitConv->slitWveDptFlag);
+         rc=XSCONV_TypeStandard(pXsnew,0,pXsnew->nl,&XSCONV_xshr,&XSCONV_xshr,NULL,slitType,XSCONV_slitMatrix,slitParam,pSlitConv->slitWveDptFlag,NULL);
          break;
      // ----------------------------------------------------------------------
         case CONVOLUTION_TYPE_I0_CORRECTION :
-          rc=XSCONV_TypeI0Correction(pXsnew,&XSCONV_xshr,&XSCONV_kurucz,pEngineContext->conc,slitType,XSCONV_slitMatrix,slitParam,pSlitConv->slitWveDptFlag);
+          rc=XSCONV_TypeI0Correction(pXsnew,&XSCONV_xshr,&XSCONV_kurucz,pEngineContext->conc,slitType,XSCONV_slitMatrix,slitParam,pSlitConv->slitWveDptFlag,NULL);
         break;
      // ----------------------------------------------------------------------
      }
@@ -1024,7 +1024,7 @@ RC mediateRingCalculate(void *engineContext,void *responseHandle)
 
      	// Start convolving the solar spectrum
 
-      if (((slitType!=SLIT_TYPE_NONE) && ((rc=XSCONV_TypeStandard(&xsSolarConv,0,xsSolarConv.nl,&xsSolar,&xsSolar,NULL,slitType,xsSlit,slitParam,pEngineContext->slitConv.slitWveDptFlag))!=ERROR_ID_NO)) ||
+      if (((slitType!=SLIT_TYPE_NONE) && ((rc=XSCONV_TypeStandard(&xsSolarConv,0,xsSolarConv.nl,&xsSolar,&xsSolar,NULL,slitType,xsSlit,slitParam,pEngineContext->slitConv.slitWveDptFlag,NULL))!=ERROR_ID_NO)) ||
           ((rc=SPLINE_Deriv2(solarLambda,solarVector,solarDeriv2,nsolar,"mediateRingCalculate"))!=0) ||
           ((rc=raman_convolution(solarLambda,solarVector,solarDeriv2,raman,nsolar,temp,pEngineContext->normalizeFlag))!=0))
        goto EndRing;
@@ -1865,6 +1865,28 @@ bool CProjectOutputSubHandler::start(const QXmlAttributes &atts)
       m_output->file_format = format;
   }
 
+  str = atts.value("chunks");
+  if (!str.isEmpty()) {
+    enum output_chunking chunking = output_get_chunking(str.toLocal8Bit().data());
+    if (chunking != -1)
+      m_output->chunking = chunking;
+  }
+
+  str = atts.value("compression");
+  if (str.isEmpty())
+   m_output->compressionLevel = OUTPUT_COMPRESSION_DEFAULT;
+  else {
+    m_output->compressionLevel = str.toInt();
+    if (m_output->compressionLevel < OUTPUT_COMPRESSION_DEFAULT || m_output->compressionLevel > 9)
+      return postErrorMessage("Output compression level should be in the range 0-9 (-1 for the default)");
+  }
+
+  str = atts.value("shuffle");
+  if (str.isEmpty())
+   m_output->shuffleFlag=1;
+  else
+   m_output->shuffleFlag = (str == "true") ? 1 : 0;
+
   return true;
 }
 
@@ -1111,7 +1111,7 @@ void CQdoasConfigWriter::writePropertiesOutput(FILE *fp, const mediate_project_o
 {
   QString tmpStr = CPathMgr::instance()->simplifyPath(QString(d->path));
                                                                  // newcalib=\"%s\"
-  fprintf(fp, "    <output path=\"%s\" anlys=\"%s\" calib=\"%s\" ref=\"%s\" conf=\"%s\" dirs=\"%s\" file=\"%s\" success=\"%s\" flux=\"%s\" cic=\" \" bandWidth=\"%f\" swathName=\"%s\" fileFormat=\"%s\">\n",
+  fprintf(fp, "    <output path=\"%s\" anlys=\"%s\" calib=\"%s\" ref=\"%s\" conf=\"%s\" dirs=\"%s\" file=\"%s\" success=\"%s\" flux=\"%s\" cic=\" \" bandWidth=\"%f\" swathName=\"%s\" fileFormat=\"%s\" chunks=\"%s\" compression=\"%d\" shuffle=\"%s\">\n",
           tmpStr.toUtf8().constData(), (d->analysisFlag ? sTrue : sFalse),
           (d->calibrationFlag ? sTrue : sFalse),
           // (d->newcalibFlag ? sTrue : sFalse),
@@ -1122,7 +1122,10 @@ void CQdoasConfigWriter::writePropertiesOutput(FILE *fp, const mediate_project_o
           (d->successFlag ? sTrue : sFalse),
           d->flux, d->bandWidth,
           d->swath_name,
-          output_file_extensions[d->file_format]);
+          output_file_extensions[d->file_format],
+          output_chunking_names[d->chunking],
+          d->compressionLevel,
+          (d->shuffleFlag ? sTrue : sFalse));
 
   writeDataSelectList(fp, &(d->selection));
 
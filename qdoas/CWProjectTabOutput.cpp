@@ -80,10 +80,29 @@ CWProjectTabOutput::CWProjectTabOutput(const mediate_project_output_t *propertie
   outputFileLayout->addLayout(pathLayout, 0);
   outputFileLayout->addWidget(groupFrame);
 
+  // chunk layout and compression of the variables
+  m_chunkingCombo = new QComboBox(groupFrame);
+  m_chunkingCombo->addItem("Default", QVariant(OUTPUT_CHUNKS_DEFAULT));
+  m_chunkingCombo->addItem("Scanlines", QVariant(OUTPUT_CHUNKS_SCANLINES));
+  m_chunkingCombo->addItem("Orbit", QVariant(OUTPUT_CHUNKS_ORBIT));
+  m_chunkingCombo->setToolTip("Scanlines: for reading a few scanlines at a time\nOrbit: for reading variables across the whole orbit");
+
+  m_compressionSpin = new QSpinBox(groupFrame);
+  m_compressionSpin->setRange(OUTPUT_COMPRESSION_DEFAULT, 9);
+  m_compressionSpin->setSpecialValueText("Default");
+  m_compressionSpin->setToolTip("Deflate level, 0 for no compression");
+
+  m_shuffleCheck = new QCheckBox("Shuffle", groupFrame);
+
   QHBoxLayout *swathLayout = new QHBoxLayout(groupFrame);
   swathLayout->setContentsMargins(0, 0, 0, 0);
   swathLayout->addWidget(new QLabel("HDF5 group name", groupFrame),0);
   swathLayout->addWidget(m_groupNameEdit, 1);
+  swathLayout->addWidget(new QLabel("Chunks", groupFrame),0);
+  swathLayout->addWidget(m_chunkingCombo, 0);
+  swathLayout->addWidget(new QLabel("Compression", groupFrame),0);
+  swathLayout->addWidget(m_compressionSpin, 0);
+  swathLayout->addWidget(m_shuffleCheck, 0);
 
   mainLayout->addWidget(m_pathFrame);
   mainLayout->addSpacing(5);
@@ -145,6 +164,12 @@ CWProjectTabOutput::CWProjectTabOutput(const mediate_project_output_t *propertie
 
   m_groupNameEdit->setText(properties->swath_name);
 
+  int index = m_chunkingCombo->findData(QVariant(properties->chunking));
+  if (index != -1)
+    m_chunkingCombo->setCurrentIndex(index);
+  m_compressionSpin->setValue(properties->compressionLevel);
+  m_shuffleCheck->setCheckState(properties->shuffleFlag ? Qt::Checked : Qt::Unchecked);
+
   m_selectFileFormat->setCurrentIndex(properties->file_format);
   // swath frame is hidden unless HDF5 output is selected
   groupFrame->setVisible(properties->file_format == HDFEOS5 || properties->file_format == NETCDF);
@@ -198,6 +223,10 @@ void CWProjectTabOutput::apply(mediate_project_output_t *properties) const
          ? m_groupNameEdit->text().toLocal8Bit().data()
          : "QDOAS results");
 
+  properties->chunking = static_cast<enum output_chunking>(m_chunkingCombo->itemData(m_chunkingCombo->currentIndex()).toInt());
+  properties->compressionLevel = m_compressionSpin->value();
+  properties->shuffleFlag = (m_shuffleCheck->checkState() == Qt::Checked) ? 1 : 0;
+
   m_selector->apply(&(properties->selection));
 }
 
@@ -26,6 +26,7 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <QCheckBox>
 #include <QGroupBox>
 #include <QComboBox>
+#include <QSpinBox>
 #include <QListWidget>
 #include <QListWidgetItem>
 
@@ -65,6 +66,9 @@ Q_OBJECT
   QLineEdit *m_fluxEdit, *m_bandWidthEdit;
   QComboBox *m_selectFileFormat;
   QLineEdit *m_groupNameEdit;
+  QComboBox *m_chunkingCombo;
+  QSpinBox *m_compressionSpin;
+  QCheckBox *m_shuffleCheck;
   CWOutputSelector *m_selector;
 };
 